@@ -8,6 +8,7 @@
 #include "configmanager.h"
 #include "container.h"
 #include "game.h"
+#include "iologindata.h"
 #include "pugicast.h"
 #include "spells.h"
 #include <fmt/format.h>
@@ -347,6 +348,13 @@ ReturnValue Actions::internalUseItem(Player* player, const Position& pos, uint8_
 
 		//depot container
 		if (DepotLocker* depot = container->getDepotLocker()) {
+			// the depot chests are fetched on the first open, it opens once they are there
+			if (!player->isLockerLoaded()) {
+				IOLoginData::loadLockerAsync(player);
+				player->sendCancelMessage("Your depot is being loaded, please try again in a moment.");
+				return RETURNVALUE_NOERROR;
+			}
+
 			DepotLocker* myDepotLocker = player->getDepotLocker(depot->getDepotId());
 			myDepotLocker->setParent(depot->getParent()->getTile());
 			openContainer = myDepotLocker;
@@ -567,8 +575,7 @@ bool Action::executeUse(Player* player, Item* item, const Position& fromPosition
 
 	scriptInterface->pushFunction(scriptId);
 
-	LuaScriptInterface::pushUserdata<Player>(L, player);
-	LuaScriptInterface::setMetatable(L, -1, "Player");
+	LuaScriptInterface::pushCreature(L, player);
 
 	LuaScriptInterface::pushThing(L, item);
 	LuaScriptInterface::pushPosition(L, fromPosition);
@@ -0,0 +1,128 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#include "otpch.h"
+
+#include "assetcache.h"
+#include "configmanager.h"
+
+#include <boost/filesystem.hpp>
+
+extern ConfigManager g_config;
+
+namespace {
+
+constexpr OTB::Identifier CACHE_IDENTIFIER = {{'T', 'F', 'S', 'C'}};
+
+constexpr uint64_t FNV_PRIME = 1099511628211ULL;
+
+struct CacheHeader {
+	OTB::Identifier identifier;
+	uint64_t sourceHash;
+	uint64_t contentSize;
+};
+
+}
+
+std::string AssetCache::getPath(const std::string& name)
+{
+	namespace fs = boost::filesystem;
+
+	const std::string& directory = g_config.getString(ConfigManager::ASSET_CACHE_PATH);
+	if (directory.empty()) {
+		return {};
+	}
+
+	boost::system::error_code error;
+	fs::create_directories(directory, error);
+	if (error) {
+		std::cout << "[Warning - AssetCache::getPath] Cannot create " << directory << ", the data files are parsed." << std::endl;
+		return {};
+	}
+	return (fs::path(directory) / (name + ".bin")).string();
+}
+
+bool AssetCache::hashFile(const std::string& path, uint64_t& hash)
+{
+	FILE* source = fopen(path.c_str(), "rb");
+	if (!source) {
+		return false;
+	}
+
+	// fnv-1a
+	char buffer[65536];
+	size_t length;
+	while ((length = fread(buffer, 1, sizeof(buffer), source)) != 0) {
+		for (size_t i = 0; i < length; ++i) {
+			hash = (hash ^ static_cast<uint8_t>(buffer[i])) * FNV_PRIME;
+		}
+	}
+
+	bool success = ferror(source) == 0;
+	fclose(source);
+	return success;
+}
+
+bool AssetCache::write(const std::string& path, uint64_t sourceHash, const PropWriteStream& content)
+{
+	size_t contentSize;
+	const char* contentData = content.getStream(contentSize);
+
+	CacheHeader header;
+	header.identifier = CACHE_IDENTIFIER;
+	header.sourceHash = sourceHash;
+	header.contentSize = contentSize;
+
+	// a cache that was cut short is never renamed over the last good one
+	std::string tmpPath = path + ".tmp";
+	FILE* cache = fopen(tmpPath.c_str(), "wb");
+	if (!cache) {
+		std::cout << "[Warning - AssetCache::write] Cannot open " << tmpPath << '.' << std::endl;
+		return false;
+	}
+
+	bool success = fwrite(&header, sizeof(header), 1, cache) == 1 && (contentSize == 0 || fwrite(contentData, contentSize, 1, cache) == 1);
+	success = fclose(cache) == 0 && success;
+	if (!success) {
+		std::cout << "[Warning - AssetCache::write] Cannot write " << tmpPath << '.' << std::endl;
+		std::remove(tmpPath.c_str());
+		return false;
+	}
+
+	if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+		std::remove(path.c_str());
+		if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+			std::remove(tmpPath.c_str());
+			return false;
+		}
+	}
+	return true;
+}
+
+bool AssetCache::open(const std::string& path, uint64_t sourceHash)
+{
+	boost::system::error_code error;
+	if (!boost::filesystem::exists(path, error)) {
+		return false;
+	}
+
+	try {
+		file.open(path);
+	} catch (const std::exception&) {
+		return false;
+	}
+
+	CacheHeader header;
+	if (!file.is_open() || file.size() < sizeof(header)) {
+		return false;
+	}
+
+	memcpy(&header, file.data(), sizeof(header));
+	if (header.identifier != CACHE_IDENTIFIER || header.sourceHash != sourceHash || header.contentSize != file.size() - sizeof(header)) {
+		file.close();
+		return false;
+	}
+
+	stream.init(file.data() + sizeof(header), header.contentSize);
+	return true;
+}
@@ -0,0 +1,41 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#ifndef FS_ASSETCACHE_H_6B1C05A682A74958B02CCD81F971096A
+#define FS_ASSETCACHE_H_6B1C05A682A74958B02CCD81F971096A
+
+#include "fileloader.h"
+
+// Compiled form of a data file, written by its loader after parsing and
+// mapped on the next start instead of parsing again. The header holds a hash
+// of the sources it was compiled from, a cache whose sources changed is
+// rejected and compiled again. The caches are machine-local, the loaders chain
+// their format version and the layout of what they write raw into the hash.
+class AssetCache
+{
+	public:
+		// path of the cache called name, empty when the caches are off
+		static std::string getPath(const std::string& name);
+
+		// chains the contents of the file onto hash, false when it cannot be read
+		static bool hashFile(const std::string& path, uint64_t& hash);
+
+		static bool write(const std::string& path, uint64_t sourceHash, const PropWriteStream& content);
+
+		// maps the cache, false when it is missing, damaged or was compiled
+		// from other sources
+		bool open(const std::string& path, uint64_t sourceHash);
+
+		// the content, valid while the cache is open
+		PropStream& getStream() {
+			return stream;
+		}
+
+		static constexpr uint64_t HASH_SEED = 14695981039346656037ULL;
+
+	private:
+		OTB::MappedFile file;
+		PropStream stream;
+};
+
+#endif
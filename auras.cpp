@@ -8,6 +8,7 @@
 bool Auras::reload()
 {
 	auras.clear();
+	auraIndex.fill(0);
 	return loadFromXml();
 }
 
@@ -28,6 +29,11 @@ bool Auras::loadFromXml()
 			pugi::cast<int32_t>(auraNode.attribute("speed").value()),
 			auraNode.attribute("premium").as_bool()
 		);
+
+		uint16_t& index = auraIndex[auras.back().id];
+		if (index == 0) {
+			index = static_cast<uint16_t>(auras.size());
+		}
 	}
 	auras.shrink_to_fit();
 	return true;
@@ -35,11 +41,8 @@ bool Auras::loadFromXml()
 
 Aura* Auras::getAuraByID(uint8_t id)
 {
-	auto it = std::find_if(auras.begin(), auras.end(), [id](const Aura& aura) {
-		return aura.id == id;
-	});
-
-	return it != auras.end() ? &*it : nullptr;
+	uint16_t index = auraIndex[id];
+	return index != 0 ? &auras[index - 1] : nullptr;
 }
 
 Aura* Auras::getAuraByName(const std::string& name) {
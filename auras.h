@@ -28,6 +28,8 @@ class Auras
 
 	private:
 		std::vector<Aura> auras;
+		// position + 1 in auras for every id, 0 when unused
+		std::array<uint16_t, std::numeric_limits<uint8_t>::max() + 1> auraIndex = {};
 };
 
 #endif
\ No newline at end of file
@@ -4,18 +4,43 @@
 #include "otpch.h"
 
 #include "ban.h"
+#include "configmanager.h"
 #include "database.h"
 #include "databasetasks.h"
+#include "scheduler.h"
 #include "tools.h"
 
 #include <fmt/format.h>
 
+extern ConfigManager g_config;
+
+// an address idle this long behaves exactly like one never seen before
+static constexpr uint64_t CONNECT_BLOCK_IDLE = 5000;
+static constexpr uint64_t CONNECT_SWEEP_INTERVAL = 60000;
+
+std::shared_ptr<const IOBan::BanCache> IOBan::banCache;
+std::mutex IOBan::banCacheLock;
+
 bool Ban::acceptConnection(uint32_t clientIP)
 {
-	std::lock_guard<std::recursive_mutex> lockClass(lock);
+	Shard& shard = shards[(clientIP * 2654435761u) >> 28];
+	std::lock_guard<ProfiledMutex> lockClass(shard.lock);
 
 	uint64_t currentTime = OTSYS_TIME();
 
+	IpConnectMap& ipConnectMap = shard.ipConnectMap;
+	if (currentTime >= shard.nextSweep) {
+		shard.nextSweep = currentTime + CONNECT_SWEEP_INTERVAL;
+		for (auto it = ipConnectMap.begin(); it != ipConnectMap.end(); ) {
+			const ConnectBlock& connectBlock = it->second;
+			if (connectBlock.blockTime <= currentTime && connectBlock.lastAttempt + CONNECT_BLOCK_IDLE < currentTime) {
+				it = ipConnectMap.erase(it);
+			} else {
+				++it;
+			}
+		}
+	}
+
 	auto it = ipConnectMap.find(clientIP);
 	if (it == ipConnectMap.end()) {
 		ipConnectMap.emplace(clientIP, ConnectBlock(currentTime, 0, 1));
@@ -44,7 +69,98 @@ bool Ban::acceptConnection(uint32_t clientIP)
 	return true;
 }
 
+std::shared_ptr<const IOBan::BanCache> IOBan::getBanCache()
+{
+	std::lock_guard<std::mutex> lockClass(banCacheLock);
+	return banCache;
+}
+
+void IOBan::updateBanCache()
+{
+	int32_t interval = g_config.getNumber(ConfigManager::BAN_CACHE_INTERVAL);
+	if (interval <= 0) {
+		std::lock_guard<std::mutex> lockClass(banCacheLock);
+		banCache.reset();
+		return;
+	}
+
+	g_databaseTasks.addJob([](Database& db) {
+		auto cache = std::make_shared<BanCache>();
+
+		DBResult_ptr result = db.storeQuery("SELECT `account_id`, `reason`, `expires_at`, (SELECT `name` FROM `players` WHERE `id` = `banned_by`) AS `name` FROM `account_bans`");
+		if (result) {
+			do {
+				BanInfo& banInfo = cache->accountBans[result->getNumber<uint32_t>("account_id")];
+				banInfo.expiresAt = result->getNumber<int64_t>("expires_at");
+				banInfo.reason = result->getString("reason");
+				banInfo.bannedBy = result->getString("name");
+			} while (result->next());
+		}
+
+		result = db.storeQuery("SELECT `ip`, `reason`, `expires_at`, (SELECT `name` FROM `players` WHERE `id` = `banned_by`) AS `name` FROM `ip_bans`");
+		if (result) {
+			do {
+				BanInfo& banInfo = cache->ipBans[result->getNumber<uint32_t>("ip")];
+				banInfo.expiresAt = result->getNumber<int64_t>("expires_at");
+				banInfo.reason = result->getString("reason");
+				banInfo.bannedBy = result->getString("name");
+			} while (result->next());
+		}
+
+		std::lock_guard<std::mutex> lockClass(banCacheLock);
+		banCache = std::move(cache);
+		return true;
+	});
+
+	g_scheduler.addEvent(createSchedulerTask(interval * 1000, &IOBan::updateBanCache));
+}
+
 bool IOBan::isAccountBanned(uint32_t accountId, BanInfo& banInfo)
+{
+	auto cache = getBanCache();
+	if (!cache) {
+		return queryAccountBan(accountId, banInfo);
+	}
+
+	auto it = cache->accountBans.find(accountId);
+	if (it == cache->accountBans.end()) {
+		return false;
+	}
+
+	// expired bans are moved to the history by the query path
+	if (it->second.expiresAt != 0 && time(nullptr) > it->second.expiresAt) {
+		return queryAccountBan(accountId, banInfo);
+	}
+
+	banInfo = it->second;
+	return true;
+}
+
+bool IOBan::isIpBanned(uint32_t clientIP, BanInfo& banInfo)
+{
+	if (clientIP == 0) {
+		return false;
+	}
+
+	auto cache = getBanCache();
+	if (!cache) {
+		return queryIpBan(clientIP, banInfo);
+	}
+
+	auto it = cache->ipBans.find(clientIP);
+	if (it == cache->ipBans.end()) {
+		return false;
+	}
+
+	if (it->second.expiresAt != 0 && time(nullptr) > it->second.expiresAt) {
+		return queryIpBan(clientIP, banInfo);
+	}
+
+	banInfo = it->second;
+	return true;
+}
+
+bool IOBan::queryAccountBan(uint32_t accountId, BanInfo& banInfo)
 {
 	Database& db = Database::getInstance();
 
@@ -56,8 +172,8 @@ bool IOBan::isAccountBanned(uint32_t accountId, BanInfo& banInfo)
 	int64_t expiresAt = result->getNumber<int64_t>("expires_at");
 	if (expiresAt != 0 && time(nullptr) > expiresAt) {
 		// Move the ban to history if it has expired
-		g_databaseTasks.addTask(fmt::format("INSERT INTO `account_ban_history` (`account_id`, `reason`, `banned_at`, `expired_at`, `banned_by`) VALUES ({:d}, {:s}, {:d}, {:d}, {:d})", accountId, db.escapeString(result->getString("reason")), result->getNumber<time_t>("banned_at"), expiresAt, result->getNumber<uint32_t>("banned_by")));
-		g_databaseTasks.addTask(fmt::format("DELETE FROM `account_bans` WHERE `account_id` = {:d}", accountId));
+		g_databaseTasks.addTask(fmt::format("INSERT INTO `account_ban_history` (`account_id`, `reason`, `banned_at`, `expired_at`, `banned_by`) VALUES ({:d}, {:s}, {:d}, {:d}, {:d})", accountId, db.escapeString(result->getString("reason")), result->getNumber<time_t>("banned_at"), expiresAt, result->getNumber<uint32_t>("banned_by")), nullptr, false, true);
+		g_databaseTasks.addTask(fmt::format("DELETE FROM `account_bans` WHERE `account_id` = {:d}", accountId), nullptr, false, true);
 		return false;
 	}
 
@@ -67,12 +183,8 @@ bool IOBan::isAccountBanned(uint32_t accountId, BanInfo& banInfo)
 	return true;
 }
 
-bool IOBan::isIpBanned(uint32_t clientIP, BanInfo& banInfo)
+bool IOBan::queryIpBan(uint32_t clientIP, BanInfo& banInfo)
 {
-	if (clientIP == 0) {
-		return false;
-	}
-
 	Database& db = Database::getInstance();
 
 	DBResult_ptr result = db.storeQuery(fmt::format("SELECT `reason`, `expires_at`, (SELECT `name` FROM `players` WHERE `id` = `banned_by`) AS `name` FROM `ip_bans` WHERE `ip` = {:d}", clientIP));
@@ -82,7 +194,7 @@ bool IOBan::isIpBanned(uint32_t clientIP, BanInfo& banInfo)
 
 	int64_t expiresAt = result->getNumber<int64_t>("expires_at");
 	if (expiresAt != 0 && time(nullptr) > expiresAt) {
-		g_databaseTasks.addTask(fmt::format("DELETE FROM `ip_bans` WHERE `ip` = {:d}", clientIP));
+		g_databaseTasks.addTask(fmt::format("DELETE FROM `ip_bans` WHERE `ip` = {:d}", clientIP), nullptr, false, true);
 		return false;
 	}
 
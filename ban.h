@@ -4,6 +4,10 @@
 #ifndef FS_BAN_H_CADB975222D745F0BDA12D982F1006E3
 #define FS_BAN_H_CADB975222D745F0BDA12D982F1006E3
 
+#include <array>
+
+#include "lockprofiler.h"
+
 struct BanInfo {
 	std::string bannedBy;
 	std::string reason;
@@ -19,7 +23,7 @@ struct ConnectBlock {
 	uint32_t count;
 };
 
-using IpConnectMap = std::map<uint32_t, ConnectBlock>;
+using IpConnectMap = std::unordered_map<uint32_t, ConnectBlock>;
 
 class Ban
 {
@@ -27,8 +31,16 @@ class Ban
 		bool acceptConnection(uint32_t clientIP);
 
 	private:
-		IpConnectMap ipConnectMap;
-		std::recursive_mutex lock;
+		// accepts from different addresses rarely share a shard, so they do not wait on each other
+		struct Shard {
+			IpConnectMap ipConnectMap;
+			uint64_t nextSweep = 0;
+			ProfiledMutex lock{"Ban::Shard::lock"};
+		};
+
+		static constexpr size_t SHARD_COUNT = 16;
+
+		std::array<Shard, SHARD_COUNT> shards;
 };
 
 class IOBan
@@ -37,6 +49,22 @@ class IOBan
 		static bool isAccountBanned(uint32_t accountId, BanInfo& banInfo);
 		static bool isIpBanned(uint32_t clientIP, BanInfo& banInfo);
 		static bool isPlayerNamelocked(uint32_t playerId);
+
+		// reloads the active bans into memory every banCacheInterval seconds, 0 keeps one query per login
+		static void updateBanCache();
+
+	private:
+		struct BanCache {
+			std::unordered_map<uint32_t, BanInfo> accountBans;
+			std::unordered_map<uint32_t, BanInfo> ipBans;
+		};
+
+		static std::shared_ptr<const BanCache> banCache;
+		static std::mutex banCacheLock;
+
+		static std::shared_ptr<const BanCache> getBanCache();
+		static bool queryAccountBan(uint32_t accountId, BanInfo& banInfo);
+		static bool queryIpBan(uint32_t clientIP, BanInfo& banInfo);
 };
 
 #endif
@@ -0,0 +1,56 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#ifndef FS_BENCHMARK_H_B817E53D6174454BB2022B14E738CB46
+#define FS_BENCHMARK_H_B817E53D6174454BB2022B14E738CB46
+
+struct BenchmarkOptions {
+	// only benchmarks whose name contains the filter are run
+	std::string filter;
+	std::chrono::milliseconds minTime{500};
+};
+
+// Times a body in batches. The batch size is grown until one batch takes a
+// few milliseconds, then batches are repeated for the minimum time and the
+// fastest and the median time per iteration are printed. The body runs the
+// measured operation the given number of times, so the loop is not behind an
+// indirect call.
+class BenchmarkRunner
+{
+	public:
+		using Body = std::function<void(uint64_t iterations)>;
+
+		explicit BenchmarkRunner(BenchmarkOptions options) : options(std::move(options)) {}
+
+		bool isEnabled(const std::string& name) const {
+			return options.filter.empty() || name.find(options.filter) != std::string::npos;
+		}
+
+		void run(const std::string& name, const Body& body);
+
+		size_t getRunCount() const {
+			return runCount;
+		}
+
+	private:
+		BenchmarkOptions options;
+		size_t runCount = 0;
+};
+
+// keeps the compiler from dropping a result that is never read
+template<typename T>
+inline void doNotOptimize(const T& value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	asm volatile("" : : "r,m"(value) : "memory");
+#else
+	static const volatile void* sink;
+	sink = &value;
+#endif
+}
+
+void runMapBenchmarks(BenchmarkRunner& runner);
+void runItemBenchmarks(BenchmarkRunner& runner);
+void runNetworkBenchmarks(BenchmarkRunner& runner);
+
+#endif
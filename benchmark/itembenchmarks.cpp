@@ -0,0 +1,194 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#include "otpch.h"
+
+#include "benchmark.h"
+#include "container.h"
+#include "fileloader.h"
+#include "iologindata.h"
+#include "player.h"
+
+namespace {
+
+constexpr int RARITY_ID = ITEM_RARITY_LEGENDARY;
+constexpr uint32_t BACKPACK_ITEMS = 19;
+constexpr uint32_t STORAGE_VALUES = 200;
+
+uint16_t findItemId(const std::function<bool(const ItemType&)>& predicate)
+{
+	for (size_t id = 100; id < Item::items.size(); ++id) {
+		const ItemType& it = Item::items[id];
+		if (it.id != 0 && predicate(it)) {
+			return it.id;
+		}
+	}
+	return 0;
+}
+
+// a character with a backpack of rare weapons, a bag of stackables in it and
+// a page of storage values, about what an active player carries
+Player* createSavePlayer(uint16_t containerId, uint16_t weaponId, uint16_t stackableId)
+{
+	static Group group{"benchmark", 0, 2000, 200, 1, false};
+	static Town town(1);
+
+	Player* player = new Player(nullptr);
+	player->incrementReferenceCounter();
+	player->setName("Benchmark Saver");
+	player->setGUID(1);
+	player->setGroup(&group);
+	player->setTown(&town);
+	player->setVocation(0);
+
+	Container* backpack = Item::CreateItemAsContainer(containerId, BACKPACK_ITEMS + 1);
+	for (uint32_t i = 0; i < BACKPACK_ITEMS; ++i) {
+		backpack->internalAddThing(Item::CreateItemWithRarity(weaponId, 1, RARITY_ID));
+	}
+
+	Container* bag = Item::CreateItemAsContainer(containerId, BACKPACK_ITEMS);
+	for (uint32_t i = 0; i < BACKPACK_ITEMS; ++i) {
+		bag->internalAddThing(Item::CreateItem(stackableId, 1 + i));
+	}
+	backpack->internalAddThing(bag);
+	static_cast<Cylinder*>(player)->internalAddThing(CONST_SLOT_BACKPACK, backpack);
+
+	for (uint32_t key = 1; key <= STORAGE_VALUES; ++key) {
+		player->addStorageValue(key, key * 7, true);
+	}
+	return player;
+}
+
+}
+
+void runItemBenchmarks(BenchmarkRunner& runner)
+{
+	uint16_t weaponId = findItemId([](const ItemType& it) {
+		return it.weaponType != WEAPON_NONE && !it.stackable && !it.isContainer();
+	});
+	uint16_t stackableId = findItemId([](const ItemType& it) {
+		return it.stackable && it.pickupable;
+	});
+	uint16_t containerId = findItemId([](const ItemType& it) {
+		return it.isContainer() && it.pickupable && it.maxItems >= BACKPACK_ITEMS + 1;
+	});
+	if (weaponId == 0 || stackableId == 0 || containerId == 0) {
+		std::cout << "> Skipped the item benchmarks, the items have no weapon, stackable or container." << std::endl;
+		return;
+	}
+
+	runner.run("Item::CreateItem", [weaponId](uint64_t iterations) {
+		for (uint64_t i = 0; i < iterations; ++i) {
+			Item* item = Item::CreateItem(weaponId);
+			doNotOptimize(item);
+			delete item;
+		}
+	});
+
+	runner.run("Item::CreateItemWithRarity (applyRarityEffects)", [weaponId](uint64_t iterations) {
+		for (uint64_t i = 0; i < iterations; ++i) {
+			Item* item = Item::CreateItemWithRarity(weaponId, 1, RARITY_ID);
+			doNotOptimize(item);
+			delete item;
+		}
+	});
+
+	std::unique_ptr<Item> rareItem(Item::CreateItemWithRarity(weaponId, 1, RARITY_ID));
+
+	runner.run("PropWriteStream Item::serializeAttr, rare item", [&rareItem](uint64_t iterations) {
+		PropWriteStream propWriteStream;
+		for (uint64_t i = 0; i < iterations; ++i) {
+			propWriteStream.clear();
+			rareItem->serializeAttr(propWriteStream);
+
+			size_t size;
+			doNotOptimize(propWriteStream.getStream(size));
+		}
+	});
+
+	PropWriteStream serialized;
+	rareItem->serializeAttr(serialized);
+	size_t serializedSize;
+	const char* serializedData = serialized.getStream(serializedSize);
+
+	runner.run("PropStream Item::unserializeAttr, rare item", [&](uint64_t iterations) {
+		for (uint64_t i = 0; i < iterations; ++i) {
+			Item* item = Item::CreateItem(weaponId);
+
+			PropStream propStream;
+			propStream.init(serializedData, serializedSize);
+			doNotOptimize(item->unserializeAttr(propStream));
+			delete item;
+		}
+	});
+
+	runner.run("PropWriteStream mixed values", [](uint64_t iterations) {
+		PropWriteStream propWriteStream;
+		const std::string text = "a description of average length";
+		for (uint64_t i = 0; i < iterations; ++i) {
+			propWriteStream.clear();
+			for (uint32_t value = 0; value < 16; ++value) {
+				propWriteStream.write<uint8_t>(value);
+				propWriteStream.write<uint32_t>(value);
+				propWriteStream.write<int64_t>(value);
+			}
+			propWriteStream.writeString(text);
+
+			size_t size;
+			doNotOptimize(propWriteStream.getStream(size));
+		}
+	});
+
+	runner.run("PropWriteStream new stream per save, 64 rare items", [&rareItem](uint64_t iterations) {
+		for (uint64_t i = 0; i < iterations; ++i) {
+			PropWriteStream propWriteStream;
+			for (uint32_t item = 0; item < 64; ++item) {
+				propWriteStream.write<uint16_t>(rareItem->getID());
+				rareItem->serializeAttr(propWriteStream);
+			}
+
+			size_t size;
+			doNotOptimize(propWriteStream.getStream(size));
+		}
+	});
+
+	PropWriteStream mixed;
+	for (uint32_t value = 0; value < 16; ++value) {
+		mixed.write<uint8_t>(value);
+		mixed.write<uint32_t>(value);
+		mixed.write<int64_t>(value);
+	}
+	mixed.writeString("a description of average length");
+	size_t mixedSize;
+	const char* mixedData = mixed.getStream(mixedSize);
+
+	runner.run("PropStream mixed values", [&](uint64_t iterations) {
+		for (uint64_t i = 0; i < iterations; ++i) {
+			PropStream propStream;
+			propStream.init(mixedData, mixedSize);
+			for (uint32_t value = 0; value < 16; ++value) {
+				uint8_t byte;
+				uint32_t number;
+				int64_t wide;
+				propStream.read<uint8_t>(byte);
+				propStream.read<uint32_t>(number);
+				propStream.read<int64_t>(wide);
+				doNotOptimize(wide);
+			}
+
+			std::string text;
+			propStream.readString(text);
+			doNotOptimize(text);
+		}
+	});
+
+	// the save statements are only built, the database is never connected
+	Player* player = createSavePlayer(containerId, weaponId, stackableId);
+	runner.run("IOLoginData::serializePlayer", [player](uint64_t iterations) {
+		for (uint64_t i = 0; i < iterations; ++i) {
+			PlayerSaveData data;
+			doNotOptimize(IOLoginData::serializePlayer(player, data));
+		}
+	});
+	player->decrementReferenceCounter();
+}
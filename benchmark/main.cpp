@@ -0,0 +1,146 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#include "otpch.h"
+
+#include "benchmark.h"
+#include "configmanager.h"
+#include "databasetasks.h"
+#include "game.h"
+#include "monsters.h"
+#include "rsa.h"
+#include "scheduler.h"
+#include "vocation.h"
+
+#include <fmt/format.h>
+
+DatabaseTasks g_databaseTasks;
+Dispatcher g_dispatcher;
+Scheduler g_scheduler;
+
+Game g_game;
+ConfigManager g_config;
+Monsters g_monsters;
+Vocations g_vocations;
+RSA g_RSA;
+
+namespace {
+
+// a batch this long keeps the clock reads out of the figures
+constexpr auto MIN_BATCH_TIME = std::chrono::milliseconds(5);
+constexpr size_t MIN_BATCHES = 5;
+
+void printUsage(const char* name)
+{
+	std::cout << "Usage: " << name << " [options]\n"
+	          << "\t--filter <text>     only run benchmarks whose name contains the text\n"
+	          << "\t--min-time <ms>     measuring time of every benchmark (500)\n"
+	          << "\t--items <file>      items.otb to load (data/items/items.otb)\n"
+	          << "\t--map <file>        fixture map, its towns are benchmarked next to the synthetic areas\n";
+}
+
+}
+
+void BenchmarkRunner::run(const std::string& name, const Body& body)
+{
+	if (!isEnabled(name)) {
+		return;
+	}
+
+	using Clock = std::chrono::steady_clock;
+
+	auto measure = [&body](uint64_t iterations) {
+		auto start = Clock::now();
+		body(iterations);
+		return Clock::now() - start;
+	};
+
+	// warm up and find a batch size worth timing
+	uint64_t iterations = 1;
+	for (auto elapsed = measure(iterations); elapsed < MIN_BATCH_TIME && iterations < (1ULL << 32); elapsed = measure(iterations)) {
+		uint64_t factor = elapsed.count() > 0 ? MIN_BATCH_TIME / elapsed + 1 : 10;
+		iterations *= std::min<uint64_t>(10, std::max<uint64_t>(2, factor));
+	}
+
+	std::vector<double> samples;
+	auto end = Clock::now() + options.minTime;
+	while (samples.size() < MIN_BATCHES || Clock::now() < end) {
+		auto elapsed = measure(iterations);
+		samples.push_back(std::chrono::duration<double, std::nano>(elapsed).count() / iterations);
+	}
+
+	std::sort(samples.begin(), samples.end());
+	std::cout << fmt::format("{:<56s} {:>12.1f} ns/op  (min {:.1f}, {:d} x {:d})", name, samples[samples.size() / 2], samples.front(), samples.size(), iterations) << std::endl;
+	++runCount;
+}
+
+int main(int argc, char* argv[])
+{
+	BenchmarkOptions options;
+	std::string itemsFile = "data/items/items.otb";
+	std::string mapFile;
+
+	for (int i = 1; i < argc; ++i) {
+		std::string option = argv[i];
+		if (i + 1 >= argc) {
+			printUsage(argv[0]);
+			return EXIT_FAILURE;
+		}
+
+		std::string value = argv[++i];
+		if (option == "--filter") {
+			options.filter = value;
+		} else if (option == "--min-time") {
+			options.minTime = std::chrono::milliseconds(std::max<int32_t>(1, std::atoi(value.c_str())));
+		} else if (option == "--items") {
+			itemsFile = value;
+		} else if (option == "--map") {
+			mapFile = value;
+		} else {
+			printUsage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	// the defaults are used without a config, the benchmarks do not depend on it
+	if (!g_config.load()) {
+		std::cout << "> Using the default configuration." << std::endl;
+	}
+
+	if (!Item::items.loadFromOtb(itemsFile)) {
+		std::cout << "> ERROR: Unable to load items (OTB)!" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	if (!Item::items.loadFromXml()) {
+		std::cout << "> ERROR: Unable to load items (XML)!" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	if (!g_vocations.loadFromXml()) {
+		std::cout << "> ERROR: Unable to load vocations!" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	if (!mapFile.empty()) {
+		auto start = std::chrono::steady_clock::now();
+		if (!g_game.map.loadMap(mapFile, false)) {
+			return EXIT_FAILURE;
+		}
+		auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+		std::cout << "> Loaded " << mapFile << " in " << elapsed.count() << " ms." << std::endl;
+	}
+
+	// the same seed every run, so areas and paths match between builds
+	seedRandomGenerator(0x5EED);
+
+	BenchmarkRunner runner(options);
+	runMapBenchmarks(runner);
+	runItemBenchmarks(runner);
+	runNetworkBenchmarks(runner);
+
+	if (runner.getRunCount() == 0) {
+		std::cout << "> No benchmark matches " << options.filter << '.' << std::endl;
+	}
+	return EXIT_SUCCESS;
+}
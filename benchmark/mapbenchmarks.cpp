@@ -0,0 +1,232 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#include "otpch.h"
+
+#include "benchmark.h"
+#include "combat.h"
+#include "game.h"
+
+#include <fmt/format.h>
+
+extern Game g_game;
+
+namespace {
+
+// the synthetic areas are built far away from anything a fixture map would use
+constexpr uint16_t AREA_X = 30000;
+constexpr uint16_t AREA_Y = 30000;
+constexpr uint8_t AREA_Z = 7;
+constexpr uint16_t OPEN_SIZE = 128;
+
+constexpr uint16_t MAZE_X = AREA_X + OPEN_SIZE + 32;
+constexpr uint16_t MAZE_SIZE = 21;
+
+constexpr size_t LOOKUPS = 4096;
+
+uint16_t findItemId(const std::function<bool(const ItemType&)>& predicate)
+{
+	for (size_t id = 100; id < Item::items.size(); ++id) {
+		const ItemType& it = Item::items[id];
+		if (it.id != 0 && predicate(it)) {
+			return it.id;
+		}
+	}
+	return 0;
+}
+
+void addTile(uint16_t x, uint16_t y, uint8_t z, uint16_t groundId, uint16_t wallId)
+{
+	Tile* tile = new DynamicTile(x, y, z);
+	tile->internalAddThing(Item::CreateItem(groundId));
+	if (wallId != 0) {
+		tile->internalAddThing(Item::CreateItem(wallId));
+	}
+	g_game.map.setTile(x, y, z, tile);
+}
+
+Player* addPlayer(const Position& pos)
+{
+	static uint32_t guid = 0;
+
+	Player* player = new Player(nullptr);
+	player->incrementReferenceCounter();
+	player->setName(fmt::format("Benchmark {:d}", ++guid));
+	player->setGUID(guid);
+	player->setID();
+
+	if (!g_game.map.placeCreature(pos, player, false, true)) {
+		player->decrementReferenceCounter();
+		return nullptr;
+	}
+	return player;
+}
+
+// the serpentine walls leave a gap at alternating ends, so a path from the top
+// left corner to the bottom row has to walk every corridor
+void buildMaze(uint16_t groundId, uint16_t wallId)
+{
+	for (uint16_t y = 0; y < MAZE_SIZE; ++y) {
+		bool wallRow = y % 2 == 1;
+		uint16_t gap = (y / 2) % 2 == 0 ? MAZE_SIZE - 1 : 0;
+		for (uint16_t x = 0; x < MAZE_SIZE; ++x) {
+			addTile(MAZE_X + x, AREA_Y + y, AREA_Z, groundId, wallRow && x != gap ? wallId : 0);
+		}
+	}
+}
+
+void runSpectatorBenchmarks(BenchmarkRunner& runner, const std::string& profile, const Position& center)
+{
+	runner.run(fmt::format("Map::getSpectators {:s}, cached", profile), [&center](uint64_t iterations) {
+		for (uint64_t i = 0; i < iterations; ++i) {
+			SpectatorVec spectators;
+			g_game.map.getSpectators(spectators, center, true, true);
+			doNotOptimize(spectators.size());
+		}
+	});
+
+	runner.run(fmt::format("Map::getSpectators {:s}, uncached", profile), [&center](uint64_t iterations) {
+		for (uint64_t i = 0; i < iterations; ++i) {
+			g_game.map.clearSpectatorCache();
+
+			SpectatorVec spectators;
+			g_game.map.getSpectators(spectators, center, true, true);
+			doNotOptimize(spectators.size());
+		}
+	});
+
+	runner.run(fmt::format("Map::getSpectators {:s}, all creatures on one floor", profile), [&center](uint64_t iterations) {
+		for (uint64_t i = 0; i < iterations; ++i) {
+			g_game.map.clearSpectatorCache();
+
+			SpectatorVec spectators;
+			g_game.map.getSpectators(spectators, center);
+			doNotOptimize(spectators.size());
+		}
+	});
+}
+
+void runTileBenchmarks(BenchmarkRunner& runner, const std::string& name, const std::vector<Position>& positions)
+{
+	runner.run(name, [&positions](uint64_t iterations) {
+		for (uint64_t i = 0; i < iterations; ++i) {
+			doNotOptimize(g_game.map.getTile(positions[i % positions.size()]));
+		}
+	});
+}
+
+void runPathBenchmark(BenchmarkRunner& runner, const std::string& name, const Position& from, const Position& to)
+{
+	Player* walker = addPlayer(from);
+	if (!walker) {
+		std::cout << "> Skipped " << name << ", the walker could not be placed." << std::endl;
+		return;
+	}
+
+	FindPathParams fpp;
+	fpp.fullPathSearch = true;
+	fpp.clearSight = false;
+	fpp.maxSearchDist = 32;
+	fpp.minTargetDist = 0;
+	fpp.maxTargetDist = 1;
+
+	FrozenPathingConditionCall condition(to);
+	std::vector<Direction> dirList;
+	if (!g_game.map.getPathMatching(*walker, dirList, condition, fpp)) {
+		std::cout << "> " << name << " finds no path." << std::endl;
+	}
+
+	runner.run(fmt::format("{:s} ({:d} steps)", name, dirList.size()), [&](uint64_t iterations) {
+		for (uint64_t i = 0; i < iterations; ++i) {
+			dirList.clear();
+			doNotOptimize(g_game.map.getPathMatching(*walker, dirList, condition, fpp));
+		}
+	});
+}
+
+void runAreaCombatBenchmark(BenchmarkRunner& runner, const std::string& name, const Position& center, int32_t radius)
+{
+	AreaCombat area;
+	area.setupArea(radius);
+
+	// no damage type, so combatBlockHit skips every target and nothing is changed
+	CombatParams params;
+	params.aggressive = false;
+
+	runner.run(name, [&](uint64_t iterations) {
+		for (uint64_t i = 0; i < iterations; ++i) {
+			CombatDamage damage;
+			Combat::doAreaCombat(nullptr, center, &area, damage, params);
+		}
+	});
+}
+
+}
+
+void runMapBenchmarks(BenchmarkRunner& runner)
+{
+	uint16_t groundId = findItemId([](const ItemType& it) {
+		return it.isGroundTile() && !it.blockSolid && !it.blockPathFind;
+	});
+	uint16_t wallId = findItemId([](const ItemType& it) {
+		return !it.isGroundTile() && it.blockSolid && !it.moveable && !it.isContainer() && !it.isDoor();
+	});
+	if (groundId == 0 || wallId == 0) {
+		std::cout << "> Skipped the map benchmarks, the items have no plain ground or wall." << std::endl;
+		return;
+	}
+
+	for (uint16_t y = 0; y < OPEN_SIZE; ++y) {
+		for (uint16_t x = 0; x < OPEN_SIZE; ++x) {
+			addTile(AREA_X + x, AREA_Y + y, AREA_Z, groundId, 0);
+		}
+	}
+	buildMaze(groundId, wallId);
+
+	std::vector<Position> hits, misses;
+	hits.reserve(LOOKUPS);
+	misses.reserve(LOOKUPS);
+	for (size_t i = 0; i < LOOKUPS; ++i) {
+		hits.emplace_back(AREA_X + uniform_random(0, OPEN_SIZE - 1), AREA_Y + uniform_random(0, OPEN_SIZE - 1), AREA_Z);
+		misses.emplace_back(AREA_X + uniform_random(0, OPEN_SIZE - 1), AREA_Y + uniform_random(0, OPEN_SIZE - 1), AREA_Z - 1);
+	}
+
+	runTileBenchmarks(runner, "Map::getTile, existing tiles", hits);
+	runTileBenchmarks(runner, "Map::getTile, empty floor", misses);
+
+	const Town* fixtureTown = nullptr;
+	if (!g_game.map.towns.getTowns().empty()) {
+		fixtureTown = g_game.map.towns.getTowns().begin()->second;
+
+		std::vector<Position> fixture;
+		fixture.reserve(LOOKUPS);
+		const Position& temple = fixtureTown->getTemplePosition();
+		for (size_t i = 0; i < LOOKUPS; ++i) {
+			fixture.emplace_back(temple.x + uniform_random(-Map::maxViewportX, Map::maxViewportX), temple.y + uniform_random(-Map::maxViewportY, Map::maxViewportY), temple.z);
+		}
+		runTileBenchmarks(runner, "Map::getTile, fixture temple", fixture);
+	}
+
+	// paths are found before the crowd is placed, it would block the corridors
+	runPathBenchmark(runner, "Map::getPathMatching, open terrain", Position(AREA_X + 4, AREA_Y + 4, AREA_Z), Position(AREA_X + 24, AREA_Y + 16, AREA_Z));
+	runPathBenchmark(runner, "Map::getPathMatching, maze", Position(MAZE_X, AREA_Y, AREA_Z), Position(MAZE_X + MAZE_SIZE / 2, AREA_Y + MAZE_SIZE - 1, AREA_Z));
+
+	// players are spread over the open area, the view around its center sees a growing crowd
+	const Position center(AREA_X + OPEN_SIZE / 2, AREA_Y + OPEN_SIZE / 2, AREA_Z);
+	size_t placed = 0;
+	for (size_t density : {10, 100, 1000}) {
+		for (; placed < density; ++placed) {
+			Position pos(center.x + uniform_random(-Map::maxViewportX * 2, Map::maxViewportX * 2), center.y + uniform_random(-Map::maxViewportY * 2, Map::maxViewportY * 2), AREA_Z);
+			addPlayer(pos);
+		}
+
+		std::string profile = fmt::format("{:d} players", density);
+		runSpectatorBenchmarks(runner, profile, center);
+		runAreaCombatBenchmark(runner, fmt::format("Combat::doAreaCombat radius 4, {:s}", profile), center, 4);
+		runAreaCombatBenchmark(runner, fmt::format("Combat::doAreaCombat radius 7, {:s}", profile), center, 7);
+	}
+
+	if (fixtureTown) {
+		runSpectatorBenchmarks(runner, "fixture temple", fixtureTown->getTemplePosition());
+	}
+}
@@ -0,0 +1,91 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#include "otpch.h"
+
+#include "benchmark.h"
+#include "networkmessage.h"
+#include "position.h"
+#include "xtea.h"
+
+#include <fmt/format.h>
+
+namespace {
+
+// roughly a creature move followed by a few text and stat updates
+void writePacket(NetworkMessage& msg)
+{
+	const Position from(1000, 1000, 7);
+	const Position to(1001, 1000, 7);
+	for (uint32_t i = 0; i < 8; ++i) {
+		msg.addByte(0x6D);
+		msg.addPosition(from);
+		msg.addByte(1);
+		msg.addPosition(to);
+		msg.add<uint32_t>(0x10000000 + i);
+		msg.add<uint16_t>(i);
+		msg.addString("You see a benchmark.");
+		msg.addDouble(123.456, 3);
+	}
+}
+
+void runXTEABenchmark(BenchmarkRunner& runner, size_t size)
+{
+	std::vector<uint8_t> buffer(size);
+	xtea::round_keys keys = xtea::expand_key({0x01234567, 0x89ABCDEF, 0xFEDCBA98, 0x76543210});
+
+	runner.run(fmt::format("xtea::encrypt {:d} bytes", size), [&](uint64_t iterations) {
+		for (uint64_t i = 0; i < iterations; ++i) {
+			xtea::encrypt(buffer.data(), buffer.size(), keys);
+			doNotOptimize(buffer[0]);
+		}
+	});
+
+	runner.run(fmt::format("xtea::decrypt {:d} bytes", size), [&](uint64_t iterations) {
+		for (uint64_t i = 0; i < iterations; ++i) {
+			xtea::decrypt(buffer.data(), buffer.size(), keys);
+			doNotOptimize(buffer[0]);
+		}
+	});
+}
+
+}
+
+void runNetworkBenchmarks(BenchmarkRunner& runner)
+{
+	// the buffer is too large for the stack of a benchmark loop
+	auto msg = std::make_unique<NetworkMessage>();
+
+	runner.run("NetworkMessage add", [&msg](uint64_t iterations) {
+		for (uint64_t i = 0; i < iterations; ++i) {
+			msg->reset();
+			writePacket(*msg);
+			doNotOptimize(msg->getLength());
+		}
+	});
+
+	msg->reset();
+	writePacket(*msg);
+	NetworkMessage::MsgSize_t length = msg->getLength();
+
+	runner.run("NetworkMessage get", [&msg, length](uint64_t iterations) {
+		for (uint64_t i = 0; i < iterations; ++i) {
+			msg->setBufferPosition(0);
+			msg->setLength(length);
+			for (uint32_t j = 0; j < 8; ++j) {
+				msg->getByte();
+				doNotOptimize(msg->getPosition());
+				msg->getByte();
+				doNotOptimize(msg->getPosition());
+				doNotOptimize(msg->get<uint32_t>());
+				doNotOptimize(msg->get<uint16_t>());
+				doNotOptimize(msg->getString());
+				msg->skipBytes(5); // double
+			}
+		}
+	});
+
+	for (size_t size : {64, 1024, 16384}) {
+		runXTEABenchmark(runner, size);
+	}
+}
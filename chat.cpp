@@ -37,8 +37,8 @@ void PrivateChatChannel::invitePlayer(const Player& player, Player& invitePlayer
 
 	player.sendTextMessage(MESSAGE_INFO_DESCR, fmt::format("{:s} has been invited.", invitePlayer.getName()));
 
-	for (const auto& it : users) {
-		it.second->sendChannelEvent(id, invitePlayer.getName(), CHANNELEVENT_INVITE);
+	for (Player* user : users) {
+		user->sendChannelEvent(id, invitePlayer.getName(), CHANNELEVENT_INVITE);
 	}
 }
 
@@ -54,21 +54,21 @@ void PrivateChatChannel::excludePlayer(const Player& player, Player& excludePlay
 
 	excludePlayer.sendClosePrivate(id);
 
-	for (const auto& it : users) {
-		it.second->sendChannelEvent(id, excludePlayer.getName(), CHANNELEVENT_EXCLUDE);
+	for (Player* user : users) {
+		user->sendChannelEvent(id, excludePlayer.getName(), CHANNELEVENT_EXCLUDE);
 	}
 }
 
 void PrivateChatChannel::closeChannel() const
 {
-	for (const auto& it : users) {
-		it.second->sendClosePrivate(id);
+	for (Player* user : users) {
+		user->sendClosePrivate(id);
 	}
 }
 
 bool ChatChannel::addUser(Player& player)
 {
-	if (users.find(player.getID()) != users.end()) {
+	if (userIndex.find(player.getID()) != userIndex.end()) {
 		return false;
 	}
 
@@ -85,27 +85,34 @@ bool ChatChannel::addUser(Player& player)
 	}
 
 	if (!publicChannel) {
-		for (const auto& it : users) {
-			it.second->sendChannelEvent(id, player.getName(), CHANNELEVENT_JOIN);
+		for (Player* user : users) {
+			user->sendChannelEvent(id, player.getName(), CHANNELEVENT_JOIN);
 		}
 	}
 
-	users[player.getID()] = &player;
+	userIndex[player.getID()] = users.size();
+	users.push_back(&player);
 	return true;
 }
 
 bool ChatChannel::removeUser(const Player& player)
 {
-	auto iter = users.find(player.getID());
-	if (iter == users.end()) {
+	auto iter = userIndex.find(player.getID());
+	if (iter == userIndex.end()) {
 		return false;
 	}
 
-	users.erase(iter);
+	size_t index = iter->second;
+	userIndex.erase(iter);
+	if (index != users.size() - 1) {
+		users[index] = users.back();
+		userIndex[users[index]->getID()] = index;
+	}
+	users.pop_back();
 
 	if (!publicChannel) {
-		for (const auto& it : users) {
-			it.second->sendChannelEvent(id, player.getName(), CHANNELEVENT_LEAVE);
+		for (Player* user : users) {
+			user->sendChannelEvent(id, player.getName(), CHANNELEVENT_LEAVE);
 		}
 	}
 
@@ -114,24 +121,58 @@ bool ChatChannel::removeUser(const Player& player)
 }
 
 bool ChatChannel::hasUser(const Player& player) {
-	return users.find(player.getID()) != users.end();
+	return userIndex.find(player.getID()) != userIndex.end();
 }
 
 void ChatChannel::sendToAll(const std::string& message, SpeakClasses type) const
 {
-	for (const auto& it : users) {
-		it.second->sendChannelMessage("", message, type, id);
+	if (users.empty()) {
+		return;
+	}
+
+	NetworkMessage msg;
+	ProtocolGame::encodeChannelMessage(msg, "", message, type, id);
+	for (Player* user : users) {
+		user->sendNetworkMessage(msg);
+	}
+}
+
+bool ChatChannel::consumeMessageToken()
+{
+	if (messagesPerSecond == 0) {
+		return true;
+	}
+
+	int64_t now = OTSYS_TIME();
+	if (now - lastTokenRefill >= 1000) {
+		lastTokenRefill = now;
+		messageTokens = messagesPerSecond;
 	}
+
+	if (messageTokens == 0) {
+		return false;
+	}
+
+	--messageTokens;
+	return true;
 }
 
 bool ChatChannel::talk(const Player& fromPlayer, SpeakClasses type, const std::string& text)
 {
-	if (users.find(fromPlayer.getID()) == users.end()) {
+	if (userIndex.find(fromPlayer.getID()) == userIndex.end()) {
 		return false;
 	}
 
-	for (const auto& it : users) {
-		it.second->sendToChannel(&fromPlayer, type, text, id);
+	if (!consumeMessageToken()) {
+		fromPlayer.sendTextMessage(MESSAGE_STATUS_SMALL, "This channel is busy. Please wait a moment.");
+		return false;
+	}
+
+	// every member receives the same bytes, so the message is encoded only once
+	NetworkMessage msg;
+	ProtocolGame::encodeChannelSpeech(msg, &fromPlayer, type, text, id);
+	for (Player* user : users) {
+		user->sendNetworkMessage(msg);
 	}
 	return true;
 }
@@ -297,15 +338,22 @@ bool Chat::load()
 				}
 			}
 
-			UsersMap tempUserMap = std::move(channel.users);
-			for (const auto& pair : tempUserMap) {
-				channel.addUser(*pair.second);
+			channel.messagesPerSecond = channelNode.attribute("messagesPerSecond").as_uint();
+			channel.messageTokens = channel.messagesPerSecond;
+
+			UsersList tempUserList = std::move(channel.users);
+			channel.users.clear();
+			channel.userIndex.clear();
+			for (Player* user : tempUserList) {
+				channel.addUser(*user);
 			}
 			continue;
 		}
 
 		ChatChannel channel(channelId, channelName);
 		channel.publicChannel = isPublic;
+		channel.messagesPerSecond = channelNode.attribute("messagesPerSecond").as_uint();
+		channel.messageTokens = channel.messagesPerSecond;
 
 		if (scriptAttribute) {
 			if (scriptInterface.loadFile("data/chatchannels/scripts/" + std::string(scriptAttribute.as_string())) == 0) {
@@ -10,7 +10,7 @@
 class Party;
 class Player;
 
-using UsersMap = std::map<uint32_t, Player*>;
+using UsersList = std::vector<Player*>;
 using InvitedMap = std::map<uint32_t, const Player*>;
 
 class ChatChannel
@@ -35,7 +35,7 @@ class ChatChannel
 		uint16_t getId() const {
 			return id;
 		}
-		const UsersMap& getUsers() const {
+		const UsersList& getUsers() const {
 			return users;
 		}
 		virtual const InvitedMap* getInvitedUsers() const {
@@ -54,13 +54,22 @@ class ChatChannel
 		bool executeOnSpeakEvent(const Player& player, SpeakClasses& type, const std::string& message);
 
 	protected:
-		UsersMap users;
+		// dense so a message fans out over a plain array, userIndex maps player ids into it
+		UsersList users;
+		std::unordered_map<uint32_t, size_t> userIndex;
 
 		uint16_t id;
 
 	private:
+		bool consumeMessageToken();
+
 		std::string name;
 
+		// optional token bucket refilled with messagesPerSecond tokens every second, 0 disables it
+		int64_t lastTokenRefill = 0;
+		uint32_t messagesPerSecond = 0;
+		uint32_t messageTokens = 0;
+
 		int32_t canJoinEvent = -1;
 		int32_t onJoinEvent = -1;
 		int32_t onLeaveEvent = -1;
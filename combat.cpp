@@ -9,6 +9,8 @@
 #include "weapons.h"
 #include "configmanager.h"
 #include "events.h"
+#include "purescripts.h"
+#include "tracer.h"
 
 extern Game g_game;
 extern Weapons* g_weapons;
@@ -50,29 +52,23 @@ MatrixArea createArea(const std::vector<uint32_t>& vec, uint32_t rows)
 	return area;
 }
 
-std::vector<Tile*> getList(const MatrixArea& area, const Position& targetPos, const Direction dir)
+std::vector<Tile*> getList(const AreaCombat::OffsetList& offsets, const Position& targetPos, const Direction dir)
 {
 	auto casterPos = getNextPosition(dir, targetPos);
 
 	std::vector<Tile*> vec;
-
-	auto center = area.getCenter();
-
-	Position tmpPos(targetPos.x - center.first, targetPos.y - center.second, targetPos.z);
-	for (uint32_t row = 0; row < area.getRows(); ++row, ++tmpPos.y) {
-		for (uint32_t col = 0; col < area.getCols(); ++col, ++tmpPos.x) {
-			if (area(row, col)) {
-				if (g_game.isSightClear(casterPos, tmpPos, true)) {
-					Tile* tile = g_game.map.getTile(tmpPos);
-					if (!tile) {
-						tile = new StaticTile(tmpPos.x, tmpPos.y, tmpPos.z);
-						g_game.map.setTile(tmpPos, tile);
-					}
-					vec.push_back(tile);
-				}
+	vec.reserve(offsets.size());
+
+	for (const AreaCombat::Offset& offset : offsets) {
+		Position tmpPos(targetPos.x + offset.x, targetPos.y + offset.y, targetPos.z);
+		if (g_game.isSightClear(casterPos, tmpPos, true)) {
+			Tile* tile = g_game.map.getTile(tmpPos);
+			if (!tile) {
+				tile = new StaticTile(tmpPos.x, tmpPos.y, tmpPos.z);
+				g_game.map.setTile(tmpPos, tile);
 			}
+			vec.push_back(tile);
 		}
-		tmpPos.x -= area.getCols();
 	}
 	return vec;
 }
@@ -84,7 +80,7 @@ std::vector<Tile*> getCombatArea(const Position& centerPos, const Position& targ
 	}
 
 	if (area) {
-		return getList(area->getArea(centerPos, targetPos), targetPos, getDirectionTo(targetPos, centerPos));
+		return getList(area->getOffsets(centerPos, targetPos), targetPos, getDirectionTo(targetPos, centerPos));
 	}
 
 	Tile* tile = g_game.map.getTile(targetPos);
@@ -787,7 +783,7 @@ void Combat::doCombat(Creature* caster, const Position& position) const
 
 			combatTileEffects(spectators, caster, tile, params);
 
-			if (CreatureVector* creatures = tile->getCreatures()) {
+			if (TileCreatureVector* creatures = tile->getCreatures()) {
 				const Creature* topCreature = tile->getTopCreature();
 				for (Creature* creature : *creatures) {
 					if (params.targetCasterOrTopMost) {
@@ -833,17 +829,16 @@ void Combat::doCombat(Creature* caster, const Position& position) const
 	}
 }
 
-void Combat::doTargetCombat(Creature* caster, Creature* target, CombatDamage& damage, const CombatParams& params)
+template <bool playerCaster, bool targetEffects>
+void Combat::doTargetCombat(Creature* caster, Player* casterPlayer, Creature* target, CombatDamage& damage, const CombatParams& params)
 {
 	if (caster && target && params.distanceEffect != CONST_ANI_NONE) {
 		addDistanceEffect(caster, caster->getPosition(), target->getPosition(), params.distanceEffect);
 	}
 
-	Player* casterPlayer = caster ? caster->getPlayer() : nullptr;
-
 	bool success = false;
 	if (damage.primary.type != COMBAT_MANADRAIN) {
-		if (casterPlayer) {
+		if (playerCaster) {
 			if (damage.primary.type == COMBAT_PHYSICALDAMAGE) {
 				auto strength = casterPlayer->getCharacterStat(CHARSTAT_STRENGTH);
 				if (strength != 0) {
@@ -874,7 +869,7 @@ void Combat::doTargetCombat(Creature* caster, Creature* target, CombatDamage& da
 			return;
 		}
 
-		if (casterPlayer) {
+		if (playerCaster) {
 			Player* targetPlayer = target ? target->getPlayer() : nullptr;
 			if (targetPlayer && casterPlayer != targetPlayer && targetPlayer->getSkull() != SKULL_BLACK && damage.primary.type != COMBAT_HEALING) {
 				damage.primary.value /= 2;
@@ -898,7 +893,7 @@ void Combat::doTargetCombat(Creature* caster, Creature* target, CombatDamage& da
 	}
 
 	if (success) {
-		if (damage.blockType == BLOCK_NONE || damage.blockType == BLOCK_ARMOR) {
+		if (targetEffects && (damage.blockType == BLOCK_NONE || damage.blockType == BLOCK_ARMOR)) {
 			for (const auto& condition : params.conditionList) {
 				if (caster == target || !target->isImmune(condition->getType())) {
 					Condition* conditionCopy = condition->clone();
@@ -916,7 +911,7 @@ void Combat::doTargetCombat(Creature* caster, Creature* target, CombatDamage& da
 			g_game.addMagicEffect(target->getPosition(), CONST_ME_CRITICAL_DAMAGE);
 		}
 
-		if (!damage.leeched && damage.primary.type != COMBAT_HEALING && casterPlayer && target != caster && damage.origin != ORIGIN_CONDITION) {
+		if (playerCaster && !damage.leeched && damage.primary.type != COMBAT_HEALING && target != caster && damage.origin != ORIGIN_CONDITION) {
 			CombatDamage leechCombat;
 			leechCombat.origin = ORIGIN_NONE;
 			leechCombat.leeched = true;
@@ -944,20 +939,39 @@ void Combat::doTargetCombat(Creature* caster, Creature* target, CombatDamage& da
 			}
 		}
 
-		if (params.dispelType == CONDITION_PARALYZE) {
-			target->removeCondition(CONDITION_PARALYZE);
-		} else {
-			target->removeCombatCondition(params.dispelType);
+		if (targetEffects) {
+			if (params.dispelType == CONDITION_PARALYZE) {
+				target->removeCondition(CONDITION_PARALYZE);
+			} else if (params.dispelType != CONDITION_NONE) {
+				target->removeCombatCondition(params.dispelType);
+			}
 		}
 	}
 
-	if (params.targetCallback) {
+	if (targetEffects && params.targetCallback) {
 		params.targetCallback->onTargetCombat(caster, target);
 	}
 }
 
+void Combat::doTargetCombat(Creature* caster, Creature* target, CombatDamage& damage, const CombatParams& params)
+{
+	Player* casterPlayer = caster ? caster->getPlayer() : nullptr;
+	if (casterPlayer) {
+		if (params.hasTargetEffects()) {
+			doTargetCombat<true, true>(caster, casterPlayer, target, damage, params);
+		} else {
+			doTargetCombat<true, false>(caster, casterPlayer, target, damage, params);
+		}
+	} else if (params.hasTargetEffects()) {
+		doTargetCombat<false, true>(caster, nullptr, target, damage, params);
+	} else {
+		doTargetCombat<false, false>(caster, nullptr, target, damage, params);
+	}
+}
+
 void Combat::doAreaCombat(Creature* caster, const Position& position, const AreaCombat* area, CombatDamage& damage, const CombatParams& params)
 {
+	TraceSpan traceSpan("Combat::doAreaCombat");
 	auto tiles = caster ? getCombatArea(caster->getPosition(), position, area) : getCombatArea(position, position, area);
 
 	Player* casterPlayer = caster ? caster->getPlayer() : nullptr;
@@ -989,6 +1003,7 @@ void Combat::doAreaCombat(Creature* caster, const Position& position, const Area
 	const int32_t rangeY = maxY + Map::maxViewportY;
 	SpectatorVec spectators;
 	g_game.map.getSpectators(spectators, position, true, true, rangeX, rangeX, rangeY, rangeY);
+	CombatSpectatorScope spectatorScope(g_game, spectators, position, maxX, maxY);
 	postCombatEffects(caster, position, params);
 	std::vector<Creature*> toDamageCreatures;
 	toDamageCreatures.reserve(100);
@@ -997,7 +1012,7 @@ void Combat::doAreaCombat(Creature* caster, const Position& position, const Area
 			continue;
 		}
 		combatTileEffects(spectators, caster, tile, params);
-		if (CreatureVector* creatures = tile->getCreatures()) {
+		if (TileCreatureVector* creatures = tile->getCreatures()) {
 			const Creature* topCreature = tile->getTopCreature();
 			for (Creature* creature : *creatures) {
 				if (params.targetCasterOrTopMost) {
@@ -1061,7 +1076,7 @@ void Combat::doAreaCombat(Creature* caster, const Position& position, const Area
 		if (damageCopy.critical) {
 			damageCopy.primary.value += playerCombatReduced ? (criticalPrimary / 2) : criticalPrimary;
 			damageCopy.secondary.value += playerCombatReduced ? (criticalSecondary / 2) : criticalSecondary;
-			g_game.addMagicEffect(creature->getPosition(), CONST_ME_CRITICAL_DAMAGE);
+			Game::addMagicEffect(spectators, creature->getPosition(), CONST_ME_CRITICAL_DAMAGE);
 		}
 		bool success = false;
 		if (damageCopy.primary.type != COMBAT_MANADRAIN) {
@@ -1156,8 +1171,52 @@ void Combat::doAreaCombat(Creature* caster, const Position& position, const Area
 
 //**********************************************************//
 
+namespace {
+
+// the arguments of a COMBAT_FORMULA_SKILL callback, also fills the element damage of the weapon
+void getSkillFormulaValues(Player* player, CombatDamage& damage, int32_t& attackSkill, int32_t& attackValue)
+{
+	Item* tool = player->getWeapon();
+	const Weapon* weapon = g_weapons->getWeapon(tool);
+	Item* item = nullptr;
+
+	attackValue = 7;
+	if (weapon) {
+		attackValue = tool->getAttack();
+		if (tool->getWeaponType() == WEAPON_AMMO) {
+			item = player->getWeapon(true);
+			if (item) {
+				attackValue += item->getAttack();
+			}
+		}
+
+		damage.secondary.type = weapon->getElementType();
+		damage.secondary.value = weapon->getElementDamage(player, nullptr, tool);
+	}
+	attackSkill = player->getWeaponSkill(item ? item : tool);
+}
+
+}
+
 void ValueCallback::getMinMaxValues(Player* player, CombatDamage& damage) const
 {
+	if (!pureFunction.empty()) {
+		lua_Number values[2];
+		bool called = false;
+		if (type == COMBAT_FORMULA_LEVELMAGIC) {
+			called = g_pureScripts.call(pureFunction, {static_cast<lua_Number>(player->getLevel()), static_cast<lua_Number>(player->getMagicLevel())}, values, 2);
+		} else if (type == COMBAT_FORMULA_SKILL) {
+			int32_t attackSkill, attackValue;
+			getSkillFormulaValues(player, damage, attackSkill, attackValue);
+			called = g_pureScripts.call(pureFunction, {static_cast<lua_Number>(attackSkill), static_cast<lua_Number>(attackValue), player->getAttackFactor()}, values, 2);
+		}
+
+		if (called) {
+			damage.primary.value = normal_random(static_cast<int32_t>(values[0]), static_cast<int32_t>(values[1]));
+		}
+		return;
+	}
+
 	//onGetPlayerMinMaxValues(...)
 	if (!scriptInterface->reserveScriptEnv()) {
 		std::cout << "[Error - ValueCallback::getMinMaxValues] Call stack overflow" << std::endl;
@@ -1174,8 +1233,7 @@ void ValueCallback::getMinMaxValues(Player* player, CombatDamage& damage) const
 
 	scriptInterface->pushFunction(scriptId);
 
-	LuaScriptInterface::pushUserdata<Player>(L, player);
-	LuaScriptInterface::setMetatable(L, -1, "Player");
+	LuaScriptInterface::pushCreature(L, player);
 
 	int parameters = 1;
 	switch (type) {
@@ -1189,25 +1247,10 @@ void ValueCallback::getMinMaxValues(Player* player, CombatDamage& damage) const
 
 		case COMBAT_FORMULA_SKILL: {
 			//onGetPlayerMinMaxValues(player, attackSkill, attackValue, attackFactor)
-			Item* tool = player->getWeapon();
-			const Weapon* weapon = g_weapons->getWeapon(tool);
-			Item* item = nullptr;
-
-			int32_t attackValue = 7;
-			if (weapon) {
-				attackValue = tool->getAttack();
-				if (tool->getWeaponType() == WEAPON_AMMO) {
-					item = player->getWeapon(true);
-					if (item) {
-						attackValue += item->getAttack();
-					}
-				}
+			int32_t attackSkill, attackValue;
+			getSkillFormulaValues(player, damage, attackSkill, attackValue);
 
-				damage.secondary.type = weapon->getElementType();
-				damage.secondary.value = weapon->getElementDamage(player, nullptr, tool);
-			}
-
-			lua_pushnumber(L, player->getWeaponSkill(item ? item : tool));
+			lua_pushnumber(L, attackSkill);
 			lua_pushnumber(L, attackValue);
 			lua_pushnumber(L, player->getAttackFactor());
 			parameters += 3;
@@ -1259,8 +1302,7 @@ void TileCallback::onTileCombat(Creature* creature, Tile* tile) const
 
 	scriptInterface->pushFunction(scriptId);
 	if (creature) {
-		LuaScriptInterface::pushUserdata<Creature>(L, creature);
-		LuaScriptInterface::setCreatureMetatable(L, -1, creature);
+		LuaScriptInterface::pushCreature(L, creature);
 	} else {
 		lua_pushnil(L);
 	}
@@ -1290,15 +1332,13 @@ void TargetCallback::onTargetCombat(Creature* creature, Creature* target) const
 	scriptInterface->pushFunction(scriptId);
 
 	if (creature) {
-		LuaScriptInterface::pushUserdata<Creature>(L, creature);
-		LuaScriptInterface::setCreatureMetatable(L, -1, creature);
+		LuaScriptInterface::pushCreature(L, creature);
 	} else {
 		lua_pushnil(L);
 	}
 
 	if (target) {
-		LuaScriptInterface::pushUserdata<Creature>(L, target);
-		LuaScriptInterface::setCreatureMetatable(L, -1, target);
+		LuaScriptInterface::pushCreature(L, target);
 	} else {
 		lua_pushnil(L);
 	}
@@ -1364,7 +1404,8 @@ MatrixArea MatrixArea::rotate270() const {
 	return {{center.second, cols - center.first - 1}, cols, rows, std::move(newArr)};
 }
 
-const MatrixArea& AreaCombat::getArea(const Position& centerPos, const Position& targetPos) const {
+Direction AreaCombat::getAreaDirection(const Position& centerPos, const Position& targetPos) const
+{
 	int32_t dx = Position::getOffsetX(targetPos, centerPos);
 	int32_t dy = Position::getOffsetY(targetPos, centerPos);
 
@@ -1390,7 +1431,11 @@ const MatrixArea& AreaCombat::getArea(const Position& centerPos, const Position&
 			dir = DIRECTION_SOUTHEAST;
 		}
 	}
+	return dir;
+}
 
+const MatrixArea& AreaCombat::getArea(const Position& centerPos, const Position& targetPos) const {
+	Direction dir = getAreaDirection(centerPos, targetPos);
 	if (dir >= areas.size()) {
 		// this should not happen. it means we forgot to call setupArea.
 		static MatrixArea empty;
@@ -1399,6 +1444,37 @@ const MatrixArea& AreaCombat::getArea(const Position& centerPos, const Position&
 	return areas[dir];
 }
 
+const AreaCombat::OffsetList& AreaCombat::getOffsets(const Position& centerPos, const Position& targetPos) const
+{
+	Direction dir = getAreaDirection(centerPos, targetPos);
+	if (dir >= offsets.size()) {
+		static OffsetList empty;
+		return empty;
+	}
+	return offsets[dir];
+}
+
+void AreaCombat::updateOffsets()
+{
+	offsets.clear();
+	offsets.resize(areas.size());
+
+	for (size_t i = 0, size = areas.size(); i < size; ++i) {
+		const MatrixArea& area = areas[i];
+		const auto& center = area.getCenter();
+
+		OffsetList& list = offsets[i];
+		for (uint32_t row = 0; row < area.getRows(); ++row) {
+			for (uint32_t col = 0; col < area.getCols(); ++col) {
+				if (area(row, col)) {
+					list.push_back({static_cast<int32_t>(col) - static_cast<int32_t>(center.first), static_cast<int32_t>(row) - static_cast<int32_t>(center.second)});
+				}
+			}
+		}
+		list.shrink_to_fit();
+	}
+}
+
 void AreaCombat::setupArea(const std::vector<uint32_t>& vec, uint32_t rows)
 {
 	auto area = createArea(vec, rows);
@@ -1410,6 +1486,7 @@ void AreaCombat::setupArea(const std::vector<uint32_t>& vec, uint32_t rows)
 	areas[DIRECTION_SOUTH] = area.rotate180();
 	areas[DIRECTION_WEST] = area.rotate270();
 	areas[DIRECTION_NORTH] = std::move(area);
+	updateOffsets();
 }
 
 void AreaCombat::setupArea(int32_t length, int32_t spread)
@@ -1495,6 +1572,7 @@ void AreaCombat::setupExtArea(const std::vector<uint32_t>& vec, uint32_t rows)
 	areas[DIRECTION_SOUTHWEST] = area.flip();
 	areas[DIRECTION_SOUTHEAST] = area.transpose();
 	areas[DIRECTION_NORTHWEST] = std::move(area);
+	updateOffsets();
 }
 
 //**********************************************************//
@@ -25,8 +25,14 @@ class ValueCallback final : public CallBack
 		explicit ValueCallback(formulaType_t type): type(type) {}
 		void getMinMaxValues(Player* player, CombatDamage& damage) const;
 
+		// uses a function of the pure scripts instead of the script interface
+		void setPureFunction(std::string name) {
+			pureFunction = std::move(name);
+		}
+
 	private:
 		formulaType_t type;
+		std::string pureFunction;
 };
 
 class TileCallback final : public CallBack
@@ -63,6 +69,11 @@ struct CombatParams {
 	bool aggressive = true;
 	bool useCharges = false;
 	bool ignoreResistances = false;
+
+	// conditions, dispel or a target callback run on every hit target
+	bool hasTargetEffects() const {
+		return !conditionList.empty() || dispelType != CONDITION_NONE || targetCallback;
+	}
 };
 
 class MatrixArea
@@ -104,14 +115,26 @@ class MatrixArea
 class AreaCombat
 {
 	public:
+		// position of an area cell relative to the target, in row order
+		struct Offset {
+			int32_t x;
+			int32_t y;
+		};
+		using OffsetList = std::vector<Offset>;
+
 		void setupArea(const std::vector<uint32_t>& vec, uint32_t rows);
 		void setupArea(int32_t length, int32_t spread);
 		void setupArea(int32_t radius);
 		void setupExtArea(const std::vector<uint32_t>& vec, uint32_t rows);
 		const MatrixArea& getArea(const Position& centerPos, const Position& targetPos) const;
+		const OffsetList& getOffsets(const Position& centerPos, const Position& targetPos) const;
 
 	private:
+		Direction getAreaDirection(const Position& centerPos, const Position& targetPos) const;
+		void updateOffsets();
+
 		std::vector<MatrixArea> areas;
+		std::vector<OffsetList> offsets;
 		bool hasExtArea = false;
 };
 
@@ -171,6 +194,10 @@ class Combat
 
 	private:
 		static void combatTileEffects(const SpectatorVec& spectators, Creature* caster, Tile* tile, const CombatParams& params);
+		// one instance per case, monster hits without conditions compile down
+		// to the block and the health change
+		template <bool playerCaster, bool targetEffects>
+		static void doTargetCombat(Creature* caster, Player* casterPlayer, Creature* target, CombatDamage& damage, const CombatParams& params);
 		CombatDamage getCombatDamage(Creature* creature, Creature* target) const;
 
 		//configurable
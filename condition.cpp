@@ -5,9 +5,40 @@
 
 #include "condition.h"
 #include "game.h"
+#include "lockfree.h"
+#include "memoryaccounting.h"
 
 extern Game g_game;
 
+static constexpr size_t CONDITION_FREE_LIST_CAPACITY = 4096;
+
+void* Condition::operator new(size_t size)
+{
+	MemoryAccounting::allocated(MEMORY_CONDITIONS, size);
+	if (size <= 64) {
+		return lockfreeAllocateBlock<64, CONDITION_FREE_LIST_CAPACITY>();
+	} else if (size <= 128) {
+		return lockfreeAllocateBlock<128, CONDITION_FREE_LIST_CAPACITY>();
+	} else if (size <= 256) {
+		return lockfreeAllocateBlock<256, CONDITION_FREE_LIST_CAPACITY>();
+	}
+	return ::operator new(size);
+}
+
+void Condition::operator delete(void* p, size_t size)
+{
+	MemoryAccounting::released(MEMORY_CONDITIONS, size);
+	if (size <= 64) {
+		lockfreeDeallocateBlock<64, CONDITION_FREE_LIST_CAPACITY>(p);
+	} else if (size <= 128) {
+		lockfreeDeallocateBlock<128, CONDITION_FREE_LIST_CAPACITY>(p);
+	} else if (size <= 256) {
+		lockfreeDeallocateBlock<256, CONDITION_FREE_LIST_CAPACITY>(p);
+	} else {
+		::operator delete(p);
+	}
+}
+
 bool Condition::setParam(ConditionParam_t param, int32_t value)
 {
 	switch (param) {
@@ -1287,7 +1318,7 @@ bool ConditionDamage::unserializeProp(ConditionAttr_t attr, PropStream& propStre
 			return false;
 		}
 
-		damageList.push_back(damageInfo);
+		addDamageRound(damageInfo);
 		if (ticks != -1) {
 			setTicks(ticks + damageInfo.interval);
 		}
@@ -1306,12 +1337,62 @@ void ConditionDamage::serialize(PropWriteStream& propWriteStream)
 	propWriteStream.write<uint8_t>(CONDITIONATTR_PERIODDAMAGE);
 	propWriteStream.write<int32_t>(periodDamage);
 
-	for (const IntervalInfo& intervalInfo : damageList) {
+	if (!hasDamageRounds()) {
+		return;
+	}
+
+	for (size_t i = nextRound, size = damageRounds->size(); i < size; ++i) {
+		IntervalInfo intervalInfo = (*damageRounds)[i];
+		if (i == nextRound) {
+			intervalInfo.timeLeft = roundTimeLeft;
+		}
+
 		propWriteStream.write<uint8_t>(CONDITIONATTR_INTERVALDATA);
 		propWriteStream.write<IntervalInfo>(intervalInfo);
 	}
 }
 
+void ConditionDamage::serializeTemplate(PropWriteStream& propWriteStream) const
+{
+	propWriteStream.write<int32_t>(initDamage);
+	propWriteStream.write<int32_t>(periodDamage);
+	propWriteStream.write<int32_t>(tickInterval);
+	propWriteStream.write<int32_t>(ticks);
+	propWriteStream.write<uint8_t>(forceUpdate);
+	propWriteStream.write<uint8_t>(field);
+
+	size_t rounds = damageRounds ? damageRounds->size() : 0;
+	propWriteStream.writeVarint(rounds);
+	for (size_t i = 0; i < rounds; ++i) {
+		propWriteStream.write<IntervalInfo>((*damageRounds)[i]);
+	}
+}
+
+bool ConditionDamage::unserializeTemplate(PropStream& propStream)
+{
+	int32_t templateTicks;
+	uint8_t forceUpdateValue, fieldValue;
+	uint64_t rounds;
+	if (!propStream.read<int32_t>(initDamage) || !propStream.read<int32_t>(periodDamage) || !propStream.read<int32_t>(tickInterval) ||
+			!propStream.read<int32_t>(templateTicks) || !propStream.read<uint8_t>(forceUpdateValue) || !propStream.read<uint8_t>(fieldValue) ||
+			!propStream.readVarint(rounds)) {
+		return false;
+	}
+
+	setTicks(templateTicks);
+	forceUpdate = forceUpdateValue != 0;
+	field = fieldValue != 0;
+
+	for (uint64_t i = 0; i < rounds; ++i) {
+		IntervalInfo damageInfo;
+		if (!propStream.read<IntervalInfo>(damageInfo)) {
+			return false;
+		}
+		addDamageRound(damageInfo);
+	}
+	return true;
+}
+
 bool ConditionDamage::updateCondition(const Condition* addCondition)
 {
 	const ConditionDamage& conditionDamage = static_cast<const ConditionDamage&>(*addCondition);
@@ -1348,7 +1429,7 @@ bool ConditionDamage::addDamage(int32_t rounds, int32_t time, int32_t value)
 		damageInfo.timeLeft = time;
 		damageInfo.value = value;
 
-		damageList.push_back(damageInfo);
+		addDamageRound(damageInfo);
 
 		if (ticks != -1) {
 			setTicks(ticks + damageInfo.interval);
@@ -1364,7 +1445,7 @@ bool ConditionDamage::init()
 		return true;
 	}
 
-	if (!damageList.empty()) {
+	if (hasDamageRounds()) {
 		return true;
 	}
 
@@ -1384,7 +1465,28 @@ bool ConditionDamage::init()
 			addDamage(1, tickInterval, -value);
 		}
 	}
-	return !damageList.empty();
+	return hasDamageRounds();
+}
+
+void ConditionDamage::addDamageRound(const IntervalInfo& damageInfo)
+{
+	if (!hasDamageRounds()) {
+		damageRounds = std::make_shared<std::vector<IntervalInfo>>();
+		nextRound = 0;
+		roundTimeLeft = damageInfo.timeLeft;
+	} else if (damageRounds.use_count() > 1 || nextRound != 0) {
+		// the remaining rounds become our own before they change
+		damageRounds = std::make_shared<std::vector<IntervalInfo>>(damageRounds->begin() + nextRound, damageRounds->end());
+		nextRound = 0;
+	}
+	damageRounds->push_back(damageInfo);
+}
+
+void ConditionDamage::popDamageRound()
+{
+	if (++nextRound < damageRounds->size()) {
+		roundTimeLeft = getCurrentRound().timeLeft;
+	}
 }
 
 bool ConditionDamage::startCondition(Creature* creature)
@@ -1415,20 +1517,19 @@ bool ConditionDamage::executeCondition(Creature* creature, int32_t interval)
 			periodDamageTick = 0;
 			doDamage(creature, periodDamage);
 		}
-	} else if (!damageList.empty()) {
-		IntervalInfo& damageInfo = damageList.front();
-
+	} else if (hasDamageRounds()) {
 		bool bRemove = (ticks != -1);
 		creature->onTickCondition(getType(), bRemove);
-		damageInfo.timeLeft -= interval;
+		roundTimeLeft -= interval;
 
-		if (damageInfo.timeLeft <= 0) {
+		if (roundTimeLeft <= 0) {
+			const IntervalInfo& damageInfo = getCurrentRound();
 			int32_t damage = damageInfo.value;
 
 			if (bRemove) {
-				damageList.pop_front();
+				popDamageRound();
 			} else {
-				damageInfo.timeLeft = damageInfo.interval;
+				roundTimeLeft = damageInfo.interval;
 			}
 
 			doDamage(creature, damage);
@@ -1451,11 +1552,10 @@ bool ConditionDamage::getNextDamage(int32_t& damage)
 	if (periodDamage != 0) {
 		damage = periodDamage;
 		return true;
-	} else if (!damageList.empty()) {
-		IntervalInfo& damageInfo = damageList.front();
-		damage = damageInfo.value;
+	} else if (hasDamageRounds()) {
+		damage = getCurrentRound().value;
 		if (ticks != -1) {
-			damageList.pop_front();
+			popDamageRound();
 		}
 		return true;
 	}
@@ -1518,20 +1618,19 @@ void ConditionDamage::addCondition(Creature* creature, const Condition* conditio
 	periodDamage = conditionDamage.periodDamage;
 	int32_t nextTimeLeft = tickInterval;
 
-	if (!damageList.empty()) {
+	if (hasDamageRounds()) {
 		//save previous timeLeft
-		IntervalInfo& damageInfo = damageList.front();
-		nextTimeLeft = damageInfo.timeLeft;
-		damageList.clear();
+		nextTimeLeft = roundTimeLeft;
 	}
 
-	damageList = conditionDamage.damageList;
+	damageRounds = conditionDamage.damageRounds;
+	nextRound = conditionDamage.nextRound;
+	roundTimeLeft = conditionDamage.roundTimeLeft;
 
 	if (init()) {
-		if (!damageList.empty()) {
+		if (hasDamageRounds()) {
 			//restore last timeLeft
-			IntervalInfo& damageInfo = damageList.front();
-			damageInfo.timeLeft = nextTimeLeft;
+			roundTimeLeft = nextTimeLeft;
 		}
 
 		if (!delayed) {
@@ -1546,10 +1645,10 @@ void ConditionDamage::addCondition(Creature* creature, const Condition* conditio
 int32_t ConditionDamage::getTotalDamage() const
 {
 	int32_t result;
-	if (!damageList.empty()) {
+	if (hasDamageRounds()) {
 		result = 0;
-		for (const IntervalInfo& intervalInfo : damageList) {
-			result += intervalInfo.value;
+		for (size_t i = nextRound, size = damageRounds->size(); i < size; ++i) {
+			result += (*damageRounds)[i].value;
 		}
 	} else {
 		result = minDamage + (maxDamage - minDamage) / 2;
@@ -62,6 +62,10 @@ class Condition
 			subId(subId), ticks(ticks), conditionType(type), isBuff(buff), aggressive(aggressive), id(id) {}
 		virtual ~Condition() = default;
 
+		// conditions are recycled through lock-free free lists by size class
+		static void* operator new(size_t size);
+		static void operator delete(void* p, size_t size);
+
 		virtual bool startCondition(Creature* creature);
 		virtual bool executeCondition(Creature* creature, int32_t interval);
 		virtual void endCondition(Creature* creature) = 0;
@@ -280,6 +284,10 @@ class ConditionDamage final : public Condition
 		void serialize(PropWriteStream& propWriteStream) override;
 		bool unserializeProp(ConditionAttr_t attr, PropStream& propStream) override;
 
+		// the damage of a template that was never started, as the asset cache keeps it
+		void serializeTemplate(PropWriteStream& propWriteStream) const;
+		bool unserializeTemplate(PropStream& propStream);
+
 	private:
 		int32_t maxDamage = 0;
 		int32_t minDamage = 0;
@@ -296,7 +304,21 @@ class ConditionDamage final : public Condition
 
 		bool init();
 
-		std::list<IntervalInfo> damageList;
+		// the damage rounds, shared with the template and its other clones until
+		// rounds are added; those before nextRound are dealt
+		std::shared_ptr<std::vector<IntervalInfo>> damageRounds;
+		uint32_t nextRound = 0;
+		// time left of the round at nextRound
+		int32_t roundTimeLeft = 0;
+
+		bool hasDamageRounds() const {
+			return damageRounds && nextRound < damageRounds->size();
+		}
+		const IntervalInfo& getCurrentRound() const {
+			return (*damageRounds)[nextRound];
+		}
+		void addDamageRound(const IntervalInfo& damageInfo);
+		void popDamageRound();
 
 		bool getNextDamage(int32_t& damage);
 		bool doDamage(Creature* creature, int32_t healthChange);
@@ -179,6 +179,8 @@ bool ConfigManager::load()
 	//parse config
 	if (!loaded) { //info that must be loaded one time (unless we reset the modules involved)
 		boolean[BIND_ONLY_GLOBAL_ADDRESS] = getGlobalBoolean(L, "bindOnlyGlobalAddress", false);
+		boolean[GAME_SOCKET_NODELAY] = getGlobalBoolean(L, "gameSocketNoDelay", true);
+		boolean[LOGIN_SOCKET_NODELAY] = getGlobalBoolean(L, "loginSocketNoDelay", true);
 		boolean[OPTIMIZE_DATABASE] = getGlobalBoolean(L, "startupDatabaseOptimization", true);
 
 		if (string[IP] == "") {
@@ -196,6 +198,11 @@ bool ConfigManager::load()
 
 		integer[SQL_PORT] = getGlobalNumber(L, "mysqlPort", 3306);
 
+		// an empty host sends every query to the primary
+		string[MYSQL_REPLICA_HOST] = getGlobalString(L, "mysqlReplicaHost", "");
+		integer[SQL_REPLICA_PORT] = getGlobalNumber(L, "mysqlReplicaPort", integer[SQL_PORT]);
+		integer[DATABASE_REPLICA_WORKERS] = getGlobalNumber(L, "databaseReplicaWorkers", 1);
+
 		if (integer[GAME_PORT] == 0) {
 			integer[GAME_PORT] = getGlobalNumber(L, "gameProtocolPort", 7172);
 		}
@@ -205,8 +212,32 @@ bool ConfigManager::load()
 		}
 
 		integer[STATUS_PORT] = getGlobalNumber(L, "statusProtocolPort", 7171);
+		integer[METRICS_PORT] = getGlobalNumber(L, "metricsProtocolPort", 0);
+
+		integer[GAME_SOCKET_SEND_BUFFER] = getGlobalNumber(L, "gameSocketSendBuffer", 0);
+		integer[GAME_SOCKET_RECEIVE_BUFFER] = getGlobalNumber(L, "gameSocketReceiveBuffer", 0);
+		integer[GAME_WRITE_HIGH_WATERMARK] = getGlobalNumber(L, "gameWriteHighWatermark", 65536);
+		integer[GAME_WRITE_LOW_WATERMARK] = getGlobalNumber(L, "gameWriteLowWatermark", 16384);
+		integer[LOGIN_SOCKET_SEND_BUFFER] = getGlobalNumber(L, "loginSocketSendBuffer", 0);
+		integer[LOGIN_SOCKET_RECEIVE_BUFFER] = getGlobalNumber(L, "loginSocketReceiveBuffer", 0);
 
 		integer[MARKET_OFFER_DURATION] = getGlobalNumber(L, "marketOfferDuration", 30 * 24 * 60 * 60);
+
+		// listening sockets per port bound with SO_REUSEPORT, up to one per network thread
+		integer[ACCEPTORS_PER_PORT] = getGlobalNumber(L, "acceptorsPerPort", 1);
+
+		// cores like "2,4-5" and realtime priorities from 1 to 99 for the hot threads, see ThreadPlacement
+		string[DISPATCHER_CPUS] = getGlobalString(L, "dispatcherCpus", "");
+		string[SCHEDULER_CPUS] = getGlobalString(L, "schedulerCpus", "");
+		string[DATABASE_CPUS] = getGlobalString(L, "databaseCpus", "");
+		string[NETWORK_CPUS] = getGlobalString(L, "networkCpus", "");
+		integer[DISPATCHER_PRIORITY] = getGlobalNumber(L, "dispatcherPriority", 0);
+		integer[SCHEDULER_PRIORITY] = getGlobalNumber(L, "schedulerPriority", 0);
+		integer[DATABASE_PRIORITY] = getGlobalNumber(L, "databasePriority", 0);
+		integer[NETWORK_PRIORITY] = getGlobalNumber(L, "networkPriority", 0);
+
+		// megabytes of huge page backed tiles, items and quadtree nodes, 0 keeps them on the heap
+		integer[HUGE_PAGE_ARENA_SIZE] = getGlobalNumber(L, "hugePageArenaSize", 0);
 	}
 
 	boolean[ALLOW_CHANGEOUTFIT] = getGlobalBoolean(L, "allowChangeOutfit", true);
@@ -244,6 +275,23 @@ bool ConfigManager::load()
 	boolean[ONLY_INVITED_CAN_MOVE_HOUSE_ITEMS] = getGlobalBoolean(L, "onlyInvitedCanMoveHouseItems", true);
 	boolean[REMOVE_ON_DESPAWN] = getGlobalBoolean(L, "removeOnDespawn", true);
 	boolean[PLAYER_CONSOLE_LOGS] = getGlobalBoolean(L, "showPlayerLogInConsole", true);
+	boolean[DISPATCHER_PROFILER] = getGlobalBoolean(L, "dispatcherProfiler", false);
+	boolean[LUA_PROFILER] = getGlobalBoolean(L, "luaProfiler", false);
+	boolean[LUA_BYTECODE_CACHE] = getGlobalBoolean(L, "luaBytecodeCache", false);
+	boolean[LAZY_MAP_LOADING] = getGlobalBoolean(L, "lazyMapLoading", false);
+	boolean[RAID_FLOW_FIELD_PATHING] = getGlobalBoolean(L, "raidFlowFieldPathing", false);
+	boolean[PACKET_COMPRESSION] = getGlobalBoolean(L, "packetCompression", false);
+	boolean[PACKET_FLOOD_CONTROL] = getGlobalBoolean(L, "packetFloodControl", true);
+	boolean[ASYNC_GLOBAL_SAVE] = getGlobalBoolean(L, "asyncGlobalSave", false);
+	boolean[BATCH_HEALTH_UPDATES] = getGlobalBoolean(L, "batchHealthUpdates", false);
+	boolean[THINK_LEVEL_OF_DETAIL] = getGlobalBoolean(L, "thinkLevelOfDetail", false);
+	boolean[COALESCE_PLAYER_UPDATES] = getGlobalBoolean(L, "coalescePlayerUpdates", false);
+	boolean[LUA_GC_GENERATIONAL] = getGlobalBoolean(L, "luaGcGenerational", false);
+	boolean[ITEM_BLOB_STORAGE] = getGlobalBoolean(L, "itemBlobStorage", false);
+	boolean[BATCH_CREATURE_MOVES] = getGlobalBoolean(L, "batchCreatureMoves", false);
+	boolean[LUA_POSITION_USERDATA] = getGlobalBoolean(L, "luaPositionUserdata", false);
+	boolean[LUA_FFI_FAST_PATHS] = getGlobalBoolean(L, "luaFfiFastPaths", false);
+	boolean[FAST_SHUTDOWN] = getGlobalBoolean(L, "fastShutdown", false);
 	boolean[WEATHER_RAIN] = getGlobalBoolean(L, "weatherRain", false);
 	boolean[WEATHER_THUNDER] = getGlobalBoolean(L, "thunderEffect", false);
 
@@ -255,6 +303,10 @@ bool ConfigManager::load()
 	string[LOCATION] = getGlobalString(L, "location", "");
 	string[MOTD] = getGlobalString(L, "motd", "");
 	string[WORLD_TYPE] = getGlobalString(L, "worldType", "pvp");
+	string[DISPATCHER_PROFILER_FILE] = getGlobalString(L, "dispatcherProfilerFile", "dispatcher_profile.log");
+	string[LUA_PROFILER_FILE] = getGlobalString(L, "luaProfilerFile", "lua_profile.log");
+	string[PLAYER_JOURNAL_FILE] = getGlobalString(L, "playerJournalFile", "player_journal.bin");
+	string[ASSET_CACHE_PATH] = getGlobalString(L, "assetCachePath", "");
 
 	integer[MAX_PLAYERS] = getGlobalNumber(L, "maxPlayers");
 	integer[PZ_LOCKED] = getGlobalNumber(L, "pzLocked", 60000);
@@ -292,14 +344,60 @@ bool ConfigManager::load()
 	integer[VIP_PREMIUM_LIMIT] = getGlobalNumber(L, "vipPremiumLimit", 100);
 	integer[DEPOT_FREE_LIMIT] = getGlobalNumber(L, "depotFreeLimit", 2000);
 	integer[DEPOT_PREMIUM_LIMIT] = getGlobalNumber(L, "depotPremiumLimit", 10000);
-
-	expStages = loadXMLStages();
+	integer[DISPATCHER_PROFILER_INTERVAL] = getGlobalNumber(L, "dispatcherProfilerInterval", 0);
+	integer[LUA_PROFILER_INTERVAL] = getGlobalNumber(L, "luaProfilerInterval", 0);
+	integer[LUA_PROFILER_SAMPLE_INTERVAL] = getGlobalNumber(L, "luaProfilerSampleInterval", 0);
+	integer[PATHFINDING_THREADS] = getGlobalNumber(L, "pathfindingThreads", 0);
+	integer[NETWORK_THREADS] = getGlobalNumber(L, "networkThreads", 1);
+	integer[LOGIN_THREADS] = getGlobalNumber(L, "loginThreads", 2);
+	integer[BULK_OUTPUT_BUDGET] = getGlobalNumber(L, "bulkOutputBudget", 8192);
+	integer[DATABASE_WORKERS] = getGlobalNumber(L, "databaseWorkers", 2);
+	integer[ACCOUNT_CACHE_DURATION] = getGlobalNumber(L, "accountCacheDuration", 60);
+	integer[PACKET_COMPRESSION_THRESHOLD] = getGlobalNumber(L, "packetCompressionThreshold", 128);
+	integer[PACKET_COMPRESSION_LEVEL] = getGlobalNumber(L, "packetCompressionLevel", 6);
+	integer[RANDOM_SEED] = getGlobalNumber(L, "randomSeed", 0);
+	integer[BAN_CACHE_INTERVAL] = getGlobalNumber(L, "banCacheInterval", 0);
+	integer[RAID_SPAWNS_PER_TICK] = getGlobalNumber(L, "raidSpawnsPerTick", 0);
+	integer[SLOW_TASK_THRESHOLD] = getGlobalNumber(L, "slowTaskThreshold", 0);
+	integer[LUA_GC_PAUSE] = getGlobalNumber(L, "luaGcPause", 200);
+	integer[LUA_GC_STEP_MULTIPLIER] = getGlobalNumber(L, "luaGcStepMultiplier", 200);
+	integer[LUA_GC_IDLE_STEP_SIZE] = getGlobalNumber(L, "luaGcIdleStepSize", 64);
+	integer[LUA_GC_IDLE_BUDGET] = getGlobalNumber(L, "luaGcIdleBudget", 500);
+	integer[PLAYER_JOURNAL_INTERVAL] = getGlobalNumber(L, "playerJournalInterval", 0);
+
+	ExperienceStages expStages = loadXMLStages();
 	if (expStages.empty()) {
 		expStages = loadLuaStages(L);
 	} else {
 		std::cout << "[Warning - ConfigManager::load] XML stages are deprecated, consider moving to config.lua." << std::endl;
 	}
-	expStages.shrink_to_fit();
+
+	// a level takes the first sorted stage containing it, the multiplier only
+	// changes where a stage starts or ends
+	std::vector<uint32_t> boundaries;
+	for (const auto& stage : expStages) {
+		boundaries.push_back(std::get<0>(stage));
+		if (std::get<1>(stage) != std::numeric_limits<uint32_t>::max()) {
+			boundaries.push_back(std::get<1>(stage) + 1);
+		}
+	}
+	std::sort(boundaries.begin(), boundaries.end());
+	boundaries.erase(std::unique(boundaries.begin(), boundaries.end()), boundaries.end());
+
+	expSteps.clear();
+	for (uint32_t level : boundaries) {
+		auto it = std::find_if(expStages.begin(), expStages.end(), [level](const ExperienceStages::value_type& stage) {
+			return level >= std::get<0>(stage) && level <= std::get<1>(stage);
+		});
+
+		bool staged = it != expStages.end();
+		float multiplier = staged ? std::get<2>(*it) : 0;
+		if (!expSteps.empty() && expSteps.back().staged == staged && expSteps.back().multiplier == multiplier) {
+			continue;
+		}
+		expSteps.push_back({level, multiplier, staged});
+	}
+	expSteps.shrink_to_fit();
 
 	loaded = true;
 	lua_close(L);
@@ -356,15 +454,14 @@ float ConfigManager::getFloat(floating_config_t what) const
 
 float ConfigManager::getExperienceStage(uint32_t level) const
 {
-	auto it = std::find_if(expStages.begin(), expStages.end(), [level](ExperienceStages::value_type stage) {
-		return level >= std::get<0>(stage) && level <= std::get<1>(stage);
+	auto it = std::upper_bound(expSteps.begin(), expSteps.end(), level, [](uint32_t level, const ExperienceStep& step) {
+		return level < step.fromLevel;
 	});
 
-	if (it == expStages.end()) {
+	if (it == expSteps.begin() || !(--it)->staged) {
 		return getNumber(ConfigManager::RATE_EXPERIENCE);
 	}
-
-	return std::get<2>(*it);
+	return it->multiplier;
 }
 
 bool ConfigManager::setString(string_config_t what, const std::string& value)
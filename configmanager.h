@@ -30,6 +30,8 @@ class ConfigManager
 			WEATHER_THUNDER,
 			ALLOW_WALKTHROUGH,
 			BIND_ONLY_GLOBAL_ADDRESS,
+			GAME_SOCKET_NODELAY,
+			LOGIN_SOCKET_NODELAY,
 			OPTIMIZE_DATABASE,
 			MARKET_PREMIUM,
 			EMOTE_SPELLS,
@@ -54,6 +56,23 @@ class ConfigManager
 			ONLY_INVITED_CAN_MOVE_HOUSE_ITEMS,
 			REMOVE_ON_DESPAWN,
 			PLAYER_CONSOLE_LOGS,
+			DISPATCHER_PROFILER,
+			LUA_PROFILER,
+			LUA_BYTECODE_CACHE,
+			LAZY_MAP_LOADING,
+			RAID_FLOW_FIELD_PATHING,
+			PACKET_COMPRESSION,
+			PACKET_FLOOD_CONTROL,
+			ASYNC_GLOBAL_SAVE,
+			BATCH_HEALTH_UPDATES,
+			THINK_LEVEL_OF_DETAIL,
+			COALESCE_PLAYER_UPDATES,
+			LUA_GC_GENERATIONAL,
+			ITEM_BLOB_STORAGE,
+			BATCH_CREATURE_MOVES,
+			LUA_POSITION_USERDATA,
+			LUA_FFI_FAST_PATHS,
+			FAST_SHUTDOWN,
 
 			LAST_BOOLEAN_CONFIG /* this must be the last one */
 		};
@@ -77,6 +96,15 @@ class ConfigManager
 			DEFAULT_PRIORITY,
 			MAP_AUTHOR,
 			CONFIG_FILE,
+			DISPATCHER_PROFILER_FILE,
+			LUA_PROFILER_FILE,
+			PLAYER_JOURNAL_FILE,
+			MYSQL_REPLICA_HOST,
+			ASSET_CACHE_PATH,
+			DISPATCHER_CPUS,
+			SCHEDULER_CPUS,
+			DATABASE_CPUS,
+			NETWORK_CPUS,
 
 			LAST_STRING_CONFIG /* this must be the last one */
 		};
@@ -108,6 +136,13 @@ class ConfigManager
 			GAME_PORT,
 			LOGIN_PORT,
 			STATUS_PORT,
+			GAME_SOCKET_SEND_BUFFER,
+			GAME_SOCKET_RECEIVE_BUFFER,
+			GAME_WRITE_HIGH_WATERMARK,
+			GAME_WRITE_LOW_WATERMARK,
+			LOGIN_SOCKET_SEND_BUFFER,
+			LOGIN_SOCKET_RECEIVE_BUFFER,
+			METRICS_PORT,
 			STAIRHOP_DELAY,
 			MARKET_OFFER_DURATION,
 			CHECK_EXPIRED_MARKET_OFFERS_EACH_MINUTES,
@@ -120,6 +155,34 @@ class ConfigManager
 			VIP_PREMIUM_LIMIT,
 			DEPOT_FREE_LIMIT,
 			DEPOT_PREMIUM_LIMIT,
+			DISPATCHER_PROFILER_INTERVAL,
+			LUA_PROFILER_INTERVAL,
+			LUA_PROFILER_SAMPLE_INTERVAL,
+			PATHFINDING_THREADS,
+			NETWORK_THREADS,
+			LOGIN_THREADS,
+			ACCEPTORS_PER_PORT,
+			BULK_OUTPUT_BUDGET,
+			DATABASE_WORKERS,
+			ACCOUNT_CACHE_DURATION,
+			PACKET_COMPRESSION_THRESHOLD,
+			PACKET_COMPRESSION_LEVEL,
+			RANDOM_SEED,
+			BAN_CACHE_INTERVAL,
+			RAID_SPAWNS_PER_TICK,
+			SLOW_TASK_THRESHOLD,
+			LUA_GC_PAUSE,
+			LUA_GC_STEP_MULTIPLIER,
+			LUA_GC_IDLE_STEP_SIZE,
+			LUA_GC_IDLE_BUDGET,
+			PLAYER_JOURNAL_INTERVAL,
+			SQL_REPLICA_PORT,
+			DATABASE_REPLICA_WORKERS,
+			DISPATCHER_PRIORITY,
+			SCHEDULER_PRIORITY,
+			DATABASE_PRIORITY,
+			NETWORK_PRIORITY,
+			HUGE_PAGE_ARENA_SIZE,
 
 			LAST_INTEGER_CONFIG /* this must be the last one */
 		};
@@ -151,7 +214,16 @@ class ConfigManager
 		bool boolean[LAST_BOOLEAN_CONFIG] = {};
 		float floating[LAST_FLOATING_CONFIG] = {};
 
-		ExperienceStages expStages = {};
+		// the stage multiplier from fromLevel up to the next step, the rate
+		// of the config where staged is false
+		struct ExperienceStep {
+			uint32_t fromLevel;
+			float multiplier;
+			bool staged;
+		};
+
+		// steps by ascending level for a binary search, built from the stages at load
+		std::vector<ExperienceStep> expSteps;
 
 		bool loaded = false;
 };
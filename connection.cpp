@@ -5,16 +5,19 @@
 
 #include "configmanager.h"
 #include "connection.h"
+#include "loginworkers.h"
+#include "metrics.h"
 #include "outputmessage.h"
 #include "protocol.h"
 #include "scheduler.h"
 #include "server.h"
+#include "tracer.h"
 
 extern ConfigManager g_config;
 
 Connection_ptr ConnectionManager::createConnection(boost::asio::io_service& io_service, ConstServicePort_ptr servicePort)
 {
-	std::lock_guard<std::mutex> lockClass(connectionManagerLock);
+	std::lock_guard<ProfiledMutex> lockClass(connectionManagerLock);
 
 	auto connection = std::make_shared<Connection>(io_service, servicePort);
 	connections.insert(connection);
@@ -23,14 +26,14 @@ Connection_ptr ConnectionManager::createConnection(boost::asio::io_service& io_s
 
 void ConnectionManager::releaseConnection(const Connection_ptr& connection)
 {
-	std::lock_guard<std::mutex> lockClass(connectionManagerLock);
+	std::lock_guard<ProfiledMutex> lockClass(connectionManagerLock);
 
 	connections.erase(connection);
 }
 
 void ConnectionManager::closeAll()
 {
-	std::lock_guard<std::mutex> lockClass(connectionManagerLock);
+	std::lock_guard<ProfiledMutex> lockClass(connectionManagerLock);
 
 	for (const auto& connection : connections) {
 		try {
@@ -50,7 +53,7 @@ void Connection::close(bool force)
 	//any thread
 	ConnectionManager::getInstance().releaseConnection(shared_from_this());
 
-	std::lock_guard<std::recursive_mutex> lockClass(connectionLock);
+	std::lock_guard<ProfiledRecursiveMutex> lockClass(connectionLock);
 	if (closed) {
 		return;
 	}
@@ -61,7 +64,7 @@ void Connection::close(bool force)
 			createTask(std::bind(&Protocol::release, protocol)));
 	}
 
-	if (messageQueue.empty() || force) {
+	if ((writingMessages.empty() && messageQueue.empty()) || force) {
 		closeSocket();
 	} else {
 		//will be closed by the destructor or onWriteOperation
@@ -98,15 +101,15 @@ void Connection::accept(Protocol_ptr protocol)
 
 void Connection::accept()
 {
-	std::lock_guard<std::recursive_mutex> lockClass(connectionLock);
+	std::lock_guard<ProfiledRecursiveMutex> lockClass(connectionLock);
 	try {
 		readTimer.expires_from_now(std::chrono::seconds(CONNECTION_READ_TIMEOUT));
-		readTimer.async_wait(std::bind(&Connection::handleTimeout, std::weak_ptr<Connection>(shared_from_this()), std::placeholders::_1));
+		readTimer.async_wait(boost::asio::bind_executor(strand, std::bind(&Connection::handleTimeout, std::weak_ptr<Connection>(shared_from_this()), std::placeholders::_1)));
 
 		// Read size of the first packet
 		boost::asio::async_read(socket,
 		                        boost::asio::buffer(msg.getBuffer(), NetworkMessage::HEADER_LENGTH),
-		                        std::bind(&Connection::parseHeader, shared_from_this(), std::placeholders::_1));
+		                        boost::asio::bind_executor(strand, std::bind(&Connection::parseHeader, shared_from_this(), std::placeholders::_1)));
 	} catch (boost::system::system_error& e) {
 		std::cout << "[Network error - Connection::accept] " << e.what() << std::endl;
 		close(FORCE_CLOSE);
@@ -115,7 +118,7 @@ void Connection::accept()
 
 void Connection::parseHeader(const boost::system::error_code& error)
 {
-	std::lock_guard<std::recursive_mutex> lockClass(connectionLock);
+	std::lock_guard<ProfiledRecursiveMutex> lockClass(connectionLock);
 	readTimer.cancel();
 
 	if (error) {
@@ -125,6 +128,23 @@ void Connection::parseHeader(const boost::system::error_code& error)
 		return;
 	}
 
+	if (protocol && !protocol->hasFramedMessages()) {
+		// the two bytes already read are the start of the request, take what followed them in one read
+		try {
+			readTimer.expires_from_now(std::chrono::seconds(CONNECTION_READ_TIMEOUT));
+			readTimer.async_wait(boost::asio::bind_executor(strand, std::bind(&Connection::handleTimeout, std::weak_ptr<Connection>(shared_from_this()),
+			                                    std::placeholders::_1)));
+
+			msg.reserve(NETWORKMESSAGE_MAXSIZE);
+			socket.async_read_some(boost::asio::buffer(msg.getBodyBuffer(), NETWORKMESSAGE_MAXSIZE - NetworkMessage::HEADER_LENGTH),
+			                       boost::asio::bind_executor(strand, std::bind(&Connection::parseRawMessage, shared_from_this(), std::placeholders::_1, std::placeholders::_2)));
+		} catch (boost::system::system_error& e) {
+			std::cout << "[Network error - Connection::parseHeader] " << e.what() << std::endl;
+			close(FORCE_CLOSE);
+		}
+		return;
+	}
+
 	uint32_t timePassed = std::max<uint32_t>(1, (time(nullptr) - timeConnected) + 1);
 	if ((++packetsSent / timePassed) > static_cast<uint32_t>(g_config.getNumber(ConfigManager::MAX_PACKETS_PER_SECOND))) {
 		std::cout << convertIPToString(getIP()) << " disconnected for exceeding packet per second limit." << std::endl;
@@ -145,13 +165,14 @@ void Connection::parseHeader(const boost::system::error_code& error)
 
 	try {
 		readTimer.expires_from_now(std::chrono::seconds(CONNECTION_READ_TIMEOUT));
-		readTimer.async_wait(std::bind(&Connection::handleTimeout, std::weak_ptr<Connection>(shared_from_this()),
-		                                    std::placeholders::_1));
+		readTimer.async_wait(boost::asio::bind_executor(strand, std::bind(&Connection::handleTimeout, std::weak_ptr<Connection>(shared_from_this()),
+		                                    std::placeholders::_1)));
 
 		// Read packet content
+		msg.reserve(size + NetworkMessage::HEADER_LENGTH);
 		msg.setLength(size + NetworkMessage::HEADER_LENGTH);
 		boost::asio::async_read(socket, boost::asio::buffer(msg.getBodyBuffer(), size),
-		                        std::bind(&Connection::parsePacket, shared_from_this(), std::placeholders::_1));
+		                        boost::asio::bind_executor(strand, std::bind(&Connection::parsePacket, shared_from_this(), std::placeholders::_1)));
 	} catch (boost::system::system_error& e) {
 		std::cout << "[Network error - Connection::parseHeader] " << e.what() << std::endl;
 		close(FORCE_CLOSE);
@@ -160,7 +181,8 @@ void Connection::parseHeader(const boost::system::error_code& error)
 
 void Connection::parsePacket(const boost::system::error_code& error)
 {
-	std::lock_guard<std::recursive_mutex> lockClass(connectionLock);
+	TraceSpan traceSpan("Connection::parsePacket");
+	std::lock_guard<ProfiledRecursiveMutex> lockClass(connectionLock);
 	readTimer.cancel();
 
 	if (error) {
@@ -170,6 +192,9 @@ void Connection::parsePacket(const boost::system::error_code& error)
 		return;
 	}
 
+	Metrics::add(METRIC_NETWORK_PACKETS_IN);
+	Metrics::add(METRIC_NETWORK_BYTES_IN, msg.getLength());
+
 	//Check packet checksum
 	uint32_t checksum;
 	int32_t len = msg.getLength() - msg.getBufferPosition() - NetworkMessage::CHECKSUM_LENGTH;
@@ -200,51 +225,135 @@ void Connection::parsePacket(const boost::system::error_code& error)
 			msg.skipBytes(1); // Skip protocol ID
 		}
 
+		// nothing is read until the worker is done with msg, then it arms the next read
+		if (protocol->decryptsFirstMessage() && g_loginWorkers.addTask(std::bind(&Connection::parseFirstMessage, shared_from_this()))) {
+			return;
+		}
+
 		protocol->onRecvFirstMessage(msg);
 	} else {
 		protocol->onRecvMessage(msg); // Send the packet to the current protocol
 	}
 
+	readNextPacket();
+}
+
+void Connection::parseFirstMessage()
+{
+	TraceSpan traceSpan("Connection::parseFirstMessage");
+	{
+		std::lock_guard<ProfiledRecursiveMutex> lockClass(connectionLock);
+		if (closed) {
+			return;
+		}
+
+		protocol->onRecvFirstMessage(msg);
+	}
+
+	boost::asio::post(strand, std::bind(&Connection::readNextPacket, shared_from_this()));
+}
+
+void Connection::readNextPacket()
+{
+	std::lock_guard<ProfiledRecursiveMutex> lockClass(connectionLock);
+	if (closed) {
+		return;
+	}
+
 	try {
 		readTimer.expires_from_now(std::chrono::seconds(CONNECTION_READ_TIMEOUT));
-		readTimer.async_wait(std::bind(&Connection::handleTimeout, std::weak_ptr<Connection>(shared_from_this()),
-		                                    std::placeholders::_1));
+		readTimer.async_wait(boost::asio::bind_executor(strand, std::bind(&Connection::handleTimeout, std::weak_ptr<Connection>(shared_from_this()),
+		                                    std::placeholders::_1)));
 
 		// Wait to the next packet
 		boost::asio::async_read(socket,
 		                        boost::asio::buffer(msg.getBuffer(), NetworkMessage::HEADER_LENGTH),
-		                        std::bind(&Connection::parseHeader, shared_from_this(), std::placeholders::_1));
+		                        boost::asio::bind_executor(strand, std::bind(&Connection::parseHeader, shared_from_this(), std::placeholders::_1)));
 	} catch (boost::system::system_error& e) {
-		std::cout << "[Network error - Connection::parsePacket] " << e.what() << std::endl;
+		std::cout << "[Network error - Connection::readNextPacket] " << e.what() << std::endl;
+		close(FORCE_CLOSE);
+	}
+}
+
+void Connection::parseRawMessage(const boost::system::error_code& error, size_t bytesTransferred)
+{
+	std::lock_guard<ProfiledRecursiveMutex> lockClass(connectionLock);
+	readTimer.cancel();
+
+	if (error) {
 		close(FORCE_CLOSE);
+		return;
+	} else if (closed) {
+		return;
 	}
+
+	Metrics::add(METRIC_NETWORK_PACKETS_IN);
+	Metrics::add(METRIC_NETWORK_BYTES_IN, bytesTransferred + NetworkMessage::HEADER_LENGTH);
+
+	// answered with a single response, nothing else is read from this connection
+	receivedFirst = true;
+	msg.setLength(bytesTransferred + NetworkMessage::HEADER_LENGTH);
+	msg.setBufferPosition(0);
+	protocol->onRecvFirstMessage(msg);
 }
 
 void Connection::send(const OutputMessage_ptr& msg)
 {
-	std::lock_guard<std::recursive_mutex> lockClass(connectionLock);
+	std::lock_guard<ProfiledRecursiveMutex> lockClass(connectionLock);
 	if (closed) {
 		return;
 	}
 
-	bool noPendingWrite = messageQueue.empty();
+	size_t pending = pendingBytes.fetch_add(msg->getLength(), std::memory_order_relaxed) + msg->getLength();
+	const SocketOptions& options = service_port->getSocketOptions();
+	if (options.highWatermark != 0 && pending > options.highWatermark) {
+		backpressured.store(true, std::memory_order_relaxed);
+	}
+
 	messageQueue.emplace_back(msg);
-	if (noPendingWrite) {
-		internalSend(msg);
+	if (writingMessages.empty() && !sendPending) {
+		// encryption runs on the network threads, not on the caller
+		sendPending = true;
+		boost::asio::post(strand, std::bind(&Connection::dispatchSend, shared_from_this()));
+	}
+}
+
+void Connection::dispatchSend()
+{
+	std::lock_guard<ProfiledRecursiveMutex> lockClass(connectionLock);
+	sendPending = false;
+	if (writingMessages.empty() && !messageQueue.empty()) {
+		internalSend();
 	}
 }
 
-void Connection::internalSend(const OutputMessage_ptr& msg)
+void Connection::internalSend()
 {
-	protocol->onSendMessage(msg);
+	TraceSpan traceSpan("Connection::internalSend");
+	writingMessages.swap(messageQueue);
+
+	writeBuffers.clear();
+	writeBuffers.reserve(writingMessages.size());
+	size_t bytes = 0;
+	writingBytes = 0;
+	for (const OutputMessage_ptr& msg : writingMessages) {
+		// counted as send added it, before headers and compression
+		writingBytes += msg->getLength();
+		protocol->onSendMessage(msg);
+		writeBuffers.emplace_back(msg->getOutputBuffer(), msg->getLength());
+		bytes += msg->getLength();
+	}
+
+	Metrics::add(METRIC_NETWORK_PACKETS_OUT, writingMessages.size());
+	Metrics::add(METRIC_NETWORK_BYTES_OUT, bytes);
+
 	try {
 		writeTimer.expires_from_now(std::chrono::seconds(CONNECTION_WRITE_TIMEOUT));
-		writeTimer.async_wait(std::bind(&Connection::handleTimeout, std::weak_ptr<Connection>(shared_from_this()),
-		                                     std::placeholders::_1));
+		writeTimer.async_wait(boost::asio::bind_executor(strand, std::bind(&Connection::handleTimeout, std::weak_ptr<Connection>(shared_from_this()),
+		                                     std::placeholders::_1)));
 
-		boost::asio::async_write(socket,
-		                         boost::asio::buffer(msg->getOutputBuffer(), msg->getLength()),
-		                         std::bind(&Connection::onWriteOperation, shared_from_this(), std::placeholders::_1));
+		boost::asio::async_write(socket, writeBuffers,
+		                         boost::asio::bind_executor(strand, std::bind(&Connection::onWriteOperation, shared_from_this(), std::placeholders::_1)));
 	} catch (boost::system::system_error& e) {
 		std::cout << "[Network error - Connection::internalSend] " << e.what() << std::endl;
 		close(FORCE_CLOSE);
@@ -253,7 +362,7 @@ void Connection::internalSend(const OutputMessage_ptr& msg)
 
 uint32_t Connection::getIP()
 {
-	std::lock_guard<std::recursive_mutex> lockClass(connectionLock);
+	std::lock_guard<ProfiledRecursiveMutex> lockClass(connectionLock);
 
 	// IP-address is expressed in network byte order
 	boost::system::error_code error;
@@ -267,9 +376,14 @@ uint32_t Connection::getIP()
 
 void Connection::onWriteOperation(const boost::system::error_code& error)
 {
-	std::lock_guard<std::recursive_mutex> lockClass(connectionLock);
+	std::lock_guard<ProfiledRecursiveMutex> lockClass(connectionLock);
 	writeTimer.cancel();
-	messageQueue.pop_front();
+	writingMessages.clear();
+	size_t pending = pendingBytes.fetch_sub(writingBytes, std::memory_order_relaxed) - writingBytes;
+	writingBytes = 0;
+	if (pending <= service_port->getSocketOptions().lowWatermark) {
+		backpressured.store(false, std::memory_order_relaxed);
+	}
 
 	if (error) {
 		messageQueue.clear();
@@ -278,7 +392,7 @@ void Connection::onWriteOperation(const boost::system::error_code& error)
 	}
 
 	if (!messageQueue.empty()) {
-		internalSend(messageQueue.front());
+		internalSend();
 	} else if (closed) {
 		closeSocket();
 	}
@@ -6,11 +6,25 @@
 
 #include <unordered_set>
 
+#include "lockprofiler.h"
 #include "networkmessage.h"
 
 static constexpr int32_t CONNECTION_WRITE_TIMEOUT = 30;
 static constexpr int32_t CONNECTION_READ_TIMEOUT = 30;
 
+// Tuning of the sockets a service accepts. Buffer sizes of 0 keep the system
+// default. Past the high watermark of unwritten output the connection reports
+// backpressure until it drains below the low one, a high watermark of 0 never
+// does.
+struct SocketOptions
+{
+	int32_t sendBufferSize = 0;
+	int32_t receiveBufferSize = 0;
+	size_t highWatermark = 0;
+	size_t lowWatermark = 0;
+	bool noDelay = true;
+};
+
 class Protocol;
 using Protocol_ptr = std::shared_ptr<Protocol>;
 class OutputMessage;
@@ -40,7 +54,7 @@ class ConnectionManager
 		ConnectionManager() = default;
 
 		std::unordered_set<Connection_ptr> connections;
-		std::mutex connectionManagerLock;
+		ProfiledMutex connectionManagerLock{"ConnectionManager::connectionManagerLock"};
 };
 
 class Connection : public std::enable_shared_from_this<Connection>
@@ -54,6 +68,7 @@ class Connection : public std::enable_shared_from_this<Connection>
 
 		Connection(boost::asio::io_service& io_service,
 		ConstServicePort_ptr service_port) :
+			strand(io_service),
 			readTimer(io_service),
 			writeTimer(io_service),
 			service_port(std::move(service_port)),
@@ -72,16 +87,29 @@ class Connection : public std::enable_shared_from_this<Connection>
 
 		uint32_t getIP();
 
+		// bytes handed to send that are not written to the socket yet, any thread
+		size_t getPendingBytes() const {
+			return pendingBytes.load(std::memory_order_relaxed);
+		}
+		// between crossing the high watermark and draining below the low one, any thread
+		bool isBackpressured() const {
+			return backpressured.load(std::memory_order_relaxed);
+		}
+
 	private:
 		void parseHeader(const boost::system::error_code& error);
 		void parsePacket(const boost::system::error_code& error);
+		void parseRawMessage(const boost::system::error_code& error, size_t bytesTransferred);
+		void parseFirstMessage();
+		void readNextPacket();
 
 		void onWriteOperation(const boost::system::error_code& error);
 
 		static void handleTimeout(ConnectionWeak_ptr connectionWeak, const boost::system::error_code& error);
 
 		void closeSocket();
-		void internalSend(const OutputMessage_ptr& msg);
+		void dispatchSend();
+		void internalSend();
 
 		boost::asio::ip::tcp::socket& getSocket() {
 			return socket;
@@ -90,12 +118,22 @@ class Connection : public std::enable_shared_from_this<Connection>
 
 		NetworkMessage msg;
 
+		// serializes the handlers of this connection when the io_service runs on several threads
+		boost::asio::io_service::strand strand;
+
 		boost::asio::steady_timer readTimer;
 		boost::asio::steady_timer writeTimer;
 
-		std::recursive_mutex connectionLock;
+		ProfiledRecursiveMutex connectionLock{"Connection::connectionLock"};
 
-		std::list<OutputMessage_ptr> messageQueue;
+		// messages queued while a write is in flight, they are sent together
+		// with one gathered write once it completes
+		std::vector<OutputMessage_ptr> messageQueue;
+		std::vector<OutputMessage_ptr> writingMessages;
+		std::vector<boost::asio::const_buffer> writeBuffers;
+		std::atomic<size_t> pendingBytes{0};
+		size_t writingBytes = 0;
+		std::atomic<bool> backpressured{false};
 
 		ConstServicePort_ptr service_port;
 		Protocol_ptr protocol;
@@ -107,6 +145,7 @@ class Connection : public std::enable_shared_from_this<Connection>
 
 		bool closed = false;
 		bool receivedFirst = false;
+		bool sendPending = false;
 };
 
 #endif
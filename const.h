@@ -685,6 +685,7 @@ enum GameFeature {
 	// advanced features
 	GamePacketSizeU32 = 110,
 	GamePacketCompression = 111,
+	GameCreatureMoveBatch = 112,
 
 	LastGameFeature = 120
 };
@@ -25,7 +25,7 @@ Container::Container(Tile* tile) : Container(ITEM_BROWSEFIELD, 30, false, true)
 	if (itemVector) {
 		for (Item* item : *itemVector) {
 			if ((item->getContainer() || item->hasProperty(CONST_PROP_MOVEABLE)) && !item->hasAttribute(ITEM_ATTRIBUTE_UNIQUEID)) {
-				itemlist.push_front(item);
+				pushFrontItem(item);
 				item->setParent(this);
 			}
 		}
@@ -81,7 +81,7 @@ bool Container::hasParent() const
 
 void Container::addItem(Item* item)
 {
-	itemlist.push_back(item);
+	pushBackItem(item);
 	item->setParent(this);
 }
 
@@ -135,6 +135,13 @@ void Container::updateItemWeight(int32_t diff)
 	totalWeight += diff;
 	if (Container* parentContainer = getParentContainer()) {
 		parentContainer->updateItemWeight(diff);
+	} else if (Cylinder* parent = getParent()) {
+		// every change below a container passes here, so it also keeps the item counts of the holder current
+		if (Creature* creature = parent->getCreature()) {
+			if (Player* player = creature->getPlayer()) {
+				player->invalidateItemTypeCounts();
+			}
+		}
 	}
 }
 
@@ -175,21 +182,82 @@ std::ostringstream& Container::getContentDescription(std::ostringstream& os) con
 	return os;
 }
 
-Item* Container::getItemByIndex(size_t index) const
+void Container::pushFrontItem(Item* item)
 {
-	if (index >= size()) {
-		return nullptr;
+	item->containerPosition = --positionBase;
+	itemlist.push_front(item);
+	updateItemTypeCount(item->getID(), item->getItemCount());
+	updateItemHoldingCount(getHoldingCount(item));
+}
+
+void Container::pushBackItem(Item* item)
+{
+	item->containerPosition = positionBase + itemlist.size();
+	itemlist.push_back(item);
+	updateItemTypeCount(item->getID(), item->getItemCount());
+	updateItemHoldingCount(getHoldingCount(item));
+}
+
+void Container::eraseItem(size_t index)
+{
+	Item* item = itemlist[index];
+	updateItemTypeCount(item->getID(), -item->getItemCount());
+	updateItemHoldingCount(-getHoldingCount(item));
+
+	// only the shorter side is renumbered, which is the side the deque moves as well
+	if (index < itemlist.size() / 2) {
+		for (size_t i = 0; i < index; ++i) {
+			++itemlist[i]->containerPosition;
+		}
+		++positionBase;
+	} else {
+		for (size_t i = index + 1, size = itemlist.size(); i < size; ++i) {
+			--itemlist[i]->containerPosition;
+		}
 	}
-	return itemlist[index];
+	itemlist.erase(itemlist.begin() + index);
 }
 
-uint32_t Container::getItemHoldingCount() const
+int32_t Container::getHoldingCount(const Item* item)
 {
-	uint32_t counter = 0;
-	for (ContainerIterator it = iterator(); it.hasNext(); it.advance()) {
-		++counter;
+	const Container* container = item->getContainer();
+	return container ? container->holdingCount + 1 : 1;
+}
+
+void Container::updateItemHoldingCount(int32_t diff)
+{
+	// the same path as the weight, so a parent sees every change below it
+	holdingCount += diff;
+	if (Container* parentContainer = getParentContainer()) {
+		parentContainer->updateItemHoldingCount(diff);
 	}
-	return counter;
+}
+
+void Container::updateItemTypeCount(uint16_t itemId, int32_t diff)
+{
+	auto it = std::lower_bound(itemTypeCounts.begin(), itemTypeCounts.end(), itemId, [](const std::pair<uint16_t, uint32_t>& entry, uint16_t id) {
+		return entry.first < id;
+	});
+
+	if (it == itemTypeCounts.end() || it->first != itemId) {
+		if (diff > 0) {
+			itemTypeCounts.emplace(it, itemId, diff);
+		}
+		return;
+	}
+
+	it->second += diff;
+	if (it->second == 0) {
+		itemTypeCounts.erase(it);
+	}
+}
+
+Item* Container::getItemByIndex(size_t index) const
+{
+	if (index >= size()) {
+		return nullptr;
+	}
+	return itemlist[index];
 }
 
 bool Container::isHoldingItem(const Item* item) const
@@ -578,7 +646,7 @@ void Container::addThing(int32_t index, Thing* thing)
 	}
 
 	item->setParent(this);
-	itemlist.push_front(item);
+	pushFrontItem(item);
 	updateItemWeight(item->getWeight());
 
 	//send change to client
@@ -611,8 +679,10 @@ void Container::updateThing(Thing* thing, uint16_t itemId, uint32_t count)
 	}
 
 	const int32_t oldWeight = item->getWeight();
+	updateItemTypeCount(item->getID(), -item->getItemCount());
 	item->setID(itemId);
 	item->setSubType(count);
+	updateItemTypeCount(item->getID(), item->getItemCount());
 	updateItemWeight(-oldWeight + item->getWeight());
 
 	//send change to client
@@ -633,6 +703,10 @@ void Container::replaceThing(uint32_t index, Thing* thing)
 		return /*RETURNVALUE_NOTPOSSIBLE*/;
 	}
 
+	updateItemTypeCount(replacedItem->getID(), -replacedItem->getItemCount());
+	updateItemTypeCount(item->getID(), item->getItemCount());
+	updateItemHoldingCount(getHoldingCount(item) - getHoldingCount(replacedItem));
+	item->containerPosition = replacedItem->containerPosition;
 	itemlist[index] = item;
 	item->setParent(this);
 	updateItemWeight(-static_cast<int32_t>(replacedItem->getWeight()) + item->getWeight());
@@ -660,6 +734,7 @@ void Container::removeThing(Thing* thing, uint32_t count)
 	if (item->isStackable() && count != item->getItemCount()) {
 		uint8_t newCount = static_cast<uint8_t>(std::max<int32_t>(0, item->getItemCount() - count));
 		const int32_t oldWeight = item->getWeight();
+		updateItemTypeCount(item->getID(), newCount - item->getItemCount());
 		item->setItemCount(newCount);
 		updateItemWeight(-oldWeight + item->getWeight());
 
@@ -676,15 +751,26 @@ void Container::removeThing(Thing* thing, uint32_t count)
 		}
 
 		item->setParent(nullptr);
-		itemlist.erase(itemlist.begin() + index);
+		eraseItem(index);
 	}
 }
 
 int32_t Container::getThingIndex(const Thing* thing) const
 {
-	int32_t index = 0;
-	for (Item* item : itemlist) {
-		if (item == thing) {
+	const Item* item = thing->getItem();
+	if (!item || item->getParent() != this) {
+		return -1;
+	}
+
+	uint32_t index = item->containerPosition - positionBase;
+	if (index < itemlist.size() && itemlist[index] == item) {
+		return index;
+	}
+
+	// a position that is out of date falls back to the scan
+	index = 0;
+	for (Item* listItem : itemlist) {
+		if (listItem == item) {
 			return index;
 		}
 		++index;
@@ -704,6 +790,13 @@ size_t Container::getLastIndex() const
 
 uint32_t Container::getItemTypeCount(uint16_t itemId, int32_t subType/* = -1*/) const
 {
+	if (subType == -1) {
+		auto it = std::lower_bound(itemTypeCounts.begin(), itemTypeCounts.end(), itemId, [](const std::pair<uint16_t, uint32_t>& entry, uint16_t id) {
+			return entry.first < id;
+		});
+		return it != itemTypeCounts.end() && it->first == itemId ? it->second : 0;
+	}
+
 	uint32_t count = 0;
 	for (Item* item : itemlist) {
 		if (item->getID() == itemId) {
@@ -715,8 +808,8 @@ uint32_t Container::getItemTypeCount(uint16_t itemId, int32_t subType/* = -1*/)
 
 std::map<uint32_t, uint32_t>& Container::getAllItemTypeCount(std::map<uint32_t, uint32_t>& countMap) const
 {
-	for (Item* item : itemlist) {
-		countMap[item->getID()] += item->getItemCount();
+	for (const auto& it : itemTypeCounts) {
+		countMap[it.first] += it.second;
 	}
 	return countMap;
 }
@@ -784,7 +877,7 @@ void Container::internalAddThing(uint32_t, Thing* thing)
 	}
 
 	item->setParent(this);
-	itemlist.push_front(item);
+	pushFrontItem(item);
 	updateItemWeight(item->getWeight());
 }
 
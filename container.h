@@ -101,7 +101,10 @@ class Container : public Item, public Cylinder
 		Item* getItemByIndex(size_t index) const;
 		bool isHoldingItem(const Item* item) const;
 
-		uint32_t getItemHoldingCount() const;
+		// all items below this one, nested ones included
+		uint32_t getItemHoldingCount() const {
+			return holdingCount;
+		}
 		uint32_t getWeight() const override final;
 
 		bool isUnlocked() const {
@@ -146,14 +149,28 @@ class Container : public Item, public Cylinder
 		void startDecaying() override final;
 
 	protected:
+		// every change of itemlist goes through these, they keep the positions and counts
+		void pushFrontItem(Item* item);
+		void pushBackItem(Item* item);
+		void eraseItem(size_t index);
+
 		ItemDeque itemlist;
 
 	private:
 		std::ostringstream& getContentDescription(std::ostringstream& os) const;
+		void updateItemTypeCount(uint16_t itemId, int32_t diff);
+		void updateItemHoldingCount(int32_t diff);
+		static int32_t getHoldingCount(const Item* item);
+
+		// item counts of the direct contents per item id, sorted by id
+		std::vector<std::pair<uint16_t, uint32_t>> itemTypeCounts;
 
 		uint32_t maxSize;
 		uint32_t totalWeight = 0;
+		uint32_t holdingCount = 0;
 		uint32_t serializationCount = 0;
+		// containerPosition of the front item, the index of an item is its position minus this
+		uint32_t positionBase = 0;
 
 		bool unlocked;
 		bool pagination;
@@ -3,10 +3,13 @@
 
 #include "otpch.h"
 
+#include <boost/container/small_vector.hpp>
+
 #include "creature.h"
 #include "game.h"
 #include "monster.h"
 #include "configmanager.h"
+#include "memoryaccounting.h"
 #include "scheduler.h"
 
 double Creature::speedA = 857.36;
@@ -17,6 +20,18 @@ extern Game g_game;
 extern ConfigManager g_config;
 extern CreatureEvents* g_creatureEvents;
 
+void* Creature::operator new(size_t size)
+{
+	MemoryAccounting::allocated(MEMORY_CREATURES, size);
+	return ::operator new(size);
+}
+
+void Creature::operator delete(void* p, size_t size)
+{
+	MemoryAccounting::released(MEMORY_CREATURES, size);
+	::operator delete(p);
+}
+
 Creature::Creature()
 {
 	onIdleStatus();
@@ -157,8 +172,7 @@ void Creature::onThink(uint32_t interval)
 	}
 
 	//scripting event - onThink
-	const CreatureEventList& thinkEvents = getCreatureEvents(CREATURE_EVENT_THINK);
-	for (CreatureEvent* thinkEvent : thinkEvents) {
+	for (CreatureEvent* thinkEvent : getCreatureEvents(CREATURE_EVENT_THINK)) {
 		thinkEvent->executeOnThink(this, interval);
 	}
 }
@@ -180,7 +194,7 @@ void Creature::onAttacking(uint32_t interval)
 void Creature::onIdleStatus()
 {
 	if (getHealth() > 0) {
-		damageMap.clear();
+		damageList.clear();
 		lastHitCreatureId = 0;
 	}
 }
@@ -306,17 +320,46 @@ void Creature::addEventWalk(bool firstStep)
 		g_game.checkCreatureWalk(getID());
 	}
 
-	eventWalk = g_scheduler.addEvent(createSchedulerTask(ticks, std::bind(&Game::checkCreatureWalk, &g_game, getID())));
+	if (getPlayer()) {
+		eventWalk = g_scheduler.addEvent(createSchedulerTask(ticks, std::bind(&Game::checkCreatureWalk, &g_game, getID())));
+	} else {
+		walkBatchTime = g_game.addWalkBatch(getID(), ticks);
+		eventWalk = WALK_BATCH_EVENT;
+	}
 }
 
 void Creature::stopEventWalk()
 {
-	if (eventWalk != 0) {
+	if (eventWalk == WALK_BATCH_EVENT) {
+		walkBatchTime = 0;
+		eventWalk = 0;
+	} else if (eventWalk != 0) {
 		g_scheduler.stopEvent(eventWalk);
 		eventWalk = 0;
 	}
 }
 
+uint32_t Creature::getThinkRateByNearestPlayer() const
+{
+	SpectatorVec spectators;
+	g_game.map.getSpectators(spectators, position, true, true);
+
+	int32_t nearest = std::numeric_limits<int32_t>::max();
+	for (Creature* spectator : spectators) {
+		const Position& pos = spectator->getPosition();
+		int32_t distance = std::max<int32_t>(Position::getDistanceX(position, pos), Position::getDistanceY(position, pos)) + Position::getDistanceZ(position, pos);
+		nearest = std::min(nearest, distance);
+	}
+
+	// full rate close to a player, then every second and every fourth cycle
+	if (nearest <= 4) {
+		return 1;
+	} else if (nearest <= 8) {
+		return 2;
+	}
+	return 4;
+}
+
 void Creature::updateMapCache()
 {
 	Tile* tile;
@@ -336,7 +379,13 @@ void Creature::updateMapCache()
 void Creature::updateTileCache(const Tile* tile, int32_t dx, int32_t dy)
 {
 	if (std::abs(dx) <= maxWalkCacheWidth && std::abs(dy) <= maxWalkCacheHeight) {
-		localMapCache[maxWalkCacheHeight + dy][maxWalkCacheWidth + dx] = tile && tile->queryAdd(0, *this, 1, FLAG_PATHFINDING | FLAG_IGNOREFIELDDAMAGE) == RETURNVALUE_NOERROR;
+		uint64_t& row = localMapCache[maxWalkCacheHeight + dy];
+		const uint64_t bit = uint64_t(1) << (maxWalkCacheWidth + dx);
+		if (tile && tile->queryAdd(0, *this, 1, FLAG_PATHFINDING | FLAG_IGNOREFIELDDAMAGE) == RETURNVALUE_NOERROR) {
+			row |= bit;
+		} else {
+			row &= ~bit;
+		}
 	}
 }
 
@@ -369,7 +418,7 @@ int32_t Creature::getWalkCache(const Position& pos) const
 	if (std::abs(dx) <= maxWalkCacheWidth) {
 		int32_t dy = Position::getOffsetY(pos, myPos);
 		if (std::abs(dy) <= maxWalkCacheHeight) {
-			if (localMapCache[maxWalkCacheHeight + dy][maxWalkCacheWidth + dx]) {
+			if (localMapCache[maxWalkCacheHeight + dy] & (uint64_t(1) << (maxWalkCacheWidth + dx))) {
 				return 1;
 			} else {
 				return 0;
@@ -515,9 +564,7 @@ void Creature::onCreatureMove(Creature* creature, const Tile* newTile, const Pos
 
 				if (oldPos.y > newPos.y) { //north
 					//shift y south
-					for (int32_t y = mapWalkHeight - 1; --y >= 0;) {
-						memcpy(localMapCache[y + 1], localMapCache[y], sizeof(localMapCache[y]));
-					}
+					std::copy_backward(localMapCache.begin(), localMapCache.end() - 1, localMapCache.end());
 
 					//update 0
 					for (int32_t x = -maxWalkCacheWidth; x <= maxWalkCacheWidth; ++x) {
@@ -526,9 +573,7 @@ void Creature::onCreatureMove(Creature* creature, const Tile* newTile, const Pos
 					}
 				} else if (oldPos.y < newPos.y) { // south
 					//shift y north
-					for (int32_t y = 0; y <= mapWalkHeight - 2; ++y) {
-						memcpy(localMapCache[y], localMapCache[y + 1], sizeof(localMapCache[y]));
-					}
+					std::copy(localMapCache.begin() + 1, localMapCache.end(), localMapCache.begin());
 
 					//update mapWalkHeight - 1
 					for (int32_t x = -maxWalkCacheWidth; x <= maxWalkCacheWidth; ++x) {
@@ -550,9 +595,7 @@ void Creature::onCreatureMove(Creature* creature, const Tile* newTile, const Pos
 					}
 
 					for (int32_t y = starty; y <= endy; ++y) {
-						for (int32_t x = 0; x <= mapWalkWidth - 2; ++x) {
-							localMapCache[y][x] = localMapCache[y][x + 1];
-						}
+						localMapCache[y] >>= 1;
 					}
 
 					//update mapWalkWidth - 1
@@ -573,9 +616,7 @@ void Creature::onCreatureMove(Creature* creature, const Tile* newTile, const Pos
 					}
 
 					for (int32_t y = starty; y <= endy; ++y) {
-						for (int32_t x = mapWalkWidth - 1; --x >= 0;) {
-							localMapCache[y][x + 1] = localMapCache[y][x];
-						}
+						localMapCache[y] = (localMapCache[y] << 1) & mapWalkRowMask;
 					}
 
 					//update 0
@@ -633,9 +674,13 @@ CreatureVector Creature::getKillers()
 	CreatureVector killers;
 	const int64_t timeNow = OTSYS_TIME();
 	const uint32_t inFightTicks = g_config.getNumber(ConfigManager::PZ_LOCKED);
-	for (const auto& it : damageMap) {
-		Creature* attacker = g_game.getCreatureByID(it.first);
-		if (attacker && attacker != this && timeNow - it.second.ticks <= inFightTicks) {
+	for (const DamageEntry& damage : damageList) {
+		if (timeNow - damage.ticks > inFightTicks) {
+			continue;
+		}
+
+		Creature* attacker = g_game.getCreatureByID(damage.attackerId);
+		if (attacker && attacker != this) {
 			killers.push_back(attacker);
 		}
 	}
@@ -660,17 +705,26 @@ void Creature::onDeath()
 	const int64_t timeNow = OTSYS_TIME();
 	const uint32_t inFightTicks = g_config.getNumber(ConfigManager::PZ_LOCKED);
 	int32_t mostDamage = 0;
-	std::map<Creature*, uint64_t> experienceMap;
-	for (const auto& it : damageMap) {
-		if (Creature* attacker = g_game.getCreatureByID(it.first)) {
-			CountBlock_t cb = it.second;
-			if ((cb.total > mostDamage && (timeNow - cb.ticks <= inFightTicks))) {
-				mostDamage = cb.total;
+
+	// the ratios of all attackers share one total and one lost experience
+	uint32_t totalDamage = 0;
+	for (const DamageEntry& damage : damageList) {
+		totalDamage += damage.total;
+	}
+	const uint64_t lostExperience = damageList.empty() ? 0 : getLostExperience();
+
+	std::vector<std::pair<Creature*, uint64_t>> experienceList;
+	experienceList.reserve(damageList.size());
+	for (const DamageEntry& damage : damageList) {
+		if (Creature* attacker = g_game.getCreatureByID(damage.attackerId)) {
+			if ((damage.total > mostDamage && (timeNow - damage.ticks <= inFightTicks))) {
+				mostDamage = damage.total;
 				mostDamageCreature = attacker;
 			}
 
 			if (attacker != this) {
-				uint64_t gainExp = getGainedExperience(attacker);
+				double damageRatio = totalDamage == 0 ? 0 : static_cast<double>(damage.total) / totalDamage;
+				uint64_t gainExp = getGainedExperience(attacker, damageRatio, lostExperience);
 				if (Player* attackerPlayer = attacker->getPlayer()) {
 					attackerPlayer->removeAttacked(getPlayer());
 
@@ -680,9 +734,9 @@ void Creature::onDeath()
 					}
 				}
 
-				auto tmpIt = experienceMap.find(attacker);
-				if (tmpIt == experienceMap.end()) {
-					experienceMap[attacker] = gainExp;
+				auto tmpIt = std::find_if(experienceList.begin(), experienceList.end(), [attacker](const std::pair<Creature*, uint64_t>& it) { return it.first == attacker; });
+				if (tmpIt == experienceList.end()) {
+					experienceList.emplace_back(attacker, gainExp);
 				} else {
 					tmpIt->second += gainExp;
 				}
@@ -690,7 +744,7 @@ void Creature::onDeath()
 		}
 	}
 
-	for (const auto& it : experienceMap) {
+	for (const auto& it : experienceList) {
 		it.first->onGainExperience(it.second, this);
 	}
 
@@ -720,8 +774,7 @@ bool Creature::dropCorpse(Creature* lastHitCreature, Creature* mostDamageCreatur
 	if (!lootDrop && getMonster()) {
 		if (master) {
 			//scripting event - onDeath
-			const CreatureEventList& deathEvents = getCreatureEvents(CREATURE_EVENT_DEATH);
-			for (CreatureEvent* deathEvent : deathEvents) {
+			for (CreatureEvent* deathEvent : getCreatureEvents(CREATURE_EVENT_DEATH)) {
 				deathEvent->executeOnDeath(this, nullptr, lastHitCreature, mostDamageCreature, lastHitUnjustified, mostDamageUnjustified);
 			}
 		}
@@ -769,13 +822,22 @@ bool Creature::dropCorpse(Creature* lastHitCreature, Creature* mostDamageCreatur
 	return true;
 }
 
+Creature::DamageList::const_iterator Creature::findDamage(uint32_t attackerId) const
+{
+	auto it = std::lower_bound(damageList.begin(), damageList.end(), attackerId, [](const DamageEntry& damage, uint32_t id) { return damage.attackerId < id; });
+	if (it != damageList.end() && it->attackerId != attackerId) {
+		return damageList.end();
+	}
+	return it;
+}
+
 bool Creature::hasBeenAttacked(uint32_t attackerId)
 {
-	auto it = damageMap.find(attackerId);
-	if (it == damageMap.end()) {
+	auto it = findDamage(attackerId);
+	if (it == damageList.end()) {
 		return false;
 	}
-	return (OTSYS_TIME() - it->second.ticks) <= g_config.getNumber(ConfigManager::PZ_LOCKED);
+	return (OTSYS_TIME() - it->ticks) <= g_config.getNumber(ConfigManager::PZ_LOCKED);
 }
 
 Item* Creature::getCorpse(Creature*, Creature*)
@@ -941,7 +1003,7 @@ void Creature::goToFollowCreature()
 			}
 		} else {
 			listWalkDir.clear();
-			if (getPathTo(followCreature->getPosition(), listWalkDir, fpp)) {
+			if ((monster && monster->getFlowFieldPath(followCreature, listWalkDir)) || getFollowPath(fpp)) {
 				hasFollowPath = true;
 				startAutoWalk();
 			} else {
@@ -953,6 +1015,55 @@ void Creature::goToFollowCreature()
 	onFollowCreatureComplete(followCreature);
 }
 
+bool Creature::getFollowPath(const FindPathParams& fpp)
+{
+	if (preparedPath.ready) {
+		preparedPath.ready = false;
+
+		const FindPathParams& preparedFpp = preparedPath.fpp;
+		if (preparedPath.startPos == getPosition() && preparedPath.targetPos == followCreature->getPosition() &&
+				preparedFpp.fullPathSearch == fpp.fullPathSearch && preparedFpp.clearSight == fpp.clearSight &&
+				preparedFpp.allowDiagonal == fpp.allowDiagonal && preparedFpp.keepDistance == fpp.keepDistance &&
+				preparedFpp.maxSearchDist == fpp.maxSearchDist && preparedFpp.minTargetDist == fpp.minTargetDist &&
+				preparedFpp.maxTargetDist == fpp.maxTargetDist) {
+			listWalkDir.swap(preparedPath.dirList);
+			return preparedPath.found;
+		}
+	}
+	return getPathTo(followCreature->getPosition(), listWalkDir, fpp);
+}
+
+bool Creature::prepareFollowPath(uint32_t interval)
+{
+	// same condition as onThink uses to update the follow path
+	if (!followCreature || (!isUpdatingPath && !forceUpdateFollowPath && walkUpdateTicks + interval < 2000)) {
+		return false;
+	}
+
+	FindPathParams fpp;
+	getPathSearchParams(followCreature, fpp);
+
+	// these try distance or flow field steps first, see goToFollowCreature
+	const Monster* monster = getMonster();
+	if (monster && ((!monster->getMaster() && (monster->isFleeing() || fpp.maxTargetDist > 1)) || monster->isFlowFieldPathing())) {
+		return false;
+	}
+
+	preparedPath.fpp = fpp;
+	preparedPath.startPos = getPosition();
+	preparedPath.targetPos = followCreature->getPosition();
+	preparedPath.ready = false;
+	return true;
+}
+
+void Creature::searchPreparedPath()
+{
+	// bypasses the shared path cache, it is not thread safe
+	preparedPath.dirList.clear();
+	preparedPath.found = g_game.map.getPathMatching(*this, preparedPath.dirList, FrozenPathingConditionCall(preparedPath.targetPos), preparedPath.fpp);
+	preparedPath.ready = true;
+}
+
 bool Creature::setFollowCreature(Creature* creature)
 {
 	if (creature) {
@@ -987,16 +1098,13 @@ bool Creature::setFollowCreature(Creature* creature)
 double Creature::getDamageRatio(Creature* attacker) const
 {
 	uint32_t totalDamage = 0;
-	uint32_t attackerDamage = 0;
-
-	for (const auto& it : damageMap) {
-		const CountBlock_t& cb = it.second;
-		totalDamage += cb.total;
-		if (it.first == attacker->getID()) {
-			attackerDamage += cb.total;
-		}
+	for (const DamageEntry& damage : damageList) {
+		totalDamage += damage.total;
 	}
 
+	auto it = findDamage(attacker->getID());
+	uint32_t attackerDamage = it != damageList.end() ? it->total : 0;
+
 	if (totalDamage == 0) {
 		return 0;
 	}
@@ -1006,7 +1114,12 @@ double Creature::getDamageRatio(Creature* attacker) const
 
 uint64_t Creature::getGainedExperience(Creature* attacker) const
 {
-	return std::floor(getDamageRatio(attacker) * getLostExperience());
+	return getGainedExperience(attacker, getDamageRatio(attacker), getLostExperience());
+}
+
+uint64_t Creature::getGainedExperience(Creature*, double damageRatio, uint64_t lostExperience) const
+{
+	return std::floor(damageRatio * lostExperience);
 }
 
 void Creature::addDamagePoints(Creature* attacker, int32_t damagePoints)
@@ -1017,15 +1130,12 @@ void Creature::addDamagePoints(Creature* attacker, int32_t damagePoints)
 
 	uint32_t attackerId = attacker->id;
 
-	auto it = damageMap.find(attackerId);
-	if (it == damageMap.end()) {
-		CountBlock_t cb;
-		cb.ticks = OTSYS_TIME();
-		cb.total = damagePoints;
-		damageMap[attackerId] = cb;
+	auto it = std::lower_bound(damageList.begin(), damageList.end(), attackerId, [](const DamageEntry& damage, uint32_t id) { return damage.attackerId < id; });
+	if (it == damageList.end() || it->attackerId != attackerId) {
+		damageList.insert(it, {attackerId, damagePoints, OTSYS_TIME()});
 	} else {
-		it->second.total += damagePoints;
-		it->second.ticks = OTSYS_TIME();
+		it->total += damagePoints;
+		it->ticks = OTSYS_TIME();
 	}
 
 	lastHitCreatureId = attackerId;
@@ -1115,8 +1225,7 @@ bool Creature::onKilledCreature(Creature* target, bool)
 	}
 
 	//scripting event - onKill
-	const CreatureEventList& killEvents = getCreatureEvents(CREATURE_EVENT_KILL);
-	for (CreatureEvent* killEvent : killEvents) {
+	for (CreatureEvent* killEvent : getCreatureEvents(CREATURE_EVENT_KILL)) {
 		killEvent->executeOnKill(this, target);
 	}
 	return false;
@@ -1326,7 +1435,12 @@ Condition* Creature::getCondition(ConditionType_t type, ConditionId_t conditionI
 
 void Creature::executeConditions(uint32_t interval)
 {
-	ConditionList tempConditions{ conditions };
+	if (conditions.empty()) {
+		return;
+	}
+
+	// executing a condition may add or remove others, so walk a snapshot that lives on the stack
+	boost::container::small_vector<Condition*, 8> tempConditions(conditions.begin(), conditions.end());
 	for (Condition* condition : tempConditions) {
 		auto it = std::find(conditions.begin(), conditions.end(), condition);
 		if (it == conditions.end()) {
@@ -1512,27 +1626,6 @@ bool Creature::unregisterCreatureEvent(const std::string& name)
 	return true;
 }
 
-CreatureEventList Creature::getCreatureEvents(CreatureEventType_t type)
-{
-	CreatureEventList tmpEventList;
-
-	if (!hasEventRegistered(type)) {
-		return tmpEventList;
-	}
-
-	for (CreatureEvent* creatureEvent : eventsList) {
-		if (!creatureEvent->isLoaded()) {
-			continue;
-		}
-
-		if (creatureEvent->getEventType() == type) {
-			tmpEventList.push_back(creatureEvent);
-		}
-	}
-
-	return tmpEventList;
-}
-
 bool FrozenPathingConditionCall::isInRange(const Position& startPos, const Position& testPos,
         const FindPathParams& fpp) const
 {
@@ -1624,7 +1717,7 @@ bool Creature::isInvisible() const
 
 bool Creature::getPathTo(const Position& targetPos, std::vector<Direction>& dirList, const FindPathParams& fpp) const
 {
-	return g_game.map.getPathMatching(*this, dirList, FrozenPathingConditionCall(targetPos), fpp);
+	return g_game.map.getPathTo(*this, targetPos, dirList, fpp);
 }
 
 bool Creature::getPathTo(const Position& targetPos, std::vector<Direction>& dirList, int32_t minTargetDist, int32_t maxTargetDist, bool fullPathSearch /*= true*/, bool clearSight /*= true*/, int32_t maxSearchDist /*= 0*/) const
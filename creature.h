@@ -11,9 +11,99 @@
 #include "tile.h"
 #include "enums.h"
 #include "creatureevent.h"
+#include "creatureidtable.h"
 
 using ConditionList = std::list<Condition*>;
-using CreatureEventList = std::list<CreatureEvent*>;
+using CreatureEventList = std::vector<CreatureEvent*>;
+
+// The loaded events of one type among those a creature registered, read from
+// its list by index while they are iterated. Nothing is copied, and a script
+// that registers or unregisters events while one of them runs does not leave
+// the loop with a dangling iterator.
+class CreatureEventRange
+{
+	public:
+		class iterator
+		{
+			public:
+				iterator(const CreatureEventList* events, size_t index, CreatureEventType_t type) : events(events), index(index), type(type) {
+					skip();
+				}
+
+				CreatureEvent* operator*() const {
+					return (*events)[index];
+				}
+				iterator& operator++() {
+					++index;
+					skip();
+					return *this;
+				}
+				bool operator==(const iterator& other) const {
+					return index == other.index;
+				}
+				bool operator!=(const iterator& other) const {
+					return index != other.index;
+				}
+
+			private:
+				void skip() {
+					if (!events) {
+						return;
+					}
+
+					while (index < events->size()) {
+						const CreatureEvent* event = (*events)[index];
+						if (event->getEventType() == type && event->isLoaded()) {
+							return;
+						}
+						++index;
+					}
+					index = END;
+				}
+
+				const CreatureEventList* events;
+				size_t index;
+				CreatureEventType_t type;
+		};
+
+		// empty for null events
+		CreatureEventRange(const CreatureEventList* events, CreatureEventType_t type) : events(events), type(type) {}
+
+		iterator begin() const {
+			return iterator(events, events ? 0 : END, type);
+		}
+		iterator end() const {
+			return iterator(nullptr, END, type);
+		}
+		bool empty() const {
+			return begin() == end();
+		}
+		size_t size() const {
+			size_t count = 0;
+			for (auto it = begin(), last = end(); it != last; ++it) {
+				++count;
+			}
+			return count;
+		}
+
+	private:
+		static constexpr size_t END = std::numeric_limits<size_t>::max();
+
+		const CreatureEventList* events;
+		CreatureEventType_t type;
+};
+
+// what a non-player creature is told about the creatures around it beyond
+// what it tracks itself, players are told everything
+enum CreatureInterest_t : uint8_t {
+	CREATURE_INTEREST_NONE = 0,
+	// onCreatureSay for what any creature says
+	CREATURE_INTEREST_SPEECH = 1 << 0,
+	// onCreatureSay for what players say
+	CREATURE_INTEREST_PLAYER_SPEECH = 1 << 1,
+
+	CREATURE_INTEREST_HEARING = CREATURE_INTEREST_SPEECH | CREATURE_INTEREST_PLAYER_SPEECH,
+};
 
 enum slots_t : uint8_t {
 	CONST_SLOT_WHEREEVER = 0,
@@ -90,6 +180,10 @@ class Creature : virtual public Thing
 
 		virtual ~Creature();
 
+		// players and npcs are counted here, monsters by their own pool
+		static void* operator new(size_t size);
+		static void operator delete(void* p, size_t size);
+
 		// non-copyable
 		Creature(const Creature&) = delete;
 		Creature& operator=(const Creature&) = delete;
@@ -181,6 +275,10 @@ class Creature : virtual public Thing
 		virtual bool isInGhostMode() const {
 			return false;
 		}
+		// see CreatureInterest_t, changed through Map::setInterests
+		uint8_t getInterests() const {
+			return interests;
+		}
 		bool noMove = false;
 		bool canMove() const {
     		return !noMove;
@@ -258,6 +356,9 @@ class Creature : virtual public Thing
 		void startAutoWalk(const std::vector<Direction>& listDir);
 		void addEventWalk(bool firstStep = false);
 		void stopEventWalk();
+
+		// players keep a scheduler event per step, the scheduler never hands out this id
+		static constexpr uint32_t WALK_BATCH_EVENT = std::numeric_limits<uint32_t>::max();
 		virtual void goToFollowCreature();
 
 		//walk events
@@ -357,7 +458,7 @@ class Creature : virtual public Thing
 
 		CreatureVector getKillers();
 		void onDeath();
-		virtual uint64_t getGainedExperience(Creature* attacker) const;
+		uint64_t getGainedExperience(Creature* attacker) const;
 		void addDamagePoints(Creature* attacker, int32_t damagePoints);
 		bool hasBeenAttacked(uint32_t attackerId);
 
@@ -385,6 +486,11 @@ class Creature : virtual public Thing
 
 		virtual void onThink(uint32_t interval);
 		void onAttacking(uint32_t interval);
+
+		// think cycles per think when thinkLevelOfDetail is enabled, see Game::checkCreatures
+		virtual uint32_t getThinkRate() const {
+			return 1;
+		}
 		virtual void onWalk();
 		virtual bool getNextStep(Direction& dir, uint32_t& flags);
 
@@ -469,6 +575,14 @@ class Creature : virtual public Thing
 		bool getPathTo(const Position& targetPos, std::vector<Direction>& dirList, const FindPathParams& fpp) const;
 		bool getPathTo(const Position& targetPos, std::vector<Direction>& dirList, int32_t minTargetDist, int32_t maxTargetDist, bool fullPathSearch = true, bool clearSight = true, int32_t maxSearchDist = 0) const;
 
+		// follow path searches done ahead of onThink by Game::checkCreatures,
+		// searchPreparedPath only reads the world and may run on a worker thread
+		bool prepareFollowPath(uint32_t interval);
+		void searchPreparedPath();
+		void clearPreparedPath() {
+			preparedPath.ready = false;
+		}
+
 		void incrementReferenceCounter() {
 			++referenceCounter;
 		}
@@ -477,26 +591,36 @@ class Creature : virtual public Thing
 				delete this;
 			}
 		}
+		uint32_t getReferenceCounter() const {
+			return referenceCounter;
+		}
 
 	protected:
 		virtual bool useCacheMap() const {
 			return false;
 		}
 
-		struct CountBlock_t {
+		// the damage of one attacker, the list is sorted by attacker id and
+		// stays small, so it is searched like a map without its nodes
+		struct DamageEntry {
+			uint32_t attackerId;
 			int32_t total;
 			int64_t ticks;
 		};
+		using DamageList = std::vector<DamageEntry>;
+
+		DamageList::const_iterator findDamage(uint32_t attackerId) const;
 
 		static constexpr int32_t mapWalkWidth = Map::maxViewportX * 2 + 1;
 		static constexpr int32_t mapWalkHeight = Map::maxViewportY * 2 + 1;
 		static constexpr int32_t maxWalkCacheWidth = (mapWalkWidth - 1) / 2;
 		static constexpr int32_t maxWalkCacheHeight = (mapWalkHeight - 1) / 2;
+		static constexpr uint64_t mapWalkRowMask = (uint64_t(1) << mapWalkWidth) - 1;
+		static_assert(mapWalkWidth < 64, "a walk cache row must fit in 64 bits");
 
 		Position position;
 
-		using CountMap = std::map<uint32_t, CountBlock_t>;
-		CountMap damageMap;
+		DamageList damageList;
 
 		std::list<Creature*> summons;
 		CreatureEventList eventsList;
@@ -504,15 +628,27 @@ class Creature : virtual public Thing
 
 		std::vector<Direction> listWalkDir;
 
+		struct PreparedPath {
+			FindPathParams fpp;
+			Position startPos;
+			Position targetPos;
+			std::vector<Direction> dirList;
+			bool found = false;
+			bool ready = false;
+		};
+		PreparedPath preparedPath;
+
 		Tile* tile = nullptr;
 		Creature* attackedCreature = nullptr;
 		Creature* master = nullptr;
 		Creature* followCreature = nullptr;
 
 		uint64_t lastStep = 0;
+		int64_t walkBatchTime = 0;
 		uint32_t referenceCounter = 0;
 		uint32_t id = 0;
 		uint32_t scriptEventsBitField = 0;
+		// WALK_BATCH_EVENT while a step waits in the walk batch of walkBatchTime
 		uint32_t eventWalk = 0;
 		uint32_t walkUpdateTicks = 0;
 		uint32_t lastHitCreatureId = 0;
@@ -524,6 +660,7 @@ class Creature : virtual public Thing
 		int32_t health = 1000;
 		int32_t healthMax = 1000;
 		uint8_t drunkenness = 0;
+		uint8_t interests = CREATURE_INTEREST_NONE;
 
 		Outfit_t currentOutfit;
 		Outfit_t defaultOutfit;
@@ -531,17 +668,22 @@ class Creature : virtual public Thing
 		Position lastPosition;
 		LightInfo internalLight;
 
+		// one bit per tile around the creature, bit x of row y is set when the tile is walkable
+		std::array<uint64_t, mapWalkHeight> localMapCache = {};
+
 		Direction direction = DIRECTION_SOUTH;
 		Skulls_t skull = SKULL_NONE;
 		GuildEmblems_t emblem = GUILDEMBLEM_NONE;
 		int32_t level = 0;
 
-		bool localMapCache[mapWalkHeight][mapWalkWidth] = {{ false }};
 		bool isInternalRemoved = false;
 		bool isMapLoaded = false;
 		bool isUpdatingPath = false;
 		bool creatureCheck = false;
 		bool inCheckCreaturesVector = false;
+		uint8_t checkCreatureBucket = 0;
+		uint8_t skippedThinks = 0;
+		uint32_t checkCreatureSlot = 0;
 		bool skillLoss = true;
 		bool lootDrop = true;
 		bool cancelNextWalk = false;
@@ -555,17 +697,23 @@ class Creature : virtual public Thing
 		bool hasEventRegistered(CreatureEventType_t event) const {
 			return (0 != (scriptEventsBitField & (static_cast<uint32_t>(1) << event)));
 		}
-		CreatureEventList getCreatureEvents(CreatureEventType_t type);
+		// empty without a registered event of the type, see CreatureEventRange
+		CreatureEventRange getCreatureEvents(CreatureEventType_t type) const {
+			return CreatureEventRange(hasEventRegistered(type) ? &eventsList : nullptr, type);
+		}
 
 		void updateMapCache();
 		void updateTileCache(const Tile* tile, int32_t dx, int32_t dy);
 		void updateTileCache(const Tile* tile, const Position& pos);
 		void onCreatureDisappear(const Creature* creature, bool isLogout);
+		uint32_t getThinkRateByNearestPlayer() const;
 		virtual void doAttacking(uint32_t) {}
 		virtual bool hasExtraSwing() {
 			return false;
 		}
 
+		// the share of lostExperience attacker gains for damageRatio of the damage
+		virtual uint64_t getGainedExperience(Creature* attacker, double damageRatio, uint64_t lostExperience) const;
 		virtual uint64_t getLostExperience() const {
 			return 0;
 		}
@@ -574,6 +722,7 @@ class Creature : virtual public Thing
 			return 0;
 		}
 		virtual void getPathSearchParams(const Creature* creature, FindPathParams& fpp) const;
+		bool getFollowPath(const FindPathParams& fpp);
 		virtual void death(Creature*) {}
 		virtual bool dropCorpse(Creature* lastHitCreature, Creature* mostDamageCreature, bool lastHitUnjustified, bool mostDamageUnjustified);
 		virtual Item* getCorpse(Creature* lastHitCreature, Creature* mostDamageCreature);
@@ -4,6 +4,7 @@
 #include "otpch.h"
 
 #include "creatureevent.h"
+#include "json.h"
 #include "tools.h"
 #include "player.h"
 
@@ -13,6 +14,8 @@ CreatureEvents::CreatureEvents() :
 	scriptInterface.initState();
 }
 
+std::array<std::atomic<bool>, std::numeric_limits<uint8_t>::max() + 1> CreatureEvents::jsonOpcodes;
+
 void CreatureEvents::clear(bool fromLua)
 {
 	for (auto it = creatureEvents.begin(); it != creatureEvents.end(); ++it) {
@@ -59,6 +62,8 @@ bool CreatureEvents::registerEvent(Event_ptr event, const pugi::xml_node&)
 		return false;
 	}
 
+	markJsonOpcodes(*creatureEvent);
+
 	CreatureEvent* oldEvent = getEventByName(creatureEvent->getName(), false);
 	if (oldEvent) {
 		//if there was an event with the same that is not loaded
@@ -83,6 +88,8 @@ bool CreatureEvents::registerLuaEvent(CreatureEvent* event)
 		return false;
 	}
 
+	markJsonOpcodes(*creatureEvent);
+
 	CreatureEvent* oldEvent = getEventByName(creatureEvent->getName(), false);
 	if (oldEvent) {
 		//if there was an event with the same that is not loaded
@@ -99,6 +106,19 @@ bool CreatureEvents::registerLuaEvent(CreatureEvent* event)
 	}
 }
 
+void CreatureEvents::markJsonOpcodes(const CreatureEvent& event)
+{
+	if (event.getEventType() != CREATURE_EVENT_EXTENDED_OPCODE || !event.decodesJson()) {
+		return;
+	}
+
+	for (size_t opcode = 0; opcode < jsonOpcodes.size(); ++opcode) {
+		if (event.handlesOpcode(opcode)) {
+			jsonOpcodes[opcode].store(true, std::memory_order_relaxed);
+		}
+	}
+}
+
 CreatureEvent* CreatureEvents::getEventByName(const std::string& name, bool forceLoaded /*= true*/)
 {
 	auto it = creatureEvents.find(name);
@@ -197,6 +217,25 @@ bool CreatureEvent::configureEvent(const pugi::xml_node& node)
 		type = CREATURE_EVENT_MANACHANGE;
 	} else if (tmpStr == "extendedopcode") {
 		type = CREATURE_EVENT_EXTENDED_OPCODE;
+
+		pugi::xml_attribute opcodeAttribute = node.attribute("opcode");
+		if (opcodeAttribute) {
+			int32_t opcode = opcodeAttribute.as_int(-1);
+			if (opcode < 0 || opcode > std::numeric_limits<uint8_t>::max()) {
+				std::cout << "[Error - CreatureEvent::configureEvent] Invalid opcode for creature event: " << eventName << std::endl;
+				return false;
+			}
+			extendedOpcode = opcode;
+		}
+
+		pugi::xml_attribute decodeAttribute = node.attribute("decode");
+		if (decodeAttribute) {
+			if (asLowerCaseString(decodeAttribute.as_string()) != "json") {
+				std::cout << "[Error - CreatureEvent::configureEvent] Invalid decode for creature event: " << eventName << std::endl;
+				return false;
+			}
+			decodeJson = true;
+		}
 	} else {
 		std::cout << "[Error - CreatureEvent::configureEvent] Invalid type for creature event: " << eventName << std::endl;
 		return false;
@@ -258,6 +297,8 @@ void CreatureEvent::copyEvent(CreatureEvent* creatureEvent)
 	scriptInterface = creatureEvent->scriptInterface;
 	scripted = creatureEvent->scripted;
 	loaded = creatureEvent->loaded;
+	extendedOpcode = creatureEvent->extendedOpcode;
+	decodeJson = creatureEvent->decodeJson;
 }
 
 void CreatureEvent::clearEvent()
@@ -320,8 +361,7 @@ bool CreatureEvent::executeOnThink(Creature* creature, uint32_t interval)
 	lua_State* L = scriptInterface->getLuaState();
 
 	scriptInterface->pushFunction(scriptId);
-	LuaScriptInterface::pushUserdata<Creature>(L, creature);
-	LuaScriptInterface::setCreatureMetatable(L, -1, creature);
+	LuaScriptInterface::pushCreature(L, creature);
 	lua_pushnumber(L, interval);
 
 	return scriptInterface->callFunction(2);
@@ -342,12 +382,10 @@ bool CreatureEvent::executeOnPrepareDeath(Creature* creature, Creature* killer)
 
 	scriptInterface->pushFunction(scriptId);
 
-	LuaScriptInterface::pushUserdata<Creature>(L, creature);
-	LuaScriptInterface::setCreatureMetatable(L, -1, creature);
+	LuaScriptInterface::pushCreature(L, creature);
 
 	if (killer) {
-		LuaScriptInterface::pushUserdata<Creature>(L, killer);
-		LuaScriptInterface::setCreatureMetatable(L, -1, killer);
+		LuaScriptInterface::pushCreature(L, killer);
 	} else {
 		lua_pushnil(L);
 	}
@@ -369,21 +407,18 @@ bool CreatureEvent::executeOnDeath(Creature* creature, Item* corpse, Creature* k
 	lua_State* L = scriptInterface->getLuaState();
 
 	scriptInterface->pushFunction(scriptId);
-	LuaScriptInterface::pushUserdata<Creature>(L, creature);
-	LuaScriptInterface::setCreatureMetatable(L, -1, creature);
+	LuaScriptInterface::pushCreature(L, creature);
 
 	LuaScriptInterface::pushThing(L, corpse);
 
 	if (killer) {
-		LuaScriptInterface::pushUserdata<Creature>(L, killer);
-		LuaScriptInterface::setCreatureMetatable(L, -1, killer);
+		LuaScriptInterface::pushCreature(L, killer);
 	} else {
 		lua_pushnil(L);
 	}
 
 	if (mostDamageKiller) {
-		LuaScriptInterface::pushUserdata<Creature>(L, mostDamageKiller);
-		LuaScriptInterface::setCreatureMetatable(L, -1, mostDamageKiller);
+		LuaScriptInterface::pushCreature(L, mostDamageKiller);
 	} else {
 		lua_pushnil(L);
 	}
@@ -432,10 +467,8 @@ void CreatureEvent::executeOnKill(Creature* creature, Creature* target)
 	lua_State* L = scriptInterface->getLuaState();
 
 	scriptInterface->pushFunction(scriptId);
-	LuaScriptInterface::pushUserdata<Creature>(L, creature);
-	LuaScriptInterface::setCreatureMetatable(L, -1, creature);
-	LuaScriptInterface::pushUserdata<Creature>(L, target);
-	LuaScriptInterface::setCreatureMetatable(L, -1, target);
+	LuaScriptInterface::pushCreature(L, creature);
+	LuaScriptInterface::pushCreature(L, target);
 	scriptInterface->callVoidFunction(2);
 }
 
@@ -566,9 +599,9 @@ void CreatureEvent::executeManaChange(Creature* creature, Creature* attacker, Co
 	scriptInterface->resetScriptEnv();
 }
 
-void CreatureEvent::executeExtendedOpcode(Player* player, uint8_t opcode, const std::string& buffer)
+void CreatureEvent::executeExtendedOpcode(Player* player, uint8_t opcode, const std::string& buffer, const JsonValue* data)
 {
-	//onExtendedOpcode(player, opcode, buffer)
+	//onExtendedOpcode(player, opcode, buffer[, data])
 	if (!scriptInterface->reserveScriptEnv()) {
 		std::cout << "[Error - CreatureEvent::executeExtendedOpcode] Call stack overflow" << std::endl;
 		return;
@@ -581,11 +614,21 @@ void CreatureEvent::executeExtendedOpcode(Player* player, uint8_t opcode, const
 
 	scriptInterface->pushFunction(scriptId);
 
-	LuaScriptInterface::pushUserdata<Player>(L, player);
-	LuaScriptInterface::setMetatable(L, -1, "Player");
+	LuaScriptInterface::pushCreature(L, player);
 
 	lua_pushnumber(L, opcode);
 	LuaScriptInterface::pushString(L, buffer);
 
-	scriptInterface->callVoidFunction(3);
+	if (!decodeJson) {
+		scriptInterface->callVoidFunction(3);
+		return;
+	}
+
+	// nil when the payload is not valid JSON
+	if (data) {
+		LuaScriptInterface::pushJsonValue(L, *data);
+	} else {
+		lua_pushnil(L);
+	}
+	scriptInterface->callVoidFunction(4);
 }
@@ -9,6 +9,7 @@
 #include "enums.h"
 
 class CreatureEvent;
+struct JsonValue;
 using CreatureEvent_ptr = std::unique_ptr<CreatureEvent>;
 
 enum CreatureEventType_t {
@@ -53,6 +54,22 @@ class CreatureEvent final : public Event
 			loaded = b;
 		}
 
+		// extended opcode events run for one opcode only, or for any when negative
+		void setOpcode(int16_t value) {
+			extendedOpcode = value;
+		}
+		bool handlesOpcode(uint8_t opcode) const {
+			return extendedOpcode < 0 || extendedOpcode == opcode;
+		}
+		// the payload is decoded as JSON before it reaches the game thread
+		// and handed to the callback as a table
+		bool decodesJson() const {
+			return decodeJson;
+		}
+		void setDecodeJson(bool value) {
+			decodeJson = value;
+		}
+
 		void clearEvent();
 		void copyEvent(CreatureEvent* creatureEvent);
 
@@ -68,7 +85,7 @@ class CreatureEvent final : public Event
 		bool executeTextEdit(Player* player, Item* item, const std::string& text);
 		void executeHealthChange(Creature* creature, Creature* attacker, CombatDamage& damage);
 		void executeManaChange(Creature* creature, Creature* attacker, CombatDamage& damage);
-		void executeExtendedOpcode(Player* player, uint8_t opcode, const std::string& buffer);
+		void executeExtendedOpcode(Player* player, uint8_t opcode, const std::string& buffer, const JsonValue* data);
 		//
 
 	private:
@@ -76,6 +93,8 @@ class CreatureEvent final : public Event
 
 		std::string eventName;
 		CreatureEventType_t type;
+		int16_t extendedOpcode = -1;
+		bool decodeJson = false;
 		bool loaded;
 };
 
@@ -100,7 +119,14 @@ class CreatureEvents final : public BaseEvents
 
 		void removeInvalidEvents();
 
+		// read by the network threads; flags are only ever set, a stale one
+		// decodes a payload no handler reads
+		static bool isJsonOpcode(uint8_t opcode) {
+			return jsonOpcodes[opcode].load(std::memory_order_relaxed);
+		}
+
 	private:
+		static void markJsonOpcodes(const CreatureEvent& event);
 		LuaScriptInterface& getScriptInterface() override;
 		std::string getScriptBaseName() const override;
 		Event_ptr getEvent(const std::string& nodeName) override;
@@ -111,6 +137,8 @@ class CreatureEvents final : public BaseEvents
 		CreatureEventMap creatureEvents;
 
 		LuaScriptInterface scriptInterface;
+
+		static std::array<std::atomic<bool>, std::numeric_limits<uint8_t>::max() + 1> jsonOpcodes;
 };
 
 #endif
@@ -0,0 +1,106 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#ifndef FS_CREATUREIDTABLE_H_E3A1F0C75B8D4C2E9F6A0B4D7C1E8F35
+#define FS_CREATUREIDTABLE_H_E3A1F0C75B8D4C2E9F6A0B4D7C1E8F35
+
+#include <deque>
+#include <vector>
+
+// Ids of one creature class and the creatures listed under them. An id is the
+// base of the class, the generation of its slot and the slot, so resolving it
+// is an index and a compare. Releasing a slot bumps its generation and freed
+// slots are taken again oldest first, so an id kept by a delayed task does
+// not resolve to the next creature of that slot. Dispatcher thread.
+template <typename T>
+class CreatureIdTable
+{
+	public:
+		static constexpr uint32_t SLOT_BITS = 20;
+
+		// the ids of the class are base plus idBits low bits
+		CreatureIdTable(uint32_t base, uint32_t idBits) : base(base), baseMask(~((1u << idBits) - 1)), generationMask((1u << (idBits - SLOT_BITS)) - 1) {}
+
+		// non-copyable
+		CreatureIdTable(const CreatureIdTable&) = delete;
+		CreatureIdTable& operator=(const CreatureIdTable&) = delete;
+
+		bool contains(uint32_t id) const {
+			return (id & baseMask) == base;
+		}
+
+		// the listed creature, nullptr for ids of other classes, stale ids and
+		// ids whose creature is not on the map
+		T* get(uint32_t id) const {
+			uint32_t slot = id & SLOT_MASK;
+			if (!contains(id) || slot >= slots.size()) {
+				return nullptr;
+			}
+
+			const Slot& entry = slots[slot];
+			return entry.id == id ? entry.creature : nullptr;
+		}
+
+		// a fresh id, its slot is taken until release; 0 once every slot is
+		uint32_t reserve() {
+			uint32_t slot;
+			if (!freeSlots.empty()) {
+				slot = freeSlots.front();
+				freeSlots.pop_front();
+			} else if (slots.size() <= SLOT_MASK) {
+				slot = slots.size();
+				slots.emplace_back();
+			} else {
+				return 0;
+			}
+
+			Slot& entry = slots[slot];
+			entry.id = base | ((entry.generation & generationMask) << SLOT_BITS) | slot;
+			return entry.id;
+		}
+
+		void release(uint32_t id) {
+			Slot* entry = find(id);
+			if (!entry) {
+				return;
+			}
+
+			entry->id = 0;
+			entry->creature = nullptr;
+			++entry->generation;
+			freeSlots.push_back(id & SLOT_MASK);
+		}
+
+		// lists the creature under its reserved id, nullptr takes it off again
+		void setCreature(uint32_t id, T* creature) {
+			if (Slot* entry = find(id)) {
+				entry->creature = creature;
+			}
+		}
+
+	private:
+		static constexpr uint32_t SLOT_MASK = (1u << SLOT_BITS) - 1;
+
+		struct Slot {
+			T* creature = nullptr;
+			// 0 while the slot is free
+			uint32_t id = 0;
+			uint32_t generation = 0;
+		};
+
+		Slot* find(uint32_t id) {
+			uint32_t slot = id & SLOT_MASK;
+			if (id == 0 || !contains(id) || slot >= slots.size() || slots[slot].id != id) {
+				return nullptr;
+			}
+			return &slots[slot];
+		}
+
+		std::vector<Slot> slots;
+		std::deque<uint32_t> freeSlots;
+		const uint32_t base;
+		const uint32_t baseMask;
+		const uint32_t generationMask;
+};
+
+#endif
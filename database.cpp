@@ -6,18 +6,36 @@
 #include "configmanager.h"
 #include "database.h"
 
+#include <fmt/format.h>
 #include <mysql/errmsg.h>
 
 extern ConfigManager g_config;
 
+namespace {
+
+// bounds the statements kept open on the server per connection
+constexpr size_t MAX_PREPARED_STATEMENTS = 128;
+// limit of placeholders in a single prepared statement
+constexpr size_t MAX_STATEMENT_PARAMS = 65535;
+
+constexpr unsigned int ER_UNKNOWN_STMT_HANDLER = 1243;
+
+bool isConnectionError(unsigned int error)
+{
+	return error == CR_SERVER_LOST || error == CR_SERVER_GONE_ERROR || error == CR_CONN_HOST_ERROR || error == 1053/*ER_SERVER_SHUTDOWN*/ || error == CR_CONNECTION_ERROR;
+}
+
+}
+
 Database::~Database()
 {
+	clearStatements();
 	if (handle != nullptr) {
 		mysql_close(handle);
 	}
 }
 
-bool Database::connect()
+bool Database::connect(bool replica/* = false*/)
 {
 	// connection handle initialization
 	handle = mysql_init(nullptr);
@@ -30,8 +48,11 @@ bool Database::connect()
 	bool reconnect = true;
 	mysql_options(handle, MYSQL_OPT_RECONNECT, &reconnect);
 
-	// connects to database
-	if (!mysql_real_connect(handle, g_config.getString(ConfigManager::MYSQL_HOST).c_str(), g_config.getString(ConfigManager::MYSQL_USER).c_str(), g_config.getString(ConfigManager::MYSQL_PASS).c_str(), g_config.getString(ConfigManager::MYSQL_DB).c_str(), g_config.getNumber(ConfigManager::SQL_PORT), g_config.getString(ConfigManager::MYSQL_SOCK).c_str(), 0)) {
+	// connects to database, the socket is only used by the primary
+	const std::string& host = g_config.getString(replica ? ConfigManager::MYSQL_REPLICA_HOST : ConfigManager::MYSQL_HOST);
+	int32_t port = g_config.getNumber(replica ? ConfigManager::SQL_REPLICA_PORT : ConfigManager::SQL_PORT);
+	const char* sock = replica ? nullptr : g_config.getString(ConfigManager::MYSQL_SOCK).c_str();
+	if (!mysql_real_connect(handle, host.c_str(), g_config.getString(ConfigManager::MYSQL_USER).c_str(), g_config.getString(ConfigManager::MYSQL_PASS).c_str(), g_config.getString(ConfigManager::MYSQL_DB).c_str(), port, sock, 0)) {
 		std::cout << std::endl << "MySQL Error Message: " << mysql_error(handle) << std::endl;
 		return false;
 	}
@@ -77,8 +98,28 @@ bool Database::commit()
 	return true;
 }
 
+bool Database::executeTransaction(const DBStatements& statements)
+{
+	if (!beginTransaction()) {
+		return false;
+	}
+
+	for (const DBStatement& statement : statements) {
+		if (!executeQuery(statement.query, statement.params)) {
+			rollback();
+			return false;
+		}
+	}
+	return commit();
+}
+
 bool Database::executeQuery(const std::string& query)
 {
+	// never connected, e.g. in a simulation, every query fails quietly
+	if (!handle) {
+		return false;
+	}
+
 	bool success = true;
 
 	// executes the query
@@ -104,8 +145,95 @@ bool Database::executeQuery(const std::string& query)
 	return success;
 }
 
+bool Database::executeQuery(const std::string& query, const DBParams& params)
+{
+	if (params.empty() || !handle) {
+		return executeQuery(query);
+	}
+
+	std::vector<MYSQL_BIND> binds(params.size());
+	std::vector<unsigned long> lengths(params.size());
+	for (size_t i = 0; i < params.size(); ++i) {
+		const DBParams::Param& param = params.params[i];
+		MYSQL_BIND& bind = binds[i];
+		bind.buffer_type = param.type;
+		if (param.type == MYSQL_TYPE_LONGLONG) {
+			bind.buffer = const_cast<int64_t*>(&param.number);
+		} else {
+			lengths[i] = param.data.size();
+			bind.buffer = const_cast<char*>(param.data.data());
+			bind.buffer_length = lengths[i];
+			bind.length = &lengths[i];
+		}
+	}
+
+	std::lock_guard<ProfiledRecursiveMutex> lockGuard(databaseLock);
+	while (true) {
+		unsigned int error;
+		MYSQL_STMT* stmt = getStatement(query, error);
+		if (stmt) {
+			if (mysql_stmt_bind_param(stmt, binds.data()) == 0 && mysql_stmt_execute(stmt) == 0) {
+				return true;
+			}
+
+			std::cout << "[Error - mysql_stmt_execute] Query: " << query.substr(0, 256) << std::endl << "Message: " << mysql_stmt_error(stmt) << std::endl;
+			error = mysql_stmt_errno(stmt);
+		}
+
+		if (!isConnectionError(error) && error != ER_UNKNOWN_STMT_HANDLER) {
+			return false;
+		}
+
+		// prepared statements do not survive a reconnect
+		clearStatements();
+		if (error != ER_UNKNOWN_STMT_HANDLER) {
+			std::this_thread::sleep_for(std::chrono::seconds(1));
+		}
+	}
+}
+
+MYSQL_STMT* Database::getStatement(const std::string& query, unsigned int& error)
+{
+	auto it = statements.find(query);
+	if (it != statements.end()) {
+		return it->second;
+	}
+
+	if (statements.size() >= MAX_PREPARED_STATEMENTS) {
+		clearStatements();
+	}
+
+	MYSQL_STMT* stmt = mysql_stmt_init(handle);
+	if (!stmt) {
+		error = mysql_errno(handle);
+		return nullptr;
+	}
+
+	if (mysql_stmt_prepare(stmt, query.c_str(), query.length()) != 0) {
+		std::cout << "[Error - mysql_stmt_prepare] Query: " << query.substr(0, 256) << std::endl << "Message: " << mysql_stmt_error(stmt) << std::endl;
+		error = mysql_stmt_errno(stmt);
+		mysql_stmt_close(stmt);
+		return nullptr;
+	}
+
+	statements.emplace(query, stmt);
+	return stmt;
+}
+
+void Database::clearStatements()
+{
+	for (const auto& it : statements) {
+		mysql_stmt_close(it.second);
+	}
+	statements.clear();
+}
+
 DBResult_ptr Database::storeQuery(const std::string& query)
 {
+	if (!handle) {
+		return nullptr;
+	}
+
 	databaseLock.lock();
 
 	retry:
@@ -140,6 +268,35 @@ DBResult_ptr Database::storeQuery(const std::string& query)
 	return result;
 }
 
+DBResult_ptr Database::useQuery(const std::string& query)
+{
+	if (!handle) {
+		return nullptr;
+	}
+
+	std::unique_lock<ProfiledRecursiveMutex> lock(databaseLock);
+
+	while (mysql_real_query(handle, query.c_str(), query.length()) != 0) {
+		std::cout << "[Error - mysql_real_query] Query: " << query << std::endl << "Message: " << mysql_error(handle) << std::endl;
+		if (!isConnectionError(mysql_errno(handle))) {
+			return nullptr;
+		}
+		std::this_thread::sleep_for(std::chrono::seconds(1));
+	}
+
+	MYSQL_RES* res = mysql_use_result(handle);
+	if (res == nullptr) {
+		std::cout << "[Error - mysql_use_result] Query: " << query << std::endl << "Message: " << mysql_error(handle) << std::endl;
+		return nullptr;
+	}
+
+	DBResult_ptr result = std::make_shared<DBResult>(res, handle, std::move(lock));
+	if (!result->hasNext()) {
+		return nullptr;
+	}
+	return result;
+}
+
 std::string Database::escapeString(const std::string& s) const
 {
 	return escapeBlob(s.c_str(), s.length());
@@ -156,7 +313,11 @@ std::string Database::escapeBlob(const char* s, uint32_t length) const
 
 	if (length != 0) {
 		char* output = new char[maxLength];
-		mysql_real_escape_string(handle, output, s, length);
+		if (handle) {
+			mysql_real_escape_string(handle, output, s, length);
+		} else {
+			mysql_escape_string(output, s, length);
+		}
 		escaped.append(output);
 		delete[] output;
 	}
@@ -169,53 +330,79 @@ DBResult::DBResult(MYSQL_RES* res)
 {
 	handle = res;
 
-	size_t i = 0;
-
 	MYSQL_FIELD* field = mysql_fetch_field(handle);
 	while (field) {
-		listNames[field->name] = i++;
+		listNames[field->name] = fieldCount++;
 		field = mysql_fetch_field(handle);
 	}
 
 	row = mysql_fetch_row(handle);
 }
 
+DBResult::DBResult(MYSQL_RES* res, MYSQL* connection, std::unique_lock<ProfiledRecursiveMutex>&& lock) : DBResult(res)
+{
+	this->connection = connection;
+	streamLock = std::move(lock);
+	if (!row && mysql_errno(connection) != 0) {
+		std::cout << "[Error - mysql_fetch_row] Message: " << mysql_error(connection) << std::endl;
+	}
+}
+
 DBResult::~DBResult()
 {
+	// fetches what is left of a streamed result before the connection is unlocked
 	mysql_free_result(handle);
 }
 
-std::string DBResult::getString(const std::string& s) const
+size_t DBResult::getColumnIndex(const std::string& s) const
 {
 	auto it = listNames.find(s);
 	if (it == listNames.end()) {
-		std::cout << "[Error - DBResult::getString] Column '" << s << "' does not exist in result set." << std::endl;
-		return std::string();
+		std::cout << "[Error - DBResult::getColumnIndex] Column '" << s << "' doesn't exist in the result set" << std::endl;
+		return INVALID_COLUMN;
 	}
+	return it->second;
+}
 
-	if (row[it->second] == nullptr) {
+std::string DBResult::getString(size_t column) const
+{
+	if (column >= fieldCount || row[column] == nullptr) {
 		return std::string();
 	}
 
-	return std::string(row[it->second]);
+	return std::string(row[column]);
 }
 
-const char* DBResult::getStream(const std::string& s, unsigned long& size) const
+std::string DBResult::getString(const std::string& s) const
 {
 	auto it = listNames.find(s);
 	if (it == listNames.end()) {
-		std::cout << "[Error - DBResult::getStream] Column '" << s << "' doesn't exist in the result set" << std::endl;
+		std::cout << "[Error - DBResult::getString] Column '" << s << "' does not exist in result set." << std::endl;
+		return std::string();
+	}
+	return getString(it->second);
+}
+
+const char* DBResult::getStream(size_t column, unsigned long& size) const
+{
+	if (column >= fieldCount || row[column] == nullptr) {
 		size = 0;
 		return nullptr;
 	}
 
-	if (row[it->second] == nullptr) {
+	size = mysql_fetch_lengths(handle)[column];
+	return row[column];
+}
+
+const char* DBResult::getStream(const std::string& s, unsigned long& size) const
+{
+	auto it = listNames.find(s);
+	if (it == listNames.end()) {
+		std::cout << "[Error - DBResult::getStream] Column '" << s << "' doesn't exist in the result set" << std::endl;
 		size = 0;
 		return nullptr;
 	}
-
-	size = mysql_fetch_lengths(handle)[it->second];
-	return row[it->second];
+	return getStream(it->second, size);
 }
 
 bool DBResult::hasNext() const
@@ -226,10 +413,13 @@ bool DBResult::hasNext() const
 bool DBResult::next()
 {
 	row = mysql_fetch_row(handle);
+	if (!row && connection && mysql_errno(connection) != 0) {
+		std::cout << "[Error - mysql_fetch_row] Message: " << mysql_error(connection) << std::endl;
+	}
 	return row != nullptr;
 }
 
-DBInsert::DBInsert(std::string query) : query(std::move(query))
+DBInsert::DBInsert(std::string query, DBStatements* statements/* = nullptr*/) : query(std::move(query)), statements(statements)
 {
 	this->length = this->query.length();
 }
@@ -258,6 +448,23 @@ bool DBInsert::addRow(const std::string& row)
 	return true;
 }
 
+bool DBInsert::addRow(const std::string& row, DBParams&& rowParams)
+{
+	length += row.length() + rowParams.getByteSize();
+	if ((length > Database::getInstance().getMaxPacketSize() || params.size() + rowParams.size() > MAX_STATEMENT_PARAMS) && !execute()) {
+		return false;
+	}
+
+	if (!values.empty()) {
+		values.push_back(',');
+	}
+	values.push_back('(');
+	values.append(row);
+	values.push_back(')');
+	params.append(std::move(rowParams));
+	return true;
+}
+
 bool DBInsert::addRow(std::ostringstream& row)
 {
 	bool ret = addRow(row.str());
@@ -271,9 +478,52 @@ bool DBInsert::execute()
 		return true;
 	}
 
+	if (statements) {
+		statements->emplace_back(query + values + upsertQuery, std::move(params));
+		values.clear();
+		params.clear();
+		length = query.length() + upsertQuery.length();
+		return true;
+	}
+
 	// executes buffer
-	bool res = Database::getInstance().executeQuery(query + values);
+	bool res = Database::getInstance().executeQuery(query + values + upsertQuery, params);
 	values.clear();
-	length = query.length();
+	params.clear();
+	length = query.length() + upsertQuery.length();
 	return res;
 }
+
+void DBInsert::upsert(const std::vector<std::string>& columns)
+{
+	upsertQuery = " ON DUPLICATE KEY UPDATE ";
+	for (size_t i = 0; i < columns.size(); ++i) {
+		if (i != 0) {
+			upsertQuery.push_back(',');
+		}
+		upsertQuery += fmt::format("`{:s}` = VALUES(`{:s}`)", columns[i], columns[i]);
+	}
+	length = query.length() + upsertQuery.length();
+}
+
+void DBParams::append(DBParams&& other)
+{
+	if (params.empty()) {
+		*this = std::move(other);
+		return;
+	}
+
+	params.reserve(params.size() + other.params.size());
+	std::move(other.params.begin(), other.params.end(), std::back_inserter(params));
+	byteSize += other.byteSize;
+}
+
+size_t DBStatement::hash() const
+{
+	size_t hash = std::hash<std::string>()(query);
+	for (const DBParams::Param& param : params.params) {
+		size_t value = param.type == MYSQL_TYPE_LONGLONG ? std::hash<int64_t>()(param.number) : std::hash<std::string>()(param.data);
+		hash ^= value + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+	}
+	return hash;
+}
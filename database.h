@@ -8,9 +8,72 @@
 
 #include <mysql/mysql.h>
 
+#include "lockprofiler.h"
+
 class DBResult;
 using DBResult_ptr = std::shared_ptr<DBResult>;
 
+// values bound to the placeholders of a prepared statement, sent in binary form
+class DBParams
+{
+	public:
+		void addNumber(int64_t value) {
+			params.push_back({MYSQL_TYPE_LONGLONG, value, {}});
+		}
+		void addString(std::string value) {
+			byteSize += value.size();
+			params.push_back({MYSQL_TYPE_STRING, 0, std::move(value)});
+		}
+		void addBlob(const char* data, size_t size) {
+			byteSize += size;
+			params.push_back({MYSQL_TYPE_BLOB, 0, std::string(data, size)});
+		}
+		void append(DBParams&& other);
+		void clear() {
+			params.clear();
+			byteSize = 0;
+		}
+
+		bool empty() const {
+			return params.empty();
+		}
+		size_t size() const {
+			return params.size();
+		}
+		// bytes sent for the values
+		size_t getByteSize() const {
+			return byteSize + params.size() * sizeof(int64_t);
+		}
+
+	private:
+		struct Param {
+			enum_field_types type;
+			int64_t number;
+			std::string data;
+		};
+
+		std::vector<Param> params;
+		size_t byteSize = 0;
+
+	friend class Database;
+	friend struct DBStatement;
+};
+
+// a query built up front, prepared when it has parameters
+struct DBStatement
+{
+	DBStatement(std::string query) : query(std::move(query)) {}
+	DBStatement(std::string query, DBParams params) : query(std::move(query)), params(std::move(params)) {}
+
+	size_t hash() const;
+
+	std::string query;
+	DBParams params;
+};
+
+// statements built up front and executed later as one transaction
+using DBStatements = std::vector<DBStatement>;
+
 class Database
 {
 	public:
@@ -35,9 +98,11 @@ class Database
 		/**
 		 * Connects to the database
 		 *
+		 * @param replica connects to the read replica instead of the primary,
+		 * with the same credentials
 		 * @return true on successful connection, false on error
 		 */
-		bool connect();
+		bool connect(bool replica = false);
 
 		/**
 		 * Executes command.
@@ -49,6 +114,18 @@ class Database
 		 */
 		bool executeQuery(const std::string& query);
 
+		/**
+		 * Executes command as a prepared statement.
+		 *
+		 * Prepared statements are cached per query text on this connection,
+		 * so placeholders should be used for every value that varies.
+		 *
+		 * @param query command with ? placeholders
+		 * @param params values of the placeholders
+		 * @return true on success, false on error
+		 */
+		bool executeQuery(const std::string& query, const DBParams& params);
+
 		/**
 		 * Queries database.
 		 *
@@ -58,6 +135,26 @@ class Database
 		 */
 		DBResult_ptr storeQuery(const std::string& query);
 
+		/**
+		 * Queries database, streaming the rows.
+		 *
+		 * Rows are fetched from the server as the result is walked instead of
+		 * being buffered up front. The connection stays busy until the result
+		 * is released, so no other query may be run on it meanwhile.
+		 *
+		 * @return results object (nullptr on error)
+		 */
+		DBResult_ptr useQuery(const std::string& query);
+
+		/**
+		 * Executes statements in a single transaction.
+		 *
+		 * Rolls back as soon as one of them fails.
+		 *
+		 * @return true on success, false on error
+		 */
+		bool executeTransaction(const DBStatements& statements);
+
 		/**
 		 * Escapes string for query.
 		 *
@@ -113,9 +210,13 @@ class Database
 		bool rollback();
 		bool commit();
 
+		MYSQL_STMT* getStatement(const std::string& query, unsigned int& error);
+		void clearStatements();
+
 		MYSQL* handle = nullptr;
-		std::recursive_mutex databaseLock;
+		ProfiledRecursiveMutex databaseLock{"Database::databaseLock"};
 		uint64_t maxPacketSize = 1048576;
+		std::unordered_map<std::string, MYSQL_STMT*> statements;
 
 	friend class DBTransaction;
 };
@@ -123,36 +224,50 @@ class Database
 class DBResult
 {
 	public:
+		static constexpr size_t INVALID_COLUMN = std::numeric_limits<size_t>::max();
+
 		explicit DBResult(MYSQL_RES* res);
+		// streamed result, keeps the connection locked until released
+		DBResult(MYSQL_RES* res, MYSQL* connection, std::unique_lock<ProfiledRecursiveMutex>&& lock);
 		~DBResult();
 
 		// non-copyable
 		DBResult(const DBResult&) = delete;
 		DBResult& operator=(const DBResult&) = delete;
 
+		// resolves a column once, the index is valid for every row of the result
+		size_t getColumnIndex(const std::string& s) const;
+
 		template<typename T>
-		T getNumber(const std::string& s) const
+		T getNumber(size_t column) const
 		{
-			auto it = listNames.find(s);
-			if (it == listNames.end()) {
-				std::cout << "[Error - DBResult::getNumber] Column '" << s << "' doesn't exist in the result set" << std::endl;
-				return static_cast<T>(0);
-			}
-
-			if (row[it->second] == nullptr) {
+			if (column >= fieldCount || row[column] == nullptr) {
 				return static_cast<T>(0);
 			}
 
 			T data;
 			try {
-				data = boost::lexical_cast<T>(row[it->second]);
+				data = boost::lexical_cast<T>(row[column]);
 			} catch (boost::bad_lexical_cast&) {
 				data = 0;
 			}
 			return data;
 		}
 
+		template<typename T>
+		T getNumber(const std::string& s) const
+		{
+			auto it = listNames.find(s);
+			if (it == listNames.end()) {
+				std::cout << "[Error - DBResult::getNumber] Column '" << s << "' doesn't exist in the result set" << std::endl;
+				return static_cast<T>(0);
+			}
+			return getNumber<T>(it->second);
+		}
+
+		std::string getString(size_t column) const;
 		std::string getString(const std::string& s) const;
+		const char* getStream(size_t column, unsigned long& size) const;
 		const char* getStream(const std::string& s, unsigned long& size) const;
 
 		bool hasNext() const;
@@ -161,9 +276,13 @@ class DBResult
 	private:
 		MYSQL_RES* handle;
 		MYSQL_ROW row;
+		MYSQL* connection = nullptr;
+		size_t fieldCount = 0;
 
 		std::map<std::string, size_t> listNames;
 
+		std::unique_lock<ProfiledRecursiveMutex> streamLock;
+
 	friend class Database;
 };
 
@@ -173,15 +292,23 @@ class DBResult
 class DBInsert
 {
 	public:
-		explicit DBInsert(std::string query);
+		// with statements set the rows are collected there instead of being executed
+		explicit DBInsert(std::string query, DBStatements* statements = nullptr);
 		bool addRow(const std::string& row);
 		bool addRow(std::ostringstream& row);
+		// row of ? placeholders, the rows are sent as one prepared statement
+		bool addRow(const std::string& row, DBParams&& rowParams);
+		// rows whose key already exists update the given columns instead
+		void upsert(const std::vector<std::string>& columns);
 		bool execute();
 
 	private:
 		std::string query;
+		std::string upsertQuery;
 		std::string values;
+		DBParams params;
 		size_t length;
+		DBStatements* statements;
 };
 
 class DBTransaction
@@ -4,56 +4,148 @@
 #include "otpch.h"
 
 #include "databasetasks.h"
+#include "configmanager.h"
 #include "tasks.h"
+#include "tracer.h"
 
+extern ConfigManager g_config;
 extern Dispatcher g_dispatcher;
 
 void DatabaseTasks::start()
 {
-	db.connect();
+	int32_t workerCount = std::max<int32_t>(1, g_config.getNumber(ConfigManager::DATABASE_WORKERS));
+	for (int32_t i = 0; i < workerCount; ++i) {
+		workers.emplace_back(new Worker);
+		workers.back()->db.connect();
+	}
+
+	// without a replica connection the replica tasks are queued with the others
+	if (!g_config.getString(ConfigManager::MYSQL_REPLICA_HOST).empty()) {
+		int32_t replicaCount = std::max<int32_t>(1, g_config.getNumber(ConfigManager::DATABASE_REPLICA_WORKERS));
+		for (int32_t i = 0; i < replicaCount; ++i) {
+			std::unique_ptr<Worker> worker(new Worker);
+			worker->replica = true;
+			if (!worker->db.connect(true)) {
+				std::cout << "[Warning - DatabaseTasks::start] Cannot connect to the replica at " << g_config.getString(ConfigManager::MYSQL_REPLICA_HOST) << ", its reads go to the primary." << std::endl;
+				break;
+			}
+			workers.push_back(std::move(worker));
+			++replicaWorkers;
+		}
+	}
+
+	// the first worker runs on the holder thread
 	ThreadHolder::start();
+	for (size_t i = 1; i < workers.size(); ++i) {
+		workers[i]->thread = std::thread(&DatabaseTasks::workerMain, this, std::ref(*workers[i]));
+	}
 }
 
 void DatabaseTasks::threadMain()
 {
-	std::unique_lock<std::mutex> taskLockUnique(taskLock, std::defer_lock);
-	while (getState() != THREAD_STATE_TERMINATED) {
-		taskLockUnique.lock();
-		if (tasks.empty()) {
-			taskSignal.wait(taskLockUnique);
-		}
+	workerMain(*workers.front());
+}
 
-		if (!tasks.empty()) {
-			DatabaseTask task = std::move(tasks.front());
-			tasks.pop_front();
-			taskLockUnique.unlock();
-			runTask(task);
-		} else {
+void DatabaseTasks::workerMain(Worker& worker)
+{
+	ProfiledConditionVariable& signal = worker.replica ? replicaSignal : taskSignal;
+	ProfiledUniqueLock taskLockUnique(taskLock);
+	while (true) {
+		DatabaseTask task;
+		if (popTask(worker, task)) {
+			++runningTasks;
 			taskLockUnique.unlock();
+			runTask(worker.db, task);
+			taskLockUnique.lock();
+			--runningTasks;
+
+			if (task.key != 0) {
+				// a task waiting for this key may be taken now, by either kind of worker
+				runningKeys.erase(task.key);
+				taskSignal.notify_all();
+				replicaSignal.notify_all();
+			}
+
+			if (runningTasks == 0 && !hasQueuedTasks()) {
+				idleSignal.notify_all();
+			}
+			continue;
+		}
+
+		bool drained = worker.replica ? replicaTasks.empty() : tasks.empty() && priorityTasks.empty();
+		if (getState() == THREAD_STATE_TERMINATED && drained) {
+			break;
 		}
+		signal.wait(taskLockUnique);
 	}
 }
 
-void DatabaseTasks::addTask(std::string query, std::function<void(DBResult_ptr, bool)> callback/* = nullptr*/, bool store/* = false*/)
+bool DatabaseTasks::popTask(Worker& worker, DatabaseTask& task)
 {
+	if (worker.replica) {
+		return popTask(replicaTasks, task);
+	}
+	return popTask(priorityTasks, task) || popTask(tasks, task);
+}
+
+bool DatabaseTasks::popTask(std::deque<DatabaseTask>& queue, DatabaseTask& task)
+{
+	// tasks of a key still running stay queued, later tasks of that key are skipped with them
+	for (auto it = queue.begin(), end = queue.end(); it != end; ++it) {
+		if (it->key != 0 && !runningKeys.insert(it->key).second) {
+			continue;
+		}
+
+		task = std::move(*it);
+		queue.erase(it);
+		return true;
+	}
+	return false;
+}
+
+void DatabaseTasks::addTask(std::string query, std::function<void(DBResult_ptr, bool)> callback/* = nullptr*/, bool store/* = false*/, bool priority/* = false*/, bool replica/* = false*/)
+{
+	replica = replica && !priority && hasReplica();
+
 	bool signal = false;
 	taskLock.lock();
 	if (getState() == THREAD_STATE_RUNNING) {
-		signal = tasks.empty();
-		tasks.emplace_back(std::move(query), std::move(callback), store);
+		signal = true;
+		(replica ? replicaTasks : priority ? priorityTasks : tasks).emplace_back(std::move(query), std::move(callback), store);
 	}
 	taskLock.unlock();
 
 	if (signal) {
-		taskSignal.notify_one();
+		(replica ? replicaSignal : taskSignal).notify_one();
 	}
 }
 
-void DatabaseTasks::runTask(const DatabaseTask& task)
+bool DatabaseTasks::addJob(std::function<bool(Database&)> job, std::function<void(DBResult_ptr, bool)> callback/* = nullptr*/, uint32_t key/* = 0*/, bool replica/* = false*/)
 {
+	replica = replica && hasReplica();
+
+	taskLock.lock();
+	bool running = getState() == THREAD_STATE_RUNNING;
+	if (running) {
+		(replica ? replicaTasks : tasks).emplace_back(std::move(job), std::move(callback), key);
+	}
+	taskLock.unlock();
+
+	if (running) {
+		(replica ? replicaSignal : taskSignal).notify_one();
+	}
+	return running;
+}
+
+void DatabaseTasks::runTask(Database& db, const DatabaseTask& task)
+{
+	TraceSpan traceSpan("DatabaseTasks::runTask");
 	bool success;
 	DBResult_ptr result;
-	if (task.store) {
+	if (task.job) {
+		result = nullptr;
+		success = task.job(db);
+	} else if (task.store) {
 		result = db.storeQuery(task.query);
 		success = true;
 	} else {
@@ -66,16 +158,19 @@ void DatabaseTasks::runTask(const DatabaseTask& task)
 	}
 }
 
+size_t DatabaseTasks::getBacklog()
+{
+	std::lock_guard<ProfiledMutex> lockClass(taskLock);
+	return tasks.size() + priorityTasks.size() + replicaTasks.size() + runningTasks;
+}
+
 void DatabaseTasks::flush()
 {
-	std::unique_lock<std::mutex> guard{ taskLock };
-	while (!tasks.empty()) {
-		auto task = std::move(tasks.front());
-		tasks.pop_front();
-		guard.unlock();
-		runTask(task);
-		guard.lock();
+	ProfiledUniqueLock guard{ taskLock };
+	if (workers.empty()) {
+		return;
 	}
+	idleSignal.wait(guard, [this]() { return runningTasks == 0 && !hasQueuedTasks(); });
 }
 
 void DatabaseTasks::shutdown()
@@ -83,6 +178,17 @@ void DatabaseTasks::shutdown()
 	taskLock.lock();
 	setState(THREAD_STATE_TERMINATED);
 	taskLock.unlock();
-	flush();
-	taskSignal.notify_one();
+	// the workers drain what is left before leaving
+	taskSignal.notify_all();
+	replicaSignal.notify_all();
+}
+
+void DatabaseTasks::join()
+{
+	ThreadHolder::join();
+	for (const auto& worker : workers) {
+		if (worker->thread.joinable()) {
+			worker->thread.join();
+		}
+	}
 }
@@ -5,17 +5,27 @@
 #define FS_DATABASETASKS_H_9CBA08E9F5FEBA7275CCEE6560059576
 
 #include <condition_variable>
+#include <deque>
+#include <unordered_set>
 #include "thread_holder_base.h"
 #include "database.h"
+#include "lockprofiler.h"
 #include "enums.h"
 
 struct DatabaseTask {
+	DatabaseTask() = default;
 	DatabaseTask(std::string&& query, std::function<void(DBResult_ptr, bool)>&& callback, bool store) :
 		query(std::move(query)), callback(std::move(callback)), store(store) {}
+	DatabaseTask(std::function<bool(Database&)>&& job, std::function<void(DBResult_ptr, bool)>&& callback, uint32_t key) :
+		job(std::move(job)), callback(std::move(callback)), store(false), key(key) {}
 
 	std::string query;
+	// runs instead of the query, against the connection of the worker
+	std::function<bool(Database&)> job;
 	std::function<void(DBResult_ptr, bool)> callback;
-	bool store;
+	bool store = false;
+	// tasks sharing a non zero key run one at a time in the order they were added
+	uint32_t key = 0;
 };
 
 class DatabaseTasks : public ThreadHolder<DatabaseTasks>
@@ -25,18 +35,72 @@ class DatabaseTasks : public ThreadHolder<DatabaseTasks>
 		void start();
 		void flush();
 		void shutdown();
+		void join();
 
-		void addTask(std::string query, std::function<void(DBResult_ptr, bool)> callback = nullptr, bool store = false);
+		// priority tasks are taken before any queued normal task, replica tasks
+		// are read like replica jobs
+		void addTask(std::string query, std::function<void(DBResult_ptr, bool)> callback = nullptr, bool store = false, bool priority = false, bool replica = false);
+		// returns false when the workers no longer accept tasks. A replica job
+		// may see the database some time behind the primary, it runs on the
+		// primary when no replica is connected
+		bool addJob(std::function<bool(Database&)> job, std::function<void(DBResult_ptr, bool)> callback = nullptr, uint32_t key = 0, bool replica = false);
+
+		// read runs on a worker and what it returns is handed to then on the
+		// dispatcher, so the calling task ends instead of waiting on the query.
+		// Both run in place once the workers no longer accept tasks
+		template <typename T>
+		void fetch(std::function<T(Database&)> read, std::function<void(T&)> then, uint32_t key = 0, bool replica = false) {
+			auto value = std::make_shared<T>();
+			bool queued = addJob([read, value](Database& db) {
+				*value = read(db);
+				return true;
+			}, [then, value](DBResult_ptr, bool) {
+				then(*value);
+			}, key, replica);
+
+			if (!queued) {
+				*value = read(Database::getInstance());
+				then(*value);
+			}
+		}
+
+		// queued and running tasks
+		size_t getBacklog();
+
+		// whether replica jobs go to a replica
+		bool hasReplica() const {
+			return replicaWorkers != 0;
+		}
 
 		void threadMain();
 	private:
-		void runTask(const DatabaseTask& task);
+		struct Worker {
+			Database db;
+			std::thread thread;
+			// takes the replica tasks and nothing else
+			bool replica = false;
+		};
+
+		void workerMain(Worker& worker);
+		bool popTask(Worker& worker, DatabaseTask& task);
+		bool popTask(std::deque<DatabaseTask>& queue, DatabaseTask& task);
+		void runTask(Database& db, const DatabaseTask& task);
+		bool hasQueuedTasks() const {
+			return !tasks.empty() || !priorityTasks.empty() || !replicaTasks.empty();
+		}
 
-		Database db;
-		std::thread thread;
-		std::list<DatabaseTask> tasks;
-		std::mutex taskLock;
-		std::condition_variable taskSignal;
+		// the primary workers come first, the holder thread runs the first one
+		std::vector<std::unique_ptr<Worker>> workers;
+		size_t replicaWorkers = 0;
+		std::deque<DatabaseTask> priorityTasks;
+		std::deque<DatabaseTask> tasks;
+		std::deque<DatabaseTask> replicaTasks;
+		std::unordered_set<uint32_t> runningKeys;
+		size_t runningTasks = 0;
+		ProfiledMutex taskLock{"DatabaseTasks::taskLock"};
+		ProfiledConditionVariable taskSignal;
+		ProfiledConditionVariable replicaSignal;
+		ProfiledConditionVariable idleSignal;
 };
 
 extern DatabaseTasks g_databaseTasks;
@@ -44,5 +44,5 @@ void DepotLocker::removeInbox(Inbox* inbox)
 	if (cit == itemlist.end()) {
 		return;
 	}
-	itemlist.erase(cit);
+	eraseItem(std::distance(itemlist.begin(), cit));
 }
@@ -78,6 +78,7 @@ enum itemAttrTypes : uint32_t {
 	ITEM_ATTRIBUTE_STOREITEM = 1 << 25,
 	ITEM_ATTRIBUTE_ATTACK_SPEED = 1 << 26,
 	ITEM_ATTRIBUTE_RARITY = 1 << 27,
+	ITEM_ATTRIBUTE_DURATION_TIMESTAMP = 1 << 28,
 	ITEM_ATTRIBUTE_CUSTOM = 1U << 31
 };
 
@@ -559,6 +560,10 @@ struct ShopInfo {
 	ShopInfo() = default;
 	ShopInfo(uint16_t itemId, int32_t subType = 0, int64_t buyPrice = 0, int64_t sellPrice = 0, std::string realName = "")
 		: itemId(itemId), subType(subType), buyPrice(buyPrice), sellPrice(sellPrice), realName(std::move(realName)) {}
+
+	bool operator==(const ShopInfo& other) const {
+		return itemId == other.itemId && subType == other.subType && buyPrice == other.buyPrice && sellPrice == other.sellPrice && realName == other.realName;
+	}
 };
 
 struct MarketOffer {
@@ -12,7 +12,8 @@ class ItemType;
 class Tile;
 
 enum class EventInfoId {
-	CREATURE_ONHEAR
+	CREATURE_ONHEAR,
+	MONSTER_ONDROPLOOT
 };
 
 class Events
@@ -101,6 +102,8 @@ class Events
 			{
 			case EventInfoId::CREATURE_ONHEAR:
 				return info.creatureOnHear;
+			case EventInfoId::MONSTER_ONDROPLOOT:
+				return info.monsterOnDropLoot;
 			default:
 				return -1;
 			}
@@ -33,44 +33,54 @@ static Node& getCurrentNode(const NodeStack& nodeStack) {
 	return *nodeStack.top();
 }
 
-const Node& Loader::parseTree()
+// parses the children of node, which start at it, and returns the position of its END
+static ContentIt parseNode(Node& node, ContentIt it, ContentIt end, size_t maxDepth)
 {
-	auto it = fileContents.begin() + sizeof(Identifier);
-	if (static_cast<uint8_t>(*it) != Node::START) {
-		throw InvalidOTBFormat{};
-	}
-	root.type = *(++it);
-	root.propsBegin = ++it;
 	NodeStack parseStack;
-	parseStack.push(&root);
+	parseStack.push(&node);
+
+	// nesting level inside the skipped children of a node at maxDepth
+	size_t skipped = 0;
 
-	for (; it != fileContents.end(); ++it) {
+	for (; it != end; ++it) {
 		switch(static_cast<uint8_t>(*it)) {
 			case Node::START: {
 				auto& currentNode = getCurrentNode(parseStack);
-				if (currentNode.children.empty()) {
+				if (skipped == 0 && currentNode.propsEnd == ContentIt{}) {
 					currentNode.propsEnd = it;
 				}
-				currentNode.children.emplace_back();
-				auto& child = currentNode.children.back();
-				if (++it == fileContents.end()) {
+				if (++it == end) {
 					throw InvalidOTBFormat{};
 				}
+				if (skipped > 0 || parseStack.size() > maxDepth) {
+					++skipped;
+					break;
+				}
+				currentNode.children.emplace_back();
+				auto& child = currentNode.children.back();
 				child.type = *it;
 				child.propsBegin = it + sizeof(Node::type);
 				parseStack.push(&child);
 				break;
 			}
 			case Node::END: {
+				if (skipped > 0) {
+					--skipped;
+					break;
+				}
 				auto& currentNode = getCurrentNode(parseStack);
-				if (currentNode.children.empty()) {
+				if (currentNode.propsEnd == ContentIt{}) {
 					currentNode.propsEnd = it;
 				}
+				currentNode.nodeEnd = it;
 				parseStack.pop();
+				if (parseStack.empty()) {
+					return it;
+				}
 				break;
 			}
 			case Node::ESCAPE: {
-				if (++it == fileContents.end()) {
+				if (++it == end) {
 					throw InvalidOTBFormat{};
 				}
 				break;
@@ -80,13 +90,29 @@ const Node& Loader::parseTree()
 			}
 		}
 	}
-	if (!parseStack.empty()) {
+	throw InvalidOTBFormat{};
+}
+
+const Node& Loader::parseTree(size_t maxDepth/* = std::numeric_limits<size_t>::max()*/)
+{
+	auto it = fileContents.begin() + sizeof(Identifier);
+	if (static_cast<uint8_t>(*it) != Node::START) {
 		throw InvalidOTBFormat{};
 	}
-
+	root.type = *(++it);
+	root.propsBegin = ++it;
+	parseNode(root, it, fileContents.end(), maxDepth);
 	return root;
 }
 
+void Loader::parseChildren(Node& node)
+{
+	if (!node.children.empty() || node.nodeEnd == ContentIt{}) {
+		return;
+	}
+	parseNode(node, node.propsEnd, node.nodeEnd + 1, std::numeric_limits<size_t>::max());
+}
+
 bool Loader::getProps(const Node& node, PropStream& props)
 {
 	auto size = std::distance(node.propsBegin, node.propsEnd);
@@ -4,7 +4,9 @@
 #ifndef FS_FILELOADER_H_9B663D19E58D42E6BFACFE5B09D7A05E
 #define FS_FILELOADER_H_9B663D19E58D42E6BFACFE5B09D7A05E
 
+#include <cstring>
 #include <limits>
+#include <type_traits>
 #include <vector>
 #include <boost/iostreams/device/mapped_file.hpp>
 
@@ -21,7 +23,8 @@ struct Node
 
 	ChildrenVector children;
 	ContentIt      propsBegin;
-	ContentIt      propsEnd;
+	ContentIt      propsEnd{};
+	ContentIt      nodeEnd{};
 	uint8_t           type;
 	enum NodeChar: uint8_t
 	{
@@ -48,7 +51,11 @@ class Loader {
 public:
 	Loader(const std::string& fileName, const Identifier& acceptedIdentifier);
 	bool getProps(const Node& node, PropStream& props);
-	const Node& parseTree();
+
+	// nodes deeper than maxDepth (the root is at 0) are skipped, their parent
+	// keeps its range so parseChildren can fill them in later, even on another thread
+	const Node& parseTree(size_t maxDepth = std::numeric_limits<size_t>::max());
+	static void parseChildren(Node& node);
 };
 
 } //namespace OTB
@@ -104,15 +111,65 @@ class PropStream
 			return true;
 		}
 
+		// seven bits per byte, low bits first
+		bool readVarint(uint64_t& ret) {
+			ret = 0;
+			for (uint32_t shift = 0; shift < 64; shift += 7) {
+				if (p == end) {
+					return false;
+				}
+
+				uint8_t byte = static_cast<uint8_t>(*p++);
+				ret |= static_cast<uint64_t>(byte & 0x7F) << shift;
+				if ((byte & 0x80) == 0) {
+					return true;
+				}
+			}
+			return false;
+		}
+
+		// zigzag, small negative values stay short
+		bool readSignedVarint(int64_t& ret) {
+			uint64_t value;
+			if (!readVarint(value)) {
+				return false;
+			}
+
+			ret = static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+			return true;
+		}
+
+		bool readCompactString(std::string& ret) {
+			uint64_t strLen;
+			if (!readVarint(strLen) || size() < strLen) {
+				return false;
+			}
+
+			ret.assign(p, strLen);
+			p += strLen;
+			return true;
+		}
+
 	private:
 		const char* p = nullptr;
 		const char* end = nullptr;
 };
 
+// Grows one contiguous buffer. It starts from the buffer the last stream
+// destroyed on the same thread left behind, so the saves that build one
+// stream per player, house or condition list do not grow a fresh buffer up
+// to the size of a depot each time.
 class PropWriteStream
 {
 	public:
-		PropWriteStream() = default;
+		PropWriteStream() : buffer(std::move(spareBuffer)) {
+			buffer.clear();
+		}
+		~PropWriteStream() {
+			if (buffer.capacity() <= MAX_SPARE_CAPACITY && buffer.capacity() > spareBuffer.capacity()) {
+				spareBuffer = std::move(buffer);
+			}
+		}
 
 		// non-copyable
 		PropWriteStream(const PropWriteStream&) = delete;
@@ -127,10 +184,21 @@ class PropWriteStream
 			buffer.clear();
 		}
 
+		// room for size more bytes
+		void reserve(size_t size) {
+			buffer.reserve(buffer.size() + size);
+		}
+
 		template <typename T>
 		void write(T add) {
-			char* addr = reinterpret_cast<char*>(&add);
-			std::copy(addr, addr + sizeof(T), std::back_inserter(buffer));
+			static_assert(std::is_trivially_copyable<T>::value, "only trivially copyable types are written raw");
+			std::memcpy(grow(sizeof(T)), &add, sizeof(T));
+		}
+
+		void writeBytes(const char* data, size_t size) {
+			if (size != 0) {
+				std::memcpy(grow(size), data, size);
+			}
 		}
 
 		void writeString(const std::string& str) {
@@ -141,11 +209,40 @@ class PropWriteStream
 			}
 
 			write(static_cast<uint16_t>(strLength));
-			std::copy(str.begin(), str.end(), std::back_inserter(buffer));
+			writeBytes(str.data(), strLength);
+		}
+
+		void writeVarint(uint64_t value) {
+			while (value >= 0x80) {
+				buffer.push_back(static_cast<char>(value | 0x80));
+				value >>= 7;
+			}
+			buffer.push_back(static_cast<char>(value));
+		}
+
+		void writeSignedVarint(int64_t value) {
+			writeVarint((static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+		}
+
+		void writeCompactString(const std::string& str) {
+			writeVarint(str.size());
+			writeBytes(str.data(), str.size());
 		}
 
 	private:
+		// larger buffers are freed rather than kept for the next stream
+		static constexpr size_t MAX_SPARE_CAPACITY = 4 * 1024 * 1024;
+
+		// the size more bytes at the end, left for the caller to fill
+		char* grow(size_t size) {
+			size_t offset = buffer.size();
+			buffer.resize(offset + size);
+			return buffer.data() + offset;
+		}
+
 		std::vector<char> buffer;
+
+		static inline thread_local std::vector<char> spareBuffer;
 };
 
 #endif
@@ -17,12 +17,20 @@
 #include "iologindata.h"
 #include "iomarket.h"
 #include "items.h"
+#include "json.h"
 #include "monster.h"
 #include "movement.h"
 #include "scheduler.h"
 #include "server.h"
 #include "spells.h"
 #include "talkaction.h"
+#include "luaprofiler.h"
+#include "purescripts.h"
+#include "taskprofiler.h"
+#include "tracer.h"
+#include "watchdog.h"
+#include "playerjournal.h"
+#include "workerpool.h"
 #include "weapons.h"
 #include "script.h"
 
@@ -41,6 +49,7 @@ extern Monsters g_monsters;
 extern MoveEvents* g_moveEvents;
 extern Weapons* g_weapons;
 extern Scripts* g_scripts;
+extern LuaEnvironment g_luaEnvironment;
 
 Game::Game()
 {
@@ -73,6 +82,24 @@ void Game::start(ServiceManager* manager)
 	}
 	g_scheduler.addEvent(createSchedulerTask(EVENT_CREATURE_THINK_INTERVAL, std::bind(&Game::checkCreatures, this, 0)));
 	g_scheduler.addEvent(createSchedulerTask(EVENT_DECAYINTERVAL, std::bind(&Game::checkDecay, this)));
+
+	g_workerPool.start(std::max<int32_t>(0, g_config.getNumber(ConfigManager::PATHFINDING_THREADS)));
+
+	g_taskProfiler.setEnabled(g_config.getBoolean(ConfigManager::DISPATCHER_PROFILER));
+	if (g_config.getNumber(ConfigManager::DISPATCHER_PROFILER_INTERVAL) > 0) {
+		g_taskProfiler.scheduleDump(g_config.getNumber(ConfigManager::DISPATCHER_PROFILER_INTERVAL), g_config.getString(ConfigManager::DISPATCHER_PROFILER_FILE));
+	}
+
+	g_luaProfiler.setSampleInterval(g_config.getNumber(ConfigManager::LUA_PROFILER_SAMPLE_INTERVAL));
+	g_luaProfiler.setEnabled(g_config.getBoolean(ConfigManager::LUA_PROFILER));
+	if (g_config.getNumber(ConfigManager::LUA_PROFILER_INTERVAL) > 0) {
+		g_luaProfiler.scheduleDump(g_config.getNumber(ConfigManager::LUA_PROFILER_INTERVAL), g_config.getString(ConfigManager::LUA_PROFILER_FILE));
+	}
+
+	g_watchdog.start(std::max<int32_t>(0, g_config.getNumber(ConfigManager::SLOW_TASK_THRESHOLD)));
+	g_playerJournal.start(std::max<int32_t>(0, g_config.getNumber(ConfigManager::PLAYER_JOURNAL_INTERVAL)));
+
+	g_luaEnvironment.configureGarbageCollector();
 }
 
 GameState_t Game::getGameState() const
@@ -114,7 +141,6 @@ void Game::setGameState(GameState_t newState)
 
 			loadMotdNum();
 			loadPlayersRecord();
-			loadAccountStorageValues();
 
 			g_globalEvents->startup();
 			break;
@@ -175,14 +201,26 @@ void Game::saveGameState()
 		std::cout << "[Error - Game::saveGameState] Failed to save account-level storage values." << std::endl;
 	}
 
-	for (const auto& it : players) {
-		it.second->loginPosition = it.second->getPosition();
-		IOLoginData::savePlayer(it.second);
-	}
+	IOMarket::getInstance().saveStatistics();
 
-	Map::save();
+	// the game only serializes, the database thread writes while it keeps running
+	if (g_config.getBoolean(ConfigManager::ASYNC_GLOBAL_SAVE) && gameState != GAME_STATE_SHUTDOWN) {
+		for (const auto& it : players) {
+			it.second->loginPosition = it.second->getPosition();
+			IOLoginData::savePlayerAsync(it.second);
+		}
 
-	g_databaseTasks.flush();
+		Map::saveAsync();
+	} else {
+		for (const auto& it : players) {
+			it.second->loginPosition = it.second->getPosition();
+			IOLoginData::savePlayer(it.second);
+		}
+
+		Map::save();
+
+		g_databaseTasks.flush();
+	}
 
 	if (gameState == GAME_STATE_MAINTAIN) {
 		setGameState(GAME_STATE_NORMAL);
@@ -361,53 +399,27 @@ void Game::internalGetPosition(Item* item, Position& pos, uint8_t& stackpos)
 
 Creature* Game::getCreatureByID(uint32_t id)
 {
-	if (id <= Player::playerAutoID) {
-		return getPlayerByID(id);
-	} else if (id <= Monster::monsterAutoID) {
-		return getMonsterByID(id);
-	} else if (id <= Npc::npcAutoID) {
-		return getNpcByID(id);
+	if (Player::ids.contains(id)) {
+		return Player::ids.get(id);
+	} else if (Monster::ids.contains(id)) {
+		return Monster::ids.get(id);
 	}
-	return nullptr;
+	return Npc::ids.get(id);
 }
 
 Monster* Game::getMonsterByID(uint32_t id)
 {
-	if (id == 0) {
-		return nullptr;
-	}
-
-	auto it = monsters.find(id);
-	if (it == monsters.end()) {
-		return nullptr;
-	}
-	return it->second;
+	return Monster::ids.get(id);
 }
 
 Npc* Game::getNpcByID(uint32_t id)
 {
-	if (id == 0) {
-		return nullptr;
-	}
-
-	auto it = npcs.find(id);
-	if (it == npcs.end()) {
-		return nullptr;
-	}
-	return it->second;
+	return Npc::ids.get(id);
 }
 
 Player* Game::getPlayerByID(uint32_t id)
 {
-	if (id == 0) {
-		return nullptr;
-	}
-
-	auto it = players.find(id);
-	if (it == players.end()) {
-		return nullptr;
-	}
-	return it->second;
+	return Player::ids.get(id);
 }
 
 Creature* Game::getCreatureByName(const std::string& s)
@@ -416,15 +428,15 @@ Creature* Game::getCreatureByName(const std::string& s)
 		return nullptr;
 	}
 
-	const std::string& lowerCaseName = asLowerCaseString(s);
-
 	{
-		auto it = mappedPlayerNames.find(lowerCaseName);
+		auto it = mappedPlayerNames.find(s);
 		if (it != mappedPlayerNames.end()) {
 			return it->second;
 		}
 	}
 
+	const std::string& lowerCaseName = asLowerCaseString(s);
+
 	auto equalCreatureName = [&](const std::pair<uint32_t, Creature*>& it) {
 		auto name = it.second->getName();
 		return lowerCaseName.size() == name.size() && std::equal(lowerCaseName.begin(), lowerCaseName.end(), name.begin(), [](char a, char b) {
@@ -470,7 +482,7 @@ Player* Game::getPlayerByName(const std::string& s)
 		return nullptr;
 	}
 
-	auto it = mappedPlayerNames.find(asLowerCaseString(s));
+	auto it = mappedPlayerNames.find(s);
 	if (it == mappedPlayerNames.end()) {
 		return nullptr;
 	}
@@ -757,7 +769,7 @@ void Game::playerMoveCreature(Player* player, Creature* movingCreature, const Po
 			player->sendCancelMessage(RETURNVALUE_NOTPOSSIBLE);
 			return;
 		} else {
-			if (CreatureVector* tileCreatures = toTile->getCreatures()) {
+			if (TileCreatureVector* tileCreatures = toTile->getCreatures()) {
 				for (Creature* tileCreature : *tileCreatures) {
 					if (!tileCreature->isInGhostMode()) {
 						player->sendCancelMessage(RETURNVALUE_NOTENOUGHROOM);
@@ -1190,6 +1202,18 @@ ReturnValue Game::internalMoveItem(Cylinder* fromCylinder, Cylinder* toCylinder,
 		}
 	}
 
+	//stacks moved inside one container keep their holder and weight, they are
+	//updated in place and the holder is notified once
+	if (fromCylinder == toCylinder && item->isStackable()) {
+		if (Container* container = toCylinder->getContainer()) {
+			const uint32_t n = item->equals(toItem) ? std::min<uint32_t>(100 - toItem->getItemCount(), m) : 0;
+			if (n != 0 || m < item->getItemCount()) {
+				return internalMoveStack(container, item, toItem, index, m, n, _moveItem, actorPlayer, fromPos, toPos,
+				                         maxQueryCount < count ? retMaxCount : RETURNVALUE_NOERROR);
+			}
+		}
+	}
+
 	//remove the item
 	int32_t itemIndex = fromCylinder->getThingIndex(item);
 	Item* updateItem = nullptr;
@@ -1277,6 +1301,118 @@ ReturnValue Game::internalMoveItem(Cylinder* fromCylinder, Cylinder* toCylinder,
 	return ret;
 }
 
+ReturnValue Game::internalMoveStack(Container* container, Item* item, Item* toItem, int32_t index, uint32_t count, uint32_t mergeCount,
+                                    Item** _moveItem, Player* actorPlayer, const Position* fromPos, const Position* toPos, ReturnValue ret)
+{
+	Item* updateItem = nullptr;
+	if (mergeCount != 0) {
+		container->updateThing(toItem, toItem->getID(), toItem->getItemCount() + mergeCount);
+		updateItem = toItem;
+	}
+
+	//what does not fit on the target stack stays on the source stack, without a target it is split off
+	const uint32_t splitCount = mergeCount != 0 ? 0 : count;
+	container->removeThing(item, mergeCount != 0 ? mergeCount : splitCount);
+
+	Item* moveItem = nullptr;
+	if (splitCount != 0) {
+		moveItem = item->clone();
+		moveItem->setItemCount(splitCount);
+		container->addThing(index, moveItem);
+	}
+
+	Item* notifyItem = updateItem ? updateItem : moveItem;
+	int32_t notifyIndex = container->getThingIndex(notifyItem);
+	if (notifyIndex != -1) {
+		container->postAddNotification(notifyItem, container, notifyIndex);
+	}
+
+	if (item->isRemoved()) {
+		ReleaseItem(item);
+	}
+
+	if (_moveItem) {
+		*_moveItem = moveItem ? moveItem : item;
+	}
+
+	if (moveItem && moveItem->getDuration() > 0) {
+		if (moveItem->getDecaying() != DECAYING_TRUE) {
+			moveItem->incrementReferenceCounter();
+			moveItem->setDecaying(DECAYING_TRUE);
+			toDecayItems.push_front(moveItem);
+		}
+	}
+
+	if (actorPlayer && fromPos && toPos && !notifyItem->isRemoved()) {
+		g_events->eventPlayerOnItemMoved(actorPlayer, notifyItem, count, *fromPos, *toPos, container, container);
+	}
+	return ret;
+}
+
+ReturnValue Game::internalMoveItems(Cylinder* toCylinder, const ItemVector& items, uint32_t& movedCount, uint32_t flags/* = 0*/, Creature* actor/* = nullptr*/)
+{
+	movedCount = 0;
+
+	//the capacity of the carrier is checked once for the whole list, what does not fit stays
+	ReturnValue ret = RETURNVALUE_NOERROR;
+	size_t end = items.size();
+
+	Player* holder = toCylinder->getCreature() ? toCylinder->getCreature()->getPlayer() : nullptr;
+	if (!holder && toCylinder->getItem()) {
+		holder = toCylinder->getItem()->getHoldingPlayer();
+	}
+
+	if (holder && !hasBitSet(FLAG_NOLIMIT, flags)) {
+		uint64_t weight = 0;
+		const uint32_t freeCapacity = holder->getFreeCapacity();
+		for (size_t i = 0; i < end; ++i) {
+			const Item* item = items[i];
+			if (item->getTopParent() == holder) {
+				continue;
+			}
+
+			weight += item->getWeight();
+			if (weight > freeCapacity) {
+				end = i;
+				ret = RETURNVALUE_NOTENOUGHCAPACITY;
+				break;
+			}
+		}
+	}
+
+	++itemMoveDepth;
+	for (size_t i = 0; i < end; ++i) {
+		Item* item = items[i];
+		if (item->isRemoved() || item->getParent() == toCylinder) {
+			continue;
+		}
+
+		ReturnValue itemRet;
+		if (item->getParent() == VirtualCylinder::virtualCylinder) {
+			itemRet = internalAddItem(toCylinder, item, INDEX_WHEREEVER, flags);
+		} else {
+			itemRet = internalMoveItem(item->getParent(), toCylinder, INDEX_WHEREEVER, item, item->getItemCount(), nullptr, flags, actor);
+		}
+
+		if (itemRet == RETURNVALUE_NOERROR) {
+			++movedCount;
+		} else if (ret == RETURNVALUE_NOERROR) {
+			ret = itemRet;
+		}
+	}
+
+	if (--itemMoveDepth == 0) {
+		std::vector<uint32_t> playerIds;
+		playerIds.swap(pendingContainerRefreshes);
+		for (uint32_t id : playerIds) {
+			if (Player* player = getPlayerByID(id)) {
+				player->flushContainerRefreshes();
+			}
+		}
+	}
+	return ret;
+}
+
 ReturnValue Game::internalAddItem(Cylinder* toCylinder, Item* item, int32_t index /*= INDEX_WHEREEVER*/,
                                   uint32_t flags/* = 0*/, bool test/* = false*/)
 {
@@ -1404,8 +1540,8 @@ ReturnValue Game::internalRemoveItem(Item* item, int32_t count /*= -1*/, bool te
 
 		if (item->isRemoved()) {
 			item->onRemoved();
-			if (item->canDecay()) {
-				decayItems->remove(item);
+			if (item->getDecaying() == DECAYING_TRUE) {
+				stopDecay(item);
 			}
 			ReleaseItem(item);
 		}
@@ -1493,6 +1629,15 @@ bool Game::removeMoney(Cylinder* cylinder, uint64_t money, uint32_t flags /*= 0*
 		return true;
 	}
 
+	// the cached worth answers most failing payments without walking the backpacks
+	if (const Creature* creature = cylinder->getCreature()) {
+		if (const Player* player = creature->getPlayer()) {
+			if (player->getMoney() < money) {
+				return false;
+			}
+		}
+	}
+
 	std::vector<Container*> containers;
 
 	std::multimap<uint32_t, Item*> moneyMap;
@@ -1778,6 +1923,8 @@ ReturnValue Game::internalTeleport(Thing* thing, const Position& newPos, bool pu
 		return RETURNVALUE_NOTPOSSIBLE;
 	}
 
+	map.loadArea(newPos, 0, 0);
+
 	Tile* toTile = map.getTile(newPos);
 	if (!toTile) {
 		return RETURNVALUE_NOTPOSSIBLE;
@@ -1902,8 +2049,10 @@ bool Game::playerBroadcastMessage(Player* player, const std::string& text) const
 
 	std::cout << "> " << player->getName() << " broadcasted: \"" << text << "\"." << std::endl;
 
+	NetworkMessage msg;
+	ProtocolGame::encodePrivateMessage(msg, player, TALKTYPE_BROADCAST, text);
 	for (const auto& it : players) {
-		it.second->sendPrivateMessage(player, TALKTYPE_BROADCAST, text);
+		it.second->sendNetworkMessage(msg);
 	}
 
 	return true;
@@ -1995,7 +2144,7 @@ void Game::playerOpenChannel(uint32_t playerId, uint16_t channelId)
 	}
 
 	const InvitedMap* invitedUsers = channel->getInvitedUsers();
-	const UsersMap* users;
+	const UsersList* users;
 	if (!channel->isPublicChannel()) {
 		users = &channel->getUsers();
 	} else {
@@ -3687,7 +3836,7 @@ bool Game::internalCreatureTurn(Creature* creature, Direction dir)
 
 	//send to client
 	SpectatorVec spectators;
-	map.getSpectators(spectators, creature->getPosition(), true, true);
+	map.getAwareSpectators(spectators, creature->getPosition());
 	for (Creature* spectator : spectators) {
 		spectator->getPlayer()->sendCreatureTurn(creature);
 	}
@@ -3712,22 +3861,37 @@ bool Game::internalCreatureSay(Creature* creature, SpeakClasses type, const std:
 		// is used if available and if it can be used, else a local vector is
 		// used (hopefully the compiler will optimize away the construction of
 		// the temporary when it's not used).
+		// Monsters and npcs without an interest in speech do nothing with it,
+		// unless the onHear event is there to tell every creature.
+		bool everyoneHears = g_events->getScriptId(EventInfoId::CREATURE_ONHEAR) != -1;
 		if (type != TALKTYPE_YELL && type != TALKTYPE_MONSTER_YELL) {
-			map.getSpectators(spectators, *pos, false, false,
-			              Map::maxClientViewportX, Map::maxClientViewportX,
-			              Map::maxClientViewportY, Map::maxClientViewportY);
-		} else {
+			if (everyoneHears) {
+				map.getSpectators(spectators, *pos, false, false,
+				              Map::maxClientViewportX, Map::maxClientViewportX,
+				              Map::maxClientViewportY, Map::maxClientViewportY);
+			} else {
+				map.getHearingSpectators(spectators, *pos, false,
+				              Map::maxClientViewportX, Map::maxClientViewportX,
+				              Map::maxClientViewportY, Map::maxClientViewportY);
+			}
+		} else if (everyoneHears) {
 			map.getSpectators(spectators, *pos, true, false, 18, 18, 14, 14);
+		} else {
+			map.getHearingSpectators(spectators, *pos, true, 18, 18, 14, 14);
 		}
 	} else {
 		spectators = (*spectatorsPtr);
 	}
 
 	//send to client
+	NetworkMessage msg;
 	for (Creature* spectator : spectators) {
 		if (Player* tmpPlayer = spectator->getPlayer()) {
 			if (!ghostMode || tmpPlayer->canSeeCreature(creature)) {
-				tmpPlayer->sendCreatureSay(creature, type, text, pos);
+				if (msg.getLength() == 0) {
+					ProtocolGame::encodeCreatureSay(msg, creature, type, text, pos);
+				}
+				tmpPlayer->sendNetworkMessage(msg);
 			}
 		}
 	}
@@ -3753,6 +3917,39 @@ void Game::checkCreatureWalk(uint32_t creatureId)
 	}
 }
 
+int64_t Game::addWalkBatch(uint32_t creatureId, int64_t delay)
+{
+	int64_t now = OTSYS_TIME();
+	int64_t time = (now + delay + EVENT_WALK_BATCH_INTERVAL - 1) / EVENT_WALK_BATCH_INTERVAL * EVENT_WALK_BATCH_INTERVAL;
+
+	auto result = walkBatches.try_emplace(time);
+	if (result.second) {
+		g_scheduler.addEvent(createSchedulerTask(time - now, std::bind(&Game::checkWalkBatch, this, time)));
+	}
+	result.first->second.push_back(creatureId);
+	return time;
+}
+
+void Game::checkWalkBatch(int64_t time)
+{
+	auto it = walkBatches.find(time);
+	if (it == walkBatches.end()) {
+		return;
+	}
+
+	std::vector<uint32_t> creatureIds = std::move(it->second);
+	walkBatches.erase(it);
+
+	for (uint32_t creatureId : creatureIds) {
+		// stopped or moved to another batch since it was queued
+		Creature* creature = getCreatureByID(creatureId);
+		if (creature && creature->eventWalk == Creature::WALK_BATCH_EVENT && creature->walkBatchTime == time && creature->getHealth() > 0) {
+			creature->onWalk();
+		}
+	}
+	cleanup();
+}
+
 void Game::updateCreatureWalk(uint32_t creatureId)
 {
 	Creature* creature = getCreatureByID(creatureId);
@@ -3779,42 +3976,132 @@ void Game::addCreatureCheck(Creature* creature)
 	}
 
 	creature->inCheckCreaturesVector = true;
-	checkCreatureLists[uniform_random(0, EVENT_CREATURECOUNT - 1)].push_back(creature);
+
+	size_t bucket = getLightestCreatureBucket();
+	creature->checkCreatureBucket = bucket;
+	creature->checkCreatureSlot = checkCreatureLists[bucket].size();
+	checkCreatureLists[bucket].push_back(creature);
 	creature->incrementReferenceCounter();
 }
 
 void Game::removeCreatureCheck(Creature* creature)
 {
-	if (creature->inCheckCreaturesVector) {
-		creature->creatureCheck = false;
+	if (!creature->inCheckCreaturesVector) {
+		return;
+	}
+
+	creature->creatureCheck = false;
+
+	// the bucket being checked right now sweeps it out by itself
+	if (creature->checkCreatureBucket != checkingCreatureBucket) {
+		eraseCreatureCheck(creature);
 	}
 }
 
 void Game::checkCreatures(size_t index)
 {
+	TraceSpan traceSpan("Game::checkCreatures");
 	g_scheduler.addEvent(createSchedulerTask(EVENT_CHECK_CREATURE_INTERVAL, std::bind(&Game::checkCreatures, this, (index + 1) % EVENT_CREATURECOUNT)));
 
 	auto& checkCreatureList = checkCreatureLists[index];
-	auto it = checkCreatureList.begin(), end = checkCreatureList.end();
-	while (it != end) {
-		Creature* creature = *it;
+
+	// search the follow paths of this bucket in parallel while nothing moves
+	if (g_workerPool.getThreadCount() != 0) {
+		for (Creature* creature : checkCreatureList) {
+			if (creature->creatureCheck && creature->getHealth() > 0 && creature->prepareFollowPath(EVENT_CREATURE_THINK_INTERVAL)) {
+				preparedPathCreatures.push_back(creature);
+			}
+		}
+
+		g_workerPool.parallelFor(preparedPathCreatures.size(), [this](size_t i) {
+			preparedPathCreatures[i]->searchPreparedPath();
+		});
+	}
+
+	const bool thinkLevelOfDetail = g_config.getBoolean(ConfigManager::THINK_LEVEL_OF_DETAIL);
+
+	// creatures removed meanwhile are only flagged and swept out here
+	checkingCreatureBucket = index;
+	for (size_t i = 0; i < checkCreatureList.size();) {
+		Creature* creature = checkCreatureList[i];
 		if (creature->creatureCheck) {
 			if (creature->getHealth() > 0) {
-				creature->onThink(EVENT_CREATURE_THINK_INTERVAL);
-				creature->onAttacking(EVENT_CREATURE_THINK_INTERVAL);
+				// creatures far from players think less often and catch up on the elapsed time
+				uint32_t interval = EVENT_CREATURE_THINK_INTERVAL;
+				if (thinkLevelOfDetail) {
+					if (++creature->skippedThinks < creature->getThinkRate()) {
+						creature->executeConditions(EVENT_CREATURE_THINK_INTERVAL);
+						++i;
+						continue;
+					}
+					interval *= creature->skippedThinks;
+					creature->skippedThinks = 0;
+				}
+
+				creature->onThink(interval);
+				creature->onAttacking(interval);
 				creature->executeConditions(EVENT_CREATURE_THINK_INTERVAL);
 			}
-			++it;
+			++i;
 		} else {
-			creature->inCheckCreaturesVector = false;
-			it = checkCreatureList.erase(it);
-			ReleaseCreature(creature);
+			eraseCreatureCheck(creature);
+		}
+	}
+	checkingCreatureBucket = -1;
+
+	for (Creature* creature : preparedPathCreatures) {
+		creature->clearPreparedPath();
+	}
+	preparedPathCreatures.clear();
+
+	// hand surplus creatures to the lightest bucket, so no slice is much heavier than the others
+	for (int32_t moved = 0; moved < 16; ++moved) {
+		size_t lightest = getLightestCreatureBucket();
+		if (checkCreatureList.size() <= checkCreatureLists[lightest].size() + 1) {
+			break;
 		}
+		moveCreatureCheck(checkCreatureList.back(), lightest);
 	}
 
 	cleanup();
 }
 
+void Game::eraseCreatureCheck(Creature* creature)
+{
+	auto& checkCreatureList = checkCreatureLists[creature->checkCreatureBucket];
+	Creature* last = checkCreatureList.back();
+	checkCreatureList[creature->checkCreatureSlot] = last;
+	last->checkCreatureSlot = creature->checkCreatureSlot;
+	checkCreatureList.pop_back();
+
+	creature->inCheckCreaturesVector = false;
+	ReleaseCreature(creature);
+}
+
+void Game::moveCreatureCheck(Creature* creature, size_t bucket)
+{
+	auto& checkCreatureList = checkCreatureLists[creature->checkCreatureBucket];
+	Creature* last = checkCreatureList.back();
+	checkCreatureList[creature->checkCreatureSlot] = last;
+	last->checkCreatureSlot = creature->checkCreatureSlot;
+	checkCreatureList.pop_back();
+
+	creature->checkCreatureBucket = bucket;
+	creature->checkCreatureSlot = checkCreatureLists[bucket].size();
+	checkCreatureLists[bucket].push_back(creature);
+}
+
+size_t Game::getLightestCreatureBucket() const
+{
+	size_t lightest = 0;
+	for (size_t bucket = 1; bucket < EVENT_CREATURECOUNT; ++bucket) {
+		if (checkCreatureLists[bucket].size() < checkCreatureLists[lightest].size()) {
+			lightest = bucket;
+		}
+	}
+	return lightest;
+}
+
 void Game::changeSpeed(Creature* creature, int32_t varSpeedDelta)
 {
 	int32_t varSpeed = creature->getSpeed() - creature->getBaseSpeed();
@@ -3844,7 +4131,7 @@ void Game::internalCreatureChangeOutfit(Creature* creature, const Outfit_t& outf
 
 	//send to clients
 	SpectatorVec spectators;
-	map.getSpectators(spectators, creature->getPosition(), true, true);
+	map.getAwareSpectators(spectators, creature->getPosition());
 	for (Creature* spectator : spectators) {
 		spectator->getPlayer()->sendCreatureChangeOutfit(creature, outfit);
 	}
@@ -3864,7 +4151,7 @@ void Game::changeLight(const Creature* creature)
 {
 	//send to clients
 	SpectatorVec spectators;
-	map.getSpectators(spectators, creature->getPosition(), true, true);
+	map.getAwareSpectators(spectators, creature->getPosition());
 	for (Creature* spectator : spectators) {
 		spectator->getPlayer()->sendCreatureLight(creature);
 	}
@@ -4099,7 +4386,7 @@ bool Game::combatChangeHealth(Creature* attacker, Creature* target, CombatDamage
 			message.primary.color = TEXTCOLOR_PASTELRED;
 
 			SpectatorVec spectators;
-			map.getSpectators(spectators, targetPos, false, true);
+			getCombatSpectators(spectators, targetPos, false);
 			for (Creature* spectator : spectators) {
 				Player* tmpPlayer = spectator->getPlayer();
 				if (tmpPlayer == attackerPlayer && attackerPlayer != targetPlayer) {
@@ -4190,7 +4477,7 @@ bool Game::combatChangeHealth(Creature* attacker, Creature* target, CombatDamage
 				}
 
 				targetPlayer->drainMana(attacker, manaDamage);
-				map.getSpectators(spectators, targetPos, true, true);
+				getCombatSpectators(spectators, targetPos, true);
 				addMagicEffect(spectators, targetPos, CONST_ME_LOSEENERGY);
 
 				std::string spectatorMessage;
@@ -4272,7 +4559,7 @@ bool Game::combatChangeHealth(Creature* attacker, Creature* target, CombatDamage
 		}
 
 		if (spectators.empty()) {
-			map.getSpectators(spectators, targetPos, true, true);
+			getCombatSpectators(spectators, targetPos, true);
 		}
 
 		message.primary.value = damage.primary.value;
@@ -4344,7 +4631,11 @@ bool Game::combatChangeHealth(Creature* attacker, Creature* target, CombatDamage
 		}
 
 		target->drainHealth(attacker, realDamage);
-		addCreatureHealth(spectators, target);
+		if (g_config.getBoolean(ConfigManager::BATCH_HEALTH_UPDATES)) {
+			addCreatureHealth(target);
+		} else {
+			addCreatureHealth(spectators, target);
+		}
 	}
 
 	return true;
@@ -4453,7 +4744,7 @@ bool Game::combatChangeMana(Creature* attacker, Creature* target, CombatDamage&
 		message.primary.color = TEXTCOLOR_BLUE;
 
 		SpectatorVec spectators;
-		map.getSpectators(spectators, targetPos, false, true);
+		getCombatSpectators(spectators, targetPos, false);
 		for (Creature* spectator : spectators) {
 			Player* tmpPlayer = spectator->getPlayer();
 			if (tmpPlayer == attackerPlayer && attackerPlayer != targetPlayer) {
@@ -4490,8 +4781,32 @@ bool Game::combatChangeMana(Creature* attacker, Creature* target, CombatDamage&
 	return true;
 }
 
+void Game::getCombatSpectators(SpectatorVec& spectators, const Position& pos, bool multifloor)
+{
+	if (!combatSpectatorScope || !combatSpectatorScope->covers(pos)) {
+		map.getSpectators(spectators, pos, multifloor, true);
+		return;
+	}
+
+	// scripts run by the combat may have moved or removed players since the snapshot
+	for (Creature* spectator : combatSpectatorScope->getSpectators()) {
+		if (!spectator->isRemoved() && Map::isInSpectatorRange(pos, spectator->getPosition(), multifloor)) {
+			spectators.emplace_back(spectator);
+		}
+	}
+}
+
 void Game::addCreatureHealth(const Creature* target)
 {
+	if (g_config.getBoolean(ConfigManager::BATCH_HEALTH_UPDATES)) {
+		// a target hit many times in one task gets a single health bar update
+		uint32_t id = target->getID();
+		if (std::find(pendingHealthUpdates.begin(), pendingHealthUpdates.end(), id) == pendingHealthUpdates.end()) {
+			pendingHealthUpdates.push_back(id);
+		}
+		return;
+	}
+
 	SpectatorVec spectators;
 	map.getSpectators(spectators, target->getPosition(), true, true);
 	addCreatureHealth(spectators, target);
@@ -4499,25 +4814,67 @@ void Game::addCreatureHealth(const Creature* target)
 
 void Game::addCreatureHealth(const SpectatorVec& spectators, const Creature* target)
 {
+	NetworkMessage msg;
 	for (Creature* spectator : spectators) {
 		if (Player* tmpPlayer = spectator->getPlayer()) {
-			tmpPlayer->sendCreatureHealth(target);
+			if (msg.getLength() == 0) {
+				ProtocolGame::encodeCreatureHealth(msg, target);
+			}
+			tmpPlayer->sendNetworkMessage(msg);
+		}
+	}
+}
+
+void Game::flushCreatureHealth()
+{
+	if (pendingHealthUpdates.empty()) {
+		return;
+	}
+
+	for (uint32_t id : pendingHealthUpdates) {
+		Creature* creature = getCreatureByID(id);
+		if (!creature || creature->isRemoved()) {
+			continue;
+		}
+
+		SpectatorVec spectators;
+		map.getSpectators(spectators, creature->getPosition(), true, true);
+		addCreatureHealth(spectators, creature);
+	}
+	pendingHealthUpdates.clear();
+}
+
+void Game::flushPlayerUpdates()
+{
+	if (pendingPlayerUpdates.empty()) {
+		return;
+	}
+
+	// players are queued once per frame, whatever they changed in it
+	for (uint32_t id : pendingPlayerUpdates) {
+		if (Player* player = getPlayerByID(id)) {
+			player->flushUpdates();
 		}
 	}
+	pendingPlayerUpdates.clear();
 }
 
 void Game::addMagicEffect(const Position& pos, uint16_t effect)
 {
 	SpectatorVec spectators;
-	map.getSpectators(spectators, pos, true, true);
+	map.getAwareSpectators(spectators, pos);
 	addMagicEffect(spectators, pos, effect);
 }
 
 void Game::addMagicEffect(const SpectatorVec& spectators, const Position& pos, uint16_t effect)
 {
+	NetworkMessage msg;
 	for (Creature* spectator : spectators) {
 		if (Player* tmpPlayer = spectator->getPlayer()) {
-			tmpPlayer->sendMagicEffect(pos, effect);
+			if (msg.getLength() == 0) {
+				ProtocolGame::encodeMagicEffect(msg, pos, effect);
+			}
+			tmpPlayer->sendMagicEffect(pos, msg);
 		}
 	}
 }
@@ -4534,78 +4891,149 @@ void Game::addDistanceEffect(const Position& fromPos, const Position& toPos, uin
 
 void Game::addDistanceEffect(const SpectatorVec& spectators, const Position& fromPos, const Position& toPos, uint8_t effect)
 {
+	NetworkMessage msg;
 	for (Creature* spectator : spectators) {
 		if (Player* tmpPlayer = spectator->getPlayer()) {
-			tmpPlayer->sendDistanceShoot(fromPos, toPos, effect);
+			if (msg.getLength() == 0) {
+				ProtocolGame::encodeDistanceShoot(msg, fromPos, toPos, effect);
+			}
+			tmpPlayer->sendDistanceShoot(msg);
 		}
 	}
 }
 
-void Game::setAccountStorageValue(const uint32_t accountId, const uint32_t key, const int32_t value)
+namespace {
+
+using AccountStorageValues = std::vector<std::pair<uint32_t, int32_t>>;
+
+AccountStorageValues::iterator findAccountStorageKey(AccountStorageValues& values, uint32_t key)
 {
-	if (value == -1) {
-		accountStorageMap[accountId].erase(key);
+	return std::lower_bound(values.begin(), values.end(), key, [](const std::pair<uint32_t, int32_t>& entry, uint32_t key) { return entry.first < key; });
+}
+
+void readAccountStorageValues(AccountStorageValues& values, DBResult_ptr result)
+{
+	if (!result) {
 		return;
 	}
 
-	accountStorageMap[accountId][key] = value;
+	const size_t keyColumn = result->getColumnIndex("key");
+	const size_t valueColumn = result->getColumnIndex("value");
+	do {
+		values.emplace_back(result->getNumber<uint32_t>(keyColumn), result->getNumber<int32_t>(valueColumn));
+	} while (result->next());
+	std::sort(values.begin(), values.end());
 }
 
-int32_t Game::getAccountStorageValue(const uint32_t accountId, const uint32_t key) const
+}
+
+Game::AccountStorage& Game::getAccountStorage(uint32_t accountId)
 {
-	const auto& accountMapIt = accountStorageMap.find(accountId);
-	if (accountMapIt != accountStorageMap.end()) {
-		const auto& storageMapIt = accountMapIt->second.find(key);
-		if (storageMapIt != accountMapIt->second.end()) {
-			return storageMapIt->second;
-		}
+	auto it = accountStorageMap.find(accountId);
+	if (it != accountStorageMap.end()) {
+		return it->second;
 	}
-	return -1;
+
+	// an account none of whose characters logged in yet
+	AccountStorage& storage = accountStorageMap[accountId];
+	readAccountStorageValues(storage.values, Database::getInstance().storeQuery(fmt::format("SELECT `key`, `value` FROM `account_storage` WHERE `account_id` = {:d}", accountId)));
+	return storage;
 }
 
-void Game::loadAccountStorageValues()
+void Game::loadAccountStorageValues(uint32_t accountId, DBResult_ptr result)
 {
-	Database& db = Database::getInstance();
-
-	DBResult_ptr result;
-	if ((result = db.storeQuery("SELECT `account_id`, `key`, `value` FROM `account_storage`"))) {
-		do {
-			g_game.setAccountStorageValue(result->getNumber<uint32_t>("account_id"), result->getNumber<uint32_t>("key"), result->getNumber<int32_t>("value"));
-		} while (result->next());
+	auto it = accountStorageMap.find(accountId);
+	if (it == accountStorageMap.end()) {
+		readAccountStorageValues(accountStorageMap[accountId].values, std::move(result));
 	}
 }
 
-bool Game::saveAccountStorageValues() const
+void Game::setAccountStorageValue(const uint32_t accountId, const uint32_t key, const int32_t value)
 {
-	DBTransaction transaction;
-	Database& db = Database::getInstance();
+	AccountStorage& storage = getAccountStorage(accountId);
+	auto it = findAccountStorageKey(storage.values, key);
+	bool found = it != storage.values.end() && it->first == key;
+	if (value == -1) {
+		if (!found) {
+			return;
+		}
+		storage.values.erase(it);
+	} else if (found) {
+		if (it->second == value) {
+			return;
+		}
+		it->second = value;
+	} else {
+		storage.values.emplace(it, key, value);
+	}
 
-	if (!transaction.begin()) {
-		return false;
+	if (std::find(storage.changedKeys.begin(), storage.changedKeys.end(), key) == storage.changedKeys.end()) {
+		storage.changedKeys.push_back(key);
 	}
+}
 
-	if (!db.executeQuery("DELETE FROM `account_storage`")) {
-		return false;
+int32_t Game::getAccountStorageValue(const uint32_t accountId, const uint32_t key)
+{
+	AccountStorage& storage = getAccountStorage(accountId);
+	auto it = findAccountStorageKey(storage.values, key);
+	if (it != storage.values.end() && it->first == key) {
+		return it->second;
 	}
+	return -1;
+}
+
+bool Game::saveAccountStorageValues()
+{
+	DBStatements statements;
+	DBInsert storageQuery("INSERT INTO `account_storage` (`account_id`, `key`, `value`) VALUES ", &statements);
+	storageQuery.upsert({"value"});
 
-	for (const auto& accountIt : g_game.accountStorageMap) {
-		if (accountIt.second.empty()) {
+	std::vector<AccountStorage*> changedAccounts;
+	for (auto& accountIt : accountStorageMap) {
+		AccountStorage& storage = accountIt.second;
+		if (storage.changedKeys.empty()) {
 			continue;
 		}
+		changedAccounts.push_back(&storage);
 
-		DBInsert accountStorageQuery("INSERT INTO `account_storage` (`account_id`, `key`, `value`) VALUES");
-		for (const auto& storageIt : accountIt.second) {
-			if (!accountStorageQuery.addRow(fmt::format("{:d}, {:d}, {:d}", accountIt.first, storageIt.first, storageIt.second))) {
+		std::ostringstream removedKeys;
+		for (uint32_t key : storage.changedKeys) {
+			auto it = findAccountStorageKey(storage.values, key);
+			if (it == storage.values.end() || it->first != key) {
+				if (removedKeys.tellp() != 0) {
+					removedKeys << ',';
+				}
+				removedKeys << key;
+				continue;
+			}
+
+			DBParams params;
+			params.addNumber(accountIt.first);
+			params.addNumber(key);
+			params.addNumber(it->second);
+			if (!storageQuery.addRow("?, ?, ?", std::move(params))) {
 				return false;
 			}
 		}
 
-		if (!accountStorageQuery.execute()) {
-			return false;
+		if (removedKeys.tellp() != 0) {
+			statements.push_back(fmt::format("DELETE FROM `account_storage` WHERE `account_id` = {:d} AND `key` IN ({:s})", accountIt.first, removedKeys.str()));
 		}
 	}
 
-	return transaction.commit();
+	if (changedAccounts.empty()) {
+		return true;
+	}
+
+	if (!storageQuery.execute() || !Database::getInstance().executeTransaction(statements)) {
+		return false;
+	}
+
+	// keys that failed to save stay changed and are written by the next save
+	for (AccountStorage* storage : changedAccounts) {
+		storage->changedKeys.clear();
+	}
+	return true;
 }
 
 void Game::startDecay(Item* item)
@@ -4646,46 +5074,86 @@ void Game::checkDecay()
 {
 	g_scheduler.addEvent(createSchedulerTask(EVENT_DECAYINTERVAL, std::bind(&Game::checkDecay, this)));
 
-	size_t bucket = (lastBucket + 1) % EVENT_DECAY_BUCKETS;
-
-	auto it = decayItems[bucket].begin(), end = decayItems[bucket].end();
-	while (it != end) {
-		Item* item = *it;
-		if (!item->canDecay()) {
-			item->setDecaying(DECAYING_FALSE);
-			ReleaseItem(item);
-			it = decayItems[bucket].erase(it);
-			continue;
+	const int64_t now = OTSYS_TIME();
+	while (!decayItems.empty()) {
+		auto it = decayItems.begin();
+		if (it->first > now) {
+			break;
 		}
 
-		int32_t duration = item->getDuration();
-		int32_t decreaseTime = std::min<int32_t>(EVENT_DECAYINTERVAL * EVENT_DECAY_BUCKETS, duration);
+		const int64_t timestamp = it->first;
+		std::vector<Item*> expiredItems = std::move(it->second);
+		decayItems.erase(it);
 
-		duration -= decreaseTime;
-		item->decreaseDuration(decreaseTime);
+		for (Item* item : expiredItems) {
+			// entries left behind by a reschedule or a stopped decay
+			if (item->getDecaying() != DECAYING_TRUE || item->getDurationTimestamp() != timestamp) {
+				ReleaseItem(item);
+				continue;
+			}
 
-		if (duration <= 0) {
-			it = decayItems[bucket].erase(it);
-			internalDecayItem(item);
-			ReleaseItem(item);
-		} else if (duration < EVENT_DECAYINTERVAL * EVENT_DECAY_BUCKETS) {
-			it = decayItems[bucket].erase(it);
-			size_t newBucket = (bucket + ((duration + EVENT_DECAYINTERVAL / 2) / 1000)) % EVENT_DECAY_BUCKETS;
-			if (newBucket == bucket) {
-				internalDecayItem(item);
+			if (!item->canDecay()) {
+				item->setDecaying(DECAYING_FALSE);
 				ReleaseItem(item);
-			} else {
-				decayItems[newBucket].push_back(item);
+				continue;
 			}
-		} else {
-			++it;
+
+			internalDecayItem(item);
+			ReleaseItem(item);
 		}
 	}
 
-	lastBucket = bucket;
 	cleanup();
 }
 
+void Game::scheduleDecay(Item* item)
+{
+	if (item->getDecaying() != DECAYING_TRUE) {
+		ReleaseItem(item);
+		return;
+	}
+
+	const int64_t timestamp = OTSYS_TIME() + item->getDuration();
+	item->setDurationTimestamp(timestamp);
+	decayItems[timestamp].push_back(item);
+}
+
+void Game::rescheduleDecay(Item* item)
+{
+	const int64_t timestamp = OTSYS_TIME() + item->getIntAttr(ITEM_ATTRIBUTE_DURATION);
+	if (item->getDurationTimestamp() == timestamp) {
+		return;
+	}
+
+	// the entry under the old deadline turns stale and is released once it is reached
+	item->incrementReferenceCounter();
+	item->setDurationTimestamp(timestamp);
+	decayItems[timestamp].push_back(item);
+}
+
+void Game::stopDecay(Item* item)
+{
+	auto it = decayItems.find(item->getDurationTimestamp());
+	if (it == decayItems.end()) {
+		return;
+	}
+
+	std::vector<Item*>& items = it->second;
+	auto itemIt = std::find(items.begin(), items.end(), item);
+	if (itemIt == items.end()) {
+		return;
+	}
+
+	*itemIt = items.back();
+	items.pop_back();
+	if (items.empty()) {
+		decayItems.erase(it);
+	}
+
+	item->setDecaying(DECAYING_FALSE);
+	ReleaseItem(item);
+}
+
 void Game::checkLight()
 {
 	g_scheduler.addEvent(createSchedulerTask(EVENT_LIGHTINTERVAL, std::bind(&Game::checkLight, this)));
@@ -4695,8 +5163,13 @@ void Game::checkLight()
 	if (previousLightLevel != lightLevel) {
 		LightInfo lightInfo = getWorldLightInfo();
 
+		// the same bytes for every player, encoded once per variant
+		NetworkMessage msg, accessMsg;
+		ProtocolGame::encodeWorldLight(msg, lightInfo, false);
+		ProtocolGame::encodeWorldLight(accessMsg, lightInfo, true);
 		for (const auto& it : players) {
-			it.second->sendWorldLight(lightInfo);
+			Player* player = it.second;
+			player->sendNetworkMessage(player->isAccessPlayer() ? accessMsg : msg);
 		}
 	}
 }
@@ -4726,13 +5199,17 @@ void Game::shutdown()
 {
 	std::cout << "Shutting down..." << std::flush;
 
+	g_watchdog.shutdown();
+	g_playerJournal.shutdown();
 	g_scheduler.shutdown();
 	g_databaseTasks.shutdown();
 	g_dispatcher.shutdown();
+	g_workerPool.shutdown();
 	map.spawns.clear();
 	raids.clear();
 
 	cleanup();
+	destroyReleased(releasedCreatures.size(), releasedItems.size());
 
 	if (serviceManager) {
 		serviceManager->stop();
@@ -4747,26 +5224,49 @@ void Game::cleanup()
 {
 	//free memory
 	for (auto creature : ToReleaseCreatures) {
-		creature->decrementReferenceCounter();
+		if (creature->getReferenceCounter() == 1) {
+			releasedCreatures.push_back(creature);
+		} else {
+			creature->decrementReferenceCounter();
+		}
 	}
 	ToReleaseCreatures.clear();
 
 	for (auto item : ToReleaseItems) {
-		item->decrementReferenceCounter();
+		if (item->getReferenceCounter() == 1) {
+			releasedItems.push_back(item);
+		} else {
+			item->decrementReferenceCounter();
+		}
 	}
 	ToReleaseItems.clear();
 
+	destroyReleased(RELEASE_CREATURES_PER_CLEANUP, RELEASE_ITEMS_PER_CLEANUP);
+
 	for (Item* item : toDecayItems) {
-		const uint32_t dur = item->getDuration();
-		if (dur >= EVENT_DECAYINTERVAL * EVENT_DECAY_BUCKETS) {
-			decayItems[lastBucket].push_back(item);
-		} else {
-			decayItems[(lastBucket + 1 + dur / 1000) % EVENT_DECAY_BUCKETS].push_back(item);
-		}
+		scheduleDecay(item);
 	}
 	toDecayItems.clear();
 }
 
+void Game::destroyReleased(size_t creatureCount, size_t itemCount)
+{
+	// a reference may have been taken again while the object was waiting
+	creatureCount = std::min(creatureCount, releasedCreatures.size());
+	for (size_t i = 0; i < creatureCount; ++i) {
+		Creature* creature = releasedCreatures.back();
+		releasedCreatures.pop_back();
+		creature->decrementReferenceCounter();
+	}
+
+	itemCount = std::min(itemCount, releasedItems.size());
+	for (size_t i = 0; i < itemCount; ++i) {
+		Item* item = releasedItems.back();
+		releasedItems.pop_back();
+		item->decrementReferenceCounter();
+	}
+}
+
 void Game::ReleaseCreature(Creature* creature)
 {
 	ToReleaseCreatures.push_back(creature);
@@ -4780,8 +5280,10 @@ void Game::ReleaseItem(Item* item)
 void Game::broadcastMessage(const std::string& text, MessageClasses type) const
 {
 	std::cout << "> Broadcasted message: \"" << text << "\"." << std::endl;
+	NetworkMessage msg;
+	ProtocolGame::encodeTextMessage(msg, TextMessage(type, text));
 	for (const auto& it : players) {
-		it.second->sendTextMessage(type, text);
+		it.second->sendNetworkMessage(msg);
 	}
 }
 
@@ -4789,7 +5291,7 @@ void Game::updateCreatureWalkthrough(const Creature* creature)
 {
 	//send to clients
 	SpectatorVec spectators;
-	map.getSpectators(spectators, creature->getPosition(), true, true);
+	map.getAwareSpectators(spectators, creature->getPosition());
 	for (Creature* spectator : spectators) {
 		Player* tmpPlayer = spectator->getPlayer();
 		tmpPlayer->sendCreatureWalkthrough(creature, tmpPlayer->canWalkthroughEx(creature));
@@ -4800,7 +5302,7 @@ void Game::updateCreatureEmblem(Creature* creature)
 {
 	//send to clients
 	SpectatorVec spectators;
-	map.getSpectators(spectators, creature->getPosition(), true, true);
+	map.getAwareSpectators(spectators, creature->getPosition());
 	for (Creature* spectator : spectators) {
 		spectator->getPlayer()->sendCreatureEmblem(creature);
 	}
@@ -4813,7 +5315,7 @@ void Game::updateCreatureSkull(const Creature* creature)
 	}
 
 	SpectatorVec spectators;
-	map.getSpectators(spectators, creature->getPosition(), true, true);
+	map.getAwareSpectators(spectators, creature->getPosition());
 	for (Creature* spectator : spectators) {
 		spectator->getPlayer()->sendCreatureSkull(creature);
 	}
@@ -4822,7 +5324,7 @@ void Game::updateCreatureSkull(const Creature* creature)
 void Game::updatePlayerShield(Player* player)
 {
 	SpectatorVec spectators;
-	map.getSpectators(spectators, player->getPosition(), true, true);
+	map.getAwareSpectators(spectators, player->getPosition());
 	for (Creature* spectator : spectators) {
 		spectator->getPlayer()->sendCreatureShield(player);
 	}
@@ -5185,9 +5687,13 @@ void Game::playerBrowseMarketOwnHistory(uint32_t playerId)
 		return;
 	}
 
-	const HistoryMarketOfferList& buyOffers = IOMarket::getOwnHistory(MARKETACTION_BUY, player->getGUID());
-	const HistoryMarketOfferList& sellOffers = IOMarket::getOwnHistory(MARKETACTION_SELL, player->getGUID());
-	player->sendMarketBrowseOwnHistory(buyOffers, sellOffers);
+	IOMarket::getOwnHistory(player->getGUID(), [this, playerId](const HistoryMarketOfferList& buyOffers, const HistoryMarketOfferList& sellOffers) {
+		// the player may have left the market while the history was read
+		Player* player = getPlayerByID(playerId);
+		if (player && player->isInMarket()) {
+			player->sendMarketBrowseOwnHistory(buyOffers, sellOffers);
+		}
+	});
 }
 
 void Game::playerCreateMarketOffer(uint32_t playerId, uint8_t type, uint16_t spriteId, uint16_t amount, uint32_t price, bool anonymous)
@@ -5293,7 +5799,7 @@ void Game::playerCreateMarketOffer(uint32_t playerId, uint8_t type, uint16_t spr
 		player->bankBalance -= debitBank;
 	}
 
-	IOMarket::createOffer(player->getGUID(), static_cast<MarketAction_t>(type), it.id, amount, price, anonymous);
+	IOMarket::createOffer(player->getGUID(), player->getName(), static_cast<MarketAction_t>(type), it.id, amount, price, anonymous);
 
 	player->sendMarketEnter(player->getLastDepotId());
 	const MarketOfferList& buyOffers = IOMarket::getActiveOffers(MARKETACTION_BUY, it.id);
@@ -5541,15 +6047,28 @@ void Game::playerAcceptMarketOffer(uint32_t playerId, uint32_t timestamp, uint16
 	player->sendMarketAcceptOffer(offer);
 }
 
-void Game::parsePlayerExtendedOpcode(uint32_t playerId, uint8_t opcode, const std::string& buffer)
+void Game::parsePlayerExtendedOpcode(uint32_t playerId, uint8_t opcode, const std::string& buffer, const std::shared_ptr<const JsonValue>& data, bool decoded)
 {
 	Player* player = getPlayerByID(playerId);
 	if (!player) {
 		return;
 	}
 
+	const JsonValue* json = data.get();
+	JsonValue lateData;
 	for (CreatureEvent* creatureEvent : player->getCreatureEvents(CREATURE_EVENT_EXTENDED_OPCODE)) {
-		creatureEvent->executeExtendedOpcode(player, opcode, buffer);
+		if (!creatureEvent->handlesOpcode(opcode)) {
+			continue;
+		}
+
+		// a handler registered after the packet was read decodes it here
+		if (creatureEvent->decodesJson() && !decoded) {
+			decoded = true;
+			if (JsonValue::parse(buffer, lateData)) {
+				json = &lateData;
+			}
+		}
+		creatureEvent->executeExtendedOpcode(player, opcode, buffer, json);
 	}
 }
 
@@ -5664,19 +6183,65 @@ void Game::playerAnswerModalWindow(uint32_t playerId, uint32_t modalWindowId, ui
 void Game::addPlayer(Player* player)
 {
 	const std::string& lowercase_name = asLowerCaseString(player->getName());
-	mappedPlayerNames[lowercase_name] = player;
+	// a stale entry would keep viewing the name of the player it was added for
+	mappedPlayerNames.erase(player->getName());
+	mappedPlayerNames.emplace(player->getName(), player);
 	mappedPlayerGuids[player->getGUID()] = player;
 	wildcardTree.insert(lowercase_name);
 	players[player->getID()] = player;
+
+	for (uint32_t vipGuid : player->VIPList) {
+		addVIPSubscriber(vipGuid, player);
+	}
 }
 
 void Game::removePlayer(Player* player)
 {
 	const std::string& lowercase_name = asLowerCaseString(player->getName());
-	mappedPlayerNames.erase(lowercase_name);
+	mappedPlayerNames.erase(player->getName());
 	mappedPlayerGuids.erase(player->getGUID());
 	wildcardTree.remove(lowercase_name);
 	players.erase(player->getID());
+
+	for (uint32_t vipGuid : player->VIPList) {
+		removeVIPSubscriber(vipGuid, player);
+	}
+}
+
+void Game::addVIPSubscriber(uint32_t vipGuid, Player* player)
+{
+	vipSubscribers[vipGuid].push_back(player);
+}
+
+void Game::removeVIPSubscriber(uint32_t vipGuid, Player* player)
+{
+	auto it = vipSubscribers.find(vipGuid);
+	if (it == vipSubscribers.end()) {
+		return;
+	}
+
+	std::vector<Player*>& subscribers = it->second;
+	auto subscriber = std::find(subscribers.begin(), subscribers.end(), player);
+	if (subscriber != subscribers.end()) {
+		*subscriber = subscribers.back();
+		subscribers.pop_back();
+	}
+
+	if (subscribers.empty()) {
+		vipSubscribers.erase(it);
+	}
+}
+
+void Game::notifyVIPSubscribers(Player* player, VipStatus_t status)
+{
+	auto it = vipSubscribers.find(player->getGUID());
+	if (it == vipSubscribers.end()) {
+		return;
+	}
+
+	for (Player* subscriber : it->second) {
+		subscriber->notifyStatusChange(player, status);
+	}
 }
 
 void Game::addNpc(Npc* npc)
@@ -5804,7 +6369,13 @@ bool Game::reload(ReloadTypes_t reloadType)
 		case RELOAD_TYPE_ACTIONS: return g_actions->reload();
 		case RELOAD_TYPE_AURAS: return auras.reload();
 		case RELOAD_TYPE_CHAT: return g_chat->load();
-		case RELOAD_TYPE_CONFIG: return g_config.reload();
+		case RELOAD_TYPE_CONFIG: {
+			if (!g_config.reload()) {
+				return false;
+			}
+			g_luaEnvironment.configureGarbageCollector();
+			return true;
+		}
 		case RELOAD_TYPE_CREATURESCRIPTS: {
 			g_creatureEvents->reload();
 			g_creatureEvents->removeInvalidEvents();
@@ -5812,8 +6383,53 @@ bool Game::reload(ReloadTypes_t reloadType)
 		}
 		case RELOAD_TYPE_EVENTS: return g_events->load();
 		case RELOAD_TYPE_GLOBALEVENTS: return g_globalEvents->reload();
-		case RELOAD_TYPE_ITEMS: return Item::items.reload();
-		case RELOAD_TYPE_MONSTERS: return g_monsters.reload();
+		case RELOAD_TYPE_ITEMS: {
+			// the otb and xml are parsed into a new registry on a helper thread, a dispatcher task swaps it in
+			if (itemsLoading.exchange(true)) {
+				return false;
+			}
+
+			std::thread([this]() {
+				auto fresh = std::make_shared<Items>();
+				bool loaded = fresh->load();
+				g_dispatcher.addTask(createTask([this, fresh, loaded]() {
+					itemsLoading = false;
+					if (!loaded) {
+						std::cout << "[Error - Game::reload] Failed to reload items." << std::endl;
+						return;
+					}
+
+					virtualTooltips.clear();
+					itemTooltips.clear();
+					Item::items.swap(*fresh);
+					g_moveEvents->reload();
+					g_weapons->reload();
+					g_weapons->loadDefaults();
+
+					// references to the old item types taken during this tick stay valid until the next one
+					g_scheduler.addEvent(createSchedulerTask(SCHEDULER_MINTICKS, [fresh]() {}));
+				}));
+			}).detach();
+			return true;
+		}
+		case RELOAD_TYPE_MONSTERS: {
+			// the files are read and parsed on a helper thread, the types are rebuilt in one dispatcher task
+			if (monstersLoading.exchange(true)) {
+				return false;
+			}
+
+			std::thread([this, names = g_monsters.getReloadNames(), forceLoad = g_config.getBoolean(ConfigManager::FORCE_MONSTERTYPE_LOAD)]() {
+				std::shared_ptr<MonsterFiles> files = Monsters::readFiles(names, forceLoad);
+				g_dispatcher.addTask(createTask([this, files]() {
+					monstersLoading = false;
+					if (!g_monsters.applyFiles(*files, true)) {
+						std::cout << "[Error - Game::reload] Failed to reload monsters." << std::endl;
+					}
+					updateMonsterInterests();
+				}));
+			}).detach();
+			return true;
+		}
 		case RELOAD_TYPE_MOUNTS: return mounts.reload();
 		case RELOAD_TYPE_MOVEMENTS: return g_moveEvents->reload();
 		case RELOAD_TYPE_NPCS: {
@@ -5832,6 +6448,7 @@ bool Game::reload(ReloadTypes_t reloadType)
 				std::cout << "[Error - Game::reload] Failed to reload monsters." << std::endl;
 				std::terminate();
 			}
+			updateMonsterInterests();
 			return true;
 		}
 
@@ -5844,30 +6461,23 @@ bool Game::reload(ReloadTypes_t reloadType)
 		}
 		case RELOAD_TYPE_WINGS: return wings.reload();
 		case RELOAD_TYPE_SCRIPTS: {
-			// commented out stuff is TODO, once we approach further in revscriptsys
-			g_actions->clear(true);
-			g_creatureEvents->clear(true);
-			g_moveEvents->clear(true);
-			g_talkActions->clear(true);
-			g_globalEvents->clear(true);
-			g_weapons->clear(true);
-			g_weapons->loadDefaults();
-			g_spells->clear(true);
-			g_scripts->loadScripts("scripts", false, true);
-			g_creatureEvents->removeInvalidEvents();
-			/*
-			Npcs::reload();
-			raids.reload() && raids.startup();
-			Item::items.reload();
-			quests.reload();
-			mounts.reload();
-			auras.reload();
-			wings.reload();
-			shaders.reload();
-			g_config.reload();
-			g_events->load();
-			g_chat->load();
-			*/
+			if (!g_config.getBoolean(ConfigManager::LUA_BYTECODE_CACHE)) {
+				reloadScripts();
+				return true;
+			}
+
+			// parse the changed files on a helper thread, the swap itself is a single dispatcher task
+			if (scriptsCompiling.exchange(true)) {
+				return false;
+			}
+
+			std::thread([this]() {
+				Scripts::compileScripts("scripts");
+				g_dispatcher.addTask(createTask([this]() {
+					reloadScripts();
+					scriptsCompiling = false;
+				}));
+			}).detach();
 			return true;
 		}
 
@@ -5906,14 +6516,53 @@ bool Game::reload(ReloadTypes_t reloadType)
 			g_talkActions->clear(true);
 			g_globalEvents->clear(true);
 			g_spells->clear(true);
+			g_pureScripts.reload();
 			g_scripts->loadScripts("scripts", false, true);
 			g_creatureEvents->removeInvalidEvents();
+			updateMonsterInterests();
 			return true;
 		}
 	}
 	return true;
 }
 
+void Game::reloadScripts()
+{
+	// commented out stuff is TODO, once we approach further in revscriptsys
+	g_actions->clear(true);
+	g_creatureEvents->clear(true);
+	g_moveEvents->clear(true);
+	g_talkActions->clear(true);
+	g_globalEvents->clear(true);
+	g_weapons->clear(true);
+	g_weapons->loadDefaults();
+	g_spells->clear(true);
+	g_pureScripts.reload();
+	g_scripts->loadScripts("scripts", false, true);
+	g_creatureEvents->removeInvalidEvents();
+	updateMonsterInterests();
+	/*
+	Npcs::reload();
+	raids.reload() && raids.startup();
+	Item::items.reload();
+	quests.reload();
+	mounts.reload();
+	auras.reload();
+	wings.reload();
+	shaders.reload();
+	g_config.reload();
+	g_events->load();
+	g_chat->load();
+	*/
+}
+
+void Game::updateMonsterInterests()
+{
+	// the events of the monster types may have changed
+	for (const auto& it : monsters) {
+		map.setInterests(it.second, it.second->getTypeInterests());
+	}
+}
 
 void Game::playerSendTooltip(uint32_t playerId, uint16_t spriteId, uint16_t count)
 {
@@ -5922,10 +6571,20 @@ void Game::playerSendTooltip(uint32_t playerId, uint16_t spriteId, uint16_t coun
 		return;
 	}
 
-	TooltipDataContainer tooltipData;
-	Item::getTooltipData(nullptr, spriteId, count, tooltipData);
-	if (!tooltipData.empty()) {
-		player->sendTooltipData(tooltipData);
+	const uint32_t key = (static_cast<uint32_t>(spriteId) << 16) | count;
+	auto it = virtualTooltips.find(key);
+	if (it == virtualTooltips.end()) {
+		if (virtualTooltips.size() >= TOOLTIP_CACHE_SIZE) {
+			virtualTooltips.clear();
+		}
+
+		TooltipDataContainer tooltipData;
+		Item::getTooltipData(nullptr, spriteId, count, tooltipData);
+		it = virtualTooltips.emplace(key, tooltipData.empty() ? std::string() : ProtocolGame::encodeTooltipData(tooltipData)).first;
+	}
+
+	if (!it->second.empty()) {
+		player->sendTooltip(it->second);
 	}
 }
 
@@ -5946,9 +6605,19 @@ void Game::playerSendTooltip(uint32_t playerId, const Position pos, uint16_t spr
 		return;
 	}
 
-	TooltipDataContainer tooltipData;
-	Item::getTooltipData(item, item->getClientID(), item->getItemCount(), tooltipData);
-	if (!tooltipData.empty()) {
-		player->sendTooltipData(tooltipData);
+	const uint64_t key = item->getTooltipHash();
+	auto it = itemTooltips.find(key);
+	if (it == itemTooltips.end()) {
+		if (itemTooltips.size() >= TOOLTIP_CACHE_SIZE) {
+			itemTooltips.clear();
+		}
+
+		TooltipDataContainer tooltipData;
+		Item::getTooltipData(item, item->getClientID(), item->getItemCount(), tooltipData);
+		it = itemTooltips.emplace(key, tooltipData.empty() ? std::string() : ProtocolGame::encodeTooltipData(tooltipData)).first;
+	}
+
+	if (!it->second.empty()) {
+		player->sendTooltip(it->second);
 	}
 }
\ No newline at end of file
@@ -23,6 +23,7 @@ class Creature;
 class Monster;
 class Npc;
 class CombatInfo;
+struct JsonValue;
 
 enum stackPosType_t {
 	STACKPOS_MOVE,
@@ -51,13 +52,22 @@ enum GameState_t {
 static constexpr int32_t EVENT_LIGHTINTERVAL = 10000;
 static constexpr int32_t EVENT_WORLDTIMEINTERVAL = 2500;
 static constexpr int32_t EVENT_DECAYINTERVAL = 250;
-static constexpr int32_t EVENT_DECAY_BUCKETS = 4;
+// monster and npc steps due within the same interval are taken in one task
+static constexpr int32_t EVENT_WALK_BATCH_INTERVAL = 25;
+
+// objects destroyed per cleanup once their last reference was released
+static constexpr size_t RELEASE_CREATURES_PER_CLEANUP = 32;
+static constexpr size_t RELEASE_ITEMS_PER_CLEANUP = 512;
+
+static constexpr size_t TOOLTIP_CACHE_SIZE = 16384;
 
 /**
   * Main Game class.
   * This class is responsible to control everything that happens
   */
 
+class CombatSpectatorScope;
+
 class Game
 {
 	public:
@@ -195,7 +205,7 @@ class Game
 		void executeDeath(uint32_t creatureId);
 
 		void addCreatureCheck(Creature* creature);
-		static void removeCreatureCheck(Creature* creature);
+		void removeCreatureCheck(Creature* creature);
 
 		size_t getPlayersOnline() const {
 			return players.size();
@@ -227,6 +237,9 @@ class Game
 
 		ReturnValue internalMoveItem(Cylinder* fromCylinder, Cylinder* toCylinder, int32_t index,
 		                             Item* item, uint32_t count, Item** _moveItem, uint32_t flags = 0, Creature* actor = nullptr, Item* tradeItem = nullptr, const Position* fromPos = nullptr, const Position* toPos = nullptr);
+		// moves whole items in order, open windows of the containers involved are sent
+		// once at the end instead of per item, returns the first failure
+		ReturnValue internalMoveItems(Cylinder* toCylinder, const ItemVector& items, uint32_t& movedCount, uint32_t flags = 0, Creature* actor = nullptr);
 
 		ReturnValue internalAddItem(Cylinder* toCylinder, Item* item, int32_t index = INDEX_WHEREEVER,
 		                            uint32_t flags = 0, bool test = false);
@@ -394,13 +407,17 @@ class Game
 		void playerCancelMarketOffer(uint32_t playerId, uint32_t timestamp, uint16_t counter);
 		void playerAcceptMarketOffer(uint32_t playerId, uint32_t timestamp, uint16_t counter, uint16_t amount);
 
-		void parsePlayerExtendedOpcode(uint32_t playerId, uint8_t opcode, const std::string& buffer);
+		// data is the payload decoded by the network thread, decoded says it tried
+		void parsePlayerExtendedOpcode(uint32_t playerId, uint8_t opcode, const std::string& buffer, const std::shared_ptr<const JsonValue>& data, bool decoded);
 
 		std::forward_list<Item*> getMarketItemList(uint16_t wareId, uint16_t sufficientCount, DepotChest* depotChest, Inbox* inbox);
 
 		void cleanup();
 		void shutdown();
 		void ReleaseCreature(Creature* creature);
+		void eraseCreatureCheck(Creature* creature);
+		void moveCreatureCheck(Creature* creature, size_t bucket);
+		size_t getLightestCreatureBucket() const;
 		void ReleaseItem(Item* item);
 
 		bool canThrowObjectTo(const Position& fromPos, const Position& toPos, bool checkLineOfSight = true, bool sameFloor = false,
@@ -424,6 +441,9 @@ class Game
 
 		//Events
 		void checkCreatureWalk(uint32_t creatureId);
+		// queues a step of the creature, returns the time of its batch
+		int64_t addWalkBatch(uint32_t creatureId, int64_t delay);
+		void checkWalkBatch(int64_t time);
 		void updateCreatureWalk(uint32_t creatureId);
 		void checkCreatureAttack(uint32_t creatureId);
 		void checkCreatures(size_t index);
@@ -435,21 +455,39 @@ class Game
 
 		bool combatChangeHealth(Creature* attacker, Creature* target, CombatDamage& damage);
 		bool combatChangeMana(Creature* attacker, Creature* target, CombatDamage& damage);
+		// the players getSpectators finds around pos, taken from the snapshot
+		// of the combat being resolved when it covers pos
+		void getCombatSpectators(SpectatorVec& spectators, const Position& pos, bool multifloor);
 
 		//animation help functions
 		void addCreatureHealth(const Creature* target);
 		static void addCreatureHealth(const SpectatorVec& spectators, const Creature* target);
+		void flushCreatureHealth();
+		void addPendingPlayerUpdate(uint32_t playerId) {
+			pendingPlayerUpdates.push_back(playerId);
+		}
+		bool isMovingItems() const {
+			return itemMoveDepth != 0;
+		}
+		void addPendingContainerRefresh(uint32_t playerId) {
+			pendingContainerRefreshes.push_back(playerId);
+		}
+		void flushPlayerUpdates();
 		void addMagicEffect(const Position& pos, uint16_t effect);
 		static void addMagicEffect(const SpectatorVec& spectators, const Position& pos, uint16_t effect);
 		void addDistanceEffect(const Position& fromPos, const Position& toPos, uint8_t effect);
 		static void addDistanceEffect(const SpectatorVec& spectators, const Position& fromPos, const Position& toPos, uint8_t effect);
 
+		// an account's values are read when one of its characters loads, or by
+		// the first get or set for it, and only changed keys are written back
 		void setAccountStorageValue(const uint32_t accountId, const uint32_t key, const int32_t value);
-		int32_t getAccountStorageValue(const uint32_t accountId, const uint32_t key) const;
-		void loadAccountStorageValues();
-		bool saveAccountStorageValues() const;
+		int32_t getAccountStorageValue(const uint32_t accountId, const uint32_t key);
+		// rows of the account fetched with its character, ignored once it is loaded
+		void loadAccountStorageValues(uint32_t accountId, DBResult_ptr result);
+		bool saveAccountStorageValues();
 
 		void startDecay(Item* item);
+		void rescheduleDecay(Item* item);
 
 		int16_t getWorldTime() { return worldTime; }
 		void updateWorldTime();
@@ -468,6 +506,10 @@ class Game
 		void addPlayer(Player* player);
 		void removePlayer(Player* player);
 
+		void addVIPSubscriber(uint32_t vipGuid, Player* player);
+		void removeVIPSubscriber(uint32_t vipGuid, Player* player);
+		void notifyVIPSubscribers(Player* player, VipStatus_t status);
+
 		void addNpc(Npc* npc);
 		void removeNpc(Npc* npc);
 
@@ -503,7 +545,7 @@ class Game
 
 		std::forward_list<Item*> toDecayItems;
 
-		std::unordered_set<Tile*> getTilesToClean() const {
+		const std::unordered_set<Tile*>& getTilesToClean() const {
 			return tilesToClean;
 		}
 		void addTileToClean(Tile* tile) {
@@ -523,26 +565,61 @@ class Game
 		bool playerSpeakTo(Player* player, SpeakClasses type, const std::string& receiver, const std::string& text);
 		void playerSpeakToNpc(Player* player, const std::string& text);
 
+		// merge or split of a stack inside one container, checks already passed
+		ReturnValue internalMoveStack(Container* container, Item* item, Item* toItem, int32_t index, uint32_t count, uint32_t mergeCount,
+		                              Item** _moveItem, Player* actorPlayer, const Position* fromPos, const Position* toPos, ReturnValue ret);
+
 		void checkDecay();
 		void internalDecayItem(Item* item);
+		void scheduleDecay(Item* item);
+		void stopDecay(Item* item);
+
+		void reloadScripts();
+		void updateMonsterInterests();
 
 		std::unordered_map<uint32_t, Player*> players;
-		std::unordered_map<std::string, Player*> mappedPlayerNames;
+		// keys view the names of the online players themselves
+		std::unordered_map<std::string_view, Player*, CaseInsensitiveHash, CaseInsensitiveEqual> mappedPlayerNames;
 		std::unordered_map<uint32_t, Player*> mappedPlayerGuids;
 		std::unordered_map<uint32_t, Guild*> guilds;
 		std::unordered_map<uint16_t, Item*> uniqueItems;
 		std::map<uint32_t, uint32_t> stages;
-		std::unordered_map<uint32_t, std::unordered_map<uint32_t, int32_t>> accountStorageMap;
 
-		std::list<Item*> decayItems[EVENT_DECAY_BUCKETS];
-		std::list<Creature*> checkCreatureLists[EVENT_CREATURECOUNT];
+		// a scripts reload waiting for its files to be compiled
+		std::atomic<bool> scriptsCompiling{false};
+		// an items or monsters reload waiting for its files to be parsed
+		std::atomic<bool> itemsLoading{false};
+		std::atomic<bool> monstersLoading{false};
+		struct AccountStorage {
+			// sorted by key
+			std::vector<std::pair<uint32_t, int32_t>> values;
+			// set or removed since the last save
+			std::vector<uint32_t> changedKeys;
+		};
+		AccountStorage& getAccountStorage(uint32_t accountId);
+		std::unordered_map<uint32_t, AccountStorage> accountStorageMap;
+
+		// decaying items keyed by the absolute time they expire at, each entry holds a reference
+		std::map<int64_t, std::vector<Item*>> decayItems;
+		// creatures stepping at each batch time, see Creature::walkBatchTime
+		std::map<int64_t, std::vector<uint32_t>> walkBatches;
+		std::vector<Creature*> checkCreatureLists[EVENT_CREATURECOUNT];
+		int32_t checkingCreatureBucket = -1;
+		std::vector<Creature*> preparedPathCreatures;
 
 		std::vector<Creature*> ToReleaseCreatures;
 		std::vector<Item*> ToReleaseItems;
 
-		size_t lastBucket = 0;
+		// encoded tooltips, virtual ones keyed by sprite id and count, real items by their tooltip hash
+		std::unordered_map<uint32_t, std::string> virtualTooltips;
+		std::unordered_map<uint64_t, std::string> itemTooltips;
+
+		// last references, destroyed a few at a time to spread out destructor cost
+		std::vector<Creature*> releasedCreatures;
+		std::vector<Item*> releasedItems;
+		void destroyReleased(size_t creatureCount, size_t itemCount);
 
-		WildcardTreeNode wildcardTree { false };
+		WildcardTree wildcardTree;
 
 		std::map<uint32_t, Npc*> npcs;
 		std::map<uint32_t, Monster*> monsters;
@@ -554,6 +631,17 @@ class Game
 
 		std::unordered_set<Tile*> tilesToClean;
 
+		// creatures whose health bar changed in the current dispatcher frame, see flushCreatureHealth
+		std::vector<uint32_t> pendingHealthUpdates;
+		// players with stats, skills or icons waiting to be sent, see flushPlayerUpdates
+		std::vector<uint32_t> pendingPlayerUpdates;
+		// players with container windows to send after internalMoveItems
+		std::vector<uint32_t> pendingContainerRefreshes;
+		uint32_t itemMoveDepth = 0;
+
+		// online players that have the guid in their VIP list
+		std::unordered_map<uint32_t, std::vector<Player*>> vipSubscribers;
+
 		ModalWindow offlineTrainingWindow { std::numeric_limits<uint32_t>::max(), "Choose a Skill", "Please choose a skill:" };
 
 		static constexpr uint8_t LIGHT_DAY = 250;
@@ -586,6 +674,50 @@ class Game
 		uint32_t lastStageLevel = 0;
 		bool stagesEnabled = false;
 		bool useLastStageLevel = false;
+
+		const CombatSpectatorScope* combatSpectatorScope = nullptr;
+
+		friend class CombatSpectatorScope;
+};
+
+/**
+  * The players that may see an area combat, looked up once for all of its
+  * tiles. While the scope lives, the damage, effect and health bar updates of
+  * its targets filter these instead of walking the map again for each
+  * target. Scopes nest, for combats started from scripts of another combat.
+  */
+class CombatSpectatorScope
+{
+	public:
+		// spectators are the players of getSpectators(center, true, true) with
+		// ranges widened by rangeX and rangeY, the area reaches that far from center
+		CombatSpectatorScope(Game& game, const SpectatorVec& spectators, const Position& center, uint32_t rangeX, uint32_t rangeY) :
+			game(game), previous(game.combatSpectatorScope), spectators(spectators), center(center), rangeX(rangeX), rangeY(rangeY) {
+			game.combatSpectatorScope = this;
+		}
+		~CombatSpectatorScope() {
+			game.combatSpectatorScope = previous;
+		}
+
+		// non-copyable
+		CombatSpectatorScope(const CombatSpectatorScope&) = delete;
+		CombatSpectatorScope& operator=(const CombatSpectatorScope&) = delete;
+
+		bool covers(const Position& pos) const {
+			return pos.z == center.z && static_cast<uint32_t>(Position::getDistanceX(pos, center)) <= rangeX &&
+			       static_cast<uint32_t>(Position::getDistanceY(pos, center)) <= rangeY;
+		}
+		const SpectatorVec& getSpectators() const {
+			return spectators;
+		}
+
+	private:
+		Game& game;
+		const CombatSpectatorScope* previous;
+		const SpectatorVec& spectators;
+		const Position center;
+		const uint32_t rangeX;
+		const uint32_t rangeY;
 };
 
 #endif
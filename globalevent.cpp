@@ -44,6 +44,17 @@ void GlobalEvents::clear(bool fromLua)
 	clearMap(serverMap, fromLua);
 	clearMap(timerMap, fromLua);
 
+	// the queues point into the maps, rebuild them from whatever survived
+	thinkQueue = GlobalEventQueue();
+	for (auto& it : thinkMap) {
+		thinkQueue.emplace(it.second.getNextExecution(), &it.second);
+	}
+
+	timerQueue = GlobalEventQueue();
+	for (auto& it : timerMap) {
+		timerQueue.emplace(it.second.getNextExecution(), &it.second);
+	}
+
 	reInitState(fromLua);
 }
 
@@ -58,12 +69,23 @@ Event_ptr GlobalEvents::getEvent(const std::string& nodeName)
 bool GlobalEvents::registerEvent(Event_ptr event, const pugi::xml_node&)
 {
 	GlobalEvent_ptr globalEvent{static_cast<GlobalEvent*>(event.release())}; //event is guaranteed to be a GlobalEvent
+	return addEvent(std::move(globalEvent));
+}
+
+bool GlobalEvents::registerLuaEvent(GlobalEvent* event)
+{
+	GlobalEvent_ptr globalEvent{ event };
+	return addEvent(std::move(globalEvent));
+}
+
+bool GlobalEvents::addEvent(GlobalEvent_ptr globalEvent)
+{
 	if (globalEvent->getEventType() == GLOBALEVENT_TIMER) {
 		auto result = timerMap.emplace(globalEvent->getName(), std::move(*globalEvent));
 		if (result.second) {
-			if (timerEventId == 0) {
-				timerEventId = g_scheduler.addEvent(createSchedulerTask(SCHEDULER_MINTICKS, std::bind(&GlobalEvents::timer, this)));
-			}
+			GlobalEvent& timerEvent = result.first->second;
+			timerQueue.emplace(timerEvent.getNextExecution(), &timerEvent);
+			scheduleTimer();
 			return true;
 		}
 	} else if (globalEvent->getEventType() != GLOBALEVENT_NONE) {
@@ -74,9 +96,9 @@ bool GlobalEvents::registerEvent(Event_ptr event, const pugi::xml_node&)
 	} else { // think event
 		auto result = thinkMap.emplace(globalEvent->getName(), std::move(*globalEvent));
 		if (result.second) {
-			if (thinkEventId == 0) {
-				thinkEventId = g_scheduler.addEvent(createSchedulerTask(SCHEDULER_MINTICKS, std::bind(&GlobalEvents::think, this)));
-			}
+			GlobalEvent& thinkEvent = result.first->second;
+			thinkQueue.emplace(thinkEvent.getNextExecution(), &thinkEvent);
+			scheduleThink();
 			return true;
 		}
 	}
@@ -85,34 +107,42 @@ bool GlobalEvents::registerEvent(Event_ptr event, const pugi::xml_node&)
 	return false;
 }
 
-bool GlobalEvents::registerLuaEvent(GlobalEvent* event)
+void GlobalEvents::scheduleThink()
 {
-	GlobalEvent_ptr globalEvent{ event };
-	if (globalEvent->getEventType() == GLOBALEVENT_TIMER) {
-		auto result = timerMap.emplace(globalEvent->getName(), std::move(*globalEvent));
-		if (result.second) {
-			if (timerEventId == 0) {
-				timerEventId = g_scheduler.addEvent(createSchedulerTask(SCHEDULER_MINTICKS, std::bind(&GlobalEvents::timer, this)));
-			}
-			return true;
-		}
-	} else if (globalEvent->getEventType() != GLOBALEVENT_NONE) {
-		auto result = serverMap.emplace(globalEvent->getName(), std::move(*globalEvent));
-		if (result.second) {
-			return true;
+	if (thinkQueue.empty()) {
+		return;
+	}
+
+	int64_t deadline = thinkQueue.top().first;
+	if (thinkEventId != 0) {
+		if (deadline >= thinkDeadline) {
+			return;
 		}
-	} else { // think event
-		auto result = thinkMap.emplace(globalEvent->getName(), std::move(*globalEvent));
-		if (result.second) {
-			if (thinkEventId == 0) {
-				thinkEventId = g_scheduler.addEvent(createSchedulerTask(SCHEDULER_MINTICKS, std::bind(&GlobalEvents::think, this)));
-			}
-			return true;
+		g_scheduler.stopEvent(thinkEventId);
+	}
+
+	thinkDeadline = deadline;
+	thinkEventId = g_scheduler.addEvent(createSchedulerTask(std::max<int64_t>(SCHEDULER_MINTICKS, deadline - OTSYS_TIME()),
+	                                    std::bind(&GlobalEvents::think, this)));
+}
+
+void GlobalEvents::scheduleTimer()
+{
+	if (timerQueue.empty()) {
+		return;
+	}
+
+	int64_t deadline = timerQueue.top().first;
+	if (timerEventId != 0) {
+		if (deadline >= timerDeadline) {
+			return;
 		}
+		g_scheduler.stopEvent(timerEventId);
 	}
 
-	std::cout << "[Warning - GlobalEvents::configureEvent] Duplicate registered globalevent with name: " << globalEvent->getName() << std::endl;
-	return false;
+	timerDeadline = deadline;
+	timerEventId = g_scheduler.addEvent(createSchedulerTask(std::max<int64_t>(1000, (deadline - time(nullptr)) * 1000),
+	                                    std::bind(&GlobalEvents::timer, this)));
 }
 
 void GlobalEvents::startup() const
@@ -122,76 +152,50 @@ void GlobalEvents::startup() const
 
 void GlobalEvents::timer()
 {
-	time_t now = time(nullptr);
-
-	int64_t nextScheduledTime = std::numeric_limits<int64_t>::max();
-
-	auto it = timerMap.begin();
-	while (it != timerMap.end()) {
-		GlobalEvent& globalEvent = it->second;
-
-		int64_t nextExecutionTime = globalEvent.getNextExecution() - now;
-		if (nextExecutionTime > 0) {
-			if (nextExecutionTime < nextScheduledTime) {
-				nextScheduledTime = nextExecutionTime;
-			}
+	timerEventId = 0;
 
-			++it;
-			continue;
-		}
+	// pop the whole due batch first, so a script that re-registers events cannot extend this run
+	int64_t now = time(nullptr);
+	std::vector<GlobalEvent*> dueEvents;
+	while (!timerQueue.empty() && timerQueue.top().first <= now) {
+		dueEvents.push_back(timerQueue.top().second);
+		timerQueue.pop();
+	}
 
-		if (!globalEvent.executeEvent()) {
-			it = timerMap.erase(it);
+	for (GlobalEvent* globalEvent : dueEvents) {
+		if (!globalEvent->executeEvent()) {
+			timerMap.erase(globalEvent->getName());
 			continue;
 		}
 
-		nextExecutionTime = 86400;
-		if (nextExecutionTime < nextScheduledTime) {
-			nextScheduledTime = nextExecutionTime;
-		}
-
-		globalEvent.setNextExecution(globalEvent.getNextExecution() + nextExecutionTime);
-
-		++it;
+		globalEvent->setNextExecution(globalEvent->getNextExecution() + 86400);
+		timerQueue.emplace(globalEvent->getNextExecution(), globalEvent);
 	}
 
-	if (nextScheduledTime != std::numeric_limits<int64_t>::max()) {
-		timerEventId = g_scheduler.addEvent(createSchedulerTask(std::max<int64_t>(1000, nextScheduledTime * 1000),
-							                std::bind(&GlobalEvents::timer, this)));
-	}
+	scheduleTimer();
 }
 
 void GlobalEvents::think()
 {
-	int64_t now = OTSYS_TIME();
-
-	int64_t nextScheduledTime = std::numeric_limits<int64_t>::max();
-	for (auto& it : thinkMap) {
-		GlobalEvent& globalEvent = it.second;
-
-		int64_t nextExecutionTime = globalEvent.getNextExecution() - now;
-		if (nextExecutionTime > 0) {
-			if (nextExecutionTime < nextScheduledTime) {
-				nextScheduledTime = nextExecutionTime;
-			}
-			continue;
-		}
+	thinkEventId = 0;
 
-		if (!globalEvent.executeEvent()) {
-			std::cout << "[Error - GlobalEvents::think] Failed to execute event: " << globalEvent.getName() << std::endl;
-		}
+	int64_t now = OTSYS_TIME();
+	std::vector<GlobalEvent*> dueEvents;
+	while (!thinkQueue.empty() && thinkQueue.top().first <= now) {
+		dueEvents.push_back(thinkQueue.top().second);
+		thinkQueue.pop();
+	}
 
-		nextExecutionTime = globalEvent.getInterval();
-		if (nextExecutionTime < nextScheduledTime) {
-			nextScheduledTime = nextExecutionTime;
+	for (GlobalEvent* globalEvent : dueEvents) {
+		if (!globalEvent->executeEvent()) {
+			std::cout << "[Error - GlobalEvents::think] Failed to execute event: " << globalEvent->getName() << std::endl;
 		}
 
-		globalEvent.setNextExecution(globalEvent.getNextExecution() + nextExecutionTime);
+		globalEvent->setNextExecution(globalEvent->getNextExecution() + globalEvent->getInterval());
+		thinkQueue.emplace(globalEvent->getNextExecution(), globalEvent);
 	}
 
-	if (nextScheduledTime != std::numeric_limits<int64_t>::max()) {
-		thinkEventId = g_scheduler.addEvent(createSchedulerTask(nextScheduledTime, std::bind(&GlobalEvents::think, this)));
-	}
+	scheduleThink();
 }
 
 void GlobalEvents::execute(GlobalEvent_t type) const
@@ -7,6 +7,8 @@
 
 #include "const.h"
 
+#include <queue>
+
 enum GlobalEvent_t {
 	GLOBALEVENT_NONE,
 	GLOBALEVENT_TIMER,
@@ -19,6 +21,8 @@ enum GlobalEvent_t {
 class GlobalEvent;
 using GlobalEvent_ptr = std::unique_ptr<GlobalEvent>;
 using GlobalEventMap = std::map<std::string, GlobalEvent>;
+using GlobalEventDeadline = std::pair<int64_t, GlobalEvent*>;
+using GlobalEventQueue = std::priority_queue<GlobalEventDeadline, std::vector<GlobalEventDeadline>, std::greater<GlobalEventDeadline>>;
 
 class GlobalEvents final : public BaseEvents
 {
@@ -49,6 +53,10 @@ class GlobalEvents final : public BaseEvents
 
 		Event_ptr getEvent(const std::string& nodeName) override;
 		bool registerEvent(Event_ptr event, const pugi::xml_node& node) override;
+		bool addEvent(GlobalEvent_ptr globalEvent);
+
+		void scheduleThink();
+		void scheduleTimer();
 
 		LuaScriptInterface& getScriptInterface() override {
 			return scriptInterface;
@@ -56,7 +64,11 @@ class GlobalEvents final : public BaseEvents
 		LuaScriptInterface scriptInterface;
 
 		GlobalEventMap thinkMap, serverMap, timerMap;
-		int32_t thinkEventId = 0, timerEventId = 0;
+
+		// deadline ordered views over thinkMap (milliseconds) and timerMap (unix seconds)
+		GlobalEventQueue thinkQueue, timerQueue;
+		int64_t thinkDeadline = 0, timerDeadline = 0;
+		uint32_t thinkEventId = 0, timerEventId = 0;
 };
 
 class GlobalEvent final : public Event
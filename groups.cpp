@@ -60,6 +60,11 @@ bool Groups::load()
 	for (auto groupNode : doc.child("groups").children()) {
 		Group group;
 		group.id = pugi::cast<uint32_t>(groupNode.attribute("id").value());
+		if (getGroup(group.id)) {
+			std::cout << "[Warning - Groups::load] Duplicate group id " << group.id << ", only the first is used." << std::endl;
+			continue;
+		}
+
 		group.name = groupNode.attribute("name").as_string();
 		group.access = groupNode.attribute("access").as_bool();
 		group.maxDepotItems = pugi::cast<uint32_t>(groupNode.attribute("maxdepotitems").value());
@@ -79,17 +84,10 @@ bool Groups::load()
 			}
 		}
 
-		groups.push_back(group);
-	}
-	return true;
-}
-
-Group* Groups::getGroup(uint16_t id)
-{
-	for (Group& group : groups) {
-		if (group.id == id) {
-			return &group;
+		if (group.id >= groups.size()) {
+			groups.resize(group.id + 1);
 		}
+		groups[group.id].reset(new Group(std::move(group)));
 	}
-	return nullptr;
+	return true;
 }
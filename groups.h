@@ -16,10 +16,13 @@ struct Group {
 class Groups {
 	public:
 		bool load();
-		Group* getGroup(uint16_t id);
+		Group* getGroup(uint16_t id) {
+			return id < groups.size() ? groups[id].get() : nullptr;
+		}
 
 	private:
-		std::vector<Group> groups;
+		// by id, nullptr for ids without a group
+		std::vector<std::unique_ptr<Group>> groups;
 };
 
 #endif
@@ -19,31 +19,30 @@ void Guild::addMember(Player* player)
 
 void Guild::removeMember(Player* player)
 {
-	membersOnline.remove(player);
+	auto it = std::find(membersOnline.begin(), membersOnline.end(), player);
+	if (it != membersOnline.end()) {
+		*it = membersOnline.back();
+		membersOnline.pop_back();
+	}
+
 	for (Player* member : membersOnline) {
 		g_game.updatePlayerHelpers(*member);
 	}
 	g_game.updatePlayerHelpers(*player);
-
-	if (membersOnline.empty()) {
-		g_game.removeGuild(id);
-		delete this;
-	}
 }
 
-GuildRank_ptr Guild::getRankById(uint32_t rankId)
+GuildRank_ptr Guild::getRankById(uint32_t rankId) const
 {
-	for (auto rank : ranks) {
-		if (rank->id == rankId) {
-			return rank;
-		}
+	auto it = std::lower_bound(ranks.begin(), ranks.end(), rankId, [](const GuildRank_ptr& rank, uint32_t id) { return rank->id < id; });
+	if (it == ranks.end() || (*it)->id != rankId) {
+		return nullptr;
 	}
-	return nullptr;
+	return *it;
 }
 
 GuildRank_ptr Guild::getRankByName(const std::string& name) const
 {
-	for (auto rank : ranks) {
+	for (const auto& rank : ranks) {
 		if (rank->name == name) {
 			return rank;
 		}
@@ -53,7 +52,7 @@ GuildRank_ptr Guild::getRankByName(const std::string& name) const
 
 GuildRank_ptr Guild::getRankByLevel(uint8_t level) const
 {
-	for (auto rank : ranks) {
+	for (const auto& rank : ranks) {
 		if (rank->level == level) {
 			return rank;
 		}
@@ -63,7 +62,13 @@ GuildRank_ptr Guild::getRankByLevel(uint8_t level) const
 
 void Guild::addRank(uint32_t rankId, const std::string& rankName, uint8_t level)
 {
-	ranks.emplace_back(std::make_shared<GuildRank>(rankId, rankName, level));
+	auto it = std::lower_bound(ranks.begin(), ranks.end(), rankId, [](const GuildRank_ptr& rank, uint32_t id) { return rank->id < id; });
+	if (it != ranks.end() && (*it)->id == rankId) {
+		(*it)->name = rankName;
+		(*it)->level = level;
+		return;
+	}
+	ranks.insert(it, std::make_shared<GuildRank>(rankId, rankName, level));
 }
 
 Guild* IOGuild::loadGuild(uint32_t guildId)
@@ -71,17 +76,26 @@ Guild* IOGuild::loadGuild(uint32_t guildId)
 	Database& db = Database::getInstance();
 	if (DBResult_ptr result = db.storeQuery(fmt::format("SELECT `name` FROM `guilds` WHERE `id` = {:d}", guildId))) {
 		Guild* guild = new Guild(guildId, result->getString("name"));
-
-		if ((result = db.storeQuery(fmt::format("SELECT `id`, `name`, `level` FROM `guild_ranks` WHERE `guild_id` = {:d}", guildId)))) {
-			do {
-				guild->addRank(result->getNumber<uint32_t>("id"), result->getString("name"), result->getNumber<uint16_t>("level"));
-			} while (result->next());
-		}
+		loadRanks(guild, db.storeQuery(fmt::format("SELECT `id`, `name`, `level` FROM `guild_ranks` WHERE `guild_id` = {:d}", guildId)));
 		return guild;
 	}
 	return nullptr;
 }
 
+void IOGuild::loadRanks(Guild* guild, DBResult_ptr result)
+{
+	if (!result) {
+		return;
+	}
+
+	const size_t idColumn = result->getColumnIndex("id");
+	const size_t nameColumn = result->getColumnIndex("name");
+	const size_t levelColumn = result->getColumnIndex("level");
+	do {
+		guild->addRank(result->getNumber<uint32_t>(idColumn), result->getString(nameColumn), result->getNumber<uint16_t>(levelColumn));
+	} while (result->next());
+}
+
 uint32_t IOGuild::getGuildIdByName(const std::string& name)
 {
 	Database& db = Database::getInstance();
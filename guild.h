@@ -4,8 +4,11 @@
 #ifndef FS_GUILD_H_C00F0A1D732E4BA88FF62ACBE74D76BC
 #define FS_GUILD_H_C00F0A1D732E4BA88FF62ACBE74D76BC
 
+class DBResult;
 class Player;
 
+using DBResult_ptr = std::shared_ptr<DBResult>;
+
 struct GuildRank {
 	uint32_t id;
 	std::string name;
@@ -31,7 +34,10 @@ class Guild
 		const std::string& getName() const {
 			return name;
 		}
-		const std::list<Player*>& getMembersOnline() const {
+		void setName(std::string name) {
+			this->name = std::move(name);
+		}
+		const std::vector<Player*>& getMembersOnline() const {
 			return membersOnline;
 		}
 		uint32_t getMemberCount() const {
@@ -41,12 +47,14 @@ class Guild
 			memberCount = count;
 		}
 
+		// sorted by id
 		const std::vector<GuildRank_ptr>& getRanks() const {
 			return ranks;
 		}
-		GuildRank_ptr getRankById(uint32_t rankId);
+		GuildRank_ptr getRankById(uint32_t rankId) const;
 		GuildRank_ptr getRankByName(const std::string& name) const;
 		GuildRank_ptr getRankByLevel(uint8_t level) const;
+		// a known id takes the name and level, the members holding it see them
 		void addRank(uint32_t rankId, const std::string& rankName, uint8_t level);
 
 		const std::string& getMotd() const {
@@ -57,7 +65,7 @@ class Guild
 		}
 
 	private:
-		std::list<Player*> membersOnline;
+		std::vector<Player*> membersOnline;
 		std::vector<GuildRank_ptr> ranks;
 		std::string name;
 		std::string motd;
@@ -67,9 +75,13 @@ class Guild
 
 using GuildWarVector = std::vector<uint32_t>;
 
+// Guilds stay in Game::guilds once loaded, the logins of their members
+// refresh the name and ranks from the rows fetched with the character.
 namespace IOGuild
 {
 	Guild* loadGuild(uint32_t guildId);
+	// rows of `id`, `name` and `level` from guild_ranks
+	void loadRanks(Guild* guild, DBResult_ptr result);
 	uint32_t getGuildIdByName(const std::string& name);
 };
 
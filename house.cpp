@@ -10,6 +10,7 @@
 #include "game.h"
 #include "configmanager.h"
 #include "bed.h"
+#include "databasetasks.h"
 
 #include <fmt/format.h>
 
@@ -36,6 +37,7 @@ void House::setOwner(uint32_t guid, bool updateDatabase/* = true*/, Player* play
 	}
 
 	isLoaded = true;
+	uint32_t previousOwner = owner;
 
 	if (owner != 0) {
 		//send items to depot
@@ -46,7 +48,7 @@ void House::setOwner(uint32_t guid, bool updateDatabase/* = true*/, Player* play
 		}
 
 		for (HouseTile* tile : houseTiles) {
-			if (const CreatureVector* creatures = tile->getCreatures()) {
+			if (const TileCreatureVector* creatures = tile->getCreatures()) {
 				for (int32_t i = creatures->size(); --i >= 0;) {
 					kickPlayer(nullptr, (*creatures)[i]->getPlayer());
 				}
@@ -98,6 +100,10 @@ void House::setOwner(uint32_t guid, bool updateDatabase/* = true*/, Player* play
 		}
 	}
 
+	if (owner != previousOwner) {
+		g_game.map.houses.updateOwner(this, previousOwner);
+	}
+
 	updateDoorDescription();
 }
 
@@ -181,7 +187,7 @@ void House::setAccessList(uint32_t listId, const std::string& textlist)
 
 	//kick uninvited players
 	for (HouseTile* tile : houseTiles) {
-		if (CreatureVector* creatures = tile->getCreatures()) {
+		if (TileCreatureVector* creatures = tile->getCreatures()) {
 			for (int32_t i = creatures->size(); --i >= 0;) {
 				Player* player = (*creatures)[i]->getPlayer();
 				if (player && !isInvited(player)) {
@@ -270,6 +276,7 @@ void House::addDoor(Door* door)
 {
 	door->incrementReferenceCounter();
 	doorSet.insert(door);
+	doorPositions[door->getPosition()] = door;
 	door->setHouse(this);
 	updateDoorDescription();
 }
@@ -277,10 +284,25 @@ void House::addDoor(Door* door)
 void House::removeDoor(Door* door)
 {
 	auto it = doorSet.find(door);
-	if (it != doorSet.end()) {
-		door->decrementReferenceCounter();
-		doorSet.erase(it);
+	if (it == doorSet.end()) {
+		return;
 	}
+
+	doorSet.erase(it);
+
+	// a transformed door is added before the old one goes, its entry stays
+	auto positionIt = std::find_if(doorPositions.begin(), doorPositions.end(), [door](const auto& entry) { return entry.second == door; });
+	if (positionIt != doorPositions.end()) {
+		Position pos = positionIt->first;
+		doorPositions.erase(positionIt);
+		for (Door* other : doorSet) {
+			if (other->getPosition() == pos) {
+				doorPositions[pos] = other;
+				break;
+			}
+		}
+	}
+	door->decrementReferenceCounter();
 }
 
 void House::addBed(BedItem* bed)
@@ -301,12 +323,8 @@ Door* House::getDoorByNumber(uint32_t doorId) const
 
 Door* House::getDoorByPosition(const Position& pos)
 {
-	for (Door* door : doorSet) {
-		if (door->getPosition() == pos) {
-			return door;
-		}
-	}
-	return nullptr;
+	auto it = doorPositions.find(pos);
+	return it != doorPositions.end() ? it->second : nullptr;
 }
 
 bool House::canEditAccessList(uint32_t listId, const Player* player)
@@ -396,6 +414,9 @@ void AccessList::parseList(const std::string& list)
 	std::istringstream listStream(list);
 	std::string line;
 
+	// names of offline players are resolved together in one query
+	std::vector<std::string> offlineNames;
+
 	uint16_t lineNo = 1;
 	while (getline(listStream, line)) {
 		if (++lineNo > 100) {
@@ -424,10 +445,16 @@ void AccessList::parseList(const std::string& list)
 			allowEveryone = true;
 		} else if (line.find("!") != std::string::npos || line.find("*") != std::string::npos || line.find("?") != std::string::npos) {
 			continue; // regexp no longer supported
+		} else if (Player* player = g_game.getPlayerByName(line)) {
+			playerList.insert(player->getGUID());
 		} else {
-			addPlayer(line);
+			offlineNames.push_back(line);
 		}
 	}
+
+	for (uint32_t guid : IOLoginData::getGuidsByNames(offlineNames)) {
+		playerList.insert(guid);
+	}
 }
 
 void AccessList::addPlayer(const std::string& name)
@@ -457,7 +484,11 @@ const Guild* getGuildByName(const std::string& name)
 		return guild;
 	}
 
-	return IOGuild::loadGuild(guildId);
+	Guild* loaded = IOGuild::loadGuild(guildId);
+	if (loaded) {
+		g_game.addGuild(loaded);
+	}
+	return loaded;
 }
 
 }
@@ -573,14 +604,30 @@ void Door::onRemoved()
 	}
 }
 
-House* Houses::getHouseByPlayerId(uint32_t playerId)
+void Houses::updateOwner(House* house, uint32_t previousOwner)
 {
-	for (const auto& it : houseMap) {
-		if (it.second->getOwner() == playerId) {
-			return it.second;
+	if (previousOwner != 0) {
+		auto it = ownerHouses.find(previousOwner);
+		if (it != ownerHouses.end() && it->second == house) {
+			ownerHouses.erase(it);
+
+			// the player may still own another house
+			for (const auto& houseIt : houseMap) {
+				if (houseIt.second->getOwner() == previousOwner) {
+					ownerHouses.emplace(previousOwner, houseIt.second);
+					break;
+				}
+			}
+		}
+	}
+
+	uint32_t owner = house->getOwner();
+	if (owner != 0) {
+		House*& entry = ownerHouses[owner];
+		if (!entry || entry->getId() > house->getId()) {
+			entry = house;
 		}
 	}
-	return nullptr;
 }
 
 bool Houses::loadHousesXML(const std::string& filename)
@@ -628,95 +675,205 @@ bool Houses::loadHousesXML(const std::string& filename)
 	return true;
 }
 
+namespace {
+
+// houses charged per dispatcher task, the rest continue in the next one
+constexpr size_t RENT_BATCH_SIZE = 32;
+
+struct RentRun
+{
+	std::vector<std::pair<uint32_t, uint32_t>> houses; // house id, owner
+	std::map<uint32_t, uint64_t> balances;
+	time_t currentTime;
+	RentPeriod_t rentPeriod;
+	size_t next = 0;
+};
+
+time_t getRentPaidUntil(time_t currentTime, RentPeriod_t rentPeriod)
+{
+	switch (rentPeriod) {
+		case RENTPERIOD_DAILY:
+			return currentTime + 24 * 60 * 60;
+		case RENTPERIOD_WEEKLY:
+			return currentTime + 24 * 60 * 60 * 7;
+		case RENTPERIOD_MONTHLY:
+			return currentTime + 24 * 60 * 60 * 30;
+		case RENTPERIOD_YEARLY:
+			return currentTime + 24 * 60 * 60 * 365;
+		default:
+			return currentTime;
+	}
+}
+
+Item* createRentWarning(const House* house, RentPeriod_t rentPeriod)
+{
+	std::string period;
+	switch (rentPeriod) {
+		case RENTPERIOD_DAILY:
+			period = "daily";
+			break;
+
+		case RENTPERIOD_WEEKLY:
+			period = "weekly";
+			break;
+
+		case RENTPERIOD_MONTHLY:
+			period = "monthly";
+			break;
+
+		case RENTPERIOD_YEARLY:
+			period = "annual";
+			break;
+
+		default:
+			break;
+	}
+
+	int32_t daysLeft = 7 - house->getPayRentWarnings();
+
+	Item* letter = Item::CreateItem(ITEM_LETTER_STAMPED);
+	letter->setText(fmt::format("Warning! \nThe {:s} rent of {:d} gold for your house \"{:s}\" is payable. Have it within {:d} days or you will lose this house.", period, house->getRent(), house->getName(), daysLeft));
+	return letter;
+}
+
+void chargeHouse(RentRun& run, House* house, uint32_t ownerId)
+{
+	const uint32_t rent = house->getRent();
+
+	// online owners pay from the balance in memory, their next save stores it
+	if (Player* player = g_game.getPlayerByGUID(ownerId)) {
+		if (player->getBankBalance() >= rent) {
+			player->setBankBalance(player->getBankBalance() - rent);
+			house->setPaidUntil(getRentPaidUntil(run.currentTime, run.rentPeriod));
+		} else if (house->getPayRentWarnings() < 7) {
+			g_game.internalAddItem(player->getInbox(), createRentWarning(house, run.rentPeriod), INDEX_WHEREEVER, FLAG_NOLIMIT);
+			house->setPayRentWarnings(house->getPayRentWarnings() + 1);
+		} else {
+			house->setOwner(0, true, player);
+		}
+		return;
+	}
+
+	auto it = run.balances.find(ownerId);
+	if (it == run.balances.end()) {
+		// Player doesn't exist, reset house owner
+		house->setOwner(0);
+		return;
+	}
+
+	if (it->second >= rent) {
+		it->second -= rent;
+
+		// keyed by the character, so it runs in order with its loads and saves
+		auto job = [ownerId, rent](Database& db) {
+			return db.executeQuery(fmt::format("UPDATE `players` SET `balance` = `balance` - {:d} WHERE `id` = {:d} AND `balance` >= {:d}", rent, ownerId, rent));
+		};
+		if (!g_databaseTasks.addJob(job, nullptr, ownerId)) {
+			job(Database::getInstance());
+		}
+		house->setPaidUntil(getRentPaidUntil(run.currentTime, run.rentPeriod));
+	} else if (house->getPayRentWarnings() < 7) {
+		Item* letter = createRentWarning(house, run.rentPeriod);
+		auto rows = std::make_shared<InboxItemRows>();
+		IOLoginData::addInboxItemRow(*rows, letter);
+		delete letter;
+
+		auto job = [ownerId, rows](Database& db) {
+			return IOLoginData::appendInboxItems(db, ownerId, *rows);
+		};
+		if (!g_databaseTasks.addJob(job, nullptr, ownerId)) {
+			job(Database::getInstance());
+		}
+		house->setPayRentWarnings(house->getPayRentWarnings() + 1);
+	} else {
+		// moves the house items to the inbox of the loaded character and saves it
+		house->setOwner(0);
+	}
+}
+
+void chargeHouses(const std::shared_ptr<RentRun>& run)
+{
+	size_t end = std::min(run->next + RENT_BATCH_SIZE, run->houses.size());
+	for (; run->next < end; ++run->next) {
+		const auto& entry = run->houses[run->next];
+
+		// the house may have changed hands since the balances were read
+		House* house = g_game.map.houses.getHouse(entry.first);
+		if (!house || house->getOwner() != entry.second || house->getPaidUntil() > run->currentTime) {
+			continue;
+		}
+		chargeHouse(*run, house, entry.second);
+	}
+
+	if (run->next < run->houses.size()) {
+		g_dispatcher.addTask(createTask([run]() { chargeHouses(run); }));
+	}
+}
+
+}
+
 void Houses::payHouses(RentPeriod_t rentPeriod) const
 {
 	if (rentPeriod == RENTPERIOD_NEVER) {
 		return;
 	}
 
-	time_t currentTime = time(nullptr);
+	auto run = std::make_shared<RentRun>();
+	run->currentTime = time(nullptr);
+	run->rentPeriod = rentPeriod;
+
+	std::set<uint32_t> owners;
 	for (const auto& it : houseMap) {
 		House* house = it.second;
 		if (house->getOwner() == 0) {
 			continue;
 		}
 
-		const uint32_t rent = house->getRent();
-		if (rent == 0 || house->getPaidUntil() > currentTime) {
-			continue;
-		}
-
-		const uint32_t ownerId = house->getOwner();
-		Town* town = g_game.map.towns.getTown(house->getTownId());
-		if (!town) {
+		if (house->getRent() == 0 || house->getPaidUntil() > run->currentTime) {
 			continue;
 		}
 
-		Player player(nullptr);
-		if (!IOLoginData::loadPlayerById(&player, ownerId)) {
-			// Player doesn't exist, reset house owner
-			house->setOwner(0);
+		if (!g_game.map.towns.getTown(house->getTownId())) {
 			continue;
 		}
 
-		if (player.getBankBalance() >= rent) {
-			player.setBankBalance(player.getBankBalance() - rent);
-
-			time_t paidUntil = currentTime;
-			switch (rentPeriod) {
-				case RENTPERIOD_DAILY:
-					paidUntil += 24 * 60 * 60;
-					break;
-				case RENTPERIOD_WEEKLY:
-					paidUntil += 24 * 60 * 60 * 7;
-					break;
-				case RENTPERIOD_MONTHLY:
-					paidUntil += 24 * 60 * 60 * 30;
-					break;
-				case RENTPERIOD_YEARLY:
-					paidUntil += 24 * 60 * 60 * 365;
-					break;
-				default:
-					break;
-			}
-
-			house->setPaidUntil(paidUntil);
-		} else {
-			if (house->getPayRentWarnings() < 7) {
-				int32_t daysLeft = 7 - house->getPayRentWarnings();
-
-				Item* letter = Item::CreateItem(ITEM_LETTER_STAMPED);
-				std::string period;
-
-				switch (rentPeriod) {
-					case RENTPERIOD_DAILY:
-						period = "daily";
-						break;
-
-					case RENTPERIOD_WEEKLY:
-						period = "weekly";
-						break;
+		run->houses.emplace_back(house->getId(), house->getOwner());
+		owners.insert(house->getOwner());
+	}
 
-					case RENTPERIOD_MONTHLY:
-						period = "monthly";
-						break;
+	if (run->houses.empty()) {
+		return;
+	}
 
-					case RENTPERIOD_YEARLY:
-						period = "annual";
-						break;
+	// the balances of every owner due are read at once, off the game thread
+	std::string query = "SELECT `id`, `balance` FROM `players` WHERE `id` IN (";
+	for (uint32_t ownerId : owners) {
+		query += std::to_string(ownerId);
+		query.push_back(',');
+	}
+	query.back() = ')';
 
-					default:
-						break;
-				}
+	// an empty result is told apart from a failed query, which must not reset every house
+	auto job = [run, query](Database& db) {
+		DBResult_ptr result = db.storeQuery(query);
+		if (!result) {
+			return db.executeQuery("SELECT 1");
+		}
 
-				letter->setText(fmt::format("Warning! \nThe {:s} rent of {:d} gold for your house \"{:s}\" is payable. Have it within {:d} days or you will lose this house.", period, house->getRent(), house->getName(), daysLeft));
-				g_game.internalAddItem(player.getInbox(), letter, INDEX_WHEREEVER, FLAG_NOLIMIT);
-				house->setPayRentWarnings(house->getPayRentWarnings() + 1);
-			} else {
-				house->setOwner(0, true, &player);
-			}
+		do {
+			run->balances[result->getNumber<uint32_t>("id")] = result->getNumber<uint64_t>("balance");
+		} while (result->next());
+		return true;
+	};
+	auto callback = [run](DBResult_ptr, bool success) {
+		if (!success) {
+			std::cout << "[Error - Houses::payHouses] Cannot read the balances of the house owners, no rent is charged." << std::endl;
+			return;
 		}
+		chargeHouses(run);
+	};
 
-		IOLoginData::savePlayer(&player);
+	if (!g_databaseTasks.addJob(job, callback)) {
+		callback(nullptr, job(Database::getInstance()));
 	}
 }
@@ -5,6 +5,7 @@
 #define FS_HOUSE_H_EB9732E7771A438F9CD0EFA8CB4C58C4
 
 #include <set>
+#include <unordered_map>
 #include <unordered_set>
 
 #include "container.h"
@@ -92,8 +93,8 @@ enum AccessHouseLevel_t {
 	HOUSE_OWNER = 3,
 };
 
-using HouseTileList = std::list<HouseTile*>;
-using HouseBedItemList = std::list<BedItem*>;
+using HouseTileList = std::vector<HouseTile*>;
+using HouseBedItemList = std::vector<BedItem*>;
 
 class HouseTransferItem final : public Item
 {
@@ -207,6 +208,14 @@ class House
 			return static_cast<uint32_t>(std::ceil(bedsList.size() / 2.)); //each bed takes 2 sqms of space, ceil is just for bad maps
 		}
 
+		// content hash of the items as last written to tile_store, 0 while unknown
+		size_t getSavedItemsHash() const {
+			return savedItemsHash;
+		}
+		void setSavedItemsHash(size_t hash) {
+			savedItemsHash = hash;
+		}
+
 	private:
 		bool transferToDepot() const;
 		bool transferToDepot(Player* player) const;
@@ -218,6 +227,8 @@ class House
 
 		HouseTileList houseTiles;
 		std::set<Door*> doorSet;
+		// doors never move, they are keyed by the tile holding them when added
+		std::unordered_map<Position, Door*> doorPositions;
 		HouseBedItemList bedsList;
 
 		std::string houseName;
@@ -226,6 +237,7 @@ class House
 		HouseTransferItem* transferItem = nullptr;
 
 		time_t paidUntil = 0;
+		size_t savedItemsHash = 0;
 
 		uint32_t id;
 		uint32_t owner = 0;
@@ -282,7 +294,12 @@ class Houses
 			return it->second;
 		}
 
-		House* getHouseByPlayerId(uint32_t playerId);
+		House* getHouseByPlayerId(uint32_t playerId) const {
+			auto it = ownerHouses.find(playerId);
+			return it != ownerHouses.end() ? it->second : nullptr;
+		}
+		// keeps the owner index, called by House::setOwner
+		void updateOwner(House* house, uint32_t previousOwner);
 
 		bool loadHousesXML(const std::string& filename);
 
@@ -294,6 +311,8 @@ class Houses
 
 	private:
 		HouseMap houseMap;
+		// the lowest house id each player owns
+		std::unordered_map<uint32_t, House*> ownerHouses;
 };
 
 #endif
@@ -0,0 +1,94 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#include "otpch.h"
+
+#include "hugepagearena.h"
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+char* HugePageArena::base = nullptr;
+size_t HugePageArena::capacity = 0;
+std::atomic<size_t> HugePageArena::used{0};
+HugePageArena::SizeClass HugePageArena::sizeClasses[CLASS_COUNT];
+
+namespace {
+
+constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+}
+
+bool HugePageArena::enable(size_t size)
+{
+	if (base || size == 0) {
+		return false;
+	}
+
+#ifdef __linux__
+	size = (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+
+	// one extra huge page to align the start to a huge page boundary
+	void* mapping = mmap(nullptr, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (mapping == MAP_FAILED) {
+		std::cout << "[Warning - HugePageArena::enable] Cannot reserve " << (size >> 20) << " MiB, the map stays on the heap." << std::endl;
+		return false;
+	}
+
+	char* start = static_cast<char*>(mapping);
+	char* aligned = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(start) + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+	if (aligned != start) {
+		munmap(start, aligned - start);
+	}
+	munmap(aligned + size, (start + size + HUGE_PAGE_SIZE) - (aligned + size));
+
+	if (madvise(aligned, size, MADV_HUGEPAGE) != 0) {
+		std::cout << "[Warning - HugePageArena::enable] Transparent huge pages are not available, the arena uses normal pages." << std::endl;
+	}
+
+	base = aligned;
+	capacity = size;
+	return true;
+#else
+	std::cout << "[Warning - HugePageArena::enable] Huge page arenas are only available on Linux." << std::endl;
+	return false;
+#endif
+}
+
+void* HugePageArena::allocateBlock(size_t size)
+{
+	size_t sizeClass = (size + CLASS_SIZE - 1) / CLASS_SIZE;
+	if (sizeClass == 0 || sizeClass > CLASS_COUNT) {
+		return nullptr;
+	}
+
+	SizeClass& freeList = sizeClasses[sizeClass - 1];
+	{
+		std::lock_guard<std::mutex> lockClass(freeList.lock);
+		if (FreeBlock* block = freeList.freeBlocks) {
+			freeList.freeBlocks = block->next;
+			return block;
+		}
+	}
+
+	size_t blockSize = sizeClass * CLASS_SIZE;
+	size_t offset = used.fetch_add(blockSize, std::memory_order_relaxed);
+	if (offset + blockSize > capacity) {
+		// no later block fits either, keep the counter from wrapping
+		used.store(capacity, std::memory_order_relaxed);
+		return nullptr;
+	}
+	return base + offset;
+}
+
+void HugePageArena::releaseBlock(char* block, size_t size)
+{
+	size_t sizeClass = (size + CLASS_SIZE - 1) / CLASS_SIZE;
+	SizeClass& freeList = sizeClasses[sizeClass - 1];
+
+	FreeBlock* freeBlock = reinterpret_cast<FreeBlock*>(block);
+	std::lock_guard<std::mutex> lockClass(freeList.lock);
+	freeBlock->next = freeList.freeBlocks;
+	freeList.freeBlocks = freeBlock;
+}
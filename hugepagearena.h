@@ -0,0 +1,64 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#ifndef FS_HUGEPAGEARENA_H_8E5386E2574A40A7A3F7BDB2F6F6DF6B
+#define FS_HUGEPAGEARENA_H_8E5386E2574A40A7A3F7BDB2F6F6DF6B
+
+#include <atomic>
+#include <mutex>
+
+// One reserved range of address space backed by transparent huge pages, so
+// the tiles, items and quadtree nodes the map is made of share a few TLB
+// entries instead of one per 4 KiB page. Blocks are cut from the front of the
+// range and freed blocks are kept per 16 byte size class for the next of
+// their size, the range itself is never given back. The pages are taken on
+// first touch, so they come from the memory node of the thread that loads the
+// map. Once the range is used up or for larger blocks the callers fall back
+// to the global heap. Linux only, elsewhere it stays off.
+class HugePageArena
+{
+	public:
+		// reserves size bytes rounded up to 2 MiB, startup before the map loads
+		static bool enable(size_t size);
+
+		// nullptr when the arena is off, full or the size too large
+		static void* allocate(size_t size) {
+			if (!base) {
+				return nullptr;
+			}
+			return allocateBlock(size);
+		}
+
+		// false for blocks not from the arena
+		static bool release(void* p, size_t size) {
+			char* block = static_cast<char*>(p);
+			if (block < base || block >= base + capacity) {
+				return false;
+			}
+			releaseBlock(block, size);
+			return true;
+		}
+
+	private:
+		static constexpr size_t CLASS_SIZE = 16;
+		static constexpr size_t CLASS_COUNT = 128;
+
+		struct FreeBlock {
+			FreeBlock* next;
+		};
+
+		struct SizeClass {
+			std::mutex lock;
+			FreeBlock* freeBlocks = nullptr;
+		};
+
+		static void* allocateBlock(size_t size);
+		static void releaseBlock(char* block, size_t size);
+
+		static char* base;
+		static size_t capacity;
+		static std::atomic<size_t> used;
+		static SizeClass sizeClasses[CLASS_COUNT];
+};
+
+#endif
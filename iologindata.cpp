@@ -5,13 +5,62 @@
 
 #include "iologindata.h"
 #include "configmanager.h"
+#include "databasemanager.h"
+#include "databasetasks.h"
 #include "game.h"
+#include "iomapserialize.h"
+#include "playerjournal.h"
 
 #include <fmt/format.h>
 
 extern ConfigManager g_config;
 extern Game g_game;
 
+namespace {
+
+// saves queued on the database thread per character guid
+std::unordered_map<uint32_t, uint32_t> pendingSaves;
+std::mutex pendingSavesLock;
+std::condition_variable pendingSavesSignal;
+
+// accounts of recent login server hits, keyed by lower case account name
+struct CachedAccount
+{
+	Account account;
+	std::string password;
+	int64_t expiresAt;
+};
+
+constexpr size_t ACCOUNT_CACHE_SIZE = 16384;
+
+std::unordered_map<std::string, CachedAccount> accountCache;
+std::unordered_map<uint32_t, std::string> accountCacheNames;
+std::mutex accountCacheLock;
+
+// tells a locker fetch from a stale one of an earlier login, only used on the game thread
+uint32_t nextLockerLoadId = 0;
+
+// set once at startup, player_item_blobs is read whenever it exists so either format can be switched back
+bool itemBlobTable = false;
+bool itemBlobWrites = false;
+
+// first byte of every blob, bump it when the record layout changes
+constexpr uint8_t ITEM_BLOB_VERSION = 1;
+
+DBParams itemParams(uint32_t guid, int32_t pid, int32_t sid, const Item* item, const char* attributes, size_t attributesSize)
+{
+	DBParams params;
+	params.addNumber(guid);
+	params.addNumber(pid);
+	params.addNumber(sid);
+	params.addNumber(item->getID());
+	params.addNumber(item->getSubType());
+	params.addBlob(attributes, attributesSize);
+	return params;
+}
+
+}
+
 Account IOLoginData::loadAccount(uint32_t accno)
 {
 	Account account;
@@ -57,16 +106,27 @@ std::string decodeSecret(const std::string& secret)
 	return key;
 }
 
-bool IOLoginData::loginserverAuthentication(const std::string& name, const std::string& password, Account& account)
+bool IOLoginData::loginserverAuthentication(Database& db, const std::string& name, const std::string& password, Account& account)
 {
-	Database& db = Database::getInstance();
+	const int64_t cacheDuration = g_config.getNumber(ConfigManager::ACCOUNT_CACHE_DURATION) * 1000;
+	const std::string passwordHash = transformToSHA1(password);
+	const std::string cacheKey = asLowerCaseString(name);
+	if (cacheDuration > 0) {
+		std::lock_guard<std::mutex> lockGuard(accountCacheLock);
+		auto it = accountCache.find(cacheKey);
+		if (it != accountCache.end() && it->second.expiresAt > OTSYS_TIME() && it->second.password == passwordHash) {
+			account = it->second.account;
+			return true;
+		}
+	}
 
+	// a wrong password reads the account again, it may have been changed meanwhile
 	DBResult_ptr result = db.storeQuery(fmt::format("SELECT `id`, `name`, `password`, `secret`, `type`, `premium_ends_at` FROM `accounts` WHERE `name` = {:s}", db.escapeString(name)));
 	if (!result) {
 		return false;
 	}
 
-	if (transformToSHA1(password) != result->getString("password")) {
+	if (passwordHash != result->getString("password")) {
 		return false;
 	}
 
@@ -95,9 +155,32 @@ bool IOLoginData::loginserverAuthentication(const std::string& name, const std::
 				account.characters.push_back(character);
 		} while (result->next());
 	}
+
+	if (cacheDuration > 0) {
+		std::lock_guard<std::mutex> lockGuard(accountCacheLock);
+		if (accountCache.size() >= ACCOUNT_CACHE_SIZE) {
+			accountCache.clear();
+			accountCacheNames.clear();
+		}
+
+		accountCache[cacheKey] = {account, passwordHash, OTSYS_TIME() + cacheDuration};
+		accountCacheNames[account.id] = cacheKey;
+	}
 	return true;
 }
 
+void IOLoginData::invalidateAccount(uint32_t accountId)
+{
+	std::lock_guard<std::mutex> lockGuard(accountCacheLock);
+	auto it = accountCacheNames.find(accountId);
+	if (it == accountCacheNames.end()) {
+		return;
+	}
+
+	accountCache.erase(it->second);
+	accountCacheNames.erase(it);
+}
+
 uint32_t IOLoginData::gameworldAuthentication(const std::string& accountName, const std::string& password, std::string& characterName, std::string& token, uint32_t tokenTime)
 {
 	Database& db = Database::getInstance();
@@ -168,6 +251,7 @@ AccountType_t IOLoginData::getAccountType(uint32_t accountId)
 void IOLoginData::setAccountType(uint32_t accountId, AccountType_t accountType)
 {
 	Database::getInstance().executeQuery(fmt::format("UPDATE `accounts` SET `type` = {:d} WHERE `id` = {:d}", static_cast<uint16_t>(accountType), accountId));
+	invalidateAccount(accountId);
 }
 
 void IOLoginData::updateOnlineStatus(uint32_t guid, bool login)
@@ -177,9 +261,13 @@ void IOLoginData::updateOnlineStatus(uint32_t guid, bool login)
 	}
 
 	if (login) {
-		Database::getInstance().executeQuery(fmt::format("INSERT INTO `players_online` VALUES ({:d})", guid));
+		DBParams params;
+		params.addNumber(guid);
+		Database::getInstance().executeQuery("INSERT INTO `players_online` VALUES (?)", params);
 	} else {
-		Database::getInstance().executeQuery(fmt::format("DELETE FROM `players_online` WHERE `player_id` = {:d}", guid));
+		DBParams params;
+		params.addNumber(guid);
+		Database::getInstance().executeQuery("DELETE FROM `players_online` WHERE `player_id` = ?", params);
 	}
 }
 
@@ -207,19 +295,84 @@ bool IOLoginData::preloadPlayer(Player* player, const std::string& name)
 
 bool IOLoginData::loadPlayerById(Player* player, uint32_t id)
 {
-	Database& db = Database::getInstance();
-	return loadPlayer(player, db.storeQuery(fmt::format("SELECT `id`, `name`, `account_id`, `group_id`, `sex`, `vocation`, `experience`, `level`, `maglevel`, `health`, `healthmax`, `blessings`, `mana`, `manamax`, `manaspent`, `soul`, `lookbody`, `lookfeet`, `lookhead`, `looklegs`, `looktype`, `lookaddons`, `posx`, `posy`, `posz`, `cap`, `lastlogin`, `lastlogout`, `lastip`, `conditions`, `skulltime`, `skull`, `town_id`, `balance`, `offlinetraining_time`, `offlinetraining_skill`, `stamina`, `skill_fist`, `skill_fist_tries`, `skill_club`, `skill_club_tries`, `skill_sword`, `skill_sword_tries`, `skill_axe`, `skill_axe_tries`, `skill_dist`, `skill_dist_tries`, `skill_shielding`, `skill_shielding_tries`, `skill_fishing`, `skill_fishing_tries`, `skill_crafting`, `skill_crafting_tries`, `skill_woodcutting`, `skill_woodcutting_tries`, `skill_mining`, `skill_mining_tries`, `skill_herbalist`, `skill_herbalist_tries`, `direction`, `stat_str`, `stat_int`, `stat_dex`, `stat_vit`, `stat_spr`, `stat_wis`, `skill_armorsmith`, `skill_armorsmith_tries`, `skill_weaponsmith`, `skill_weaponsmith_tries`, `skill_jewelsmith`, `skill_jewelsmith_tries` FROM `players` WHERE `id` = {:d}", id)));
+	waitForPendingSave(id);
+
+	PlayerLoadData data;
+	return fetchPlayer(Database::getInstance(), fmt::format("`id` = {:d}", id), data) && loadPlayer(player, data);
 }
 
 bool IOLoginData::loadPlayerByName(Player* player, const std::string& name)
 {
+	bool pending;
+	{
+		std::lock_guard<std::mutex> lockGuard(pendingSavesLock);
+		pending = !pendingSaves.empty();
+	}
+
+	if (pending) {
+		waitForPendingSave(getGuidByName(name));
+	}
+
 	Database& db = Database::getInstance();
-	return loadPlayer(player, db.storeQuery(fmt::format("SELECT `id`, `name`, `account_id`, `group_id`, `sex`, `vocation`, `experience`, `level`, `maglevel`, `health`, `healthmax`, `blessings`, `mana`, `manamax`, `manaspent`, `soul`, `lookbody`, `lookfeet`, `lookhead`, `looklegs`, `looktype`, `lookaddons`, `posx`, `posy`, `posz`, `cap`, `lastlogin`, `lastlogout`, `lastip`, `conditions`, `skulltime`, `skull`, `town_id`, `balance`, `offlinetraining_time`, `offlinetraining_skill`, `stamina`, `skill_fist`, `skill_fist_tries`, `skill_club`, `skill_club_tries`, `skill_sword`, `skill_sword_tries`, `skill_axe`, `skill_axe_tries`, `skill_dist`, `skill_dist_tries`, `skill_shielding`, `skill_shielding_tries`, `skill_fishing`, `skill_fishing_tries`, `skill_crafting`, `skill_crafting_tries`, `skill_woodcutting`, `skill_woodcutting_tries`, `skill_mining`, `skill_mining_tries`,  `skill_herbalist`, `skill_herbalist_tries`, `direction`, `stat_str`, `stat_int`, `stat_dex`, `stat_vit`, `stat_spr`, `stat_wis`, `skill_armorsmith`, `skill_armorsmith_tries`, `skill_weaponsmith`, `skill_weaponsmith_tries`, `skill_jewelsmith`, `skill_jewelsmith_tries` FROM `players` WHERE `name` = {:s}", db.escapeString(name))));
+	PlayerLoadData data;
+	return fetchPlayer(db, fmt::format("`name` = {:s}", db.escapeString(name)), data) && loadPlayer(player, data);
+}
+
+void IOLoginData::loadPlayerAsync(uint32_t guid, std::function<void(PlayerLoadData*)> callback)
+{
+	auto data = std::make_shared<PlayerLoadData>();
+
+	// keyed by the character, so it runs after the saves already queued for it
+	bool queued = g_databaseTasks.addJob([guid, data](Database& db) {
+		return fetchPlayer(db, fmt::format("`id` = {:d}", guid), *data);
+	}, [data, callback](DBResult_ptr, bool success) {
+		callback(success ? data.get() : nullptr);
+	}, guid);
+
+	if (!queued) {
+		waitForPendingSave(guid);
+		callback(fetchPlayer(Database::getInstance(), fmt::format("`id` = {:d}", guid), *data) ? data.get() : nullptr);
+	}
 }
 
-static GuildWarVector getWarList(uint32_t guildId)
+bool IOLoginData::fetchPlayer(Database& db, const std::string& condition, PlayerLoadData& data)
+{
+	data.player = db.storeQuery(fmt::format("SELECT `id`, `name`, `account_id`, `group_id`, `sex`, `vocation`, `experience`, `level`, `maglevel`, `health`, `healthmax`, `blessings`, `mana`, `manamax`, `manaspent`, `soul`, `lookbody`, `lookfeet`, `lookhead`, `looklegs`, `looktype`, `lookaddons`, `posx`, `posy`, `posz`, `cap`, `lastlogin`, `lastlogout`, `lastip`, `conditions`, `skulltime`, `skull`, `town_id`, `balance`, `offlinetraining_time`, `offlinetraining_skill`, `stamina`, `skill_fist`, `skill_fist_tries`, `skill_club`, `skill_club_tries`, `skill_sword`, `skill_sword_tries`, `skill_axe`, `skill_axe_tries`, `skill_dist`, `skill_dist_tries`, `skill_shielding`, `skill_shielding_tries`, `skill_fishing`, `skill_fishing_tries`, `skill_crafting`, `skill_crafting_tries`, `skill_woodcutting`, `skill_woodcutting_tries`, `skill_mining`, `skill_mining_tries`, `skill_herbalist`, `skill_herbalist_tries`, `direction`, `stat_str`, `stat_int`, `stat_dex`, `stat_vit`, `stat_spr`, `stat_wis`, `skill_armorsmith`, `skill_armorsmith_tries`, `skill_weaponsmith`, `skill_weaponsmith_tries`, `skill_jewelsmith`, `skill_jewelsmith_tries` FROM `players` WHERE {:s}", condition));
+	if (!data.player) {
+		return false;
+	}
+
+	uint32_t guid = data.player->getNumber<uint32_t>("id");
+	uint32_t accountId = data.player->getNumber<uint32_t>("account_id");
+
+	data.account = db.storeQuery(fmt::format("SELECT `type`, `premium_ends_at` FROM `accounts` WHERE `id` = {:d}", accountId));
+
+	data.guildMembership = db.storeQuery(fmt::format("SELECT `guild_id`, `rank_id`, `nick` FROM `guild_membership` WHERE `player_id` = {:d}", guid));
+	if (data.guildMembership) {
+		uint32_t guildId = data.guildMembership->getNumber<uint32_t>("guild_id");
+		data.guild = db.storeQuery(fmt::format("SELECT `name` FROM `guilds` WHERE `id` = {:d}", guildId));
+		data.guildRanks = db.storeQuery(fmt::format("SELECT `id`, `name`, `level` FROM `guild_ranks` WHERE `guild_id` = {:d}", guildId));
+		data.guildWars = db.storeQuery(fmt::format("SELECT `guild1`, `guild2` FROM `guild_wars` WHERE (`guild1` = {:d} OR `guild2` = {:d}) AND `ended` = 0 AND `status` = 1", guildId, guildId));
+		data.guildMembers = db.storeQuery(fmt::format("SELECT COUNT(*) AS `members` FROM `guild_membership` WHERE `guild_id` = {:d}", guildId));
+	}
+
+	data.spells = db.storeQuery(fmt::format("SELECT `player_id`, `name` FROM `player_spells` WHERE `player_id` = {:d}", guid));
+	data.items = db.storeQuery(fmt::format("SELECT `pid`, `sid`, `itemtype`, `count`, `attributes` FROM `player_items` WHERE `player_id` = {:d} ORDER BY `sid` DESC", guid));
+	if (itemBlobTable) {
+		data.itemBlobs = db.storeQuery(fmt::format("SELECT `section`, `pid`, `data` FROM `player_item_blobs` WHERE `player_id` = {:d} AND `section` IN ({:d}, {:d})", guid, ITEM_BLOB_INVENTORY, ITEM_BLOB_STORE_INBOX));
+		data.lockerItems = db.storeQuery(fmt::format("SELECT (SELECT COUNT(*) FROM `player_depotitems` WHERE `player_id` = {0:d}) + (SELECT COUNT(*) FROM `player_inboxitems` WHERE `player_id` = {0:d}) + (SELECT COUNT(*) FROM `player_item_blobs` WHERE `player_id` = {0:d} AND `section` IN ({1:d}, {2:d})) AS `count`", guid, ITEM_BLOB_DEPOT, ITEM_BLOB_INBOX));
+	} else {
+		data.lockerItems = db.storeQuery(fmt::format("SELECT (SELECT COUNT(*) FROM `player_depotitems` WHERE `player_id` = {:d}) + (SELECT COUNT(*) FROM `player_inboxitems` WHERE `player_id` = {:d}) AS `count`", guid, guid));
+	}
+	data.storeInboxItems = db.storeQuery(fmt::format("SELECT `pid`, `sid`, `itemtype`, `count`, `attributes` FROM `player_storeinboxitems` WHERE `player_id` = {:d} ORDER BY `sid` DESC", guid));
+	data.storage = db.storeQuery(fmt::format("SELECT `key`, `value` FROM `player_storage` WHERE `player_id` = {:d}", guid));
+	data.vipList = db.storeQuery(fmt::format("SELECT `player_id` FROM `account_viplist` WHERE `account_id` = {:d}", accountId));
+	data.accountStorage = db.storeQuery(fmt::format("SELECT `key`, `value` FROM `account_storage` WHERE `account_id` = {:d}", accountId));
+	return true;
+}
+
+static GuildWarVector getWarList(uint32_t guildId, DBResult_ptr result)
 {
-	DBResult_ptr result = Database::getInstance().storeQuery(fmt::format("SELECT `guild1`, `guild2` FROM `guild_wars` WHERE (`guild1` = {:d} OR `guild2` = {:d}) AND `ended` = 0 AND `status` = 1", guildId, guildId));
 	if (!result) {
 		return {};
 	}
@@ -236,8 +389,9 @@ static GuildWarVector getWarList(uint32_t guildId)
 	return std::move(guildWarVector);
 }
 
-bool IOLoginData::loadPlayer(Player* player, DBResult_ptr result)
+bool IOLoginData::loadPlayer(Player* player, PlayerLoadData& data)
 {
+	DBResult_ptr result = data.player;
 	if (!result) {
 		return false;
 	}
@@ -245,11 +399,16 @@ bool IOLoginData::loadPlayer(Player* player, DBResult_ptr result)
 	Database& db = Database::getInstance();
 
 	uint32_t accno = result->getNumber<uint32_t>("account_id");
-	Account acc = loadAccount(accno);
+	Account acc;
+	if (data.account) {
+		acc.accountType = static_cast<AccountType_t>(data.account->getNumber<int32_t>("type"));
+		acc.premiumEndsAt = data.account->getNumber<time_t>("premium_ends_at");
+	}
 
 	player->setGUID(result->getNumber<uint32_t>("id"));
 	player->name = result->getString("name");
 	player->accountNumber = accno;
+	g_game.loadAccountStorageValues(accno, std::move(data.accountStorage));
 
 	player->accountType = acc.accountType;
 
@@ -392,55 +551,51 @@ bool IOLoginData::loadPlayer(Player* player, DBResult_ptr result)
 		player->charStats[i] = result->getNumber<int16_t>(charStatNames[i]);
 	}
 
-	if ((result = db.storeQuery(fmt::format("SELECT `guild_id`, `rank_id`, `nick` FROM `guild_membership` WHERE `player_id` = {:d}", player->getGUID())))) {
+	if ((result = data.guildMembership)) {
 		uint32_t guildId = result->getNumber<uint32_t>("guild_id");
 		uint32_t playerRankId = result->getNumber<uint32_t>("rank_id");
 		player->guildNick = result->getString("nick");
 
 		Guild* guild = g_game.getGuild(guildId);
-		if (!guild) {
-			guild = IOGuild::loadGuild(guildId);
-			if (guild) {
-				g_game.addGuild(guild);
-			} else {
-				std::cout << "[Warning - IOLoginData::loadPlayer] " << player->name << " has Guild ID " << guildId << " which doesn't exist" << std::endl;
-			}
+		if (!data.guild) {
+			std::cout << "[Warning - IOLoginData::loadPlayer] " << player->name << " has Guild ID " << guildId << " which doesn't exist" << std::endl;
+			guild = nullptr;
+		} else if (!guild) {
+			guild = new Guild(guildId, data.guild->getString("name"));
+			g_game.addGuild(guild);
+		} else {
+			guild->setName(data.guild->getString("name"));
 		}
 
 		if (guild) {
-			player->guild = guild;
-			GuildRank_ptr rank = guild->getRankById(playerRankId);
-			if (!rank) {
-				if ((result = db.storeQuery(fmt::format("SELECT `id`, `name`, `level` FROM `guild_ranks` WHERE `id` = {:d}", playerRankId)))) {
-					guild->addRank(result->getNumber<uint32_t>("id"), result->getString("name"), result->getNumber<uint16_t>("level"));
-				}
+			IOGuild::loadRanks(guild, data.guildRanks);
 
-				rank = guild->getRankById(playerRankId);
-				if (!rank) {
-					player->guild = nullptr;
-				}
+			GuildRank_ptr rank = guild->getRankById(playerRankId);
+			if (rank) {
+				player->guild = guild;
 			}
 
 			player->guildRank = rank;
-			player->guildWarVector = getWarList(guildId);
+			player->guildWarVector = getWarList(guildId, data.guildWars);
 
-			if ((result = db.storeQuery(fmt::format("SELECT COUNT(*) AS `members` FROM `guild_membership` WHERE `guild_id` = {:d}", guildId)))) {
+			if ((result = data.guildMembers)) {
 				guild->setMemberCount(result->getNumber<uint32_t>("members"));
 			}
 		}
 	}
 
-	if ((result = db.storeQuery(fmt::format("SELECT `player_id`, `name` FROM `player_spells` WHERE `player_id` = {:d}", player->getGUID())))) {
+	if ((result = data.spells)) {
+		const size_t nameColumn = result->getColumnIndex("name");
 		do {
-			player->learnedInstantSpellList.emplace_front(result->getString("name"));
+			player->learnedInstantSpellList.emplace_front(result->getString(nameColumn));
 		} while (result->next());
 	}
 
 	//load inventory items
 	ItemMap itemMap;
 
-	if ((result = db.storeQuery(fmt::format("SELECT `pid`, `sid`, `itemtype`, `count`, `attributes` FROM `player_items` WHERE `player_id` = {:d} ORDER BY `sid` DESC", player->getGUID())))) {
-		loadItems(itemMap, result);
+	if (data.items) {
+		loadItems(itemMap, std::move(data.items));
 
 		for (ItemMap::const_reverse_iterator it = itemMap.rbegin(), end = itemMap.rend(); it != end; ++it) {
 			const std::pair<Item*, int32_t>& pair = it->second;
@@ -462,24 +617,27 @@ bool IOLoginData::loadPlayer(Player* player, DBResult_ptr result)
 		}
 	}
 
-	//load depot items
+	//depot and inbox items wait for the first use of the locker
+	if ((result = data.lockerItems) && result->getNumber<uint64_t>("count") == 0) {
+		player->lockerState = LOCKER_LOADED;
+	}
+
+	//load store inbox items
 	itemMap.clear();
 
-	if ((result = db.storeQuery(fmt::format("SELECT `pid`, `sid`, `itemtype`, `count`, `attributes` FROM `player_depotitems` WHERE `player_id` = {:d} ORDER BY `sid` DESC", player->getGUID())))) {
-		loadItems(itemMap, result);
+	if (data.storeInboxItems) {
+		loadItems(itemMap, std::move(data.storeInboxItems));
 
 		for (ItemMap::const_reverse_iterator it = itemMap.rbegin(), end = itemMap.rend(); it != end; ++it) {
 			const std::pair<Item*, int32_t>& pair = it->second;
 			Item* item = pair.first;
-
 			int32_t pid = pair.second;
+
 			if (pid >= 0 && pid < 100) {
-				DepotChest* depotChest = player->getDepotChest(pid, true);
-				if (depotChest) {
-					depotChest->internalAddThing(item);
-				}
+				player->getStoreInbox()->internalAddThing(item);
 			} else {
 				ItemMap::const_iterator it2 = itemMap.find(pid);
+
 				if (it2 == itemMap.end()) {
 					continue;
 				}
@@ -492,22 +650,111 @@ bool IOLoginData::loadPlayer(Player* player, DBResult_ptr result)
 		}
 	}
 
-	//load inbox items
-	itemMap.clear();
+	//inventory and store inbox items of the blob format
+	if (data.itemBlobs) {
+		loadItemBlobs(player, std::move(data.itemBlobs));
+	}
 
-	if ((result = db.storeQuery(fmt::format("SELECT `pid`, `sid`, `itemtype`, `count`, `attributes` FROM `player_inboxitems` WHERE `player_id` = {:d} ORDER BY `sid` DESC", player->getGUID())))) {
-		loadItems(itemMap, result);
+	//load storage map
+	if ((result = data.storage)) {
+		const size_t keyColumn = result->getColumnIndex("key");
+		const size_t valueColumn = result->getColumnIndex("value");
+		do {
+			player->addStorageValue(result->getNumber<uint32_t>(keyColumn), result->getNumber<int32_t>(valueColumn), true);
+		} while (result->next());
+	}
+
+	//load vip list
+	if ((result = data.vipList)) {
+		do {
+			player->addVIPInternal(result->getNumber<uint32_t>("player_id"));
+		} while (result->next());
+	}
+
+	player->updateBaseSpeed();
+	player->updateInventoryWeight();
+	player->updateItemsLight(true);
+	return true;
+}
+
+void IOLoginData::loadLockerAsync(Player* player)
+{
+	if (player->lockerState != LOCKER_UNLOADED) {
+		return;
+	}
+
+	if (player->isOffline()) {
+		loadLocker(player);
+		return;
+	}
+
+	uint32_t guid = player->getGUID();
+	uint32_t loadId = ++nextLockerLoadId;
+	auto data = std::make_shared<PlayerLockerData>();
+
+	player->lockerState = LOCKER_LOADING;
+	player->lockerLoadId = loadId;
+
+	bool queued = g_databaseTasks.addJob([guid, data](Database& db) {
+		fetchLocker(db, guid, *data);
+		return true;
+	}, [guid, loadId, data](DBResult_ptr, bool) {
+		// a save may have loaded it meanwhile, or the character logged out
+		Player* player = g_game.getPlayerByGUID(guid);
+		if (player && player->lockerState == LOCKER_LOADING && player->lockerLoadId == loadId) {
+			applyLocker(player, *data);
+		}
+	}, guid);
+
+	if (!queued) {
+		loadLocker(player);
+	}
+}
+
+void IOLoginData::loadLocker(Player* player)
+{
+	if (player->lockerState == LOCKER_LOADED) {
+		return;
+	}
+
+	PlayerLockerData data;
+	fetchLocker(Database::getInstance(), player->getGUID(), data);
+	applyLocker(player, data);
+}
+
+void IOLoginData::fetchLocker(Database& db, uint32_t guid, PlayerLockerData& data)
+{
+	data.depotItems = db.storeQuery(fmt::format("SELECT `pid`, `sid`, `itemtype`, `count`, `attributes` FROM `player_depotitems` WHERE `player_id` = {:d} ORDER BY `sid` DESC", guid));
+	data.inboxItems = db.storeQuery(fmt::format("SELECT `pid`, `sid`, `itemtype`, `count`, `attributes` FROM `player_inboxitems` WHERE `player_id` = {:d} ORDER BY `sid` DESC", guid));
+	if (itemBlobTable) {
+		data.itemBlobs = db.storeQuery(fmt::format("SELECT `section`, `pid`, `data` FROM `player_item_blobs` WHERE `player_id` = {:d} AND `section` IN ({:d}, {:d})", guid, ITEM_BLOB_DEPOT, ITEM_BLOB_INBOX));
+	}
+}
+
+void IOLoginData::applyLocker(Player* player, PlayerLockerData& data)
+{
+	// items put into the locker before it was loaded stay next to the stored ones
+	player->lockerState = LOCKER_LOADED;
+	player->lockerLoadId = 0;
+
+	ItemMap itemMap;
+
+	//load depot items
+	if (data.depotItems) {
+		loadItems(itemMap, std::move(data.depotItems));
 
 		for (ItemMap::const_reverse_iterator it = itemMap.rbegin(), end = itemMap.rend(); it != end; ++it) {
 			const std::pair<Item*, int32_t>& pair = it->second;
 			Item* item = pair.first;
-			int32_t pid = pair.second;
 
+			int32_t pid = pair.second;
 			if (pid >= 0 && pid < 100) {
-				player->getInbox()->internalAddThing(item);
+				DepotChest* depotChest = player->getDepotChest(pid, true);
+				if (depotChest) {
+					depotChest->internalAddThing(item);
+				}
 			} else {
 				ItemMap::const_iterator it2 = itemMap.find(pid);
-
 				if (it2 == itemMap.end()) {
 					continue;
 				}
@@ -520,11 +767,11 @@ bool IOLoginData::loadPlayer(Player* player, DBResult_ptr result)
 		}
 	}
 
-	//load store inbox items
+	//load inbox items
 	itemMap.clear();
 
-	if ((result = db.storeQuery(fmt::format("SELECT `pid`, `sid`, `itemtype`, `count`, `attributes` FROM `player_storeinboxitems` WHERE `player_id` = {:d} ORDER BY `sid` DESC", player->getGUID())))) {
-		loadItems(itemMap, result);
+	if (data.inboxItems) {
+		loadItems(itemMap, std::move(data.inboxItems));
 
 		for (ItemMap::const_reverse_iterator it = itemMap.rbegin(), end = itemMap.rend(); it != end; ++it) {
 			const std::pair<Item*, int32_t>& pair = it->second;
@@ -532,7 +779,7 @@ bool IOLoginData::loadPlayer(Player* player, DBResult_ptr result)
 			int32_t pid = pair.second;
 
 			if (pid >= 0 && pid < 100) {
-				player->getStoreInbox()->internalAddThing(item);
+				player->getInbox()->internalAddThing(item);
 			} else {
 				ItemMap::const_iterator it2 = itemMap.find(pid);
 
@@ -548,24 +795,9 @@ bool IOLoginData::loadPlayer(Player* player, DBResult_ptr result)
 		}
 	}
 
-	//load storage map
-	if ((result = db.storeQuery(fmt::format("SELECT `key`, `value` FROM `player_storage` WHERE `player_id` = {:d}", player->getGUID())))) {
-		do {
-			player->addStorageValue(result->getNumber<uint32_t>("key"), result->getNumber<int32_t>("value"), true);
-		} while (result->next());
+	if (data.itemBlobs) {
+		loadItemBlobs(player, std::move(data.itemBlobs));
 	}
-
-	//load vip list
-	if ((result = db.storeQuery(fmt::format("SELECT `player_id` FROM `account_viplist` WHERE `account_id` = {:d}", player->getAccount())))) {
-		do {
-			player->addVIPInternal(result->getNumber<uint32_t>("player_id"));
-		} while (result->next());
-	}
-
-	player->updateBaseSpeed();
-	player->updateInventoryWeight();
-	player->updateItemsLight(true);
-	return true;
 }
 
 bool IOLoginData::saveItems(const Player* player, const ItemBlockList& itemList, DBInsert& query_insert, PropWriteStream& propWriteStream)
@@ -575,7 +807,6 @@ bool IOLoginData::saveItems(const Player* player, const ItemBlockList& itemList,
 
 	int32_t runningId = 100;
 
-	Database& db = Database::getInstance();
 	for (const auto& it : itemList) {
 		int32_t pid = it.first;
 		Item* item = it.second;
@@ -587,7 +818,7 @@ bool IOLoginData::saveItems(const Player* player, const ItemBlockList& itemList,
 		size_t attributesSize;
 		const char* attributes = propWriteStream.getStream(attributesSize);
 
-		if (!query_insert.addRow(fmt::format("{:d}, {:d}, {:d}, {:d}, {:d}, {:s}", player->getGUID(), pid, runningId, item->getID(), item->getSubType(), db.escapeBlob(attributes, attributesSize)))) {
+		if (!query_insert.addRow("?, ?, ?, ?, ?, ?", itemParams(player->getGUID(), pid, runningId, item, attributes, attributesSize))) {
 			return false;
 		}
 
@@ -616,7 +847,7 @@ bool IOLoginData::saveItems(const Player* player, const ItemBlockList& itemList,
 			size_t attributesSize;
 			const char* attributes = propWriteStream.getStream(attributesSize);
 
-			if (!query_insert.addRow(fmt::format("{:d}, {:d}, {:d}, {:d}, {:d}, {:s}", player->getGUID(), parentId, runningId, item->getID(), item->getSubType(), db.escapeBlob(attributes, attributesSize)))) {
+			if (!query_insert.addRow("?, ?, ?, ?, ?, ?", itemParams(player->getGUID(), parentId, runningId, item, attributes, attributesSize))) {
 				return false;
 			}
 		}
@@ -624,23 +855,334 @@ bool IOLoginData::saveItems(const Player* player, const ItemBlockList& itemList,
 	return query_insert.execute();
 }
 
+bool IOLoginData::saveItemSection(const Player* player, const ItemBlockList& itemList, const char* table, ItemBlobSection_t section, DBStatements& statements, PropWriteStream& propWriteStream)
+{
+	// the format not written is cleared, so a character is never stored twice
+	statements.push_back(fmt::format("DELETE FROM `{:s}` WHERE `player_id` = {:d}", table, player->getGUID()));
+	if (itemBlobTable) {
+		statements.push_back(fmt::format("DELETE FROM `player_item_blobs` WHERE `player_id` = {:d} AND `section` = {:d}", player->getGUID(), section));
+	}
+
+	if (itemBlobWrites) {
+		return saveItemBlobs(player, itemList, section, statements);
+	}
+
+	DBInsert query(fmt::format("INSERT INTO `{:s}` (`player_id`, `pid`, `sid`, `itemtype`, `count`, `attributes`) VALUES ", table), &statements);
+	return saveItems(player, itemList, query, propWriteStream);
+}
+
+bool IOLoginData::saveItemBlobs(const Player* player, const ItemBlockList& itemList, ItemBlobSection_t section, DBStatements& statements)
+{
+	// one blob per parent, a slot, a depot chest or the inbox
+	std::map<int32_t, std::vector<const Item*>> parents;
+	for (const auto& it : itemList) {
+		parents[it.first].push_back(it.second);
+	}
+
+	DBInsert query("INSERT INTO `player_item_blobs` (`player_id`, `section`, `pid`, `data`) VALUES ", &statements);
+
+	PropWriteStream stream;
+	for (const auto& it : parents) {
+		stream.clear();
+		stream.write<uint8_t>(ITEM_BLOB_VERSION);
+		stream.write<uint32_t>(it.second.size());
+
+		// read back to front like container contents, each one is pushed to the front
+		for (auto item = it.second.rbegin(), end = it.second.rend(); item != end; ++item) {
+			IOMapSerialize::saveItem(stream, *item);
+		}
+
+		size_t size;
+		const char* blob = stream.getStream(size);
+
+		DBParams params;
+		params.addNumber(player->getGUID());
+		params.addNumber(section);
+		params.addNumber(it.first);
+		params.addBlob(blob, size);
+		if (!query.addRow("?, ?, ?, ?", std::move(params))) {
+			return false;
+		}
+	}
+	return query.execute();
+}
+
+void IOLoginData::loadItemBlobs(Player* player, DBResult_ptr result)
+{
+	const size_t sectionColumn = result->getColumnIndex("section");
+	const size_t pidColumn = result->getColumnIndex("pid");
+	const size_t dataColumn = result->getColumnIndex("data");
+
+	do {
+		auto section = static_cast<ItemBlobSection_t>(result->getNumber<uint16_t>(sectionColumn));
+		int32_t pid = result->getNumber<int32_t>(pidColumn);
+
+		unsigned long size;
+		const char* blob = result->getStream(dataColumn, size);
+
+		PropStream propStream;
+		propStream.init(blob, size);
+
+		uint8_t version;
+		uint32_t count;
+		if (!propStream.read<uint8_t>(version) || version != ITEM_BLOB_VERSION || !propStream.read<uint32_t>(count)) {
+			std::cout << "[Warning - IOLoginData::loadItemBlobs] Unknown item blob of player " << player->getName() << ", section " << static_cast<int>(section) << '.' << std::endl;
+			continue;
+		}
+
+		for (uint32_t i = 0; i < count; ++i) {
+			Item* item = IOMapSerialize::unserializeItem(propStream);
+			if (!item) {
+				std::cout << "[Warning - IOLoginData::loadItemBlobs] Unserialization error in section " << static_cast<int>(section) << " of player " << player->getName() << '.' << std::endl;
+				break;
+			}
+
+			switch (section) {
+				case ITEM_BLOB_INVENTORY:
+					if (pid >= CONST_SLOT_FIRST && pid <= CONST_SLOT_LAST && !player->inventory[pid]) {
+						player->internalAddThing(pid, item);
+					} else {
+						delete item;
+					}
+					break;
+
+				case ITEM_BLOB_DEPOT:
+					player->getDepotChest(pid, true)->internalAddThing(item);
+					break;
+
+				case ITEM_BLOB_INBOX:
+					player->getInbox()->internalAddThing(item);
+					break;
+
+				case ITEM_BLOB_STORE_INBOX:
+					player->getStoreInbox()->internalAddThing(item);
+					break;
+
+				default:
+					delete item;
+					break;
+			}
+		}
+	} while (result->next());
+}
+
+void IOLoginData::initItemBlobs()
+{
+	if (g_config.getBoolean(ConfigManager::ITEM_BLOB_STORAGE) && !DatabaseManager::tableExists("player_item_blobs")) {
+		Database::getInstance().executeQuery("CREATE TABLE `player_item_blobs` (`player_id` int NOT NULL, `section` tinyint unsigned NOT NULL, `pid` int NOT NULL, `data` mediumblob NOT NULL, PRIMARY KEY (`player_id`, `section`, `pid`), FOREIGN KEY (`player_id`) REFERENCES `players` (`id`) ON DELETE CASCADE) ENGINE=InnoDB DEFAULT CHARACTER SET=utf8");
+	}
+
+	itemBlobTable = DatabaseManager::tableExists("player_item_blobs");
+	itemBlobWrites = itemBlobTable && g_config.getBoolean(ConfigManager::ITEM_BLOB_STORAGE);
+	if (g_config.getBoolean(ConfigManager::ITEM_BLOB_STORAGE) && !itemBlobWrites) {
+		std::cout << "> Warning: player_item_blobs could not be created, player items are stored as rows." << std::endl;
+	}
+}
+
+void IOLoginData::addInboxItemRow(InboxItemRows& rows, const Item* item)
+{
+	PropWriteStream propWriteStream;
+	auto addRow = [&](int32_t parent, const Item* rowItem) {
+		propWriteStream.clear();
+		rowItem->serializeAttr(propWriteStream);
+
+		size_t attributesSize;
+		const char* attributes = propWriteStream.getStream(attributesSize);
+		rows.push_back({parent, rowItem->getID(), static_cast<uint16_t>(rowItem->getSubType()), std::string(attributes, attributesSize)});
+	};
+
+	// breadth first like saveItems, so the contents load back in order
+	std::list<std::pair<const Container*, int32_t>> queue;
+	if (const Container* container = item->getContainer()) {
+		queue.emplace_back(container, rows.size());
+	}
+	addRow(-1, item);
+
+	while (!queue.empty()) {
+		const Container* container = queue.front().first;
+		int32_t parent = queue.front().second;
+		queue.pop_front();
+
+		for (const Item* containerItem : container->getItemList()) {
+			if (const Container* subContainer = containerItem->getContainer()) {
+				queue.emplace_back(subContainer, rows.size());
+			}
+			addRow(parent, containerItem);
+		}
+	}
+}
+
+bool IOLoginData::appendInboxItems(Database& db, uint32_t guid, const InboxItemRows& rows)
+{
+	if (rows.empty()) {
+		return true;
+	}
+
+	// the next save of the character renumbers them
+	DBResult_ptr result = db.storeQuery(fmt::format("SELECT MAX(`sid`) AS `sid` FROM `player_inboxitems` WHERE `player_id` = {:d}", guid));
+	const int32_t firstSid = std::max<int32_t>(100, result ? result->getNumber<int32_t>("sid") : 0) + 1;
+
+	std::string query = "INSERT INTO `player_inboxitems` (`player_id`, `pid`, `sid`, `itemtype`, `count`, `attributes`) VALUES ";
+	DBParams params;
+	for (size_t i = 0; i < rows.size(); ++i) {
+		const InboxItemRow& row = rows[i];
+		if (i != 0) {
+			query.push_back(',');
+		}
+		query += "(?, ?, ?, ?, ?, ?)";
+		params.addNumber(guid);
+		params.addNumber(row.parent < 0 ? 0 : firstSid + row.parent);
+		params.addNumber(firstSid + static_cast<int32_t>(i));
+		params.addNumber(row.itemType);
+		params.addNumber(row.count);
+		params.addBlob(row.attributes.data(), row.attributes.size());
+	}
+	return db.executeQuery(query, params);
+}
+
 bool IOLoginData::savePlayer(Player* player)
 {
-	if (player->getHealth() <= 0) {
-		player->changeHealth(1);
+	if (hasPendingSave(player->getGUID())) {
+		// stay behind the write already queued for this character
+		return savePlayerAsync(player);
 	}
 
-	Database& db = Database::getInstance();
+	PlayerSaveData data;
+	if (!serializePlayer(player, data)) {
+		return false;
+	}
+
+	bool success = executePlayerSave(Database::getInstance(), data);
+	setSavedSections(player, data);
+	return success;
+}
+
+bool IOLoginData::savePlayerAsync(Player* player)
+{
+	auto data = std::make_shared<PlayerSaveData>();
+	if (!serializePlayer(player, *data)) {
+		return false;
+	}
+
+	uint32_t guid = data->guid;
+	addPendingSave(guid);
+
+	bool queued = g_databaseTasks.addJob([data](Database& db) {
+		bool success = executePlayerSave(db, *data);
+		removePendingSave(data->guid);
+		return success;
+	}, [data](DBResult_ptr, bool success) {
+		if (!success) {
+			std::cout << "[Error - IOLoginData::savePlayerAsync] Failed to save player " << data->guid << '.' << std::endl;
+		}
+
+		if (Player* savedPlayer = g_game.getPlayerByGUID(data->guid)) {
+			setSavedSections(savedPlayer, *data);
+		}
+	}, guid);
+
+	if (!queued) {
+		removePendingSave(guid);
+		bool success = executePlayerSave(Database::getInstance(), *data);
+		setSavedSections(player, *data);
+		return success;
+	}
+	return true;
+}
+
+bool IOLoginData::hasPendingSave(uint32_t guid)
+{
+	std::lock_guard<std::mutex> lockGuard(pendingSavesLock);
+	return pendingSaves.find(guid) != pendingSaves.end();
+}
+
+void IOLoginData::addPendingSave(uint32_t guid)
+{
+	std::lock_guard<std::mutex> lockGuard(pendingSavesLock);
+	++pendingSaves[guid];
+}
 
-	DBResult_ptr result = db.storeQuery(fmt::format("SELECT `save` FROM `players` WHERE `id` = {:d}", player->getGUID()));
+void IOLoginData::removePendingSave(uint32_t guid)
+{
+	{
+		std::lock_guard<std::mutex> lockGuard(pendingSavesLock);
+		auto it = pendingSaves.find(guid);
+		if (it == pendingSaves.end() || --it->second != 0) {
+			return;
+		}
+		pendingSaves.erase(it);
+	}
+	pendingSavesSignal.notify_all();
+}
+
+void IOLoginData::waitForPendingSave(uint32_t guid)
+{
+	std::unique_lock<std::mutex> lockGuard(pendingSavesLock);
+	pendingSavesSignal.wait(lockGuard, [guid]() { return pendingSaves.find(guid) == pendingSaves.end(); });
+}
+
+bool IOLoginData::executePlayerSave(Database& db, PlayerSaveData& data)
+{
+	DBResult_ptr result = db.storeQuery(fmt::format("SELECT `save` FROM `players` WHERE `id` = {:d}", data.guid));
 	if (!result) {
 		return false;
 	}
 
 	if (result->getNumber<uint16_t>("save") == 0) {
-		return db.executeQuery(fmt::format("UPDATE `players` SET `lastlogin` = {:d}, `lastip` = {:d} WHERE `id` = {:d}", player->lastLoginSaved, player->lastIP, player->getGUID()));
+		return db.executeQuery(data.loginQuery);
+	}
+
+	data.written = db.executeTransaction(data.statements);
+	if (data.written) {
+		g_playerJournal.markSaved(data.guid, data.journalSequence);
+	}
+	return data.written;
+}
+
+void IOLoginData::skipUnchangedSection(const Player* player, PlayerSaveData& data, PlayerSaveSection_t section, size_t firstStatement)
+{
+	size_t hash = 0;
+	for (size_t i = firstStatement; i < data.statements.size(); ++i) {
+		hash ^= data.statements[i].hash() + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+	}
+	hash = std::max<size_t>(hash, 1);
+
+	data.sections[section] = hash;
+	if (player->savedSections[section] == hash) {
+		data.statements.erase(data.statements.begin() + firstStatement, data.statements.end());
+	}
+}
+
+void IOLoginData::setSavedSections(Player* player, const PlayerSaveData& data)
+{
+	if (!data.written) {
+		// the storage keys are written again by the next save
+		player->changedStorageKeys.insert(data.storageKeys.begin(), data.storageKeys.end());
+		return;
+	}
+
+	for (size_t section = 0; section < PLAYER_SAVE_SECTIONS; ++section) {
+		if (data.sections[section] != 0) {
+			player->savedSections[section] = data.sections[section];
+		}
+	}
+}
+
+bool IOLoginData::serializePlayer(Player* player, PlayerSaveData& data)
+{
+	if (player->getHealth() <= 0) {
+		player->changeHealth(1);
 	}
 
+	Database& db = Database::getInstance();
+
+	// the character list shows level and outfit
+	invalidateAccount(player->getAccount());
+
+	data.guid = player->getGUID();
+	data.journalSequence = g_playerJournal.nextSequence();
+	data.loginQuery = fmt::format("UPDATE `players` SET `lastlogin` = {:d}, `lastip` = {:d} WHERE `id` = {:d}", player->lastLoginSaved, player->lastIP, player->getGUID());
+
 	//serialize conditions
 	PropWriteStream propWriteStream;
 	for (Condition* condition : player->conditions) {
@@ -655,43 +1197,70 @@ bool IOLoginData::savePlayer(Player* player)
 
 	//First, an UPDATE query to write the player itself
 	std::ostringstream query;
+	DBParams params;
 	query << "UPDATE `players` SET ";
-	query << "`level` = " << player->level << ',';
-	query << "`group_id` = " << player->group->id << ',';
-	query << "`vocation` = " << player->getVocationId() << ',';
-	query << "`health` = " << player->health << ',';
-	query << "`healthmax` = " << player->healthMax << ',';
-	query << "`experience` = " << player->experience << ',';
-	query << "`lookbody` = " << static_cast<uint32_t>(player->defaultOutfit.lookBody) << ',';
-	query << "`lookfeet` = " << static_cast<uint32_t>(player->defaultOutfit.lookFeet) << ',';
-	query << "`lookhead` = " << static_cast<uint32_t>(player->defaultOutfit.lookHead) << ',';
-	query << "`looklegs` = " << static_cast<uint32_t>(player->defaultOutfit.lookLegs) << ',';
-	query << "`looktype` = " << player->defaultOutfit.lookType << ',';
-	query << "`lookaddons` = " << static_cast<uint32_t>(player->defaultOutfit.lookAddons) << ',';
-	query << "`maglevel` = " << player->magLevel << ',';
-	query << "`mana` = " << player->mana << ',';
-	query << "`manamax` = " << player->manaMax << ',';
-	query << "`manaspent` = " << player->manaSpent << ',';
-	query << "`soul` = " << static_cast<uint16_t>(player->soul) << ',';
-	query << "`town_id` = " << player->town->getID() << ',';
+	query << "`level` = ?,";
+	params.addNumber(player->level);
+	query << "`group_id` = ?,";
+	params.addNumber(player->group->id);
+	query << "`vocation` = ?,";
+	params.addNumber(player->getVocationId());
+	query << "`health` = ?,";
+	params.addNumber(player->health);
+	query << "`healthmax` = ?,";
+	params.addNumber(player->healthMax);
+	query << "`experience` = ?,";
+	params.addNumber(player->experience);
+	query << "`lookbody` = ?,";
+	params.addNumber(static_cast<uint32_t>(player->defaultOutfit.lookBody));
+	query << "`lookfeet` = ?,";
+	params.addNumber(static_cast<uint32_t>(player->defaultOutfit.lookFeet));
+	query << "`lookhead` = ?,";
+	params.addNumber(static_cast<uint32_t>(player->defaultOutfit.lookHead));
+	query << "`looklegs` = ?,";
+	params.addNumber(static_cast<uint32_t>(player->defaultOutfit.lookLegs));
+	query << "`looktype` = ?,";
+	params.addNumber(player->defaultOutfit.lookType);
+	query << "`lookaddons` = ?,";
+	params.addNumber(static_cast<uint32_t>(player->defaultOutfit.lookAddons));
+	query << "`maglevel` = ?,";
+	params.addNumber(player->magLevel);
+	query << "`mana` = ?,";
+	params.addNumber(player->mana);
+	query << "`manamax` = ?,";
+	params.addNumber(player->manaMax);
+	query << "`manaspent` = ?,";
+	params.addNumber(player->manaSpent);
+	query << "`soul` = ?,";
+	params.addNumber(static_cast<uint16_t>(player->soul));
+	query << "`town_id` = ?,";
+	params.addNumber(player->town->getID());
 
 	const Position& loginPosition = player->getLoginPosition();
-	query << "`posx` = " << loginPosition.getX() << ',';
-	query << "`posy` = " << loginPosition.getY() << ',';
-	query << "`posz` = " << loginPosition.getZ() << ',';
-
-	query << "`cap` = " << (player->capacity / 100) << ',';
-	query << "`sex` = " << static_cast<uint16_t>(player->sex) << ',';
+	query << "`posx` = ?,";
+	params.addNumber(loginPosition.getX());
+	query << "`posy` = ?,";
+	params.addNumber(loginPosition.getY());
+	query << "`posz` = ?,";
+	params.addNumber(loginPosition.getZ());
+
+	query << "`cap` = ?,";
+	params.addNumber((player->capacity / 100));
+	query << "`sex` = ?,";
+	params.addNumber(static_cast<uint16_t>(player->sex));
 
 	if (player->lastLoginSaved != 0) {
-		query << "`lastlogin` = " << player->lastLoginSaved << ',';
+		query << "`lastlogin` = ?,";
+		params.addNumber(player->lastLoginSaved);
 	}
 
 	if (player->lastIP != 0) {
-		query << "`lastip` = " << player->lastIP << ',';
+		query << "`lastip` = ?,";
+		params.addNumber(player->lastIP);
 	}
 
-	query << "`conditions` = " << db.escapeBlob(conditions, conditionsSize) << ',';
+	query << "`conditions` = ?,";
+	params.addBlob(conditions, conditionsSize);
 
 	if (g_game.getWorldType() != WORLD_TYPE_PVP_ENFORCED) {
 		int64_t skullTime = 0;
@@ -699,7 +1268,8 @@ bool IOLoginData::savePlayer(Player* player)
 		if (player->skullTicks > 0) {
 			skullTime = time(nullptr) + player->skullTicks;
 		}
-		query << "`skulltime` = " << skullTime << ',';
+		query << "`skulltime` = ?,";
+		params.addNumber(skullTime);
 
 		Skulls_t skull = SKULL_NONE;
 		if (player->skull == SKULL_RED) {
@@ -707,72 +1277,108 @@ bool IOLoginData::savePlayer(Player* player)
 		} else if (player->skull == SKULL_BLACK) {
 			skull = SKULL_BLACK;
 		}
-		query << "`skull` = " << static_cast<int64_t>(skull) << ',';
-	}
-
-	query << "`lastlogout` = " << player->getLastLogout() << ',';
-	query << "`balance` = " << player->bankBalance << ',';
-	query << "`offlinetraining_time` = " << player->getOfflineTrainingTime() / 1000 << ',';
-	query << "`offlinetraining_skill` = " << player->getOfflineTrainingSkill() << ',';
-	query << "`stamina` = " << player->getStaminaMinutes() << ',';
-
-	query << "`skill_fist` = " << player->skills[SKILL_FIST].level << ',';
-	query << "`skill_fist_tries` = " << player->skills[SKILL_FIST].tries << ',';
-	query << "`skill_club` = " << player->skills[SKILL_CLUB].level << ',';
-	query << "`skill_club_tries` = " << player->skills[SKILL_CLUB].tries << ',';
-	query << "`skill_sword` = " << player->skills[SKILL_SWORD].level << ',';
-	query << "`skill_sword_tries` = " << player->skills[SKILL_SWORD].tries << ',';
-	query << "`skill_axe` = " << player->skills[SKILL_AXE].level << ',';
-	query << "`skill_axe_tries` = " << player->skills[SKILL_AXE].tries << ',';
-	query << "`skill_dist` = " << player->skills[SKILL_DISTANCE].level << ',';
-	query << "`skill_dist_tries` = " << player->skills[SKILL_DISTANCE].tries << ',';
-	query << "`skill_shielding` = " << player->skills[SKILL_SHIELD].level << ',';
-	query << "`skill_shielding_tries` = " << player->skills[SKILL_SHIELD].tries << ',';
-	query << "`skill_fishing` = " << player->skills[SKILL_FISHING].level << ',';
-	query << "`skill_fishing_tries` = " << player->skills[SKILL_FISHING].tries << ',';
-	query << "`skill_crafting` = " << player->skills[SKILL_CRAFTING].level << ',';
-	query << "`skill_crafting_tries` = " << player->skills[SKILL_CRAFTING].tries << ',';
-	query << "`skill_woodcutting` = " << player->skills[SKILL_WOODCUTTING].level << ',';
-	query << "`skill_woodcutting_tries` = " << player->skills[SKILL_WOODCUTTING].tries << ',';
-	query << "`skill_mining` = " << player->skills[SKILL_MINING].level << ',';
-	query << "`skill_mining_tries` = " << player->skills[SKILL_MINING].tries << ',';
-	query << "`skill_herbalist` = " << player->skills[SKILL_HERBALIST].level << ',';
-	query << "`skill_herbalist_tries` = " << player->skills[SKILL_HERBALIST].tries << ',';
-	query << "`direction` = " << static_cast<int16_t> (player->getDirection()) << ',';
-	query << "`stat_str` = " << static_cast<int16_t>(player->charStats[CHARSTAT_STRENGTH]) << ',';
-	query << "`stat_int` = " << static_cast<int16_t>(player->charStats[CHARSTAT_INTELLIGENCE]) << ',';
-	query << "`stat_dex` = " << static_cast<int16_t>(player->charStats[CHARSTAT_DEXTERITY]) << ',';
-	query << "`stat_vit` = " << static_cast<int16_t>(player->charStats[CHARSTAT_VITALITY]) << ',';
-	query << "`stat_spr` = " << static_cast<int16_t>(player->charStats[CHARSTAT_SPIRIT]) << ',';
-	query << "`stat_wis` = " << static_cast<int16_t>(player->charStats[CHARSTAT_WISDOM]) << ',';
-	query << "`skill_armorsmith` = " << player->skills[SKILL_ARMORSMITH].level << ',';
-	query << "`skill_armorsmith_tries` = " << player->skills[SKILL_ARMORSMITH].tries << ',';
-	query << "`skill_weaponsmith` = " << player->skills[SKILL_WEAPONSMITH].level << ',';
-	query << "`skill_weaponsmith_tries` = " << player->skills[SKILL_WEAPONSMITH].tries << ',';
-	query << "`skill_jewelsmith` = " << player->skills[SKILL_JEWELSMITH].level << ',';
-	query << "`skill_jewelsmith_tries` = " << player->skills[SKILL_JEWELSMITH].tries << ',';
+		query << "`skull` = ?,";
+		params.addNumber(static_cast<int64_t>(skull));
+	}
+
+	query << "`lastlogout` = ?,";
+	params.addNumber(player->getLastLogout());
+	query << "`balance` = ?,";
+	params.addNumber(player->bankBalance);
+	query << "`offlinetraining_time` = ?,";
+	params.addNumber(player->getOfflineTrainingTime() / 1000);
+	query << "`offlinetraining_skill` = ?,";
+	params.addNumber(player->getOfflineTrainingSkill());
+	query << "`stamina` = ?,";
+	params.addNumber(player->getStaminaMinutes());
+
+	query << "`skill_fist` = ?,";
+	params.addNumber(player->skills[SKILL_FIST].level);
+	query << "`skill_fist_tries` = ?,";
+	params.addNumber(player->skills[SKILL_FIST].tries);
+	query << "`skill_club` = ?,";
+	params.addNumber(player->skills[SKILL_CLUB].level);
+	query << "`skill_club_tries` = ?,";
+	params.addNumber(player->skills[SKILL_CLUB].tries);
+	query << "`skill_sword` = ?,";
+	params.addNumber(player->skills[SKILL_SWORD].level);
+	query << "`skill_sword_tries` = ?,";
+	params.addNumber(player->skills[SKILL_SWORD].tries);
+	query << "`skill_axe` = ?,";
+	params.addNumber(player->skills[SKILL_AXE].level);
+	query << "`skill_axe_tries` = ?,";
+	params.addNumber(player->skills[SKILL_AXE].tries);
+	query << "`skill_dist` = ?,";
+	params.addNumber(player->skills[SKILL_DISTANCE].level);
+	query << "`skill_dist_tries` = ?,";
+	params.addNumber(player->skills[SKILL_DISTANCE].tries);
+	query << "`skill_shielding` = ?,";
+	params.addNumber(player->skills[SKILL_SHIELD].level);
+	query << "`skill_shielding_tries` = ?,";
+	params.addNumber(player->skills[SKILL_SHIELD].tries);
+	query << "`skill_fishing` = ?,";
+	params.addNumber(player->skills[SKILL_FISHING].level);
+	query << "`skill_fishing_tries` = ?,";
+	params.addNumber(player->skills[SKILL_FISHING].tries);
+	query << "`skill_crafting` = ?,";
+	params.addNumber(player->skills[SKILL_CRAFTING].level);
+	query << "`skill_crafting_tries` = ?,";
+	params.addNumber(player->skills[SKILL_CRAFTING].tries);
+	query << "`skill_woodcutting` = ?,";
+	params.addNumber(player->skills[SKILL_WOODCUTTING].level);
+	query << "`skill_woodcutting_tries` = ?,";
+	params.addNumber(player->skills[SKILL_WOODCUTTING].tries);
+	query << "`skill_mining` = ?,";
+	params.addNumber(player->skills[SKILL_MINING].level);
+	query << "`skill_mining_tries` = ?,";
+	params.addNumber(player->skills[SKILL_MINING].tries);
+	query << "`skill_herbalist` = ?,";
+	params.addNumber(player->skills[SKILL_HERBALIST].level);
+	query << "`skill_herbalist_tries` = ?,";
+	params.addNumber(player->skills[SKILL_HERBALIST].tries);
+	query << "`direction` = ?,";
+	params.addNumber(static_cast<int16_t> (player->getDirection()));
+	query << "`stat_str` = ?,";
+	params.addNumber(static_cast<int16_t>(player->charStats[CHARSTAT_STRENGTH]));
+	query << "`stat_int` = ?,";
+	params.addNumber(static_cast<int16_t>(player->charStats[CHARSTAT_INTELLIGENCE]));
+	query << "`stat_dex` = ?,";
+	params.addNumber(static_cast<int16_t>(player->charStats[CHARSTAT_DEXTERITY]));
+	query << "`stat_vit` = ?,";
+	params.addNumber(static_cast<int16_t>(player->charStats[CHARSTAT_VITALITY]));
+	query << "`stat_spr` = ?,";
+	params.addNumber(static_cast<int16_t>(player->charStats[CHARSTAT_SPIRIT]));
+	query << "`stat_wis` = ?,";
+	params.addNumber(static_cast<int16_t>(player->charStats[CHARSTAT_WISDOM]));
+	query << "`skill_armorsmith` = ?,";
+	params.addNumber(player->skills[SKILL_ARMORSMITH].level);
+	query << "`skill_armorsmith_tries` = ?,";
+	params.addNumber(player->skills[SKILL_ARMORSMITH].tries);
+	query << "`skill_weaponsmith` = ?,";
+	params.addNumber(player->skills[SKILL_WEAPONSMITH].level);
+	query << "`skill_weaponsmith_tries` = ?,";
+	params.addNumber(player->skills[SKILL_WEAPONSMITH].tries);
+	query << "`skill_jewelsmith` = ?,";
+	params.addNumber(player->skills[SKILL_JEWELSMITH].level);
+	query << "`skill_jewelsmith_tries` = ?,";
+	params.addNumber(player->skills[SKILL_JEWELSMITH].tries);
 
 	if (!player->isOffline()) {
-		query << "`onlinetime` = `onlinetime` + " << (time(nullptr) - player->lastLoginSaved) << ',';
+		query << "`onlinetime` = `onlinetime` + ?,";
+		params.addNumber(time(nullptr) - player->lastLoginSaved);
 	}
-	query << "`blessings` = " << player->blessings.to_ulong();
-	query << " WHERE `id` = " << player->getGUID();
+	query << "`blessings` = ?";
+	params.addNumber(player->blessings.to_ulong());
+	query << " WHERE `id` = ?";
+	params.addNumber(player->getGUID());
 
-	DBTransaction transaction;
-	if (!transaction.begin()) {
-		return false;
-	}
-
-	if (!db.executeQuery(query.str())) {
-		return false;
-	}
+	data.statements.emplace_back(query.str(), std::move(params));
 
 	// learned spells
-	if (!db.executeQuery(fmt::format("DELETE FROM `player_spells` WHERE `player_id` = {:d}", player->getGUID()))) {
-		return false;
-	}
+	size_t firstStatement = data.statements.size();
+	data.statements.push_back(fmt::format("DELETE FROM `player_spells` WHERE `player_id` = {:d}", player->getGUID()));
 
-	DBInsert spellsQuery("INSERT INTO `player_spells` (`player_id`, `name` ) VALUES ");
+	DBInsert spellsQuery("INSERT INTO `player_spells` (`player_id`, `name` ) VALUES ", &data.statements);
 	for (const std::string& spellName : player->learnedInstantSpellList) {
 		if (!spellsQuery.addRow(fmt::format("{:d}, {:s}", player->getGUID(), db.escapeString(spellName)))) {
 			return false;
@@ -782,13 +1388,10 @@ bool IOLoginData::savePlayer(Player* player)
 	if (!spellsQuery.execute()) {
 		return false;
 	}
+	skipUnchangedSection(player, data, PLAYER_SAVE_SPELLS, firstStatement);
 
 	//item saving
-	if (!db.executeQuery(fmt::format("DELETE FROM `player_items` WHERE `player_id` = {:d}", player->getGUID()))) {
-		return false;
-	}
-
-	DBInsert itemsQuery("INSERT INTO `player_items` (`player_id`, `pid`, `sid`, `itemtype`, `count`, `attributes`) VALUES ");
+	firstStatement = data.statements.size();
 
 	ItemBlockList itemList;
 	for (int32_t slotId = CONST_SLOT_FIRST; slotId <= CONST_SLOT_LAST; ++slotId) {
@@ -798,17 +1401,19 @@ bool IOLoginData::savePlayer(Player* player)
 		}
 	}
 
-	if (!saveItems(player, itemList, itemsQuery, propWriteStream)) {
+	if (!saveItemSection(player, itemList, "player_items", ITEM_BLOB_INVENTORY, data.statements, propWriteStream)) {
 		return false;
 	}
+	skipUnchangedSection(player, data, PLAYER_SAVE_ITEMS, firstStatement);
 
-	if (player->lastDepotId != -1) {
-		//save depot items
-		if (!db.executeQuery(fmt::format("DELETE FROM `player_depotitems` WHERE `player_id` = {:d}", player->getGUID()))) {
-			return false;
-		}
+	// the locker got items before it was loaded, e.g. mail, merge them with the stored ones
+	if (!player->isLockerLoaded() && (!player->depotChests.empty() || !player->getInbox()->empty())) {
+		loadLocker(player);
+	}
 
-		DBInsert depotQuery("INSERT INTO `player_depotitems` (`player_id`, `pid`, `sid`, `itemtype`, `count`, `attributes`) VALUES ");
+	if (player->lastDepotId != -1 && player->isLockerLoaded()) {
+		//save depot items
+		firstStatement = data.statements.size();
 		itemList.clear();
 
 		for (const auto& it : player->depotChests) {
@@ -817,62 +1422,73 @@ bool IOLoginData::savePlayer(Player* player)
 			}
 		}
 
-		if (!saveItems(player, itemList, depotQuery, propWriteStream)) {
+		if (!saveItemSection(player, itemList, "player_depotitems", ITEM_BLOB_DEPOT, data.statements, propWriteStream)) {
 			return false;
 		}
+		skipUnchangedSection(player, data, PLAYER_SAVE_DEPOT, firstStatement);
 	}
 
-	//save inbox items
-	if (!db.executeQuery(fmt::format("DELETE FROM `player_inboxitems` WHERE `player_id` = {:d}", player->getGUID()))) {
-		return false;
-	}
-
-	DBInsert inboxQuery("INSERT INTO `player_inboxitems` (`player_id`, `pid`, `sid`, `itemtype`, `count`, `attributes`) VALUES ");
-	itemList.clear();
+	//the inbox is only written once the stored one was loaded, so nothing is lost
+	if (player->isLockerLoaded()) {
+		//save inbox items
+		firstStatement = data.statements.size();
+		itemList.clear();
 
-	for (Item* item : player->getInbox()->getItemList()) {
-		itemList.emplace_back(0, item);
-	}
+		for (Item* item : player->getInbox()->getItemList()) {
+			itemList.emplace_back(0, item);
+		}
 
-	if (!saveItems(player, itemList, inboxQuery, propWriteStream)) {
-		return false;
+		if (!saveItemSection(player, itemList, "player_inboxitems", ITEM_BLOB_INBOX, data.statements, propWriteStream)) {
+			return false;
+		}
+		skipUnchangedSection(player, data, PLAYER_SAVE_INBOX, firstStatement);
 	}
 
 	//save store inbox items
-	if (!db.executeQuery(fmt::format("DELETE FROM `player_storeinboxitems` WHERE `player_id` = {:d}", player->getGUID()))) {
-		return false;
-	}
-
-	DBInsert storeInboxQuery("INSERT INTO `player_storeinboxitems` (`player_id`, `pid`, `sid`, `itemtype`, `count`, `attributes`) VALUES ");
+	firstStatement = data.statements.size();
 	itemList.clear();
 
 	for (Item* item : player->getStoreInbox()->getItemList()) {
 		itemList.emplace_back(0, item);
 	}
 
-	if (!saveItems(player, itemList, storeInboxQuery, propWriteStream)) {
-		return false;
-	}
-
-	if (!db.executeQuery(fmt::format("DELETE FROM `player_storage` WHERE `player_id` = {:d}", player->getGUID()))) {
+	if (!saveItemSection(player, itemList, "player_storeinboxitems", ITEM_BLOB_STORE_INBOX, data.statements, propWriteStream)) {
 		return false;
 	}
+	skipUnchangedSection(player, data, PLAYER_SAVE_STORE_INBOX, firstStatement);
 
-	DBInsert storageQuery("INSERT INTO `player_storage` (`player_id`, `key`, `value`) VALUES ");
+	//only the storage keys changed since the last write are saved
 	player->genReservedStorageRange();
+	data.storageKeys.assign(player->changedStorageKeys.begin(), player->changedStorageKeys.end());
+	player->changedStorageKeys.clear();
+
+	DBInsert storageQuery("INSERT INTO `player_storage` (`player_id`, `key`, `value`) VALUES ", &data.statements);
+	storageQuery.upsert({"value"});
+
+	std::ostringstream removedKeys;
+	for (uint32_t key : data.storageKeys) {
+		auto it = player->storageMap.find(key);
+		if (it == player->storageMap.end()) {
+			if (removedKeys.tellp() != 0) {
+				removedKeys << ',';
+			}
+			removedKeys << key;
+			continue;
+		}
 
-	for (const auto& it : player->storageMap) {
-		if (!storageQuery.addRow(fmt::format("{:d}, {:d}, {:d}", player->getGUID(), it.first, it.second))) {
+		DBParams params;
+		params.addNumber(player->getGUID());
+		params.addNumber(key);
+		params.addNumber(it->second);
+		if (!storageQuery.addRow("?, ?, ?", std::move(params))) {
 			return false;
 		}
 	}
 
-	if (!storageQuery.execute()) {
-		return false;
+	if (removedKeys.tellp() != 0) {
+		data.statements.push_back(fmt::format("DELETE FROM `player_storage` WHERE `player_id` = {:d} AND `key` IN ({:s})", player->getGUID(), removedKeys.str()));
 	}
-
-	//End the transaction
-	return transaction.commit();
+	return storageQuery.execute();
 }
 
 std::string IOLoginData::getNameByGuid(uint32_t guid)
@@ -895,6 +1511,35 @@ uint32_t IOLoginData::getGuidByName(const std::string& name)
 	return result->getNumber<uint32_t>("id");
 }
 
+std::vector<uint32_t> IOLoginData::getGuidsByNames(const std::vector<std::string>& names)
+{
+	std::vector<uint32_t> guids;
+	if (names.empty()) {
+		return guids;
+	}
+
+	Database& db = Database::getInstance();
+
+	std::string nameList;
+	for (const std::string& name : names) {
+		if (!nameList.empty()) {
+			nameList.push_back(',');
+		}
+		nameList += db.escapeString(name);
+	}
+
+	DBResult_ptr result = db.storeQuery(fmt::format("SELECT `id` FROM `players` WHERE `name` IN ({:s})", nameList));
+	if (!result) {
+		return guids;
+	}
+
+	guids.reserve(names.size());
+	do {
+		guids.push_back(result->getNumber<uint32_t>("id"));
+	} while (result->next());
+	return guids;
+}
+
 bool IOLoginData::getGuidByNameEx(uint32_t& guid, bool& specialVip, std::string& name)
 {
 	Database& db = Database::getInstance();
@@ -934,14 +1579,20 @@ bool IOLoginData::formatPlayerName(std::string& name)
 
 void IOLoginData::loadItems(ItemMap& itemMap, DBResult_ptr result)
 {
+	const size_t sidColumn = result->getColumnIndex("sid");
+	const size_t pidColumn = result->getColumnIndex("pid");
+	const size_t typeColumn = result->getColumnIndex("itemtype");
+	const size_t countColumn = result->getColumnIndex("count");
+	const size_t attributesColumn = result->getColumnIndex("attributes");
+
 	do {
-		uint32_t sid = result->getNumber<uint32_t>("sid");
-		uint32_t pid = result->getNumber<uint32_t>("pid");
-		uint16_t type = result->getNumber<uint16_t>("itemtype");
-		uint16_t count = result->getNumber<uint16_t>("count");
+		uint32_t sid = result->getNumber<uint32_t>(sidColumn);
+		uint32_t pid = result->getNumber<uint32_t>(pidColumn);
+		uint16_t type = result->getNumber<uint16_t>(typeColumn);
+		uint16_t count = result->getNumber<uint16_t>(countColumn);
 
 		unsigned long attrSize;
-		const char* attr = result->getStream("attributes", attrSize);
+		const char* attr = result->getStream(attributesColumn, attrSize);
 
 		PropStream propStream;
 		propStream.init(attr, attrSize);
@@ -969,23 +1620,25 @@ bool IOLoginData::hasBiddedOnHouse(uint32_t guid)
 	return db.storeQuery(fmt::format("SELECT `id` FROM `houses` WHERE `highest_bidder` = {:d} LIMIT 1", guid)).get() != nullptr;
 }
 
-std::forward_list<VIPEntry> IOLoginData::getVIPEntries(uint32_t accountId)
+void IOLoginData::getVIPEntries(uint32_t accountId, std::function<void(std::forward_list<VIPEntry>&)> callback)
 {
-	std::forward_list<VIPEntry> entries;
+	g_databaseTasks.fetch<std::forward_list<VIPEntry>>([accountId](Database& db) {
+		std::forward_list<VIPEntry> entries;
 
-	DBResult_ptr result = Database::getInstance().storeQuery(fmt::format("SELECT `player_id`, (SELECT `name` FROM `players` WHERE `id` = `player_id`) AS `name`, `description`, `icon`, `notify` FROM `account_viplist` WHERE `account_id` = {:d}", accountId));
-	if (result) {
-		do {
-			entries.emplace_front(
-				result->getNumber<uint32_t>("player_id"),
-				result->getString("name"),
-				result->getString("description"),
-				result->getNumber<uint32_t>("icon"),
-				result->getNumber<uint16_t>("notify") != 0
-			);
-		} while (result->next());
-	}
-	return entries;
+		DBResult_ptr result = db.storeQuery(fmt::format("SELECT `player_id`, (SELECT `name` FROM `players` WHERE `id` = `player_id`) AS `name`, `description`, `icon`, `notify` FROM `account_viplist` WHERE `account_id` = {:d}", accountId));
+		if (result) {
+			do {
+				entries.emplace_front(
+					result->getNumber<uint32_t>("player_id"),
+					result->getString("name"),
+					result->getString("description"),
+					result->getNumber<uint32_t>("icon"),
+					result->getNumber<uint16_t>("notify") != 0
+				);
+			} while (result->next());
+		}
+		return entries;
+	}, callback, 0, true);
 }
 
 void IOLoginData::addVIPEntry(uint32_t accountId, uint32_t guid, const std::string& description, uint32_t icon, bool notify)
@@ -1008,4 +1661,5 @@ void IOLoginData::removeVIPEntry(uint32_t accountId, uint32_t guid)
 void IOLoginData::updatePremiumTime(uint32_t accountId, time_t endTime)
 {
 	Database::getInstance().executeQuery(fmt::format("UPDATE `accounts` SET `premium_ends_at` = {:d} WHERE `id` = {:d}", endTime, accountId));
+	invalidateAccount(accountId);
 }
@@ -9,13 +9,76 @@
 #include "database.h"
 
 using ItemBlockList = std::list<std::pair<int32_t, Item*>>;
+// items for a character that is not loaded, the contents of a container
+// follow it and point back at its row
+struct InboxItemRow {
+	int32_t parent; // index of the container row, -1 for the inbox itself
+	uint16_t itemType;
+	uint16_t count;
+	std::string attributes;
+};
+using InboxItemRows = std::vector<InboxItemRow>;
+
+// sections of player_item_blobs, stored in the database so only append
+enum ItemBlobSection_t : uint8_t {
+	ITEM_BLOB_INVENTORY = 1,
+	ITEM_BLOB_DEPOT = 2,
+	ITEM_BLOB_INBOX = 3,
+	ITEM_BLOB_STORE_INBOX = 4,
+};
+
+// everything a character save writes, serialized on the game thread
+struct PlayerSaveData
+{
+	uint32_t guid = 0;
+	std::string loginQuery; // written instead when saving is disabled for the character
+	DBStatements statements;
+	std::array<size_t, PLAYER_SAVE_SECTIONS> sections = {};
+	std::vector<uint32_t> storageKeys; // handed back to the player when not written
+	uint64_t journalSequence = 0; // the progress recorded up to it is held by this save
+	bool written = false; // statements executed, not only the login query
+};
+
+// rows of a character, fetched on any connection and applied on the game thread
+struct PlayerLoadData
+{
+	DBResult_ptr player;
+	DBResult_ptr account;
+	DBResult_ptr guildMembership;
+	DBResult_ptr guild; // the name, for a guild that is not loaded yet or renamed
+	DBResult_ptr guildRanks;
+	DBResult_ptr guildWars;
+	DBResult_ptr guildMembers;
+	DBResult_ptr spells;
+	DBResult_ptr items;
+	DBResult_ptr lockerItems; // only the number of depot and inbox rows
+	DBResult_ptr storeInboxItems;
+	DBResult_ptr itemBlobs; // inventory and store inbox
+	DBResult_ptr storage;
+	DBResult_ptr vipList;
+	DBResult_ptr accountStorage; // unused once the account is cached
+};
+
+// depot and inbox rows, fetched on the first use of the locker
+struct PlayerLockerData
+{
+	DBResult_ptr depotItems;
+	DBResult_ptr inboxItems;
+	DBResult_ptr itemBlobs; // depot chests and inbox
+};
 
 class IOLoginData
 {
 	public:
 		static Account loadAccount(uint32_t accno);
 
-		static bool loginserverAuthentication(const std::string& name, const std::string& password, Account& account);
+		// creates player_item_blobs when itemBlobStorage is on, call once the database is connected
+		static void initItemBlobs();
+
+		// safe to call from any thread, recent accounts are served from a cache
+		static bool loginserverAuthentication(Database& db, const std::string& name, const std::string& password, Account& account);
+		// drops the cached character list, call when the account or its characters change
+		static void invalidateAccount(uint32_t accountId);
 		static uint32_t gameworldAuthentication(const std::string& accountName, const std::string& password, std::string& characterName, std::string& token, uint32_t tokenTime);
 		static uint32_t getAccountIdByPlayerName(const std::string& playerName);
 		static uint32_t getAccountIdByPlayerId(uint32_t playerId);
@@ -27,16 +90,33 @@ class IOLoginData
 
 		static bool loadPlayerById(Player* player, uint32_t id);
 		static bool loadPlayerByName(Player* player, const std::string& name);
-		static bool loadPlayer(Player* player, DBResult_ptr result);
+		// fetches the character on the database thread, callback gets nullptr when it failed
+		static void loadPlayerAsync(uint32_t guid, std::function<void(PlayerLoadData*)> callback);
+		static bool loadPlayer(Player* player, PlayerLoadData& data);
+		// fetches the depot chests and the inbox on the database thread, at once for offline characters
+		static void loadLockerAsync(Player* player);
+		// blocks until the depot chests and the inbox are loaded, for saves and scripts
+		static void loadLocker(Player* player);
 		static bool savePlayer(Player* player);
+		// serializes the character now and writes it from the database thread
+		static bool savePlayerAsync(Player* player);
+		// builds the save statements without touching the database, also used by the benchmarks
+		static bool serializePlayer(Player* player, PlayerSaveData& data);
+		static bool hasPendingSave(uint32_t guid);
+		// serializes the item and its contents into rows, on the game thread, the item stays with the caller
+		static void addInboxItemRow(InboxItemRows& rows, const Item* item);
+		// appends rows behind the stored inbox, run it under the key of the character
+		static bool appendInboxItems(Database& db, uint32_t guid, const InboxItemRows& rows);
 		static uint32_t getGuidByName(const std::string& name);
+		static std::vector<uint32_t> getGuidsByNames(const std::vector<std::string>& names);
 		static bool getGuidByNameEx(uint32_t& guid, bool& specialVip, std::string& name);
 		static std::string getNameByGuid(uint32_t guid);
 		static bool formatPlayerName(std::string& name);
 		static void increaseBankBalance(uint32_t guid, uint64_t bankBalance);
 		static bool hasBiddedOnHouse(uint32_t guid);
 
-		static std::forward_list<VIPEntry> getVIPEntries(uint32_t accountId);
+		// read on a replica when there is one, callback runs on the dispatcher
+		static void getVIPEntries(uint32_t accountId, std::function<void(std::forward_list<VIPEntry>&)> callback);
 		static void addVIPEntry(uint32_t accountId, uint32_t guid, const std::string& description, uint32_t icon, bool notify);
 		static void editVIPEntry(uint32_t accountId, uint32_t guid, const std::string& description, uint32_t icon, bool notify);
 		static void removeVIPEntry(uint32_t accountId, uint32_t guid);
@@ -46,8 +126,24 @@ class IOLoginData
 	private:
 		using ItemMap = std::map<uint32_t, std::pair<Item*, uint32_t>>;
 
+		static bool fetchPlayer(Database& db, const std::string& condition, PlayerLoadData& data);
 		static void loadItems(ItemMap& itemMap, DBResult_ptr result);
+		static void fetchLocker(Database& db, uint32_t guid, PlayerLockerData& data);
+		static void applyLocker(Player* player, PlayerLockerData& data);
 		static bool saveItems(const Player* player, const ItemBlockList& itemList, DBInsert& query_insert, PropWriteStream& propWriteStream);
+		// one parent per blob instead of one row per item, written with itemBlobStorage
+		static bool saveItemSection(const Player* player, const ItemBlockList& itemList, const char* table, ItemBlobSection_t section, DBStatements& statements, PropWriteStream& propWriteStream);
+		static bool saveItemBlobs(const Player* player, const ItemBlockList& itemList, ItemBlobSection_t section, DBStatements& statements);
+		static void loadItemBlobs(Player* player, DBResult_ptr result);
+
+		static bool executePlayerSave(Database& db, PlayerSaveData& data);
+		static void skipUnchangedSection(const Player* player, PlayerSaveData& data, PlayerSaveSection_t section, size_t firstStatement);
+		static void setSavedSections(Player* player, const PlayerSaveData& data);
+
+		// loads of a character wait until its queued saves are written
+		static void addPendingSave(uint32_t guid);
+		static void removePendingSave(uint32_t guid);
+		static void waitForPendingSave(uint32_t guid);
 };
 
 #endif
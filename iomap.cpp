@@ -6,6 +6,7 @@
 #include "iomap.h"
 
 #include "bed.h"
+#include "workerpool.h"
 
 #include <fmt/format.h>
 
@@ -39,8 +40,10 @@ Tile* IOMap::createTile(Item*& ground, Item* item, uint16_t x, uint16_t y, uint8
 		return new StaticTile(x, y, z);
 	}
 
+	// most of a map is bare ground, those tiles only allocate their item and
+	// creature vectors once something is put on them
 	Tile* tile;
-	if ((item && item->isBlocking()) || ground->isBlocking()) {
+	if (!item || item->isBlocking() || ground->isBlocking()) {
 		tile = new StaticTile(x, y, z);
 	} else {
 		tile = new DynamicTile(x, y, z);
@@ -56,8 +59,11 @@ bool IOMap::loadMap(Map* map, const std::string& fileName)
 {
 	int64_t start = OTSYS_TIME();
 	try {
-		OTB::Loader loader{fileName, OTB::Identifier{{'O', 'T', 'B', 'M'}}};
-		auto& root = loader.parseTree();
+		auto fileLoader = std::make_unique<OTB::Loader>(fileName, OTB::Identifier{{'O', 'T', 'B', 'M'}});
+		OTB::Loader& loader = *fileLoader;
+
+		// the tiles of each area are parsed later, a chunk at a time
+		auto& root = loader.parseTree(2);
 
 		PropStream propStream;
 		if (!loader.getProps(root, propStream)) {
@@ -118,17 +124,21 @@ bool IOMap::loadMap(Map* map, const std::string& fileName)
 			return false;
 		}
 
+		std::vector<const OTB::Node*> tileAreaNodes;
 		for (auto& mapDataNode : mapNode.children) {
 			if (mapDataNode.type == OTBM_TILE_AREA) {
-				if (!parseTileArea(loader, mapDataNode, *map)) {
-					return false;
-				}
-			} else if (mapDataNode.type == OTBM_TOWNS) {
-				if (!parseTowns(loader, mapDataNode, *map)) {
+				tileAreaNodes.push_back(&mapDataNode);
+				continue;
+			}
+
+			OTB::Node node = mapDataNode;
+			OTB::Loader::parseChildren(node);
+			if (node.type == OTBM_TOWNS) {
+				if (!parseTowns(loader, node, *map)) {
 					return false;
 				}
-			} else if (mapDataNode.type == OTBM_WAYPOINTS && headerVersion > 1) {
-				if (!parseWaypoints(loader, mapDataNode, *map)) {
+			} else if (node.type == OTBM_WAYPOINTS && headerVersion > 1) {
+				if (!parseWaypoints(loader, node, *map)) {
 					return false;
 				}
 			} else {
@@ -136,6 +146,16 @@ bool IOMap::loadMap(Map* map, const std::string& fileName)
 				return false;
 			}
 		}
+
+		bool lazy = g_config.getBoolean(ConfigManager::LAZY_MAP_LOADING);
+		if (!parseTileAreas(loader, tileAreaNodes, *map, lazy)) {
+			return false;
+		}
+
+		if (!pendingAreas.empty()) {
+			std::cout << "> Deferred " << pendingAreaCount << " of " << tileAreaNodes.size() << " tile areas until they are needed." << std::endl;
+			lazyLoader = std::move(fileLoader);
+		}
 	} catch (const OTB::InvalidOTBFormat& err) {
 		setLastErrorString(err.what());
 		return false;
@@ -194,6 +214,130 @@ bool IOMap::parseMapDataAttributes(OTB::Loader& loader, const OTB::Node& mapNode
 	return true;
 }
 
+bool IOMap::parseTileAreas(OTB::Loader& loader, const std::vector<const OTB::Node*>& tileAreaNodes, Map& map, bool lazy)
+{
+	// building the tiles and items registers unique ids, bed sleepers and
+	// custom attribute keys globally, so only the node scan goes wide and
+	// runs one chunk ahead of the decoding
+	static constexpr size_t chunkSize = 512;
+
+	auto parseChunk = [&tileAreaNodes](size_t begin, std::vector<OTB::Node>& chunk) {
+		chunk.clear();
+		for (size_t i = begin, end = std::min(begin + chunkSize, tileAreaNodes.size()); i < end; ++i) {
+			chunk.push_back(*tileAreaNodes[i]);
+		}
+
+		std::atomic<bool> valid{true};
+		WorkerPool::parallelForStartup(chunk.size(), [&chunk, &valid](size_t i) {
+			try {
+				OTB::Loader::parseChildren(chunk[i]);
+			} catch (const OTB::InvalidOTBFormat&) {
+				valid = false;
+			}
+		});
+		return valid.load();
+	};
+
+	std::vector<OTB::Node> current, next;
+	if (!parseChunk(0, current)) {
+		throw OTB::InvalidOTBFormat{};
+	}
+
+	for (size_t begin = 0; begin < tileAreaNodes.size(); begin += chunkSize) {
+		bool nextValid = true;
+		std::thread parser;
+		if (begin + chunkSize < tileAreaNodes.size()) {
+			parser = std::thread([&]() { nextValid = parseChunk(begin + chunkSize, next); });
+		}
+
+		bool success = true;
+		for (const OTB::Node& tileAreaNode : current) {
+			if (lazy && deferTileArea(loader, tileAreaNode)) {
+				continue;
+			}
+
+			if (!parseTileArea(loader, tileAreaNode, map)) {
+				success = false;
+				break;
+			}
+		}
+
+		if (parser.joinable()) {
+			parser.join();
+		}
+
+		if (!success) {
+			return false;
+		} else if (!nextValid) {
+			throw OTB::InvalidOTBFormat{};
+		}
+		current.swap(next);
+	}
+	return true;
+}
+
+bool IOMap::deferTileArea(OTB::Loader& loader, const OTB::Node& tileAreaNode)
+{
+	// house tiles get their items from the database at startup, they stay loaded
+	for (auto& tileNode : tileAreaNode.children) {
+		if (tileNode.type == OTBM_HOUSETILE) {
+			return false;
+		}
+	}
+
+	PropStream propStream;
+	OTBM_Destination_coords area_coord;
+	if (!loader.getProps(tileAreaNode, propStream) || !propStream.read(area_coord)) {
+		// parseTileArea reports it
+		return false;
+	}
+
+	// only the node range is kept, the tiles are parsed again once needed
+	OTB::Node node;
+	node.type = tileAreaNode.type;
+	node.propsBegin = tileAreaNode.propsBegin;
+	node.propsEnd = tileAreaNode.propsEnd;
+	node.nodeEnd = tileAreaNode.nodeEnd;
+	pendingAreas[getAreaKey(area_coord.x, area_coord.y)].push_back(node);
+	++pendingAreaCount;
+	return true;
+}
+
+bool IOMap::loadAreas(Map& map, int32_t fromX, int32_t fromY, int32_t toX, int32_t toY)
+{
+	fromX = std::max<int32_t>(0, fromX);
+	fromY = std::max<int32_t>(0, fromY);
+	toX = std::min<int32_t>(std::numeric_limits<uint16_t>::max(), toX);
+	toY = std::min<int32_t>(std::numeric_limits<uint16_t>::max(), toY);
+
+	for (int32_t x = fromX & ~AREA_MASK; x <= toX; x += AREA_SIZE) {
+		for (int32_t y = fromY & ~AREA_MASK; y <= toY; y += AREA_SIZE) {
+			auto it = pendingAreas.find(getAreaKey(x, y));
+			if (it == pendingAreas.end()) {
+				continue;
+			}
+
+			std::vector<OTB::Node> nodes = std::move(it->second);
+			pendingAreas.erase(it);
+
+			for (OTB::Node& node : nodes) {
+				--pendingAreaCount;
+				try {
+					OTB::Loader::parseChildren(node);
+				} catch (const OTB::InvalidOTBFormat& err) {
+					setLastErrorString(err.what());
+					return false;
+				}
+
+				if (!parseTileArea(*lazyLoader, node, map)) {
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
 bool IOMap::parseTileArea(OTB::Loader& loader, const OTB::Node& tileAreaNode, Map& map)
 {
 	PropStream propStream;
@@ -88,9 +88,9 @@ struct OTBM_Tile_coords {
 
 class IOMap
 {
-	static Tile* createTile(Item*& ground, Item* item, uint16_t x, uint16_t y, uint8_t z);
-
 	public:
+		static Tile* createTile(Item*& ground, Item* item, uint16_t x, uint16_t y, uint8_t z);
+
 		bool loadMap(Map* map, const std::string& fileName);
 
 		/* Load the spawns
@@ -123,6 +123,16 @@ class IOMap
 			return map->houses.loadHousesXML(map->housefile);
 		}
 
+		/* Load the tile areas deferred by lazyMapLoading which overlap the given range
+		 * \param map reference to the Map class
+		 * \returns Returns false if one of them could not be loaded
+		 */
+		bool loadAreas(Map& map, int32_t fromX, int32_t fromY, int32_t toX, int32_t toY);
+
+		bool hasPendingAreas() const {
+			return !pendingAreas.empty();
+		}
+
 		const std::string& getLastErrorString() const {
 			return errorString;
 		}
@@ -135,8 +145,24 @@ class IOMap
 		bool parseMapDataAttributes(OTB::Loader& loader, const OTB::Node& mapNode, Map& map, const std::string& fileName);
 		bool parseWaypoints(OTB::Loader& loader, const OTB::Node& waypointsNode, Map& map);
 		bool parseTowns(OTB::Loader& loader, const OTB::Node& townsNode, Map& map);
+		bool parseTileAreas(OTB::Loader& loader, const std::vector<const OTB::Node*>& tileAreaNodes, Map& map, bool lazy);
 		bool parseTileArea(OTB::Loader& loader, const OTB::Node& tileAreaNode, Map& map);
+		bool deferTileArea(OTB::Loader& loader, const OTB::Node& tileAreaNode);
+
+		// tile areas cover AREA_SIZE x AREA_SIZE tiles, all floors of one are loaded together
+		static constexpr int32_t AREA_SIZE = 256;
+		static constexpr int32_t AREA_MASK = AREA_SIZE - 1;
+
+		static uint32_t getAreaKey(uint16_t x, uint16_t y) {
+			return (static_cast<uint32_t>(x / AREA_SIZE) << 16) | (y / AREA_SIZE);
+		}
+
 		std::string errorString;
+
+		// keeps the file mapped while there are deferred tile areas
+		std::unique_ptr<OTB::Loader> lazyLoader;
+		std::unordered_map<uint32_t, std::vector<OTB::Node>> pendingAreas;
+		size_t pendingAreaCount = 0;
 };
 
 #endif
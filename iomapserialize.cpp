@@ -53,48 +53,92 @@ void IOMapSerialize::loadHouseItems(Map* map)
 bool IOMapSerialize::saveHouseItems()
 {
 	int64_t start = OTSYS_TIME();
-	Database& db = Database::getInstance();
 
-	//Start the transaction
-	DBTransaction transaction;
-	if (!transaction.begin()) {
+	DBStatements statements;
+	HouseItemHashes hashes;
+	if (!serializeHouseItems(statements, hashes)) {
 		return false;
 	}
 
-	//clear old tile data
-	if (!db.executeQuery("DELETE FROM `tile_store`")) {
-		return false;
+	bool success = Database::getInstance().executeTransaction(statements);
+	if (success) {
+		setSavedHouseItems(hashes);
 	}
 
-	DBInsert stmt("INSERT INTO `tile_store` (`house_id`, `data`) VALUES ");
+	std::cout << "> Saved items of " << hashes.size() << " houses in: " <<
+	          (OTSYS_TIME() - start) / (1000.) << " s" << std::endl;
+	return success;
+}
+
+bool IOMapSerialize::serializeHouseItems(DBStatements& statements, HouseItemHashes& hashes)
+{
+	Database& db = Database::getInstance();
+
+	// nothing written yet, start from a clean table
+	bool fullSave = true;
+	for (const auto& it : g_game.map.houses.getHouses()) {
+		if (it.second->getSavedItemsHash() != 0) {
+			fullSave = false;
+			break;
+		}
+	}
+
+	std::vector<std::string> rows;
+	std::string changedHouses;
 
 	PropWriteStream stream;
 	for (const auto& it : g_game.map.houses.getHouses()) {
 		//save house items
 		House* house = it.second;
+
+		size_t firstRow = rows.size();
+		size_t hash = 0;
 		for (HouseTile* tile : house->getTiles()) {
 			saveTile(stream, tile);
 
 			size_t attributesSize;
 			const char* attributes = stream.getStream(attributesSize);
 			if (attributesSize > 0) {
-				if (!stmt.addRow(fmt::format("{:d}, {:s}", house->getId(), db.escapeBlob(attributes, attributesSize)))) {
-					return false;
-				}
+				rows.push_back(fmt::format("{:d}, {:s}", house->getId(), db.escapeBlob(attributes, attributesSize)));
+				hash ^= std::hash<std::string>()(rows.back()) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
 				stream.clear();
 			}
 		}
+		hash = std::max<size_t>(hash, 1);
+
+		if (hash == house->getSavedItemsHash()) {
+			rows.resize(firstRow);
+			continue;
+		}
+
+		hashes.emplace_back(house, hash);
+		if (!changedHouses.empty()) {
+			changedHouses.push_back(',');
+		}
+		changedHouses += std::to_string(house->getId());
 	}
 
-	if (!stmt.execute()) {
-		return false;
+	//clear old tile data
+	if (fullSave) {
+		statements.emplace_back("DELETE FROM `tile_store`");
+	} else if (!changedHouses.empty()) {
+		statements.push_back(fmt::format("DELETE FROM `tile_store` WHERE `house_id` IN ({:s})", changedHouses));
 	}
 
-	//End the transaction
-	bool success = transaction.commit();
-	std::cout << "> Saved house items in: " <<
-	          (OTSYS_TIME() - start) / (1000.) << " s" << std::endl;
-	return success;
+	DBInsert stmt("INSERT INTO `tile_store` (`house_id`, `data`) VALUES ", &statements);
+	for (const std::string& row : rows) {
+		if (!stmt.addRow(row)) {
+			return false;
+		}
+	}
+	return stmt.execute();
+}
+
+void IOMapSerialize::setSavedHouseItems(const HouseItemHashes& hashes)
+{
+	for (const auto& it : hashes) {
+		it.first->setSavedItemsHash(it.second);
+	}
 }
 
 bool IOMapSerialize::loadContainer(PropStream& propStream, Container* container)
@@ -198,6 +242,47 @@ bool IOMapSerialize::loadItem(PropStream& propStream, Cylinder* parent)
 	return true;
 }
 
+Item* IOMapSerialize::unserializeItem(PropStream& propStream)
+{
+	uint16_t id;
+	if (!propStream.read<uint16_t>(id)) {
+		return nullptr;
+	}
+
+	Item* item = Item::CreateItem(id);
+	if (!item) {
+		return nullptr;
+	}
+
+	if (!item->unserializeAttr(propStream)) {
+		delete item;
+		return nullptr;
+	}
+
+	Container* container = item->getContainer();
+	if (!container) {
+		return item;
+	}
+
+	while (container->serializationCount > 0) {
+		Item* containerItem = unserializeItem(propStream);
+		if (!containerItem) {
+			delete item;
+			return nullptr;
+		}
+
+		container->internalAddThing(containerItem);
+		container->serializationCount--;
+	}
+
+	uint8_t endAttr;
+	if (!propStream.read<uint8_t>(endAttr) || endAttr != 0) {
+		delete item;
+		return nullptr;
+	}
+	return item;
+}
+
 void IOMapSerialize::saveItem(PropWriteStream& stream, const Item* item)
 {
 	const Container* container = item->getContainer();
@@ -284,28 +369,25 @@ bool IOMapSerialize::loadHouseInfo()
 
 bool IOMapSerialize::saveHouseInfo()
 {
-	Database& db = Database::getInstance();
-
-	DBTransaction transaction;
-	if (!transaction.begin()) {
+	DBStatements statements;
+	if (!serializeHouseInfo(statements)) {
 		return false;
 	}
+	return Database::getInstance().executeTransaction(statements);
+}
 
-	if (!db.executeQuery("DELETE FROM `house_lists`")) {
-		return false;
-	}
+bool IOMapSerialize::serializeHouseInfo(DBStatements& statements)
+{
+	Database& db = Database::getInstance();
+
+	statements.emplace_back("DELETE FROM `house_lists`");
 
 	for (const auto& it : g_game.map.houses.getHouses()) {
 		House* house = it.second;
-		DBResult_ptr result = db.storeQuery(fmt::format("SELECT `id` FROM `houses` WHERE `id` = {:d}", house->getId()));
-		if (result) {
-			db.executeQuery(fmt::format("UPDATE `houses` SET `owner` = {:d}, `paid` = {:d}, `warnings` = {:d}, `name` = {:s}, `town_id` = {:d}, `rent` = {:d}, `size` = {:d}, `beds` = {:d} WHERE `id` = {:d}", house->getOwner(), house->getPaidUntil(), house->getPayRentWarnings(), db.escapeString(house->getName()), house->getTownId(), house->getRent(), house->getTiles().size(), house->getBedCount(), house->getId()));
-		} else {
-			db.executeQuery(fmt::format("INSERT INTO `houses` (`id`, `owner`, `paid`, `warnings`, `name`, `town_id`, `rent`, `size`, `beds`) VALUES ({:d}, {:d}, {:d}, {:d}, {:s}, {:d}, {:d}, {:d}, {:d})", house->getId(), house->getOwner(), house->getPaidUntil(), house->getPayRentWarnings(), db.escapeString(house->getName()), house->getTownId(), house->getRent(), house->getTiles().size(), house->getBedCount()));
-		}
+		statements.push_back(fmt::format("INSERT INTO `houses` (`id`, `owner`, `paid`, `warnings`, `name`, `town_id`, `rent`, `size`, `beds`) VALUES ({:d}, {:d}, {:d}, {:d}, {:s}, {:d}, {:d}, {:d}, {:d}) ON DUPLICATE KEY UPDATE `owner` = VALUES(`owner`), `paid` = VALUES(`paid`), `warnings` = VALUES(`warnings`), `name` = VALUES(`name`), `town_id` = VALUES(`town_id`), `rent` = VALUES(`rent`), `size` = VALUES(`size`), `beds` = VALUES(`beds`)", house->getId(), house->getOwner(), house->getPaidUntil(), house->getPayRentWarnings(), db.escapeString(house->getName()), house->getTownId(), house->getRent(), house->getTiles().size(), house->getBedCount()));
 	}
 
-	DBInsert stmt("INSERT INTO `house_lists` (`house_id` , `listid` , `list`) VALUES ");
+	DBInsert stmt("INSERT INTO `house_lists` (`house_id` , `listid` , `list`) VALUES ", &statements);
 
 	for (const auto& it : g_game.map.houses.getHouses()) {
 		House* house = it.second;
@@ -338,11 +420,7 @@ bool IOMapSerialize::saveHouseInfo()
 		}
 	}
 
-	if (!stmt.execute()) {
-		return false;
-	}
-
-	return transaction.commit();
+	return stmt.execute();
 }
 
 bool IOMapSerialize::saveHouse(House* house)
@@ -383,5 +461,11 @@ bool IOMapSerialize::saveHouse(House* house)
 	}
 
 	//End the transaction
-	return transaction.commit();
+	if (!transaction.commit()) {
+		return false;
+	}
+
+	// no longer matches the last global save, the next one rewrites the house
+	house->setSavedItemsHash(0);
+	return true;
 }
@@ -8,6 +8,8 @@
 #include "map.h"
 #include "house.h"
 
+using HouseItemHashes = std::vector<std::pair<House*, size_t>>;
+
 class IOMapSerialize
 {
 	public:
@@ -18,8 +20,19 @@ class IOMapSerialize
 
 		static bool saveHouse(House* house);
 
-	private:
+		// build the statements of saveHouseItems and saveHouseInfo without executing them,
+		// only houses whose items changed since they were last written are included
+		static bool serializeHouseItems(DBStatements& statements, HouseItemHashes& hashes);
+		static bool serializeHouseInfo(DBStatements& statements);
+		// to be called once the statements of serializeHouseItems are committed
+		static void setSavedHouseItems(const HouseItemHashes& hashes);
+
+		// an item with its contents, the record format of house tiles
 		static void saveItem(PropWriteStream& stream, const Item* item);
+		// reads a saveItem record into a new item that is not decaying yet, nullptr when broken
+		static Item* unserializeItem(PropStream& propStream);
+
+	private:
 		static void saveTile(PropWriteStream& stream, const Tile* tile);
 
 		static bool loadContainer(PropStream& propStream, Container* container);
@@ -6,6 +6,7 @@
 #include "iomarket.h"
 
 #include "configmanager.h"
+#include "databasemanager.h"
 #include "databasetasks.h"
 #include "iologindata.h"
 #include "game.h"
@@ -16,30 +17,51 @@
 extern ConfigManager g_config;
 extern Game g_game;
 
+namespace {
+
+// market writes are queued under one key so they reach the database in order
+constexpr uint32_t MARKET_SAVE_KEY = std::numeric_limits<uint32_t>::max() - 1;
+
+constexpr size_t MARKET_HISTORY_CACHE_SIZE = 4096;
+
+// expired offers handled per dispatcher task, the rest continue in the next one
+constexpr size_t MARKET_EXPIRY_BATCH_SIZE = 256;
+
+// writes queued so far, a history read is only cached when none was queued after it
+uint64_t queuedWrites = 0;
+
+// a history read from the replica may miss writes queued this long before it,
+// it is only cached when none was
+constexpr int64_t MARKET_REPLICA_LAG = 10 * 1000;
+int64_t lastWriteTime = 0;
+
+}
+
 MarketOfferList IOMarket::getActiveOffers(MarketAction_t action, uint16_t itemId)
 {
 	MarketOfferList offerList;
 
-	DBResult_ptr result = Database::getInstance().storeQuery(fmt::format("SELECT `id`, `amount`, `price`, `created`, `anonymous`, (SELECT `name` FROM `players` WHERE `id` = `player_id`) AS `player_name` FROM `market_offers` WHERE `sale` = {:d} AND `itemtype` = {:d}", action, itemId));
-	if (!result) {
+	IOMarket& market = getInstance();
+	auto it = market.orderBooks.find(itemId);
+	if (it == market.orderBooks.end()) {
 		return offerList;
 	}
 
 	const int32_t marketOfferDuration = g_config.getNumber(ConfigManager::MARKET_OFFER_DURATION);
 
-	do {
+	for (const Offer* entry : action == MARKETACTION_BUY ? it->second.buy : it->second.sell) {
 		MarketOffer offer;
-		offer.amount = result->getNumber<uint16_t>("amount");
-		offer.price = result->getNumber<uint32_t>("price");
-		offer.timestamp = result->getNumber<uint32_t>("created") + marketOfferDuration;
-		offer.counter = result->getNumber<uint32_t>("id") & 0xFFFF;
-		if (result->getNumber<uint16_t>("anonymous") == 0) {
-			offer.playerName = result->getString("player_name");
+		offer.amount = entry->amount;
+		offer.price = entry->price;
+		offer.timestamp = entry->created + marketOfferDuration;
+		offer.counter = entry->id & 0xFFFF;
+		if (!entry->anonymous) {
+			offer.playerName = entry->playerName;
 		} else {
 			offer.playerName = "Anonymous";
 		}
 		offerList.push_back(offer);
-	} while (result->next());
+	}
 	return offerList;
 }
 
@@ -47,132 +69,183 @@ MarketOfferList IOMarket::getOwnOffers(MarketAction_t action, uint32_t playerId)
 {
 	MarketOfferList offerList;
 
-	const int32_t marketOfferDuration = g_config.getNumber(ConfigManager::MARKET_OFFER_DURATION);
-
-	DBResult_ptr result = Database::getInstance().storeQuery(fmt::format("SELECT `id`, `amount`, `price`, `created`, `itemtype` FROM `market_offers` WHERE `player_id` = {:d} AND `sale` = {:d}", playerId, action));
-	if (!result) {
+	IOMarket& market = getInstance();
+	auto it = market.playerOffers.find(playerId);
+	if (it == market.playerOffers.end()) {
 		return offerList;
 	}
 
-	do {
+	const int32_t marketOfferDuration = g_config.getNumber(ConfigManager::MARKET_OFFER_DURATION);
+
+	for (const Offer* entry : it->second) {
+		if (entry->type != action) {
+			continue;
+		}
+
 		MarketOffer offer;
-		offer.amount = result->getNumber<uint16_t>("amount");
-		offer.price = result->getNumber<uint32_t>("price");
-		offer.timestamp = result->getNumber<uint32_t>("created") + marketOfferDuration;
-		offer.counter = result->getNumber<uint32_t>("id") & 0xFFFF;
-		offer.itemId = result->getNumber<uint16_t>("itemtype");
+		offer.amount = entry->amount;
+		offer.price = entry->price;
+		offer.timestamp = entry->created + marketOfferDuration;
+		offer.counter = entry->id & 0xFFFF;
+		offer.itemId = entry->itemId;
 		offerList.push_back(offer);
-	} while (result->next());
+	}
 	return offerList;
 }
 
-HistoryMarketOfferList IOMarket::getOwnHistory(MarketAction_t action, uint32_t playerId)
+void IOMarket::getOwnHistory(uint32_t playerId, std::function<void(const HistoryMarketOfferList& buyOffers, const HistoryMarketOfferList& sellOffers)> callback)
 {
-	HistoryMarketOfferList offerList;
-
-	DBResult_ptr result = Database::getInstance().storeQuery(fmt::format("SELECT `itemtype`, `amount`, `price`, `expires_at`, `state` FROM `market_history` WHERE `player_id` = {:d} AND `sale` = {:d}", playerId, action));
-	if (!result) {
-		return offerList;
+	IOMarket& market = getInstance();
+	auto it = market.histories.find(playerId);
+	if (it != market.histories.end()) {
+		callback(filterHistory(it->second, MARKETACTION_BUY), filterHistory(it->second, MARKETACTION_SELL));
+		return;
 	}
 
-	do {
-		HistoryMarketOffer offer;
-		offer.itemId = result->getNumber<uint16_t>("itemtype");
-		offer.amount = result->getNumber<uint16_t>("amount");
-		offer.price = result->getNumber<uint32_t>("price");
-		offer.timestamp = result->getNumber<uint32_t>("expires_at");
-
-		MarketOfferState_t offerState = static_cast<MarketOfferState_t>(result->getNumber<uint16_t>("state"));
-		if (offerState == OFFERSTATE_ACCEPTEDEX) {
-			offerState = OFFERSTATE_ACCEPTED;
+	// the read shares the key of the writes, so on the primary it sees every
+	// write queued before it
+	uint64_t writes = queuedWrites;
+	bool replica = g_databaseTasks.hasReplica();
+	bool recentWrites = OTSYS_TIME() - lastWriteTime < MARKET_REPLICA_LAG;
+	g_databaseTasks.fetch<HistoryEntries>([playerId](Database& db) {
+		HistoryEntries entries;
+		DBResult_ptr result = db.storeQuery(fmt::format("SELECT `sale`, `itemtype`, `amount`, `price`, `expires_at`, `state` FROM `market_history` WHERE `player_id` = {:d}", playerId));
+		if (result) {
+			do {
+				HistoryMarketOffer offer;
+				offer.itemId = result->getNumber<uint16_t>("itemtype");
+				offer.amount = result->getNumber<uint16_t>("amount");
+				offer.price = result->getNumber<uint32_t>("price");
+				offer.timestamp = result->getNumber<uint32_t>("expires_at");
+				offer.state = static_cast<MarketOfferState_t>(result->getNumber<uint16_t>("state"));
+				entries.emplace_back(static_cast<MarketAction_t>(result->getNumber<uint16_t>("sale")), offer);
+			} while (result->next());
 		}
+		return entries;
+	}, [playerId, writes, replica, recentWrites, callback](HistoryEntries& entries) {
+		IOMarket& market = getInstance();
+		auto it = market.histories.find(playerId);
+		if (it == market.histories.end()) {
+			// trades made while the read was queued would be missing from the cached history
+			if (writes != queuedWrites || (replica && recentWrites)) {
+				callback(filterHistory(entries, MARKETACTION_BUY), filterHistory(entries, MARKETACTION_SELL));
+				return;
+			}
 
-		offer.state = offerState;
+			if (market.histories.size() >= MARKET_HISTORY_CACHE_SIZE) {
+				market.histories.clear();
+			}
+			it = market.histories.emplace(playerId, std::move(entries)).first;
+		}
+		callback(filterHistory(it->second, MARKETACTION_BUY), filterHistory(it->second, MARKETACTION_SELL));
+	}, MARKET_SAVE_KEY, true);
+}
+
+HistoryMarketOfferList IOMarket::filterHistory(const HistoryEntries& entries, MarketAction_t action)
+{
+	HistoryMarketOfferList offerList;
+	for (const auto& entry : entries) {
+		if (entry.first != action) {
+			continue;
+		}
 
+		HistoryMarketOffer offer = entry.second;
+		if (offer.state == OFFERSTATE_ACCEPTEDEX) {
+			offer.state = OFFERSTATE_ACCEPTED;
+		}
 		offerList.push_back(offer);
-	} while (result->next());
+	}
 	return offerList;
 }
 
-void IOMarket::processExpiredOffers(DBResult_ptr result, bool)
+void IOMarket::deliverExpiredOffer(const Offer& offer, std::map<uint32_t, OfflineDelivery>& offlineDeliveries)
 {
-	if (!result) {
+	const uint32_t playerId = offer.playerId;
+	const uint16_t amount = offer.amount;
+	Player* player = g_game.getPlayerByGUID(playerId);
+
+	if (offer.type != MARKETACTION_SELL) {
+		uint64_t totalPrice = static_cast<uint64_t>(offer.price) * amount;
+		if (player) {
+			player->setBankBalance(player->getBankBalance() + totalPrice);
+		} else {
+			offlineDeliveries[playerId].balance += totalPrice;
+		}
 		return;
 	}
 
-	do {
-		if (!IOMarket::moveOfferToHistory(result->getNumber<uint32_t>("id"), OFFERSTATE_EXPIRED)) {
-			continue;
-		}
+	const ItemType& itemType = Item::items[offer.itemId];
+	if (itemType.id == 0) {
+		return;
+	}
 
-		const uint32_t playerId = result->getNumber<uint32_t>("player_id");
-		const uint16_t amount = result->getNumber<uint16_t>("amount");
-		if (result->getNumber<uint16_t>("sale") == 1) {
-			const ItemType& itemType = Item::items[result->getNumber<uint16_t>("itemtype")];
-			if (itemType.id == 0) {
-				continue;
-			}
+	// items of an offline character become inbox rows, built here since items are game thread objects
+	auto deliver = [player, playerId, &offlineDeliveries](Item* item) {
+		if (!item) {
+			return false;
+		}
 
-			Player* player = g_game.getPlayerByGUID(playerId);
-			if (!player) {
-				player = new Player(nullptr);
-				if (!IOLoginData::loadPlayerById(player, playerId)) {
-					delete player;
-					continue;
-				}
+		if (player) {
+			if (g_game.internalAddItem(player->getInbox(), item, INDEX_WHEREEVER, FLAG_NOLIMIT) != RETURNVALUE_NOERROR) {
+				delete item;
+				return false;
 			}
+			return true;
+		}
 
-			if (itemType.stackable) {
-				uint16_t tmpAmount = amount;
-				while (tmpAmount > 0) {
-					uint16_t stackCount = std::min<uint16_t>(100, tmpAmount);
-					Item* item = Item::CreateItem(itemType.id, stackCount);
-					if (g_game.internalAddItem(player->getInbox(), item, INDEX_WHEREEVER, FLAG_NOLIMIT) != RETURNVALUE_NOERROR) {
-						delete item;
-						break;
-					}
-
-					tmpAmount -= stackCount;
-				}
-			} else {
-				int32_t subType;
-				if (itemType.charges != 0) {
-					subType = itemType.charges;
-				} else {
-					subType = -1;
-				}
-
-				for (uint16_t i = 0; i < amount; ++i) {
-					Item* item = Item::CreateItem(itemType.id, subType);
-					if (g_game.internalAddItem(player->getInbox(), item, INDEX_WHEREEVER, FLAG_NOLIMIT) != RETURNVALUE_NOERROR) {
-						delete item;
-						break;
-					}
-				}
+		IOLoginData::addInboxItemRow(offlineDeliveries[playerId].items, item);
+		delete item;
+		return true;
+	};
+
+	if (itemType.stackable) {
+		uint16_t tmpAmount = amount;
+		while (tmpAmount > 0) {
+			uint16_t stackCount = std::min<uint16_t>(100, tmpAmount);
+			if (!deliver(Item::CreateItem(itemType.id, stackCount))) {
+				break;
 			}
 
-			if (player->isOffline()) {
-				IOLoginData::savePlayer(player);
-				delete player;
-			}
+			tmpAmount -= stackCount;
+		}
+	} else {
+		int32_t subType;
+		if (itemType.charges != 0) {
+			subType = itemType.charges;
 		} else {
-			uint64_t totalPrice = result->getNumber<uint64_t>("price") * amount;
+			subType = -1;
+		}
 
-			Player* player = g_game.getPlayerByGUID(playerId);
-			if (player) {
-				player->setBankBalance(player->getBankBalance() + totalPrice);
-			} else {
-				IOLoginData::increaseBankBalance(playerId, totalPrice);
+		for (uint16_t i = 0; i < amount; ++i) {
+			if (!deliver(Item::CreateItem(itemType.id, subType))) {
+				break;
 			}
 		}
-	} while (result->next());
+	}
 }
 
-void IOMarket::checkExpiredOffers()
+void IOMarket::writeOfflineDelivery(uint32_t playerId, OfflineDelivery&& delivery)
 {
-	const time_t lastExpireDate = time(nullptr) - g_config.getNumber(ConfigManager::MARKET_OFFER_DURATION);
+	auto data = std::make_shared<OfflineDelivery>(std::move(delivery));
+	auto job = [playerId, data](Database& db) {
+		bool success = true;
+		if (data->balance != 0) {
+			success = db.executeQuery(fmt::format("UPDATE `players` SET `balance` = `balance` + {:d} WHERE `id` = {:d}", data->balance, playerId));
+		}
+
+		return IOLoginData::appendInboxItems(db, playerId, data->items) && success;
+	};
+
+	// keyed by the character, so it runs in order with its loads and saves
+	if (!g_databaseTasks.addJob(job, nullptr, playerId)) {
+		job(Database::getInstance());
+	}
+}
 
-	g_databaseTasks.addTask(fmt::format("SELECT `id`, `amount`, `price`, `itemtype`, `player_id`, `sale` FROM `market_offers` WHERE `created` <= {:d}", lastExpireDate), IOMarket::processExpiredOffers, true);
+void IOMarket::checkExpiredOffers()
+{
+	processExpiredOffers();
+	getInstance().saveStatistics();
 
 	int32_t checkExpiredMarketOffersEachMinutes = g_config.getNumber(ConfigManager::CHECK_EXPIRED_MARKET_OFFERS_EACH_MINUTES);
 	if (checkExpiredMarketOffersEachMinutes <= 0) {
@@ -182,103 +255,406 @@ void IOMarket::checkExpiredOffers()
 	g_scheduler.addEvent(createSchedulerTask(checkExpiredMarketOffersEachMinutes * 60 * 1000, std::bind(IOMarket::checkExpiredOffers)));
 }
 
+void IOMarket::processExpiredOffers()
+{
+	const int32_t marketOfferDuration = g_config.getNumber(ConfigManager::MARKET_OFFER_DURATION);
+	const time_t lastExpireDate = time(nullptr) - marketOfferDuration;
+
+	IOMarket& market = getInstance();
+	std::vector<Offer> expiredOffers;
+	for (const auto& it : market.offers) {
+		if (it.second.created <= lastExpireDate) {
+			expiredOffers.push_back(it.second);
+			if (expiredOffers.size() == MARKET_EXPIRY_BATCH_SIZE) {
+				break;
+			}
+		}
+	}
+
+	if (expiredOffers.empty()) {
+		return;
+	}
+
+	std::string offerIds;
+	std::string historyQuery = "INSERT INTO `market_history` (`player_id`, `sale`, `itemtype`, `amount`, `price`, `expires_at`, `inserted`, `state`) VALUES ";
+	DBParams historyParams;
+	std::map<uint32_t, OfflineDelivery> offlineDeliveries;
+
+	const time_t now = time(nullptr);
+	for (const Offer& offer : expiredOffers) {
+		market.removeOffer(offer.id);
+
+		if (!offerIds.empty()) {
+			offerIds.push_back(',');
+			historyQuery.push_back(',');
+		}
+		offerIds += std::to_string(offer.id);
+
+		const time_t expiresAt = offer.created + marketOfferDuration;
+		market.cacheHistory(offer.playerId, offer.type, offer.itemId, offer.amount, offer.price, expiresAt, OFFERSTATE_EXPIRED);
+
+		historyQuery += "(?, ?, ?, ?, ?, ?, ?, ?)";
+		historyParams.addNumber(offer.playerId);
+		historyParams.addNumber(offer.type);
+		historyParams.addNumber(offer.itemId);
+		historyParams.addNumber(offer.amount);
+		historyParams.addNumber(offer.price);
+		historyParams.addNumber(expiresAt);
+		historyParams.addNumber(now);
+		historyParams.addNumber(OFFERSTATE_EXPIRED);
+
+		deliverExpiredOffer(offer, offlineDeliveries);
+	}
+
+	writeBehind(fmt::format("DELETE FROM `market_offers` WHERE `id` IN ({:s})", offerIds), {});
+	writeBehind(std::move(historyQuery), std::move(historyParams));
+
+	for (auto& it : offlineDeliveries) {
+		writeOfflineDelivery(it.first, std::move(it.second));
+	}
+
+	// a full batch may have left more behind, they follow after the queued tasks
+	if (expiredOffers.size() == MARKET_EXPIRY_BATCH_SIZE) {
+		g_dispatcher.addTask(createTask(std::bind(IOMarket::processExpiredOffers)));
+	}
+}
+
 uint32_t IOMarket::getPlayerOfferCount(uint32_t playerId)
 {
-	DBResult_ptr result = Database::getInstance().storeQuery(fmt::format("SELECT COUNT(*) AS `count` FROM `market_offers` WHERE `player_id` = {:d}", playerId));
-	if (!result) {
+	IOMarket& market = getInstance();
+	auto it = market.playerOffers.find(playerId);
+	if (it == market.playerOffers.end()) {
 		return 0;
 	}
-	return result->getNumber<int32_t>("count");
+	return it->second.size();
 }
 
 MarketOfferEx IOMarket::getOfferByCounter(uint32_t timestamp, uint16_t counter)
 {
 	MarketOfferEx offer;
 
-	const int32_t created = timestamp - g_config.getNumber(ConfigManager::MARKET_OFFER_DURATION);
+	const uint32_t created = timestamp - g_config.getNumber(ConfigManager::MARKET_OFFER_DURATION);
 
-	DBResult_ptr result = Database::getInstance().storeQuery(fmt::format("SELECT `id`, `sale`, `itemtype`, `amount`, `created`, `price`, `player_id`, `anonymous`, (SELECT `name` FROM `players` WHERE `id` = `player_id`) AS `player_name` FROM `market_offers` WHERE `created` = {:d} AND (`id` & 65535) = {:d} LIMIT 1", created, counter));
-	if (!result) {
+	IOMarket& market = getInstance();
+	auto it = market.counterOffers.find({created, counter});
+	if (it == market.counterOffers.end()) {
 		offer.id = 0;
 		offer.playerId = 0;
 		return offer;
 	}
 
-	offer.id = result->getNumber<uint32_t>("id");
-	offer.type = static_cast<MarketAction_t>(result->getNumber<uint16_t>("sale"));
-	offer.amount = result->getNumber<uint16_t>("amount");
-	offer.counter = result->getNumber<uint32_t>("id") & 0xFFFF;
-	offer.timestamp = result->getNumber<uint32_t>("created");
-	offer.price = result->getNumber<uint32_t>("price");
-	offer.itemId = result->getNumber<uint16_t>("itemtype");
-	offer.playerId = result->getNumber<uint32_t>("player_id");
-	if (result->getNumber<uint16_t>("anonymous") == 0) {
-		offer.playerName = result->getString("player_name");
+	const Offer& entry = *it->second;
+	offer.id = entry.id;
+	offer.type = entry.type;
+	offer.amount = entry.amount;
+	offer.counter = entry.id & 0xFFFF;
+	offer.timestamp = entry.created;
+	offer.price = entry.price;
+	offer.itemId = entry.itemId;
+	offer.playerId = entry.playerId;
+	if (!entry.anonymous) {
+		offer.playerName = entry.playerName;
 	} else {
 		offer.playerName = "Anonymous";
 	}
 	return offer;
 }
 
-void IOMarket::createOffer(uint32_t playerId, MarketAction_t action, uint32_t itemId, uint16_t amount, uint32_t price, bool anonymous)
+void IOMarket::createOffer(uint32_t playerId, const std::string& playerName, MarketAction_t action, uint32_t itemId, uint16_t amount, uint32_t price, bool anonymous)
 {
-	Database::getInstance().executeQuery(fmt::format("INSERT INTO `market_offers` (`player_id`, `sale`, `itemtype`, `amount`, `price`, `created`, `anonymous`) VALUES ({:d}, {:d}, {:d}, {:d}, {:d}, {:d}, {:d})", playerId, action, itemId, amount, price, time(nullptr), anonymous));
+	IOMarket& market = getInstance();
+
+	Offer offer;
+	offer.id = market.nextOfferId++;
+	offer.playerId = playerId;
+	offer.created = time(nullptr);
+	offer.price = price;
+	offer.amount = amount;
+	offer.itemId = itemId;
+	offer.type = action;
+	offer.anonymous = anonymous;
+	offer.playerName = playerName;
+
+	DBParams params;
+	params.addNumber(offer.id);
+	params.addNumber(playerId);
+	params.addNumber(action);
+	params.addNumber(itemId);
+	params.addNumber(amount);
+	params.addNumber(price);
+	params.addNumber(offer.created);
+	params.addNumber(anonymous);
+	writeBehind("INSERT INTO `market_offers` (`id`, `player_id`, `sale`, `itemtype`, `amount`, `price`, `created`, `anonymous`) VALUES (?, ?, ?, ?, ?, ?, ?, ?)", std::move(params));
+
+	market.addOffer(std::move(offer));
 }
 
 void IOMarket::acceptOffer(uint32_t offerId, uint16_t amount)
 {
-	Database::getInstance().executeQuery(fmt::format("UPDATE `market_offers` SET `amount` = `amount` - {:d} WHERE `id` = {:d}", amount, offerId));
+	IOMarket& market = getInstance();
+	auto it = market.offers.find(offerId);
+	if (it == market.offers.end()) {
+		return;
+	}
+
+	it->second.amount -= std::min(it->second.amount, amount);
+
+	DBParams params;
+	params.addNumber(amount);
+	params.addNumber(offerId);
+	writeBehind("UPDATE `market_offers` SET `amount` = `amount` - ? WHERE `id` = ?", std::move(params));
 }
 
 void IOMarket::deleteOffer(uint32_t offerId)
 {
-	Database::getInstance().executeQuery(fmt::format("DELETE FROM `market_offers` WHERE `id` = {:d}", offerId));
+	getInstance().removeOffer(offerId);
+
+	DBParams params;
+	params.addNumber(offerId);
+	writeBehind("DELETE FROM `market_offers` WHERE `id` = ?", std::move(params));
+}
+
+void IOMarket::cacheHistory(uint32_t playerId, MarketAction_t type, uint16_t itemId, uint16_t amount, uint32_t price, time_t timestamp, MarketOfferState_t state)
+{
+	auto it = histories.find(playerId);
+	if (it != histories.end()) {
+		HistoryMarketOffer offer;
+		offer.timestamp = timestamp;
+		offer.price = price;
+		offer.itemId = itemId;
+		offer.amount = amount;
+		offer.state = state;
+		it->second.emplace_back(type, offer);
+	}
+
+	// only the owner's row of a trade is accepted, the other side is accepted ex
+	if (state == OFFERSTATE_ACCEPTED) {
+		addStatistic(type, itemId, price);
+	}
 }
 
 void IOMarket::appendHistory(uint32_t playerId, MarketAction_t type, uint16_t itemId, uint16_t amount, uint32_t price, time_t timestamp, MarketOfferState_t state)
 {
-	g_databaseTasks.addTask(fmt::format("INSERT INTO `market_history` (`player_id`, `sale`, `itemtype`, `amount`, `price`, `expires_at`, `inserted`, `state`) VALUES ({:d}, {:d}, {:d}, {:d}, {:d}, {:d}, {:d}, {:d})", playerId, type, itemId, amount, price, timestamp, time(nullptr), state));
+	getInstance().cacheHistory(playerId, type, itemId, amount, price, timestamp, state);
+
+	DBParams params;
+	params.addNumber(playerId);
+	params.addNumber(type);
+	params.addNumber(itemId);
+	params.addNumber(amount);
+	params.addNumber(price);
+	params.addNumber(timestamp);
+	params.addNumber(time(nullptr));
+	params.addNumber(state);
+	writeBehind("INSERT INTO `market_history` (`player_id`, `sale`, `itemtype`, `amount`, `price`, `expires_at`, `inserted`, `state`) VALUES (?, ?, ?, ?, ?, ?, ?, ?)", std::move(params));
 }
 
 bool IOMarket::moveOfferToHistory(uint32_t offerId, MarketOfferState_t state)
 {
 	const int32_t marketOfferDuration = g_config.getNumber(ConfigManager::MARKET_OFFER_DURATION);
 
-	Database& db = Database::getInstance();
-
-	DBResult_ptr result = db.storeQuery(fmt::format("SELECT `player_id`, `sale`, `itemtype`, `amount`, `price`, `created` FROM `market_offers` WHERE `id` = {:d}", offerId));
-	if (!result) {
+	IOMarket& market = getInstance();
+	auto it = market.offers.find(offerId);
+	if (it == market.offers.end()) {
 		return false;
 	}
 
-	if (!db.executeQuery(fmt::format("DELETE FROM `market_offers` WHERE `id` = {:d}", offerId))) {
-		return false;
-	}
+	Offer offer = it->second;
+	deleteOffer(offerId);
 
-	appendHistory(result->getNumber<uint32_t>("player_id"), static_cast<MarketAction_t>(result->getNumber<uint16_t>("sale")), result->getNumber<uint16_t>("itemtype"), result->getNumber<uint16_t>("amount"), result->getNumber<uint32_t>("price"), result->getNumber<uint32_t>("created") + marketOfferDuration, state);
+	appendHistory(offer.playerId, offer.type, offer.itemId, offer.amount, offer.price, offer.created + marketOfferDuration, state);
 	return true;
 }
 
-void IOMarket::updateStatistics()
+void IOMarket::loadOffers()
 {
-	DBResult_ptr result = Database::getInstance().storeQuery(fmt::format("SELECT `sale` AS `sale`, `itemtype` AS `itemtype`, COUNT(`price`) AS `num`, MIN(`price`) AS `min`, MAX(`price`) AS `max`, SUM(`price`) AS `sum` FROM `market_history` WHERE `state` = {:d} GROUP BY `itemtype`, `sale`", OFFERSTATE_ACCEPTED));
+	offers.clear();
+	orderBooks.clear();
+	playerOffers.clear();
+	counterOffers.clear();
+
+	DBResult_ptr result = Database::getInstance().storeQuery("SELECT `id`, `player_id`, `sale`, `itemtype`, `amount`, `price`, `created`, `anonymous`, (SELECT `name` FROM `players` WHERE `id` = `player_id`) AS `player_name` FROM `market_offers` ORDER BY `id`");
 	if (!result) {
 		return;
 	}
 
+	const size_t idColumn = result->getColumnIndex("id");
+	const size_t playerIdColumn = result->getColumnIndex("player_id");
+	const size_t saleColumn = result->getColumnIndex("sale");
+	const size_t itemTypeColumn = result->getColumnIndex("itemtype");
+	const size_t amountColumn = result->getColumnIndex("amount");
+	const size_t priceColumn = result->getColumnIndex("price");
+	const size_t createdColumn = result->getColumnIndex("created");
+	const size_t anonymousColumn = result->getColumnIndex("anonymous");
+	const size_t playerNameColumn = result->getColumnIndex("player_name");
+
 	do {
-		MarketStatistics* statistics;
-		if (result->getNumber<uint16_t>("sale") == MARKETACTION_BUY) {
-			statistics = &purchaseStatistics[result->getNumber<uint16_t>("itemtype")];
-		} else {
-			statistics = &saleStatistics[result->getNumber<uint16_t>("itemtype")];
+		Offer offer;
+		offer.id = result->getNumber<uint32_t>(idColumn);
+		offer.playerId = result->getNumber<uint32_t>(playerIdColumn);
+		offer.created = result->getNumber<uint32_t>(createdColumn);
+		offer.price = result->getNumber<uint32_t>(priceColumn);
+		offer.amount = result->getNumber<uint16_t>(amountColumn);
+		offer.itemId = result->getNumber<uint16_t>(itemTypeColumn);
+		offer.type = static_cast<MarketAction_t>(result->getNumber<uint16_t>(saleColumn));
+		offer.anonymous = result->getNumber<uint16_t>(anonymousColumn) != 0;
+		offer.playerName = result->getString(playerNameColumn);
+		nextOfferId = std::max(nextOfferId, offer.id + 1);
+		addOffer(std::move(offer));
+	} while (result->next());
+}
+
+void IOMarket::addOffer(Offer&& offer)
+{
+	const Offer* entry = &offers.emplace(offer.id, std::move(offer)).first->second;
+
+	OrderBook& book = orderBooks[entry->itemId];
+	if (entry->type == MARKETACTION_BUY) {
+		book.buy.insert(std::upper_bound(book.buy.begin(), book.buy.end(), entry, [](const Offer* lhs, const Offer* rhs) {
+			return lhs->price > rhs->price;
+		}), entry);
+	} else {
+		book.sell.insert(std::upper_bound(book.sell.begin(), book.sell.end(), entry, [](const Offer* lhs, const Offer* rhs) {
+			return lhs->price < rhs->price;
+		}), entry);
+	}
+
+	playerOffers[entry->playerId].push_back(entry);
+	counterOffers[{entry->created, static_cast<uint16_t>(entry->id & 0xFFFF)}] = entry;
+}
+
+void IOMarket::removeOffer(uint32_t offerId)
+{
+	auto it = offers.find(offerId);
+	if (it == offers.end()) {
+		return;
+	}
+
+	const Offer* entry = &it->second;
+
+	auto bookIt = orderBooks.find(entry->itemId);
+	if (bookIt != orderBooks.end()) {
+		std::vector<const Offer*>& side = entry->type == MARKETACTION_BUY ? bookIt->second.buy : bookIt->second.sell;
+		side.erase(std::remove(side.begin(), side.end(), entry), side.end());
+		if (bookIt->second.buy.empty() && bookIt->second.sell.empty()) {
+			orderBooks.erase(bookIt);
+		}
+	}
+
+	auto playerIt = playerOffers.find(entry->playerId);
+	if (playerIt != playerOffers.end()) {
+		playerIt->second.erase(std::remove(playerIt->second.begin(), playerIt->second.end(), entry), playerIt->second.end());
+		if (playerIt->second.empty()) {
+			playerOffers.erase(playerIt);
 		}
+	}
+
+	auto counterIt = counterOffers.find({entry->created, static_cast<uint16_t>(entry->id & 0xFFFF)});
+	if (counterIt != counterOffers.end() && counterIt->second == entry) {
+		counterOffers.erase(counterIt);
+	}
+
+	offers.erase(it);
+}
+
+void IOMarket::writeBehind(std::string query, DBParams params)
+{
+	++queuedWrites;
+	lastWriteTime = OTSYS_TIME();
+	bool queued = g_databaseTasks.addJob([query, params](Database& db) {
+		return db.executeQuery(query, params);
+	}, nullptr, MARKET_SAVE_KEY);
+
+	if (!queued) {
+		Database::getInstance().executeQuery(query, params);
+	}
+}
+
+void IOMarket::loadStatistics()
+{
+	Database& db = Database::getInstance();
+	purchaseStatistics.clear();
+	saleStatistics.clear();
+	changedStatistics.clear();
+
+	bool build = !DatabaseManager::tableExists("market_statistics");
+	if (build) {
+		if (!db.executeQuery("CREATE TABLE `market_statistics` (`itemtype` smallint unsigned NOT NULL, `sale` tinyint NOT NULL, `num` int unsigned NOT NULL, `min` int unsigned NOT NULL, `max` int unsigned NOT NULL, `sum` bigint unsigned NOT NULL, PRIMARY KEY (`itemtype`, `sale`)) ENGINE=InnoDB DEFAULT CHARACTER SET=utf8")) {
+			return;
+		}
+		std::cout << ">> Building market statistics from the history" << std::endl;
+	}
+
+	DBResult_ptr result;
+	if (build) {
+		result = db.storeQuery(fmt::format("SELECT `sale`, `itemtype`, COUNT(`price`) AS `num`, MIN(`price`) AS `min`, MAX(`price`) AS `max`, SUM(`price`) AS `sum` FROM `market_history` WHERE `state` = {:d} GROUP BY `itemtype`, `sale`", OFFERSTATE_ACCEPTED));
+	} else {
+		result = db.storeQuery("SELECT `sale`, `itemtype`, `num`, `min`, `max`, `sum` FROM `market_statistics`");
+	}
+
+	if (!result) {
+		return;
+	}
+
+	do {
+		auto type = static_cast<MarketAction_t>(result->getNumber<uint16_t>("sale"));
+		uint16_t itemId = result->getNumber<uint16_t>("itemtype");
 
-		statistics->numTransactions = result->getNumber<uint32_t>("num");
-		statistics->lowestPrice = result->getNumber<uint32_t>("min");
-		statistics->totalPrice = result->getNumber<uint64_t>("sum");
-		statistics->highestPrice = result->getNumber<uint32_t>("max");
+		MarketStatistics& statistics = type == MARKETACTION_BUY ? purchaseStatistics[itemId] : saleStatistics[itemId];
+		statistics.numTransactions = result->getNumber<uint32_t>("num");
+		statistics.lowestPrice = result->getNumber<uint32_t>("min");
+		statistics.totalPrice = result->getNumber<uint64_t>("sum");
+		statistics.highestPrice = result->getNumber<uint32_t>("max");
+
+		if (build) {
+			changedStatistics.emplace(type, itemId);
+		}
 	} while (result->next());
+
+	saveStatistics();
+}
+
+void IOMarket::saveStatistics()
+{
+	if (changedStatistics.empty()) {
+		return;
+	}
+
+	std::string query = "INSERT INTO `market_statistics` (`itemtype`, `sale`, `num`, `min`, `max`, `sum`) VALUES ";
+	DBParams params;
+	for (const auto& it : changedStatistics) {
+		const MarketStatistics& statistics = it.first == MARKETACTION_BUY ? purchaseStatistics[it.second] : saleStatistics[it.second];
+		if (!params.empty()) {
+			query.push_back(',');
+		}
+		query += "(?, ?, ?, ?, ?, ?)";
+		params.addNumber(it.second);
+		params.addNumber(it.first);
+		params.addNumber(statistics.numTransactions);
+		params.addNumber(statistics.lowestPrice);
+		params.addNumber(statistics.highestPrice);
+		params.addNumber(statistics.totalPrice);
+	}
+	query += " ON DUPLICATE KEY UPDATE `num` = VALUES(`num`), `min` = VALUES(`min`), `max` = VALUES(`max`), `sum` = VALUES(`sum`)";
+
+	changedStatistics.clear();
+	writeBehind(std::move(query), std::move(params));
+}
+
+void IOMarket::addStatistic(MarketAction_t type, uint16_t itemId, uint32_t price)
+{
+	MarketStatistics& statistics = type == MARKETACTION_BUY ? purchaseStatistics[itemId] : saleStatistics[itemId];
+	if (statistics.numTransactions == 0) {
+		statistics.lowestPrice = price;
+		statistics.highestPrice = price;
+	} else {
+		statistics.lowestPrice = std::min(statistics.lowestPrice, price);
+		statistics.highestPrice = std::max(statistics.highestPrice, price);
+	}
+
+	++statistics.numTransactions;
+	statistics.totalPrice += price;
+	changedStatistics.emplace(type, itemId);
 }
 
 MarketStatistics* IOMarket::getPurchaseStatistics(uint16_t itemId)
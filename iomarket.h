@@ -6,7 +6,10 @@
 
 #include "enums.h"
 #include "database.h"
+#include "iologindata.h"
 
+// The active offers are kept in memory, loaded once at startup and written
+// behind to the database. Everything here runs on the dispatcher thread.
 class IOMarket
 {
 	public:
@@ -17,31 +20,85 @@ class IOMarket
 
 		static MarketOfferList getActiveOffers(MarketAction_t action, uint16_t itemId);
 		static MarketOfferList getOwnOffers(MarketAction_t action, uint32_t playerId);
-		static HistoryMarketOfferList getOwnHistory(MarketAction_t action, uint32_t playerId);
+		// hands both sides of the history to callback, at once when it is cached
+		// and otherwise once a database worker has read it
+		static void getOwnHistory(uint32_t playerId, std::function<void(const HistoryMarketOfferList& buyOffers, const HistoryMarketOfferList& sellOffers)> callback);
 
-		static void processExpiredOffers(DBResult_ptr result, bool);
 		static void checkExpiredOffers();
 
 		static uint32_t getPlayerOfferCount(uint32_t playerId);
 		static MarketOfferEx getOfferByCounter(uint32_t timestamp, uint16_t counter);
 
-		static void createOffer(uint32_t playerId, MarketAction_t action, uint32_t itemId, uint16_t amount, uint32_t price, bool anonymous);
+		static void createOffer(uint32_t playerId, const std::string& playerName, MarketAction_t action, uint32_t itemId, uint16_t amount, uint32_t price, bool anonymous);
 		static void acceptOffer(uint32_t offerId, uint16_t amount);
 		static void deleteOffer(uint32_t offerId);
 
 		static void appendHistory(uint32_t playerId, MarketAction_t type, uint16_t itemId, uint16_t amount, uint32_t price, time_t timestamp, MarketOfferState_t state);
 		static bool moveOfferToHistory(uint32_t offerId, MarketOfferState_t state);
 
-		void updateStatistics();
+		void loadOffers();
+		// reads market_statistics, built once from the history when the table is missing
+		void loadStatistics();
+		// writes the statistics changed since the last call behind
+		void saveStatistics();
 
 		MarketStatistics* getPurchaseStatistics(uint16_t itemId);
 		MarketStatistics* getSaleStatistics(uint16_t itemId);
 
 	private:
+		using HistoryEntries = std::vector<std::pair<MarketAction_t, HistoryMarketOffer>>;
+
+		struct Offer
+		{
+			uint32_t id;
+			uint32_t playerId;
+			uint32_t created;
+			uint32_t price;
+			uint16_t amount;
+			uint16_t itemId;
+			MarketAction_t type;
+			bool anonymous;
+			std::string playerName;
+		};
+
+		// both sides of an item, buy offers by descending and sell offers by ascending price
+		struct OrderBook
+		{
+			std::vector<const Offer*> buy;
+			std::vector<const Offer*> sell;
+		};
+
 		IOMarket() = default;
 
+		void addOffer(Offer&& offer);
+		void removeOffer(uint32_t offerId);
+		// what an expiry batch hands to a character that is not online
+		struct OfflineDelivery
+		{
+			InboxItemRows items;
+			uint64_t balance = 0;
+		};
+
+		static void processExpiredOffers();
+		static void deliverExpiredOffer(const Offer& offer, std::map<uint32_t, OfflineDelivery>& offlineDeliveries);
+		static void writeOfflineDelivery(uint32_t playerId, OfflineDelivery&& delivery);
+		void cacheHistory(uint32_t playerId, MarketAction_t type, uint16_t itemId, uint16_t amount, uint32_t price, time_t timestamp, MarketOfferState_t state);
+		void addStatistic(MarketAction_t type, uint16_t itemId, uint32_t price);
+		static void writeBehind(std::string query, DBParams params);
+		static HistoryMarketOfferList filterHistory(const HistoryEntries& entries, MarketAction_t action);
+
+		std::map<uint32_t, Offer> offers;
+		std::map<uint16_t, OrderBook> orderBooks;
+		std::map<uint32_t, std::vector<const Offer*>> playerOffers;
+		std::map<std::pair<uint32_t, uint16_t>, const Offer*> counterOffers;
+		// histories of the players who browsed them, loaded on demand
+		std::unordered_map<uint32_t, HistoryEntries> histories;
+		uint32_t nextOfferId = 1;
+
+		// accepted offers per item, kept current by appendHistory
 		std::map<uint16_t, MarketStatistics> purchaseStatistics;
 		std::map<uint16_t, MarketStatistics> saleStatistics;
+		std::set<std::pair<MarketAction_t, uint16_t>> changedStatistics;
 };
 
 #endif
@@ -19,8 +19,13 @@
 #include <algorithm>
 #include <cstdint>
 
+#include <boost/functional/hash.hpp>
+
 #include "actions.h"
 #include "spells.h"
+#include "hugepagearena.h"
+#include "lockfree.h"
+#include "rarity.h"
 
 extern Game g_game;
 extern Spells* g_spells;
@@ -28,15 +33,41 @@ extern Vocations g_vocations;
 
 Items Item::items;
 
-struct RarityAttributes {
-    int numAbsorbs;
-    int numSkills;
-    int numSpecials;
-    int numElements;
+namespace {
+
+constexpr uint8_t COMPACT_ATTRIBUTES_VERSION = 1;
+
+// custom keys written as their position here, 0 is a key written by name;
+// stored blobs refer to the positions, so only append
+const CustomAttributeKey* const compactCustomKeys[] = {
+	&CustomAttributeKeys::RARITY,
+	&CustomAttributeKeys::COMBAT_POWER_LEVEL,
 };
 
+uint8_t getCompactCustomKeyIndex(CustomAttributeKey key)
+{
+	for (size_t i = 0; i < std::size(compactCustomKeys); ++i) {
+		if (*compactCustomKeys[i] == key) {
+			return static_cast<uint8_t>(i + 1);
+		}
+	}
+	return 0;
+}
+
+bool getCompactCustomKey(uint8_t index, CustomAttributeKey& key)
+{
+	if (index == 0 || index > std::size(compactCustomKeys)) {
+		return false;
+	}
+
+	key = *compactCustomKeys[index - 1];
+	return true;
+}
+
+}
+
 void Item::applyRarityEffects(Item* item) {
-    const auto rarityAttr = item->getCustomAttribute("rarity");
+    const auto rarityAttr = item->getCustomAttribute(CustomAttributeKeys::RARITY);
     if (!rarityAttr) {
         return;
     }
@@ -50,294 +81,10 @@ void Item::applyRarityEffects(Item* item) {
         return;
     }
 
-    struct Rarity {
-        int value;
-        double chance;
-        int minLevel;
-        int maxLevel;
-        int minBonus;
-        int maxBonus;
-    };
-    std::vector<Rarity> rarities = {
-        {1,   15.0,   1,   10,   1,   1},
-        {2,   14.0,  11,   20,   1,   2},
-        {3,   13.0,  21,   30,   1,   2},
-        {4,   12.0,  31,   40,   1,   3},
-        {5,   10.0,  41,   50,   1,   3},
-        {6,    8.0,  51,   60,   2,   4},
-        {7,    7.0,  61,   70,   2,   5},
-        {8,    6.0,  71,   80,   3,   6},
-        {9,    5.0,  81,   90,   3,   7},
-        {10,   4.5,  91,  100,   4,   8},
-        {11,   3.3, 101,  110,   4,   9},
-        {12,   2.2, 111,  120,   5,  10},
-        {13,   1.8, 121,  130,   6,  10},
-        {14,   1.3, 131,  140,   7,  12},
-        {15,   1.0, 141,  150,   9,  15}
-    };
-
-    std::vector<RarityAttributes> rarityAttributes = {
-        {1, 1, 0, 0}, // Rarity 1
-        {1, 1, 0, 1}, // Rarity 2
-        {1, 1, 0, 1}, // Rarity 3
-        {1, 1, 1, 1}, // Rarity 4
-        {1, 1, 1, 1}, // Rarity 5
-        {1, 2, 1, 1}, // Rarity 6
-        {1, 2, 1, 1}, // Rarity 7
-        {1, 2, 2, 1}, // Rarity 8
-        {2, 2, 2, 1}, // Rarity 9
-        {2, 2, 2, 1}, // Rarity 10
-        {2, 2, 2, 1}, // Rarity 11
-        {2, 2, 2, 1}, // Rarity 12
-        {2, 2, 2, 1}, // Rarity 13
-        {3, 3, 2, 1}, // Rarity 14
-        {3, 3, 2, 1}  // Rarity 15
-    };
-
-    std::vector<std::pair<int, int>> absorptionBonuses = {
-        {1, 1}, {1, 1}, {1, 1}, {1, 2}, {1, 2},
-        {1, 3}, {1, 3}, {1, 4}, {1, 4}, {2, 5},
-        {2, 5}, {2, 5}, {3, 6}, {4, 6}, {5, 6}
-    };
-
-    std::vector<std::pair<int, int>> elementBonuses = {
-        {1, 3}, {3, 6}, {4, 8}, {5, 10}, {6, 12},
-        {7, 14}, {8, 16}, {9, 18}, {10, 20}, {12, 22},
-        {14, 24}, {16, 26}, {18, 28}, {20, 30}, {25, 40}
-    };
-
-    const ItemType& it = Item::items[item->getID()];
-
-    if (item->getCustomAttribute("combatPowerLevel"))
+    if (item->getCustomAttribute(CustomAttributeKeys::COMBAT_POWER_LEVEL))
         return;
 
-    const uint32_t VALID_EQUIP_SLOTS =
-        SLOTP_HEAD |
-        SLOTP_NECKLACE |
-        SLOTP_ARMOR |
-        SLOTP_RIGHT |
-        SLOTP_LEFT |
-        SLOTP_LEGS |
-        SLOTP_FEET |
-        SLOTP_RING |
-        SLOTP_DECKBAD |
-        SLOTP_BELT |
-        SLOTP_GLOVES;
-
-    if ((it.slotPosition & VALID_EQUIP_SLOTS) == 0)
-        return;
-
-    bool isWeapon = (it.weaponType != WEAPON_NONE);
-
-    int finalLevel = 0, minBonus = 0, maxBonus = 0;
-    for (const Rarity& r : rarities) {
-        if (r.value == rarityId) {
-            finalLevel = uniform_random(r.minLevel, r.maxLevel);
-            minBonus = r.minBonus;
-            maxBonus = r.maxBonus;
-            break;
-        }
-    }
-    int bonusRange = maxBonus - minBonus + 1;
-    int finalBonus = minBonus + (finalLevel * bonusRange / 100);
-
-    if (it.attack > 0) {
-        int64_t newAttack = it.attack + finalBonus;
-        item->setIntAttr(ITEM_ATTRIBUTE_ATTACK, newAttack);
-    }
-    if (it.defense > 0) {
-        int64_t newDefense = it.defense + finalBonus;
-        item->setIntAttr(ITEM_ATTRIBUTE_DEFENSE, newDefense);
-    }
-    if (it.armor > 0) {
-        int64_t newArmor = it.armor + finalBonus;
-        item->setIntAttr(ITEM_ATTRIBUTE_ARMOR, newArmor);
-    }
-    if (it.hitChance > 0) {
-        int64_t newHitChance = it.hitChance + finalBonus;
-        item->setIntAttr(ITEM_ATTRIBUTE_HITCHANCE, newHitChance);
-    }
-
-    std::string levelKey = "combatPowerLevel";
-        item->setCustomAttribute(levelKey, static_cast<int64_t>(finalLevel));
-
-        RarityAttributes attrCounts = rarityAttributes[rarityId - 1];
-
-        std::vector<std::tuple<CombatType_t, std::string, std::string>> absorptionTypes = {
-            {COMBAT_PHYSICALDAMAGE, "rarity_physicalAbsorb", "Physical"},
-            {COMBAT_ENERGYDAMAGE, "rarity_energyAbsorb", "Energy"},
-            {COMBAT_EARTHDAMAGE, "rarity_earthAbsorb", "Earth"},
-            {COMBAT_FIREDAMAGE, "rarity_fireAbsorb", "Fire"},
-            {COMBAT_DROWNDAMAGE, "rarity_drownAbsorb", "Drown"},
-            {COMBAT_ICEDAMAGE, "rarity_iceAbsorb", "Ice"},
-            {COMBAT_HOLYDAMAGE, "rarity_holyAbsorb", "Holy"},
-            {COMBAT_DEATHDAMAGE, "rarity_deathAbsorb", "Death"},
-            {COMBAT_WATERDAMAGE, "rarity_waterAbsorb", "Water"},
-            {COMBAT_ARCANEDAMAGE, "rarity_arcaneAbsorb", "Arcane"}
-        };
-
-        std::vector<std::tuple<int, std::string, std::string>> skillTypes = {
-            {SKILL_FIST, "rarity_fistSkill", "Fist"},
-            {SKILL_CLUB, "rarity_clubSkill", "Club"},
-            {SKILL_SWORD, "rarity_swordSkill", "Sword"},
-            {SKILL_AXE, "rarity_axeSkill", "Axe"},
-            {SKILL_DISTANCE, "rarity_distanceSkill", "Distance"},
-            {SKILL_SHIELD, "rarity_shieldSkill", "Shielding"},
-            {SKILL_FISHING, "rarity_fishingSkill", "Fishing"},
-            {SKILL_CRAFTING, "rarity_craftingSkill", "Crafting"},
-            {SKILL_WOODCUTTING, "rarity_woodcuttingSkill", "Woodcutting"},
-            {SKILL_MINING, "rarity_miningSkill", "Mining"},
-            {SKILL_HERBALIST, "rarity_herbalistSkill", "Herbalism"},
-            {SKILL_ARMORSMITH, "rarity_armorsmithSkill", "Armorsmithing"},
-            {SKILL_WEAPONSMITH, "rarity_weaponsmithSkill", "Weaponsmithing"},
-            {SKILL_JEWELSMITH, "rarity_jewelsmithSkill", "Jewelsmithing"},
-            {SKILL_MAGLEVEL, "rarity_maglevelSkill", "Magic"}
-        };
-
-        std::vector<std::tuple<int, std::string, std::string>> specialSkillTypes = {
-            {SPECIALSKILL_CRITICALHITCHANCE, "rarity_criticalHitChance", "Critical Chance"},
-            {SPECIALSKILL_CRITICALHITAMOUNT, "rarity_criticalHitAmount", "Critical Hit"},
-            {SPECIALSKILL_MANALEECHCHANCE, "rarity_manaLeechChance", "Mana Chance"},
-            {SPECIALSKILL_MANALEECHAMOUNT, "rarity_manaLeechAmount", "Mana Amount"},
-            {SPECIALSKILL_LIFELEECHCHANCE, "rarity_lifeLeechChance", "Life Chance"},
-            {SPECIALSKILL_LIFELEECHAMOUNT, "rarity_lifeLeechAmount", "Life Amount"}
-        };
-
-        std::vector<std::tuple<CombatType_t, std::string, std::string>> elementTypes = {
-            {COMBAT_FIREDAMAGE,  "rarity_elementfire",  "Fire"},
-            {COMBAT_ICEDAMAGE,   "rarity_elementice",   "Ice"},
-            {COMBAT_ENERGYDAMAGE,"rarity_elementenergy", "Energy"},
-            {COMBAT_DEATHDAMAGE, "rarity_elementdeath", "Death"},
-            {COMBAT_EARTHDAMAGE, "rarity_elementearth", "Earth"},
-            {COMBAT_WATERDAMAGE, "rarity_elementwater", "Water"},
-            {COMBAT_ARCANEDAMAGE,"rarity_elementarcane", "Arcane"},
-            {COMBAT_HOLYDAMAGE,  "rarity_elementholy",  "Holy"}
-        };
-
-        std::string absorptionDesc;
-        if (attrCounts.numAbsorbs > 0) {
-            std::mt19937 rng(std::random_device{}());
-            std::shuffle(absorptionTypes.begin(), absorptionTypes.end(), rng);
-            for (int i = 0; i < attrCounts.numAbsorbs && i < (int)absorptionTypes.size(); ++i) {
-                auto [ctype, key, name] = absorptionTypes[i];
-                const auto& range = absorptionBonuses[rarityId - 1];
-                int bonus = uniform_random(range.first, range.second);
-                std::string attrKey = key;
-                item->setCustomAttribute(attrKey, static_cast<int64_t>(bonus));
-                absorptionDesc += (absorptionDesc.empty() ? "" : ", ") + name + " +" + std::to_string(bonus) + "%";
-            }
-        }
-
-        std::string skillsDesc;
-        if (attrCounts.numSkills > 0) {
-            std::mt19937 rng(std::random_device{}());
-            std::shuffle(skillTypes.begin(), skillTypes.end(), rng);
-            for (int i = 0; i < attrCounts.numSkills && i < (int)skillTypes.size(); ++i) {
-                auto [skillId, key, name] = skillTypes[i];
-                const auto& range = absorptionBonuses[rarityId - 1];
-                int bonus = uniform_random(range.first, range.second);
-                std::string attrKey = key;
-                item->setCustomAttribute(attrKey, static_cast<int64_t>(bonus));
-                skillsDesc += (skillsDesc.empty() ? "" : ", ") + name + " +" + std::to_string(bonus);
-            }
-        }
-
-        std::string specialsDesc;
-		bool criticalApplied = false;
-		bool manaApplied = false;
-		bool lifeApplied = false;
-
-		for (int i = 0; i < attrCounts.numSpecials && i < (int)specialSkillTypes.size(); ++i) {
-    		auto [specialId, key, name] = specialSkillTypes[i];
-    	if (specialId == SPECIALSKILL_CRITICALHITCHANCE || specialId == SPECIALSKILL_CRITICALHITAMOUNT) {
-        	if (!criticalApplied) {
-            	const auto& range = absorptionBonuses[rarityId - 1];
-            	int bonus = uniform_random(range.first, range.second);
-            	std::string critChanceKey = "rarity_criticalHitChance";
-            	std::string critHitKey    = "rarity_criticalHitAmount";
-            	item->setCustomAttribute(critChanceKey, static_cast<int64_t>(bonus));
-            	item->setCustomAttribute(critHitKey,    static_cast<int64_t>(bonus));
-            	specialsDesc += (specialsDesc.empty() ? "" : ", ") +
-                            std::string("Critical Chance +") + std::to_string(bonus) + "%";
-            	specialsDesc += ", " +
-                            std::string("Critical Hit +") + std::to_string(bonus) + "%";
-            	criticalApplied = true;
-        	}
-        	continue;
-    	}
-    	if (specialId == SPECIALSKILL_MANALEECHCHANCE || specialId == SPECIALSKILL_MANALEECHAMOUNT) {
-        	if (!manaApplied) {
-            	const auto& range = absorptionBonuses[rarityId - 1];
-            	int bonus = uniform_random(range.first, range.second);
-            	std::string manaChanceKey = "rarity_manaLeechChance";
-            	std::string manaAmountKey = "rarity_manaLeechAmount";
-            	item->setCustomAttribute(manaChanceKey, static_cast<int64_t>(bonus));
-            	item->setCustomAttribute(manaAmountKey, static_cast<int64_t>(bonus));
-            	specialsDesc += (specialsDesc.empty() ? "" : ", ") +
-                            std::string("Mana Chance +") + std::to_string(bonus) + "%";
-            	specialsDesc += ", " +
-                            std::string("Mana Amount +") + std::to_string(bonus) + "%";
-            	manaApplied = true;
-        	}
-        	continue;
-    	}
-    	if (specialId == SPECIALSKILL_LIFELEECHCHANCE || specialId == SPECIALSKILL_LIFELEECHAMOUNT) {
-        	if (!lifeApplied) {
-            	const auto& range = absorptionBonuses[rarityId - 1];
-            	int bonus = uniform_random(range.first, range.second);
-            	std::string lifeChanceKey = "rarity_lifeLeechChance";
-            	std::string lifeAmountKey = "rarity_lifeLeechAmount";
-            	item->setCustomAttribute(lifeChanceKey, static_cast<int64_t>(bonus));
-            	item->setCustomAttribute(lifeAmountKey, static_cast<int64_t>(bonus));
-            	specialsDesc += (specialsDesc.empty() ? "" : ", ") +
-                            std::string("Life Chance +") + std::to_string(bonus) + "%";
-            	specialsDesc += ", " +
-                            std::string("Life Amount +") + std::to_string(bonus) + "%";
-            	lifeApplied = true;
-        	}
-        	continue;
-    	}
-    	const auto& range = absorptionBonuses[rarityId - 1];
-    	int bonus = uniform_random(range.first, range.second);
-    	std::string attrKey = key;
-    	item->setCustomAttribute(attrKey, static_cast<int64_t>(bonus));
-    	specialsDesc += (specialsDesc.empty() ? "" : ", ") + name + " +" + std::to_string(bonus) + "%";
-		}
-
-        std::string elementDesc;
-		if (isWeapon && it.attack > 0 && attrCounts.numElements > 0) {
-    		if (!it.abilities || it.abilities->elementDamage <= 0) {
-        		std::mt19937 rng(std::random_device{}());
-        		std::shuffle(elementTypes.begin(), elementTypes.end(), rng);
-        		for (int i = 0; i < attrCounts.numElements && i < (int)elementTypes.size(); ++i) {
-            		auto [ctype, key, name] = elementTypes[i];
-            		const auto& range = elementBonuses[rarityId - 1];
-            		int bonus = uniform_random(range.first, range.second);
-            		std::string attrKey = key;
-            		item->setCustomAttribute(attrKey, static_cast<int64_t>(bonus));
-            		elementDesc += (elementDesc.empty() ? "" : ", ") + name + " +" + std::to_string(bonus) + "% dmg";
-        		}
-    		}
-		}
-
-        std::string description = item->getStrAttr(ITEM_ATTRIBUTE_DESCRIPTION);
-        if (!description.empty()) {
-            description += ", ";
-        }
-        description += "Level: " + std::to_string(finalLevel);
-        if (!absorptionDesc.empty()) {
-            description += ", " + absorptionDesc;
-        }
-        if (!skillsDesc.empty()) {
-            description += ", " + skillsDesc;
-        }
-        if (!specialsDesc.empty()) {
-            description += ", " + specialsDesc;
-        }
-        if (!elementDesc.empty()) {
-            description += ", Element: " + elementDesc;
-        }
-        item->setStrAttr(ITEM_ATTRIBUTE_DESCRIPTION, description);
+    applyRarityBonuses(item, rarityId, RARITY_SPECIALS_IN_ORDER);
 }
 
 Item* Item::CreateItemWithRarity(const uint16_t type, uint16_t count, int rarityId) {
@@ -346,13 +93,43 @@ Item* Item::CreateItemWithRarity(const uint16_t type, uint16_t count, int rarity
     }
     Item* newItem = CreateItem(type, count);
     if (newItem) {
-        std::string key = "rarity";
-        newItem->setCustomAttribute(key, static_cast<int64_t>(rarityId));
+        newItem->setCustomAttribute(CustomAttributeKeys::RARITY, static_cast<int64_t>(rarityId));
         applyRarityEffects(newItem);
     }
     return newItem;
 }
 
+static constexpr size_t ITEM_FREE_LIST_CAPACITY = 32768;
+static constexpr size_t CONTAINER_FREE_LIST_CAPACITY = 8192;
+
+void* Item::operator new(size_t size)
+{
+	MemoryAccounting::allocated(size == sizeof(Container) ? MEMORY_CONTAINERS : MEMORY_ITEMS, size);
+	// the arena keeps its own free blocks, so it takes over the free lists
+	if (void* p = HugePageArena::allocate(size)) {
+		return p;
+	} else if (size == sizeof(Item)) {
+		return LockfreePoolingAllocator<Item, ITEM_FREE_LIST_CAPACITY>().allocate(1);
+	} else if (size == sizeof(Container)) {
+		return LockfreePoolingAllocator<Container, CONTAINER_FREE_LIST_CAPACITY>().allocate(1);
+	}
+	return ::operator new(size);
+}
+
+void Item::operator delete(void* p, size_t size)
+{
+	MemoryAccounting::released(size == sizeof(Container) ? MEMORY_CONTAINERS : MEMORY_ITEMS, size);
+	if (HugePageArena::release(p, size)) {
+		return;
+	} else if (size == sizeof(Item)) {
+		LockfreePoolingAllocator<Item, ITEM_FREE_LIST_CAPACITY>().deallocate(static_cast<Item*>(p), 1);
+	} else if (size == sizeof(Container)) {
+		LockfreePoolingAllocator<Container, CONTAINER_FREE_LIST_CAPACITY>().deallocate(static_cast<Container*>(p), 1);
+	} else {
+		::operator delete(p);
+	}
+}
+
 Item* Item::CreateItem(const uint16_t type, uint16_t count /*= 0*/)
 {
 	Item* newItem = nullptr;
@@ -398,7 +175,7 @@ Item* Item::CreateItem(const uint16_t type, uint16_t count /*= 0*/)
 		} else {
 			newItem = new Item(type, count);
 		}
-		if(newItem && newItem->getCustomAttribute("rarity")) {
+		if(newItem && newItem->getCustomAttribute(CustomAttributeKeys::RARITY)) {
     		applyRarityEffects(newItem);
 		}
 
@@ -490,16 +267,14 @@ Item::Item(const uint16_t type, uint16_t count /*= 0*/) :
 Item::Item(const Item& i) :
 	Thing(), id(i.id), count(i.count), loadedFromMap(i.loadedFromMap)
 {
-	if (i.attributes) {
-		attributes.reset(new ItemAttributes(*i.attributes));
-	}
+	attributes = i.attributes;
 }
 
 Item* Item::clone() const
 {
 	Item* item = Item::CreateItem(id, count);
 	if (attributes) {
-		item->attributes.reset(new ItemAttributes(*attributes));
+		item->attributes = attributes;
 		if (item->getDuration() > 0) {
 			item->incrementReferenceCounter();
 			item->setDecaying(DECAYING_TRUE);
@@ -522,7 +297,9 @@ bool Item::equals(const Item* otherItem) const
 		return (attributes->attributeBits == 0);
 	}
 
-	if (attributes->attributeBits != otherAttributes->attributeBits) {
+	if (attributes == otherAttributes) {
+		return true;
+	} else if (attributes->attributeBits != otherAttributes->attributeBits) {
 		return false;
 	}
 
@@ -597,6 +374,26 @@ void Item::setID(uint16_t newid)
 	}
 }
 
+void Item::setDuration(int32_t time)
+{
+	setIntAttr(ITEM_ATTRIBUTE_DURATION, time);
+
+	// the scheduled entry is keyed by the old deadline
+	if (getDecaying() == DECAYING_TRUE && hasAttribute(ITEM_ATTRIBUTE_DURATION_TIMESTAMP)) {
+		g_game.rescheduleDecay(this);
+	}
+}
+
+void Item::setDecaying(ItemDecayState_t decayState)
+{
+	// keep the time that is left once the item leaves the decay schedule
+	if (decayState != DECAYING_TRUE && hasAttribute(ITEM_ATTRIBUTE_DURATION_TIMESTAMP)) {
+		setIntAttr(ITEM_ATTRIBUTE_DURATION, getDuration());
+		removeAttribute(ITEM_ATTRIBUTE_DURATION_TIMESTAMP);
+	}
+	setIntAttr(ITEM_ATTRIBUTE_DECAYSTATE, decayState);
+}
+
 Cylinder* Item::getTopParent()
 {
 	Cylinder* aux = getParent();
@@ -1014,6 +811,14 @@ Attr_ReadValue Item::readAttr(AttrTypes_t attr, PropStream& propStream)
 			return ATTR_READ_ERROR;
 		}
 
+		case ATTR_COMPACT_ATTRIBUTES: {
+			uint8_t version;
+			if (!propStream.read<uint8_t>(version) || version != COMPACT_ATTRIBUTES_VERSION || !readCompactAttr(propStream)) {
+				return ATTR_READ_ERROR;
+			}
+			break;
+		}
+
 		case ATTR_CUSTOM_ATTRIBUTES: {
 			uint64_t size;
 			if (!propStream.read<uint64_t>(size)) {
@@ -1066,166 +871,279 @@ bool Item::unserializeItemNode(OTB::Loader&, const OTB::Node&, PropStream& propS
 
 void Item::serializeAttr(PropWriteStream& propWriteStream) const
 {
+	// the section only starts with the first attribute, plain items write nothing
+	bool started = false;
+	auto writeTag = [&](AttrTypes_t attr) {
+		if (!started) {
+			propWriteStream.write<uint8_t>(ATTR_COMPACT_ATTRIBUTES);
+			propWriteStream.write<uint8_t>(COMPACT_ATTRIBUTES_VERSION);
+			started = true;
+		}
+		propWriteStream.write<uint8_t>(attr);
+	};
+
 	const ItemType& it = items[id];
 	if (it.stackable || it.isFluidContainer() || it.isSplash()) {
-		propWriteStream.write<uint8_t>(ATTR_COUNT);
-		propWriteStream.write<uint8_t>(getSubType());
+		writeTag(ATTR_COUNT);
+		propWriteStream.writeVarint(getSubType());
 	}
 
 	uint16_t charges = getCharges();
 	if (charges != 0) {
-		propWriteStream.write<uint8_t>(ATTR_CHARGES);
-		propWriteStream.write<uint16_t>(charges);
+		writeTag(ATTR_CHARGES);
+		propWriteStream.writeVarint(charges);
 	}
 
 	if (it.moveable) {
 		uint16_t actionId = getActionId();
 		if (actionId != 0) {
-			propWriteStream.write<uint8_t>(ATTR_ACTION_ID);
-			propWriteStream.write<uint16_t>(actionId);
+			writeTag(ATTR_ACTION_ID);
+			propWriteStream.writeVarint(actionId);
 		}
 	}
 
 	const std::string& text = getText();
 	if (!text.empty()) {
-		propWriteStream.write<uint8_t>(ATTR_TEXT);
-		propWriteStream.writeString(text);
+		writeTag(ATTR_TEXT);
+		propWriteStream.writeCompactString(text);
 	}
 
 	const time_t writtenDate = getDate();
 	if (writtenDate != 0) {
-		propWriteStream.write<uint8_t>(ATTR_WRITTENDATE);
-		propWriteStream.write<uint32_t>(writtenDate);
+		writeTag(ATTR_WRITTENDATE);
+		propWriteStream.writeVarint(static_cast<uint32_t>(writtenDate));
 	}
 
 	const std::string& writer = getWriter();
 	if (!writer.empty()) {
-		propWriteStream.write<uint8_t>(ATTR_WRITTENBY);
-		propWriteStream.writeString(writer);
+		writeTag(ATTR_WRITTENBY);
+		propWriteStream.writeCompactString(writer);
 	}
 
 	const std::string& specialDesc = getSpecialDescription();
 	if (!specialDesc.empty()) {
-		propWriteStream.write<uint8_t>(ATTR_DESC);
-		propWriteStream.writeString(specialDesc);
+		writeTag(ATTR_DESC);
+		propWriteStream.writeCompactString(specialDesc);
 	}
 
 	if (hasAttribute(ITEM_ATTRIBUTE_DURATION)) {
-		propWriteStream.write<uint8_t>(ATTR_DURATION);
-		propWriteStream.write<uint32_t>(getIntAttr(ITEM_ATTRIBUTE_DURATION));
+		writeTag(ATTR_DURATION);
+		propWriteStream.writeSignedVarint(getDuration());
 	}
 
 	ItemDecayState_t decayState = getDecaying();
 	if (decayState == DECAYING_TRUE || decayState == DECAYING_PENDING) {
-		propWriteStream.write<uint8_t>(ATTR_DECAYING_STATE);
-		propWriteStream.write<uint8_t>(decayState);
-	}
-
-	if (hasAttribute(ITEM_ATTRIBUTE_NAME)) {
-		propWriteStream.write<uint8_t>(ATTR_NAME);
-		propWriteStream.writeString(getStrAttr(ITEM_ATTRIBUTE_NAME));
+		writeTag(ATTR_DECAYING_STATE);
+		propWriteStream.writeVarint(decayState);
+	}
+
+	static constexpr std::pair<itemAttrTypes, AttrTypes_t> stringAttributes[] = {
+		{ITEM_ATTRIBUTE_NAME, ATTR_NAME},
+		{ITEM_ATTRIBUTE_ARTICLE, ATTR_ARTICLE},
+		{ITEM_ATTRIBUTE_PLURALNAME, ATTR_PLURALNAME},
+	};
+	for (const auto& entry : stringAttributes) {
+		if (hasAttribute(entry.first)) {
+			writeTag(entry.second);
+			propWriteStream.writeCompactString(getStrAttr(entry.first));
+		}
+	}
+
+	static constexpr std::pair<itemAttrTypes, AttrTypes_t> intAttributes[] = {
+		{ITEM_ATTRIBUTE_WEIGHT, ATTR_WEIGHT},
+		{ITEM_ATTRIBUTE_ATTACK, ATTR_ATTACK},
+		{ITEM_ATTRIBUTE_ATTACK_SPEED, ATTR_ATTACK_SPEED},
+		{ITEM_ATTRIBUTE_DEFENSE, ATTR_DEFENSE},
+		{ITEM_ATTRIBUTE_EXTRADEFENSE, ATTR_EXTRADEFENSE},
+		{ITEM_ATTRIBUTE_ARMOR, ATTR_ARMOR},
+		{ITEM_ATTRIBUTE_RARITY, ATTR_RARITY},
+		{ITEM_ATTRIBUTE_HITCHANCE, ATTR_HITCHANCE},
+		{ITEM_ATTRIBUTE_SHOOTRANGE, ATTR_SHOOTRANGE},
+		{ITEM_ATTRIBUTE_DECAYTO, ATTR_DECAYTO},
+		{ITEM_ATTRIBUTE_WRAPID, ATTR_WRAPID},
+		{ITEM_ATTRIBUTE_STOREITEM, ATTR_STOREITEM},
+	};
+	for (const auto& entry : intAttributes) {
+		if (hasAttribute(entry.first)) {
+			writeTag(entry.second);
+			propWriteStream.writeSignedVarint(getIntAttr(entry.first));
+		}
 	}
 
-	if (hasAttribute(ITEM_ATTRIBUTE_ARTICLE)) {
-		propWriteStream.write<uint8_t>(ATTR_ARTICLE);
-		propWriteStream.writeString(getStrAttr(ITEM_ATTRIBUTE_ARTICLE));
+	if (hasAttribute(ITEM_ATTRIBUTE_CUSTOM)) {
+		const ItemAttributes::CustomAttributeMap* customAttrMap = attributes->getCustomAttributeMap();
+		writeTag(ATTR_CUSTOM_ATTRIBUTES);
+		propWriteStream.writeVarint(customAttrMap->size());
+		for (const auto& entry : *customAttrMap) {
+			uint8_t keyIndex = getCompactCustomKeyIndex(entry.first);
+			propWriteStream.write<uint8_t>(keyIndex);
+			if (keyIndex == 0) {
+				propWriteStream.writeCompactString(entry.first.getName());
+			}
+			entry.second.serializeCompact(propWriteStream);
+		}
 	}
 
-	if (hasAttribute(ITEM_ATTRIBUTE_PLURALNAME)) {
-		propWriteStream.write<uint8_t>(ATTR_PLURALNAME);
-		propWriteStream.writeString(getStrAttr(ITEM_ATTRIBUTE_PLURALNAME));
+	if (started) {
+		propWriteStream.write<uint8_t>(0);
 	}
+}
 
-	if (hasAttribute(ITEM_ATTRIBUTE_WEIGHT)) {
-		propWriteStream.write<uint8_t>(ATTR_WEIGHT);
-		propWriteStream.write<uint32_t>(getIntAttr(ITEM_ATTRIBUTE_WEIGHT));
-	}
+bool Item::readCompactAttr(PropStream& propStream)
+{
+	uint8_t attr;
+	while (propStream.read<uint8_t>(attr)) {
+		switch (attr) {
+			case 0:
+				return true;
+
+			case ATTR_TEXT:
+			case ATTR_WRITTENBY:
+			case ATTR_DESC:
+			case ATTR_NAME:
+			case ATTR_ARTICLE:
+			case ATTR_PLURALNAME: {
+				std::string value;
+				if (!propStream.readCompactString(value)) {
+					return false;
+				}
 
-	if (hasAttribute(ITEM_ATTRIBUTE_ATTACK)) {
-		propWriteStream.write<uint8_t>(ATTR_ATTACK);
-		propWriteStream.write<int32_t>(getIntAttr(ITEM_ATTRIBUTE_ATTACK));
-	}
+				switch (attr) {
+					case ATTR_TEXT: setText(value); break;
+					case ATTR_WRITTENBY: setWriter(value); break;
+					case ATTR_DESC: setSpecialDescription(value); break;
+					case ATTR_NAME: setStrAttr(ITEM_ATTRIBUTE_NAME, value); break;
+					case ATTR_ARTICLE: setStrAttr(ITEM_ATTRIBUTE_ARTICLE, value); break;
+					default: setStrAttr(ITEM_ATTRIBUTE_PLURALNAME, value); break;
+				}
+				break;
+			}
 
-	if (hasAttribute(ITEM_ATTRIBUTE_ATTACK_SPEED)) {
-		propWriteStream.write<uint8_t>(ATTR_ATTACK_SPEED);
-		propWriteStream.write<uint32_t>(getIntAttr(ITEM_ATTRIBUTE_ATTACK_SPEED));
-	}
+			case ATTR_COUNT:
+			case ATTR_CHARGES:
+			case ATTR_ACTION_ID:
+			case ATTR_WRITTENDATE:
+			case ATTR_DECAYING_STATE: {
+				uint64_t value;
+				if (!propStream.readVarint(value)) {
+					return false;
+				}
 
-	if (hasAttribute(ITEM_ATTRIBUTE_DEFENSE)) {
-		propWriteStream.write<uint8_t>(ATTR_DEFENSE);
-		propWriteStream.write<int32_t>(getIntAttr(ITEM_ATTRIBUTE_DEFENSE));
-	}
+				switch (attr) {
+					case ATTR_COUNT: setSubType(static_cast<uint8_t>(value)); break;
+					case ATTR_CHARGES: setSubType(static_cast<uint16_t>(value)); break;
+					case ATTR_ACTION_ID: setActionId(static_cast<uint16_t>(value)); break;
+					case ATTR_WRITTENDATE: setDate(static_cast<uint32_t>(value)); break;
+					default:
+						if (value != DECAYING_FALSE) {
+							setDecaying(DECAYING_PENDING);
+						}
+						break;
+				}
+				break;
+			}
 
-	if (hasAttribute(ITEM_ATTRIBUTE_EXTRADEFENSE)) {
-		propWriteStream.write<uint8_t>(ATTR_EXTRADEFENSE);
-		propWriteStream.write<int32_t>(getIntAttr(ITEM_ATTRIBUTE_EXTRADEFENSE));
-	}
+			case ATTR_DURATION: {
+				int64_t value;
+				if (!propStream.readSignedVarint(value)) {
+					return false;
+				}
 
-	if (hasAttribute(ITEM_ATTRIBUTE_ARMOR)) {
-		propWriteStream.write<uint8_t>(ATTR_ARMOR);
-		propWriteStream.write<int32_t>(getIntAttr(ITEM_ATTRIBUTE_ARMOR));
-	}
+				setDuration(std::max<int32_t>(0, static_cast<int32_t>(value)));
+				break;
+			}
 
-	if (hasAttribute(ITEM_ATTRIBUTE_RARITY)) {
-		propWriteStream.write<uint8_t>(ATTR_RARITY);
-		propWriteStream.write<int32_t>(getIntAttr(ITEM_ATTRIBUTE_RARITY));
-	}
+			// the widths of the fixed tags are kept, so a value reads back the same
+			case ATTR_WEIGHT:
+			case ATTR_ATTACK_SPEED:
+			case ATTR_ATTACK:
+			case ATTR_DEFENSE:
+			case ATTR_EXTRADEFENSE:
+			case ATTR_ARMOR:
+			case ATTR_RARITY:
+			case ATTR_DECAYTO:
+			case ATTR_HITCHANCE:
+			case ATTR_SHOOTRANGE:
+			case ATTR_WRAPID:
+			case ATTR_STOREITEM: {
+				int64_t value;
+				if (!propStream.readSignedVarint(value)) {
+					return false;
+				}
 
-	if (hasAttribute(ITEM_ATTRIBUTE_HITCHANCE)) {
-		propWriteStream.write<uint8_t>(ATTR_HITCHANCE);
-		propWriteStream.write<int8_t>(getIntAttr(ITEM_ATTRIBUTE_HITCHANCE));
-	}
+				switch (attr) {
+					case ATTR_WEIGHT: setIntAttr(ITEM_ATTRIBUTE_WEIGHT, static_cast<uint32_t>(value)); break;
+					case ATTR_ATTACK_SPEED: setIntAttr(ITEM_ATTRIBUTE_ATTACK_SPEED, static_cast<uint32_t>(value)); break;
+					case ATTR_ATTACK: setIntAttr(ITEM_ATTRIBUTE_ATTACK, static_cast<int32_t>(value)); break;
+					case ATTR_DEFENSE: setIntAttr(ITEM_ATTRIBUTE_DEFENSE, static_cast<int32_t>(value)); break;
+					case ATTR_EXTRADEFENSE: setIntAttr(ITEM_ATTRIBUTE_EXTRADEFENSE, static_cast<int32_t>(value)); break;
+					case ATTR_ARMOR: setIntAttr(ITEM_ATTRIBUTE_ARMOR, static_cast<int32_t>(value)); break;
+					case ATTR_RARITY: setIntAttr(ITEM_ATTRIBUTE_RARITY, static_cast<int32_t>(value)); break;
+					case ATTR_DECAYTO: setIntAttr(ITEM_ATTRIBUTE_DECAYTO, static_cast<int32_t>(value)); break;
+					case ATTR_HITCHANCE: setIntAttr(ITEM_ATTRIBUTE_HITCHANCE, static_cast<int8_t>(value)); break;
+					case ATTR_SHOOTRANGE: setIntAttr(ITEM_ATTRIBUTE_SHOOTRANGE, static_cast<uint8_t>(value)); break;
+					case ATTR_WRAPID: setIntAttr(ITEM_ATTRIBUTE_WRAPID, static_cast<uint16_t>(value)); break;
+					default: setIntAttr(ITEM_ATTRIBUTE_STOREITEM, static_cast<uint8_t>(value)); break;
+				}
+				break;
+			}
 
-	if (hasAttribute(ITEM_ATTRIBUTE_SHOOTRANGE)) {
-		propWriteStream.write<uint8_t>(ATTR_SHOOTRANGE);
-		propWriteStream.write<uint8_t>(getIntAttr(ITEM_ATTRIBUTE_SHOOTRANGE));
-	}
+			case ATTR_CUSTOM_ATTRIBUTES: {
+				uint64_t size;
+				if (!propStream.readVarint(size)) {
+					return false;
+				}
 
-	if (hasAttribute(ITEM_ATTRIBUTE_DECAYTO)) {
-		propWriteStream.write<uint8_t>(ATTR_DECAYTO);
-		propWriteStream.write<int32_t>(getIntAttr(ITEM_ATTRIBUTE_DECAYTO));
-	}
+				for (uint64_t i = 0; i < size; ++i) {
+					uint8_t keyIndex;
+					if (!propStream.read<uint8_t>(keyIndex)) {
+						return false;
+					}
 
-	if (hasAttribute(ITEM_ATTRIBUTE_WRAPID)) {
-		propWriteStream.write<uint8_t>(ATTR_WRAPID);
-		propWriteStream.write<uint16_t>(getIntAttr(ITEM_ATTRIBUTE_WRAPID));
-	}
+					CustomAttributeKey key;
+					if (keyIndex == 0) {
+						std::string name;
+						if (!propStream.readCompactString(name)) {
+							return false;
+						}
+						key = CustomAttributeKey::get(name);
+					} else if (!getCompactCustomKey(keyIndex, key)) {
+						return false;
+					}
 
-	if (hasAttribute(ITEM_ATTRIBUTE_STOREITEM)) {
-		propWriteStream.write<uint8_t>(ATTR_STOREITEM);
-		propWriteStream.write<uint8_t>(getIntAttr(ITEM_ATTRIBUTE_STOREITEM));
-	}
+					ItemAttributes::CustomAttribute val;
+					if (!val.unserializeCompact(propStream)) {
+						return false;
+					}
 
-	if (hasAttribute(ITEM_ATTRIBUTE_CUSTOM)) {
-		const ItemAttributes::CustomAttributeMap* customAttrMap = attributes->getCustomAttributeMap();
-		propWriteStream.write<uint8_t>(ATTR_CUSTOM_ATTRIBUTES);
-		propWriteStream.write<uint64_t>(static_cast<uint64_t>(customAttrMap->size()));
-		for (const auto &entry : *customAttrMap) {
-			// Serializing key type and value
-			propWriteStream.writeString(entry.first);
+					setCustomAttribute(key, val);
+				}
+				break;
+			}
 
-			// Serializing value type and value
-			entry.second.serialize(propWriteStream);
+			default:
+				return false;
 		}
 	}
+	return false;
 }
 
 bool Item::hasProperty(ITEMPROPERTY prop) const
 {
-	const ItemType& it = items[id];
+	const ItemHotType& it = items.getHotType(id);
 	switch (prop) {
-		case CONST_PROP_BLOCKSOLID: return it.blockSolid;
-		case CONST_PROP_MOVEABLE: return it.moveable && !hasAttribute(ITEM_ATTRIBUTE_UNIQUEID);
-		case CONST_PROP_HASHEIGHT: return it.hasHeight;
-		case CONST_PROP_BLOCKPROJECTILE: return it.blockProjectile;
-		case CONST_PROP_BLOCKPATH: return it.blockPathFind;
-		case CONST_PROP_ISVERTICAL: return it.isVertical;
-		case CONST_PROP_ISHORIZONTAL: return it.isHorizontal;
-		case CONST_PROP_IMMOVABLEBLOCKSOLID: return it.blockSolid && (!it.moveable || hasAttribute(ITEM_ATTRIBUTE_UNIQUEID));
-		case CONST_PROP_IMMOVABLEBLOCKPATH: return it.blockPathFind && (!it.moveable || hasAttribute(ITEM_ATTRIBUTE_UNIQUEID));
-		case CONST_PROP_IMMOVABLENOFIELDBLOCKPATH: return !it.isMagicField() && it.blockPathFind && (!it.moveable || hasAttribute(ITEM_ATTRIBUTE_UNIQUEID));
-		case CONST_PROP_NOFIELDBLOCKPATH: return !it.isMagicField() && it.blockPathFind;
-		case CONST_PROP_SUPPORTHANGABLE: return it.isHorizontal || it.isVertical;
+		case CONST_PROP_BLOCKSOLID: return it.hasFlag(ITEMFLAG_BLOCKSOLID);
+		case CONST_PROP_MOVEABLE: return it.hasFlag(ITEMFLAG_MOVEABLE) && !hasAttribute(ITEM_ATTRIBUTE_UNIQUEID);
+		case CONST_PROP_HASHEIGHT: return it.hasFlag(ITEMFLAG_HASHEIGHT);
+		case CONST_PROP_BLOCKPROJECTILE: return it.hasFlag(ITEMFLAG_BLOCKPROJECTILE);
+		case CONST_PROP_BLOCKPATH: return it.hasFlag(ITEMFLAG_BLOCKPATH);
+		case CONST_PROP_ISVERTICAL: return it.hasFlag(ITEMFLAG_VERTICAL);
+		case CONST_PROP_ISHORIZONTAL: return it.hasFlag(ITEMFLAG_HORIZONTAL);
+		case CONST_PROP_IMMOVABLEBLOCKSOLID: return it.hasFlag(ITEMFLAG_BLOCKSOLID) && (!it.hasFlag(ITEMFLAG_MOVEABLE) || hasAttribute(ITEM_ATTRIBUTE_UNIQUEID));
+		case CONST_PROP_IMMOVABLEBLOCKPATH: return it.hasFlag(ITEMFLAG_BLOCKPATH) && (!it.hasFlag(ITEMFLAG_MOVEABLE) || hasAttribute(ITEM_ATTRIBUTE_UNIQUEID));
+		case CONST_PROP_IMMOVABLENOFIELDBLOCKPATH: return !it.hasFlag(ITEMFLAG_MAGICFIELD) && it.hasFlag(ITEMFLAG_BLOCKPATH) && (!it.hasFlag(ITEMFLAG_MOVEABLE) || hasAttribute(ITEM_ATTRIBUTE_UNIQUEID));
+		case CONST_PROP_NOFIELDBLOCKPATH: return !it.hasFlag(ITEMFLAG_MAGICFIELD) && it.hasFlag(ITEMFLAG_BLOCKPATH);
+		case CONST_PROP_SUPPORTHANGABLE: return it.hasFlag(ITEMFLAG_HORIZONTAL) || it.hasFlag(ITEMFLAG_VERTICAL);
 		default: return false;
 	}
 }
@@ -2019,6 +1937,72 @@ LightInfo Item::getLightInfo() const
 	return {it.lightLevel, it.lightColor};
 }
 
+namespace {
+
+struct CustomAttributeKeyTable
+{
+	std::unordered_map<std::string, uint16_t> ids;
+	std::vector<std::string> names;
+};
+
+CustomAttributeKeyTable& getCustomAttributeKeyTable()
+{
+	static CustomAttributeKeyTable table;
+	return table;
+}
+
+}
+
+namespace CustomAttributeKeys {
+	const CustomAttributeKey RARITY = CustomAttributeKey::get("rarity");
+	const CustomAttributeKey COMBAT_POWER_LEVEL = CustomAttributeKey::get("combatPowerLevel");
+}
+
+CustomAttributeKey CustomAttributeKey::get(const std::string& name)
+{
+	CustomAttributeKeyTable& table = getCustomAttributeKeyTable();
+	std::string lowerName = asLowerCaseString(name);
+
+	CustomAttributeKey key;
+	auto it = table.ids.find(lowerName);
+	if (it != table.ids.end()) {
+		key.id = it->second;
+		return key;
+	}
+
+	if (table.names.size() > std::numeric_limits<uint16_t>::max()) {
+		std::cout << "[Error - CustomAttributeKey::get] Too many custom attribute keys, " << lowerName << " is not interned." << std::endl;
+		return key;
+	}
+
+	key.id = static_cast<uint16_t>(table.names.size());
+	table.ids.emplace(lowerName, key.id);
+	table.names.push_back(std::move(lowerName));
+	return key;
+}
+
+bool CustomAttributeKey::find(const std::string& name, CustomAttributeKey& key)
+{
+	const CustomAttributeKeyTable& table = getCustomAttributeKeyTable();
+	auto it = table.ids.find(asLowerCaseString(name));
+	if (it == table.ids.end()) {
+		return false;
+	}
+
+	key.id = it->second;
+	return true;
+}
+
+const std::string& CustomAttributeKey::getName() const
+{
+	const CustomAttributeKeyTable& table = getCustomAttributeKeyTable();
+	static const std::string emptyName;
+	if (id >= table.names.size()) {
+		return emptyName;
+	}
+	return table.names[id];
+}
+
 std::string ItemAttributes::emptyString;
 int64_t ItemAttributes::emptyInt;
 double ItemAttributes::emptyDouble;
@@ -2449,10 +2433,41 @@ void Item::getTooltipData(Item* item, uint16_t spriteId, uint16_t count, Tooltip
 	getTooltipOther(it, tooltipData);
 }
 
+uint64_t Item::getTooltipHash() const
+{
+	size_t seed = 0;
+	boost::hash_combine(seed, id);
+	boost::hash_combine(seed, getSubType());
+	boost::hash_combine(seed, getItemCount());
+	boost::hash_combine(seed, getWeight());
+	if (!attributes) {
+		return seed;
+	}
+
+	boost::hash_combine(seed, attributes->attributeBits);
+	for (const auto& attribute : attributes->getList()) {
+		if (ItemAttributes::isIntAttrType(attribute.type)) {
+			boost::hash_combine(seed, attribute.value.integer);
+		} else if (ItemAttributes::isStrAttrType(attribute.type)) {
+			boost::hash_combine(seed, *attribute.value.string);
+		}
+	}
+
+	// the remaining time of decaying items is not stored as an attribute
+	boost::hash_combine(seed, getDuration() / 1000);
+
+	if (const ItemAttributes::CustomAttribute* rarity = attributes->getCustomAttribute(CustomAttributeKeys::RARITY)) {
+		if (rarity->value.type() == typeid(int64_t)) {
+			boost::hash_combine(seed, boost::get<int64_t>(rarity->value));
+		}
+	}
+	return seed;
+}
+
 void Item::getRarityLevel(TooltipDataContainer& tooltipData)
 {
     int rarity = 0;
-    const auto rarityId = getCustomAttribute("rarity");
+    const auto rarityId = getCustomAttribute(CustomAttributeKeys::RARITY);
     if (rarityId) {
         const auto& value = rarityId->value;
         if (value.type() == typeid(int64_t)) {
@@ -9,8 +9,11 @@
 #include "items.h"
 #include "luascript.h"
 #include "tools.h"
+#include "memoryaccounting.h"
 #include <typeinfo>
 
+#include <boost/container/flat_map.hpp>
+#include <boost/container/small_vector.hpp>
 #include <boost/variant.hpp>
 #include <deque>
 
@@ -96,6 +99,9 @@ enum AttrTypes_t {
 	ATTR_PODIUMOUTFIT = 40,
 	ATTR_TIER = 41,
 	ATTR_RARITY = 42,
+
+	// the attributes of Item::serializeAttr as varints, never in map files
+	ATTR_COMPACT_ATTRIBUTES = 128,
 };
 
 enum Attr_ReadValue {
@@ -104,7 +110,32 @@ enum Attr_ReadValue {
 	ATTR_READ_END,
 };
 
-class ItemAttributes
+// custom attribute names are interned once, items only store the id
+struct CustomAttributeKey
+{
+	uint16_t id = 0;
+
+	// interns the lowercased name
+	static CustomAttributeKey get(const std::string& name);
+	// like get, but unknown names are not added to the table
+	static bool find(const std::string& name, CustomAttributeKey& key);
+
+	const std::string& getName() const;
+
+	bool operator==(const CustomAttributeKey& other) const {
+		return id == other.id;
+	}
+	bool operator<(const CustomAttributeKey& other) const {
+		return id < other.id;
+	}
+};
+
+namespace CustomAttributeKeys {
+	extern const CustomAttributeKey RARITY;
+	extern const CustomAttributeKey COMBAT_POWER_LEVEL;
+}
+
+class ItemAttributes : private MemoryTracked<ItemAttributes, MEMORY_ITEM_ATTRIBUTES>
 {
 	public:
 		ItemAttributes() = default;
@@ -284,6 +315,68 @@ class ItemAttributes
 				boost::apply_visitor(SerializeVisitor(propWriteStream), value);
 			}
 
+			// same variant positions, integers and string lengths as varints
+			void serializeCompact(PropWriteStream& propWriteStream) const {
+				propWriteStream.write<uint8_t>(static_cast<uint8_t>(value.which()));
+				switch (value.which()) {
+					case 1: propWriteStream.writeCompactString(boost::get<std::string>(value)); break;
+					case 2: propWriteStream.writeSignedVarint(boost::get<int64_t>(value)); break;
+					case 3: propWriteStream.write<double>(boost::get<double>(value)); break;
+					case 4: propWriteStream.write<bool>(boost::get<bool>(value)); break;
+					default: break;
+				}
+			}
+
+			bool unserializeCompact(PropStream& propStream) {
+				uint8_t pos;
+				if (!propStream.read<uint8_t>(pos)) {
+					return false;
+				}
+
+				switch (pos) {
+					case 1: {
+						std::string tmp;
+						if (!propStream.readCompactString(tmp)) {
+							return false;
+						}
+						value = std::move(tmp);
+						return true;
+					}
+
+					case 2: {
+						int64_t tmp;
+						if (!propStream.readSignedVarint(tmp)) {
+							return false;
+						}
+						value = tmp;
+						return true;
+					}
+
+					case 3: {
+						double tmp;
+						if (!propStream.read<double>(tmp)) {
+							return false;
+						}
+						value = tmp;
+						return true;
+					}
+
+					case 4: {
+						bool tmp;
+						if (!propStream.read<bool>(tmp)) {
+							return false;
+						}
+						value = tmp;
+						return true;
+					}
+
+					default: {
+						value = boost::blank();
+						return false;
+					}
+				}
+			}
+
 			bool unserialize(PropStream& propStream) {
 				// This is hard-coded so it's not general, depends on the position of the variants.
 				uint8_t pos;
@@ -348,7 +441,8 @@ class ItemAttributes
 		static double emptyDouble;
 		static bool emptyBool;
 
-		typedef std::unordered_map<std::string, CustomAttribute> CustomAttributeMap;
+		// few keys per item, kept sorted in one contiguous block
+		typedef boost::container::flat_map<CustomAttributeKey, CustomAttribute> CustomAttributeMap;
 
 		struct Attribute
 		{
@@ -412,7 +506,10 @@ class ItemAttributes
 			}
 		};
 
-		std::vector<Attribute> attributes;
+		// most items carry one or two attributes, those are stored inline
+		typedef boost::container::small_vector<Attribute, 2> AttributeList;
+
+		AttributeList attributes;
 		uint32_t attributeBits = 0;
 
 		const std::string& getStrAttr(itemAttrTypes type) const;
@@ -446,23 +543,25 @@ class ItemAttributes
 
 		template<typename R>
 		void setCustomAttribute(std::string& key, R value) {
-			toLowerCaseString(key);
-			if (hasAttribute(ITEM_ATTRIBUTE_CUSTOM)) {
-				removeCustomAttribute(key);
-			} else {
-				getAttr(ITEM_ATTRIBUTE_CUSTOM).value.custom = new CustomAttributeMap();
-			}
-			getAttr(ITEM_ATTRIBUTE_CUSTOM).value.custom->emplace(key, value);
+			setCustomAttribute(CustomAttributeKey::get(key), value);
 		}
 
 		void setCustomAttribute(std::string& key, CustomAttribute& value) {
-			toLowerCaseString(key);
-			if (hasAttribute(ITEM_ATTRIBUTE_CUSTOM)) {
-				removeCustomAttribute(key);
-			} else {
-				getAttr(ITEM_ATTRIBUTE_CUSTOM).value.custom = new CustomAttributeMap();
+			setCustomAttribute(CustomAttributeKey::get(key), value);
+		}
+
+		template<typename R>
+		void setCustomAttribute(CustomAttributeKey key, R value) {
+			CustomAttribute attribute(value);
+			setCustomAttribute(key, attribute);
+		}
+
+		void setCustomAttribute(CustomAttributeKey key, CustomAttribute& value) {
+			Attribute& attr = getAttr(ITEM_ATTRIBUTE_CUSTOM);
+			if (!attr.value.custom) {
+				attr.value.custom = new CustomAttributeMap();
 			}
-			getAttr(ITEM_ATTRIBUTE_CUSTOM).value.custom->insert(std::make_pair(std::move(key), std::move(value)));
+			(*attr.value.custom)[key] = std::move(value);
 		}
 
 		const CustomAttribute* getCustomAttribute(int64_t key) {
@@ -471,8 +570,16 @@ class ItemAttributes
 		}
 
 		const CustomAttribute* getCustomAttribute(const std::string& key) {
+			CustomAttributeKey attrKey;
+			if (!CustomAttributeKey::find(key, attrKey)) {
+				return nullptr;
+			}
+			return getCustomAttribute(attrKey);
+		}
+
+		const CustomAttribute* getCustomAttribute(CustomAttributeKey key) {
 			if (const CustomAttributeMap* customAttrMap = getCustomAttributeMap()) {
-				auto it = customAttrMap->find(asLowerCaseString(key));
+				auto it = customAttrMap->find(key);
 				if (it != customAttrMap->end()) {
 					return &(it->second);
 				}
@@ -486,8 +593,16 @@ class ItemAttributes
 		}
 
 		bool removeCustomAttribute(const std::string& key) {
+			CustomAttributeKey attrKey;
+			if (!CustomAttributeKey::find(key, attrKey)) {
+				return false;
+			}
+			return removeCustomAttribute(attrKey);
+		}
+
+		bool removeCustomAttribute(CustomAttributeKey key) {
 			if (CustomAttributeMap* customAttrMap = getCustomAttributeMap()) {
-				auto it = customAttrMap->find(asLowerCaseString(key));
+				auto it = customAttrMap->find(key);
 				if (it != customAttrMap->end()) {
 					customAttrMap->erase(it);
 					return true;
@@ -499,7 +614,7 @@ class ItemAttributes
 		const static uint32_t intAttributeTypes = ITEM_ATTRIBUTE_ACTIONID | ITEM_ATTRIBUTE_UNIQUEID | ITEM_ATTRIBUTE_DATE
 			| ITEM_ATTRIBUTE_WEIGHT | ITEM_ATTRIBUTE_ATTACK | ITEM_ATTRIBUTE_DEFENSE | ITEM_ATTRIBUTE_EXTRADEFENSE
 			| ITEM_ATTRIBUTE_ARMOR | ITEM_ATTRIBUTE_HITCHANCE | ITEM_ATTRIBUTE_SHOOTRANGE | ITEM_ATTRIBUTE_OWNER
-			| ITEM_ATTRIBUTE_DURATION | ITEM_ATTRIBUTE_DECAYSTATE | ITEM_ATTRIBUTE_CORPSEOWNER | ITEM_ATTRIBUTE_CHARGES
+			| ITEM_ATTRIBUTE_DURATION | ITEM_ATTRIBUTE_DURATION_TIMESTAMP | ITEM_ATTRIBUTE_DECAYSTATE | ITEM_ATTRIBUTE_CORPSEOWNER | ITEM_ATTRIBUTE_CHARGES
 			| ITEM_ATTRIBUTE_FLUIDTYPE | ITEM_ATTRIBUTE_DOORID | ITEM_ATTRIBUTE_DECAYTO | ITEM_ATTRIBUTE_WRAPID | ITEM_ATTRIBUTE_STOREITEM
 			| ITEM_ATTRIBUTE_ATTACK_SPEED | ITEM_ATTRIBUTE_RARITY;
 		const static uint32_t stringAttributeTypes = ITEM_ATTRIBUTE_DESCRIPTION | ITEM_ATTRIBUTE_TEXT | ITEM_ATTRIBUTE_WRITER
@@ -516,7 +631,7 @@ class ItemAttributes
 			return (type & ITEM_ATTRIBUTE_CUSTOM) == type;
 		}
 
-		const std::vector<Attribute>& getList() const {
+		const AttributeList& getList() const {
 			return attributes;
 		}
 
@@ -541,6 +656,10 @@ class Item : virtual public Thing
 
 		virtual ~Item() = default;
 
+		// items and containers are recycled through lock-free free lists
+		static void* operator new(size_t size);
+		static void operator delete(void* p, size_t size);
+
 		// non-assignable
 		Item& operator=(const Item&) = delete;
 
@@ -613,8 +732,8 @@ class Item : virtual public Thing
 		}
 
 		void removeAttribute(itemAttrTypes type) {
-			if (attributes) {
-				attributes->removeAttribute(type);
+			if (hasAttribute(type)) {
+				getAttributes()->removeAttribute(type);
 			}
 		}
 		bool hasAttribute(itemAttrTypes type) const {
@@ -633,18 +752,30 @@ class Item : virtual public Thing
 			getAttributes()->setCustomAttribute(key, value);
 		}
 
+		template<typename R>
+		void setCustomAttribute(CustomAttributeKey key, R value) {
+			getAttributes()->setCustomAttribute(key, value);
+		}
+
 		const ItemAttributes::CustomAttribute* getCustomAttribute(int64_t key) {
 			if (!attributes) {
 				return nullptr;
 			}
-			return getAttributes()->getCustomAttribute(key);
+			return attributes->getCustomAttribute(key);
 		}
 
 		const ItemAttributes::CustomAttribute* getCustomAttribute(const std::string& key) {
 			if (!attributes) {
 				return nullptr;
 			}
-			return getAttributes()->getCustomAttribute(key);
+			return attributes->getCustomAttribute(key);
+		}
+
+		const ItemAttributes::CustomAttribute* getCustomAttribute(CustomAttributeKey key) {
+			if (!attributes) {
+				return nullptr;
+			}
+			return attributes->getCustomAttribute(key);
 		}
 
 		bool removeCustomAttribute(int64_t key) {
@@ -661,6 +792,13 @@ class Item : virtual public Thing
 			return getAttributes()->removeCustomAttribute(key);
 		}
 
+		bool removeCustomAttribute(CustomAttributeKey key) {
+			if (!attributes) {
+				return false;
+			}
+			return getAttributes()->removeCustomAttribute(key);
+		}
+
 		void setSpecialDescription(const std::string& desc) {
 			setStrAttr(ITEM_ATTRIBUTE_DESCRIPTION, desc);
 		}
@@ -759,22 +897,29 @@ class Item : virtual public Thing
 			return getIntAttr(ITEM_ATTRIBUTE_CORPSEOWNER);
 		}
 
-		void setDuration(int32_t time) {
-			setIntAttr(ITEM_ATTRIBUTE_DURATION, time);
-		}
-		void decreaseDuration(int32_t time) {
-			increaseIntAttr(ITEM_ATTRIBUTE_DURATION, -time);
-		}
+		void setDuration(int32_t time);
 		uint32_t getDuration() const {
 			if (!attributes) {
 				return 0;
 			}
+			// while decaying the remaining time follows from the scheduled deadline
+			if (getDecaying() == DECAYING_TRUE && hasAttribute(ITEM_ATTRIBUTE_DURATION_TIMESTAMP)) {
+				return std::max<int64_t>(0, getIntAttr(ITEM_ATTRIBUTE_DURATION_TIMESTAMP) - OTSYS_TIME());
+			}
 			return getIntAttr(ITEM_ATTRIBUTE_DURATION);
 		}
 
-		void setDecaying(ItemDecayState_t decayState) {
-			setIntAttr(ITEM_ATTRIBUTE_DECAYSTATE, decayState);
+		void setDurationTimestamp(int64_t timestamp) {
+			setIntAttr(ITEM_ATTRIBUTE_DURATION_TIMESTAMP, timestamp);
+		}
+		int64_t getDurationTimestamp() const {
+			if (!attributes) {
+				return 0;
+			}
+			return getIntAttr(ITEM_ATTRIBUTE_DURATION_TIMESTAMP);
 		}
+
+		void setDecaying(ItemDecayState_t decayState);
 		ItemDecayState_t getDecaying() const {
 			if (!attributes) {
 				return DECAYING_FALSE;
@@ -793,6 +938,8 @@ class Item : virtual public Thing
 		}
 
 		void getRarityLevel(TooltipDataContainer& tooltipData);
+		// changes whenever the tooltip of this item would change
+		uint64_t getTooltipHash() const;
 		static void getTooltipData(Item* item, uint16_t spriteId, uint16_t count, TooltipDataContainer& tooltipData);
 		static void getTooltipCombats(const ItemType& it, CombatType_t combatType, TooltipDataContainer& tooltipData);
 		static void getTooltipStats(const ItemType& it, TooltipDataContainer& tooltipData);
@@ -812,6 +959,7 @@ class Item : virtual public Thing
 		bool unserializeAttr(PropStream& propStream);
 		virtual bool unserializeItemNode(OTB::Loader&, const OTB::Node&, PropStream& propStream);
 
+		// writes the compact section, unserializeAttr also reads the fixed width tags
 		virtual void serializeAttr(PropWriteStream& propWriteStream) const;
 
 		bool isPushable() const override final {
@@ -825,7 +973,7 @@ class Item : virtual public Thing
 			return id;
 		}
 		uint16_t getClientID() const {
-			return items[id].clientId;
+			return items.getHotType(id).clientId;
 		}
 		void setID(uint16_t newid);
 
@@ -850,7 +998,7 @@ class Item : virtual public Thing
 			if (hasAttribute(ITEM_ATTRIBUTE_WEIGHT)) {
 				return getIntAttr(ITEM_ATTRIBUTE_WEIGHT);
 			}
-			return items[id].weight;
+			return items.getHotType(id).weight;
 		}
 		int32_t getAttack() const {
 			if (hasAttribute(ITEM_ATTRIBUTE_ATTACK)) {
@@ -912,38 +1060,38 @@ class Item : virtual public Thing
 
 		bool hasProperty(ITEMPROPERTY prop) const;
 		bool isBlocking() const {
-			return items[id].blockSolid;
+			return items.getHotType(id).hasFlag(ITEMFLAG_BLOCKSOLID);
 		}
 		bool isStackable() const {
-			return items[id].stackable;
+			return items.getHotType(id).hasFlag(ITEMFLAG_STACKABLE);
 		}
 		bool isAlwaysOnTop() const {
-			return items[id].alwaysOnTop;
+			return items.getHotType(id).hasFlag(ITEMFLAG_ALWAYSONTOP);
 		}
 		bool isGroundTile() const {
-			return items[id].isGroundTile();
+			return items.getHotType(id).hasFlag(ITEMFLAG_GROUND);
 		}
 		bool isMagicField() const {
-			return items[id].isMagicField();
+			return items.getHotType(id).hasFlag(ITEMFLAG_MAGICFIELD);
 		}
 		bool isMoveable() const {
-			return items[id].moveable;
+			return items.getHotType(id).hasFlag(ITEMFLAG_MOVEABLE);
 		}
 		bool isPickupable() const {
-			return items[id].pickupable;
+			return items.getHotType(id).hasFlag(ITEMFLAG_PICKUPABLE);
 		}
 		bool isUseable() const {
-			return items[id].useable;
+			return items.getHotType(id).hasFlag(ITEMFLAG_USEABLE);
 		}
 		bool isHangable() const {
-			return items[id].isHangable;
+			return items.getHotType(id).hasFlag(ITEMFLAG_HANGABLE);
 		}
 		bool isRotatable() const {
 			const ItemType& it = items[id];
 			return it.rotatable && it.rotateTo;
 		}
 		bool hasWalkStack() const {
-			return items[id].walkStack;
+			return items.getHotType(id).hasFlag(ITEMFLAG_WALKSTACK);
 		}
 
 		void setStoreItem(bool storeItem) {
@@ -953,7 +1101,7 @@ class Item : virtual public Thing
 			if (hasAttribute(ITEM_ATTRIBUTE_STOREITEM)) {
 				return getIntAttr(ITEM_ATTRIBUTE_STOREITEM) == 1;
 			}
-			return items[id].storeItem;
+			return items.getHotType(id).hasFlag(ITEMFLAG_STOREITEM);
 		}
 		const std::string& getName() const {
 			if (hasAttribute(ITEM_ATTRIBUTE_NAME)) {
@@ -1030,11 +1178,14 @@ class Item : virtual public Thing
 
 		bool hasMarketAttributes() const;
 
-		std::unique_ptr<ItemAttributes>& getAttributes() {
+		ItemAttributes* getAttributes() {
 			if (!attributes) {
-				attributes.reset(new ItemAttributes());
+				attributes = std::make_shared<ItemAttributes>();
+			} else if (attributes.use_count() > 1) {
+				// shared with a copy of this item, detach before writing
+				attributes = std::make_shared<ItemAttributes>(*attributes);
 			}
-			return attributes;
+			return attributes.get();
 		}
 
 		void incrementReferenceCounter() {
@@ -1045,6 +1196,9 @@ class Item : virtual public Thing
 				delete this;
 			}
 		}
+		uint32_t getReferenceCounter() const {
+			return referenceCounter;
+		}
 
 		Cylinder* getParent() const override {
 			return parent;
@@ -1067,8 +1221,13 @@ class Item : virtual public Thing
 
 	private:
 		std::string getWeightDescription(uint32_t weight) const;
+		bool readCompactAttr(PropStream& propStream);
+
+		// set by the parent container, fills the padding after id
+		uint32_t containerPosition = 0;
 
-		std::unique_ptr<ItemAttributes> attributes;
+		// copies of an item share their attributes until one of them is modified
+		std::shared_ptr<ItemAttributes> attributes;
 
 		uint32_t referenceCounter = 0;
 
@@ -1077,6 +1236,8 @@ class Item : virtual public Thing
 		bool loadedFromMap = false;
 
 		//Don't add variables here, use the ItemAttribute class.
+
+		friend class Container;
 };
 
 using ItemList = std::list<Item*>;
@@ -7,12 +7,50 @@
 #include "spells.h"
 #include "movement.h"
 #include "weapons.h"
+#include "rarity.h"
+#include "assetcache.h"
 
 #include "pugicast.h"
 
 extern MoveEvents* g_moveEvents;
 extern Weapons* g_weapons;
 
+namespace {
+
+// bumped whenever ItemType::serialize writes something else
+constexpr uint64_t ITEMS_CACHE_VERSION = 1;
+
+// the plain fields of an item type in the order the items cache holds them
+constexpr uint32_t ItemType::* CACHED_UINT32_FIELDS[] = {
+	&ItemType::attackSpeed, &ItemType::weight, &ItemType::levelDoor, &ItemType::decayTime, &ItemType::wieldInfo,
+	&ItemType::minReqLevel, &ItemType::minReqMagicLevel, &ItemType::charges,
+};
+constexpr int32_t ItemType::* CACHED_INT32_FIELDS[] = {
+	&ItemType::maxHitChance, &ItemType::decayTo, &ItemType::attack, &ItemType::defense, &ItemType::extraDefense,
+	&ItemType::armor, &ItemType::rarity, &ItemType::runeMagLevel, &ItemType::runeLevel,
+};
+constexpr uint16_t ItemType::* CACHED_UINT16_FIELDS[] = {
+	&ItemType::id, &ItemType::clientId, &ItemType::rotateTo, &ItemType::transformToFree, &ItemType::destroyTo,
+	&ItemType::maxTextLen, &ItemType::writeOnceItemId, &ItemType::transformEquipTo, &ItemType::transformDeEquipTo,
+	&ItemType::maxItems, &ItemType::slotPosition, &ItemType::speed, &ItemType::wareId,
+};
+constexpr uint8_t ItemType::* CACHED_UINT8_FIELDS[] = {
+	&ItemType::floorChange, &ItemType::alwaysOnTopOrder, &ItemType::lightLevel, &ItemType::lightColor, &ItemType::shootRange,
+};
+constexpr bool ItemType::* CACHED_FLAGS[] = {
+	&ItemType::stackable, &ItemType::isAnimation, &ItemType::storeItem, &ItemType::forceUse, &ItemType::forceSerialize,
+	&ItemType::hasHeight, &ItemType::walkStack, &ItemType::blockSolid, &ItemType::blockPickupable, &ItemType::blockProjectile,
+	&ItemType::blockPathFind, &ItemType::allowPickupable, &ItemType::showDuration, &ItemType::showCharges, &ItemType::showAttributes,
+	&ItemType::replaceable, &ItemType::pickupable, &ItemType::rotatable, &ItemType::useable, &ItemType::moveable,
+	&ItemType::alwaysOnTop, &ItemType::canReadText, &ItemType::canWriteText, &ItemType::isVertical, &ItemType::isHorizontal,
+	&ItemType::isHangable, &ItemType::allowDistRead, &ItemType::lookThrough, &ItemType::stopTime, &ItemType::showCount,
+};
+
+static_assert(sizeof(CACHED_FLAGS) / sizeof(CACHED_FLAGS[0]) <= 64, "the flags of an item type are cached in one word");
+static_assert(std::is_trivially_copyable<Abilities>::value, "abilities are cached raw");
+
+}
+
 const std::unordered_map<std::string, ItemParseAttributes_t> ItemParseAttributesMap = {
 	{"type", ITEM_PARSE_TYPE},
 	{"description", ITEM_PARSE_DESCRIPTION},
@@ -222,20 +260,43 @@ Items::Items()
 void Items::clear()
 {
 	items.clear();
+	hotTypes.clear();
 	clientIdToServerIdMap.clear();
+	nameIndex.clear();
 	nameToItems.clear();
 	inventory.clear();
 }
 
-bool Items::reload()
+void Items::swap(Items& other)
 {
-	clear();
-	loadFromOtb("data/items/items.otb");
+	std::swap(majorVersion, other.majorVersion);
+	std::swap(minorVersion, other.minorVersion);
+	std::swap(buildNumber, other.buildNumber);
+	nameToItems.swap(other.nameToItems);
+	items.swap(other.items);
+	hotTypes.swap(other.hotTypes);
+	nameIndex.swap(other.nameIndex);
+	inventory.swap(other.inventory);
+	std::swap(clientIdToServerIdMap, other.clientIdToServerIdMap);
+}
 
-	if (!loadFromXml()) {
+bool Items::load()
+{
+	if (!loadFromOtb("data/items/items.otb")) {
+		std::cout << "[Error - Items::load] Unable to load data/items/items.otb" << std::endl;
 		return false;
 	}
+	return loadFromXml();
+}
 
+bool Items::reload()
+{
+	Items fresh;
+	if (!fresh.load()) {
+		return false;
+	}
+
+	swap(fresh);
 	g_moveEvents->reload();
 	g_weapons->reload();
 	g_weapons->loadDefaults();
@@ -483,6 +544,21 @@ bool Items::loadFromOtb(const std::string& file)
 
 bool Items::loadFromXml()
 {
+	// the cache holds the item types once items.xml is applied to items.otb
+	std::string cachePath = AssetCache::getPath("items");
+	uint64_t sourceHash = AssetCache::HASH_SEED ^ (ITEMS_CACHE_VERSION << 32 | sizeof(Abilities) << 16 | sizeof(IntervalInfo));
+	if (!cachePath.empty()) {
+		if (!AssetCache::hashFile("data/items/items.otb", sourceHash) || !AssetCache::hashFile("data/items/items.xml", sourceHash)) {
+			cachePath.clear();
+		} else {
+			AssetCache cache;
+			if (cache.open(cachePath, sourceHash) && loadFromCache(cache.getStream())) {
+				finishLoading();
+				return true;
+			}
+		}
+	}
+
 	pugi::xml_document doc;
 	pugi::xml_parse_result result = doc.load_file("data/items/items.xml");
 	if (!result) {
@@ -516,10 +592,180 @@ bool Items::loadFromXml()
 		}
 	}
 
+	if (!cachePath.empty()) {
+		writeCache(cachePath, sourceHash);
+	}
+
+	finishLoading();
+	return true;
+}
+
+void Items::finishLoading()
+{
+	for (ItemType& type : items) {
+		buildRarityProfile(type);
+	}
+
 	buildInventoryList();
+	buildHotTypes();
+	buildNameIndex();
+}
+
+bool Items::loadFromCache(PropStream& propStream)
+{
+	uint64_t size;
+	if (!propStream.readVarint(size) || size != items.size()) {
+		return false;
+	}
+
+	// read aside, a damaged cache leaves the otb types to the xml
+	std::vector<ItemType> cached(size);
+	uint64_t types;
+	if (!propStream.readVarint(types)) {
+		return false;
+	}
+
+	for (uint64_t i = 0; i < types; ++i) {
+		uint64_t index;
+		if (!propStream.readVarint(index) || index >= size || !cached[index].unserialize(propStream)) {
+			return false;
+		}
+	}
+
+	uint64_t names;
+	if (!propStream.readVarint(names)) {
+		return false;
+	}
+
+	NameMap cachedNames;
+	cachedNames.reserve(names);
+	for (uint64_t i = 0; i < names; ++i) {
+		std::string name;
+		uint16_t id;
+		if (!propStream.readCompactString(name) || !propStream.read<uint16_t>(id)) {
+			return false;
+		}
+		cachedNames.emplace(std::move(name), id);
+	}
+
+	items.swap(cached);
+	nameToItems.swap(cachedNames);
 	return true;
 }
 
+void Items::writeCache(const std::string& path, uint64_t sourceHash) const
+{
+	PropWriteStream propWriteStream;
+	propWriteStream.writeVarint(items.size());
+
+	size_t types = std::count_if(items.begin(), items.end(), [](const ItemType& type) { return type.id != 0; });
+	propWriteStream.writeVarint(types);
+	for (size_t i = 0, size = items.size(); i < size; ++i) {
+		if (items[i].id != 0) {
+			propWriteStream.writeVarint(i);
+			items[i].serialize(propWriteStream);
+		}
+	}
+
+	propWriteStream.writeVarint(nameToItems.size());
+	for (const auto& it : nameToItems) {
+		propWriteStream.writeCompactString(it.first);
+		propWriteStream.write<uint16_t>(it.second);
+	}
+
+	AssetCache::write(path, sourceHash, propWriteStream);
+}
+
+void Items::buildNameIndex()
+{
+	nameIndex.clear();
+	nameIndex.reserve(nameToItems.size());
+	for (const auto& it : nameToItems) {
+		nameIndex.emplace_back(&it.first, it.second);
+	}
+
+	std::sort(nameIndex.begin(), nameIndex.end(), [](const std::pair<const std::string*, uint16_t>& lhs, const std::pair<const std::string*, uint16_t>& rhs) {
+		int cmp = lhs.first->compare(*rhs.first);
+		return cmp < 0 || (cmp == 0 && lhs.second < rhs.second);
+	});
+}
+
+void Items::buildHotTypes()
+{
+	hotTypes.clear();
+	hotTypes.resize(items.size());
+
+	for (size_t i = 0, size = items.size(); i < size; ++i) {
+		const ItemType& it = items[i];
+		ItemHotType& hot = hotTypes[i];
+
+		hot.weight = it.weight;
+		hot.clientId = it.clientId;
+		hot.speed = it.speed;
+		hot.group = static_cast<uint8_t>(it.group);
+		hot.type = static_cast<uint8_t>(it.type);
+		hot.alwaysOnTopOrder = it.alwaysOnTopOrder;
+		hot.floorChange = it.floorChange;
+
+		uint32_t flags = 0;
+		if (it.blockSolid) {
+			flags |= ITEMFLAG_BLOCKSOLID;
+		}
+		if (it.blockProjectile) {
+			flags |= ITEMFLAG_BLOCKPROJECTILE;
+		}
+		if (it.blockPathFind) {
+			flags |= ITEMFLAG_BLOCKPATH;
+		}
+		if (it.blockPickupable) {
+			flags |= ITEMFLAG_BLOCKPICKUPABLE;
+		}
+		if (it.hasHeight) {
+			flags |= ITEMFLAG_HASHEIGHT;
+		}
+		if (it.moveable) {
+			flags |= ITEMFLAG_MOVEABLE;
+		}
+		if (it.stackable) {
+			flags |= ITEMFLAG_STACKABLE;
+		}
+		if (it.pickupable) {
+			flags |= ITEMFLAG_PICKUPABLE;
+		}
+		if (it.useable) {
+			flags |= ITEMFLAG_USEABLE;
+		}
+		if (it.alwaysOnTop) {
+			flags |= ITEMFLAG_ALWAYSONTOP;
+		}
+		if (it.isVertical) {
+			flags |= ITEMFLAG_VERTICAL;
+		}
+		if (it.isHorizontal) {
+			flags |= ITEMFLAG_HORIZONTAL;
+		}
+		if (it.isHangable) {
+			flags |= ITEMFLAG_HANGABLE;
+		}
+		if (it.walkStack) {
+			flags |= ITEMFLAG_WALKSTACK;
+		}
+		if (it.lookThrough) {
+			flags |= ITEMFLAG_LOOKTHROUGH;
+		}
+		if (it.storeItem) {
+			flags |= ITEMFLAG_STOREITEM;
+		}
+		if (it.isGroundTile()) {
+			flags |= ITEMFLAG_GROUND;
+		}
+		if (it.isMagicField()) {
+			flags |= ITEMFLAG_MAGICFIELD;
+		}
+		hot.flags = flags;
+	}
+}
+
 void Items::buildInventoryList()
 {
 	inventory.reserve(items.size());
@@ -1484,6 +1730,129 @@ void Items::parseItemNode(const pugi::xml_node& itemNode, uint16_t id)
 	}
 }
 
+void ItemType::serialize(PropWriteStream& propWriteStream) const
+{
+	propWriteStream.write(group);
+	propWriteStream.write(type);
+	propWriteStream.write(combatType);
+	propWriteStream.write(magicEffect);
+	propWriteStream.write(bedPartnerDir);
+	propWriteStream.write(weaponType);
+	propWriteStream.write(ammoType);
+	propWriteStream.write(shootType);
+	propWriteStream.write(corpseType);
+	propWriteStream.write(fluidSource);
+	propWriteStream.write(hitChance);
+	propWriteStream.write(transformToOnUse[PLAYERSEX_FEMALE]);
+	propWriteStream.write(transformToOnUse[PLAYERSEX_MALE]);
+
+	for (auto field : CACHED_UINT32_FIELDS) {
+		propWriteStream.write(this->*field);
+	}
+	for (auto field : CACHED_INT32_FIELDS) {
+		propWriteStream.write(this->*field);
+	}
+	for (auto field : CACHED_UINT16_FIELDS) {
+		propWriteStream.write(this->*field);
+	}
+	for (auto field : CACHED_UINT8_FIELDS) {
+		propWriteStream.write(this->*field);
+	}
+
+	uint64_t flags = 0;
+	for (size_t i = 0; i < std::size(CACHED_FLAGS); ++i) {
+		if (this->*CACHED_FLAGS[i]) {
+			flags |= 1ULL << i;
+		}
+	}
+	propWriteStream.write(flags);
+
+	propWriteStream.writeCompactString(name);
+	propWriteStream.writeCompactString(article);
+	propWriteStream.writeCompactString(pluralName);
+	propWriteStream.writeCompactString(description);
+	propWriteStream.writeCompactString(runeSpellName);
+	propWriteStream.writeCompactString(vocationString);
+
+	propWriteStream.write<uint8_t>(abilities ? 1 : 0);
+	if (abilities) {
+		propWriteStream.write(*abilities);
+	}
+
+	propWriteStream.write<uint8_t>(conditionDamage ? 1 : 0);
+	if (conditionDamage) {
+		propWriteStream.write(conditionDamage->getType());
+		conditionDamage->serializeTemplate(propWriteStream);
+	}
+}
+
+bool ItemType::unserialize(PropStream& propStream)
+{
+	if (!propStream.read(group) || !propStream.read(type) || !propStream.read(combatType) || !propStream.read(magicEffect) ||
+			!propStream.read(bedPartnerDir) || !propStream.read(weaponType) || !propStream.read(ammoType) || !propStream.read(shootType) ||
+			!propStream.read(corpseType) || !propStream.read(fluidSource) || !propStream.read(hitChance) ||
+			!propStream.read(transformToOnUse[PLAYERSEX_FEMALE]) || !propStream.read(transformToOnUse[PLAYERSEX_MALE])) {
+		return false;
+	}
+
+	for (auto field : CACHED_UINT32_FIELDS) {
+		if (!propStream.read(this->*field)) {
+			return false;
+		}
+	}
+	for (auto field : CACHED_INT32_FIELDS) {
+		if (!propStream.read(this->*field)) {
+			return false;
+		}
+	}
+	for (auto field : CACHED_UINT16_FIELDS) {
+		if (!propStream.read(this->*field)) {
+			return false;
+		}
+	}
+	for (auto field : CACHED_UINT8_FIELDS) {
+		if (!propStream.read(this->*field)) {
+			return false;
+		}
+	}
+
+	uint64_t flags;
+	if (!propStream.read(flags)) {
+		return false;
+	}
+	for (size_t i = 0; i < std::size(CACHED_FLAGS); ++i) {
+		this->*CACHED_FLAGS[i] = (flags & (1ULL << i)) != 0;
+	}
+
+	if (!propStream.readCompactString(name) || !propStream.readCompactString(article) || !propStream.readCompactString(pluralName) ||
+			!propStream.readCompactString(description) || !propStream.readCompactString(runeSpellName) || !propStream.readCompactString(vocationString)) {
+		return false;
+	}
+
+	uint8_t hasAbilities;
+	if (!propStream.read(hasAbilities) || (hasAbilities != 0 && !propStream.read(getAbilities()))) {
+		return false;
+	}
+
+	uint8_t hasConditionDamage;
+	if (!propStream.read(hasConditionDamage)) {
+		return false;
+	}
+
+	if (hasConditionDamage != 0) {
+		ConditionType_t conditionType;
+		if (!propStream.read(conditionType)) {
+			return false;
+		}
+
+		conditionDamage.reset(new ConditionDamage(CONDITIONID_COMBAT, conditionType));
+		if (!conditionDamage->unserializeTemplate(propStream)) {
+			return false;
+		}
+	}
+	return true;
+}
+
 ItemType& Items::getItemType(size_t id)
 {
 	if (id < items.size()) {
@@ -1519,3 +1888,21 @@ uint16_t Items::getItemIdByName(const std::string& name)
 
 	return result->second;
 }
+
+std::vector<uint16_t> Items::getItemIdsByPrefix(const std::string& prefix, size_t limit/* = 0*/) const
+{
+	std::vector<uint16_t> ids;
+
+	std::string lowerPrefix = asLowerCaseString(prefix);
+	auto it = std::lower_bound(nameIndex.begin(), nameIndex.end(), lowerPrefix, [](const std::pair<const std::string*, uint16_t>& entry, const std::string& value) {
+		return entry.first->compare(value) < 0;
+	});
+
+	for (auto end = nameIndex.end(); it != end && it->first->compare(0, lowerPrefix.size(), lowerPrefix) == 0; ++it) {
+		ids.push_back(it->second);
+		if (ids.size() == limit) {
+			break;
+		}
+	}
+	return ids;
+}
@@ -283,6 +283,11 @@ class ItemType
 			return *abilities;
 		}
 
+		// every field but the rarity profile, for the items cache; a field
+		// added below is written here too and ITEMS_CACHE_VERSION bumped
+		void serialize(PropWriteStream& propWriteStream) const;
+		bool unserialize(PropStream& propStream);
+
 		std::string getPluralName() const {
 			if (!pluralName.empty()) {
 				return pluralName;
@@ -396,6 +401,49 @@ class ItemType
 		bool lookThrough = false;
 		bool stopTime = false;
 		bool showCount = true;
+
+		// rarity profile, filled once the type is loaded
+		bool rarityEquipment = false;
+		bool rarityElements = false;
+};
+
+enum ItemHotFlags_t : uint32_t {
+	ITEMFLAG_BLOCKSOLID = 1 << 0,
+	ITEMFLAG_BLOCKPROJECTILE = 1 << 1,
+	ITEMFLAG_BLOCKPATH = 1 << 2,
+	ITEMFLAG_BLOCKPICKUPABLE = 1 << 3,
+	ITEMFLAG_HASHEIGHT = 1 << 4,
+	ITEMFLAG_MOVEABLE = 1 << 5,
+	ITEMFLAG_STACKABLE = 1 << 6,
+	ITEMFLAG_PICKUPABLE = 1 << 7,
+	ITEMFLAG_USEABLE = 1 << 8,
+	ITEMFLAG_ALWAYSONTOP = 1 << 9,
+	ITEMFLAG_VERTICAL = 1 << 10,
+	ITEMFLAG_HORIZONTAL = 1 << 11,
+	ITEMFLAG_HANGABLE = 1 << 12,
+	ITEMFLAG_WALKSTACK = 1 << 13,
+	ITEMFLAG_LOOKTHROUGH = 1 << 14,
+	ITEMFLAG_STOREITEM = 1 << 15,
+	ITEMFLAG_GROUND = 1 << 16,
+	ITEMFLAG_MAGICFIELD = 1 << 17,
+};
+
+// compact copy of the item type fields read on hot paths (tile, map and
+// container code), 16 bytes so a lookup does not drag in the whole ItemType.
+// only fields that scripts cannot change after loading belong here
+struct ItemHotType {
+	uint32_t flags = 0;
+	uint32_t weight = 0;
+	uint16_t clientId = 0;
+	uint16_t speed = 0;
+	uint8_t group = ITEM_GROUP_NONE;
+	uint8_t type = ITEM_TYPE_NONE;
+	uint8_t alwaysOnTopOrder = 0;
+	uint8_t floorChange = 0;
+
+	bool hasFlag(ItemHotFlags_t flag) const {
+		return (flags & flag) != 0;
+	}
 };
 
 class Items
@@ -412,7 +460,11 @@ class Items
 
 		bool reload();
 		void clear();
+		// exchanges every table with other, the item types of both keep their addresses
+		void swap(Items& other);
 
+		// otb and xml into an empty instance, touches no other global and may run on any thread
+		bool load();
 		bool loadFromOtb(const std::string& file);
 
 		const ItemType& operator[](size_t id) const {
@@ -422,16 +474,29 @@ class Items
 		ItemType& getItemType(size_t id);
 		const ItemType& getItemIdByClientId(uint16_t spriteId) const;
 
+		const ItemHotType& getHotType(size_t id) const {
+			if (id < hotTypes.size()) {
+				return hotTypes[id];
+			}
+			return hotTypes.front();
+		}
+
 		uint16_t getItemIdByName(const std::string& name);
+		// ids of the items whose name starts with prefix (case insensitive), sorted by name
+		std::vector<uint16_t> getItemIdsByPrefix(const std::string& prefix, size_t limit = 0) const;
 
 		uint32_t majorVersion = 0;
 		uint32_t minorVersion = 0;
 		uint32_t buildNumber = 0;
 
+		// reads what items.xml adds to the loaded otb from the items cache
+		// when both files are unchanged, parses and caches it otherwise
 		bool loadFromXml();
 		void parseItemNode(const pugi::xml_node& itemNode, uint16_t id);
 
 		void buildInventoryList();
+		void buildHotTypes();
+		void buildNameIndex();
 		const InventoryVector& getInventory() const {
 			return inventory;
 		}
@@ -443,7 +508,14 @@ class Items
 		NameMap nameToItems;
 
 	private:
+		bool loadFromCache(PropStream& propStream);
+		void writeCache(const std::string& path, uint64_t sourceHash) const;
+		void finishLoading();
+
 		std::vector<ItemType> items;
+		std::vector<ItemHotType> hotTypes;
+		// keys of nameToItems in sorted order, built once the items are loaded
+		std::vector<std::pair<const std::string*, uint16_t>> nameIndex;
 		InventoryVector inventory;
 		class ClientIdToServerIdMap
 		{
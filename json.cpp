@@ -0,0 +1,289 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#include "otpch.h"
+
+#include "json.h"
+
+namespace {
+
+// deeper documents are refused, the parser and the lua conversion recurse per level
+constexpr uint32_t MAX_JSON_DEPTH = 64;
+
+class JsonParser
+{
+	public:
+		explicit JsonParser(std::string_view text) : text(text) {}
+
+		bool parseDocument(JsonValue& value) {
+			if (!parseValue(value, 0)) {
+				return false;
+			}
+			skipWhitespace();
+			return pos == text.size();
+		}
+
+	private:
+		bool parseValue(JsonValue& value, uint32_t depth) {
+			skipWhitespace();
+			if (pos == text.size()) {
+				return false;
+			}
+
+			switch (text[pos]) {
+				case '{':
+					return parseObject(value, depth + 1);
+				case '[':
+					return parseArray(value, depth + 1);
+				case '"':
+					value.type = JSON_STRING;
+					return parseString(value.string);
+				case 't':
+					value.type = JSON_BOOLEAN;
+					value.boolean = true;
+					return parseLiteral("true");
+				case 'f':
+					value.type = JSON_BOOLEAN;
+					value.boolean = false;
+					return parseLiteral("false");
+				case 'n':
+					value.type = JSON_NULL;
+					return parseLiteral("null");
+				default:
+					value.type = JSON_NUMBER;
+					return parseNumber(value.number);
+			}
+		}
+
+		bool parseObject(JsonValue& value, uint32_t depth) {
+			if (depth > MAX_JSON_DEPTH) {
+				return false;
+			}
+
+			value.type = JSON_OBJECT;
+			++pos;
+			skipWhitespace();
+			if (consume('}')) {
+				return true;
+			}
+
+			do {
+				skipWhitespace();
+				if (pos == text.size() || text[pos] != '"') {
+					return false;
+				}
+
+				value.keys.emplace_back();
+				if (!parseString(value.keys.back())) {
+					return false;
+				}
+
+				skipWhitespace();
+				if (!consume(':')) {
+					return false;
+				}
+
+				value.values.emplace_back();
+				if (!parseValue(value.values.back(), depth)) {
+					return false;
+				}
+				skipWhitespace();
+			} while (consume(','));
+			return consume('}');
+		}
+
+		bool parseArray(JsonValue& value, uint32_t depth) {
+			if (depth > MAX_JSON_DEPTH) {
+				return false;
+			}
+
+			value.type = JSON_ARRAY;
+			++pos;
+			skipWhitespace();
+			if (consume(']')) {
+				return true;
+			}
+
+			do {
+				value.values.emplace_back();
+				if (!parseValue(value.values.back(), depth)) {
+					return false;
+				}
+				skipWhitespace();
+			} while (consume(','));
+			return consume(']');
+		}
+
+		bool parseString(std::string& out) {
+			++pos;
+			while (pos < text.size()) {
+				// copy the run up to the next quote or escape at once
+				size_t end = pos;
+				while (end < text.size() && text[end] != '"' && text[end] != '\\') {
+					if (static_cast<uint8_t>(text[end]) < 0x20) {
+						return false;
+					}
+					++end;
+				}
+				out.append(text.data() + pos, end - pos);
+				pos = end;
+
+				if (pos == text.size()) {
+					return false;
+				} else if (text[pos] == '"') {
+					++pos;
+					return true;
+				}
+
+				if (++pos == text.size()) {
+					return false;
+				}
+
+				switch (text[pos++]) {
+					case '"': out.push_back('"'); break;
+					case '\\': out.push_back('\\'); break;
+					case '/': out.push_back('/'); break;
+					case 'b': out.push_back('\b'); break;
+					case 'f': out.push_back('\f'); break;
+					case 'n': out.push_back('\n'); break;
+					case 'r': out.push_back('\r'); break;
+					case 't': out.push_back('\t'); break;
+					case 'u': {
+						uint32_t codePoint;
+						if (!parseHex(codePoint)) {
+							return false;
+						}
+
+						// a high surrogate must be followed by its low half
+						if (codePoint >= 0xD800 && codePoint <= 0xDBFF) {
+							uint32_t low;
+							if (!consume('\\') || !consume('u') || !parseHex(low) || low < 0xDC00 || low > 0xDFFF) {
+								return false;
+							}
+							codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+						} else if (codePoint >= 0xDC00 && codePoint <= 0xDFFF) {
+							return false;
+						}
+						appendUtf8(out, codePoint);
+						break;
+					}
+					default:
+						return false;
+				}
+			}
+			return false;
+		}
+
+		bool parseHex(uint32_t& value) {
+			if (text.size() - pos < 4) {
+				return false;
+			}
+
+			value = 0;
+			for (size_t i = 0; i < 4; ++i) {
+				char c = text[pos++];
+				value <<= 4;
+				if (c >= '0' && c <= '9') {
+					value |= c - '0';
+				} else if (c >= 'a' && c <= 'f') {
+					value |= c - 'a' + 10;
+				} else if (c >= 'A' && c <= 'F') {
+					value |= c - 'A' + 10;
+				} else {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		static void appendUtf8(std::string& out, uint32_t codePoint) {
+			if (codePoint < 0x80) {
+				out.push_back(static_cast<char>(codePoint));
+			} else if (codePoint < 0x800) {
+				out.push_back(static_cast<char>(0xC0 | (codePoint >> 6)));
+				out.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+			} else if (codePoint < 0x10000) {
+				out.push_back(static_cast<char>(0xE0 | (codePoint >> 12)));
+				out.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+				out.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+			} else {
+				out.push_back(static_cast<char>(0xF0 | (codePoint >> 18)));
+				out.push_back(static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F)));
+				out.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+				out.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+			}
+		}
+
+		bool parseNumber(double& value) {
+			// check the grammar first, strtod alone accepts hex, inf and nan
+			size_t start = pos;
+			consume('-');
+			if (consume('0')) {
+				// no leading zeros
+			} else if (!skipDigits()) {
+				return false;
+			}
+
+			if (consume('.') && !skipDigits()) {
+				return false;
+			}
+
+			if (consume('e') || consume('E')) {
+				if (!consume('+')) {
+					consume('-');
+				}
+				if (!skipDigits()) {
+					return false;
+				}
+			}
+
+			std::string number(text.data() + start, pos - start);
+			value = std::strtod(number.c_str(), nullptr);
+			return true;
+		}
+
+		bool parseLiteral(std::string_view literal) {
+			if (text.compare(pos, literal.size(), literal) != 0) {
+				return false;
+			}
+			pos += literal.size();
+			return true;
+		}
+
+		bool skipDigits() {
+			size_t start = pos;
+			while (pos < text.size() && text[pos] >= '0' && text[pos] <= '9') {
+				++pos;
+			}
+			return pos != start;
+		}
+
+		void skipWhitespace() {
+			while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' || text[pos] == '\r')) {
+				++pos;
+			}
+		}
+
+		bool consume(char c) {
+			if (pos < text.size() && text[pos] == c) {
+				++pos;
+				return true;
+			}
+			return false;
+		}
+
+		std::string_view text;
+		size_t pos = 0;
+};
+
+}
+
+bool JsonValue::parse(std::string_view text, JsonValue& value)
+{
+	JsonParser parser(text);
+	if (!parser.parseDocument(value)) {
+		value = JsonValue();
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,36 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#ifndef FS_JSON_H_8C2F4A6E1D3B4F7A9E5C0B8D2A6F1E3C
+#define FS_JSON_H_8C2F4A6E1D3B4F7A9E5C0B8D2A6F1E3C
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum JsonType_t : uint8_t {
+	JSON_NULL,
+	JSON_BOOLEAN,
+	JSON_NUMBER,
+	JSON_STRING,
+	JSON_ARRAY,
+	JSON_OBJECT,
+};
+
+// Decoded JSON document, built where a payload is received so the game thread
+// only walks the tree. Array elements and object values are both in values,
+// objects keep the member names in keys at the same indexes.
+struct JsonValue
+{
+	// false for malformed or too deeply nested text, value is left as null then
+	static bool parse(std::string_view text, JsonValue& value);
+
+	std::vector<JsonValue> values;
+	std::vector<std::string> keys;
+	std::string string;
+	double number = 0;
+	bool boolean = false;
+	JsonType_t type = JSON_NULL;
+};
+
+#endif
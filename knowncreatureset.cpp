@@ -0,0 +1,111 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#include "otpch.h"
+
+#include "knowncreatureset.h"
+
+KnownCreatureSet::KnownCreatureSet()
+{
+	table.fill(NONE);
+}
+
+bool KnownCreatureSet::insert(uint32_t id, uint32_t& removed, const std::function<bool(uint32_t)>& canEvict)
+{
+	uint16_t bucket = find(id);
+	if (table[bucket] != NONE) {
+		uint16_t slot = table[bucket];
+		if (slot != head) {
+			unlink(slot);
+			pushFront(slot);
+		}
+		return true;
+	}
+
+	removed = 0;
+
+	uint16_t slot;
+	if (count < CAPACITY) {
+		// slots are handed out in order and only ever reused by eviction
+		slot = count++;
+	} else {
+		// creatures still on screen are moved to the front as they are looked
+		// at, the next eviction starts past them
+		uint16_t victim = tail;
+		for (uint16_t scanned = 0; scanned < EVICTION_SCAN && !canEvict(slots[victim].id); ++scanned) {
+			unlink(victim);
+			pushFront(victim);
+			victim = tail;
+		}
+
+		removed = slots[victim].id;
+		erase(find(removed));
+		slot = victim;
+		// erasing moved buckets around, the free one may be another now
+		bucket = find(id);
+	}
+
+	slots[slot].id = id;
+	pushFront(slot);
+	table[bucket] = slot;
+	return false;
+}
+
+uint16_t KnownCreatureSet::find(uint32_t id) const
+{
+	// the table is never more than a third full, an empty bucket always ends the probe
+	uint16_t bucket = hash(id);
+	while (table[bucket] != NONE && slots[table[bucket]].id != id) {
+		bucket = (bucket + 1) & (TABLE_SIZE - 1);
+	}
+	return bucket;
+}
+
+void KnownCreatureSet::erase(uint16_t bucket)
+{
+	unlink(table[bucket]);
+
+	// shift the rest of the probe run back so lookups never cross a hole
+	uint16_t hole = bucket;
+	uint16_t next = (hole + 1) & (TABLE_SIZE - 1);
+	while (table[next] != NONE) {
+		uint16_t home = hash(slots[table[next]].id);
+		if (((next - home) & (TABLE_SIZE - 1)) >= ((next - hole) & (TABLE_SIZE - 1))) {
+			table[hole] = table[next];
+			hole = next;
+		}
+		next = (next + 1) & (TABLE_SIZE - 1);
+	}
+	table[hole] = NONE;
+}
+
+void KnownCreatureSet::unlink(uint16_t slot)
+{
+	Slot& entry = slots[slot];
+	if (entry.prev != NONE) {
+		slots[entry.prev].next = entry.next;
+	} else {
+		head = entry.next;
+	}
+
+	if (entry.next != NONE) {
+		slots[entry.next].prev = entry.prev;
+	} else {
+		tail = entry.prev;
+	}
+	entry.prev = NONE;
+	entry.next = NONE;
+}
+
+void KnownCreatureSet::pushFront(uint16_t slot)
+{
+	Slot& entry = slots[slot];
+	entry.prev = NONE;
+	entry.next = head;
+	if (head != NONE) {
+		slots[head].prev = slot;
+	} else {
+		tail = slot;
+	}
+	head = slot;
+}
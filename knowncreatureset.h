@@ -0,0 +1,64 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#ifndef FS_KNOWNCREATURESET_H_5B0E7C2A94D34F6E8A1D3C6F0B2E9A47
+#define FS_KNOWNCREATURESET_H_5B0E7C2A94D34F6E8A1D3C6F0B2E9A47
+
+#include <array>
+#include <functional>
+
+// Ids of the creatures a client was sent in full, at most CAPACITY of them.
+// An open-addressing table finds the slot of an id and the slots form a list
+// from the most to the least recently sent, so lookups and evictions take the
+// same few steps however crowded the screen is.
+class KnownCreatureSet
+{
+	public:
+		static constexpr uint16_t CAPACITY = 1300;
+
+		KnownCreatureSet();
+
+		// non-copyable
+		KnownCreatureSet(const KnownCreatureSet&) = delete;
+		KnownCreatureSet& operator=(const KnownCreatureSet&) = delete;
+
+		// true if the id was known already, it is the most recent one either
+		// way; a new id in a full set evicts a least recent id canEvict accepts,
+		// or the least recent one, and removed is that id, otherwise 0
+		bool insert(uint32_t id, uint32_t& removed, const std::function<bool(uint32_t)>& canEvict);
+
+		size_t size() const {
+			return count;
+		}
+
+	private:
+		// slots are looked at from the least recent end before giving up
+		static constexpr uint16_t EVICTION_SCAN = 32;
+		// a power of two above three times the capacity keeps the probes short
+		static constexpr uint16_t TABLE_SIZE = 4096;
+		static constexpr uint16_t NONE = 0xFFFF;
+
+		struct Slot {
+			uint32_t id = 0;
+			uint16_t prev = NONE;
+			uint16_t next = NONE;
+		};
+
+		static uint16_t hash(uint32_t id) {
+			return static_cast<uint16_t>((id * 2654435769u) >> 20);
+		}
+
+		uint16_t find(uint32_t id) const;
+		void erase(uint16_t bucket);
+		void unlink(uint16_t slot);
+		void pushFront(uint16_t slot);
+
+		// slot index of each bucket, NONE when empty
+		std::array<uint16_t, TABLE_SIZE> table;
+		std::array<Slot, CAPACITY> slots;
+		uint16_t head = NONE;
+		uint16_t tail = NONE;
+		uint16_t count = 0;
+};
+
+#endif
@@ -0,0 +1,706 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#include "otpch.h"
+
+#include "botclient.h"
+#include "networkmessage.h"
+#include "rsa.h"
+
+#include <fmt/format.h>
+#include <zlib.h>
+
+namespace {
+
+constexpr size_t RSA_BLOCK_SIZE = 128;
+
+// replies that are not answered in time are not waited for any longer
+constexpr auto REPLY_TIMEOUT = std::chrono::seconds(5);
+
+class PacketWriter
+{
+	public:
+		void addByte(uint8_t value) {
+			buffer.push_back(value);
+		}
+
+		template<typename T>
+		void add(T value) {
+			const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+			buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+		}
+
+		void addString(const std::string& value) {
+			add<uint16_t>(value.size());
+			buffer.insert(buffer.end(), value.begin(), value.end());
+		}
+
+		void addBytes(const std::vector<uint8_t>& bytes) {
+			buffer.insert(buffer.end(), bytes.begin(), bytes.end());
+		}
+
+		// the block is padded to the key size and encrypted with the public key
+		void addRSABlock(PacketWriter& block, const RSA& rsa) {
+			block.buffer.resize(RSA_BLOCK_SIZE);
+			rsa.encrypt(reinterpret_cast<char*>(block.buffer.data()));
+			addBytes(block.buffer);
+		}
+
+		std::vector<uint8_t>& getBuffer() {
+			return buffer;
+		}
+
+	private:
+		std::vector<uint8_t> buffer;
+};
+
+class PacketReader
+{
+	public:
+		PacketReader(const uint8_t* data, size_t length) : data(data), length(length) {}
+
+		uint8_t getByte() {
+			if (!canRead(1)) {
+				return 0;
+			}
+			return data[position++];
+		}
+
+		template<typename T>
+		T get() {
+			if (!canRead(sizeof(T))) {
+				return 0;
+			}
+
+			T v;
+			memcpy(&v, data + position, sizeof(T));
+			position += sizeof(T);
+			return v;
+		}
+
+		std::string getString() {
+			uint16_t stringLength = get<uint16_t>();
+			if (!canRead(stringLength)) {
+				return {};
+			}
+
+			std::string value(reinterpret_cast<const char*>(data + position), stringLength);
+			position += stringLength;
+			return value;
+		}
+
+		void skipBytes(size_t count) {
+			if (canRead(count)) {
+				position += count;
+			}
+		}
+
+		bool isOverrun() const {
+			return overrun;
+		}
+
+		bool atEnd() const {
+			return position >= length;
+		}
+
+	private:
+		bool canRead(size_t size) {
+			if (position + size > length) {
+				overrun = true;
+				return false;
+			}
+			return true;
+		}
+
+		const uint8_t* data;
+		size_t length;
+		size_t position = 0;
+		bool overrun = false;
+};
+
+// first messages are sent in the clear, only their rsa blocks are encrypted
+std::vector<uint8_t> makePlainFrame(const std::vector<uint8_t>& body)
+{
+	PacketWriter frame;
+	frame.add<uint16_t>(body.size() + sizeof(uint32_t));
+	frame.add<uint32_t>(adler32(1, body.data(), body.size()));
+	frame.addBytes(body);
+	return std::move(frame.getBuffer());
+}
+
+// size of the server opcodes that can be stepped over without knowing the
+// item and creature data, 0 for everything else
+size_t getFixedOpcodeSize(uint8_t opcode)
+{
+	switch (opcode) {
+		case 0x0A: // pending state
+		case 0x0F: // enter world
+		case 0x1D: // ping
+		case 0x1E: // ping back
+			return 1;
+		case 0xB5: // cancel walk
+			return 2;
+		case 0x8C: // creature health
+			return 6;
+		case 0x6D: // creature move
+			return 11;
+		default:
+			return 0;
+	}
+}
+
+}
+
+std::string LatencyStats::getSummary(const char* name) const
+{
+	if (samples.empty()) {
+		return fmt::format("{:s}: no samples", name);
+	}
+
+	std::vector<int64_t> sorted = samples;
+	std::sort(sorted.begin(), sorted.end());
+
+	auto getPercentile = [&sorted](double quantile) {
+		return sorted[std::min<size_t>(sorted.size() - 1, quantile * sorted.size())] / 1000.;
+	};
+
+	int64_t total = 0;
+	for (int64_t sample : sorted) {
+		total += sample;
+	}
+
+	return fmt::format("{:s}: {:d} samples, avg {:.2f} ms, p50 {:.2f} ms, p90 {:.2f} ms, p99 {:.2f} ms, max {:.2f} ms",
+	                   name, sorted.size(), total / 1000. / sorted.size(), getPercentile(0.5), getPercentile(0.9), getPercentile(0.99), sorted.back() / 1000.);
+}
+
+BotClient::BotClient(boost::asio::io_context& io, const LoadTestOptions& options, LoadTestStats& stats, const RSA& rsa, uint32_t index) :
+	io(io), socket(io), actionTimer(io), pingTimer(io), options(options), stats(stats), rsa(rsa), generator(std::random_device{}()), index(index)
+{
+	for (uint32_t& part : key) {
+		part = generator();
+	}
+	roundKeys = xtea::expand_key(key);
+
+	accountName = options.accountPrefix + std::to_string(options.firstAccount + index);
+
+	if (index == 0 && !options.recordFile.empty()) {
+		recording.open(options.recordFile, std::ios::binary | std::ios::trunc);
+		if (!recording.is_open()) {
+			std::cout << "[Warning - BotClient::BotClient] Cannot write the recording to " << options.recordFile << '.' << std::endl;
+		}
+	}
+}
+
+void BotClient::start()
+{
+	boost::system::error_code error;
+	boost::asio::ip::tcp::resolver resolver(io);
+	auto endpoints = resolver.resolve(options.host, std::to_string(options.loginPort), error);
+	if (error) {
+		fail("cannot resolve the login server: " + error.message());
+		return;
+	}
+
+	auto self = shared_from_this();
+	boost::asio::async_connect(socket, endpoints, [self](const boost::system::error_code& error, const boost::asio::ip::tcp::endpoint&) {
+		if (self->stopped) {
+			return;
+		} else if (error) {
+			self->fail("cannot connect to the login server: " + error.message());
+			return;
+		}
+
+		self->sendLogin();
+	});
+}
+
+void BotClient::stop()
+{
+	if (stopped) {
+		return;
+	}
+
+	stopped = true;
+	actionTimer.cancel();
+	pingTimer.cancel();
+
+	boost::system::error_code error;
+	socket.close(error);
+
+	if (playerId != 0) {
+		--stats.online;
+		auto it = std::find(stats.playerIds.begin(), stats.playerIds.end(), playerId);
+		if (it != stats.playerIds.end()) {
+			*it = stats.playerIds.back();
+			stats.playerIds.pop_back();
+		}
+	}
+}
+
+void BotClient::fail(const std::string& reason)
+{
+	std::cout << "[Bot " << accountName << "] " << reason << std::endl;
+	++stats.failed;
+	stop();
+}
+
+void BotClient::readPacket(PacketHandler handler)
+{
+	auto self = shared_from_this();
+	boost::asio::async_read(socket, boost::asio::buffer(header), [self, handler](const boost::system::error_code& error, size_t) {
+		if (self->stopped) {
+			return;
+		} else if (error) {
+			self->fail("connection lost: " + error.message());
+			return;
+		}
+
+		self->body.resize(self->header[0] | self->header[1] << 8);
+		boost::asio::async_read(self->socket, boost::asio::buffer(self->body), [self, handler](const boost::system::error_code& error, size_t) {
+			if (self->stopped) {
+				return;
+			} else if (error) {
+				self->fail("connection lost: " + error.message());
+				return;
+			}
+
+			((*self).*handler)(self->body.data(), self->body.size());
+		});
+	});
+}
+
+void BotClient::sendFrame(std::vector<uint8_t> frame)
+{
+	outputQueue.push_back(std::move(frame));
+	if (outputQueue.size() == 1) {
+		sendNextFrame();
+	}
+}
+
+void BotClient::sendNextFrame()
+{
+	auto self = shared_from_this();
+	boost::asio::async_write(socket, boost::asio::buffer(outputQueue.front()), [self](const boost::system::error_code& error, size_t) {
+		if (self->stopped) {
+			return;
+		} else if (error) {
+			self->fail("send failed: " + error.message());
+			return;
+		}
+
+		self->outputQueue.pop_front();
+		if (!self->outputQueue.empty()) {
+			self->sendNextFrame();
+		}
+	});
+}
+
+void BotClient::sendPayload(const std::vector<uint8_t>& payload)
+{
+	// u16 inner length and the payload, padded to the xtea block size
+	size_t innerLength = (sizeof(uint16_t) + payload.size() + 7) & ~static_cast<size_t>(7);
+
+	std::vector<uint8_t> frame(NetworkMessage::HEADER_LENGTH + NetworkMessage::CHECKSUM_LENGTH + innerLength);
+	uint8_t* inner = frame.data() + NetworkMessage::HEADER_LENGTH + NetworkMessage::CHECKSUM_LENGTH;
+
+	uint16_t payloadLength = payload.size();
+	memcpy(inner, &payloadLength, sizeof(payloadLength));
+	memcpy(inner + sizeof(payloadLength), payload.data(), payload.size());
+	xtea::encrypt(inner, innerLength, roundKeys);
+
+	uint16_t frameLength = NetworkMessage::CHECKSUM_LENGTH + innerLength;
+	uint32_t checksum = adler32(1, inner, innerLength);
+	memcpy(frame.data(), &frameLength, sizeof(frameLength));
+	memcpy(frame.data() + NetworkMessage::HEADER_LENGTH, &checksum, sizeof(checksum));
+
+	++stats.packetsSent;
+	sendFrame(std::move(frame));
+}
+
+bool BotClient::decryptBody(uint8_t* body, size_t length, const uint8_t*& payload, size_t& payloadLength) const
+{
+	if (length < NetworkMessage::CHECKSUM_LENGTH + NetworkMessage::XTEA_MULTIPLE || ((length - NetworkMessage::CHECKSUM_LENGTH) & 7) != 0) {
+		return false;
+	}
+
+	uint8_t* inner = body + NetworkMessage::CHECKSUM_LENGTH;
+	size_t innerLength = length - NetworkMessage::CHECKSUM_LENGTH;
+	xtea::decrypt(inner, innerLength, roundKeys);
+
+	payloadLength = inner[0] | inner[1] << 8;
+	if (payloadLength + sizeof(uint16_t) > innerLength) {
+		return false;
+	}
+
+	payload = inner + sizeof(uint16_t);
+	return true;
+}
+
+void BotClient::sendLogin()
+{
+	PacketWriter out;
+	out.addByte(0x01); // login protocol
+	out.add<uint16_t>(CLIENTOS_WINDOWS);
+	out.add<uint16_t>(CLIENT_VERSION_MAX);
+	out.add<uint32_t>(CLIENT_VERSION_MAX);
+	out.add<uint32_t>(0); // dat signature
+	out.add<uint32_t>(0); // spr signature
+	out.add<uint32_t>(0); // pic signature
+	out.addByte(0);
+
+	PacketWriter credentials;
+	credentials.addByte(0);
+	for (uint32_t part : key) {
+		credentials.add<uint32_t>(part);
+	}
+	credentials.addString(accountName);
+	credentials.addString(options.password);
+	out.addRSABlock(credentials, rsa);
+
+	PacketWriter token;
+	token.addByte(0);
+	token.addString(""); // authenticator token
+	token.addByte(0); // stay logged in
+	out.addRSABlock(token, rsa);
+
+	sendFrame(makePlainFrame(out.getBuffer()));
+	readPacket(&BotClient::parseLoginResponse);
+}
+
+void BotClient::parseLoginResponse(uint8_t* body, size_t length)
+{
+	const uint8_t* payload;
+	size_t payloadLength;
+	if (!decryptBody(body, length, payload, payloadLength)) {
+		fail("malformed login server response");
+		return;
+	}
+
+	uint16_t gamePort = 0;
+
+	PacketReader msg(payload, payloadLength);
+	while (!msg.atEnd() && !msg.isOverrun() && characterName.empty()) {
+		switch (msg.getByte()) {
+			case 0x0A:
+			case 0x0B:
+				fail("login refused: " + msg.getString());
+				return;
+
+			case 0x0C:
+				msg.skipBytes(1);
+				break;
+
+			case 0x0D:
+				fail("login refused: authenticator token required");
+				return;
+
+			case 0x14:
+				msg.getString(); // motd
+				break;
+
+			case 0x28:
+				sessionKey = msg.getString();
+				break;
+
+			case 0x64: {
+				uint8_t worlds = msg.getByte();
+				for (uint8_t i = 0; i < worlds; ++i) {
+					msg.skipBytes(1); // world id
+					msg.getString(); // name
+					msg.getString(); // ip, the bots stay on the host they were given
+					gamePort = msg.get<uint16_t>();
+					msg.skipBytes(1); // preview
+				}
+
+				if (msg.getByte() == 0) {
+					fail("the account has no characters");
+					return;
+				}
+
+				msg.skipBytes(1); // world id
+				characterName = msg.getString();
+				break;
+			}
+
+			default:
+				fail("unexpected login server response");
+				return;
+		}
+	}
+
+	if (msg.isOverrun() || sessionKey.empty() || characterName.empty() || gamePort == 0) {
+		fail("incomplete character list");
+		return;
+	}
+
+	boost::system::error_code error;
+	socket.close(error);
+	connectGame(gamePort);
+}
+
+void BotClient::connectGame(uint16_t port)
+{
+	boost::system::error_code error;
+	boost::asio::ip::tcp::resolver resolver(io);
+	auto endpoints = resolver.resolve(options.host, std::to_string(port), error);
+	if (error) {
+		fail("cannot resolve the game server: " + error.message());
+		return;
+	}
+
+	auto self = shared_from_this();
+	boost::asio::async_connect(socket, endpoints, [self](const boost::system::error_code& error, const boost::asio::ip::tcp::endpoint&) {
+		if (self->stopped) {
+			return;
+		} else if (error) {
+			self->fail("cannot connect to the game server: " + error.message());
+			return;
+		}
+
+		// the game server sends its challenge first
+		self->readPacket(&BotClient::parseChallenge);
+	});
+}
+
+void BotClient::parseChallenge(uint8_t* body, size_t length)
+{
+	// checksum, u16 length, 0x1F, u32 timestamp, u8 random number
+	PacketReader msg(body, length);
+	msg.skipBytes(NetworkMessage::CHECKSUM_LENGTH + sizeof(uint16_t));
+	if (msg.getByte() != 0x1F) {
+		fail("unexpected game server challenge");
+		return;
+	}
+
+	uint32_t timestamp = msg.get<uint32_t>();
+	uint8_t randomNumber = msg.getByte();
+	if (msg.isOverrun()) {
+		fail("truncated game server challenge");
+		return;
+	}
+
+	PacketWriter out;
+	out.addByte(0x0A); // game protocol
+	out.add<uint16_t>(CLIENTOS_WINDOWS);
+	out.add<uint16_t>(CLIENT_VERSION_MAX);
+	out.add<uint32_t>(CLIENT_VERSION_MAX);
+	out.addByte(0); // client type
+	out.add<uint16_t>(0); // dat revision
+
+	PacketWriter login;
+	login.addByte(0);
+	for (uint32_t part : key) {
+		login.add<uint32_t>(part);
+	}
+	login.addByte(0); // gamemaster flag
+	login.addString(sessionKey);
+	login.addString(characterName);
+	login.add<uint32_t>(timestamp);
+	login.addByte(randomNumber);
+	out.addRSABlock(login, rsa);
+
+	sendFrame(makePlainFrame(out.getBuffer()));
+	readPacket(&BotClient::parseGamePacket);
+}
+
+void BotClient::parseGamePacket(uint8_t* body, size_t length)
+{
+	const uint8_t* payload;
+	size_t payloadLength;
+	if (!decryptBody(body, length, payload, payloadLength)) {
+		fail("malformed game packet");
+		return;
+	}
+
+	++stats.packetsReceived;
+	stats.bytesReceived += NetworkMessage::HEADER_LENGTH + length;
+
+	auto now = std::chrono::steady_clock::now();
+	for (size_t position = 0; position < payloadLength;) {
+		uint8_t opcode = payload[position];
+		size_t size = getFixedOpcodeSize(opcode);
+
+		switch (opcode) {
+			case 0x14:
+			case 0x16: {
+				PacketReader msg(payload + position + 1, payloadLength - position - 1);
+				fail("disconnected: " + msg.getString());
+				return;
+			}
+
+			case 0x17: {
+				// the rest of the login message is not needed
+				PacketReader msg(payload + position + 1, payloadLength - position - 1);
+				uint32_t id = msg.get<uint32_t>();
+				if (playerId == 0 && !msg.isOverrun()) {
+					onEnterGame(id);
+				}
+				break;
+			}
+
+			case 0x1D:
+				sendPayload({0x1E});
+				break;
+
+			case 0x1E:
+				if (pingPending) {
+					pingPending = false;
+					stats.pingLatency.add(std::chrono::duration_cast<std::chrono::microseconds>(now - pingSent).count());
+				}
+				break;
+
+			case 0x6D:
+			case 0xB5:
+				if (walkPending) {
+					walkPending = false;
+					stats.walkLatency.add(std::chrono::duration_cast<std::chrono::microseconds>(now - walkSent).count());
+				}
+				break;
+
+			default:
+				break;
+		}
+
+		if (size == 0 || position + size > payloadLength) {
+			break;
+		}
+		position += size;
+	}
+
+	readPacket(&BotClient::parseGamePacket);
+}
+
+void BotClient::onEnterGame(uint32_t id)
+{
+	playerId = id;
+	++stats.online;
+	stats.playerIds.push_back(id);
+
+	lastRecorded = std::chrono::steady_clock::now();
+
+	schedulePing();
+	if (options.replay && !options.replay->empty()) {
+		scheduleReplay(0);
+	} else {
+		scheduleAction();
+	}
+}
+
+void BotClient::scheduleAction()
+{
+	std::uniform_int_distribution<uint32_t> delay(options.actionInterval / 2, options.actionInterval * 3 / 2);
+	actionTimer.expires_from_now(std::chrono::milliseconds(delay(generator)));
+
+	auto self = shared_from_this();
+	actionTimer.async_wait([self](const boost::system::error_code& error) {
+		if (!error && !self->stopped) {
+			self->doAction();
+			self->scheduleAction();
+		}
+	});
+}
+
+void BotClient::doAction()
+{
+	auto now = std::chrono::steady_clock::now();
+	if (walkPending && now - walkSent > REPLY_TIMEOUT) {
+		walkPending = false;
+	}
+
+	PacketWriter out;
+
+	uint32_t action = std::uniform_int_distribution<uint32_t>(0, 99)(generator);
+	if (action < 50) {
+		out.addByte(0x65 + generator() % 4); // north, east, south or west
+		if (!walkPending) {
+			walkPending = true;
+			walkSent = now;
+		}
+	} else if (action < 65 && stats.playerIds.size() > 1) {
+		uint32_t target = stats.playerIds[generator() % stats.playerIds.size()];
+		if (target == playerId) {
+			return;
+		}
+
+		out.addByte(0xA1);
+		out.add<uint32_t>(target);
+		out.add<uint32_t>(++attackSequence);
+	} else if (action < 80 && !options.spellWords.empty()) {
+		out.addByte(0x96);
+		out.addByte(TALKTYPE_SAY);
+		out.addString(options.spellWords[generator() % options.spellWords.size()]);
+	} else {
+		out.addByte(0x96);
+		out.addByte(TALKTYPE_SAY);
+		out.addString(fmt::format("load test message {:d}", generator() % 1000));
+	}
+
+	const std::vector<uint8_t>& payload = out.getBuffer();
+	if (recording.is_open()) {
+		uint32_t delay = std::chrono::duration_cast<std::chrono::milliseconds>(now - lastRecorded).count();
+		uint16_t payloadLength = payload.size();
+		lastRecorded = now;
+
+		recording.write(reinterpret_cast<const char*>(&delay), sizeof(delay));
+		recording.write(reinterpret_cast<const char*>(&payloadLength), sizeof(payloadLength));
+		recording.write(reinterpret_cast<const char*>(payload.data()), payload.size());
+	}
+
+	sendPayload(payload);
+}
+
+void BotClient::schedulePing()
+{
+	pingTimer.expires_from_now(std::chrono::milliseconds(options.pingInterval));
+
+	auto self = shared_from_this();
+	pingTimer.async_wait([self](const boost::system::error_code& error) {
+		if (error || self->stopped) {
+			return;
+		}
+
+		// answer the server side ping check and measure the round trip
+		self->sendPayload({0x1E});
+
+		auto now = std::chrono::steady_clock::now();
+		if (!self->pingPending || now - self->pingSent > REPLY_TIMEOUT) {
+			self->pingPending = true;
+			self->pingSent = now;
+			self->sendPayload({0x1D});
+		}
+
+		self->schedulePing();
+	});
+}
+
+void BotClient::scheduleReplay(size_t index)
+{
+	const ReplayRecords& records = *options.replay;
+	if (index >= records.size()) {
+		index = 0;
+	}
+
+	const ReplayRecord& record = records[index];
+	actionTimer.expires_from_now(std::chrono::milliseconds(static_cast<int64_t>(record.delay / options.replaySpeed)));
+
+	auto self = shared_from_this();
+	actionTimer.async_wait([self, index](const boost::system::error_code& error) {
+		if (error || self->stopped) {
+			return;
+		}
+
+		auto now = std::chrono::steady_clock::now();
+		if (self->walkPending && now - self->walkSent > REPLY_TIMEOUT) {
+			self->walkPending = false;
+		}
+
+		const ReplayRecord& record = (*self->options.replay)[index];
+		if (!record.payload.empty() && record.payload.front() >= 0x65 && record.payload.front() <= 0x68 && !self->walkPending) {
+			self->walkPending = true;
+			self->walkSent = now;
+		}
+
+		self->sendPayload(record.payload);
+		self->scheduleReplay(index + 1);
+	});
+}
@@ -0,0 +1,162 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#ifndef FS_BOTCLIENT_H_7F0FB0C6B23F4B37843A554B7CDC7759
+#define FS_BOTCLIENT_H_7F0FB0C6B23F4B37843A554B7CDC7759
+
+#include "xtea.h"
+
+#include <deque>
+#include <fstream>
+#include <random>
+
+class RSA;
+
+// one client packet of a recording, the payload is the plain game packet
+// starting with its opcode. On disk every record is a little endian u32 delay
+// in milliseconds since the previous record, a u16 length and the payload.
+struct ReplayRecord {
+	uint32_t delay;
+	std::vector<uint8_t> payload;
+};
+
+using ReplayRecords = std::vector<ReplayRecord>;
+
+struct LoadTestOptions {
+	std::string host = "127.0.0.1";
+	uint16_t loginPort = 7171;
+	std::string keyFile = "key.pem";
+
+	// bot n logs in as accountPrefix + (firstAccount + n) and plays its first character
+	std::string accountPrefix = "bot";
+	std::string password = "bot";
+	uint32_t firstAccount = 1;
+	uint32_t players = 10;
+
+	uint32_t loginInterval = 100;
+	uint32_t actionInterval = 1000;
+	uint32_t pingInterval = 2000;
+	uint32_t reportInterval = 10;
+	uint32_t duration = 60;
+
+	std::vector<std::string> spellWords = {"exura", "utevo lux", "exori"};
+
+	// the first bot writes what it sends to recordFile, replays are sent by
+	// every bot at replaySpeed times the recorded pace
+	std::string recordFile;
+	const ReplayRecords* replay = nullptr;
+	double replaySpeed = 1.0;
+};
+
+class LatencyStats
+{
+	public:
+		void add(int64_t micros) {
+			samples.push_back(micros);
+		}
+		void clear() {
+			samples.clear();
+		}
+
+		std::string getSummary(const char* name) const;
+
+	private:
+		std::vector<int64_t> samples;
+};
+
+struct LoadTestStats {
+	LatencyStats walkLatency;
+	LatencyStats pingLatency;
+
+	uint32_t online = 0;
+	uint32_t failed = 0;
+	uint64_t packetsSent = 0;
+	uint64_t packetsReceived = 0;
+	uint64_t bytesReceived = 0;
+
+	// ids of the bots in the game, the attack targets
+	std::vector<uint32_t> playerIds;
+};
+
+// A headless client for one character. It logs in through the login server
+// like the real client, enters the game with the session key and then either
+// walks, attacks, casts and chats at random or sends a recording. Replies are
+// only recognised while they lead their message, the rest of the stream is
+// skipped without decoding it, so latencies are measured from the request to
+// the first message that starts with the walk confirm or the ping answer.
+// All bots share one io_context on one thread.
+class BotClient : public std::enable_shared_from_this<BotClient>
+{
+	public:
+		BotClient(boost::asio::io_context& io, const LoadTestOptions& options, LoadTestStats& stats, const RSA& rsa, uint32_t index);
+
+		// non-copyable
+		BotClient(const BotClient&) = delete;
+		BotClient& operator=(const BotClient&) = delete;
+
+		void start();
+		void stop();
+
+	private:
+		using PacketHandler = void (BotClient::*)(uint8_t* body, size_t length);
+
+		void fail(const std::string& reason);
+
+		void readPacket(PacketHandler handler);
+		void sendFrame(std::vector<uint8_t> frame);
+		void sendNextFrame();
+		void sendPayload(const std::vector<uint8_t>& payload);
+
+		// login server
+		void sendLogin();
+		void parseLoginResponse(uint8_t* body, size_t length);
+
+		// game server
+		void connectGame(uint16_t port);
+		void parseChallenge(uint8_t* body, size_t length);
+		void parseGamePacket(uint8_t* body, size_t length);
+		void onEnterGame(uint32_t id);
+
+		void scheduleAction();
+		void doAction();
+		void schedulePing();
+		void scheduleReplay(size_t index);
+
+		bool decryptBody(uint8_t* body, size_t length, const uint8_t*& payload, size_t& payloadLength) const;
+
+		boost::asio::io_context& io;
+		boost::asio::ip::tcp::socket socket;
+		boost::asio::steady_timer actionTimer;
+		boost::asio::steady_timer pingTimer;
+
+		const LoadTestOptions& options;
+		LoadTestStats& stats;
+		const RSA& rsa;
+
+		std::mt19937 generator;
+		xtea::key key;
+		xtea::round_keys roundKeys;
+
+		std::string accountName;
+		std::string sessionKey;
+		std::string characterName;
+		uint32_t playerId = 0;
+		uint32_t attackSequence = 0;
+		uint32_t index;
+
+		std::array<uint8_t, 2> header;
+		std::vector<uint8_t> body;
+		std::deque<std::vector<uint8_t>> outputQueue;
+
+		std::chrono::steady_clock::time_point walkSent;
+		std::chrono::steady_clock::time_point pingSent;
+		bool walkPending = false;
+		bool pingPending = false;
+
+		std::ofstream recording;
+		std::chrono::steady_clock::time_point lastRecorded;
+
+		bool stopped = false;
+};
+
+#endif
@@ -0,0 +1,218 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#include "otpch.h"
+
+#include "botclient.h"
+#include "rsa.h"
+
+#include <fmt/format.h>
+
+namespace {
+
+void printUsage(const char* name)
+{
+	std::cout << "Usage: " << name << " [options]\n"
+	          << "\t--host <address>           server address (127.0.0.1)\n"
+	          << "\t--login-port <port>        login server port (7171)\n"
+	          << "\t--key <file>               rsa key of the server (key.pem)\n"
+	          << "\t--account-prefix <name>    account names are the prefix and a number (bot)\n"
+	          << "\t--password <password>      password of every account (bot)\n"
+	          << "\t--first-account <n>        number of the first account (1)\n"
+	          << "\t--players <n>              simulated players (10)\n"
+	          << "\t--login-interval <ms>      delay between two logins (100)\n"
+	          << "\t--action-interval <ms>     average delay between two actions of a player (1000)\n"
+	          << "\t--ping-interval <ms>       delay between two pings (2000)\n"
+	          << "\t--spells <words,...>       spell words to cast (exura,utevo lux,exori)\n"
+	          << "\t--report-interval <s>      seconds between two reports (10)\n"
+	          << "\t--duration <s>             length of the test (60)\n"
+	          << "\t--record <file>            write the packets of the first player to a file\n"
+	          << "\t--replay <file>            send a recording instead of random actions\n"
+	          << "\t--replay-speed <factor>    pace of the replay relative to the recording (1)\n";
+}
+
+bool parseOptions(int argc, char* argv[], LoadTestOptions& options, std::string& replayFile)
+{
+	for (int i = 1; i < argc; ++i) {
+		std::string option = argv[i];
+		if (option == "--help" || i + 1 >= argc) {
+			return false;
+		}
+
+		std::string value = argv[++i];
+		try {
+			if (option == "--host") {
+				options.host = value;
+			} else if (option == "--login-port") {
+				options.loginPort = std::stoul(value);
+			} else if (option == "--key") {
+				options.keyFile = value;
+			} else if (option == "--account-prefix") {
+				options.accountPrefix = value;
+			} else if (option == "--password") {
+				options.password = value;
+			} else if (option == "--first-account") {
+				options.firstAccount = std::stoul(value);
+			} else if (option == "--players") {
+				options.players = std::stoul(value);
+			} else if (option == "--login-interval") {
+				options.loginInterval = std::stoul(value);
+			} else if (option == "--action-interval") {
+				options.actionInterval = std::max<uint32_t>(1, std::stoul(value));
+			} else if (option == "--ping-interval") {
+				options.pingInterval = std::max<uint32_t>(1, std::stoul(value));
+			} else if (option == "--spells") {
+				options.spellWords.clear();
+				std::istringstream words(value);
+				for (std::string word; std::getline(words, word, ',');) {
+					if (!word.empty()) {
+						options.spellWords.push_back(word);
+					}
+				}
+			} else if (option == "--report-interval") {
+				options.reportInterval = std::max<uint32_t>(1, std::stoul(value));
+			} else if (option == "--duration") {
+				options.duration = std::stoul(value);
+			} else if (option == "--record") {
+				options.recordFile = value;
+			} else if (option == "--replay") {
+				replayFile = value;
+			} else if (option == "--replay-speed") {
+				options.replaySpeed = std::stod(value);
+				if (options.replaySpeed <= 0) {
+					return false;
+				}
+			} else {
+				return false;
+			}
+		} catch (const std::exception&) {
+			std::cout << "> ERROR: Invalid value " << value << " for " << option << '.' << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool loadReplay(const std::string& filename, ReplayRecords& records)
+{
+	std::ifstream file(filename, std::ios::binary);
+	if (!file.is_open()) {
+		std::cout << "> ERROR: Cannot open the recording " << filename << '.' << std::endl;
+		return false;
+	}
+
+	while (true) {
+		uint32_t delay;
+		uint16_t length;
+		if (!file.read(reinterpret_cast<char*>(&delay), sizeof(delay)) || !file.read(reinterpret_cast<char*>(&length), sizeof(length))) {
+			break;
+		}
+
+		ReplayRecord record{delay, std::vector<uint8_t>(length)};
+		if (!file.read(reinterpret_cast<char*>(record.payload.data()), length)) {
+			std::cout << "> ERROR: The recording " << filename << " is truncated." << std::endl;
+			return false;
+		}
+		records.push_back(std::move(record));
+	}
+
+	if (records.empty()) {
+		std::cout << "> ERROR: The recording " << filename << " is empty." << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void printReport(LoadTestStats& stats)
+{
+	std::cout << fmt::format("> {:d} players online, {:d} failed, {:d} packets sent, {:d} packets ({:d} bytes) received",
+	                         stats.online, stats.failed, stats.packetsSent, stats.packetsReceived, stats.bytesReceived) << '\n'
+	          << "> " << stats.walkLatency.getSummary("walk confirm") << '\n'
+	          << "> " << stats.pingLatency.getSummary("ping") << std::endl;
+
+	stats.walkLatency.clear();
+	stats.pingLatency.clear();
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+	LoadTestOptions options;
+	std::string replayFile;
+	if (!parseOptions(argc, argv, options, replayFile)) {
+		printUsage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	RSA rsa;
+	try {
+		rsa.loadPEM(options.keyFile);
+	} catch (const std::exception& e) {
+		std::cout << "> ERROR: " << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	ReplayRecords replay;
+	if (!replayFile.empty()) {
+		if (!loadReplay(replayFile, replay)) {
+			return EXIT_FAILURE;
+		}
+		options.replay = &replay;
+		std::cout << ">> Replaying " << replay.size() << " packets from " << replayFile << " at " << options.replaySpeed << "x." << std::endl;
+	}
+
+	boost::asio::io_context io;
+	LoadTestStats stats;
+	std::vector<std::shared_ptr<BotClient>> bots;
+	bots.reserve(options.players);
+
+	// logins are spread out, the login server checks every password on a worker
+	boost::asio::steady_timer loginTimer(io);
+	std::function<void()> startNextBot = [&]() {
+		auto bot = std::make_shared<BotClient>(io, options, stats, rsa, bots.size());
+		bots.push_back(bot);
+		bot->start();
+
+		if (bots.size() < options.players) {
+			loginTimer.expires_from_now(std::chrono::milliseconds(options.loginInterval));
+			loginTimer.async_wait([&](const boost::system::error_code& error) {
+				if (!error) {
+					startNextBot();
+				}
+			});
+		}
+	};
+
+	boost::asio::steady_timer reportTimer(io);
+	std::function<void()> scheduleReport = [&]() {
+		reportTimer.expires_from_now(std::chrono::seconds(options.reportInterval));
+		reportTimer.async_wait([&](const boost::system::error_code& error) {
+			if (!error) {
+				printReport(stats);
+				scheduleReport();
+			}
+		});
+	};
+
+	boost::asio::steady_timer endTimer(io);
+	endTimer.expires_from_now(std::chrono::seconds(options.duration));
+	endTimer.async_wait([&](const boost::system::error_code&) {
+		loginTimer.cancel();
+		reportTimer.cancel();
+		printReport(stats);
+		for (const auto& bot : bots) {
+			bot->stop();
+		}
+	});
+
+	std::cout << ">> Starting " << options.players << " players against " << options.host << ':' << options.loginPort << " for " << options.duration << " seconds." << std::endl;
+
+	if (options.players != 0) {
+		startNextBot();
+	}
+	scheduleReport();
+
+	io.run();
+	return EXIT_SUCCESS;
+}
@@ -64,4 +64,26 @@ class LockfreePoolingAllocator
 		}
 };
 
+/*
+ * raw blocks of TSize bytes for class-level operator new/delete, a size class
+ * serves every derived type that fits into it
+ */
+template <size_t TSize, size_t Capacity>
+void* lockfreeAllocateBlock()
+{
+	void* p;
+	if (!LockfreeFreeList<TSize, Capacity>::get().pop(p)) {
+		p = operator new (TSize);
+	}
+	return p;
+}
+
+template <size_t TSize, size_t Capacity>
+void lockfreeDeallocateBlock(void* p)
+{
+	if (!LockfreeFreeList<TSize, Capacity>::get().bounded_push(p)) {
+		operator delete(p);
+	}
+}
+
 #endif
@@ -0,0 +1,77 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#include "otpch.h"
+
+#include "lockprofiler.h"
+
+#include <fmt/format.h>
+
+namespace {
+
+std::map<std::string, std::unique_ptr<LockStats>>& getLocks()
+{
+	static std::map<std::string, std::unique_ptr<LockStats>> locks;
+	return locks;
+}
+
+// locks are registered during static initialization too
+std::mutex& getLocksLock()
+{
+	static std::mutex locksLock;
+	return locksLock;
+}
+
+void addLockMetric(std::string& out, const char* name, const char* type, const char* help, const std::function<std::string(const LockStats&)>& value)
+{
+	out += fmt::format("# HELP {:s} {:s}\n# TYPE {:s} {:s}\n", name, help, name, type);
+	for (const auto& it : getLocks()) {
+		out += fmt::format("{:s}{{lock=\"{:s}\"}} {:s}\n", name, it.first, value(*it.second));
+	}
+}
+
+std::string seconds(const std::atomic<uint64_t>& nanos)
+{
+	return fmt::format("{:.9f}", nanos.load(std::memory_order_relaxed) / 1000000000.);
+}
+
+}
+
+LockStats& LockProfiler::registerLock(const char* name)
+{
+	std::lock_guard<std::mutex> lockClass(getLocksLock());
+	auto& stats = getLocks()[name];
+	if (!stats) {
+		stats.reset(new LockStats());
+	}
+	return *stats;
+}
+
+std::string LockProfiler::getReport()
+{
+	std::lock_guard<std::mutex> lockClass(getLocksLock());
+	if (getLocks().empty()) {
+		return {};
+	}
+
+	std::string out;
+	addLockMetric(out, "tfs_lock_acquisitions_total", "counter", "Times the lock has been taken and released.", [](const LockStats& stats) {
+		return std::to_string(stats.acquisitions.load(std::memory_order_relaxed));
+	});
+	addLockMetric(out, "tfs_lock_contentions_total", "counter", "Times a thread had to wait for the lock.", [](const LockStats& stats) {
+		return std::to_string(stats.contentions.load(std::memory_order_relaxed));
+	});
+	addLockMetric(out, "tfs_lock_wait_seconds_total", "counter", "Time threads spent waiting for the lock.", [](const LockStats& stats) {
+		return seconds(stats.waitNanos);
+	});
+	addLockMetric(out, "tfs_lock_hold_seconds_total", "counter", "Time the lock has been held.", [](const LockStats& stats) {
+		return seconds(stats.holdNanos);
+	});
+	addLockMetric(out, "tfs_lock_wait_seconds_max", "gauge", "Longest wait for the lock.", [](const LockStats& stats) {
+		return seconds(stats.maxWaitNanos);
+	});
+	addLockMetric(out, "tfs_lock_hold_seconds_max", "gauge", "Longest time the lock has been held.", [](const LockStats& stats) {
+		return seconds(stats.maxHoldNanos);
+	});
+	return out;
+}
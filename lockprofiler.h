@@ -0,0 +1,123 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#ifndef FS_LOCKPROFILER_H_069DE5F79EF84019A1723765B53E60E5
+#define FS_LOCKPROFILER_H_069DE5F79EF84019A1723765B53E60E5
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+
+// Wait time, hold time and contention of the mutexes on cross-thread paths,
+// summed per lock name, so every connection adds to the same entry. Built
+// with ENABLE_LOCK_PROFILING only, otherwise ProfiledLock is the plain mutex
+// and no lock ever registers.
+struct LockStats
+{
+	std::atomic<uint64_t> acquisitions{0};
+	std::atomic<uint64_t> contentions{0};
+	std::atomic<uint64_t> waitNanos{0};
+	std::atomic<uint64_t> holdNanos{0};
+	std::atomic<uint64_t> maxWaitNanos{0};
+	std::atomic<uint64_t> maxHoldNanos{0};
+
+	void addWait(uint64_t nanos) {
+		contentions.fetch_add(1, std::memory_order_relaxed);
+		waitNanos.fetch_add(nanos, std::memory_order_relaxed);
+		updateMax(maxWaitNanos, nanos);
+	}
+	void addHold(uint64_t nanos) {
+		acquisitions.fetch_add(1, std::memory_order_relaxed);
+		holdNanos.fetch_add(nanos, std::memory_order_relaxed);
+		updateMax(maxHoldNanos, nanos);
+	}
+
+	static void updateMax(std::atomic<uint64_t>& max, uint64_t value) {
+		uint64_t current = max.load(std::memory_order_relaxed);
+		while (current < value && !max.compare_exchange_weak(current, value, std::memory_order_relaxed));
+	}
+};
+
+class LockProfiler
+{
+	public:
+		// the entry of a name lives as long as the process
+		static LockStats& registerLock(const char* name);
+
+		// prometheus text, empty while nothing is profiled
+		static std::string getReport();
+};
+
+#ifdef ENABLE_LOCK_PROFILING
+template <typename Mutex>
+class ProfiledLock
+{
+	public:
+		explicit ProfiledLock(const char* name) : stats(LockProfiler::registerLock(name)) {}
+
+		// non-copyable
+		ProfiledLock(const ProfiledLock&) = delete;
+		ProfiledLock& operator=(const ProfiledLock&) = delete;
+
+		void lock() {
+			if (!mutex.try_lock()) {
+				auto start = std::chrono::steady_clock::now();
+				mutex.lock();
+				stats.addWait(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+			}
+			acquired();
+		}
+
+		bool try_lock() {
+			if (!mutex.try_lock()) {
+				return false;
+			}
+			acquired();
+			return true;
+		}
+
+		void unlock() {
+			// a recursive lock is held until its outermost unlock
+			if (--depth == 0) {
+				stats.addHold(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - acquiredAt).count());
+			}
+			mutex.unlock();
+		}
+
+	private:
+		// only touched by the owner while it holds the mutex
+		void acquired() {
+			if (depth++ == 0) {
+				acquiredAt = std::chrono::steady_clock::now();
+			}
+		}
+
+		Mutex mutex;
+		LockStats& stats;
+		std::chrono::steady_clock::time_point acquiredAt;
+		uint32_t depth = 0;
+};
+#else
+template <typename Mutex>
+class ProfiledLock : public Mutex
+{
+	public:
+		explicit ProfiledLock(const char*) {}
+};
+#endif
+
+using ProfiledMutex = ProfiledLock<std::mutex>;
+using ProfiledRecursiveMutex = ProfiledLock<std::recursive_mutex>;
+
+// waiting needs a lock the condition variable can release and take again
+#ifdef ENABLE_LOCK_PROFILING
+using ProfiledConditionVariable = std::condition_variable_any;
+using ProfiledUniqueLock = std::unique_lock<ProfiledMutex>;
+#else
+using ProfiledConditionVariable = std::condition_variable;
+using ProfiledUniqueLock = std::unique_lock<std::mutex>;
+#endif
+
+#endif
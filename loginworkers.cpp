@@ -0,0 +1,66 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#include "otpch.h"
+
+#include "loginworkers.h"
+
+LoginWorkers g_loginWorkers;
+
+void LoginWorkers::start(size_t threadCount)
+{
+	stopping = false;
+	threads.reserve(threadCount);
+	for (size_t i = 0; i < threadCount; ++i) {
+		threads.emplace_back(&LoginWorkers::threadMain, this);
+	}
+}
+
+void LoginWorkers::shutdown()
+{
+	{
+		std::lock_guard<ProfiledMutex> lockClass(taskLock);
+		stopping = true;
+	}
+	taskSignal.notify_all();
+
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+	threads.clear();
+
+	std::lock_guard<ProfiledMutex> lockClass(taskLock);
+	tasks.clear();
+}
+
+bool LoginWorkers::addTask(std::function<void()> task)
+{
+	{
+		std::lock_guard<ProfiledMutex> lockClass(taskLock);
+		if (threads.empty() || stopping) {
+			return false;
+		}
+		tasks.emplace_back(std::move(task));
+	}
+	taskSignal.notify_one();
+	return true;
+}
+
+void LoginWorkers::threadMain()
+{
+	ProfiledUniqueLock lockClass(taskLock);
+	while (true) {
+		taskSignal.wait(lockClass, [this]() { return stopping || !tasks.empty(); });
+		if (stopping) {
+			break;
+		}
+
+		std::function<void()> task = std::move(tasks.front());
+		tasks.pop_front();
+		lockClass.unlock();
+
+		task();
+
+		lockClass.lock();
+	}
+}
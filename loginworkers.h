@@ -0,0 +1,44 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#ifndef FS_LOGINWORKERS_H_9B41E07C2D6A4F3B8E15A7C0D4F2B968
+#define FS_LOGINWORKERS_H_9B41E07C2D6A4F3B8E15A7C0D4F2B968
+
+#include "lockprofiler.h"
+
+#include <deque>
+#include <functional>
+#include <thread>
+
+// Threads for the first message of the login and game protocols, its rsa
+// block takes long enough that decrypting it on the network threads would
+// hold up the packets of every connection sharing them during a mass login.
+class LoginWorkers
+{
+	public:
+		LoginWorkers() = default;
+
+		// non-copyable
+		LoginWorkers(const LoginWorkers&) = delete;
+		LoginWorkers& operator=(const LoginWorkers&) = delete;
+
+		void start(size_t threadCount);
+		// tasks still queued are dropped
+		void shutdown();
+
+		// false while no worker runs, the caller runs the task itself then
+		bool addTask(std::function<void()> task);
+
+	private:
+		void threadMain();
+
+		std::vector<std::thread> threads;
+		std::deque<std::function<void()>> tasks;
+		ProfiledMutex taskLock{"LoginWorkers::taskLock"};
+		ProfiledConditionVariable taskSignal;
+		bool stopping = false;
+};
+
+extern LoginWorkers g_loginWorkers;
+
+#endif
@@ -0,0 +1,254 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#include "otpch.h"
+
+#include "luafastpaths.h"
+
+#ifdef LUAJIT_VERSION
+#include "configmanager.h"
+#include "player.h"
+
+extern ConfigManager g_config;
+
+namespace {
+
+// the objects are the pointers stored in the userdata, never null here; the
+// functions must not call back into lua
+uint32_t creatureGetId(const Creature* creature)
+{
+	return creature->getID();
+}
+
+int32_t creatureGetHealth(const Creature* creature)
+{
+	return creature->getHealth();
+}
+
+int32_t creatureGetMaxHealth(const Creature* creature)
+{
+	return creature->getMaxHealth();
+}
+
+void creatureGetPosition(const Creature* creature, uint16_t* position)
+{
+	const Position& pos = creature->getPosition();
+	position[0] = pos.x;
+	position[1] = pos.y;
+	position[2] = pos.z;
+}
+
+uint32_t playerGetLevel(const Player* player)
+{
+	return player->getLevel();
+}
+
+uint32_t playerGetMana(const Player* player)
+{
+	return player->getMana();
+}
+
+uint32_t playerGetMaxMana(const Player* player)
+{
+	return player->getMaxMana();
+}
+
+const Vocation* playerGetVocation(const Player* player)
+{
+	return player->getVocation();
+}
+
+int32_t playerGetStorageValue(const Player* player, uint32_t key)
+{
+	int32_t value;
+	player->getStorageValue(key, value);
+	return value;
+}
+
+uint16_t itemGetId(const Item* item)
+{
+	return item->getID();
+}
+
+uint16_t itemGetCount(const Item* item)
+{
+	return item->getItemCount();
+}
+
+// false for string and custom attributes, which are left to item:getAttribute
+bool itemGetIntAttribute(const Item* item, int64_t key, int64_t* value)
+{
+	itemAttrTypes attribute = static_cast<itemAttrTypes>(key);
+	if (attribute == ITEM_ATTRIBUTE_DURATION) {
+		*value = item->getDuration();
+	} else if (ItemAttributes::isIntAttrType(attribute)) {
+		*value = item->getIntAttr(attribute);
+	} else {
+		return false;
+	}
+	return true;
+}
+
+// declared again as tfs_fast_paths in FAST_PATHS_SCRIPT, in the same order
+struct FastPaths {
+	uint32_t (*creatureGetId)(const Creature*);
+	int32_t (*creatureGetHealth)(const Creature*);
+	int32_t (*creatureGetMaxHealth)(const Creature*);
+	void (*creatureGetPosition)(const Creature*, uint16_t*);
+	uint32_t (*playerGetLevel)(const Player*);
+	uint32_t (*playerGetMana)(const Player*);
+	uint32_t (*playerGetMaxMana)(const Player*);
+	const Vocation* (*playerGetVocation)(const Player*);
+	int32_t (*playerGetStorageValue)(const Player*, uint32_t);
+	uint16_t (*itemGetId)(const Item*);
+	uint16_t (*itemGetCount)(const Item*);
+	bool (*itemGetIntAttribute)(const Item*, int64_t, int64_t*);
+};
+
+FastPaths fastPaths = {
+	creatureGetId, creatureGetHealth, creatureGetMaxHealth, creatureGetPosition,
+	playerGetLevel, playerGetMana, playerGetMaxMana, playerGetVocation, playerGetStorageValue,
+	itemGetId, itemGetCount, itemGetIntAttribute,
+};
+
+// called with the fast paths, the Position metatable and whether positions
+// are pushed as userdata; returns false when luajit has no ffi
+constexpr const char* FAST_PATHS_SCRIPT = R"lua(
+local paths, positionMetatable, positionUserdata = ...
+local ok, ffi = pcall(require, "ffi")
+if not ok then
+	return false
+end
+
+ffi.cdef[[
+typedef struct {
+	uint32_t (*creatureGetId)(void*);
+	int32_t (*creatureGetHealth)(void*);
+	int32_t (*creatureGetMaxHealth)(void*);
+	void (*creatureGetPosition)(void*, uint16_t*);
+	uint32_t (*playerGetLevel)(void*);
+	uint32_t (*playerGetMana)(void*);
+	uint32_t (*playerGetMaxMana)(void*);
+	void* (*playerGetVocation)(void*);
+	int32_t (*playerGetStorageValue)(void*, uint32_t);
+	uint16_t (*itemGetId)(void*);
+	uint16_t (*itemGetCount)(void*);
+	bool (*itemGetIntAttribute)(void*, int64_t, int64_t*);
+} tfs_fast_paths;
+]]
+
+paths = ffi.cast("tfs_fast_paths*", paths)
+local objectPointer = ffi.typeof("void**")
+
+-- the object of a userdata, nil like getUserdata gives when there is none
+local function getObject(self)
+	if type(self) == "userdata" then
+		local object = ffi.cast(objectPointer, self)[0]
+		if object ~= nil then
+			return object
+		end
+	end
+	return nil
+end
+
+local function getter(path)
+	return function(self)
+		local object = getObject(self)
+		if object then
+			return path(object)
+		end
+		return nil
+	end
+end
+
+Creature.getId = getter(paths.creatureGetId)
+Creature.getHealth = getter(paths.creatureGetHealth)
+Creature.getMaxHealth = getter(paths.creatureGetMaxHealth)
+Player.getLevel = getter(paths.playerGetLevel)
+Player.getMana = getter(paths.playerGetMana)
+Player.getMaxMana = getter(paths.playerGetMaxMana)
+Item.getId = getter(paths.itemGetId)
+Item.getCount = getter(paths.itemGetCount)
+
+-- a userdata holds only the pointer, so any with the same vocation will do
+local getVocation, vocationGetter, vocations = Player.getVocation, paths.playerGetVocation, {}
+Player.getVocation = function(self)
+	local object = getObject(self)
+	if not object then
+		return nil
+	end
+
+	local key = tonumber(ffi.cast("uintptr_t", vocationGetter(object)))
+	local vocation = vocations[key]
+	if not vocation then
+		vocation = getVocation(self)
+		vocations[key] = vocation
+	end
+	return vocation
+end
+
+local getStorageValue, storageGetter = Player.getStorageValue, paths.playerGetStorageValue
+Player.getStorageValue = function(self, key)
+	if type(key) == "number" then
+		local object = getObject(self)
+		if object then
+			return storageGetter(object, key)
+		end
+	end
+	return getStorageValue(self, key)
+end
+
+local getAttribute, attributeGetter, attributeValue = Item.getAttribute, paths.itemGetIntAttribute, ffi.new("int64_t[1]")
+Item.getAttribute = function(self, key)
+	if type(key) == "number" then
+		local object = getObject(self)
+		if object and attributeGetter(object, key, attributeValue) then
+			return tonumber(attributeValue[0])
+		end
+	end
+	return getAttribute(self, key)
+end
+
+-- the userdata form of positions can only be built through the C api
+if not positionUserdata then
+	local positionGetter, position = paths.creatureGetPosition, ffi.new("uint16_t[3]")
+	Creature.getPosition = function(self)
+		local object = getObject(self)
+		if not object then
+			return nil
+		end
+
+		positionGetter(object, position)
+		return setmetatable({x = position[0], y = position[1], z = position[2], stackpos = 0}, positionMetatable)
+	end
+end
+return true
+)lua";
+
+}
+#endif
+
+void LuaFastPaths::install(lua_State* L)
+{
+#ifdef LUAJIT_VERSION
+	if (!g_config.getBoolean(ConfigManager::LUA_FFI_FAST_PATHS)) {
+		return;
+	}
+
+	if (luaL_loadbuffer(L, FAST_PATHS_SCRIPT, strlen(FAST_PATHS_SCRIPT), "fastpaths") != 0) {
+		std::cout << "[Error - LuaFastPaths::install] " << lua_tostring(L, -1) << std::endl;
+		lua_pop(L, 1);
+		return;
+	}
+
+	lua_pushlightuserdata(L, &fastPaths);
+	luaL_getmetatable(L, "Position");
+	lua_pushboolean(L, g_config.getBoolean(ConfigManager::LUA_POSITION_USERDATA));
+	if (lua_pcall(L, 3, 1, 0) != 0) {
+		std::cout << "[Error - LuaFastPaths::install] " << lua_tostring(L, -1) << std::endl;
+	} else if (!lua_toboolean(L, -1)) {
+		std::cout << "[Warning - LuaFastPaths::install] LuaJIT was built without the FFI, the fast paths are off." << std::endl;
+	}
+	lua_pop(L, 1);
+#endif
+}
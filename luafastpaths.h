@@ -0,0 +1,27 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#ifndef FS_LUAFASTPATHS_H_6C31CEBCA2524785B65E16EB4B75908F
+#define FS_LUAFASTPATHS_H_6C31CEBCA2524785B65E16EB4B75908F
+
+#if __has_include("luajit/lua.hpp")
+#include <luajit/lua.hpp>
+#else
+#include <lua.hpp>
+#endif
+
+// With LuaJIT and luaFfiFastPaths set, the hottest read-only getters of
+// Creature, Player and Item are replaced by Lua functions that read the
+// object pointer out of the userdata through the FFI and call a plain C
+// function for the value, which the JIT compiles into the trace instead of
+// leaving it for a call through the Lua C API. Arguments they do not handle
+// go to the original method. Without LuaJIT install does nothing.
+class LuaFastPaths
+{
+	public:
+		// after the classes are registered and before the libs are loaded,
+		// so functions the libs define over these still win
+		static void install(lua_State* L);
+};
+
+#endif
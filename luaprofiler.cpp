@@ -0,0 +1,173 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#include "otpch.h"
+
+#include "luaprofiler.h"
+#include "scheduler.h"
+#include "tools.h"
+
+#include <fstream>
+#include <fmt/format.h>
+
+LuaProfiler g_luaProfiler;
+
+void LuaProfiler::setEnabled(bool value)
+{
+	if (value && !enabled) {
+		reset();
+	}
+	enabled = value;
+	updateHook();
+}
+
+void LuaProfiler::setSampleInterval(int32_t interval)
+{
+	sampleInterval = std::max<int32_t>(0, interval);
+	updateHook();
+}
+
+void LuaProfiler::attach(lua_State* L)
+{
+	state = L;
+	updateHook();
+}
+
+void LuaProfiler::updateHook()
+{
+	if (!state) {
+		return;
+	}
+
+	if (enabled && sampleInterval > 0) {
+		lua_sethook(state, sampleHook, LUA_MASKCOUNT, sampleInterval);
+	} else {
+		lua_sethook(state, nullptr, 0, 0);
+	}
+}
+
+void LuaProfiler::sampleHook(lua_State* L, lua_Debug* ar)
+{
+	if (!lua_getinfo(L, "Sl", ar) || ar->currentline < 0) {
+		return;
+	}
+	++g_luaProfiler.samples[fmt::format("{:s}:{:d}", ar->short_src, ar->currentline)];
+}
+
+void LuaProfiler::enter(lua_State* L, int params, const std::string& origin)
+{
+	lua_Debug ar;
+	lua_pushvalue(L, -(params + 1));
+	if (!lua_getinfo(L, ">S", &ar)) {
+		frames.push_back({&calls[origin], std::chrono::steady_clock::now(), 0});
+		return;
+	}
+
+	CallStats* stats = &calls[fmt::format("{:s} {:s}:{:d}", origin, ar.short_src, ar.linedefined)];
+	frames.push_back({stats, std::chrono::steady_clock::now(), 0});
+}
+
+void LuaProfiler::leave()
+{
+	if (frames.empty()) {
+		return;
+	}
+
+	Frame frame = frames.back();
+	frames.pop_back();
+
+	uint64_t micros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - frame.start).count();
+	if (!frames.empty()) {
+		frames.back().children += micros;
+	}
+
+	// the counters were reset while this callback was running
+	if (!frame.stats) {
+		return;
+	}
+
+	CallStats& stats = *frame.stats;
+	++stats.count;
+	stats.total += micros;
+	stats.self += micros - std::min(micros, frame.children);
+	stats.max = std::max(stats.max, micros);
+}
+
+void LuaProfiler::reset()
+{
+	calls.clear();
+	samples.clear();
+	for (Frame& frame : frames) {
+		frame.stats = nullptr;
+	}
+	since = std::chrono::steady_clock::now();
+}
+
+std::string LuaProfiler::getReport(size_t entries/* = 25*/) const
+{
+	std::vector<std::pair<std::string, CallStats>> sortedCalls(calls.begin(), calls.end());
+	std::sort(sortedCalls.begin(), sortedCalls.end(), [](const std::pair<std::string, CallStats>& lhs, const std::pair<std::string, CallStats>& rhs) {
+		return lhs.second.self > rhs.second.self;
+	});
+
+	uint64_t count = 0, busy = 0;
+	for (const auto& it : sortedCalls) {
+		count += it.second.count;
+		busy += it.second.self;
+	}
+
+	auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - since).count();
+
+	std::ostringstream ss;
+	ss << fmt::format("Lua profile over {:.1f}s: {:d} calls, {:.1f} ms in lua, {:.1f}% busy\n", elapsed / 1000., count, busy / 1000., elapsed > 0 ? busy / (elapsed * 10.) : 0.);
+	ss << fmt::format("{:<64s} {:>9s} {:>10s} {:>10s} {:>8s} {:>9s}\n", "callback", "count", "total ms", "self ms", "avg us", "max us");
+	for (size_t i = 0, size = std::min(entries, sortedCalls.size()); i < size; ++i) {
+		const CallStats& stats = sortedCalls[i].second;
+		ss << fmt::format("{:<64s} {:>9d} {:>10.1f} {:>10.1f} {:>8d} {:>9d}\n", sortedCalls[i].first, stats.count, stats.total / 1000., stats.self / 1000.,
+		                  stats.total / std::max<uint64_t>(1, stats.count), stats.max);
+	}
+
+	if (!samples.empty()) {
+		std::vector<std::pair<std::string, uint64_t>> sortedSamples(samples.begin(), samples.end());
+		std::sort(sortedSamples.begin(), sortedSamples.end(), [](const std::pair<std::string, uint64_t>& lhs, const std::pair<std::string, uint64_t>& rhs) {
+			return lhs.second > rhs.second;
+		});
+
+		uint64_t total = 0;
+		for (const auto& it : sortedSamples) {
+			total += it.second;
+		}
+
+		ss << fmt::format("{:<64s} {:>9s} {:>8s}\n", "line", "samples", "share");
+		for (size_t i = 0, size = std::min(entries, sortedSamples.size()); i < size; ++i) {
+			ss << fmt::format("{:<64s} {:>9d} {:>7.1f}%\n", sortedSamples[i].first, sortedSamples[i].second, sortedSamples[i].second * 100. / total);
+		}
+	}
+	return ss.str();
+}
+
+bool LuaProfiler::dumpReport(const std::string& path) const
+{
+	std::ofstream file(path, std::ios::app);
+	if (!file.is_open()) {
+		std::cout << "[Warning - LuaProfiler::dumpReport] Unable to open " << path << " for writing." << std::endl;
+		return false;
+	}
+
+	file << formatDateShort(time(nullptr)) << '\n' << getReport() << std::endl;
+	return true;
+}
+
+void LuaProfiler::scheduleDump(uint32_t interval, const std::string& path)
+{
+	g_scheduler.addEvent(createSchedulerTask(interval, std::bind(&LuaProfiler::dump, this, interval, path)));
+}
+
+void LuaProfiler::dump(uint32_t interval, std::string path)
+{
+	if (enabled) {
+		dumpReport(path);
+		reset();
+	}
+	scheduleDump(interval, path);
+}
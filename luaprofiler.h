@@ -0,0 +1,75 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#ifndef FS_LUAPROFILER_H_3E8B1D6A0F2C4B97A5D4C1E0B9F7A263
+#define FS_LUAPROFILER_H_3E8B1D6A0F2C4B97A5D4C1E0B9F7A263
+
+#include <chrono>
+
+#if __has_include("luajit/lua.hpp")
+#include <luajit/lua.hpp>
+#else
+#include <lua.hpp>
+#endif
+
+// Opt-in accounting of the lua callbacks run by the script interfaces, keyed by
+// the calling interface and the source location of the callback. It can also
+// sample the line being executed every few instructions to find hotspots inside
+// of a callback. Everything happens on the dispatcher thread.
+class LuaProfiler
+{
+	public:
+		struct CallStats {
+			uint64_t count = 0;
+			uint64_t total = 0;
+			uint64_t self = 0;
+			uint64_t max = 0;
+		};
+
+		bool isEnabled() const {
+			return enabled;
+		}
+		void setEnabled(bool value);
+
+		// lua instructions between two line samples, 0 turns sampling off
+		void setSampleInterval(int32_t interval);
+
+		// the state whose execution gets sampled, nullptr once it is closed
+		void attach(lua_State* L);
+
+		// the function to be called sits below its params on the stack
+		void enter(lua_State* L, int params, const std::string& origin);
+		void leave();
+
+		void reset();
+		std::string getReport(size_t entries = 25) const;
+		bool dumpReport(const std::string& path) const;
+
+		// periodically appends the report to the given file and resets the counters
+		void scheduleDump(uint32_t interval, const std::string& path);
+
+	private:
+		struct Frame {
+			CallStats* stats;
+			std::chrono::steady_clock::time_point start;
+			uint64_t children;
+		};
+
+		static void sampleHook(lua_State* L, lua_Debug* ar);
+
+		void updateHook();
+		void dump(uint32_t interval, std::string path);
+
+		bool enabled = false;
+		int32_t sampleInterval = 0;
+		lua_State* state = nullptr;
+
+		std::unordered_map<std::string, CallStats> calls;
+		std::unordered_map<std::string, uint64_t> samples;
+		std::vector<Frame> frames;
+		std::chrono::steady_clock::time_point since = std::chrono::steady_clock::now();
+};
+
+extern LuaProfiler g_luaProfiler;
+
+#endif
@@ -3,11 +3,13 @@
 
 #include "otpch.h"
 
-#include <boost/range/adaptor/reversed.hpp>
+#include <boost/filesystem.hpp>
 #include <fmt/format.h>
+#include <fstream>
 
 #include "luascript.h"
 #include "chat.h"
+#include "json.h"
 #include "player.h"
 #include "game.h"
 #include "protocolstatus.h"
@@ -20,6 +22,14 @@
 #include "bed.h"
 #include "monster.h"
 #include "scheduler.h"
+#include "lockfree.h"
+#include "luafastpaths.h"
+#include "luaprofiler.h"
+#include "memoryaccounting.h"
+#include "purescripts.h"
+#include "taskprofiler.h"
+#include "tracer.h"
+#include "watchdog.h"
 #include "databasetasks.h"
 #include "events.h"
 #include "movement.h"
@@ -288,10 +298,139 @@ int LuaScriptInterface::protectedCall(lua_State* L, int nargs, int nresults)
 	return ret;
 }
 
+namespace {
+
+// the cache of foo.lua lives in foo.luac, a header followed by the output of lua_dump
+struct BytecodeHeader {
+	char magic[4];
+	int64_t mtime;
+	uint64_t hash;
+};
+
+constexpr char BYTECODE_MAGIC[4] = {'F', 'S', 'B', 'C'};
+
+uint64_t hashSource(const std::string& source)
+{
+	// FNV-1a, stable across builds unlike std::hash
+	uint64_t hash = 14695981039346656037ULL;
+	for (char c : source) {
+		hash ^= static_cast<uint8_t>(c);
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+bool readFile(const std::string& path, std::string& contents)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open()) {
+		return false;
+	}
+	contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	return true;
+}
+
+void writeBytecodeCache(const std::string& path, const BytecodeHeader& header, const char* bytecode, size_t size)
+{
+	// written aside and renamed so that a concurrent loader never sees half a file
+	const std::string tmpPath = path + ".tmp";
+	{
+		std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) {
+			return;
+		}
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(bytecode, size);
+		if (!file) {
+			return;
+		}
+	}
+
+	boost::system::error_code ec;
+	boost::filesystem::rename(tmpPath, path, ec);
+}
+
+int appendBytecode(lua_State*, const void* p, size_t size, void* userdata)
+{
+	static_cast<std::string*>(userdata)->append(static_cast<const char*>(p), size);
+	return 0;
+}
+
+}
+
+int LuaScriptInterface::loadCachedFile(lua_State* L, const std::string& file)
+{
+	if (!g_config.getBoolean(ConfigManager::LUA_BYTECODE_CACHE)) {
+		return luaL_loadfile(L, file.c_str());
+	}
+
+	boost::system::error_code ec;
+	int64_t mtime = boost::filesystem::last_write_time(file, ec);
+	if (ec) {
+		return luaL_loadfile(L, file.c_str());
+	}
+
+	const std::string chunkName = '@' + file;
+	const std::string cachePath = file + 'c';
+
+	std::string cache;
+	BytecodeHeader header;
+	bool cached = readFile(cachePath, cache) && cache.size() > sizeof(header);
+	if (cached) {
+		std::memcpy(&header, cache.data(), sizeof(header));
+		cached = std::memcmp(header.magic, BYTECODE_MAGIC, sizeof(BYTECODE_MAGIC)) == 0;
+	}
+
+	// an untouched source is not even read
+	if (cached && header.mtime == mtime) {
+		if (luaL_loadbuffer(L, cache.data() + sizeof(header), cache.size() - sizeof(header), chunkName.c_str()) == 0) {
+			return 0;
+		}
+
+		// written by an incompatible lua build
+		lua_pop(L, 1);
+		cached = false;
+	}
+
+	std::string source;
+	if (!readFile(file, source)) {
+		return luaL_loadfile(L, file.c_str());
+	}
+
+	// luaL_loadfile skips a leading #! line, keep its newline for the line numbers
+	if (!source.empty() && source.front() == '#') {
+		source.erase(0, std::min(source.find('\n'), source.size()));
+	}
+
+	uint64_t hash = hashSource(source);
+	if (cached && header.hash == hash) {
+		if (luaL_loadbuffer(L, cache.data() + sizeof(header), cache.size() - sizeof(header), chunkName.c_str()) == 0) {
+			header.mtime = mtime;
+			writeBytecodeCache(cachePath, header, cache.data() + sizeof(header), cache.size() - sizeof(header));
+			return 0;
+		}
+		lua_pop(L, 1);
+	}
+
+	int ret = luaL_loadbuffer(L, source.data(), source.size(), chunkName.c_str());
+	if (ret != 0) {
+		return ret;
+	}
+
+	std::string bytecode;
+	if (lua_dump(L, appendBytecode, &bytecode) == 0) {
+		std::memcpy(header.magic, BYTECODE_MAGIC, sizeof(BYTECODE_MAGIC));
+		header.mtime = mtime;
+		header.hash = hash;
+		writeBytecodeCache(cachePath, header, bytecode.data(), bytecode.size());
+	}
+	return 0;
+}
+
 int32_t LuaScriptInterface::loadFile(const std::string& file, Npc* npc /* = nullptr*/)
 {
 	//loads file as a chunk at stack top
-	int ret = luaL_loadfile(luaState, file.c_str());
+	int ret = loadCachedFile(luaState, file);
 	if (ret != 0) {
 		lastLuaError = popString(luaState);
 		return -1;
@@ -528,6 +667,12 @@ int LuaScriptInterface::luaErrorHandler(lua_State* L)
 
 bool LuaScriptInterface::callFunction(int params)
 {
+	TraceSpan traceSpan("LuaScriptInterface::callFunction");
+	bool profiled = g_luaProfiler.isEnabled();
+	if (profiled) {
+		g_luaProfiler.enter(luaState, params, getProfilerOrigin());
+	}
+
 	bool result = false;
 	int size = lua_gettop(luaState);
 	if (protectedCall(luaState, params, 1) != 0) {
@@ -541,17 +686,31 @@ bool LuaScriptInterface::callFunction(int params)
 		LuaScriptInterface::reportError(nullptr, "Stack size changed!");
 	}
 
+	if (profiled) {
+		g_luaProfiler.leave();
+	}
+
 	resetScriptEnv();
 	return result;
 }
 
 void LuaScriptInterface::callVoidFunction(int params)
 {
+	TraceSpan traceSpan("LuaScriptInterface::callVoidFunction");
+	bool profiled = g_luaProfiler.isEnabled();
+	if (profiled) {
+		g_luaProfiler.enter(luaState, params, getProfilerOrigin());
+	}
+
 	int size = lua_gettop(luaState);
 	if (protectedCall(luaState, params, 0) != 0) {
 		LuaScriptInterface::reportError(nullptr, LuaScriptInterface::popString(luaState));
 	}
 
+	if (profiled) {
+		g_luaProfiler.leave();
+	}
+
 	if ((lua_gettop(luaState) + params + 1) != size) {
 		LuaScriptInterface::reportError(nullptr, "Stack size changed!");
 	}
@@ -559,6 +718,19 @@ void LuaScriptInterface::callVoidFunction(int params)
 	resetScriptEnv();
 }
 
+std::string LuaScriptInterface::getProfilerOrigin() const
+{
+	// timer callbacks run on the main interface no matter who scheduled them
+	int32_t scriptId, callbackId;
+	bool timerEvent;
+	LuaScriptInterface* scriptInterface;
+	getScriptEnv()->getEventInfo(scriptId, scriptInterface, callbackId, timerEvent);
+	if (timerEvent) {
+		return "addEvent";
+	}
+	return interfaceName;
+}
+
 void LuaScriptInterface::pushVariant(lua_State* L, const LuaVariant& var)
 {
 	lua_createtable(L, 0, 2);
@@ -594,11 +766,9 @@ void LuaScriptInterface::pushThing(lua_State* L, Thing* thing)
 	}
 
 	if (Item* item = thing->getItem()) {
-		pushUserdata<Item>(L, item);
-		setItemMetatable(L, -1, item);
+		pushItem(L, item);
 	} else if (Creature* creature = thing->getCreature()) {
-		pushUserdata<Creature>(L, creature);
-		setCreatureMetatable(L, -1, creature);
+		pushCreature(L, creature);
 	} else {
 		lua_pushnil(L);
 	}
@@ -607,11 +777,9 @@ void LuaScriptInterface::pushThing(lua_State* L, Thing* thing)
 void LuaScriptInterface::pushCylinder(lua_State* L, Cylinder* cylinder)
 {
 	if (Creature* creature = cylinder->getCreature()) {
-		pushUserdata<Creature>(L, creature);
-		setCreatureMetatable(L, -1, creature);
+		pushCreature(L, creature);
 	} else if (Item* parentItem = cylinder->getItem()) {
-		pushUserdata<Item>(L, parentItem);
-		setItemMetatable(L, -1, parentItem);
+		pushItem(L, parentItem);
 	} else if (Tile* tile = cylinder->getTile()) {
 		pushUserdata<Tile>(L, tile);
 		setMetatable(L, -1, "Tile");
@@ -627,6 +795,50 @@ void LuaScriptInterface::pushString(lua_State* L, const std::string& value)
 	lua_pushlstring(L, value.c_str(), value.length());
 }
 
+void LuaScriptInterface::pushJsonValue(lua_State* L, const JsonValue& value)
+{
+	// null becomes nil, arrays then keep a hole at its index
+	if (!lua_checkstack(L, 3)) {
+		lua_pushnil(L);
+		return;
+	}
+
+	switch (value.type) {
+		case JSON_BOOLEAN:
+			pushBoolean(L, value.boolean);
+			break;
+
+		case JSON_NUMBER:
+			lua_pushnumber(L, value.number);
+			break;
+
+		case JSON_STRING:
+			pushString(L, value.string);
+			break;
+
+		case JSON_ARRAY:
+			lua_createtable(L, value.values.size(), 0);
+			for (size_t i = 0; i < value.values.size(); ++i) {
+				pushJsonValue(L, value.values[i]);
+				lua_rawseti(L, -2, i + 1);
+			}
+			break;
+
+		case JSON_OBJECT:
+			lua_createtable(L, 0, value.values.size());
+			for (size_t i = 0; i < value.values.size(); ++i) {
+				pushString(L, value.keys[i]);
+				pushJsonValue(L, value.values[i]);
+				lua_rawset(L, -3);
+			}
+			break;
+
+		default:
+			lua_pushnil(L);
+			break;
+	}
+}
+
 void LuaScriptInterface::pushCallback(lua_State* L, int32_t callback)
 {
 	lua_rawgeti(L, LUA_REGISTRYINDEX, callback);
@@ -690,6 +902,116 @@ void LuaScriptInterface::setWeakMetatable(lua_State* L, int32_t index, const std
 	lua_setmetatable(L, index - 1);
 }
 
+namespace {
+
+// a position pushed as userdata instead of a table, so pushing one is a
+// single allocation and reading one back no field lookups. It starts with a
+// null pointer, code that takes it for an object userdata finds no object
+struct LuaPosition {
+	void* object;
+	Position position;
+	int32_t stackpos;
+};
+
+LuaPosition* getPositionValue(lua_State* L, int32_t arg)
+{
+	void* userdata = lua_touserdata(L, arg);
+	if (!userdata || lua_type(L, arg) != LUA_TUSERDATA || !lua_getmetatable(L, arg)) {
+		return nullptr;
+	}
+
+	luaL_getmetatable(L, "PositionValue");
+	bool isPosition = lua_rawequal(L, -1, -2) != 0;
+	lua_pop(L, 2);
+	return isPosition ? static_cast<LuaPosition*>(userdata) : nullptr;
+}
+
+// reuses the userdata of a live object as long as lua still references it,
+// creatures are keyed by id and items by address
+void pushCachedUserdata(lua_State* L, void* value, uint32_t id, const char* metatable)
+{
+	lua_getfield(L, LUA_REGISTRYINDEX, "UserdataCache");
+	if (!lua_istable(L, -1)) {
+		lua_pop(L, 1);
+		lua_newtable(L);
+		lua_createtable(L, 0, 1);
+		lua_pushstring(L, "v");
+		lua_setfield(L, -2, "__mode");
+		lua_setmetatable(L, -2);
+		lua_pushvalue(L, -1);
+		lua_setfield(L, LUA_REGISTRYINDEX, "UserdataCache");
+	}
+
+	int cache = lua_gettop(L);
+	if (id != 0) {
+		lua_pushnumber(L, id);
+	} else {
+		lua_pushlightuserdata(L, value);
+	}
+
+	lua_pushvalue(L, -1);
+	lua_rawget(L, cache);
+
+	// the cached userdata is stale once removed, transformed or its address got reused by another type
+	void** userdata = static_cast<void**>(lua_touserdata(L, -1));
+	if (userdata && *userdata == value && lua_getmetatable(L, -1)) {
+		luaL_getmetatable(L, metatable);
+		bool valid = lua_rawequal(L, -1, -2) != 0;
+		lua_pop(L, 2);
+		if (valid) {
+			lua_replace(L, cache);
+			lua_settop(L, cache);
+			return;
+		}
+	}
+	lua_pop(L, 1);
+
+	userdata = static_cast<void**>(lua_newuserdata(L, sizeof(void*)));
+	*userdata = value;
+	luaL_getmetatable(L, metatable);
+	lua_setmetatable(L, -2);
+
+	// cache[key] = userdata, leaving only the userdata on the stack
+	lua_pushvalue(L, -1);
+	lua_insert(L, cache);
+	lua_rawset(L, cache + 1);
+	lua_pop(L, 1);
+}
+
+}
+
+void LuaScriptInterface::pushItem(lua_State* L, Item* item)
+{
+	if (!item) {
+		lua_pushnil(L);
+		return;
+	}
+
+	const char* metatable = "Item";
+	if (item->getContainer()) {
+		metatable = "Container";
+	} else if (item->getTeleport()) {
+		metatable = "Teleport";
+	}
+	pushCachedUserdata(L, item, 0, metatable);
+}
+
+void LuaScriptInterface::pushCreature(lua_State* L, Creature* creature)
+{
+	if (!creature) {
+		lua_pushnil(L);
+		return;
+	}
+
+	const char* metatable = "Npc";
+	if (creature->getPlayer()) {
+		metatable = "Player";
+	} else if (creature->getMonster()) {
+		metatable = "Monster";
+	}
+	pushCachedUserdata(L, creature, creature->getID(), metatable);
+}
+
 void LuaScriptInterface::setItemMetatable(lua_State* L, int32_t index, const Item* item)
 {
 	if (item->getContainer()) {
@@ -727,6 +1049,11 @@ std::string LuaScriptInterface::getString(lua_State* L, int32_t arg)
 
 Position LuaScriptInterface::getPosition(lua_State* L, int32_t arg, int32_t& stackpos)
 {
+	if (const LuaPosition* value = getPositionValue(L, arg)) {
+		stackpos = value->stackpos;
+		return value->position;
+	}
+
 	Position position;
 	position.x = getField<uint16_t>(L, arg, "x");
 	position.y = getField<uint16_t>(L, arg, "y");
@@ -745,6 +1072,10 @@ Position LuaScriptInterface::getPosition(lua_State* L, int32_t arg, int32_t& sta
 
 Position LuaScriptInterface::getPosition(lua_State* L, int32_t arg)
 {
+	if (const LuaPosition* value = getPositionValue(L, arg)) {
+		return value->position;
+	}
+
 	Position position;
 	position.x = getField<uint16_t>(L, arg, "x");
 	position.y = getField<uint16_t>(L, arg, "y");
@@ -882,6 +1213,11 @@ std::string LuaScriptInterface::getFieldString(lua_State* L, int32_t arg, const
 	return getString(L, -1);
 }
 
+bool LuaScriptInterface::isPosition(lua_State* L, int32_t arg)
+{
+	return isTable(L, arg) || getPositionValue(L, arg);
+}
+
 LuaDataType LuaScriptInterface::getUserdataType(lua_State* L, int32_t arg)
 {
 	if (lua_getmetatable(L, arg) == 0) {
@@ -927,6 +1263,15 @@ void LuaScriptInterface::pushInstantSpell(lua_State* L, const InstantSpell& spel
 
 void LuaScriptInterface::pushPosition(lua_State* L, const Position& position, int32_t stackpos/* = 0*/)
 {
+	if (g_config.getBoolean(ConfigManager::LUA_POSITION_USERDATA)) {
+		LuaPosition* value = static_cast<LuaPosition*>(lua_newuserdata(L, sizeof(LuaPosition)));
+		value->object = nullptr;
+		value->position = position;
+		value->stackpos = stackpos;
+		setMetatable(L, -1, "PositionValue");
+		return;
+	}
+
 	lua_createtable(L, 0, 4);
 
 	setField(L, "x", position.x);
@@ -1773,6 +2118,7 @@ void LuaScriptInterface::registerFunctions()
 	registerEnum(TILESTATE_FLOORCHANGE_SOUTH_ALT)
 	registerEnum(TILESTATE_FLOORCHANGE_EAST_ALT)
 	registerEnum(TILESTATE_SUPPORTS_HANGABLE)
+	registerEnum(TILESTATE_BLOCKPROJECTILE)
 
 	registerEnum(WEAPON_NONE)
 	registerEnum(WEAPON_SWORD)
@@ -2020,6 +2366,8 @@ void LuaScriptInterface::registerFunctions()
 	registerEnumIn("configKeys", ConfigManager::REPLACE_KICK_ON_LOGIN)
 	registerEnumIn("configKeys", ConfigManager::ALLOW_CLONES)
 	registerEnumIn("configKeys", ConfigManager::BIND_ONLY_GLOBAL_ADDRESS)
+	registerEnumIn("configKeys", ConfigManager::GAME_SOCKET_NODELAY)
+	registerEnumIn("configKeys", ConfigManager::LOGIN_SOCKET_NODELAY)
 	registerEnumIn("configKeys", ConfigManager::OPTIMIZE_DATABASE)
 	registerEnumIn("configKeys", ConfigManager::MARKET_PREMIUM)
 	registerEnumIn("configKeys", ConfigManager::EMOTE_SPELLS)
@@ -2083,6 +2431,13 @@ void LuaScriptInterface::registerFunctions()
 	registerEnumIn("configKeys", ConfigManager::GAME_PORT)
 	registerEnumIn("configKeys", ConfigManager::LOGIN_PORT)
 	registerEnumIn("configKeys", ConfigManager::STATUS_PORT)
+	registerEnumIn("configKeys", ConfigManager::GAME_SOCKET_SEND_BUFFER)
+	registerEnumIn("configKeys", ConfigManager::GAME_SOCKET_RECEIVE_BUFFER)
+	registerEnumIn("configKeys", ConfigManager::GAME_WRITE_HIGH_WATERMARK)
+	registerEnumIn("configKeys", ConfigManager::GAME_WRITE_LOW_WATERMARK)
+	registerEnumIn("configKeys", ConfigManager::LOGIN_SOCKET_SEND_BUFFER)
+	registerEnumIn("configKeys", ConfigManager::LOGIN_SOCKET_RECEIVE_BUFFER)
+	registerEnumIn("configKeys", ConfigManager::METRICS_PORT)
 	registerEnumIn("configKeys", ConfigManager::STAIRHOP_DELAY)
 	registerEnumIn("configKeys", ConfigManager::MARKET_OFFER_DURATION)
 	registerEnumIn("configKeys", ConfigManager::CHECK_EXPIRED_MARKET_OFFERS_EACH_MINUTES)
@@ -2090,6 +2445,41 @@ void LuaScriptInterface::registerFunctions()
 	registerEnumIn("configKeys", ConfigManager::EXP_FROM_PLAYERS_LEVEL_RANGE)
 	registerEnumIn("configKeys", ConfigManager::MAX_PACKETS_PER_SECOND)
 	registerEnumIn("configKeys", ConfigManager::PLAYER_CONSOLE_LOGS)
+	registerEnumIn("configKeys", ConfigManager::DISPATCHER_PROFILER)
+	registerEnumIn("configKeys", ConfigManager::DISPATCHER_PROFILER_FILE)
+	registerEnumIn("configKeys", ConfigManager::DISPATCHER_PROFILER_INTERVAL)
+	registerEnumIn("configKeys", ConfigManager::LUA_PROFILER)
+	registerEnumIn("configKeys", ConfigManager::LUA_BYTECODE_CACHE)
+	registerEnumIn("configKeys", ConfigManager::LAZY_MAP_LOADING)
+	registerEnumIn("configKeys", ConfigManager::LUA_PROFILER_FILE)
+	registerEnumIn("configKeys", ConfigManager::LUA_PROFILER_INTERVAL)
+	registerEnumIn("configKeys", ConfigManager::LUA_PROFILER_SAMPLE_INTERVAL)
+	registerEnumIn("configKeys", ConfigManager::RAID_FLOW_FIELD_PATHING)
+	registerEnumIn("configKeys", ConfigManager::PACKET_COMPRESSION)
+	registerEnumIn("configKeys", ConfigManager::PACKET_FLOOD_CONTROL)
+	registerEnumIn("configKeys", ConfigManager::ASYNC_GLOBAL_SAVE)
+	registerEnumIn("configKeys", ConfigManager::BATCH_HEALTH_UPDATES)
+	registerEnumIn("configKeys", ConfigManager::THINK_LEVEL_OF_DETAIL)
+	registerEnumIn("configKeys", ConfigManager::COALESCE_PLAYER_UPDATES)
+	registerEnumIn("configKeys", ConfigManager::LUA_GC_GENERATIONAL)
+	registerEnumIn("configKeys", ConfigManager::ITEM_BLOB_STORAGE)
+	registerEnumIn("configKeys", ConfigManager::BATCH_CREATURE_MOVES)
+	registerEnumIn("configKeys", ConfigManager::PATHFINDING_THREADS)
+	registerEnumIn("configKeys", ConfigManager::NETWORK_THREADS)
+	registerEnumIn("configKeys", ConfigManager::LOGIN_THREADS)
+	registerEnumIn("configKeys", ConfigManager::BULK_OUTPUT_BUDGET)
+	registerEnumIn("configKeys", ConfigManager::DATABASE_WORKERS)
+	registerEnumIn("configKeys", ConfigManager::ACCOUNT_CACHE_DURATION)
+	registerEnumIn("configKeys", ConfigManager::PACKET_COMPRESSION_THRESHOLD)
+	registerEnumIn("configKeys", ConfigManager::PACKET_COMPRESSION_LEVEL)
+	registerEnumIn("configKeys", ConfigManager::RANDOM_SEED)
+	registerEnumIn("configKeys", ConfigManager::BAN_CACHE_INTERVAL)
+	registerEnumIn("configKeys", ConfigManager::RAID_SPAWNS_PER_TICK)
+	registerEnumIn("configKeys", ConfigManager::SLOW_TASK_THRESHOLD)
+	registerEnumIn("configKeys", ConfigManager::LUA_GC_PAUSE)
+	registerEnumIn("configKeys", ConfigManager::LUA_GC_STEP_MULTIPLIER)
+	registerEnumIn("configKeys", ConfigManager::LUA_GC_IDLE_STEP_SIZE)
+	registerEnumIn("configKeys", ConfigManager::LUA_GC_IDLE_BUDGET)
 
 	// os
 	registerMethod("os", "mtime", LuaScriptInterface::luaSystemTime);
@@ -2102,8 +2492,14 @@ void LuaScriptInterface::registerFunctions()
 	registerTable("Game");
 
 	registerMethod("Game", "getSpectators", LuaScriptInterface::luaGameGetSpectators);
+	registerMethod("Game", "countSpectators", LuaScriptInterface::luaGameCountSpectators);
+	registerMethod("Game", "forEachSpectator", LuaScriptInterface::luaGameForEachSpectator);
+	registerMethod("Game", "sendMagicEffectArea", LuaScriptInterface::luaGameSendMagicEffectArea);
+	registerMethod("Game", "broadcastToArea", LuaScriptInterface::luaGameBroadcastToArea);
 	registerMethod("Game", "getPlayers", LuaScriptInterface::luaGameGetPlayers);
 	registerMethod("Game", "loadMap", LuaScriptInterface::luaGameLoadMap);
+	registerMethod("Game", "createInstance", LuaScriptInterface::luaGameCreateInstance);
+	registerMethod("Game", "destroyInstance", LuaScriptInterface::luaGameDestroyInstance);
 
 	registerMethod("Game", "getExperienceStage", LuaScriptInterface::luaGameGetExperienceStage);
 	registerMethod("Game", "getExperienceForLevel", LuaScriptInterface::luaGameGetExperienceForLevel);
@@ -2111,6 +2507,7 @@ void LuaScriptInterface::registerFunctions()
 	registerMethod("Game", "getPlayerCount", LuaScriptInterface::luaGameGetPlayerCount);
 	registerMethod("Game", "getNpcCount", LuaScriptInterface::luaGameGetNpcCount);
 	registerMethod("Game", "getMonsterTypes", LuaScriptInterface::luaGameGetMonsterTypes);
+	registerMethod("Game", "getItemIdsByPrefix", LuaScriptInterface::luaGameGetItemIdsByPrefix);
 
 	registerMethod("Game", "getTowns", LuaScriptInterface::luaGameGetTowns);
 	registerMethod("Game", "getHouses", LuaScriptInterface::luaGameGetHouses);
@@ -2132,6 +2529,8 @@ void LuaScriptInterface::registerFunctions()
 	registerMethod("Game", "createTile", LuaScriptInterface::luaGameCreateTile);
 	registerMethod("Game", "createMonsterType", LuaScriptInterface::luaGameCreateMonsterType);
 
+	registerMethod("Game", "moveItems", LuaScriptInterface::luaGameMoveItems);
+
 	registerMethod("Game", "startRaid", LuaScriptInterface::luaGameStartRaid);
 
 	registerMethod("Game", "getClientVersion", LuaScriptInterface::luaGameGetClientVersion);
@@ -2142,6 +2541,15 @@ void LuaScriptInterface::registerFunctions()
 	registerMethod("Game", "setAccountStorageValue", LuaScriptInterface::luaGameSetAccountStorageValue);
 	registerMethod("Game", "saveAccountStorageValues", LuaScriptInterface::luaGameSaveAccountStorageValues);
 
+	registerMethod("Game", "getDispatcherProfile", LuaScriptInterface::luaGameGetDispatcherProfile);
+	registerMethod("Game", "setDispatcherProfilerEnabled", LuaScriptInterface::luaGameSetDispatcherProfilerEnabled);
+	registerMethod("Game", "getLuaProfile", LuaScriptInterface::luaGameGetLuaProfile);
+	registerMethod("Game", "setLuaProfilerEnabled", LuaScriptInterface::luaGameSetLuaProfilerEnabled);
+	registerMethod("Game", "setTracingEnabled", LuaScriptInterface::luaGameSetTracingEnabled);
+	registerMethod("Game", "dumpTrace", LuaScriptInterface::luaGameDumpTrace);
+	registerMethod("Game", "getMemoryUsage", LuaScriptInterface::luaGameGetMemoryUsage);
+	registerMethod("Game", "sleep", LuaScriptInterface::luaGameSleep);
+
 	// Variant
 	registerClass("Variant", "", LuaScriptInterface::luaVariantCreate);
 
@@ -2161,6 +2569,20 @@ void LuaScriptInterface::registerFunctions()
 	registerMethod("Position", "sendMagicEffect", LuaScriptInterface::luaPositionSendMagicEffect);
 	registerMethod("Position", "sendDistanceEffect", LuaScriptInterface::luaPositionSendDistanceEffect);
 
+	// positions pushed as userdata read their fields through __index and share the methods of Position
+	luaL_newmetatable(luaState, "PositionValue");
+	lua_pushcfunction(luaState, LuaScriptInterface::luaPositionValueIndex);
+	lua_setfield(luaState, -2, "__index");
+	lua_pushcfunction(luaState, LuaScriptInterface::luaPositionValueNewIndex);
+	lua_setfield(luaState, -2, "__newindex");
+	lua_pushcfunction(luaState, LuaScriptInterface::luaPositionAdd);
+	lua_setfield(luaState, -2, "__add");
+	lua_pushcfunction(luaState, LuaScriptInterface::luaPositionSub);
+	lua_setfield(luaState, -2, "__sub");
+	lua_pushcfunction(luaState, LuaScriptInterface::luaPositionCompare);
+	lua_setfield(luaState, -2, "__eq");
+	lua_pop(luaState, 1);
+
 	// Tile
 	registerClass("Tile", "", LuaScriptInterface::luaTileCreate);
 	registerMetaMethod("Tile", "__eq", LuaScriptInterface::luaUserdataCompare);
@@ -2591,6 +3013,7 @@ void LuaScriptInterface::registerFunctions()
 	registerMethod("Player", "isPzLocked", LuaScriptInterface::luaPlayerIsPzLocked);
 
 	registerMethod("Player", "getClient", LuaScriptInterface::luaPlayerGetClient);
+	registerMethod("Player", "getNetworkStats", LuaScriptInterface::luaPlayerGetNetworkStats);
 
 	registerMethod("Player", "getHouse", LuaScriptInterface::luaPlayerGetHouse);
 	registerMethod("Player", "sendHouseWindow", LuaScriptInterface::luaPlayerSendHouseWindow);
@@ -2861,6 +3284,7 @@ void LuaScriptInterface::registerFunctions()
 	registerMethod("Combat", "addCondition", LuaScriptInterface::luaCombatAddCondition);
 	registerMethod("Combat", "clearConditions", LuaScriptInterface::luaCombatClearConditions);
 	registerMethod("Combat", "setCallback", LuaScriptInterface::luaCombatSetCallback);
+	registerMethod("Combat", "setPureCallback", LuaScriptInterface::luaCombatSetPureCallback);
 	registerMethod("Combat", "setOrigin", LuaScriptInterface::luaCombatSetOrigin);
 
 	registerMethod("Combat", "execute", LuaScriptInterface::luaCombatExecute);
@@ -2915,6 +3339,7 @@ void LuaScriptInterface::registerFunctions()
 	registerMethod("MonsterType", "canWalkOnFire", LuaScriptInterface::luaMonsterTypeCanWalkOnFire);
 	registerMethod("MonsterType", "canWalkOnPoison", LuaScriptInterface::luaMonsterTypeCanWalkOnPoison);
 
+	registerMethod("MonsterType", "id", LuaScriptInterface::luaMonsterTypeId);
 	registerMethod("MonsterType", "name", LuaScriptInterface::luaMonsterTypeName);
 	registerMethod("MonsterType", "nameDescription", LuaScriptInterface::luaMonsterTypeNameDescription);
 
@@ -2941,6 +3366,7 @@ void LuaScriptInterface::registerFunctions()
 
 	registerMethod("MonsterType", "getLoot", LuaScriptInterface::luaMonsterTypeGetLoot);
 	registerMethod("MonsterType", "addLoot", LuaScriptInterface::luaMonsterTypeAddLoot);
+	registerMethod("MonsterType", "createLoot", LuaScriptInterface::luaMonsterTypeCreateLoot);
 
 	registerMethod("MonsterType", "getCreatureEvents", LuaScriptInterface::luaMonsterTypeGetCreatureEvents);
 	registerMethod("MonsterType", "registerEvent", LuaScriptInterface::luaMonsterTypeRegisterEvent);
@@ -3006,6 +3432,7 @@ void LuaScriptInterface::registerFunctions()
 	registerMethod("MonsterSpell", "setCombatLength", LuaScriptInterface::luaMonsterSpellSetCombatLength);
 	registerMethod("MonsterSpell", "setCombatSpread", LuaScriptInterface::luaMonsterSpellSetCombatSpread);
 	registerMethod("MonsterSpell", "setCombatRadius", LuaScriptInterface::luaMonsterSpellSetCombatRadius);
+	registerMethod("MonsterSpell", "setCombatArea", LuaScriptInterface::luaMonsterSpellSetCombatArea);
 	registerMethod("MonsterSpell", "setConditionType", LuaScriptInterface::luaMonsterSpellSetConditionType);
 	registerMethod("MonsterSpell", "setConditionDamage", LuaScriptInterface::luaMonsterSpellSetConditionDamage);
 	registerMethod("MonsterSpell", "setConditionSpeedChange", LuaScriptInterface::luaMonsterSpellSetConditionSpeedChange);
@@ -3109,6 +3536,8 @@ void LuaScriptInterface::registerFunctions()
 	registerClass("CreatureEvent", "", LuaScriptInterface::luaCreateCreatureEvent);
 	registerMethod("CreatureEvent", "type", LuaScriptInterface::luaCreatureEventType);
 	registerMethod("CreatureEvent", "register", LuaScriptInterface::luaCreatureEventRegister);
+	registerMethod("CreatureEvent", "opcode", LuaScriptInterface::luaCreatureEventOpcode);
+	registerMethod("CreatureEvent", "decode", LuaScriptInterface::luaCreatureEventDecode);
 	registerMethod("CreatureEvent", "onLogin", LuaScriptInterface::luaCreatureEventOnCallback);
 	registerMethod("CreatureEvent", "onLogout", LuaScriptInterface::luaCreatureEventOnCallback);
 	registerMethod("CreatureEvent", "onThink", LuaScriptInterface::luaCreatureEventOnCallback);
@@ -3832,25 +4261,22 @@ int LuaScriptInterface::luaAddEvent(lua_State* L)
 		}
 	}
 
+	uint32_t delay = std::max<uint32_t>(100, getNumber<uint32_t>(L, 2));
+
+	// {callback, parameters...}, nil parameters simply leave holes
 	LuaTimerEventDesc eventDesc;
-	eventDesc.parameters.reserve(parameters - 2); // safe to use -2 since we garanteed that there is at least two parameters
-	for (int i = 0; i < parameters - 2; ++i) {
-		eventDesc.parameters.push_back(luaL_ref(L, LUA_REGISTRYINDEX));
+	eventDesc.parameters = parameters - 2;
+	lua_createtable(L, parameters - 1, 0);
+	lua_pushvalue(L, 1);
+	lua_rawseti(L, -2, 1);
+	for (int i = 1; i <= eventDesc.parameters; ++i) {
+		lua_pushvalue(L, i + 2);
+		lua_rawseti(L, -2, i + 1);
 	}
 
-	uint32_t delay = std::max<uint32_t>(100, getNumber<uint32_t>(L, 2));
-	lua_pop(L, 1);
-
-	eventDesc.function = luaL_ref(L, LUA_REGISTRYINDEX);
+	eventDesc.reference = luaL_ref(L, LUA_REGISTRYINDEX);
 	eventDesc.scriptId = getScriptEnv()->getScriptId();
-
-	auto& lastTimerEventId = g_luaEnvironment.lastEventTimerId;
-	eventDesc.eventId = g_scheduler.addEvent(createSchedulerTask(
-		delay, std::bind(&LuaEnvironment::executeTimerEvent, &g_luaEnvironment, lastTimerEventId)
-	));
-
-	g_luaEnvironment.timerEvents.emplace(lastTimerEventId, std::move(eventDesc));
-	lua_pushnumber(L, lastTimerEventId++);
+	lua_pushnumber(L, g_luaEnvironment.addTimerEvent(std::move(eventDesc), delay));
 	return 1;
 }
 
@@ -3866,16 +4292,10 @@ int LuaScriptInterface::luaStopEvent(lua_State* L)
 		return 1;
 	}
 
-	LuaTimerEventDesc timerEventDesc = std::move(it->second);
+	// its slot skips the event once it is gone
+	luaL_unref(L, LUA_REGISTRYINDEX, it->second.reference);
 	timerEvents.erase(it);
 
-	g_scheduler.stopEvent(timerEventDesc.eventId);
-	luaL_unref(L, LUA_REGISTRYINDEX, timerEventDesc.function);
-
-	for (auto parameter : timerEventDesc.parameters) {
-		luaL_unref(L, LUA_REGISTRYINDEX, parameter);
-	}
-
 	pushBoolean(L, true);
 	return 1;
 }
@@ -4064,6 +4484,8 @@ const luaL_Reg LuaScriptInterface::luaDatabaseTable[] = {
 	{"asyncQuery", LuaScriptInterface::luaDatabaseAsyncExecute},
 	{"storeQuery", LuaScriptInterface::luaDatabaseStoreQuery},
 	{"asyncStoreQuery", LuaScriptInterface::luaDatabaseAsyncStoreQuery},
+	{"awaitQuery", LuaScriptInterface::luaDatabaseAwaitQuery},
+	{"awaitStoreQuery", LuaScriptInterface::luaDatabaseAwaitStoreQuery},
 	{"escapeString", LuaScriptInterface::luaDatabaseEscapeString},
 	{"escapeBlob", LuaScriptInterface::luaDatabaseEscapeBlob},
 	{"lastInsertId", LuaScriptInterface::luaDatabaseLastInsertId},
@@ -4119,6 +4541,10 @@ int LuaScriptInterface::luaDatabaseStoreQuery(lua_State* L)
 
 int LuaScriptInterface::luaDatabaseAsyncStoreQuery(lua_State* L)
 {
+	// db.asyncStoreQuery(query[, callback[, replica = false]])
+	bool replica = getBoolean(L, 3, false);
+	lua_settop(L, std::min(lua_gettop(L), 2));
+
 	std::function<void(DBResult_ptr, bool)> callback;
 	if (lua_gettop(L) > 1) {
 		int32_t ref = luaL_ref(L, LUA_REGISTRYINDEX);
@@ -4147,10 +4573,75 @@ int LuaScriptInterface::luaDatabaseAsyncStoreQuery(lua_State* L)
 			luaL_unref(luaState, LUA_REGISTRYINDEX, ref);
 		};
 	}
-	g_databaseTasks.addTask(getString(L, -1), callback, true);
+	g_databaseTasks.addTask(getString(L, -1), callback, true, false, replica);
 	return 0;
 }
 
+int LuaScriptInterface::luaDatabaseAwaitQuery(lua_State* L)
+{
+	// db.awaitQuery(query) from a coroutine, resumes with the success
+	uint32_t coroutineId = g_luaEnvironment.suspendCoroutine(L);
+	if (coroutineId == 0) {
+		reportErrorFunc(L, "db.awaitQuery can only be called from a coroutine.");
+		pushBoolean(L, false);
+		return 1;
+	}
+
+	std::string query = getString(L, 1);
+	auto resume = [coroutineId](DBResult_ptr, bool success) {
+		g_luaEnvironment.resumeCoroutine(coroutineId, [success](lua_State* L) {
+			pushBoolean(L, success);
+			return 1;
+		});
+	};
+
+	bool queued = g_databaseTasks.addJob([query](Database& db) {
+		return db.executeQuery(query);
+	}, resume);
+
+	// the coroutine is resumed once it has yielded, never in place
+	if (!queued) {
+		g_dispatcher.addTask(createTask(std::bind(resume, nullptr, Database::getInstance().executeQuery(query))));
+	}
+	return lua_yield(L, 0);
+}
+
+int LuaScriptInterface::luaDatabaseAwaitStoreQuery(lua_State* L)
+{
+	// db.awaitStoreQuery(query[, replica = false]) from a coroutine, resumes with the result id or false
+	bool replica = getBoolean(L, 2, false);
+	uint32_t coroutineId = g_luaEnvironment.suspendCoroutine(L);
+	if (coroutineId == 0) {
+		reportErrorFunc(L, "db.awaitStoreQuery can only be called from a coroutine.");
+		pushBoolean(L, false);
+		return 1;
+	}
+
+	std::string query = getString(L, 1);
+	auto result = std::make_shared<DBResult_ptr>();
+	auto resume = [coroutineId, result](DBResult_ptr, bool) {
+		g_luaEnvironment.resumeCoroutine(coroutineId, [result](lua_State* L) {
+			if (*result) {
+				lua_pushnumber(L, ScriptEnvironment::addResult(*result));
+			} else {
+				pushBoolean(L, false);
+			}
+			return 1;
+		});
+	};
+
+	bool queued = g_databaseTasks.addJob([query, result](Database& db) {
+		*result = db.storeQuery(query);
+		return true;
+	}, resume, 0, replica);
+
+	if (!queued) {
+		*result = Database::getInstance().storeQuery(query);
+		g_dispatcher.addTask(createTask(std::bind(resume, nullptr, true)));
+	}
+	return lua_yield(L, 0);
+}
+
 int LuaScriptInterface::luaDatabaseEscapeString(lua_State* L)
 {
 	pushString(L, Database::getInstance().escapeString(getString(L, -1)));
@@ -4338,13 +4829,158 @@ int LuaScriptInterface::luaGameGetSpectators(lua_State* L)
 
 	int index = 0;
 	for (Creature* creature : spectators) {
-		pushUserdata<Creature>(L, creature);
-		setCreatureMetatable(L, -1, creature);
+		pushCreature(L, creature);
 		lua_rawseti(L, -2, ++index);
 	}
 	return 1;
 }
 
+int LuaScriptInterface::luaGameCountSpectators(lua_State* L)
+{
+	// Game.countSpectators(position[, multifloor = false[, onlyPlayer = false[, minRangeX = 0[, maxRangeX = 0[, minRangeY = 0[, maxRangeY = 0]]]]]])
+	const Position& position = getPosition(L, 1);
+	bool multifloor = getBoolean(L, 2, false);
+	bool onlyPlayers = getBoolean(L, 3, false);
+	int32_t minRangeX = getNumber<int32_t>(L, 4, 0);
+	int32_t maxRangeX = getNumber<int32_t>(L, 5, 0);
+	int32_t minRangeY = getNumber<int32_t>(L, 6, 0);
+	int32_t maxRangeY = getNumber<int32_t>(L, 7, 0);
+
+	SpectatorVec spectators;
+	g_game.map.getSpectators(spectators, position, multifloor, onlyPlayers, minRangeX, maxRangeX, minRangeY, maxRangeY);
+	lua_pushnumber(L, spectators.size());
+	return 1;
+}
+
+int LuaScriptInterface::luaGameForEachSpectator(lua_State* L)
+{
+	// Game.forEachSpectator(position, filter, callback)
+	// filter = {multifloor = false, onlyPlayers = false, minRangeX = 0, maxRangeX = 0, minRangeY = 0, maxRangeY = 0} or nil
+	// iteration stops once the callback returns false, returns the number of visited creatures
+	if (!isFunction(L, 3)) {
+		reportErrorFunc(L, "callback parameter should be a function.");
+		pushBoolean(L, false);
+		return 1;
+	}
+
+	const Position& position = getPosition(L, 1);
+	bool multifloor = false;
+	bool onlyPlayers = false;
+	int32_t minRangeX = 0, maxRangeX = 0, minRangeY = 0, maxRangeY = 0;
+	if (isTable(L, 2)) {
+		lua_getfield(L, 2, "multifloor");
+		multifloor = getBoolean(L, -1);
+		lua_getfield(L, 2, "onlyPlayers");
+		onlyPlayers = getBoolean(L, -1);
+		minRangeX = getField<int32_t>(L, 2, "minRangeX");
+		maxRangeX = getField<int32_t>(L, 2, "maxRangeX");
+		minRangeY = getField<int32_t>(L, 2, "minRangeY");
+		maxRangeY = getField<int32_t>(L, 2, "maxRangeY");
+		lua_pop(L, 6);
+	}
+
+	SpectatorVec spectators;
+	g_game.map.getSpectators(spectators, position, multifloor, onlyPlayers, minRangeX, maxRangeX, minRangeY, maxRangeY);
+
+	// the callback may remove any of them, keep them alive until the loop is done
+	for (Creature* creature : spectators) {
+		creature->incrementReferenceCounter();
+	}
+
+	int32_t count = 0;
+	int error = 0;
+	for (Creature* creature : spectators) {
+		if (creature->isRemoved()) {
+			continue;
+		}
+
+		lua_pushvalue(L, 3);
+		pushCreature(L, creature);
+		error = lua_pcall(L, 1, 1, 0);
+		if (error != 0) {
+			break;
+		}
+
+		++count;
+		bool stop = lua_isboolean(L, -1) && !lua_toboolean(L, -1);
+		lua_pop(L, 1);
+		if (stop) {
+			break;
+		}
+	}
+
+	for (Creature* creature : spectators) {
+		creature->decrementReferenceCounter();
+	}
+
+	if (error != 0) {
+		return lua_error(L);
+	}
+
+	lua_pushnumber(L, count);
+	return 1;
+}
+
+int LuaScriptInterface::luaGameSendMagicEffectArea(lua_State* L)
+{
+	// Game.sendMagicEffectArea(fromPosition, toPosition, magicEffect)
+	const Position& fromPosition = getPosition(L, 1);
+	const Position& toPosition = getPosition(L, 2);
+	MagicEffectClasses magicEffect = getNumber<MagicEffectClasses>(L, 3);
+	if (fromPosition.z != toPosition.z) {
+		reportErrorFunc(L, "positions must be on the same floor.");
+		pushBoolean(L, false);
+		return 1;
+	}
+
+	int32_t minX = std::min(fromPosition.x, toPosition.x), maxX = std::max(fromPosition.x, toPosition.x);
+	int32_t minY = std::min(fromPosition.y, toPosition.y), maxY = std::max(fromPosition.y, toPosition.y);
+	if (maxX - minX > Map::maxClientViewportX * 2 || maxY - minY > Map::maxClientViewportY * 2) {
+		reportErrorFunc(L, "area must fit on one screen.");
+		pushBoolean(L, false);
+		return 1;
+	}
+
+	// one lookup around the whole area, every player gets the effects it can see
+	Position center((minX + maxX) / 2, (minY + maxY) / 2, fromPosition.z);
+	SpectatorVec spectators;
+	g_game.map.getSpectators(spectators, center, true, true, center.x - minX + Map::maxViewportX, maxX - center.x + Map::maxViewportX,
+	                         center.y - minY + Map::maxViewportY, maxY - center.y + Map::maxViewportY);
+	for (Creature* spectator : spectators) {
+		Player* player = spectator->getPlayer();
+		for (int32_t y = minY; y <= maxY; ++y) {
+			for (int32_t x = minX; x <= maxX; ++x) {
+				player->sendMagicEffect(Position(x, y, fromPosition.z), magicEffect);
+			}
+		}
+	}
+
+	pushBoolean(L, true);
+	return 1;
+}
+
+int LuaScriptInterface::luaGameBroadcastToArea(lua_State* L)
+{
+	// Game.broadcastToArea(position, type, text[, multifloor = false[, minRangeX = 0[, maxRangeX = 0[, minRangeY = 0[, maxRangeY = 0]]]]])
+	// returns the number of players that got the message
+	const Position& position = getPosition(L, 1);
+	TextMessage message(getNumber<MessageClasses>(L, 2), getString(L, 3));
+	bool multifloor = getBoolean(L, 4, false);
+	int32_t minRangeX = getNumber<int32_t>(L, 5, 0);
+	int32_t maxRangeX = getNumber<int32_t>(L, 6, 0);
+	int32_t minRangeY = getNumber<int32_t>(L, 7, 0);
+	int32_t maxRangeY = getNumber<int32_t>(L, 8, 0);
+
+	SpectatorVec spectators;
+	g_game.map.getSpectators(spectators, position, multifloor, true, minRangeX, maxRangeX, minRangeY, maxRangeY);
+	for (Creature* spectator : spectators) {
+		spectator->getPlayer()->sendTextMessage(message);
+	}
+
+	lua_pushnumber(L, spectators.size());
+	return 1;
+}
+
 int LuaScriptInterface::luaGameGetPlayers(lua_State* L)
 {
 	// Game.getPlayers()
@@ -4352,8 +4988,7 @@ int LuaScriptInterface::luaGameGetPlayers(lua_State* L)
 
 	int index = 0;
 	for (const auto& playerEntry : g_game.getPlayers()) {
-		pushUserdata<Player>(L, playerEntry.second);
-		setMetatable(L, -1, "Player");
+		pushCreature(L, playerEntry.second);
 		lua_rawseti(L, -2, ++index);
 	}
 	return 1;
@@ -4430,6 +5065,39 @@ int LuaScriptInterface::luaGameGetMonsterTypes(lua_State* L)
 	return 1;
 }
 
+int LuaScriptInterface::luaGameCreateInstance(lua_State* L)
+{
+	// Game.createInstance(fromPos, toPos, destination)
+	uint32_t instanceId = g_game.map.createInstance(getPosition(L, 1), getPosition(L, 2), getPosition(L, 3));
+	if (instanceId != 0) {
+		lua_pushnumber(L, instanceId);
+	} else {
+		lua_pushnil(L);
+	}
+	return 1;
+}
+
+int LuaScriptInterface::luaGameDestroyInstance(lua_State* L)
+{
+	// Game.destroyInstance(instanceId)
+	pushBoolean(L, g_game.map.destroyInstance(getNumber<uint32_t>(L, 1)));
+	return 1;
+}
+
+int LuaScriptInterface::luaGameGetItemIdsByPrefix(lua_State* L)
+{
+	// Game.getItemIdsByPrefix(prefix[, limit = 0])
+	const std::vector<uint16_t> ids = Item::items.getItemIdsByPrefix(getString(L, 1), getNumber<size_t>(L, 2, 0));
+	lua_createtable(L, ids.size(), 0);
+
+	int index = 0;
+	for (uint16_t id : ids) {
+		lua_pushnumber(L, id);
+		lua_rawseti(L, -2, ++index);
+	}
+	return 1;
+}
+
 int LuaScriptInterface::luaGameGetTowns(lua_State* L)
 {
 	// Game.getTowns()
@@ -4535,6 +5203,8 @@ int LuaScriptInterface::luaGameCreateItem(lua_State* L)
 
 	if (lua_gettop(L) >= 3) {
 		const Position& position = getPosition(L, 3);
+		g_game.map.loadArea(position, 0, 0);
+
 		Tile* tile = g_game.map.getTile(position);
 		if (!tile) {
 			delete item;
@@ -4548,8 +5218,7 @@ int LuaScriptInterface::luaGameCreateItem(lua_State* L)
 		item->setParent(VirtualCylinder::virtualCylinder);
 	}
 
-	pushUserdata<Item>(L, item);
-	setItemMetatable(L, -1, item);
+	pushItem(L, item);
 	return 1;
 }
 
@@ -4578,6 +5247,7 @@ int LuaScriptInterface::luaGameCreateItemWithRarity(lua_State* L) {
     }
     if (lua_gettop(L) >= 4) {
         const Position& position = getPosition(L, 4);
+        g_game.map.loadArea(position, 0, 0);
         Tile* tile = g_game.map.getTile(position);
         if (!tile) {
             delete item;
@@ -4589,8 +5259,7 @@ int LuaScriptInterface::luaGameCreateItemWithRarity(lua_State* L) {
         getScriptEnv()->addTempItem(item);
         item->setParent(VirtualCylinder::virtualCylinder);
     }
-    pushUserdata<Item>(L, item);
-    setItemMetatable(L, -1, item);
+    pushItem(L, item);
     return 1;
 }
 
@@ -4630,15 +5299,19 @@ int LuaScriptInterface::luaGameCreateContainer(lua_State* L)
 		container->setParent(VirtualCylinder::virtualCylinder);
 	}
 
-	pushUserdata<Container>(L, container);
-	setMetatable(L, -1, "Container");
+	pushItem(L, container);
 	return 1;
 }
 
 int LuaScriptInterface::luaGameCreateMonster(lua_State* L)
 {
-	// Game.createMonster(monsterName, position[, extended = false[, force = false]])
-	Monster* monster = Monster::createMonster(getString(L, 1));
+	// Game.createMonster(monsterName or monsterTypeId, position[, extended = false[, force = false]])
+	Monster* monster;
+	if (isNumber(L, 1)) {
+		monster = Monster::createMonster(getNumber<uint32_t>(L, 1));
+	} else {
+		monster = Monster::createMonster(getString(L, 1));
+	}
 	if (!monster) {
 		lua_pushnil(L);
 		return 1;
@@ -4649,8 +5322,7 @@ int LuaScriptInterface::luaGameCreateMonster(lua_State* L)
 	bool force = getBoolean(L, 4, false);
 	if (g_events->eventMonsterOnSpawn(monster, position, false, true) || force) {
 		if (g_game.placeCreature(monster, position, extended, force)) {
-			pushUserdata<Monster>(L, monster);
-			setMetatable(L, -1, "Monster");
+			pushCreature(L, monster);
 		} else {
 			delete monster;
 			lua_pushnil(L);
@@ -4675,8 +5347,7 @@ int LuaScriptInterface::luaGameCreateNpc(lua_State* L)
 	bool extended = getBoolean(L, 3, false);
 	bool force = getBoolean(L, 4, false);
 	if (g_game.placeCreature(npc, position, extended, force)) {
-		pushUserdata<Npc>(L, npc);
-		setMetatable(L, -1, "Npc");
+		pushCreature(L, npc);
 	} else {
 		delete npc;
 		lua_pushnil(L);
@@ -4690,7 +5361,7 @@ int LuaScriptInterface::luaGameCreateTile(lua_State* L)
 	// Game.createTile(position[, isDynamic = false])
 	Position position;
 	bool isDynamic;
-	if (isTable(L, 1)) {
+	if (isPosition(L, 1)) {
 		position = getPosition(L, 1);
 		isDynamic = getBoolean(L, 2, false);
 	} else {
@@ -4700,6 +5371,8 @@ int LuaScriptInterface::luaGameCreateTile(lua_State* L)
 		isDynamic = getBoolean(L, 4, false);
 	}
 
+	g_game.map.loadArea(position, 0, 0);
+
 	Tile* tile = g_game.map.getTile(position);
 	if (!tile) {
 		if (isDynamic) {
@@ -4733,11 +5406,12 @@ int LuaScriptInterface::luaGameCreateMonsterType(lua_State* L)
 
 	MonsterType* monsterType = g_monsters.getMonsterType(name, false);
 	if (!monsterType) {
-		monsterType = &g_monsters.monsters[asLowerCaseString(name)];
+		monsterType = g_monsters.addMonsterType(name);
 		monsterType->name = name;
 		monsterType->nameDescription = "a " + name;
 	} else {
 		monsterType->info.lootItems.clear();
+		monsterType->info.compiledLoot.clear();
 		monsterType->info.attackSpells.clear();
 		monsterType->info.defenseSpells.clear();
 		monsterType->info.scripts.clear();
@@ -4753,6 +5427,58 @@ int LuaScriptInterface::luaGameCreateMonsterType(lua_State* L)
 	return 1;
 }
 
+int LuaScriptInterface::luaGameMoveItems(lua_State* L)
+{
+	// Game.moveItems(items, position or cylinder[, flags])
+	if (!isTable(L, 1)) {
+		lua_pushnil(L);
+		return 1;
+	}
+
+	Cylinder* toCylinder;
+	if (isUserdata(L, 2) && !isPosition(L, 2)) {
+		const LuaDataType type = getUserdataType(L, 2);
+		switch (type) {
+			case LuaData_Container:
+				toCylinder = getUserdata<Container>(L, 2);
+				break;
+			case LuaData_Player:
+				toCylinder = getUserdata<Player>(L, 2);
+				break;
+			case LuaData_Tile:
+				toCylinder = getUserdata<Tile>(L, 2);
+				break;
+			default:
+				toCylinder = nullptr;
+				break;
+		}
+	} else {
+		toCylinder = g_game.map.getTile(getPosition(L, 2));
+	}
+
+	if (!toCylinder) {
+		lua_pushnil(L);
+		return 1;
+	}
+
+	ItemVector items;
+	lua_pushnil(L);
+	while (lua_next(L, 1) != 0) {
+		Item* item = getUserdata<Item>(L, -1);
+		if (item && !item->isRemoved()) {
+			items.push_back(item);
+		}
+		lua_pop(L, 1);
+	}
+
+	uint32_t flags = getNumber<uint32_t>(L, 3, FLAG_NOLIMIT | FLAG_IGNOREBLOCKITEM | FLAG_IGNOREBLOCKCREATURE | FLAG_IGNORENOTMOVEABLE);
+
+	uint32_t movedCount;
+	g_game.internalMoveItems(toCylinder, items, movedCount, flags);
+	lua_pushnumber(L, movedCount);
+	return 1;
+}
+
 int LuaScriptInterface::luaGameStartRaid(lua_State* L)
 {
 	// Game.startRaid(raidName)
@@ -4831,19 +5557,115 @@ int LuaScriptInterface::luaGameSaveAccountStorageValues(lua_State* L)
 	return 1;
 }
 
+int LuaScriptInterface::luaGameGetDispatcherProfile(lua_State* L)
+{
+	// Game.getDispatcherProfile([reset = false])
+	if (!g_taskProfiler.isEnabled()) {
+		lua_pushnil(L);
+		return 1;
+	}
+
+	pushString(L, g_taskProfiler.getReport());
+	if (getBoolean(L, 1, false)) {
+		g_taskProfiler.reset();
+	}
+	return 1;
+}
+
+int LuaScriptInterface::luaGameSetDispatcherProfilerEnabled(lua_State* L)
+{
+	// Game.setDispatcherProfilerEnabled(enabled)
+	g_taskProfiler.setEnabled(getBoolean(L, 1));
+	pushBoolean(L, true);
+	return 1;
+}
+
+int LuaScriptInterface::luaGameGetLuaProfile(lua_State* L)
+{
+	// Game.getLuaProfile([reset = false[, entries = 25]])
+	if (!g_luaProfiler.isEnabled()) {
+		lua_pushnil(L);
+		return 1;
+	}
+
+	pushString(L, g_luaProfiler.getReport(getNumber<size_t>(L, 2, 25)));
+	if (getBoolean(L, 1, false)) {
+		g_luaProfiler.reset();
+	}
+	return 1;
+}
+
+int LuaScriptInterface::luaGameSetLuaProfilerEnabled(lua_State* L)
+{
+	// Game.setLuaProfilerEnabled(enabled[, sampleInterval])
+	if (isNumber(L, 2)) {
+		g_luaProfiler.setSampleInterval(getNumber<int32_t>(L, 2));
+	}
+	g_luaProfiler.setEnabled(getBoolean(L, 1));
+	pushBoolean(L, true);
+	return 1;
+}
+
+int LuaScriptInterface::luaGameSetTracingEnabled(lua_State* L)
+{
+	// Game.setTracingEnabled(enabled)
+	g_tracer.setEnabled(getBoolean(L, 1));
+	pushBoolean(L, true);
+	return 1;
+}
+
+int LuaScriptInterface::luaGameDumpTrace(lua_State* L)
+{
+	// Game.dumpTrace(path[, window = 5000])
+	pushBoolean(L, g_tracer.dump(getString(L, 1), getNumber<uint32_t>(L, 2, 5000)));
+	return 1;
+}
+
+int LuaScriptInterface::luaGameGetMemoryUsage(lua_State* L)
+{
+	// Game.getMemoryUsage()
+	lua_createtable(L, 0, MEMORY_LAST);
+	for (uint8_t i = 0; i < MEMORY_LAST; ++i) {
+		MemoryCategory_t category = static_cast<MemoryCategory_t>(i);
+		lua_createtable(L, 0, 2);
+		setField(L, "bytes", MemoryAccounting::getBytes(category));
+		setField(L, "objects", MemoryAccounting::getObjects(category));
+		lua_setfield(L, -2, MemoryAccounting::getName(category));
+	}
+	return 1;
+}
+
+int LuaScriptInterface::luaGameSleep(lua_State* L)
+{
+	// Game.sleep(milliseconds) from a coroutine
+	uint32_t coroutineId = g_luaEnvironment.suspendCoroutine(L);
+	if (coroutineId == 0) {
+		reportErrorFunc(L, "Game.sleep can only be called from a coroutine.");
+		pushBoolean(L, false);
+		return 1;
+	}
+
+	g_scheduler.addEvent(createSchedulerTask(getNumber<uint32_t>(L, 1), [coroutineId]() {
+		g_luaEnvironment.resumeCoroutine(coroutineId, [](lua_State*) {
+			return 0;
+		});
+	}));
+	return lua_yield(L, 0);
+}
+
 // Variant
 int LuaScriptInterface::luaVariantCreate(lua_State* L)
 {
 	// Variant(number or string or position or thing)
 	LuaVariant variant;
-	if (isUserdata(L, 2)) {
+	if (isPosition(L, 2)) {
+		variant.type = VARIANT_POSITION;
+		variant.pos = getPosition(L, 2);
+	} else if (isUserdata(L, 2)) {
 		if (Thing* thing = getThing(L, 2)) {
 			variant.type = VARIANT_TARGETPOSITION;
 			variant.pos = thing->getPosition();
 		}
-	} else if (isTable(L, 2)) {
-		variant.type = VARIANT_POSITION;
-		variant.pos = getPosition(L, 2);
 	} else if (isNumber(L, 2)) {
 		variant.type = VARIANT_NUMBER;
 		variant.number = getNumber<uint32_t>(L, 2);
@@ -4902,7 +5724,7 @@ int LuaScriptInterface::luaPositionCreate(lua_State* L)
 	}
 
 	int32_t stackpos;
-	if (isTable(L, 2)) {
+	if (isPosition(L, 2)) {
 		const Position& position = getPosition(L, 2, stackpos);
 		pushPosition(L, position, stackpos);
 	} else {
@@ -4959,6 +5781,56 @@ int LuaScriptInterface::luaPositionCompare(lua_State* L)
 	return 1;
 }
 
+int LuaScriptInterface::luaPositionValueIndex(lua_State* L)
+{
+	// position.x, position.y, position.z, position.stackpos or a method of Position
+	const LuaPosition* value = getPositionValue(L, 1);
+	size_t length = 0;
+	const char* key = lua_type(L, 2) == LUA_TSTRING ? lua_tolstring(L, 2, &length) : nullptr;
+	if (value && key) {
+		if (length == 1) {
+			switch (key[0]) {
+				case 'x': lua_pushnumber(L, value->position.x); return 1;
+				case 'y': lua_pushnumber(L, value->position.y); return 1;
+				case 'z': lua_pushnumber(L, value->position.z); return 1;
+				default: break;
+			}
+		} else if (length == 8 && memcmp(key, "stackpos", 8) == 0) {
+			lua_pushnumber(L, value->stackpos);
+			return 1;
+		}
+	}
+
+	lua_getglobal(L, "Position");
+	lua_pushvalue(L, 2);
+	lua_gettable(L, -2);
+	return 1;
+}
+
+int LuaScriptInterface::luaPositionValueNewIndex(lua_State* L)
+{
+	// position.x = x, position.y = y, position.z = z or position.stackpos = stackpos
+	LuaPosition* value = getPositionValue(L, 1);
+	size_t length = 0;
+	const char* key = lua_type(L, 2) == LUA_TSTRING ? lua_tolstring(L, 2, &length) : nullptr;
+	if (!value || !key) {
+		return luaL_error(L, "positions only have x, y, z and stackpos");
+	}
+
+	if (length == 1 && key[0] == 'x') {
+		value->position.x = getNumber<uint16_t>(L, 3);
+	} else if (length == 1 && key[0] == 'y') {
+		value->position.y = getNumber<uint16_t>(L, 3);
+	} else if (length == 1 && key[0] == 'z') {
+		value->position.z = getNumber<uint8_t>(L, 3);
+	} else if (length == 8 && memcmp(key, "stackpos", 8) == 0) {
+		value->stackpos = getNumber<int32_t>(L, 3);
+	} else {
+		return luaL_error(L, "positions only have x, y, z and stackpos, not %s", key);
+	}
+	return 0;
+}
+
 int LuaScriptInterface::luaPositionGetDistance(lua_State* L)
 {
 	// position:getDistance(positionEx)
@@ -5036,16 +5908,19 @@ int LuaScriptInterface::luaTileCreate(lua_State* L)
 {
 	// Tile(x, y, z)
 	// Tile(position)
-	Tile* tile;
-	if (isTable(L, 2)) {
-		tile = g_game.map.getTile(getPosition(L, 2));
+	Position position;
+	if (isPosition(L, 2)) {
+		position = getPosition(L, 2);
 	} else {
-		uint8_t z = getNumber<uint8_t>(L, 4);
-		uint16_t y = getNumber<uint16_t>(L, 3);
-		uint16_t x = getNumber<uint16_t>(L, 2);
-		tile = g_game.map.getTile(x, y, z);
+		position.z = getNumber<uint8_t>(L, 4);
+		position.y = getNumber<uint16_t>(L, 3);
+		position.x = getNumber<uint16_t>(L, 2);
 	}
 
+	g_game.map.loadArea(position, 0, 0);
+
+	Tile* tile = g_game.map.getTile(position);
+
 	if (tile) {
 		pushUserdata<Tile>(L, tile);
 		setMetatable(L, -1, "Tile");
@@ -5086,8 +5961,7 @@ int LuaScriptInterface::luaTileGetGround(lua_State* L)
 	// tile:getGround()
 	Tile* tile = getUserdata<Tile>(L, 1);
 	if (tile && tile->getGround()) {
-		pushUserdata<Item>(L, tile->getGround());
-		setItemMetatable(L, -1, tile->getGround());
+		pushItem(L, tile->getGround());
 	} else {
 		lua_pushnil(L);
 	}
@@ -5111,11 +5985,9 @@ int LuaScriptInterface::luaTileGetThing(lua_State* L)
 	}
 
 	if (Creature* creature = thing->getCreature()) {
-		pushUserdata<Creature>(L, creature);
-		setCreatureMetatable(L, -1, creature);
+		pushCreature(L, creature);
 	} else if (Item* item = thing->getItem()) {
-		pushUserdata<Item>(L, item);
-		setItemMetatable(L, -1, item);
+		pushItem(L, item);
 	} else {
 		lua_pushnil(L);
 	}
@@ -5151,11 +6023,9 @@ int LuaScriptInterface::luaTileGetTopVisibleThing(lua_State* L)
 	}
 
 	if (Creature* visibleCreature = thing->getCreature()) {
-		pushUserdata<Creature>(L, visibleCreature);
-		setCreatureMetatable(L, -1, visibleCreature);
+		pushCreature(L, visibleCreature);
 	} else if (Item* visibleItem = thing->getItem()) {
-		pushUserdata<Item>(L, visibleItem);
-		setItemMetatable(L, -1, visibleItem);
+		pushItem(L, visibleItem);
 	} else {
 		lua_pushnil(L);
 	}
@@ -5173,8 +6043,7 @@ int LuaScriptInterface::luaTileGetTopTopItem(lua_State* L)
 
 	Item* item = tile->getTopTopItem();
 	if (item) {
-		pushUserdata<Item>(L, item);
-		setItemMetatable(L, -1, item);
+		pushItem(L, item);
 	} else {
 		lua_pushnil(L);
 	}
@@ -5192,8 +6061,7 @@ int LuaScriptInterface::luaTileGetTopDownItem(lua_State* L)
 
 	Item* item = tile->getTopDownItem();
 	if (item) {
-		pushUserdata<Item>(L, item);
-		setItemMetatable(L, -1, item);
+		pushItem(L, item);
 	} else {
 		lua_pushnil(L);
 	}
@@ -5211,8 +6079,7 @@ int LuaScriptInterface::luaTileGetFieldItem(lua_State* L)
 
 	Item* item = tile->getFieldItem();
 	if (item) {
-		pushUserdata<Item>(L, item);
-		setItemMetatable(L, -1, item);
+		pushItem(L, item);
 	} else {
 		lua_pushnil(L);
 	}
@@ -5242,8 +6109,7 @@ int LuaScriptInterface::luaTileGetItemById(lua_State* L)
 
 	Item* item = g_game.findItemOfType(tile, itemId, false, subType);
 	if (item) {
-		pushUserdata<Item>(L, item);
-		setItemMetatable(L, -1, item);
+		pushItem(L, item);
 	} else {
 		lua_pushnil(L);
 	}
@@ -5294,8 +6160,7 @@ int LuaScriptInterface::luaTileGetItemByType(lua_State* L)
 	if (Item* item = tile->getGround()) {
 		const ItemType& it = Item::items[item->getID()];
 		if (it.type == itemType) {
-			pushUserdata<Item>(L, item);
-			setItemMetatable(L, -1, item);
+			pushItem(L, item);
 			return 1;
 		}
 	}
@@ -5304,8 +6169,7 @@ int LuaScriptInterface::luaTileGetItemByType(lua_State* L)
 		for (Item* item : *items) {
 			const ItemType& it = Item::items[item->getID()];
 			if (it.type == itemType) {
-				pushUserdata<Item>(L, item);
-				setItemMetatable(L, -1, item);
+				pushItem(L, item);
 				return 1;
 			}
 		}
@@ -5332,8 +6196,7 @@ int LuaScriptInterface::luaTileGetItemByTopOrder(lua_State* L)
 		return 1;
 	}
 
-	pushUserdata<Item>(L, item);
-	setItemMetatable(L, -1, item);
+	pushItem(L, item);
 	return 1;
 }
 
@@ -5398,8 +6261,7 @@ int LuaScriptInterface::luaTileGetTopCreature(lua_State* L)
 		return 1;
 	}
 
-	pushUserdata<Creature>(L, creature);
-	setCreatureMetatable(L, -1, creature);
+	pushCreature(L, creature);
 	return 1;
 }
 
@@ -5445,8 +6307,7 @@ int LuaScriptInterface::luaTileGetTopVisibleCreature(lua_State* L)
 
 	Creature* visibleCreature = tile->getTopVisibleCreature(creature);
 	if (visibleCreature) {
-		pushUserdata<Creature>(L, visibleCreature);
-		setCreatureMetatable(L, -1, visibleCreature);
+		pushCreature(L, visibleCreature);
 	} else {
 		lua_pushnil(L);
 	}
@@ -5472,8 +6333,7 @@ int LuaScriptInterface::luaTileGetItems(lua_State* L)
 
 	int index = 0;
 	for (Item* item : *itemVector) {
-		pushUserdata<Item>(L, item);
-		setItemMetatable(L, -1, item);
+		pushItem(L, item);
 		lua_rawseti(L, -2, ++index);
 	}
 	return 1;
@@ -5526,7 +6386,7 @@ int LuaScriptInterface::luaTileGetCreatures(lua_State* L)
 		return 1;
 	}
 
-	CreatureVector* creatureVector = tile->getCreatures();
+	TileCreatureVector* creatureVector = tile->getCreatures();
 	if (!creatureVector) {
 		lua_pushnil(L);
 		return 1;
@@ -5536,8 +6396,7 @@ int LuaScriptInterface::luaTileGetCreatures(lua_State* L)
 
 	int index = 0;
 	for (Creature* creature : *creatureVector) {
-		pushUserdata<Creature>(L, creature);
-		setCreatureMetatable(L, -1, creature);
+		pushCreature(L, creature);
 		lua_rawseti(L, -2, ++index);
 	}
 	return 1;
@@ -5663,8 +6522,7 @@ int LuaScriptInterface::luaTileAddItem(lua_State* L)
 
 	ReturnValue ret = g_game.internalAddItem(tile, item, INDEX_WHEREEVER, flags);
 	if (ret == RETURNVALUE_NOERROR) {
-		pushUserdata<Item>(L, item);
-		setItemMetatable(L, -1, item);
+		pushItem(L, item);
 	} else {
 		delete item;
 		lua_pushnil(L);
@@ -6282,8 +7140,7 @@ int LuaScriptInterface::luaItemCreate(lua_State* L)
 
 	Item* item = getScriptEnv()->getItemByUID(id);
 	if (item) {
-		pushUserdata<Item>(L, item);
-		setItemMetatable(L, -1, item);
+		pushItem(L, item);
 	} else {
 		lua_pushnil(L);
 	}
@@ -6365,8 +7222,7 @@ int LuaScriptInterface::luaItemClone(lua_State* L)
 	getScriptEnv()->addTempItem(clone);
 	clone->setParent(VirtualCylinder::virtualCylinder);
 
-	pushUserdata<Item>(L, clone);
-	setItemMetatable(L, -1, clone);
+	pushItem(L, clone);
 	return 1;
 }
 
@@ -6413,8 +7269,7 @@ int LuaScriptInterface::luaItemSplit(lua_State* L)
 	splitItem->setParent(VirtualCylinder::virtualCylinder);
 	env->addTempItem(splitItem);
 
-	pushUserdata<Item>(L, splitItem);
-	setItemMetatable(L, -1, splitItem);
+	pushItem(L, splitItem);
 	return 1;
 }
 
@@ -6640,7 +7495,9 @@ int LuaScriptInterface::luaItemGetAttribute(lua_State* L)
 		attribute = ITEM_ATTRIBUTE_NONE;
 	}
 
-	if (ItemAttributes::isIntAttrType(attribute)) {
+	if (attribute == ITEM_ATTRIBUTE_DURATION) {
+		lua_pushnumber(L, item->getDuration());
+	} else if (ItemAttributes::isIntAttrType(attribute)) {
 		lua_pushnumber(L, item->getIntAttr(attribute));
 	} else if (ItemAttributes::isStrAttrType(attribute)) {
 		pushString(L, item->getStrAttr(attribute));
@@ -6675,7 +7532,11 @@ int LuaScriptInterface::luaItemSetAttribute(lua_State* L)
 			return 1;
 		}
 
-		item->setIntAttr(attribute, getNumber<int32_t>(L, 3));
+		if (attribute == ITEM_ATTRIBUTE_DURATION) {
+			item->setDuration(getNumber<int32_t>(L, 3));
+		} else {
+			item->setIntAttr(attribute, getNumber<int32_t>(L, 3));
+		}
 		pushBoolean(L, true);
 	} else if (ItemAttributes::isStrAttrType(attribute)) {
 		item->setStrAttr(attribute, getString(L, 3));
@@ -6814,7 +7675,7 @@ int LuaScriptInterface::luaItemMoveTo(lua_State* L)
 	}
 
 	Cylinder* toCylinder;
-	if (isUserdata(L, 2)) {
+	if (isUserdata(L, 2) && !isPosition(L, 2)) {
 		const LuaDataType type = getUserdataType(L, 2);
 		switch (type) {
 			case LuaData_Container:
@@ -7104,8 +7965,7 @@ int LuaScriptInterface::luaContainerGetItem(lua_State* L)
 	uint32_t index = getNumber<uint32_t>(L, 2);
 	Item* item = container->getItemByIndex(index);
 	if (item) {
-		pushUserdata<Item>(L, item);
-		setItemMetatable(L, -1, item);
+		pushItem(L, item);
 	} else {
 		lua_pushnil(L);
 	}
@@ -7162,8 +8022,7 @@ int LuaScriptInterface::luaContainerAddItem(lua_State* L)
 
 	ReturnValue ret = g_game.internalAddItem(container, item, index, flags);
 	if (ret == RETURNVALUE_NOERROR) {
-		pushUserdata<Item>(L, item);
-		setItemMetatable(L, -1, item);
+		pushItem(L, item);
 	} else {
 		delete item;
 		lua_pushnil(L);
@@ -7336,8 +8195,7 @@ int LuaScriptInterface::luaCreatureCreate(lua_State* L)
 	}
 
 	if (creature) {
-		pushUserdata<Creature>(L, creature);
-		setCreatureMetatable(L, -1, creature);
+		pushCreature(L, creature);
 	} else {
 		lua_pushnil(L);
 	}
@@ -7563,8 +8421,7 @@ int LuaScriptInterface::luaCreatureGetTarget(lua_State* L)
 
 	Creature* target = creature->getAttackedCreature();
 	if (target) {
-		pushUserdata<Creature>(L, target);
-		setCreatureMetatable(L, -1, target);
+		pushCreature(L, target);
 	} else {
 		lua_pushnil(L);
 	}
@@ -7594,8 +8451,7 @@ int LuaScriptInterface::luaCreatureGetFollowCreature(lua_State* L)
 
 	Creature* followCreature = creature->getFollowCreature();
 	if (followCreature) {
-		pushUserdata<Creature>(L, followCreature);
-		setCreatureMetatable(L, -1, followCreature);
+		pushCreature(L, followCreature);
 	} else {
 		lua_pushnil(L);
 	}
@@ -7629,8 +8485,7 @@ int LuaScriptInterface::luaCreatureGetMaster(lua_State* L)
 		return 1;
 	}
 
-	pushUserdata<Creature>(L, master);
-	setCreatureMetatable(L, -1, master);
+	pushCreature(L, master);
 	return 1;
 }
 
@@ -8245,12 +9100,12 @@ int LuaScriptInterface::luaCreatureGetDamageMap(lua_State* L)
 		return 1;
 	}
 
-	lua_createtable(L, creature->damageMap.size(), 0);
-	for (const auto& damageEntry : creature->damageMap) {
+	lua_createtable(L, 0, creature->damageList.size());
+	for (const auto& damageEntry : creature->damageList) {
 		lua_createtable(L, 0, 2);
-		setField(L, "total", damageEntry.second.total);
-		setField(L, "ticks", damageEntry.second.ticks);
-		lua_rawseti(L, -2, damageEntry.first);
+		setField(L, "total", damageEntry.total);
+		setField(L, "ticks", damageEntry.ticks);
+		lua_rawseti(L, -2, damageEntry.attackerId);
 	}
 	return 1;
 }
@@ -8268,8 +9123,7 @@ int LuaScriptInterface::luaCreatureGetSummons(lua_State* L)
 
 	int index = 0;
 	for (Creature* summon : creature->getSummons()) {
-		pushUserdata<Creature>(L, summon);
-		setCreatureMetatable(L, -1, summon);
+		pushCreature(L, summon);
 		lua_rawseti(L, -2, ++index);
 	}
 	return 1;
@@ -8395,7 +9249,7 @@ int LuaScriptInterface::luaPlayerCreate(lua_State* L)
 	Player* player;
 	if (isNumber(L, 2)) {
 		uint32_t id = getNumber<uint32_t>(L, 2);
-		if (id >= 0x10000000 && id <= Player::playerAutoID) {
+		if (Player::ids.contains(id)) {
 			player = g_game.getPlayerByID(id);
 		} else {
 			player = g_game.getPlayerByGUID(id);
@@ -8418,8 +9272,7 @@ int LuaScriptInterface::luaPlayerCreate(lua_State* L)
 	}
 
 	if (player) {
-		pushUserdata<Player>(L, player);
-		setMetatable(L, -1, "Player");
+		pushCreature(L, player);
 	} else {
 		lua_pushnil(L);
 	}
@@ -8566,13 +9419,15 @@ int LuaScriptInterface::luaPlayerGetDepotChest(lua_State* L)
 		return 1;
 	}
 
+	// scripts read the contents right away, so the locker is not loaded in the background
+	IOLoginData::loadLocker(player);
+
 	uint32_t depotId = getNumber<uint32_t>(L, 2);
 	bool autoCreate = getBoolean(L, 3, false);
 	DepotChest* depotChest = player->getDepotChest(depotId, autoCreate);
 	if (depotChest) {
 		player->setLastDepotId(depotId); // FIXME: workaround for #2251
-		pushUserdata<Item>(L, depotChest);
-		setItemMetatable(L, -1, depotChest);
+		pushItem(L, depotChest);
 	} else {
 		pushBoolean(L, false);
 	}
@@ -8588,10 +9443,11 @@ int LuaScriptInterface::luaPlayerGetInbox(lua_State* L)
 		return 1;
 	}
 
+	IOLoginData::loadLocker(player);
+
 	Inbox* inbox = player->getInbox();
 	if (inbox) {
-		pushUserdata<Item>(L, inbox);
-		setItemMetatable(L, -1, inbox);
+		pushItem(L, inbox);
 	} else {
 		pushBoolean(L, false);
 	}
@@ -9096,8 +9952,7 @@ int LuaScriptInterface::luaPlayerGetItemById(lua_State* L)
 
 	Item* item = g_game.findItemOfType(player, itemId, deepSearch, subType);
 	if (item) {
-		pushUserdata<Item>(L, item);
-		setItemMetatable(L, -1, item);
+		pushItem(L, item);
 	} else {
 		lua_pushnil(L);
 	}
@@ -9543,12 +10398,10 @@ int LuaScriptInterface::luaPlayerAddItem(lua_State* L)
 
 		if (hasTable) {
 			lua_pushnumber(L, i);
-			pushUserdata<Item>(L, item);
-			setItemMetatable(L, -1, item);
+			pushItem(L, item);
 			lua_settable(L, -3);
 		} else {
-			pushUserdata<Item>(L, item);
-			setItemMetatable(L, -1, item);
+			pushItem(L, item);
 		}
 	}
 	return 1;
@@ -9845,8 +10698,7 @@ int LuaScriptInterface::luaPlayerGetSlotItem(lua_State* L)
 
 	Item* item = thing->getItem();
 	if (item) {
-		pushUserdata<Item>(L, item);
-		setItemMetatable(L, -1, item);
+		pushItem(L, item);
 	} else {
 		lua_pushnil(L);
 	}
@@ -10333,6 +11185,38 @@ int LuaScriptInterface::luaPlayerGetClient(lua_State* L)
 	return 1;
 }
 
+int LuaScriptInterface::luaPlayerGetNetworkStats(lua_State* L)
+{
+	// player:getNetworkStats()
+	Player* player = getUserdata<Player>(L, 1);
+	if (!player || !player->client) {
+		lua_pushnil(L);
+		return 1;
+	}
+
+	const ProtocolGame_ptr& client = player->client;
+	lua_createtable(L, 0, 3);
+	setField(L, "payloadBytes", client->getSentPayloadBytes());
+	setField(L, "wireBytes", client->getSentWireBytes());
+
+	// opcode -> {count = n, bytes = n}, only opcodes that have been sent
+	lua_newtable(L);
+	const ProtocolGame::SentPackets& sentPackets = client->getSentPackets();
+	for (size_t opcode = 0; opcode < sentPackets.size(); ++opcode) {
+		const ProtocolGame::SentPacketStats& stats = sentPackets[opcode];
+		if (stats.count == 0) {
+			continue;
+		}
+
+		lua_createtable(L, 0, 2);
+		setField(L, "count", stats.count);
+		setField(L, "bytes", stats.bytes);
+		lua_rawseti(L, -2, opcode);
+	}
+	lua_setfield(L, -2, "packets");
+	return 1;
+}
+
 int LuaScriptInterface::luaPlayerGetHouse(lua_State* L)
 {
 	// player:getHouse()
@@ -10484,8 +11368,7 @@ int LuaScriptInterface::luaPlayerGetContainerById(lua_State* L)
 
 	Container* container = player->getContainerByID(getNumber<uint8_t>(L, 2));
 	if (container) {
-		pushUserdata<Container>(L, container);
-		setMetatable(L, -1, "Container");
+		pushItem(L, container);
 	} else {
 		lua_pushnil(L);
 	}
@@ -10572,7 +11455,7 @@ int LuaScriptInterface::luaPlayerGetItem(lua_State* L)
 		uint32_t uid = getNumber<uint32_t>(L, 2);
 		item = player->getItemByUID(uid);
 	}
-	else if (isTable(L, 2)) {
+	else if (isPosition(L, 2)) {
 		int32_t stackpos;
 		Position pos = getPosition(L, 2, stackpos);
 		thing = g_game.internalGetThing(player, pos, stackpos, 0, STACKPOS_LOOK);
@@ -10585,8 +11468,7 @@ int LuaScriptInterface::luaPlayerGetItem(lua_State* L)
 	}
 
 	if (item) {
-		pushUserdata<Item>(L, item);
-		setItemMetatable(L, -1, item);
+		pushItem(L, item);
 	}
 	else {
 		lua_pushnil(L);
@@ -10632,8 +11514,7 @@ int LuaScriptInterface::luaPlayerGetStoreInbox(lua_State* L)
 		return 1;
 	}
 
-	pushUserdata<Container>(L, storeInbox);
-	setMetatable(L, -1, "Container");
+	pushItem(L, storeInbox);
 	return 1;
 }
 
@@ -10772,8 +11653,7 @@ int LuaScriptInterface::luaMonsterCreate(lua_State* L)
 	}
 
 	if (monster) {
-		pushUserdata<Monster>(L, monster);
-		setMetatable(L, -1, "Monster");
+		pushCreature(L, monster);
 	} else {
 		lua_pushnil(L);
 	}
@@ -10979,8 +11859,7 @@ int LuaScriptInterface::luaMonsterGetFriendList(lua_State* L)
 
 	int index = 0;
 	for (Creature* creature : friendList) {
-		pushUserdata<Creature>(L, creature);
-		setCreatureMetatable(L, -1, creature);
+		pushCreature(L, creature);
 		lua_rawseti(L, -2, ++index);
 	}
 	return 1;
@@ -11055,8 +11934,7 @@ int LuaScriptInterface::luaMonsterGetTargetList(lua_State* L)
 
 	int index = 0;
 	for (Creature* creature : targetList) {
-		pushUserdata<Creature>(L, creature);
-		setCreatureMetatable(L, -1, creature);
+		pushCreature(L, creature);
 		lua_rawseti(L, -2, ++index);
 	}
 	return 1;
@@ -11154,8 +12032,7 @@ int LuaScriptInterface::luaNpcCreate(lua_State* L)
 	}
 
 	if (npc) {
-		pushUserdata<Npc>(L, npc);
-		setMetatable(L, -1, "Npc");
+		pushCreature(L, npc);
 	} else {
 		lua_pushnil(L);
 	}
@@ -11262,8 +12139,7 @@ int LuaScriptInterface::luaGuildGetMembersOnline(lua_State* L)
 
 	int index = 0;
 	for (Player* player : members) {
-		pushUserdata<Player>(L, player);
-		setMetatable(L, -1, "Player");
+		pushCreature(L, player);
 		lua_rawseti(L, -2, ++index);
 	}
 	return 1;
@@ -11973,8 +12849,7 @@ int LuaScriptInterface::luaHouseGetBeds(lua_State* L)
 
 	int index = 0;
 	for (BedItem* bedItem : beds) {
-		pushUserdata<Item>(L, bedItem);
-		setItemMetatable(L, -1, bedItem);
+		pushItem(L, bedItem);
 		lua_rawseti(L, -2, ++index);
 	}
 	return 1;
@@ -12006,8 +12881,7 @@ int LuaScriptInterface::luaHouseGetDoors(lua_State* L)
 
 	int index = 0;
 	for (Door* door : doors) {
-		pushUserdata<Item>(L, door);
-		setItemMetatable(L, -1, door);
+		pushItem(L, door);
 		lua_rawseti(L, -2, ++index);
 	}
 	return 1;
@@ -12081,8 +12955,7 @@ int LuaScriptInterface::luaHouseGetItems(lua_State* L)
 		TileItemVector* itemVector = tile->getItemList();
 		if(itemVector) {
 			for(Item* item : *itemVector) {
-				pushUserdata<Item>(L, item);
-				setItemMetatable(L, -1, item);
+				pushItem(L, item);
 				lua_rawseti(L, -2, ++index);
 			}
 		}
@@ -13367,6 +14240,37 @@ int LuaScriptInterface::luaCombatSetCallback(lua_State* L)
 	return 1;
 }
 
+int LuaScriptInterface::luaCombatSetPureCallback(lua_State* L)
+{
+	// combat:setPureCallback(key, function)
+	const Combat_ptr& combat = getSharedPtr<Combat>(L, 1);
+	if (!combat) {
+		reportErrorFunc(L, getErrorDesc(LUA_ERROR_COMBAT_NOT_FOUND));
+		lua_pushnil(L);
+		return 1;
+	}
+
+	// only formulas take plain numbers, tile and target callbacks need the game
+	CallBackParam_t key = getNumber<CallBackParam_t>(L, 2);
+	if (key != CALLBACK_PARAM_LEVELMAGICVALUE && key != CALLBACK_PARAM_SKILLVALUE) {
+		reportErrorFunc(L, "only value callbacks can be pure.");
+		pushBoolean(L, false);
+		return 1;
+	}
+
+	const std::string& function = getString(L, 3);
+	if (!g_pureScripts.hasFunction(function)) {
+		reportErrorFunc(L, fmt::format("pure function {:s} not found.", function));
+		pushBoolean(L, false);
+		return 1;
+	}
+
+	combat->setCallback(key);
+	static_cast<ValueCallback*>(combat->getCallback(key))->setPureFunction(function);
+	pushBoolean(L, true);
+	return 1;
+}
+
 int LuaScriptInterface::luaCombatSetOrigin(lua_State* L)
 {
 	// combat:setOrigin(origin)
@@ -14027,6 +14931,18 @@ int LuaScriptInterface::luaMonsterTypeCanWalkOnPoison(lua_State* L)
 	return 1;
 }
 
+int LuaScriptInterface::luaMonsterTypeId(lua_State* L)
+{
+	// monsterType:id()
+	MonsterType* monsterType = getUserdata<MonsterType>(L, 1);
+	if (monsterType) {
+		lua_pushnumber(L, monsterType->id);
+	} else {
+		lua_pushnil(L);
+	}
+	return 1;
+}
+
 int32_t LuaScriptInterface::luaMonsterTypeName(lua_State* L)
 {
 	// get: monsterType:name() set: monsterType:name(name)
@@ -14386,10 +15302,12 @@ int LuaScriptInterface::luaMonsterTypeGetElementList(lua_State* L)
 		return 1;
 	}
 
-	lua_createtable(L, monsterType->info.elementMap.size(), 0);
-	for (const auto& elementEntry : monsterType->info.elementMap) {
-		lua_pushnumber(L, elementEntry.second);
-		lua_rawseti(L, -2, elementEntry.first);
+	lua_newtable(L);
+	for (size_t i = 0; i < COMBAT_COUNT; ++i) {
+		if (monsterType->info.elements[i] != 0) {
+			lua_pushnumber(L, monsterType->info.elements[i]);
+			lua_rawseti(L, -2, indexToCombatType(i));
+		}
 	}
 	return 1;
 }
@@ -14400,8 +15318,12 @@ int LuaScriptInterface::luaMonsterTypeAddElement(lua_State* L)
 	MonsterType* monsterType = getUserdata<MonsterType>(L, 1);
 	if (monsterType) {
 		CombatType_t element = getNumber<CombatType_t>(L, 2);
-		monsterType->info.elementMap[element] = getNumber<int32_t>(L, 3);
-		pushBoolean(L, true);
+		if (element != COMBAT_NONE && indexToCombatType(combatTypeToIndex(element)) == element) {
+			monsterType->info.elements[combatTypeToIndex(element)] = getNumber<int32_t>(L, 3);
+			pushBoolean(L, true);
+		} else {
+			pushBoolean(L, false);
+		}
 	} else {
 		lua_pushnil(L);
 	}
@@ -14478,6 +15400,27 @@ int LuaScriptInterface::luaMonsterTypeAddLoot(lua_State* L)
 	return 1;
 }
 
+int LuaScriptInterface::luaMonsterTypeCreateLoot(lua_State* L)
+{
+	// monsterType:createLoot(corpse)
+	MonsterType* monsterType = getUserdata<MonsterType>(L, 1);
+	if (!monsterType) {
+		lua_pushnil(L);
+		return 1;
+	}
+
+	Container* corpse = getUserdata<Container>(L, 2);
+	if (!corpse) {
+		reportErrorFunc(L, getErrorDesc(LUA_ERROR_CONTAINER_NOT_FOUND));
+		pushBoolean(L, false);
+		return 1;
+	}
+
+	monsterType->createLoot(corpse);
+	pushBoolean(L, true);
+	return 1;
+}
+
 int LuaScriptInterface::luaMonsterTypeGetCreatureEvents(lua_State* L)
 {
 	// monsterType:getCreatureEvents()
@@ -15184,6 +16127,30 @@ int LuaScriptInterface::luaMonsterSpellSetCombatRadius(lua_State* L)
 	return 1;
 }
 
+int LuaScriptInterface::luaMonsterSpellSetCombatArea(lua_State* L)
+{
+	// monsterSpell:setCombatArea(area)
+	MonsterSpell* spell = getUserdata<MonsterSpell>(L, 1);
+	if (!spell) {
+		lua_pushnil(L);
+		return 1;
+	}
+
+	std::vector<uint32_t> vec;
+	uint32_t rows;
+	lua_settop(L, 2);
+	if (!isTable(L, 2) || !getArea(L, vec, rows)) {
+		reportErrorFunc(L, "Invalid area table.");
+		pushBoolean(L, false);
+		return 1;
+	}
+
+	spell->area = std::move(vec);
+	spell->areaRows = rows;
+	pushBoolean(L, true);
+	return 1;
+}
+
 int LuaScriptInterface::luaMonsterSpellSetConditionType(lua_State* L)
 {
 	// monsterSpell:setConditionType(type)
@@ -15340,8 +16307,7 @@ int LuaScriptInterface::luaPartyGetLeader(lua_State* L)
 
 	Player* leader = party->getLeader();
 	if (leader) {
-		pushUserdata<Player>(L, leader);
-		setMetatable(L, -1, "Player");
+		pushCreature(L, leader);
 	} else {
 		lua_pushnil(L);
 	}
@@ -15373,8 +16339,7 @@ int LuaScriptInterface::luaPartyGetMembers(lua_State* L)
 	int index = 0;
 	lua_createtable(L, party->getMemberCount(), 0);
 	for (Player* player : party->getMembers()) {
-		pushUserdata<Player>(L, player);
-		setMetatable(L, -1, "Player");
+		pushCreature(L, player);
 		lua_rawseti(L, -2, ++index);
 	}
 	return 1;
@@ -15401,8 +16366,7 @@ int LuaScriptInterface::luaPartyGetInvitees(lua_State* L)
 
 		int index = 0;
 		for (Player* player : party->getInvitees()) {
-			pushUserdata<Player>(L, player);
-			setMetatable(L, -1, "Player");
+			pushCreature(L, player);
 			lua_rawseti(L, -2, ++index);
 		}
 	} else {
@@ -16737,6 +17701,38 @@ int LuaScriptInterface::luaCreatureEventRegister(lua_State* L)
 	return 1;
 }
 
+int LuaScriptInterface::luaCreatureEventOpcode(lua_State* L)
+{
+	// creatureevent:opcode(opcode)
+	CreatureEvent* creature = getUserdata<CreatureEvent>(L, 1);
+	if (creature) {
+		creature->setOpcode(getNumber<uint8_t>(L, 2));
+		pushBoolean(L, true);
+	} else {
+		lua_pushnil(L);
+	}
+	return 1;
+}
+
+int LuaScriptInterface::luaCreatureEventDecode(lua_State* L)
+{
+	// creatureevent:decode(format)
+	CreatureEvent* creature = getUserdata<CreatureEvent>(L, 1);
+	if (creature) {
+		std::string format = getString(L, 2);
+		if (asLowerCaseString(format) != "json") {
+			std::cout << "[Error - CreatureEvent::decode] Invalid format for creature event: " << format << std::endl;
+			pushBoolean(L, false);
+			return 1;
+		}
+		creature->setDecodeJson(true);
+		pushBoolean(L, true);
+	} else {
+		lua_pushnil(L);
+	}
+	return 1;
+}
+
 int LuaScriptInterface::luaCreatureEventOnCallback(lua_State* L)
 {
 	// creatureevent:onLogin / logout / etc. (callback)
@@ -17876,15 +18872,129 @@ LuaEnvironment::~LuaEnvironment()
 	closeState();
 }
 
+#ifndef LUAJIT_VERSION
+namespace {
+
+// positions, small tables, userdata and short strings fit into these, larger
+// blocks go straight to malloc
+constexpr size_t LUA_FREE_LIST_CAPACITY = 16384;
+constexpr size_t LUA_MAX_POOLED_SIZE = 256;
+
+size_t getLuaSizeClass(size_t size)
+{
+	if (size <= 16) {
+		return 16;
+	} else if (size <= 32) {
+		return 32;
+	} else if (size <= 64) {
+		return 64;
+	} else if (size <= 128) {
+		return 128;
+	} else if (size <= LUA_MAX_POOLED_SIZE) {
+		return LUA_MAX_POOLED_SIZE;
+	}
+	return 0;
+}
+
+void* allocateLuaBlock(size_t sizeClass, size_t size)
+{
+	// lua expects a null pointer rather than an exception
+	try {
+		switch (sizeClass) {
+			case 16: return lockfreeAllocateBlock<16, LUA_FREE_LIST_CAPACITY>();
+			case 32: return lockfreeAllocateBlock<32, LUA_FREE_LIST_CAPACITY>();
+			case 64: return lockfreeAllocateBlock<64, LUA_FREE_LIST_CAPACITY>();
+			case 128: return lockfreeAllocateBlock<128, LUA_FREE_LIST_CAPACITY>();
+			case LUA_MAX_POOLED_SIZE: return lockfreeAllocateBlock<LUA_MAX_POOLED_SIZE, LUA_FREE_LIST_CAPACITY>();
+			default: return malloc(size);
+		}
+	} catch (const std::bad_alloc&) {
+		return nullptr;
+	}
+}
+
+void deallocateLuaBlock(void* p, size_t sizeClass)
+{
+	switch (sizeClass) {
+		case 16: lockfreeDeallocateBlock<16, LUA_FREE_LIST_CAPACITY>(p); break;
+		case 32: lockfreeDeallocateBlock<32, LUA_FREE_LIST_CAPACITY>(p); break;
+		case 64: lockfreeDeallocateBlock<64, LUA_FREE_LIST_CAPACITY>(p); break;
+		case 128: lockfreeDeallocateBlock<128, LUA_FREE_LIST_CAPACITY>(p); break;
+		case LUA_MAX_POOLED_SIZE: lockfreeDeallocateBlock<LUA_MAX_POOLED_SIZE, LUA_FREE_LIST_CAPACITY>(p); break;
+		default: free(p); break;
+	}
+}
+
+void* luaAllocator(void*, void* ptr, size_t osize, size_t nsize)
+{
+	// for a new block osize carries the lua type, not a size
+	size_t oldClass = ptr ? getLuaSizeClass(osize) : 0;
+	if (nsize == 0) {
+		if (ptr) {
+			MemoryAccounting::released(MEMORY_LUA, osize);
+			deallocateLuaBlock(ptr, oldClass);
+		}
+		return nullptr;
+	}
+
+	size_t newClass = getLuaSizeClass(nsize);
+	void* block;
+	if (ptr && oldClass == newClass) {
+		// still fits its size class, or both sizes are beyond the pools
+		block = newClass != 0 ? ptr : realloc(ptr, nsize);
+		if (!block) {
+			return nullptr;
+		}
+	} else {
+		block = allocateLuaBlock(newClass, nsize);
+		if (!block) {
+			return nullptr;
+		}
+
+		if (ptr) {
+			std::memcpy(block, ptr, std::min(osize, nsize));
+			deallocateLuaBlock(ptr, oldClass);
+		}
+	}
+
+	if (ptr) {
+		MemoryAccounting::released(MEMORY_LUA, osize);
+	}
+	MemoryAccounting::allocated(MEMORY_LUA, nsize);
+	return block;
+}
+
+// what luaL_newstate installs, needed since the state has its own allocator
+int luaPanic(lua_State* L)
+{
+	const char* message = lua_tostring(L, -1);
+	std::cout << "[Error - LuaEnvironment] Unprotected error in call to Lua API: " << (message ? message : "not a string") << std::endl;
+	return 0;
+}
+
+}
+#endif
+
 bool LuaEnvironment::initState()
 {
+#ifndef LUAJIT_VERSION
+	// small blocks come from size class pools, every block is counted for the memory report
+	luaState = lua_newstate(luaAllocator, nullptr);
+	if (luaState) {
+		lua_atpanic(luaState, luaPanic);
+	}
+#else
 	luaState = luaL_newstate();
+#endif
 	if (!luaState) {
 		return false;
 	}
 
 	luaL_openlibs(luaState);
 	registerFunctions();
+	LuaFastPaths::install(luaState);
+	g_luaProfiler.attach(luaState);
+	g_watchdog.attach(luaState);
 
 	runningEventId = EVENT_ID_USER;
 	return true;
@@ -17894,7 +19004,60 @@ bool LuaEnvironment::reInitState()
 {
 	// TODO: get children, reload children
 	closeState();
-	return initState();
+	if (!initState()) {
+		return false;
+	}
+
+	configureGarbageCollector();
+	return true;
+}
+
+void LuaEnvironment::configureGarbageCollector()
+{
+	if (!luaState) {
+		return;
+	}
+
+	int pause = g_config.getNumber(ConfigManager::LUA_GC_PAUSE);
+	int stepMultiplier = g_config.getNumber(ConfigManager::LUA_GC_STEP_MULTIPLIER);
+#if LUA_VERSION_NUM >= 504
+	if (g_config.getBoolean(ConfigManager::LUA_GC_GENERATIONAL)) {
+		lua_gc(luaState, LUA_GCGEN, 0, 0);
+	} else {
+		lua_gc(luaState, LUA_GCINC, pause, stepMultiplier, 0);
+	}
+#else
+	if (g_config.getBoolean(ConfigManager::LUA_GC_GENERATIONAL)) {
+		std::cout << "[Warning - LuaEnvironment::configureGarbageCollector] Generational collection needs Lua 5.4, the incremental collector is used." << std::endl;
+	}
+	lua_gc(luaState, LUA_GCSETPAUSE, pause);
+	lua_gc(luaState, LUA_GCSETSTEPMUL, stepMultiplier);
+#endif
+
+	gcIdleStepSize = std::max<int32_t>(0, g_config.getNumber(ConfigManager::LUA_GC_IDLE_STEP_SIZE));
+	gcIdleBudget = std::chrono::microseconds(std::max<int32_t>(0, g_config.getNumber(ConfigManager::LUA_GC_IDLE_BUDGET)));
+	gcIdleThreshold = 0;
+}
+
+void LuaEnvironment::collectIdleGarbage()
+{
+	if (!luaState || gcIdleStepSize == 0) {
+		return;
+	}
+
+	// after a finished cycle the collector rests until the heap has grown by
+	// another step, otherwise every idle gap would start a new cycle
+	if (lua_gc(luaState, LUA_GCCOUNT, 0) < gcIdleThreshold) {
+		return;
+	}
+
+	auto deadline = std::chrono::steady_clock::now() + gcIdleBudget;
+	do {
+		if (lua_gc(luaState, LUA_GCSTEP, gcIdleStepSize)) {
+			gcIdleThreshold = lua_gc(luaState, LUA_GCCOUNT, 0) + gcIdleStepSize;
+			break;
+		}
+	} while (std::chrono::steady_clock::now() < deadline);
 }
 
 bool LuaEnvironment::closeState()
@@ -17911,19 +19074,27 @@ bool LuaEnvironment::closeState()
 		clearAreaObjects(areaEntry.first);
 	}
 
-	for (auto& timerEntry : timerEvents) {
-		LuaTimerEventDesc timerEventDesc = std::move(timerEntry.second);
-		for (int32_t parameter : timerEventDesc.parameters) {
-			luaL_unref(luaState, LUA_REGISTRYINDEX, parameter);
-		}
-		luaL_unref(luaState, LUA_REGISTRYINDEX, timerEventDesc.function);
+	for (const auto& timerEntry : timerEvents) {
+		luaL_unref(luaState, LUA_REGISTRYINDEX, timerEntry.second.reference);
+	}
+
+	for (const auto& slotEntry : timerSlots) {
+		g_scheduler.stopEvent(slotEntry.second.schedulerEventId);
+	}
+
+	for (const auto& coroutineEntry : suspendedCoroutines) {
+		luaL_unref(luaState, LUA_REGISTRYINDEX, coroutineEntry.second.reference);
 	}
 
 	combatIdMap.clear();
 	areaIdMap.clear();
 	timerEvents.clear();
+	timerSlots.clear();
+	suspendedCoroutines.clear();
 	cacheFiles.clear();
 
+	g_luaProfiler.attach(nullptr);
+	g_watchdog.attach(nullptr);
 	lua_close(luaState);
 	luaState = nullptr;
 	return true;
@@ -18004,37 +19175,154 @@ void LuaEnvironment::clearAreaObjects(LuaScriptInterface* interface)
 	it->second.clear();
 }
 
-void LuaEnvironment::executeTimerEvent(uint32_t eventIndex)
+uint32_t LuaEnvironment::suspendCoroutine(lua_State* L)
 {
-	auto it = timerEvents.find(eventIndex);
-	if (it == timerEvents.end()) {
+	if (lua_pushthread(L) == 1) {
+		lua_pop(L, 1);
+		return 0;
+	}
+
+	LuaSuspendedCoroutine coroutine;
+	coroutine.reference = luaL_ref(L, LUA_REGISTRYINDEX);
+
+	ScriptEnvironment* env = getScriptEnv();
+	int32_t callbackId;
+	env->getEventInfo(coroutine.scriptId, coroutine.scriptInterface, callbackId, coroutine.timerEvent);
+	coroutine.npc = env->getNpc();
+
+	uint32_t coroutineId = ++lastCoroutineId;
+	suspendedCoroutines.emplace(coroutineId, coroutine);
+	return coroutineId;
+}
+
+void LuaEnvironment::resumeCoroutine(uint32_t coroutineId, const std::function<int(lua_State*)>& push)
+{
+	auto it = suspendedCoroutines.find(coroutineId);
+	if (it == suspendedCoroutines.end()) {
 		return;
 	}
 
-	LuaTimerEventDesc timerEventDesc = std::move(it->second);
-	timerEvents.erase(it);
+	LuaSuspendedCoroutine coroutine = it->second;
+	suspendedCoroutines.erase(it);
+
+	lua_rawgeti(luaState, LUA_REGISTRYINDEX, coroutine.reference);
+	lua_State* thread = lua_tothread(luaState, -1);
+	lua_pop(luaState, 1);
+
+	if (!thread || lua_status(thread) != LUA_YIELD) {
+		luaL_unref(luaState, LUA_REGISTRYINDEX, coroutine.reference);
+		return;
+	}
+
+	if (!reserveScriptEnv()) {
+		std::cout << "[Error - LuaEnvironment::resumeCoroutine] Call stack overflow" << std::endl;
+		luaL_unref(luaState, LUA_REGISTRYINDEX, coroutine.reference);
+		return;
+	}
+
+	ScriptEnvironment* env = getScriptEnv();
+	env->setScriptId(coroutine.scriptId, coroutine.scriptInterface);
+	env->setNpc(coroutine.npc);
+	if (coroutine.timerEvent) {
+		env->setTimerEvent();
+	}
+
+	// the values of the last yield are replaced by those of the yielding call
+	lua_settop(thread, 0);
+	int parameters = push(thread);
+#if LUA_VERSION_NUM >= 504
+	int results;
+	int status = lua_resume(thread, luaState, parameters, &results);
+#elif LUA_VERSION_NUM >= 502
+	int status = lua_resume(thread, luaState, parameters);
+#else
+	int status = lua_resume(thread, parameters);
+#endif
+
+	// a yield leaves the thread to whoever resumes it next
+	if (status != 0 && status != LUA_YIELD) {
+		reportError(nullptr, getString(thread, -1));
+	}
+	lua_settop(thread, 0);
+
+	resetScriptEnv();
+	luaL_unref(luaState, LUA_REGISTRYINDEX, coroutine.reference);
+}
+
+uint32_t LuaEnvironment::addTimerEvent(LuaTimerEventDesc&& eventDesc, uint32_t delay)
+{
+	int64_t now = OTSYS_TIME();
+	eventDesc.due = now + delay;
+
+	// round up so that no event runs before its delay has passed
+	int64_t slot = (eventDesc.due + SCHEDULER_MINTICKS - 1) / SCHEDULER_MINTICKS;
+	LuaTimerSlot& timerSlot = timerSlots[slot];
+	if (timerSlot.events.empty()) {
+		timerSlot.schedulerEventId = g_scheduler.addEvent(createSchedulerTask(
+			slot * SCHEDULER_MINTICKS - now, std::bind(&LuaEnvironment::executeTimerSlot, this, slot)
+		));
+	}
 
-	//push function
-	lua_rawgeti(luaState, LUA_REGISTRYINDEX, timerEventDesc.function);
+	uint32_t eventId = lastEventTimerId++;
+	timerSlot.events.push_back(eventId);
+	timerEvents.emplace(eventId, std::move(eventDesc));
+	return eventId;
+}
+
+void LuaEnvironment::executeTimerSlot(int64_t slot)
+{
+	auto it = timerSlots.find(slot);
+	if (it == timerSlots.end()) {
+		return;
+	}
+
+	std::vector<std::pair<int64_t, uint32_t>> dueEvents;
+	dueEvents.reserve(it->second.events.size());
+	for (uint32_t eventId : it->second.events) {
+		auto eventIt = timerEvents.find(eventId);
+		if (eventIt != timerEvents.end()) {
+			dueEvents.emplace_back(eventIt->second.due, eventId);
+		}
+	}
+	timerSlots.erase(it);
 
-	//push parameters
-	for (auto parameter : boost::adaptors::reverse(timerEventDesc.parameters)) {
-		lua_rawgeti(luaState, LUA_REGISTRYINDEX, parameter);
+	// keep the order a scheduler event per timer would have had
+	std::sort(dueEvents.begin(), dueEvents.end());
+
+	for (const auto& dueEvent : dueEvents) {
+		// an earlier callback of this slot may have stopped it
+		auto eventIt = timerEvents.find(dueEvent.second);
+		if (eventIt == timerEvents.end()) {
+			continue;
+		}
+
+		LuaTimerEventDesc timerEventDesc = std::move(eventIt->second);
+		timerEvents.erase(eventIt);
+		executeTimerEvent(timerEventDesc);
+	}
+}
+
+void LuaEnvironment::executeTimerEvent(LuaTimerEventDesc& timerEventDesc)
+{
+	//push function and parameters
+	lua_rawgeti(luaState, LUA_REGISTRYINDEX, timerEventDesc.reference);
+	int packed = lua_gettop(luaState);
+	for (int i = 1; i <= timerEventDesc.parameters + 1; ++i) {
+		lua_rawgeti(luaState, packed, i);
 	}
+	lua_remove(luaState, packed);
 
 	//call the function
 	if (reserveScriptEnv()) {
 		ScriptEnvironment* env = getScriptEnv();
 		env->setTimerEvent();
 		env->setScriptId(timerEventDesc.scriptId, this);
-		callFunction(timerEventDesc.parameters.size());
+		callFunction(timerEventDesc.parameters);
 	} else {
+		lua_pop(luaState, timerEventDesc.parameters + 1);
 		std::cout << "[Error - LuaScriptInterface::executeTimerEvent] Call stack overflow" << std::endl;
 	}
 
 	//free resources
-	luaL_unref(luaState, LUA_REGISTRYINDEX, timerEventDesc.function);
-	for (auto parameter : timerEventDesc.parameters) {
-		luaL_unref(luaState, LUA_REGISTRYINDEX, parameter);
-	}
+	luaL_unref(luaState, LUA_REGISTRYINDEX, timerEventDesc.reference);
 }
@@ -38,6 +38,7 @@ class Condition;
 class Npc;
 class Monster;
 class InstantSpell;
+struct JsonValue;
 
 enum {
 	EVENT_ID_LOADING = 1,
@@ -74,9 +75,10 @@ struct LuaVariant {
 
 struct LuaTimerEventDesc {
 	int32_t scriptId = -1;
-	int32_t function = -1;
-	std::vector<int32_t> parameters;
-	uint32_t eventId = 0;
+	// the callback followed by its parameters, packed into a single table
+	int32_t reference = -1;
+	int32_t parameters = 0;
+	int64_t due = 0;
 
 	LuaTimerEventDesc() = default;
 	LuaTimerEventDesc(LuaTimerEventDesc&& other) = default;
@@ -88,6 +90,17 @@ class Game;
 
 struct LootBlock;
 
+// a coroutine waiting in a yielding call and the script environment it
+// yielded from, which is set up again when it resumes
+struct LuaSuspendedCoroutine {
+	// the thread in the registry, so it is not collected while it waits
+	int32_t reference = -1;
+	int32_t scriptId = -1;
+	LuaScriptInterface* scriptInterface = nullptr;
+	Npc* npc = nullptr;
+	bool timerEvent = false;
+};
+
 class ScriptEnvironment
 {
 	public:
@@ -200,6 +213,10 @@ class LuaScriptInterface
 
 		int32_t loadFile(const std::string& file, Npc* npc = nullptr);
 
+		// luaL_loadfile through the bytecode cache when luaBytecodeCache is on,
+		// refreshes the cache of changed files, safe to call from any thread
+		static int loadCachedFile(lua_State* L, const std::string& file);
+
 		const std::string& getFileById(int32_t scriptId);
 		int32_t getEvent(const std::string& eventName);
 		int32_t getEvent();
@@ -220,6 +237,7 @@ class LuaScriptInterface
 		}
 
 		static void reportError(const char* function, const std::string& error_desc, lua_State* L = nullptr, bool stack_trace = false);
+		static std::string getStackTrace(lua_State* L, const std::string& error_desc);
 
 		const std::string& getInterfaceName() const {
 			return interfaceName;
@@ -237,13 +255,17 @@ class LuaScriptInterface
 		static int luaErrorHandler(lua_State* L);
 		bool callFunction(int params);
 		void callVoidFunction(int params);
+		std::string getProfilerOrigin() const;
 
 		//push/pop common structures
 		static void pushThing(lua_State* L, Thing* thing);
 		static void pushVariant(lua_State* L, const LuaVariant& var);
 		static void pushString(lua_State* L, const std::string& value);
+		static void pushJsonValue(lua_State* L, const JsonValue& value);
 		static void pushCallback(lua_State* L, int32_t callback);
 		static void pushCylinder(lua_State* L, Cylinder* cylinder);
+		static void pushItem(lua_State* L, Item* item);
+		static void pushCreature(lua_State* L, Creature* creature);
 
 		static std::string popString(lua_State* L);
 		static int32_t popCallback(lua_State* L);
@@ -392,6 +414,8 @@ class LuaScriptInterface
 		{
 			return lua_isuserdata(L, arg) != 0;
 		}
+		// a position table or a position pushed as userdata
+		static bool isPosition(lua_State* L, int32_t arg);
 
 		// Push
 		static void pushBoolean(lua_State* L, bool value);
@@ -421,7 +445,7 @@ class LuaScriptInterface
 		static const luaL_Reg luaBitReg[7];
 #endif
 		static const luaL_Reg luaConfigManagerTable[4];
-		static const luaL_Reg luaDatabaseTable[9];
+		static const luaL_Reg luaDatabaseTable[11];
 		static const luaL_Reg luaResultTable[6];
 
 		static int protectedCall(lua_State* L, int nargs, int nresults);
@@ -452,7 +476,6 @@ class LuaScriptInterface
 		void registerGlobalVariable(const std::string& name, lua_Number value);
 		void registerGlobalBoolean(const std::string& name, bool value);
 
-		static std::string getStackTrace(lua_State* L, const std::string& error_desc);
 
 		static bool getArea(lua_State* L, std::vector<uint32_t>& vec, uint32_t& rows);
 
@@ -520,6 +543,8 @@ class LuaScriptInterface
 		static int luaDatabaseAsyncExecute(lua_State* L);
 		static int luaDatabaseStoreQuery(lua_State* L);
 		static int luaDatabaseAsyncStoreQuery(lua_State* L);
+		static int luaDatabaseAwaitQuery(lua_State* L);
+		static int luaDatabaseAwaitStoreQuery(lua_State* L);
 		static int luaDatabaseEscapeString(lua_State* L);
 		static int luaDatabaseEscapeBlob(lua_State* L);
 		static int luaDatabaseLastInsertId(lua_State* L);
@@ -547,8 +572,14 @@ class LuaScriptInterface
 
 		// Game
 		static int luaGameGetSpectators(lua_State* L);
+		static int luaGameCountSpectators(lua_State* L);
+		static int luaGameForEachSpectator(lua_State* L);
+		static int luaGameSendMagicEffectArea(lua_State* L);
+		static int luaGameBroadcastToArea(lua_State* L);
 		static int luaGameGetPlayers(lua_State* L);
 		static int luaGameLoadMap(lua_State* L);
+		static int luaGameCreateInstance(lua_State* L);
+		static int luaGameDestroyInstance(lua_State* L);
 
 		static int luaGameGetExperienceStage(lua_State* L);
 		static int luaGameGetExperienceForLevel(lua_State* L);
@@ -556,6 +587,7 @@ class LuaScriptInterface
 		static int luaGameGetPlayerCount(lua_State* L);
 		static int luaGameGetNpcCount(lua_State* L);
 		static int luaGameGetMonsterTypes(lua_State* L);
+		static int luaGameGetItemIdsByPrefix(lua_State* L);
 
 		static int luaGameGetTowns(lua_State* L);
 		static int luaGameGetHouses(lua_State* L);
@@ -577,6 +609,8 @@ class LuaScriptInterface
 		static int luaGameCreateTile(lua_State* L);
 		static int luaGameCreateMonsterType(lua_State* L);
 
+		static int luaGameMoveItems(lua_State* L);
+
 		static int luaGameStartRaid(lua_State* L);
 
 		static int luaGameGetClientVersion(lua_State* L);
@@ -587,6 +621,15 @@ class LuaScriptInterface
 		static int luaGameSetAccountStorageValue(lua_State* L);
 		static int luaGameSaveAccountStorageValues(lua_State* L);
 
+		static int luaGameGetDispatcherProfile(lua_State* L);
+		static int luaGameSetDispatcherProfilerEnabled(lua_State* L);
+		static int luaGameGetLuaProfile(lua_State* L);
+		static int luaGameSetLuaProfilerEnabled(lua_State* L);
+		static int luaGameSetTracingEnabled(lua_State* L);
+		static int luaGameDumpTrace(lua_State* L);
+		static int luaGameGetMemoryUsage(lua_State* L);
+		static int luaGameSleep(lua_State* L);
+
 		// Variant
 		static int luaVariantCreate(lua_State* L);
 
@@ -606,6 +649,9 @@ class LuaScriptInterface
 		static int luaPositionSendMagicEffect(lua_State* L);
 		static int luaPositionSendDistanceEffect(lua_State* L);
 
+		static int luaPositionValueIndex(lua_State* L);
+		static int luaPositionValueNewIndex(lua_State* L);
+
 		// Tile
 		static int luaTileCreate(lua_State* L);
 
@@ -1027,6 +1073,7 @@ class LuaScriptInterface
 		static int luaPlayerIsPzLocked(lua_State* L);
 
 		static int luaPlayerGetClient(lua_State* L);
+		static int luaPlayerGetNetworkStats(lua_State* L);
 
 		static int luaPlayerGetHouse(lua_State* L);
 		static int luaPlayerSendHouseWindow(lua_State* L);
@@ -1287,6 +1334,7 @@ class LuaScriptInterface
 		static int luaCombatAddCondition(lua_State* L);
 		static int luaCombatClearConditions(lua_State* L);
 		static int luaCombatSetCallback(lua_State* L);
+		static int luaCombatSetPureCallback(lua_State* L);
 		static int luaCombatSetOrigin(lua_State* L);
 
 		static int luaCombatExecute(lua_State* L);
@@ -1339,6 +1387,7 @@ class LuaScriptInterface
 		static int luaMonsterTypeCanWalkOnFire(lua_State* L);
 		static int luaMonsterTypeCanWalkOnPoison(lua_State* L);
 
+		static int luaMonsterTypeId(lua_State* L);
 		static int luaMonsterTypeName(lua_State* L);
 		static int luaMonsterTypeNameDescription(lua_State* L);
 
@@ -1365,6 +1414,7 @@ class LuaScriptInterface
 
 		static int luaMonsterTypeGetLoot(lua_State* L);
 		static int luaMonsterTypeAddLoot(lua_State* L);
+		static int luaMonsterTypeCreateLoot(lua_State* L);
 
 		static int luaMonsterTypeGetCreatureEvents(lua_State* L);
 		static int luaMonsterTypeRegisterEvent(lua_State* L);
@@ -1420,6 +1470,7 @@ class LuaScriptInterface
 		static int luaMonsterSpellSetCombatLength(lua_State* L);
 		static int luaMonsterSpellSetCombatSpread(lua_State* L);
 		static int luaMonsterSpellSetCombatRadius(lua_State* L);
+		static int luaMonsterSpellSetCombatArea(lua_State* L);
 		static int luaMonsterSpellSetConditionType(lua_State* L);
 		static int luaMonsterSpellSetConditionDamage(lua_State* L);
 		static int luaMonsterSpellSetConditionSpeedChange(lua_State* L);
@@ -1520,6 +1571,8 @@ class LuaScriptInterface
 		static int luaCreateCreatureEvent(lua_State* L);
 		static int luaCreatureEventType(lua_State* L);
 		static int luaCreatureEventRegister(lua_State* L);
+		static int luaCreatureEventOpcode(lua_State* L);
+		static int luaCreatureEventDecode(lua_State* L);
 		static int luaCreatureEventOnCallback(lua_State* L);
 
 		// MoveEvents
@@ -1611,6 +1664,11 @@ class LuaEnvironment : public LuaScriptInterface
 		bool reInitState();
 		bool closeState() override;
 
+		// applies the collector settings of the config to the current state
+		void configureGarbageCollector();
+		// spends the idle budget on collector steps, called by the dispatcher before it sleeps
+		void collectIdleGarbage();
+
 		LuaScriptInterface* getTestInterface();
 
 		Combat_ptr getCombatObject(uint32_t id) const;
@@ -1621,12 +1679,29 @@ class LuaEnvironment : public LuaScriptInterface
 		uint32_t createAreaObject(LuaScriptInterface* interface);
 		void clearAreaObjects(LuaScriptInterface* interface);
 
+		// keeps the running coroutine L until resumeCoroutine, 0 when L is the
+		// main thread and cannot yield
+		uint32_t suspendCoroutine(lua_State* L);
+		// pushes the values of the yielding call with push and runs the
+		// coroutine on, nothing once the state it belonged to was closed
+		void resumeCoroutine(uint32_t coroutineId, const std::function<int(lua_State*)>& push);
+
 	private:
-		void executeTimerEvent(uint32_t eventIndex);
+		// timer events due within the same scheduler tick share one scheduler event
+		struct LuaTimerSlot {
+			uint32_t schedulerEventId = 0;
+			std::vector<uint32_t> events;
+		};
+
+		uint32_t addTimerEvent(LuaTimerEventDesc&& eventDesc, uint32_t delay);
+		void executeTimerSlot(int64_t slot);
+		void executeTimerEvent(LuaTimerEventDesc& eventDesc);
 
 		std::unordered_map<uint32_t, LuaTimerEventDesc> timerEvents;
+		std::map<int64_t, LuaTimerSlot> timerSlots;
 		std::unordered_map<uint32_t, Combat_ptr> combatMap;
 		std::unordered_map<uint32_t, AreaCombat*> areaMap;
+		std::unordered_map<uint32_t, LuaSuspendedCoroutine> suspendedCoroutines;
 
 		std::unordered_map<LuaScriptInterface*, std::vector<uint32_t>> combatIdMap;
 		std::unordered_map<LuaScriptInterface*, std::vector<uint32_t>> areaIdMap;
@@ -1636,6 +1711,12 @@ class LuaEnvironment : public LuaScriptInterface
 		uint32_t lastEventTimerId = 1;
 		uint32_t lastCombatId = 0;
 		uint32_t lastAreaId = 0;
+		uint32_t lastCoroutineId = 0;
+
+		// idle collection, in kilobytes as lua_gc counts them
+		int gcIdleStepSize = 0;
+		int gcIdleThreshold = 0;
+		std::chrono::microseconds gcIdleBudget{0};
 
 		friend class LuaScriptInterface;
 		friend class CombatSpell;
@@ -6,6 +6,7 @@
 #include "mailbox.h"
 #include "game.h"
 #include "iologindata.h"
+#include "databasetasks.h"
 
 extern Game g_game;
 
@@ -93,17 +94,28 @@ bool Mailbox::sendItem(Item* item) const
 			return true;
 		}
 	} else {
-		Player tmpPlayer(nullptr);
-		if (!IOLoginData::loadPlayerByName(&tmpPlayer, receiver)) {
+		const uint32_t guid = IOLoginData::getGuidByName(receiver);
+		if (guid == 0) {
 			return false;
 		}
 
-		if (g_game.internalMoveItem(item->getParent(), tmpPlayer.getInbox(), INDEX_WHEREEVER,
-		                            item, item->getItemCount(), nullptr, FLAG_NOLIMIT) == RETURNVALUE_NOERROR) {
-			g_game.transformItem(item, item->getID() + 1);
-			IOLoginData::savePlayer(&tmpPlayer);
-			return true;
+		// the parcel goes straight into the stored inbox, arriving stamped
+		auto rows = std::make_shared<InboxItemRows>();
+		IOLoginData::addInboxItemRow(*rows, item);
+		rows->front().itemType = item->getID() + 1;
+
+		if (g_game.internalRemoveItem(item) != RETURNVALUE_NOERROR) {
+			return false;
+		}
+
+		// keyed by the character, so it runs in order with its loads and saves
+		auto job = [guid, rows](Database& db) {
+			return IOLoginData::appendInboxItems(db, guid, *rows);
+		};
+		if (!g_databaseTasks.addJob(job, nullptr, guid)) {
+			job(Database::getInstance());
 		}
+		return true;
 	}
 	return false;
 }
@@ -5,21 +5,32 @@
 
 #include "iomap.h"
 #include "iomapserialize.h"
+#include "databasetasks.h"
 #include "combat.h"
 #include "creature.h"
 #include "game.h"
+#include "hugepagearena.h"
 #include "monster.h"
+#include "metrics.h"
+#include "teleport.h"
+#include "workerpool.h"
+#include "scheduler.h"
+#include "tracer.h"
 
 extern Game g_game;
 
 bool Map::loadMap(const std::string& identifier, bool loadHouses)
 {
-	IOMap loader;
-	if (!loader.loadMap(this, identifier)) {
-		std::cout << "[Fatal - Map::loadMap] " << loader.getLastErrorString() << std::endl;
+	auto loader = std::make_shared<IOMap>();
+	if (!loader->loadMap(this, identifier)) {
+		std::cout << "[Fatal - Map::loadMap] " << loader->getLastErrorString() << std::endl;
 		return false;
 	}
 
+	if (loader->hasPendingAreas()) {
+		lazyMap = loader;
+	}
+
 	if (!IOMap::loadSpawns(this)) {
 		std::cout << "[Warning - Map::loadMap] Failed to load spawn data." << std::endl;
 	}
@@ -35,6 +46,248 @@ bool Map::loadMap(const std::string& identifier, bool loadHouses)
 	return true;
 }
 
+void Map::loadArea(const Position& pos, int32_t rangeX/* = maxViewportX * 2*/, int32_t rangeY/* = maxViewportY * 2*/)
+{
+	for (auto& it : instances) {
+		if (!it.second.pendingBlocks.empty()) {
+			loadInstanceBlocks(it.second, pos.x - rangeX, pos.y - rangeY, pos.x + rangeX, pos.y + rangeY);
+		}
+	}
+
+	if (!lazyMap) {
+		return;
+	}
+
+	if (!lazyMap->loadAreas(*this, pos.x - rangeX, pos.y - rangeY, pos.x + rangeX, pos.y + rangeY)) {
+		std::cout << "[Error - Map::loadArea] " << lazyMap->getLastErrorString() << std::endl;
+	}
+
+	// everything is loaded, unmap the file
+	if (!lazyMap->hasPendingAreas()) {
+		lazyMap.reset();
+	}
+}
+
+namespace {
+
+bool isInRegion(const Position& pos, const Position& from, const Position& to)
+{
+	return pos.x >= from.x && pos.x <= to.x && pos.y >= from.y && pos.y <= to.y && pos.z >= from.z && pos.z <= to.z;
+}
+
+Item* cloneInstanceItem(const MapInstance& instance, const Item* source)
+{
+	Item* item = source->clone();
+	item->setLoadedFromMap(source->isLoadedFromMap());
+
+	// the original stays registered under its unique id
+	if (item->hasAttribute(ITEM_ATTRIBUTE_UNIQUEID)) {
+		item->removeAttribute(ITEM_ATTRIBUTE_UNIQUEID);
+	}
+
+	if (Teleport* teleport = item->getTeleport()) {
+		const Position& destPos = teleport->getDestPos();
+		if (isInRegion(destPos, instance.from, instance.to)) {
+			teleport->setDestPos(Position(destPos.x - instance.from.x + instance.destination.x, destPos.y - instance.from.y + instance.destination.y, destPos.z - instance.from.z + instance.destination.z));
+		}
+	}
+
+	if (Container* container = item->getContainer()) {
+		for (ContainerIterator it = container->iterator(); it.hasNext(); it.advance()) {
+			if ((*it)->hasAttribute(ITEM_ATTRIBUTE_UNIQUEID)) {
+				(*it)->removeAttribute(ITEM_ATTRIBUTE_UNIQUEID);
+			}
+		}
+	}
+	return item;
+}
+
+}
+
+uint32_t Map::createInstance(const Position& fromPos, const Position& toPos, const Position& destination)
+{
+	MapInstance instance;
+	instance.from = Position(std::min(fromPos.x, toPos.x), std::min(fromPos.y, toPos.y), std::min(fromPos.z, toPos.z));
+	instance.to = Position(std::max(fromPos.x, toPos.x), std::max(fromPos.y, toPos.y), std::max(fromPos.z, toPos.z));
+	instance.destination = destination;
+
+	int32_t width = instance.to.x - instance.from.x;
+	int32_t height = instance.to.y - instance.from.y;
+	int32_t depth = instance.to.z - instance.from.z;
+	if (destination.x + width > std::numeric_limits<uint16_t>::max() || destination.y + height > std::numeric_limits<uint16_t>::max() || destination.z + depth >= MAP_MAX_LAYERS) {
+		return 0;
+	}
+
+	Position destinationEnd(destination.x + width, destination.y + height, destination.z + depth);
+	auto overlaps = [&](const Position& from, const Position& to) {
+		return destination.x <= to.x && destinationEnd.x >= from.x && destination.y <= to.y && destinationEnd.y >= from.y && destination.z <= to.z && destinationEnd.z >= from.z;
+	};
+
+	if (overlaps(instance.from, instance.to)) {
+		return 0;
+	}
+
+	for (const auto& it : instances) {
+		const MapInstance& other = it.second;
+		if (overlaps(other.destination, Position(other.destination.x + other.to.x - other.from.x, other.destination.y + other.to.y - other.from.y, other.destination.z + other.to.z - other.from.z))) {
+			return 0;
+		}
+	}
+
+	// tiles deferred by lazyMapLoading are tiles of the map as well
+	if (lazyMap) {
+		lazyMap->loadAreas(*this, destination.x, destination.y, destinationEnd.x, destinationEnd.y);
+	}
+	for (int32_t z = destination.z; z <= destinationEnd.z; ++z) {
+		for (int32_t x = destination.x; x <= destinationEnd.x; ++x) {
+			for (int32_t y = destination.y; y <= destinationEnd.y; ++y) {
+				// empty tiles left by a destroyed instance count as free
+				const Tile* tile = getTile(x, y, z);
+				if (tile && tile->getThingCount() != 0) {
+					return 0;
+				}
+			}
+		}
+	}
+
+	for (int32_t x = destination.x & ~FLOOR_MASK; x <= destinationEnd.x; x += FLOOR_SIZE) {
+		for (int32_t y = destination.y & ~FLOOR_MASK; y <= destinationEnd.y; y += FLOOR_SIZE) {
+			instance.pendingBlocks.insert(getInstanceBlockKey(x, y));
+		}
+	}
+
+	uint32_t instanceId = ++nextInstanceId;
+	MapInstance& placed = instances.emplace(instanceId, std::move(instance)).first->second;
+
+	// copy what players may already be looking at
+	SpectatorVec spectators;
+	getSpectators(spectators, Position(destination.x + width / 2, destination.y + height / 2, destination.z), true, true, width / 2 + maxViewportX, width / 2 + maxViewportX, height / 2 + maxViewportY, height / 2 + maxViewportY);
+	for (Creature* spectator : spectators) {
+		const Position& pos = spectator->getPosition();
+		loadInstanceBlocks(placed, pos.x - maxViewportX * 2, pos.y - maxViewportY * 2, pos.x + maxViewportX * 2, pos.y + maxViewportY * 2);
+	}
+	return instanceId;
+}
+
+bool Map::destroyInstance(uint32_t instanceId)
+{
+	auto it = instances.find(instanceId);
+	if (it == instances.end()) {
+		return false;
+	}
+
+	MapInstance& instance = it->second;
+	Position destinationEnd(instance.destination.x + instance.to.x - instance.from.x, instance.destination.y + instance.to.y - instance.from.y, instance.destination.z + instance.to.z - instance.from.z);
+	for (uint32_t key : instance.copiedBlocks) {
+		int32_t blockX = (key >> 16) << FLOOR_BITS;
+		int32_t blockY = (key & 0xFFFF) << FLOOR_BITS;
+		for (int32_t x = std::max<int32_t>(blockX, instance.destination.x), endX = std::min<int32_t>(blockX + FLOOR_MASK, destinationEnd.x); x <= endX; ++x) {
+			for (int32_t y = std::max<int32_t>(blockY, instance.destination.y), endY = std::min<int32_t>(blockY + FLOOR_MASK, destinationEnd.y); y <= endY; ++y) {
+				for (int32_t z = instance.destination.z; z <= destinationEnd.z; ++z) {
+					Tile* tile = getTile(x, y, z);
+					if (!tile) {
+						continue;
+					}
+
+					// removed creatures keep pointing at their tile, such a tile stays on the map empty
+					bool hadCreatures = tile->getCreatureCount() != 0;
+					removeTile(x, y, z);
+					if (hadCreatures) {
+						continue;
+					}
+
+					getLeaf(x, y)->getFloor(z)->tiles[x & FLOOR_MASK][y & FLOOR_MASK] = nullptr;
+					g_game.removeTileToClean(tile);
+					auto& cleanFloor = cleanFloors[z];
+					cleanFloor.erase(std::remove(cleanFloor.begin(), cleanFloor.end(), tile), cleanFloor.end());
+					invalidatePathCache(tile->getPosition());
+					delete tile;
+				}
+			}
+		}
+	}
+
+	instances.erase(it);
+	return true;
+}
+
+void Map::loadInstanceBlocks(MapInstance& instance, int32_t fromX, int32_t fromY, int32_t toX, int32_t toY)
+{
+	int32_t width = instance.to.x - instance.from.x;
+	int32_t height = instance.to.y - instance.from.y;
+	fromX = std::max<int32_t>(fromX, instance.destination.x);
+	fromY = std::max<int32_t>(fromY, instance.destination.y);
+	toX = std::min<int32_t>(toX, instance.destination.x + width);
+	toY = std::min<int32_t>(toY, instance.destination.y + height);
+	if (fromX > toX || fromY > toY) {
+		return;
+	}
+
+	for (int32_t blockX = fromX & ~FLOOR_MASK; blockX <= toX; blockX += FLOOR_SIZE) {
+		for (int32_t blockY = fromY & ~FLOOR_MASK; blockY <= toY; blockY += FLOOR_SIZE) {
+			uint32_t key = getInstanceBlockKey(blockX, blockY);
+			if (instance.pendingBlocks.erase(key) == 0) {
+				continue;
+			}
+			instance.copiedBlocks.push_back(key);
+
+			int32_t startX = std::max<int32_t>(blockX, instance.destination.x);
+			int32_t startY = std::max<int32_t>(blockY, instance.destination.y);
+			int32_t endX = std::min<int32_t>(blockX + FLOOR_MASK, instance.destination.x + width);
+			int32_t endY = std::min<int32_t>(blockY + FLOOR_MASK, instance.destination.y + height);
+
+			// the source block may still be deferred by lazyMapLoading
+			if (lazyMap) {
+				lazyMap->loadAreas(*this, startX - instance.destination.x + instance.from.x, startY - instance.destination.y + instance.from.y,
+				                   endX - instance.destination.x + instance.from.x, endY - instance.destination.y + instance.from.y);
+			}
+
+			for (int32_t x = startX; x <= endX; ++x) {
+				for (int32_t y = startY; y <= endY; ++y) {
+					for (int32_t z = instance.from.z; z <= instance.to.z; ++z) {
+						copyInstanceTile(instance, x, y, z - instance.from.z + instance.destination.z);
+					}
+				}
+			}
+		}
+	}
+}
+
+void Map::copyInstanceTile(const MapInstance& instance, uint16_t x, uint16_t y, uint8_t z)
+{
+	const Tile* source = getTile(x - instance.destination.x + instance.from.x, y - instance.destination.y + instance.from.y, z - instance.destination.z + instance.from.z);
+	if (!source) {
+		return;
+	}
+
+	// the down items are stacked newest first, they are added back from the bottom
+	std::vector<Item*> items;
+	if (const TileItemVector* sourceItems = source->getItemList()) {
+		items.reserve(sourceItems->size());
+		for (auto it = sourceItems->getBeginTopItem(), end = sourceItems->getEndTopItem(); it != end; ++it) {
+			items.push_back(cloneInstanceItem(instance, *it));
+		}
+		for (auto it = sourceItems->getEndDownItem(), begin = sourceItems->getBeginDownItem(); it != begin;) {
+			items.push_back(cloneInstanceItem(instance, *--it));
+		}
+	}
+
+	Item* ground = source->getGround() ? cloneInstanceItem(instance, source->getGround()) : nullptr;
+	Tile* tile = IOMap::createTile(ground, items.empty() ? nullptr : items.front(), x, y, z);
+	for (Item* item : items) {
+		tile->internalAddThing(item);
+		item->startDecaying();
+	}
+
+	for (tileflags_t flag : {TILESTATE_PROTECTIONZONE, TILESTATE_NOPVPZONE, TILESTATE_PVPZONE, TILESTATE_NOLOGOUT}) {
+		if (source->hasFlag(flag)) {
+			tile->setFlag(flag);
+		}
+	}
+
+	setTile(x, y, z, tile);
+}
+
 bool Map::save()
 {
 	bool saved = false;
@@ -59,13 +312,42 @@ bool Map::save()
 	return saved;
 }
 
+bool Map::saveAsync()
+{
+	DBStatements houseInfo, houseItems;
+	HouseItemHashes hashes;
+	if (!IOMapSerialize::serializeHouseInfo(houseInfo) || !IOMapSerialize::serializeHouseItems(houseItems, hashes)) {
+		return false;
+	}
+
+	auto callback = [](DBResult_ptr, bool success) {
+		if (!success) {
+			std::cout << "[Error - Map::saveAsync] Failed to save houses." << std::endl;
+		}
+	};
+
+	// keeps consecutive house saves in order, player guids never get this high
+	static constexpr uint32_t HOUSE_SAVE_KEY = std::numeric_limits<uint32_t>::max();
+
+	if (!g_databaseTasks.addJob([houseInfo](Database& db) { return db.executeTransaction(houseInfo); }, callback, HOUSE_SAVE_KEY)) {
+		return save();
+	}
+	return g_databaseTasks.addJob([houseItems](Database& db) { return db.executeTransaction(houseItems); }, [hashes](DBResult_ptr, bool success) {
+		if (!success) {
+			std::cout << "[Error - Map::saveAsync] Failed to save house items." << std::endl;
+			return;
+		}
+		IOMapSerialize::setSavedHouseItems(hashes);
+	}, HOUSE_SAVE_KEY);
+}
+
 Tile* Map::getTile(uint16_t x, uint16_t y, uint8_t z) const
 {
 	if (z >= MAP_MAX_LAYERS) {
 		return nullptr;
 	}
 
-	const QTreeLeafNode* leaf = QTreeNode::getLeafStatic<const QTreeLeafNode*, const QTreeNode*>(&root, x, y);
+	const QTreeLeafNode* leaf = getLeaf(x, y);
 	if (!leaf) {
 		return nullptr;
 	}
@@ -88,26 +370,32 @@ void Map::setTile(uint16_t x, uint16_t y, uint8_t z, Tile* newTile)
 	QTreeLeafNode* leaf = root.createLeaf(x, y, 15);
 
 	if (QTreeLeafNode::newLeaf) {
+		std::unique_ptr<LeafPage>& page = leafPages[getLeafPageIndex(x, y)];
+		if (!page) {
+			page.reset(new LeafPage);
+		}
+		page->leaves[getLeafIndex(x, y)] = leaf;
+
 		//update north
-		QTreeLeafNode* northLeaf = root.getLeaf(x, y - FLOOR_SIZE);
+		QTreeLeafNode* northLeaf = getLeaf(x, y - FLOOR_SIZE);
 		if (northLeaf) {
 			northLeaf->leafS = leaf;
 		}
 
 		//update west leaf
-		QTreeLeafNode* westLeaf = root.getLeaf(x - FLOOR_SIZE, y);
+		QTreeLeafNode* westLeaf = getLeaf(x - FLOOR_SIZE, y);
 		if (westLeaf) {
 			westLeaf->leafE = leaf;
 		}
 
 		//update south
-		QTreeLeafNode* southLeaf = root.getLeaf(x, y + FLOOR_SIZE);
+		QTreeLeafNode* southLeaf = getLeaf(x, y + FLOOR_SIZE);
 		if (southLeaf) {
 			leaf->leafS = southLeaf;
 		}
 
 		//update east
-		QTreeLeafNode* eastLeaf = root.getLeaf(x + FLOOR_SIZE, y);
+		QTreeLeafNode* eastLeaf = getLeaf(x + FLOOR_SIZE, y);
 		if (eastLeaf) {
 			leaf->leafE = eastLeaf;
 		}
@@ -135,6 +423,8 @@ void Map::setTile(uint16_t x, uint16_t y, uint8_t z, Tile* newTile)
 		delete newTile;
 	} else {
 		tile = newTile;
+		// its items may have been added before it was on the map
+		++leaf->pathGeneration;
 	}
 }
 
@@ -144,7 +434,7 @@ void Map::removeTile(uint16_t x, uint16_t y, uint8_t z)
 		return;
 	}
 
-	const QTreeLeafNode* leaf = QTreeNode::getLeafStatic<const QTreeLeafNode*, const QTreeNode*>(&root, x, y);
+	const QTreeLeafNode* leaf = getLeaf(x, y);
 	if (!leaf) {
 		return;
 	}
@@ -156,7 +446,7 @@ void Map::removeTile(uint16_t x, uint16_t y, uint8_t z)
 
 	Tile* tile = floor->tiles[x & FLOOR_MASK][y & FLOOR_MASK];
 	if (tile) {
-		if (const CreatureVector* creatures = tile->getCreatures()) {
+		if (const TileCreatureVector* creatures = tile->getCreatures()) {
 			for (int32_t i = creatures->size(); --i >= 0;) {
 				if (Player* player = (*creatures)[i]->getPlayer()) {
 					g_game.internalTeleport(player, player->getTown()->getTemplePosition(), false, FLAG_NOLIMIT);
@@ -185,6 +475,8 @@ bool Map::placeCreature(const Position& centerPos, Creature* creature, bool exte
 	bool foundTile;
 	bool placeInPZ;
 
+	loadArea(centerPos);
+
 	Tile* tile = getTile(centerPos.x, centerPos.y, centerPos.z);
 	if (tile) {
 		placeInPZ = tile->hasFlag(TILESTATE_PROTECTIONZONE);
@@ -248,7 +540,11 @@ bool Map::placeCreature(const Position& centerPos, Creature* creature, bool exte
 	toCylinder->internalAddThing(creature);
 
 	const Position& dest = toCylinder->getPosition();
-	getQTNode(dest.x, dest.y)->addCreature(creature);
+	getQTNode(dest.x, dest.y)->addCreature(creature, dest);
+
+	if (creature->getPlayer()) {
+		spawns.onPlayerMove(dest);
+	}
 	return true;
 }
 
@@ -259,6 +555,8 @@ void Map::moveCreature(Creature& creature, Tile& newTile, bool forceTeleport/* =
 	Position oldPos = oldTile.getPosition();
 	Position newPos = newTile.getPosition();
 
+	loadArea(newPos);
+
 	bool teleport = forceTeleport || !newTile.getGround() || !Position::areInRange<1, 1, 0>(oldPos, newPos);
 
 	SpectatorVec spectators, newPosSpectators;
@@ -286,12 +584,18 @@ void Map::moveCreature(Creature& creature, Tile& newTile, bool forceTeleport/* =
 	// Switch the node ownership
 	if (leaf != new_leaf) {
 		leaf->removeCreature(&creature);
-		new_leaf->addCreature(&creature);
+		new_leaf->addCreature(&creature, newPos);
+	} else {
+		leaf->moveCreature(&creature, newPos);
 	}
 
 	//add the creature
 	newTile.addThing(&creature);
 
+	if (creature.getPlayer()) {
+		spawns.onPlayerMove(newPos);
+	}
+
 	if (!teleport) {
 		if (oldPos.y > newPos.y) {
 			creature.setDirection(DIRECTION_NORTH);
@@ -327,7 +631,25 @@ void Map::moveCreature(Creature& creature, Tile& newTile, bool forceTeleport/* =
 	newTile.postAddNotification(&creature, &oldTile, 0);
 }
 
-void Map::getSpectatorsInternal(SpectatorVec& spectators, const Position& centerPos, int32_t minRangeX, int32_t maxRangeX, int32_t minRangeY, int32_t maxRangeY, int32_t minRangeZ, int32_t maxRangeZ, bool onlyPlayers) const
+namespace {
+
+constexpr size_t SPECTATOR_SCAN_CHUNK = 64;
+
+// players hear through player_list
+inline bool isHearing(const Creature* creature, uint8_t interests)
+{
+	return (interests & CREATURE_INTEREST_HEARING) != 0 && !creature->getPlayer();
+}
+
+// low <= value <= low + range as a single unsigned compare
+inline uint8_t scanRange(int32_t value, int32_t low, uint32_t range)
+{
+	return static_cast<uint32_t>(value - low) <= range;
+}
+
+}
+
+void Map::getSpectatorsInternal(SpectatorVec& spectators, const Position& centerPos, int32_t minRangeX, int32_t maxRangeX, int32_t minRangeY, int32_t maxRangeY, int32_t minRangeZ, int32_t maxRangeZ, QTreeLeafNode::CreatureIndex QTreeLeafNode::* list) const
 {
 	auto min_y = centerPos.y + minRangeY;
 	auto min_x = centerPos.x + minRangeX;
@@ -347,7 +669,12 @@ void Map::getSpectatorsInternal(SpectatorVec& spectators, const Position& center
 	int32_t endx2 = x2 - (x2 % FLOOR_SIZE);
 	int32_t endy2 = y2 - (y2 % FLOOR_SIZE);
 
-	const QTreeLeafNode* startLeaf = QTreeNode::getLeafStatic<const QTreeLeafNode*, const QTreeNode*>(&root, startx1, starty1);
+	const uint32_t rangeX = max_x - min_x;
+	const uint32_t rangeY = max_y - min_y;
+	minRangeZ = std::max<int32_t>(minRangeZ, 0);
+	maxRangeZ = std::min<int32_t>(maxRangeZ, MAP_MAX_LAYERS - 1);
+
+	const QTreeLeafNode* startLeaf = getLeaf(startx1, starty1);
 	const QTreeLeafNode* leafS = startLeaf;
 	const QTreeLeafNode* leafE;
 
@@ -355,203 +682,399 @@ void Map::getSpectatorsInternal(SpectatorVec& spectators, const Position& center
 		leafE = leafS;
 		for (int_fast32_t nx = startx1; nx <= endx2; nx += FLOOR_SIZE) {
 			if (leafE) {
-				const CreatureVector& node_list = (onlyPlayers ? leafE->player_list : leafE->creature_list);
-				for (Creature* creature : node_list) {
-					const Position& cpos = creature->getPosition();
-					if (minRangeZ > cpos.z || maxRangeZ < cpos.z) {
-						continue;
-					}
+				const QTreeLeafNode::CreatureIndex& index = leafE->*list;
+				for (int32_t z = minRangeZ; z <= maxRangeZ; ++z) {
+					// the floor offset (centerPos.z - z) moves the window: min_x + offsetZ <= x
+					const int32_t lowX = min_x + centerPos.z - z;
+					const int32_t lowY = min_y + centerPos.z - z;
+					const size_t end = index.floorStart[z + 1];
+					for (size_t base = index.floorStart[z]; base < end; base += SPECTATOR_SCAN_CHUNK) {
+						const size_t chunk = std::min<size_t>(SPECTATOR_SCAN_CHUNK, end - base);
+						const uint16_t* xs = index.x.data() + base;
+						const uint16_t* ys = index.y.data() + base;
+
+						// branchless pass the compiler can vectorize, see scanRange
+						uint8_t matches[SPECTATOR_SCAN_CHUNK];
+						for (size_t i = 0; i < chunk; ++i) {
+							matches[i] = scanRange(xs[i], lowX, rangeX) & scanRange(ys[i], lowY, rangeY);
+						}
 
-					int_fast16_t offsetZ = Position::getOffsetZ(centerPos, cpos);
-					if ((min_y + offsetZ) > cpos.y || (max_y + offsetZ) < cpos.y || (min_x + offsetZ) > cpos.x || (max_x + offsetZ) < cpos.x) {
-						continue;
+						for (size_t i = 0; i < chunk; ++i) {
+							if (matches[i]) {
+								spectators.emplace_back(index.creatures[base + i]);
+							}
+						}
 					}
-
-					spectators.emplace_back(creature);
 				}
 				leafE = leafE->leafE;
 			} else {
-				leafE = QTreeNode::getLeafStatic<const QTreeLeafNode*, const QTreeNode*>(&root, nx + FLOOR_SIZE, ny);
+				leafE = getLeaf(nx + FLOOR_SIZE, ny);
 			}
 		}
 
 		if (leafS) {
 			leafS = leafS->leafS;
 		} else {
-			leafS = QTreeNode::getLeafStatic<const QTreeLeafNode*, const QTreeNode*>(&root, startx1, ny + FLOOR_SIZE);
+			leafS = getLeaf(startx1, ny + FLOOR_SIZE);
 		}
 	}
 }
 
+void Map::getSpectatorFloorRange(int32_t z, int32_t& minRangeZ, int32_t& maxRangeZ)
+{
+	if (z > 7) {
+		//underground (8->15)
+		minRangeZ = std::max<int32_t>(z - 2, 0);
+		maxRangeZ = std::min<int32_t>(z + 2, MAP_MAX_LAYERS - 1);
+	} else if (z == 6) {
+		minRangeZ = 0;
+		maxRangeZ = 8;
+	} else if (z == 7) {
+		minRangeZ = 0;
+		maxRangeZ = 9;
+	} else {
+		minRangeZ = 0;
+		maxRangeZ = 7;
+	}
+}
+
+bool Map::isInSpectatorRange(const Position& centerPos, const Position& pos, bool multifloor)
+{
+	int32_t minRangeZ;
+	int32_t maxRangeZ;
+	if (multifloor) {
+		getSpectatorFloorRange(centerPos.z, minRangeZ, maxRangeZ);
+	} else {
+		minRangeZ = centerPos.z;
+		maxRangeZ = centerPos.z;
+	}
+
+	if (pos.z < minRangeZ || pos.z > maxRangeZ) {
+		return false;
+	}
+
+	// the window moves by the floor offset like in getSpectatorsInternal
+	int32_t offsetZ = centerPos.z - pos.z;
+	return std::abs(pos.x - centerPos.x - offsetZ) <= maxViewportX && std::abs(pos.y - centerPos.y - offsetZ) <= maxViewportY;
+}
+
 void Map::getSpectators(SpectatorVec& spectators, const Position& centerPos, bool multifloor /*= false*/, bool onlyPlayers /*= false*/, int32_t minRangeX /*= 0*/, int32_t maxRangeX /*= 0*/, int32_t minRangeY /*= 0*/, int32_t maxRangeY /*= 0*/)
 {
+	TraceSpan traceSpan("Map::getSpectators");
 	if (centerPos.z >= MAP_MAX_LAYERS) {
 		return;
 	}
 
-	bool foundCache = false;
-	bool cacheResult = false;
-
 	minRangeX = (minRangeX == 0 ? -maxViewportX : -minRangeX);
 	maxRangeX = (maxRangeX == 0 ? maxViewportX : maxRangeX);
 	minRangeY = (minRangeY == 0 ? -maxViewportY : -minRangeY);
 	maxRangeY = (maxRangeY == 0 ? maxViewportY : maxRangeY);
 
-	if (minRangeX == -maxViewportX && maxRangeX == maxViewportX && minRangeY == -maxViewportY && maxRangeY == maxViewportY && multifloor) {
-		if (onlyPlayers) {
-			auto it = playersSpectatorCache.find(centerPos);
-			if (it != playersSpectatorCache.end()) {
-				if (!spectators.empty()) {
-					spectators.addSpectators(it->second);
-				} else {
-					spectators = it->second;
-				}
-
-				foundCache = true;
+	bool cacheable = minRangeX == -maxViewportX && maxRangeX == maxViewportX && minRangeY == -maxViewportY && maxRangeY == maxViewportY && multifloor;
+	if (cacheable) {
+		if (const SpectatorVec* cachedSpectators = spectatorCache.find(centerPos, onlyPlayers)) {
+			Metrics::add(METRIC_SPECTATOR_CACHE_HITS);
+			if (!spectators.empty()) {
+				spectators.addSpectators(*cachedSpectators);
+			} else {
+				spectators = *cachedSpectators;
 			}
+			return;
 		}
 
-		if (!foundCache) {
-			auto it = spectatorCache.find(centerPos);
-			if (it != spectatorCache.end()) {
-				if (!onlyPlayers) {
-					if (!spectators.empty()) {
-						const SpectatorVec& cachedSpectators = it->second;
-						spectators.addSpectators(cachedSpectators);
-					} else {
-						spectators = it->second;
-					}
-				} else {
-					const SpectatorVec& cachedSpectators = it->second;
-					for (Creature* spectator : cachedSpectators) {
-						if (spectator->getPlayer()) {
-							spectators.emplace_back(spectator);
-						}
+		if (onlyPlayers) {
+			if (const SpectatorVec* cachedSpectators = spectatorCache.find(centerPos, false)) {
+				Metrics::add(METRIC_SPECTATOR_CACHE_HITS);
+				for (Creature* spectator : *cachedSpectators) {
+					if (spectator->getPlayer()) {
+						spectators.emplace_back(spectator);
 					}
 				}
-
-				foundCache = true;
-			} else {
-				cacheResult = true;
+				return;
 			}
 		}
 	}
 
-	if (!foundCache) {
-		int32_t minRangeZ;
-		int32_t maxRangeZ;
+	int32_t minRangeZ;
+	int32_t maxRangeZ;
 
-		if (multifloor) {
-			if (centerPos.z > 7) {
-				//underground (8->15)
-				minRangeZ = std::max<int32_t>(centerPos.getZ() - 2, 0);
-				maxRangeZ = std::min<int32_t>(centerPos.getZ() + 2, MAP_MAX_LAYERS - 1);
-			} else if (centerPos.z == 6) {
-				minRangeZ = 0;
-				maxRangeZ = 8;
-			} else if (centerPos.z == 7) {
-				minRangeZ = 0;
-				maxRangeZ = 9;
-			} else {
-				minRangeZ = 0;
-				maxRangeZ = 7;
-			}
-		} else {
-			minRangeZ = centerPos.z;
-			maxRangeZ = centerPos.z;
-		}
+	if (multifloor) {
+		getSpectatorFloorRange(centerPos.z, minRangeZ, maxRangeZ);
+	} else {
+		minRangeZ = centerPos.z;
+		maxRangeZ = centerPos.z;
+	}
 
+	const QTreeLeafNode* leaf = cacheable ? getLeaf(centerPos.x, centerPos.y) : nullptr;
+	if (!leaf) {
 		getSpectatorsInternal(spectators, centerPos, minRangeX, maxRangeX, minRangeY, maxRangeY, minRangeZ, maxRangeZ, onlyPlayers);
+		return;
+	}
 
-		if (cacheResult) {
-			if (onlyPlayers) {
-				playersSpectatorCache[centerPos] = spectators;
-			} else {
-				spectatorCache[centerPos] = spectators;
-			}
-		}
+	Metrics::add(METRIC_SPECTATOR_CACHE_MISSES);
+	SpectatorVec& cachedSpectators = spectatorCache.insert(centerPos, onlyPlayers, leaf);
+	getSpectatorsInternal(cachedSpectators, centerPos, minRangeX, maxRangeX, minRangeY, maxRangeY, minRangeZ, maxRangeZ, onlyPlayers);
+	if (!spectators.empty()) {
+		spectators.addSpectators(cachedSpectators);
+	} else {
+		spectators = cachedSpectators;
 	}
 }
 
-void Map::clearSpectatorCache()
+void Map::getHearingSpectators(SpectatorVec& spectators, const Position& centerPos, bool multifloor /*= false*/, int32_t minRangeX /*= 0*/, int32_t maxRangeX /*= 0*/, int32_t minRangeY /*= 0*/, int32_t maxRangeY /*= 0*/)
 {
-	spectatorCache.clear();
-}
+	if (centerPos.z >= MAP_MAX_LAYERS) {
+		return;
+	}
 
-void Map::clearPlayersSpectatorCache()
-{
-	playersSpectatorCache.clear();
-}
+	getSpectators(spectators, centerPos, multifloor, true, minRangeX, maxRangeX, minRangeY, maxRangeY);
 
-bool Map::canThrowObjectTo(const Position& fromPos, const Position& toPos, bool checkLineOfSight /*= true*/, bool sameFloor /*= false*/,
-                           int32_t rangex /*= Map::maxClientViewportX*/, int32_t rangey /*= Map::maxClientViewportY*/) const
-{
-	if (Position::getDistanceX(fromPos, toPos) > rangex || Position::getDistanceY(fromPos, toPos) > rangey) {
-		return false;
+	minRangeX = (minRangeX == 0 ? -maxViewportX : -minRangeX);
+	maxRangeX = (maxRangeX == 0 ? maxViewportX : maxRangeX);
+	minRangeY = (minRangeY == 0 ? -maxViewportY : -minRangeY);
+	maxRangeY = (maxRangeY == 0 ? maxViewportY : maxRangeY);
+
+	int32_t minRangeZ;
+	int32_t maxRangeZ;
+	if (multifloor) {
+		getSpectatorFloorRange(centerPos.z, minRangeZ, maxRangeZ);
+	} else {
+		minRangeZ = centerPos.z;
+		maxRangeZ = centerPos.z;
 	}
 
-	return !checkLineOfSight || isSightClear(fromPos, toPos, sameFloor);
+	// holds no players, so nothing found here is in spectators yet
+	getSpectatorsInternal(spectators, centerPos, minRangeX, maxRangeX, minRangeY, maxRangeY, minRangeZ, maxRangeZ, &QTreeLeafNode::hearing_list);
 }
 
-bool Map::isTileClear(uint16_t x, uint16_t y, uint8_t z, bool blockFloor /*= false*/) const
+void Map::getAwareSpectators(SpectatorVec& spectators, const Position& centerPos)
 {
-	const Tile* tile = getTile(x, y, z);
-	if (!tile) {
-		return true;
+	TraceSpan traceSpan("Map::getAwareSpectators");
+	if (centerPos.z >= MAP_MAX_LAYERS) {
+		return;
 	}
 
-	if (blockFloor && tile->getGround()) {
-		return false;
+	const QTreeLeafNode* leaf = getLeaf(centerPos.x, centerPos.y);
+	if (leaf) {
+		if (const SpectatorVec* cachedSpectators = spectatorCache.find(centerPos, true, true)) {
+			Metrics::add(METRIC_SPECTATOR_CACHE_HITS);
+			if (!spectators.empty()) {
+				spectators.addSpectators(*cachedSpectators);
+			} else {
+				spectators = *cachedSpectators;
+			}
+			return;
+		}
+		Metrics::add(METRIC_SPECTATOR_CACHE_MISSES);
 	}
 
-	return !tile->hasProperty(CONST_PROP_BLOCKPROJECTILE);
-}
+	int32_t minRangeZ;
+	int32_t maxRangeZ;
+	getSpectatorFloorRange(centerPos.z, minRangeZ, maxRangeZ);
 
-namespace {
+	SpectatorVec wideSpectators;
+	getSpectatorsInternal(wideSpectators, centerPos, -maxViewportX, maxViewportX, -maxViewportY, maxViewportY, minRangeZ, maxRangeZ, &QTreeLeafNode::wide_player_list);
 
-bool checkSteepLine(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint8_t z)
-{
-	float dx = x1 - x0;
-	float slope = (dx == 0) ? 1 : (y1 - y0) / dx;
-	float yi = y0 + slope;
+	SpectatorVec localSpectators;
+	SpectatorVec& awareSpectators = leaf ? spectatorCache.insert(centerPos, true, leaf, true) : localSpectators;
+	getSpectatorsInternal(awareSpectators, centerPos, -awareViewportX, awareViewportX, -awareViewportY, awareViewportY, minRangeZ, maxRangeZ, &QTreeLeafNode::player_list);
+	// wide players close by were found by both scans
+	awareSpectators.addSpectators(wideSpectators);
 
-	for (uint16_t x = x0 + 1; x < x1; ++x) {
-		//0.1 is necessary to avoid loss of precision during calculation
-		if (!g_game.map.isTileClear(std::floor(yi + 0.1), x, z)) {
-			return false;
-		}
-		yi += slope;
+	if (!spectators.empty()) {
+		spectators.addSpectators(awareSpectators);
+	} else {
+		spectators = awareSpectators;
 	}
-
-	return true;
 }
 
-bool checkSlightLine(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint8_t z)
+void Map::setWideAwareRange(Player* player, bool wide)
 {
-	float dx = x1 - x0;
-	float slope = (dx == 0) ? 1 : (y1 - y0) / dx;
-	float yi = y0 + slope;
-
-	for (uint16_t x = x0 + 1; x < x1; ++x) {
-		//0.1 is necessary to avoid loss of precision during calculation
-		if (!g_game.map.isTileClear(x, std::floor(yi + 0.1), z)) {
-			return false;
-		}
-		yi += slope;
+	if (player->wideAwareRange == wide) {
+		return;
 	}
 
-	return true;
-}
+	const Tile* tile = player->getTile();
+	if (player->isRemoved() || !tile) {
+		// not in a leaf, it is indexed by the flag once placed
+		player->wideAwareRange = wide;
+		return;
+	}
 
+	const Position& pos = tile->getPosition();
+	getQTNode(pos.x, pos.y)->setWideAwareRange(player, pos, wide);
+	player->wideAwareRange = wide;
+	invalidateSpectatorCache(pos, true);
 }
 
-bool Map::checkSightLine(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint8_t z) const
+void Map::setInterests(Creature* creature, uint8_t interests)
 {
-	if (x0 == x1 && y0 == y1) {
-		return true;
+	bool hearing = isHearing(creature, interests);
+	const Tile* tile = creature->getTile();
+	if (hearing == isHearing(creature, creature->interests) || creature->isRemoved() || !tile) {
+		// not in a leaf, it is indexed by its interests once placed
+		creature->interests = interests;
+		return;
 	}
 
-	if (std::abs(y1 - y0) > std::abs(x1 - x0)) {
+	const Position& pos = tile->getPosition();
+	getQTNode(pos.x, pos.y)->setHearing(creature, pos, hearing);
+	creature->interests = interests;
+}
+
+void Map::invalidateSpectatorCache(const Position& pos, bool isPlayer)
+{
+	// find the floors whose spectator lists can contain pos
+	int32_t minCenterZ = MAP_MAX_LAYERS;
+	int32_t maxCenterZ = -1;
+	for (int32_t z = 0; z < MAP_MAX_LAYERS; ++z) {
+		int32_t minRangeZ, maxRangeZ;
+		getSpectatorFloorRange(z, minRangeZ, maxRangeZ);
+		if (pos.z >= minRangeZ && pos.z <= maxRangeZ) {
+			minCenterZ = std::min(minCenterZ, z);
+			maxCenterZ = std::max(maxCenterZ, z);
+		}
+	}
+
+	if (maxCenterZ < 0) {
+		return;
+	}
+
+	// a center sees pos when it is within the viewport shifted by the floor offset
+	int32_t minOffsetZ = minCenterZ - pos.z;
+	int32_t maxOffsetZ = maxCenterZ - pos.z;
+	uint16_t x1 = std::min<int32_t>(0xFFFF, std::max<int32_t>(0, pos.x - maxViewportX - maxOffsetZ));
+	uint16_t y1 = std::min<int32_t>(0xFFFF, std::max<int32_t>(0, pos.y - maxViewportY - maxOffsetZ));
+	uint16_t x2 = std::min<int32_t>(0xFFFF, std::max<int32_t>(0, pos.x + maxViewportX - minOffsetZ));
+	uint16_t y2 = std::min<int32_t>(0xFFFF, std::max<int32_t>(0, pos.y + maxViewportY - minOffsetZ));
+
+	int32_t startx1 = x1 - (x1 % FLOOR_SIZE);
+	int32_t starty1 = y1 - (y1 % FLOOR_SIZE);
+	int32_t endx2 = x2 - (x2 % FLOOR_SIZE);
+	int32_t endy2 = y2 - (y2 % FLOOR_SIZE);
+
+	QTreeLeafNode* leafS = getLeaf(startx1, starty1);
+	QTreeLeafNode* leafE;
+
+	for (int_fast32_t ny = starty1; ny <= endy2; ny += FLOOR_SIZE) {
+		leafE = leafS;
+		for (int_fast32_t nx = startx1; nx <= endx2; nx += FLOOR_SIZE) {
+			if (leafE) {
+				++leafE->spectatorGeneration;
+				if (isPlayer) {
+					++leafE->playerSpectatorGeneration;
+				}
+				leafE = leafE->leafE;
+			} else {
+				leafE = getLeaf(nx + FLOOR_SIZE, ny);
+			}
+		}
+
+		if (leafS) {
+			leafS = leafS->leafS;
+		} else {
+			leafS = getLeaf(startx1, ny + FLOOR_SIZE);
+		}
+	}
+}
+
+void Map::clearSpectatorCache()
+{
+	spectatorCache.clear();
+}
+
+const TileDescription* Map::getTileDescription(const Tile* tile) const
+{
+	auto it = tileDescriptions.find(tile);
+	if (it == tileDescriptions.end()) {
+		return nullptr;
+	}
+	return &it->second;
+}
+
+const TileDescription& Map::setTileDescription(const Tile* tile, TileDescription&& description)
+{
+	if (tileDescriptions.size() >= TILE_DESCRIPTION_CACHE_SIZE) {
+		// tiles still flagged as cached simply miss on their next lookup
+		tileDescriptions.clear();
+	}
+	return tileDescriptions[tile] = std::move(description);
+}
+
+void Map::removeTileDescription(const Tile* tile)
+{
+	tileDescriptions.erase(tile);
+}
+
+bool Map::canThrowObjectTo(const Position& fromPos, const Position& toPos, bool checkLineOfSight /*= true*/, bool sameFloor /*= false*/,
+                           int32_t rangex /*= Map::maxClientViewportX*/, int32_t rangey /*= Map::maxClientViewportY*/) const
+{
+	if (Position::getDistanceX(fromPos, toPos) > rangex || Position::getDistanceY(fromPos, toPos) > rangey) {
+		return false;
+	}
+
+	return !checkLineOfSight || isSightClear(fromPos, toPos, sameFloor);
+}
+
+bool Map::isTileClear(uint16_t x, uint16_t y, uint8_t z, bool blockFloor /*= false*/) const
+{
+	const Tile* tile = getTile(x, y, z);
+	if (!tile) {
+		return true;
+	}
+
+	if (blockFloor && tile->getGround()) {
+		return false;
+	}
+
+	return !tile->hasProperty(CONST_PROP_BLOCKPROJECTILE);
+}
+
+namespace {
+
+bool checkSteepLine(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint8_t z)
+{
+	float dx = x1 - x0;
+	float slope = (dx == 0) ? 1 : (y1 - y0) / dx;
+	float yi = y0 + slope;
+
+	for (uint16_t x = x0 + 1; x < x1; ++x) {
+		//0.1 is necessary to avoid loss of precision during calculation
+		if (!g_game.map.isTileClear(std::floor(yi + 0.1), x, z)) {
+			return false;
+		}
+		yi += slope;
+	}
+
+	return true;
+}
+
+bool checkSlightLine(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint8_t z)
+{
+	float dx = x1 - x0;
+	float slope = (dx == 0) ? 1 : (y1 - y0) / dx;
+	float yi = y0 + slope;
+
+	for (uint16_t x = x0 + 1; x < x1; ++x) {
+		//0.1 is necessary to avoid loss of precision during calculation
+		if (!g_game.map.isTileClear(x, std::floor(yi + 0.1), z)) {
+			return false;
+		}
+		yi += slope;
+	}
+
+	return true;
+}
+
+}
+
+bool Map::checkSightLine(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint8_t z) const
+{
+	if (x0 == x1 && y0 == y1) {
+		return true;
+	}
+
+	if (std::abs(y1 - y0) > std::abs(x1 - x0)) {
 		if (y1 > y0) {
 			return checkSteepLine(y0, x0, y1, x1, z);
 		}
@@ -566,6 +1089,29 @@ bool Map::checkSightLine(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uin
 }
 
 bool Map::isSightClear(const Position& fromPos, const Position& toPos, bool sameFloor /*= false*/) const
+{
+	// path searches on the worker threads must not touch the cache
+	if (WorkerPool::getCurrentWorker() != 0 || (fromPos.z == toPos.z && Position::getDistanceX(fromPos, toPos) < 2 && Position::getDistanceY(fromPos, toPos) < 2) ||
+	    Position::getDistanceX(fromPos, toPos) > SightCache::MAX_OFFSET || Position::getDistanceY(fromPos, toPos) > SightCache::MAX_OFFSET) {
+		return checkSight(fromPos, toPos, sameFloor);
+	}
+
+	// every tile looked at lies within the rectangle spanned by both positions
+	uint64_t generation = getPathGeneration(std::min(fromPos.x, toPos.x), std::min(fromPos.y, toPos.y), std::max(fromPos.x, toPos.x), std::max(fromPos.y, toPos.y));
+
+	uint64_t key = SightCache::makeKey(fromPos, toPos, sameFloor);
+	SightCache::Entry& entry = sightCache.getEntry(key);
+	if (entry.key == key && entry.generation == generation) {
+		return entry.clear;
+	}
+
+	entry.key = key;
+	entry.generation = generation;
+	entry.clear = checkSight(fromPos, toPos, sameFloor);
+	return entry.clear;
+}
+
+bool Map::checkSight(const Position& fromPos, const Position& toPos, bool sameFloor) const
 {
 	//target is on the same floor
 	if (fromPos.z == toPos.z) {
@@ -642,12 +1188,165 @@ const Tile* Map::canWalkTo(const Creature& creature, const Position& pos) const
 	return tile;
 }
 
+namespace {
+
+// the node arena is kept between searches, monsters re-path very often
+thread_local AStarNodes pathNodes;
+
+enum PathWalkFlags : uint32_t {
+	PATH_WALK_SUMMON = 1 << 0,
+	PATH_WALK_IGNOREFIELDDAMAGE = 1 << 1,
+	PATH_WALK_ENERGYCONDITION = 1 << 2,
+	PATH_WALK_FIRECONDITION = 1 << 3,
+	PATH_WALK_POISONCONDITION = 1 << 4,
+};
+
+}
+
+bool Map::getPathTo(const Creature& creature, const Position& targetPos, std::vector<Direction>& dirList, const FindPathParams& fpp) const
+{
+	FrozenPathingConditionCall pathCondition(targetPos);
+
+	// walkability and walk costs of monsters only depend on their type and the state below
+	const Monster* monster = creature.getMonster();
+	if (!monster) {
+		return getPathMatching(creature, dirList, pathCondition, fpp);
+	}
+
+	uint32_t walkFlags = 0;
+	if (monster->isSummon()) {
+		walkFlags |= PATH_WALK_SUMMON;
+	}
+	if (monster->isIgnoringFieldDamage()) {
+		walkFlags |= PATH_WALK_IGNOREFIELDDAMAGE;
+	}
+	if (monster->hasCondition(CONDITION_ENERGY)) {
+		walkFlags |= PATH_WALK_ENERGYCONDITION;
+	}
+	if (monster->hasCondition(CONDITION_FIRE)) {
+		walkFlags |= PATH_WALK_FIRECONDITION;
+	}
+	if (monster->hasCondition(CONDITION_POISON)) {
+		walkFlags |= PATH_WALK_POISONCONDITION;
+	}
+
+	PathCache::Key key;
+	key.startPos = creature.getPosition();
+	key.targetPos = targetPos;
+	key.monsterType = monster->getMonsterType();
+	key.walkFlags = walkFlags;
+	key.searchFlags = fpp.fullPathSearch | (fpp.clearSight << 1) | (fpp.allowDiagonal << 2) | (fpp.keepDistance << 3);
+	key.maxSearchDist = fpp.maxSearchDist;
+	key.minTargetDist = fpp.minTargetDist;
+	key.maxTargetDist = fpp.maxTargetDist;
+
+	int64_t now = OTSYS_TIME();
+	if (const PathCache::Entry* entry = pathCache.find(key, now)) {
+		if (entry->generation == getPathGeneration(entry->minX, entry->minY, entry->maxX, entry->maxY)) {
+			dirList.insert(dirList.end(), entry->dirList.begin(), entry->dirList.end());
+			return entry->found;
+		}
+	}
+
+	size_t first = dirList.size();
+	bool found = getPathMatching(creature, dirList, pathCondition, fpp);
+
+	// the search looked at the explored nodes, their neighbours and the sight lines towards the target
+	uint16_t minX, minY, maxX, maxY;
+	pathNodes.getSearchArea(minX, minY, maxX, maxY);
+	minX = std::max<int32_t>(0, std::min<int32_t>(minX, targetPos.x) - 1);
+	minY = std::max<int32_t>(0, std::min<int32_t>(minY, targetPos.y) - 1);
+	maxX = std::min<int32_t>(0xFFFF, std::max<int32_t>(maxX, targetPos.x) + 1);
+	maxY = std::min<int32_t>(0xFFFF, std::max<int32_t>(maxY, targetPos.y) + 1);
+
+	PathCache::Entry& entry = pathCache.insert(key, now);
+	entry.generation = getPathGeneration(minX, minY, maxX, maxY);
+	entry.minX = minX;
+	entry.minY = minY;
+	entry.maxX = maxX;
+	entry.maxY = maxY;
+	entry.found = found;
+	entry.dirList.assign(dirList.begin() + first, dirList.end());
+	return found;
+}
+
+void Map::invalidatePathCache(const Position& pos)
+{
+	if (QTreeLeafNode* leaf = getLeaf(pos.x, pos.y)) {
+		++leaf->pathGeneration;
+	}
+}
+
+uint64_t Map::getPathGeneration(uint16_t minX, uint16_t minY, uint16_t maxX, uint16_t maxY) const
+{
+	// generations only grow, so any change inside the area changes the sum
+	int32_t startx1 = minX - (minX % FLOOR_SIZE);
+	int32_t starty1 = minY - (minY % FLOOR_SIZE);
+	int32_t endx2 = maxX - (maxX % FLOOR_SIZE);
+	int32_t endy2 = maxY - (maxY % FLOOR_SIZE);
+
+	uint64_t generation = 0;
+
+	const QTreeLeafNode* leafS = getLeaf(startx1, starty1);
+	const QTreeLeafNode* leafE;
+
+	for (int_fast32_t ny = starty1; ny <= endy2; ny += FLOOR_SIZE) {
+		leafE = leafS;
+		for (int_fast32_t nx = startx1; nx <= endx2; nx += FLOOR_SIZE) {
+			if (leafE) {
+				generation += leafE->pathGeneration;
+				leafE = leafE->leafE;
+			} else {
+				leafE = getLeaf(nx + FLOOR_SIZE, ny);
+			}
+		}
+
+		if (leafS) {
+			leafS = leafS->leafS;
+		} else {
+			leafS = getLeaf(startx1, ny + FLOOR_SIZE);
+		}
+	}
+	return generation;
+}
+
+const FlowField& Map::getFlowField(const Creature& target) const
+{
+	int64_t now = OTSYS_TIME();
+
+	auto it = flowFields.find(target.getID());
+	if (it != flowFields.end()) {
+		if (it->second.expiration > now && it->second.getOrigin() == target.getPosition()) {
+			return it->second;
+		}
+	} else {
+		// fields of targets nobody chases anymore
+		for (auto field = flowFields.begin(); field != flowFields.end();) {
+			if (field->second.expiration <= now) {
+				field = flowFields.erase(field);
+			} else {
+				++field;
+			}
+		}
+		it = flowFields.emplace(target.getID(), FlowField()).first;
+	}
+
+	FlowField& field = it->second;
+	field.build(*this, target.getPosition());
+	field.expiration = now + FlowField::DURATION;
+	return field;
+}
+
 bool Map::getPathMatching(const Creature& creature, std::vector<Direction>& dirList, const FrozenPathingConditionCall& pathCondition, const FindPathParams& fpp) const
 {
+	TraceSpan traceSpan("Map::getPathMatching");
+	Metrics::add(METRIC_PATHFINDING_SEARCHES);
+
 	Position pos = creature.getPosition();
 	Position endPos;
 
-	AStarNodes nodes(pos.x, pos.y);
+	AStarNodes& nodes = pathNodes;
+	nodes.reset(pos.x, pos.y);
 
 	int32_t bestMatch = 0;
 
@@ -819,19 +1518,30 @@ bool Map::getPathMatching(const Creature& creature, std::vector<Direction>& dirL
 
 // AStarNodes
 
-AStarNodes::AStarNodes(uint32_t x, uint32_t y)
-	: nodes(), openNodes()
+void AStarNodes::reset(uint32_t x, uint32_t y)
 {
+	if (++stamp == 0) {
+		std::fill(std::begin(gridStamps), std::end(gridStamps), 0);
+		stamp = 1;
+	}
+
+	startX = x;
+	startY = y;
+	nodeTable.clear();
+	heapSize = 0;
 	curNode = 1;
 	closedNodes = 0;
-	openNodes[0] = true;
 
 	AStarNode& startNode = nodes[0];
 	startNode.parent = nullptr;
 	startNode.x = x;
 	startNode.y = y;
 	startNode.f = 0;
-	nodeTable[(x << 16) | y] = nodes;
+	pushHeap(0);
+	*getGridSlot(x, y) = 0;
+
+	areaMinX = areaMaxX = x;
+	areaMinY = areaMaxY = y;
 }
 
 AStarNode* AStarNodes::createOpenNode(AStarNode* parent, uint32_t x, uint32_t y, int_fast32_t f)
@@ -840,44 +1550,41 @@ AStarNode* AStarNodes::createOpenNode(AStarNode* parent, uint32_t x, uint32_t y,
 		return nullptr;
 	}
 
-	size_t retNode = curNode++;
-	openNodes[retNode] = true;
+	uint16_t retNode = curNode++;
 
 	AStarNode* node = nodes + retNode;
-	nodeTable[(x << 16) | y] = node;
 	node->parent = parent;
 	node->x = x;
 	node->y = y;
 	node->f = f;
+	pushHeap(retNode);
+
+	areaMinX = std::min<uint16_t>(areaMinX, x);
+	areaMinY = std::min<uint16_t>(areaMinY, y);
+	areaMaxX = std::max<uint16_t>(areaMaxX, x);
+	areaMaxY = std::max<uint16_t>(areaMaxY, y);
+
+	if (uint16_t* slot = getGridSlot(x, y)) {
+		*slot = retNode;
+	} else {
+		nodeTable[(x << 16) | y] = node;
+	}
 	return node;
 }
 
 AStarNode* AStarNodes::getBestNode()
 {
-	if (curNode == 0) {
+	if (heapSize == 0) {
 		return nullptr;
 	}
-
-	int32_t best_node_f = std::numeric_limits<int32_t>::max();
-	int32_t best_node = -1;
-	for (size_t i = 0; i < curNode; i++) {
-		if (openNodes[i] && nodes[i].f < best_node_f) {
-			best_node_f = nodes[i].f;
-			best_node = i;
-		}
-	}
-
-	if (best_node >= 0) {
-		return nodes + best_node;
-	}
-	return nullptr;
+	return nodes + heap[0];
 }
 
 void AStarNodes::closeNode(AStarNode* node)
 {
 	size_t index = node - nodes;
 	assert(index < MAX_NODES);
-	openNodes[index] = false;
+	removeHeap(index);
 	++closedNodes;
 }
 
@@ -885,9 +1592,12 @@ void AStarNodes::openNode(AStarNode* node)
 {
 	size_t index = node - nodes;
 	assert(index < MAX_NODES);
-	if (!openNodes[index]) {
-		openNodes[index] = true;
+	if (heapPosition[index] == NOT_IN_HEAP) {
+		pushHeap(index);
 		--closedNodes;
+	} else {
+		// f only ever decreases here
+		siftUp(heapPosition[index]);
 	}
 }
 
@@ -898,6 +1608,16 @@ int_fast32_t AStarNodes::getClosedNodes() const
 
 AStarNode* AStarNodes::getNodeByPosition(uint32_t x, uint32_t y)
 {
+	int32_t gridX = static_cast<int32_t>(x - startX) + GRID_SIZE / 2;
+	int32_t gridY = static_cast<int32_t>(y - startY) + GRID_SIZE / 2;
+	if (gridX >= 0 && gridX < GRID_SIZE && gridY >= 0 && gridY < GRID_SIZE) {
+		size_t slot = gridY * GRID_SIZE + gridX;
+		if (gridStamps[slot] != stamp) {
+			return nullptr;
+		}
+		return nodes + gridNodes[slot];
+	}
+
 	auto it = nodeTable.find((x << 16) | y);
 	if (it == nodeTable.end()) {
 		return nullptr;
@@ -905,6 +1625,85 @@ AStarNode* AStarNodes::getNodeByPosition(uint32_t x, uint32_t y)
 	return it->second;
 }
 
+uint16_t* AStarNodes::getGridSlot(uint32_t x, uint32_t y)
+{
+	int32_t gridX = static_cast<int32_t>(x - startX) + GRID_SIZE / 2;
+	int32_t gridY = static_cast<int32_t>(y - startY) + GRID_SIZE / 2;
+	if (gridX < 0 || gridX >= GRID_SIZE || gridY < 0 || gridY >= GRID_SIZE) {
+		return nullptr;
+	}
+
+	size_t slot = gridY * GRID_SIZE + gridX;
+	gridStamps[slot] = stamp;
+	return gridNodes + slot;
+}
+
+void AStarNodes::pushHeap(uint16_t index)
+{
+	heap[heapSize] = index;
+	heapPosition[index] = heapSize;
+	siftUp(heapSize++);
+}
+
+void AStarNodes::removeHeap(uint16_t index)
+{
+	size_t pos = heapPosition[index];
+	assert(pos != NOT_IN_HEAP);
+	heapPosition[index] = NOT_IN_HEAP;
+
+	if (pos == --heapSize) {
+		return;
+	}
+
+	uint16_t moved = heap[heapSize];
+	heap[pos] = moved;
+	heapPosition[moved] = pos;
+	siftUp(pos);
+	siftDown(heapPosition[moved]);
+}
+
+void AStarNodes::siftUp(size_t pos)
+{
+	uint16_t index = heap[pos];
+	while (pos > 0) {
+		size_t parent = (pos - 1) / 2;
+		if (!isBetter(index, heap[parent])) {
+			break;
+		}
+
+		heap[pos] = heap[parent];
+		heapPosition[heap[pos]] = pos;
+		pos = parent;
+	}
+	heap[pos] = index;
+	heapPosition[index] = pos;
+}
+
+void AStarNodes::siftDown(size_t pos)
+{
+	uint16_t index = heap[pos];
+	while (true) {
+		size_t child = pos * 2 + 1;
+		if (child >= heapSize) {
+			break;
+		}
+
+		if (child + 1 < heapSize && isBetter(heap[child + 1], heap[child])) {
+			++child;
+		}
+
+		if (!isBetter(heap[child], index)) {
+			break;
+		}
+
+		heap[pos] = heap[child];
+		heapPosition[heap[pos]] = pos;
+		pos = child;
+	}
+	heap[pos] = index;
+	heapPosition[index] = pos;
+}
+
 int_fast32_t AStarNodes::getMapWalkCost(AStarNode* node, const Position& neighborPos)
 {
 	if (std::abs(node->x - neighborPos.x) == std::abs(node->y - neighborPos.y)) {
@@ -943,6 +1742,36 @@ Floor::~Floor()
 }
 
 // QTreeNode
+void* Floor::operator new(size_t size)
+{
+	if (void* p = HugePageArena::allocate(size)) {
+		return p;
+	}
+	return ::operator new(size);
+}
+
+void Floor::operator delete(void* p, size_t size)
+{
+	if (!HugePageArena::release(p, size)) {
+		::operator delete(p);
+	}
+}
+
+void* QTreeNode::operator new(size_t size)
+{
+	if (void* p = HugePageArena::allocate(size)) {
+		return p;
+	}
+	return ::operator new(size);
+}
+
+void QTreeNode::operator delete(void* p, size_t size)
+{
+	if (!HugePageArena::release(p, size)) {
+		::operator delete(p);
+	}
+}
+
 QTreeNode::~QTreeNode()
 {
 	for (auto* ptr : child) {
@@ -981,6 +1810,164 @@ QTreeLeafNode* QTreeNode::createLeaf(uint32_t x, uint32_t y, uint32_t level)
 }
 
 // QTreeLeafNode
+const SpectatorVec* SpectatorCache::find(const Position& pos, bool onlyPlayers, bool aware/* = false*/) const
+{
+	uint64_t key = makeKey(pos, onlyPlayers, aware);
+	size_t slot = getSlot(key);
+	for (size_t probe = 0; probe < MAX_PROBES; ++probe) {
+		const Entry& entry = entries[(slot + probe) & (CAPACITY - 1)];
+		if (entry.key == key) {
+			return entry.isValid() ? &entry.spectators : nullptr;
+		} else if (entry.key == 0) {
+			break;
+		}
+	}
+	return nullptr;
+}
+
+SpectatorVec& SpectatorCache::insert(const Position& pos, bool onlyPlayers, const QTreeLeafNode* leaf, bool aware/* = false*/)
+{
+	uint64_t key = makeKey(pos, onlyPlayers, aware);
+	size_t slot = getSlot(key);
+
+	// reuse the slot of this key, else the first free or stale one, else evict the home slot
+	Entry* target = nullptr;
+	for (size_t probe = 0; probe < MAX_PROBES; ++probe) {
+		Entry& entry = entries[(slot + probe) & (CAPACITY - 1)];
+		if (entry.key == key || entry.key == 0) {
+			target = &entry;
+			break;
+		} else if (!target && !entry.isValid()) {
+			target = &entry;
+		}
+	}
+
+	if (!target) {
+		target = &entries[slot];
+	}
+
+	target->key = key;
+	target->leaf = leaf;
+	target->generation = onlyPlayers ? leaf->playerSpectatorGeneration : leaf->spectatorGeneration;
+	target->spectators.clear();
+	return target->spectators;
+}
+
+void SpectatorCache::clear()
+{
+	for (Entry& entry : entries) {
+		entry.key = 0;
+		entry.leaf = nullptr;
+		entry.spectators.clear();
+	}
+}
+
+void FlowField::build(const Map& map, const Position& targetPos)
+{
+	origin = targetPos;
+	distances.fill(UNREACHABLE);
+
+	static const int_fast32_t neighbors[8][2] = {
+		{-1, 0}, {0, 1}, {1, 0}, {0, -1}, {-1, -1}, {1, -1}, {1, 1}, {-1, 1}
+	};
+
+	using QueueEntry = std::pair<uint16_t, uint16_t>;
+	std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry>> queue;
+
+	// the target tile itself is never walkable, it is only the source
+	const uint16_t originIndex = RADIUS * SIZE + RADIUS;
+	distances[originIndex] = 0;
+	queue.emplace(0, originIndex);
+
+	while (!queue.empty()) {
+		uint16_t distance, index;
+		std::tie(distance, index) = queue.top();
+		queue.pop();
+
+		if (distance != distances[index]) {
+			continue;
+		}
+
+		const int32_t x = index % SIZE;
+		const int32_t y = index / SIZE;
+		for (int32_t i = 0; i < 8; ++i) {
+			const int32_t nx = x + neighbors[i][0];
+			const int32_t ny = y + neighbors[i][1];
+			if (nx < 0 || nx >= SIZE || ny < 0 || ny >= SIZE) {
+				continue;
+			}
+
+			const uint16_t nextDistance = distance + (i < 4 ? MAP_NORMALWALKCOST : MAP_DIAGONALWALKCOST);
+			const uint16_t nextIndex = ny * SIZE + nx;
+			if (nextDistance >= distances[nextIndex]) {
+				continue;
+			}
+
+			const Tile* tile = map.getTile(origin.x + nx - RADIUS, origin.y + ny - RADIUS, origin.z);
+			if (!tile || !tile->getGround() || tile->hasFlag(TILESTATE_PROTECTIONZONE | TILESTATE_FLOORCHANGE | TILESTATE_TELEPORT |
+					TILESTATE_BLOCKSOLID | TILESTATE_NOFIELDBLOCKPATH | TILESTATE_IMMOVABLEBLOCKSOLID | TILESTATE_IMMOVABLENOFIELDBLOCKPATH)) {
+				continue;
+			}
+
+			distances[nextIndex] = nextDistance;
+			queue.emplace(nextDistance, nextIndex);
+		}
+	}
+}
+
+bool PathCache::Key::operator==(const Key& other) const
+{
+	return startPos == other.startPos && targetPos == other.targetPos && monsterType == other.monsterType &&
+	       walkFlags == other.walkFlags && searchFlags == other.searchFlags && maxSearchDist == other.maxSearchDist &&
+	       minTargetDist == other.minTargetDist && maxTargetDist == other.maxTargetDist;
+}
+
+const PathCache::Entry* PathCache::find(const Key& key, int64_t now) const
+{
+	size_t slot = getSlot(key);
+	for (size_t probe = 0; probe < MAX_PROBES; ++probe) {
+		const Entry& entry = entries[(slot + probe) & (CAPACITY - 1)];
+		if (entry.expiration > now && entry.key == key) {
+			return &entry;
+		}
+	}
+	return nullptr;
+}
+
+PathCache::Entry& PathCache::insert(const Key& key, int64_t now)
+{
+	size_t slot = getSlot(key);
+
+	// reuse the slot of this key, else the first expired one, else evict the home slot
+	Entry* target = nullptr;
+	for (size_t probe = 0; probe < MAX_PROBES; ++probe) {
+		Entry& entry = entries[(slot + probe) & (CAPACITY - 1)];
+		if (entry.expiration > now && entry.key == key) {
+			target = &entry;
+			break;
+		} else if (!target && entry.expiration <= now) {
+			target = &entry;
+		}
+	}
+
+	if (!target) {
+		target = &entries[slot];
+	}
+
+	target->key = key;
+	target->expiration = now + DURATION;
+	return *target;
+}
+
+size_t PathCache::getSlot(const Key& key)
+{
+	uint64_t hash = (static_cast<uint64_t>(key.startPos.x) << 32) | (key.startPos.y << 16) | (key.startPos.z << 8) | key.walkFlags;
+	hash ^= ((static_cast<uint64_t>(key.targetPos.x) << 24) | (key.targetPos.y << 8) | key.targetPos.z) * 0x9E3779B97F4A7C15ULL;
+	hash ^= reinterpret_cast<uintptr_t>(key.monsterType) >> 4;
+	hash ^= (static_cast<uint64_t>(key.searchFlags) << 48) | (static_cast<uint64_t>(key.maxSearchDist & 0xFF) << 40) | ((key.minTargetDist & 0xFF) << 8) | (key.maxTargetDist & 0xFF);
+	return (hash * 0x9E3779B97F4A7C15ULL) >> (64 - 10) & (CAPACITY - 1);
+}
+
 bool QTreeLeafNode::newLeaf = false;
 
 QTreeLeafNode::~QTreeLeafNode()
@@ -998,69 +1985,226 @@ Floor* QTreeLeafNode::createFloor(uint32_t z)
 	return array[z];
 }
 
-void QTreeLeafNode::addCreature(Creature* c)
+void QTreeLeafNode::addCreature(Creature* c, const Position& pos)
 {
-	creature_list.push_back(c);
+	creature_list.add(c, pos);
 
-	if (c->getPlayer()) {
-		player_list.push_back(c);
+	if (const Player* player = c->getPlayer()) {
+		player_list.add(c, pos);
+		if (player->hasWideAwareRange()) {
+			wide_player_list.add(c, pos);
+		}
+	} else if (isHearing(c, c->getInterests())) {
+		hearing_list.add(c, pos);
 	}
 }
 
 void QTreeLeafNode::removeCreature(Creature* c)
 {
-	auto iter = std::find(creature_list.begin(), creature_list.end(), c);
-	assert(iter != creature_list.end());
-	*iter = creature_list.back();
-	creature_list.pop_back();
+	creature_list.remove(c);
 
-	if (c->getPlayer()) {
-		iter = std::find(player_list.begin(), player_list.end(), c);
-		assert(iter != player_list.end());
-		*iter = player_list.back();
-		player_list.pop_back();
+	if (const Player* player = c->getPlayer()) {
+		player_list.remove(c);
+		if (player->hasWideAwareRange()) {
+			wide_player_list.remove(c);
+		}
+	} else if (isHearing(c, c->getInterests())) {
+		hearing_list.remove(c);
 	}
 }
 
-uint32_t Map::clean() const
+void QTreeLeafNode::moveCreature(Creature* c, const Position& pos)
 {
-	uint64_t start = OTSYS_TIME();
-	size_t tiles = 0;
+	creature_list.move(c, pos);
 
-	if (g_game.getGameState() == GAME_STATE_NORMAL) {
-		g_game.setGameState(GAME_STATE_MAINTAIN);
+	if (const Player* player = c->getPlayer()) {
+		player_list.move(c, pos);
+		if (player->hasWideAwareRange()) {
+			wide_player_list.move(c, pos);
+		}
+	} else if (isHearing(c, c->getInterests())) {
+		hearing_list.move(c, pos);
 	}
+}
 
-	std::vector<Item*> toRemove;
+void QTreeLeafNode::setWideAwareRange(Player* player, const Position& pos, bool wide)
+{
+	if (wide) {
+		wide_player_list.add(player, pos);
+	} else {
+		wide_player_list.remove(player);
+	}
+}
+
+void QTreeLeafNode::setHearing(Creature* c, const Position& pos, bool hearing)
+{
+	if (hearing) {
+		hearing_list.add(c, pos);
+	} else {
+		hearing_list.remove(c);
+	}
+}
+
+void QTreeLeafNode::CreatureIndex::add(Creature* c, const Position& pos)
+{
+	creatures.emplace_back();
+	x.emplace_back();
+	y.emplace_back();
+
+	// open a slot at the end of floor pos.z by rotating the first entry
+	// of every higher floor to the end of its bucket
+	size_t slot = floorStart[MAP_MAX_LAYERS]++;
+	for (int32_t z = MAP_MAX_LAYERS - 1; z > pos.z; --z) {
+		moveEntry(floorStart[z], slot);
+		slot = floorStart[z]++;
+	}
+
+	creatures[slot] = c;
+	x[slot] = pos.x;
+	y[slot] = pos.y;
+}
+
+void QTreeLeafNode::CreatureIndex::remove(Creature* c)
+{
+	uint8_t z;
+	size_t hole = find(c, z);
+
+	// fill the hole with the last entry of its floor, then move the hole
+	// up through the higher floors the same way
+	for (int32_t f = z; f < MAP_MAX_LAYERS; ++f) {
+		size_t last = --floorStart[f + 1];
+		moveEntry(last, hole);
+		hole = last;
+	}
+
+	creatures.pop_back();
+	x.pop_back();
+	y.pop_back();
+}
+
+void QTreeLeafNode::CreatureIndex::move(Creature* c, const Position& pos)
+{
+	uint8_t z;
+	size_t i = find(c, z);
+	if (z != pos.z) {
+		remove(c);
+		add(c, pos);
+		return;
+	}
 
-	for (auto tile : g_game.getTilesToClean()) {
-		if (!tile) {
+	x[i] = pos.x;
+	y[i] = pos.y;
+}
+
+size_t QTreeLeafNode::CreatureIndex::find(Creature* c, uint8_t& z) const
+{
+	auto iter = std::find(creatures.begin(), creatures.end(), c);
+	assert(iter != creatures.end());
+	size_t i = std::distance(creatures.begin(), iter);
+
+	z = 0;
+	while (floorStart[z + 1] <= i) {
+		++z;
+	}
+	return i;
+}
+
+void QTreeLeafNode::CreatureIndex::moveEntry(size_t from, size_t to)
+{
+	if (from != to) {
+		creatures[to] = creatures[from];
+		x[to] = x[from];
+		y[to] = y[from];
+	}
+}
+
+uint32_t Map::clean()
+{
+	// the registered tiles are moved into per floor lists, the items are then removed a slice per tick
+	uint32_t count = 0;
+	auto& tilesToClean = g_game.getTilesToClean();
+	for (Tile* tile : tilesToClean) {
+		const TileItemVector* items = tile->getItemList();
+		if (!items) {
 			continue;
 		}
 
-		if (auto items = tile->getItemList()) {
-			++tiles;
-			for (auto item : *items) {
-				if (item->isCleanable()) {
-					toRemove.emplace_back(item);
-				}
+		for (const Item* item : *items) {
+			if (item->isCleanable()) {
+				++count;
 			}
 		}
+		cleanFloors[tile->getPosition().z].push_back(tile);
 	}
+	g_game.clearTilesToClean();
 
-	for (auto item : toRemove) {
-		g_game.internalRemoveItem(item, -1);
+	if (cleanEvent == 0) {
+		cleanStart = OTSYS_TIME();
+		cleanedItems = 0;
+		cleanedTiles = 0;
+		cleanEvent = g_scheduler.addEvent(createSchedulerTask(CLEAN_SLICE_INTERVAL, std::bind(&Map::cleanSlice, this)));
 	}
+	return count;
+}
 
-	size_t count = toRemove.size();
-	g_game.clearTilesToClean();
+void Map::cleanSlice()
+{
+	cleanEvent = 0;
+
+	int64_t deadline = OTSYS_TIME() + CLEAN_SLICE_DURATION;
+	size_t processed = 0;
+	std::vector<Item*> toRemove;
+
+	for (auto& floor : cleanFloors) {
+		while (!floor.empty()) {
+			// checking the clock is not free, so do it every few tiles only
+			if (++processed % 32 == 0 && OTSYS_TIME() >= deadline) {
+				cleanEvent = g_scheduler.addEvent(createSchedulerTask(CLEAN_SLICE_INTERVAL, std::bind(&Map::cleanSlice, this)));
+				return;
+			}
+
+			Tile* tile = floor.back();
+			floor.pop_back();
+
+			TileItemVector* items = tile->getItemList();
+			if (!items) {
+				continue;
+			}
+
+			// a player would see the items vanish, leave the tile for the next clean
+			const Position& pos = tile->getPosition();
+			int32_t minRangeZ;
+			int32_t maxRangeZ;
+			getSpectatorFloorRange(pos.z, minRangeZ, maxRangeZ);
+
+			SpectatorVec spectators;
+			getSpectatorsInternal(spectators, pos, -maxViewportX, maxViewportX, -maxViewportY, maxViewportY, minRangeZ, maxRangeZ, true);
+			if (!spectators.empty()) {
+				g_game.addTileToClean(tile);
+				continue;
+			}
+
+			toRemove.clear();
+			for (Item* item : *items) {
+				if (item->isCleanable()) {
+					toRemove.push_back(item);
+				}
+			}
+
+			if (toRemove.empty()) {
+				continue;
+			}
+
+			for (Item* item : toRemove) {
+				g_game.internalRemoveItem(item, -1);
+			}
 
-	if (g_game.getGameState() == GAME_STATE_MAINTAIN) {
-		g_game.setGameState(GAME_STATE_NORMAL);
+			cleanedItems += toRemove.size();
+			++cleanedTiles;
+		}
 	}
 
-	std::cout << "> CLEAN: Removed " << count << " item" << (count != 1 ? "s" : "")
-		<< " from " << tiles << " tile" << (tiles != 1 ? "s" : "") << " in "
-		<< (OTSYS_TIME() - start) / (1000.) << " seconds." << std::endl;
-	return count;
+	std::cout << "> CLEAN: Removed " << cleanedItems << " item" << (cleanedItems != 1 ? "s" : "")
+		<< " from " << cleanedTiles << " tile" << (cleanedTiles != 1 ? "s" : "") << " in "
+		<< (OTSYS_TIME() - cleanStart) / (1000.) << " seconds." << std::endl;
 }
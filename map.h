@@ -19,6 +19,7 @@ class Player;
 class Game;
 class Tile;
 class Map;
+class IOMap;
 
 static constexpr int32_t MAP_MAX_LAYERS = 16;
 
@@ -33,11 +34,13 @@ static constexpr int32_t MAX_NODES = 512;
 
 static constexpr int32_t MAP_NORMALWALKCOST = 10;
 static constexpr int32_t MAP_DIAGONALWALKCOST = 25;
+static constexpr size_t TILE_DESCRIPTION_CACHE_SIZE = 65536;
 
 class AStarNodes
 {
 	public:
-		AStarNodes(uint32_t x, uint32_t y);
+		// reused between searches, see Map::getPathMatching
+		void reset(uint32_t x, uint32_t y);
 
 		AStarNode* createOpenNode(AStarNode* parent, uint32_t x, uint32_t y, int_fast32_t f);
 		AStarNode* getBestNode();
@@ -45,19 +48,54 @@ class AStarNodes
 		void openNode(AStarNode* node);
 		int_fast32_t getClosedNodes() const;
 		AStarNode* getNodeByPosition(uint32_t x, uint32_t y);
+		void getSearchArea(uint16_t& minX, uint16_t& minY, uint16_t& maxX, uint16_t& maxY) const {
+			minX = areaMinX;
+			minY = areaMinY;
+			maxX = areaMaxX;
+			maxY = areaMaxY;
+		}
 
 		static int_fast32_t getMapWalkCost(AStarNode* node, const Position& neighborPos);
 		static int_fast32_t getTileWalkCost(const Creature& creature, const Tile* tile);
 
 	private:
+		// dense index of nodes around the start position, positions outside
+		// of it fall back to nodeTable
+		static constexpr int32_t GRID_SIZE = 128;
+		static constexpr uint16_t NOT_IN_HEAP = MAX_NODES;
+
+		uint16_t* getGridSlot(uint32_t x, uint32_t y);
+
+		// open list is a binary heap ordered by (f, index), so the best node
+		// is the same one a linear scan over the nodes would pick
+		bool isBetter(uint16_t lhs, uint16_t rhs) const {
+			return nodes[lhs].f < nodes[rhs].f || (nodes[lhs].f == nodes[rhs].f && lhs < rhs);
+		}
+		void pushHeap(uint16_t index);
+		void removeHeap(uint16_t index);
+		void siftUp(size_t pos);
+		void siftDown(size_t pos);
+
 		AStarNode nodes[MAX_NODES];
-		bool openNodes[MAX_NODES];
+		uint16_t heap[MAX_NODES];
+		uint16_t heapPosition[MAX_NODES];
+		size_t heapSize = 0;
+
+		uint16_t gridNodes[GRID_SIZE * GRID_SIZE];
+		uint32_t gridStamps[GRID_SIZE * GRID_SIZE] = {};
+		uint32_t stamp = 0;
+		uint32_t startX = 0;
+		uint32_t startY = 0;
 		std::unordered_map<uint32_t, AStarNode*> nodeTable;
-		size_t curNode;
-		int_fast32_t closedNodes;
-};
 
-using SpectatorCache = std::map<Position, SpectatorVec>;
+		uint16_t areaMinX = 0;
+		uint16_t areaMinY = 0;
+		uint16_t areaMaxX = 0;
+		uint16_t areaMaxY = 0;
+
+		size_t curNode = 0;
+		int_fast32_t closedNodes = 0;
+};
 
 static constexpr int32_t FLOOR_BITS = 3;
 static constexpr int32_t FLOOR_SIZE = (1 << FLOOR_BITS);
@@ -67,6 +105,10 @@ struct Floor {
 	constexpr Floor() = default;
 	~Floor();
 
+	// floors and quadtree nodes come from the HugePageArena while it is on
+	static void* operator new(size_t size);
+	static void operator delete(void* p, size_t size);
+
 	// non-copyable
 	Floor(const Floor&) = delete;
 	Floor& operator=(const Floor&) = delete;
@@ -83,6 +125,9 @@ class QTreeNode
 		constexpr QTreeNode() = default;
 		virtual ~QTreeNode();
 
+		static void* operator new(size_t size);
+		static void operator delete(void* p, size_t size);
+
 		// non-copyable
 		QTreeNode(const QTreeNode&) = delete;
 		QTreeNode& operator=(const QTreeNode&) = delete;
@@ -134,19 +179,236 @@ class QTreeLeafNode final : public QTreeNode
 			return array[z];
 		}
 
-		void addCreature(Creature* c);
+		void addCreature(Creature* c, const Position& pos);
 		void removeCreature(Creature* c);
+		void moveCreature(Creature* c, const Position& pos);
+		void setWideAwareRange(Player* player, const Position& pos, bool wide);
+		void setHearing(Creature* c, const Position& pos, bool hearing);
 
 	private:
+		// creatures of the leaf with their positions kept in parallel arrays,
+		// so range checks are a tight loop over packed coordinates; entries
+		// are bucketed by floor, floor z occupies [floorStart[z], floorStart[z + 1])
+		struct CreatureIndex {
+			void add(Creature* c, const Position& pos);
+			void remove(Creature* c);
+			void move(Creature* c, const Position& pos);
+
+			// a leaf rarely holds more than a handful of creatures
+			boost::container::small_vector<Creature*, 4> creatures;
+			boost::container::small_vector<uint16_t, 4> x;
+			boost::container::small_vector<uint16_t, 4> y;
+			std::array<uint32_t, MAP_MAX_LAYERS + 1> floorStart = {};
+
+			private:
+				size_t find(Creature* c, uint8_t& z) const;
+				void moveEntry(size_t from, size_t to);
+		};
+
 		static bool newLeaf;
 		QTreeLeafNode* leafS = nullptr;
 		QTreeLeafNode* leafE = nullptr;
 		Floor* array[MAP_MAX_LAYERS] = {};
-		CreatureVector creature_list;
-		CreatureVector player_list;
+		CreatureIndex creature_list;
+		CreatureIndex player_list;
+		// players whose client sees past the default aware range, they are in player_list too
+		CreatureIndex wide_player_list;
+		// non-players with an interest in speech, see Map::getHearingSpectators
+		CreatureIndex hearing_list;
+
+		// bumped whenever a creature (player) appears or disappears in view
+		// of a position inside this leaf, see Map::invalidateSpectatorCache
+		uint32_t spectatorGeneration = 0;
+		uint32_t playerSpectatorGeneration = 0;
+
+		// bumped whenever pathing relevant state of a tile inside this leaf
+		// changes, see Map::invalidatePathCache
+		uint32_t pathGeneration = 0;
 
 		friend class Map;
 		friend class QTreeNode;
+		friend class SpectatorCache;
+};
+
+/**
+  * Short-lived cache of monster path searches, shared by all monsters of the
+  * same type and walk state. An entry remembers the area its search looked
+  * at and is only reused while no tile in there changed, see Map::getPathTo.
+  */
+class PathCache
+{
+	public:
+		static constexpr size_t CAPACITY = 1024;
+		static constexpr size_t MAX_PROBES = 4;
+		static constexpr int64_t DURATION = 1000;
+
+		struct Key {
+			bool operator==(const Key& other) const;
+
+			Position startPos;
+			Position targetPos;
+			const MonsterType* monsterType;
+			uint32_t walkFlags;
+			uint32_t searchFlags;
+			int32_t maxSearchDist;
+			int32_t minTargetDist;
+			int32_t maxTargetDist;
+		};
+
+		struct Entry {
+			Key key;
+			int64_t expiration = 0;
+			uint64_t generation = 0;
+			uint16_t minX = 0, minY = 0, maxX = 0, maxY = 0;
+			bool found = false;
+			std::vector<Direction> dirList;
+		};
+
+		PathCache() : entries(CAPACITY) {}
+
+		const Entry* find(const Key& key, int64_t now) const;
+		Entry& insert(const Key& key, int64_t now);
+
+	private:
+		static size_t getSlot(const Key& key);
+
+		std::vector<Entry> entries;
+};
+
+/**
+  * Recent isSightClear results, direct mapped by the packed positions. An
+  * entry is only trusted while no pathing relevant tile in the rectangle
+  * spanned by both positions changed, see Map::invalidatePathCache.
+  */
+class SightCache
+{
+	public:
+		static constexpr size_t CAPACITY = 8192;
+		// larger offsets do not fit the key and are never cached
+		static constexpr int32_t MAX_OFFSET = 31;
+
+		struct Entry {
+			uint64_t key = 0;
+			uint64_t generation = 0;
+			bool clear = false;
+		};
+
+		SightCache() : entries(CAPACITY) {}
+
+		static uint64_t makeKey(const Position& fromPos, const Position& toPos, bool sameFloor) {
+			// bit 0 marks a used slot, bit 1 sameFloor, then the floors, the offset and the origin
+			uint64_t offsetX = toPos.x - fromPos.x + MAX_OFFSET;
+			uint64_t offsetY = toPos.y - fromPos.y + MAX_OFFSET;
+			return (static_cast<uint64_t>(fromPos.x) << 48) | (static_cast<uint64_t>(fromPos.y) << 32) | (offsetX << 26) | (offsetY << 20) |
+			       (static_cast<uint64_t>(fromPos.z) << 10) | (static_cast<uint64_t>(toPos.z) << 2) | (sameFloor ? 2 : 0) | 1;
+		}
+
+		Entry& getEntry(uint64_t key) {
+			return entries[static_cast<size_t>((key * 0x9E3779B97F4A7C15ULL) >> 51) & (CAPACITY - 1)];
+		}
+
+	private:
+		std::vector<Entry> entries;
+};
+
+/**
+  * Dijkstra distance map around a chase target. Monsters that share the
+  * target step down its gradient instead of each running their own A*, see
+  * Map::getFlowField and Monster::getFlowFieldPath.
+  * Only static obstacles are considered, creatures and per monster walk
+  * rules are checked by the stepping monster.
+  */
+class FlowField
+{
+	public:
+		static constexpr int32_t RADIUS = 16;
+		static constexpr int32_t SIZE = RADIUS * 2 + 1;
+		static constexpr int64_t DURATION = 1000;
+		static constexpr uint16_t UNREACHABLE = std::numeric_limits<uint16_t>::max();
+
+		void build(const Map& map, const Position& targetPos);
+
+		uint16_t getDistance(const Position& pos) const {
+			int32_t x = pos.x - origin.x + RADIUS;
+			int32_t y = pos.y - origin.y + RADIUS;
+			if (pos.z != origin.z || x < 0 || x >= SIZE || y < 0 || y >= SIZE) {
+				return UNREACHABLE;
+			}
+			return distances[y * SIZE + x];
+		}
+
+		const Position& getOrigin() const {
+			return origin;
+		}
+
+		int64_t expiration = 0;
+
+	private:
+		Position origin;
+		std::array<uint16_t, SIZE * SIZE> distances;
+};
+
+/**
+  * Flat cache of full viewport, multifloor spectator queries keyed by the
+  * packed center position. Entries are never erased: an entry whose center
+  * leaf changed since it was filled is stale and simply gets overwritten.
+  */
+class SpectatorCache
+{
+	public:
+		static constexpr size_t CAPACITY = 4096;
+		static constexpr size_t MAX_PROBES = 8;
+
+		SpectatorCache() : entries(CAPACITY) {}
+
+		// aware entries hold the players of Map::getAwareSpectators, onlyPlayers must be set
+		const SpectatorVec* find(const Position& pos, bool onlyPlayers, bool aware = false) const;
+		SpectatorVec& insert(const Position& pos, bool onlyPlayers, const QTreeLeafNode* leaf, bool aware = false);
+		void clear();
+
+	private:
+		struct Entry {
+			bool isValid() const {
+				if (!leaf) {
+					return false;
+				}
+				return generation == ((key & 1) ? leaf->playerSpectatorGeneration : leaf->spectatorGeneration);
+			}
+
+			uint64_t key = 0;
+			const QTreeLeafNode* leaf = nullptr;
+			uint32_t generation = 0;
+			SpectatorVec spectators;
+		};
+
+		static uint64_t makeKey(const Position& pos, bool onlyPlayers, bool aware) {
+			// bit 1 marks a used slot, bit 0 the players only variant and bit 6 the aware one
+			return (static_cast<uint64_t>(pos.x) << 24) | (static_cast<uint64_t>(pos.y) << 8) | (static_cast<uint64_t>(pos.z) << 2) | 2 | (onlyPlayers ? 1 : 0) | (aware ? 64 : 0);
+		}
+		static size_t getSlot(uint64_t key) {
+			return static_cast<size_t>((key * 0x9E3779B97F4A7C15ULL) >> 52) & (CAPACITY - 1);
+		}
+
+		std::vector<Entry> entries;
+};
+
+/**
+  * A copy of a map region placed somewhere else. The tiles are copied from
+  * the source one block of FLOOR_SIZE x FLOOR_SIZE columns at a time, the
+  * first time loadArea reaches them, so a dungeon nobody walked through yet
+  * costs nothing and destroying it only visits the blocks that were copied.
+  */
+struct MapInstance
+{
+	// inclusive corners of the source region
+	Position from;
+	Position to;
+	// where from is placed
+	Position destination;
+
+	// destination blocks left to copy and the ones copied, keyed by their first column
+	std::unordered_set<uint32_t> pendingBlocks;
+	std::vector<uint32_t> copiedBlocks;
 };
 
 /**
@@ -161,8 +423,16 @@ class Map
         static constexpr int32_t maxClientViewportY = 10;
 		static constexpr int32_t maxViewportX = maxClientViewportX + 2;
 		static constexpr int32_t maxViewportY = maxClientViewportY + 2;
+		// reach of the default 17x13 aware range from either side, see ProtocolGame::canSee
+		static constexpr int32_t awareViewportX = 9;
+		static constexpr int32_t awareViewportY = 7;
 
-		uint32_t clean() const;
+		/**
+		  * Queues the tiles registered for cleaning, the items are removed over
+		  * the next ticks and tiles in view of a player are left for the next clean.
+		  * \returns the number of cleanable items queued
+		  */
+		uint32_t clean();
 
 		/**
 		  * Load a map.
@@ -175,6 +445,8 @@ class Map
 		  * \returns true if the map was saved successfully
 		  */
 		static bool save();
+		// serializes the houses now and writes them from the database thread
+		static bool saveAsync();
 
 		/**
 		  * Get a single tile.
@@ -212,12 +484,67 @@ class Map
 
 		void moveCreature(Creature& creature, Tile& newTile, bool forceTeleport = false);
 
+		/**
+		  * Loads the tile areas around pos which lazyMapLoading deferred.
+		  * Creatures are placed and moved with twice their view range around them
+		  * loaded, anything else looking at a possibly unloaded position calls it first.
+		  */
+		void loadArea(const Position& pos, int32_t rangeX = maxViewportX * 2, int32_t rangeY = maxViewportY * 2);
+
+		/**
+		  * Places a copy of the region between fromPos and toPos, all floors in
+		  * between included, with fromPos at destination. The destination area
+		  * must be free of tiles. Action ids are kept, teleports into the source
+		  * lead into the copy and unique ids are dropped.
+		  * \returns the id of the instance, 0 if it could not be placed
+		  */
+		uint32_t createInstance(const Position& fromPos, const Position& toPos, const Position& destination);
+
+		/**
+		  * Removes the copied tiles of an instance, players on them are sent to their temple
+		  */
+		bool destroyInstance(uint32_t instanceId);
+
+		// whether getSpectators with the default ranges around centerPos finds a creature at pos
+		static bool isInSpectatorRange(const Position& centerPos, const Position& pos, bool multifloor);
+
 		void getSpectators(SpectatorVec& spectators, const Position& centerPos, bool multifloor = false, bool onlyPlayers = false,
 		                   int32_t minRangeX = 0, int32_t maxRangeX = 0,
 		                   int32_t minRangeY = 0, int32_t maxRangeY = 0);
 
+		/**
+		  * Drops the cached spectator lists that may contain a creature at pos.
+		  * Must be called whenever a creature is added to or removed from a tile.
+		  */
+		void invalidateSpectatorCache(const Position& pos, bool isPlayer);
+
+		/**
+		  * Players whose client may see centerPos, for updates the clients filter
+		  * with canSee anyway. Only players with a wide aware range are looked for
+		  * in the whole viewport, everyone else within the default aware range.
+		  */
+		void getAwareSpectators(SpectatorVec& spectators, const Position& centerPos);
+		// moves the player between the aware range classes getAwareSpectators looks at
+		void setWideAwareRange(Player* player, bool wide);
+
+		/**
+		  * Like getSpectators, but among the non-player creatures only those
+		  * with an interest in speech, for who hears what is said there.
+		  */
+		void getHearingSpectators(SpectatorVec& spectators, const Position& centerPos, bool multifloor = false,
+		                          int32_t minRangeX = 0, int32_t maxRangeX = 0,
+		                          int32_t minRangeY = 0, int32_t maxRangeY = 0);
+		// sets the interests of the creature and moves it in or out of hearing_list
+		void setInterests(Creature* creature, uint8_t interests);
 		void clearSpectatorCache();
-		void clearPlayersSpectatorCache();
+
+		/**
+		  * Serialized tile descriptions, owned by the map so they outlive the tiles.
+		  * Tiles drop their own entry whenever their ground or items change.
+		  */
+		const TileDescription* getTileDescription(const Tile* tile) const;
+		const TileDescription& setTileDescription(const Tile* tile, TileDescription&& description);
+		void removeTileDescription(const Tile* tile);
 
 		/**
 		  * Checks if you can throw an object to that position
@@ -255,10 +582,25 @@ class Map
 		bool getPathMatching(const Creature& creature, std::vector<Direction>& dirList,
 		                     const FrozenPathingConditionCall& pathCondition, const FindPathParams& fpp) const;
 
+		/**
+		  * Finds a path towards targetPos, monster searches are shared through the path cache
+		  */
+		bool getPathTo(const Creature& creature, const Position& targetPos, std::vector<Direction>& dirList, const FindPathParams& fpp) const;
+
+		/**
+		  * Invalidates cached paths whose search area contains pos
+		  */
+		void invalidatePathCache(const Position& pos);
+
+		/**
+		  * Gets the distance map towards target, rebuilt when the target moved or the field expired
+		  */
+		const FlowField& getFlowField(const Creature& target) const;
+
 		std::map<std::string, Position> waypoints;
 
 		QTreeLeafNode* getQTNode(uint16_t x, uint16_t y) {
-			return QTreeNode::getLeafStatic<QTreeLeafNode*, QTreeNode*>(&root, x, y);
+			return getLeaf(x, y);
 		}
 
 		Spawns spawns;
@@ -267,21 +609,86 @@ class Map
 
 	private:
 		SpectatorCache spectatorCache;
-		SpectatorCache playersSpectatorCache;
+		mutable PathCache pathCache;
+		mutable SightCache sightCache;
+		mutable std::unordered_map<uint32_t, FlowField> flowFields;
+		std::unordered_map<const Tile*, TileDescription> tileDescriptions;
 
 		QTreeNode root;
 
+		// flat index of the leaves of root, a page covers LEAF_PAGE_SIZE x LEAF_PAGE_SIZE
+		// tiles so a lookup takes two loads instead of descending the quadtree
+		static constexpr int32_t LEAF_PAGE_BITS = 8;
+		static constexpr int32_t LEAF_PAGE_SIZE = 1 << LEAF_PAGE_BITS;
+		static constexpr int32_t LEAF_PAGE_LEAVES = LEAF_PAGE_SIZE / FLOOR_SIZE;
+		static constexpr size_t LEAF_PAGE_COUNT = (0x10000 / LEAF_PAGE_SIZE) * (0x10000 / LEAF_PAGE_SIZE);
+
+		struct LeafPage {
+			QTreeLeafNode* leaves[LEAF_PAGE_LEAVES * LEAF_PAGE_LEAVES] = {};
+		};
+
+		std::vector<std::unique_ptr<LeafPage>> leafPages = std::vector<std::unique_ptr<LeafPage>>(LEAF_PAGE_COUNT);
+
+		static size_t getLeafPageIndex(uint16_t x, uint16_t y) {
+			return (static_cast<size_t>(y >> LEAF_PAGE_BITS) << (16 - LEAF_PAGE_BITS)) | (x >> LEAF_PAGE_BITS);
+		}
+		static size_t getLeafIndex(uint16_t x, uint16_t y) {
+			return (((y & (LEAF_PAGE_SIZE - 1)) >> FLOOR_BITS) * LEAF_PAGE_LEAVES) + ((x & (LEAF_PAGE_SIZE - 1)) >> FLOOR_BITS);
+		}
+
+		QTreeLeafNode* getLeaf(uint16_t x, uint16_t y) const {
+			const LeafPage* page = leafPages[getLeafPageIndex(x, y)].get();
+			return page ? page->leaves[getLeafIndex(x, y)] : nullptr;
+		}
+
+		// tiles queued by clean, removed a slice per tick
+		static constexpr int64_t CLEAN_SLICE_DURATION = 5;
+		static constexpr uint32_t CLEAN_SLICE_INTERVAL = 50;
+
+		std::array<std::vector<Tile*>, MAP_MAX_LAYERS> cleanFloors;
+		int64_t cleanStart = 0;
+		size_t cleanedItems = 0;
+		size_t cleanedTiles = 0;
+		uint32_t cleanEvent = 0;
+
+		void cleanSlice();
+
+		// set while tile areas are left to be loaded, see loadArea
+		std::shared_ptr<IOMap> lazyMap;
+
+		std::map<uint32_t, MapInstance> instances;
+		uint32_t nextInstanceId = 0;
+
+		static uint32_t getInstanceBlockKey(uint16_t x, uint16_t y) {
+			return (static_cast<uint32_t>(x >> FLOOR_BITS) << 16) | (y >> FLOOR_BITS);
+		}
+		void loadInstanceBlocks(MapInstance& instance, int32_t fromX, int32_t fromY, int32_t toX, int32_t toY);
+		void copyInstanceTile(const MapInstance& instance, uint16_t x, uint16_t y, uint8_t z);
+
 		std::string spawnfile;
 		std::string housefile;
 
 		uint32_t width = 0;
 		uint32_t height = 0;
 
+		static void getSpectatorFloorRange(int32_t z, int32_t& minRangeZ, int32_t& maxRangeZ);
+
+		bool checkSight(const Position& fromPos, const Position& toPos, bool sameFloor) const;
+
+		uint64_t getPathGeneration(uint16_t minX, uint16_t minY, uint16_t maxX, uint16_t maxY) const;
+
 		// Actually scans the map for spectators
 		void getSpectatorsInternal(SpectatorVec& spectators, const Position& centerPos,
 		                           int32_t minRangeX, int32_t maxRangeX,
 		                           int32_t minRangeY, int32_t maxRangeY,
-		                           int32_t minRangeZ, int32_t maxRangeZ, bool onlyPlayers) const;
+		                           int32_t minRangeZ, int32_t maxRangeZ, bool onlyPlayers) const {
+			getSpectatorsInternal(spectators, centerPos, minRangeX, maxRangeX, minRangeY, maxRangeY, minRangeZ, maxRangeZ,
+			                      onlyPlayers ? &QTreeLeafNode::player_list : &QTreeLeafNode::creature_list);
+		}
+		void getSpectatorsInternal(SpectatorVec& spectators, const Position& centerPos,
+		                           int32_t minRangeX, int32_t maxRangeX,
+		                           int32_t minRangeY, int32_t maxRangeY,
+		                           int32_t minRangeZ, int32_t maxRangeZ, QTreeLeafNode::CreatureIndex QTreeLeafNode::* list) const;
 
 		friend class Game;
 		friend class IOMap;
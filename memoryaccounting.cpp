@@ -0,0 +1,43 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#include "otpch.h"
+
+#include "memoryaccounting.h"
+#include "luascript.h"
+
+extern LuaEnvironment g_luaEnvironment;
+
+std::array<MemoryAccounting::Counter, MEMORY_LAST> MemoryAccounting::counters;
+
+int64_t MemoryAccounting::getBytes(MemoryCategory_t category)
+{
+#ifdef LUAJIT_VERSION
+	// luajit keeps its own allocator on 64 bit, its collector knows the total
+	if (category == MEMORY_LUA) {
+		lua_State* L = g_luaEnvironment.getLuaState();
+		return L ? (static_cast<int64_t>(lua_gc(L, LUA_GCCOUNT, 0)) << 10) + lua_gc(L, LUA_GCCOUNTB, 0) : 0;
+	}
+#endif
+	return counters[category].bytes.load(std::memory_order_relaxed);
+}
+
+int64_t MemoryAccounting::getObjects(MemoryCategory_t category)
+{
+	return counters[category].objects.load(std::memory_order_relaxed);
+}
+
+const char* MemoryAccounting::getName(MemoryCategory_t category)
+{
+	switch (category) {
+		case MEMORY_TILES: return "tiles";
+		case MEMORY_ITEMS: return "items";
+		case MEMORY_ITEM_ATTRIBUTES: return "item_attributes";
+		case MEMORY_CONTAINERS: return "containers";
+		case MEMORY_CREATURES: return "creatures";
+		case MEMORY_CONDITIONS: return "conditions";
+		case MEMORY_OUTPUT_MESSAGES: return "output_messages";
+		case MEMORY_LUA: return "lua";
+		default: return "unknown";
+	}
+}
@@ -0,0 +1,74 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#ifndef FS_MEMORYACCOUNTING_H_6435C43AAAA9412D9215A003CF1EE7EF
+#define FS_MEMORYACCOUNTING_H_6435C43AAAA9412D9215A003CF1EE7EF
+
+#include <array>
+#include <atomic>
+
+enum MemoryCategory_t : uint8_t {
+	MEMORY_TILES,
+	MEMORY_ITEMS,
+	MEMORY_ITEM_ATTRIBUTES,
+	MEMORY_CONTAINERS,
+	MEMORY_CREATURES,
+	MEMORY_CONDITIONS,
+	MEMORY_OUTPUT_MESSAGES,
+	MEMORY_LUA,
+
+	MEMORY_LAST
+};
+
+// Live bytes and objects of the engine's largest allocation sites, bumped by
+// the class-level operator new and delete of each type and by the allocator
+// of the lua state. Only the objects themselves are counted, not what their
+// members allocate, and pooled blocks count while they are handed out.
+class MemoryAccounting
+{
+	public:
+		static void allocated(MemoryCategory_t category, size_t size) {
+			Counter& counter = counters[category];
+			counter.bytes.fetch_add(size, std::memory_order_relaxed);
+			counter.objects.fetch_add(1, std::memory_order_relaxed);
+		}
+		static void released(MemoryCategory_t category, size_t size) {
+			Counter& counter = counters[category];
+			counter.bytes.fetch_sub(size, std::memory_order_relaxed);
+			counter.objects.fetch_sub(1, std::memory_order_relaxed);
+		}
+
+		static int64_t getBytes(MemoryCategory_t category);
+		static int64_t getObjects(MemoryCategory_t category);
+		static const char* getName(MemoryCategory_t category);
+
+	private:
+		// each counter on its own cache line, items and output messages are
+		// allocated on different threads
+		struct alignas(64) Counter {
+			std::atomic<int64_t> bytes{0};
+			std::atomic<int64_t> objects{0};
+		};
+
+		static std::array<Counter, MEMORY_LAST> counters;
+};
+
+// base for types built through make_shared or allocate_shared, which never
+// reach a class-level operator new, so their constructors count them instead
+template <typename T, MemoryCategory_t category>
+class MemoryTracked
+{
+	protected:
+		MemoryTracked() {
+			MemoryAccounting::allocated(category, sizeof(T));
+		}
+		MemoryTracked(const MemoryTracked&) {
+			MemoryAccounting::allocated(category, sizeof(T));
+		}
+		MemoryTracked& operator=(const MemoryTracked&) = default;
+		~MemoryTracked() {
+			MemoryAccounting::released(category, sizeof(T));
+		}
+};
+
+#endif
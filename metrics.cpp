@@ -0,0 +1,144 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#include "otpch.h"
+
+#include "metrics.h"
+#include "databasetasks.h"
+#include "game.h"
+#include "lockprofiler.h"
+#include "memoryaccounting.h"
+#include "outputmessage.h"
+#include "scheduler.h"
+
+#include <fmt/format.h>
+
+extern Game g_game;
+
+Metrics g_metrics;
+
+std::vector<std::unique_ptr<Metrics::CounterBlock>> Metrics::blocks;
+std::mutex Metrics::blocksLock;
+
+namespace {
+
+void addMetric(std::string& out, const char* name, const char* type, const char* help, uint64_t value)
+{
+	out += fmt::format("# HELP {:s} {:s}\n# TYPE {:s} {:s}\n{:s} {:d}\n", name, help, name, type, name, value);
+}
+
+}
+
+Metrics::CounterBlock* Metrics::registerBlock()
+{
+	std::lock_guard<std::mutex> lockClass(blocksLock);
+	blocks.emplace_back(new CounterBlock());
+	return blocks.back().get();
+}
+
+void Metrics::addSentPacketMetrics(std::string& out) const
+{
+	std::array<uint64_t, 256> packets = {};
+	std::array<uint64_t, 256> bytes = {};
+	{
+		std::lock_guard<std::mutex> lockClass(blocksLock);
+		for (const auto& block : blocks) {
+			for (size_t opcode = 0; opcode < 256; ++opcode) {
+				packets[opcode] += block->sentPackets[opcode].load(std::memory_order_relaxed);
+				bytes[opcode] += block->sentPacketBytes[opcode].load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	// only opcodes that have been sent, a message counts under its first opcode
+	out += "# HELP tfs_network_sent_opcode_packets_total Game messages sent to clients by their first opcode.\n# TYPE tfs_network_sent_opcode_packets_total counter\n";
+	for (size_t opcode = 0; opcode < 256; ++opcode) {
+		if (packets[opcode] != 0) {
+			out += fmt::format("tfs_network_sent_opcode_packets_total{{opcode=\"0x{:02X}\"}} {:d}\n", opcode, packets[opcode]);
+		}
+	}
+	out += "# HELP tfs_network_sent_opcode_bytes_total Bytes of the game messages sent to clients by their first opcode, before compression and encryption.\n# TYPE tfs_network_sent_opcode_bytes_total counter\n";
+	for (size_t opcode = 0; opcode < 256; ++opcode) {
+		if (packets[opcode] != 0) {
+			out += fmt::format("tfs_network_sent_opcode_bytes_total{{opcode=\"0x{:02X}\"}} {:d}\n", opcode, bytes[opcode]);
+		}
+	}
+}
+
+uint64_t Metrics::get(MetricCounter_t counter) const
+{
+	std::lock_guard<std::mutex> lockClass(blocksLock);
+
+	uint64_t value = 0;
+	for (const auto& block : blocks) {
+		value += block->counters[counter].load(std::memory_order_relaxed);
+	}
+	return value;
+}
+
+std::string Metrics::getReport()
+{
+	std::string out;
+	out.reserve(4096);
+
+	addMetric(out, "tfs_dispatcher_queue_depth", "gauge", "Tasks taken by the dispatcher in its latest batch.", lastBatchSize);
+	addMetric(out, "tfs_dispatcher_queue_depth_max", "gauge", "Largest dispatcher batch since the previous scrape.", maxBatchSize);
+
+	out += "# HELP tfs_dispatcher_task_duration_seconds Execution time of dispatcher tasks, quantiles since the previous scrape.\n";
+	out += "# TYPE tfs_dispatcher_task_duration_seconds summary\n";
+	for (double quantile : {0.5, 0.9, 0.99}) {
+		out += fmt::format("tfs_dispatcher_task_duration_seconds{{quantile=\"{:g}\"}} {:.6f}\n", quantile, taskDurations.getPercentile(quantile) / 1000000.);
+	}
+	out += fmt::format("tfs_dispatcher_task_duration_seconds_sum {:.6f}\n", totalTaskMicros / 1000000.);
+	out += fmt::format("tfs_dispatcher_task_duration_seconds_count {:d}\n", totalTasks);
+
+	static constexpr std::array<const char*, TICK_PHASE_LAST> phaseNames = {"input", "simulate", "output"};
+	out += "# HELP tfs_dispatcher_phase_seconds_total Time the dispatcher frames spent in each phase.\n# TYPE tfs_dispatcher_phase_seconds_total counter\n";
+	for (size_t phase = 0; phase < TICK_PHASE_LAST; ++phase) {
+		out += fmt::format("tfs_dispatcher_phase_seconds_total{{phase=\"{:s}\"}} {:.6f}\n", phaseNames[phase], phaseMicros[phase] / 1000000.);
+	}
+	out += "# HELP tfs_dispatcher_phase_seconds_max Longest single frame phase since the previous scrape.\n# TYPE tfs_dispatcher_phase_seconds_max gauge\n";
+	for (size_t phase = 0; phase < TICK_PHASE_LAST; ++phase) {
+		out += fmt::format("tfs_dispatcher_phase_seconds_max{{phase=\"{:s}\"}} {:.6f}\n", phaseNames[phase], maxPhaseMicros[phase] / 1000000.);
+	}
+
+	addMetric(out, "tfs_scheduler_pending_events", "gauge", "Events waiting in the scheduler.", g_scheduler.getEventCount());
+	addMetric(out, "tfs_output_buffered_protocols", "gauge", "Protocols with buffered output waiting for autosend.", OutputMessagePool::getInstance().getBufferedProtocolCount());
+	addMetric(out, "tfs_database_backlog", "gauge", "Database tasks queued or running.", g_databaseTasks.getBacklog());
+
+	addMetric(out, "tfs_network_received_bytes_total", "counter", "Bytes received from clients.", get(METRIC_NETWORK_BYTES_IN));
+	addMetric(out, "tfs_network_sent_bytes_total", "counter", "Bytes sent to clients.", get(METRIC_NETWORK_BYTES_OUT));
+	addMetric(out, "tfs_network_sent_payload_bytes_total", "counter", "Bytes of the messages sent to clients before compression and encryption.", get(METRIC_NETWORK_PAYLOAD_BYTES_OUT));
+	addMetric(out, "tfs_network_received_packets_total", "counter", "Packets received from clients.", get(METRIC_NETWORK_PACKETS_IN));
+	addMetric(out, "tfs_network_sent_packets_total", "counter", "Output messages sent to clients.", get(METRIC_NETWORK_PACKETS_OUT));
+	addMetric(out, "tfs_network_shed_packets_total", "counter", "Effect and tooltip packets dropped for a client over its output budget.", get(METRIC_NETWORK_PACKETS_SHED));
+
+	addSentPacketMetrics(out);
+
+	addMetric(out, "tfs_players_online", "gauge", "Players online.", g_game.getPlayersOnline());
+	addMetric(out, "tfs_monsters_online", "gauge", "Monsters on the map.", g_game.getMonstersOnline());
+	addMetric(out, "tfs_npcs_online", "gauge", "NPCs on the map.", g_game.getNpcsOnline());
+
+	addMetric(out, "tfs_spectator_cache_hits_total", "counter", "Spectator queries answered from the cache.", get(METRIC_SPECTATOR_CACHE_HITS));
+	addMetric(out, "tfs_spectator_cache_misses_total", "counter", "Cacheable spectator queries that had to scan the map.", get(METRIC_SPECTATOR_CACHE_MISSES));
+	addMetric(out, "tfs_pathfinding_searches_total", "counter", "A* path searches.", get(METRIC_PATHFINDING_SEARCHES));
+
+	out += "# HELP tfs_memory_bytes Live bytes of the objects of each subsystem.\n# TYPE tfs_memory_bytes gauge\n";
+	for (uint8_t i = 0; i < MEMORY_LAST; ++i) {
+		MemoryCategory_t category = static_cast<MemoryCategory_t>(i);
+		out += fmt::format("tfs_memory_bytes{{subsystem=\"{:s}\"}} {:d}\n", MemoryAccounting::getName(category), MemoryAccounting::getBytes(category));
+	}
+	out += "# HELP tfs_memory_objects Live objects of each subsystem.\n# TYPE tfs_memory_objects gauge\n";
+	for (uint8_t i = 0; i < MEMORY_LAST; ++i) {
+		MemoryCategory_t category = static_cast<MemoryCategory_t>(i);
+		out += fmt::format("tfs_memory_objects{{subsystem=\"{:s}\"}} {:d}\n", MemoryAccounting::getName(category), MemoryAccounting::getObjects(category));
+	}
+
+	// empty unless built with ENABLE_LOCK_PROFILING
+	out += LockProfiler::getReport();
+
+	taskDurations = TaskProfiler::Histogram();
+	maxBatchSize = lastBatchSize;
+	maxPhaseMicros = {};
+	return out;
+}
@@ -0,0 +1,95 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#ifndef FS_METRICS_H_868CCEAA5CA74EDB8E85ACB7359FD46C
+#define FS_METRICS_H_868CCEAA5CA74EDB8E85ACB7359FD46C
+
+#include "taskprofiler.h"
+#include "tasks.h"
+
+#include <array>
+#include <atomic>
+
+enum MetricCounter_t : uint8_t {
+	METRIC_NETWORK_BYTES_IN,
+	METRIC_NETWORK_BYTES_OUT,
+	METRIC_NETWORK_PAYLOAD_BYTES_OUT,
+	METRIC_NETWORK_PACKETS_IN,
+	METRIC_NETWORK_PACKETS_OUT,
+	METRIC_NETWORK_PACKETS_SHED,
+	METRIC_SPECTATOR_CACHE_HITS,
+	METRIC_SPECTATOR_CACHE_MISSES,
+	METRIC_PATHFINDING_SEARCHES,
+
+	METRIC_LAST
+};
+
+// Always-on runtime counters. Every thread owns a block of counters that only
+// it writes to, so bumping one is a relaxed load and store without any shared
+// cache line. A scrape sums the blocks of all threads. The dispatcher figures
+// are only touched by the game thread, which is also where reports are built.
+class Metrics
+{
+	public:
+		static void add(MetricCounter_t counter, uint64_t value = 1) {
+			std::atomic<uint64_t>& slot = getLocalBlock().counters[counter];
+			slot.store(slot.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+		}
+		uint64_t get(MetricCounter_t counter) const;
+
+		// game messages by their first opcode, before compression and encryption
+		static void addSentPacket(uint8_t opcode, uint64_t bytes) {
+			CounterBlock& block = getLocalBlock();
+			block.sentPacketBytes[opcode].store(block.sentPacketBytes[opcode].load(std::memory_order_relaxed) + bytes, std::memory_order_relaxed);
+			block.sentPackets[opcode].store(block.sentPackets[opcode].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		}
+
+		// dispatcher thread
+		void addDispatcherBatch(size_t tasks) {
+			lastBatchSize = tasks;
+			maxBatchSize = std::max(maxBatchSize, tasks);
+		}
+		void addTaskExecution(uint64_t micros) {
+			taskDurations.add(micros);
+			++totalTasks;
+			totalTaskMicros += micros;
+		}
+		void addTickPhase(TickPhase_t phase, uint64_t micros) {
+			phaseMicros[phase] += micros;
+			maxPhaseMicros[phase] = std::max(maxPhaseMicros[phase], micros);
+		}
+
+		// dispatcher thread, quantiles and the batch peak cover the time since the previous report
+		std::string getReport();
+
+	private:
+		struct CounterBlock {
+			std::array<std::atomic<uint64_t>, METRIC_LAST> counters = {};
+			std::array<std::atomic<uint64_t>, 256> sentPackets = {};
+			std::array<std::atomic<uint64_t>, 256> sentPacketBytes = {};
+		};
+
+		static CounterBlock& getLocalBlock() {
+			thread_local CounterBlock* block = registerBlock();
+			return *block;
+		}
+		static CounterBlock* registerBlock();
+
+		void addSentPacketMetrics(std::string& out) const;
+
+		// blocks outlive their threads so the counts of finished workers are kept
+		static std::vector<std::unique_ptr<CounterBlock>> blocks;
+		static std::mutex blocksLock;
+
+		TaskProfiler::Histogram taskDurations;
+		uint64_t totalTasks = 0;
+		uint64_t totalTaskMicros = 0;
+		size_t lastBatchSize = 0;
+		size_t maxBatchSize = 0;
+		std::array<uint64_t, TICK_PHASE_LAST> phaseMicros = {};
+		std::array<uint64_t, TICK_PHASE_LAST> maxPhaseMicros = {};
+};
+
+extern Metrics g_metrics;
+
+#endif
@@ -9,6 +9,8 @@
 #include "events.h"
 
 #include "configmanager.h"
+#include "lockfree.h"
+#include "rarity.h"
 #include <vector>
 #include <list>
 #include <tuple>
@@ -16,6 +18,7 @@
 #include <random>
 #include <algorithm>
 #include <cstdint>
+#include <boost/container/small_vector.hpp>
 
 extern Game g_game;
 extern Monsters g_monsters;
@@ -25,7 +28,7 @@ extern ConfigManager g_config;
 int32_t Monster::despawnRange;
 int32_t Monster::despawnRadius;
 
-uint32_t Monster::monsterAutoID = 0x40000000;
+CreatureIdTable<Monster> Monster::ids{0x40000000, 30};
 
 Monster* Monster::createMonster(const std::string& name)
 {
@@ -36,6 +39,15 @@ Monster* Monster::createMonster(const std::string& name)
 	return new Monster(mType);
 }
 
+Monster* Monster::createMonster(uint32_t monsterTypeId)
+{
+	MonsterType* mType = g_monsters.getMonsterTypeById(monsterTypeId);
+	if (!mType) {
+		return nullptr;
+	}
+	return new Monster(mType);
+}
+
 Monster::Monster(MonsterType* mType) :
 	Creature(),
 	nameDescription(mType->nameDescription),
@@ -108,10 +120,35 @@ Monster::Monster(MonsterType* mType) :
 			std::cout << "[Warning - Monster::Monster] Unknown event name: " << scriptName << std::endl;
 		}
 	}
+
+	interests = getTypeInterests();
+}
+
+static constexpr size_t MONSTER_FREE_LIST_CAPACITY = 2048;
+
+void* Monster::operator new(size_t size)
+{
+	MemoryAccounting::allocated(MEMORY_CREATURES, size);
+	if (size != sizeof(Monster)) {
+		return ::operator new(size);
+	}
+	return LockfreePoolingAllocator<Monster, MONSTER_FREE_LIST_CAPACITY>().allocate(1);
+}
+
+void Monster::operator delete(void* p, size_t size)
+{
+	MemoryAccounting::released(MEMORY_CREATURES, size);
+	if (size != sizeof(Monster)) {
+		::operator delete(p);
+		return;
+	}
+	LockfreePoolingAllocator<Monster, MONSTER_FREE_LIST_CAPACITY>().deallocate(static_cast<Monster*>(p), 1);
 }
 
 Monster::~Monster()
 {
+	ids.release(id);
+
 	clearTargetList();
 	clearFriendList();
 }
@@ -119,10 +156,12 @@ Monster::~Monster()
 void Monster::addList()
 {
 	g_game.addMonster(this);
+	ids.setCreature(id, this);
 }
 
 void Monster::removeList()
 {
+	ids.setCreature(id, nullptr);
 	g_game.removeMonster(this);
 }
 
@@ -203,11 +242,9 @@ void Monster::onCreatureAppear(Creature* creature, bool isLogin)
 		lua_State* L = scriptInterface->getLuaState();
 		scriptInterface->pushFunction(mType->info.creatureAppearEvent);
 
-		LuaScriptInterface::pushUserdata<Monster>(L, this);
-		LuaScriptInterface::setMetatable(L, -1, "Monster");
+		LuaScriptInterface::pushCreature(L, this);
 
-		LuaScriptInterface::pushUserdata<Creature>(L, creature);
-		LuaScriptInterface::setCreatureMetatable(L, -1, creature);
+		LuaScriptInterface::pushCreature(L, creature);
 
 		if (scriptInterface->callFunction(2)) {
 			return;
@@ -245,11 +282,9 @@ void Monster::onRemoveCreature(Creature* creature, bool isLogout)
 		lua_State* L = scriptInterface->getLuaState();
 		scriptInterface->pushFunction(mType->info.creatureDisappearEvent);
 
-		LuaScriptInterface::pushUserdata<Monster>(L, this);
-		LuaScriptInterface::setMetatable(L, -1, "Monster");
+		LuaScriptInterface::pushCreature(L, this);
 
-		LuaScriptInterface::pushUserdata<Creature>(L, creature);
-		LuaScriptInterface::setCreatureMetatable(L, -1, creature);
+		LuaScriptInterface::pushCreature(L, creature);
 
 		if (scriptInterface->callFunction(2)) {
 			return;
@@ -286,11 +321,9 @@ void Monster::onCreatureMove(Creature* creature, const Tile* newTile, const Posi
 		lua_State* L = scriptInterface->getLuaState();
 		scriptInterface->pushFunction(mType->info.creatureMoveEvent);
 
-		LuaScriptInterface::pushUserdata<Monster>(L, this);
-		LuaScriptInterface::setMetatable(L, -1, "Monster");
+		LuaScriptInterface::pushCreature(L, this);
 
-		LuaScriptInterface::pushUserdata<Creature>(L, creature);
-		LuaScriptInterface::setCreatureMetatable(L, -1, creature);
+		LuaScriptInterface::pushCreature(L, creature);
 
 		LuaScriptInterface::pushPosition(L, oldPos);
 		LuaScriptInterface::pushPosition(L, newPos);
@@ -317,6 +350,11 @@ void Monster::onCreatureMove(Creature* creature, const Tile* newTile, const Posi
 			onCreatureLeave(creature);
 		}
 
+		// friends and bystanders walking in view change neither the targets nor the idle status
+		if (creature != getMaster() && !isOpponent(creature)) {
+			return;
+		}
+
 		if (canSeeNewPos && isSummon() && getMaster() == creature) {
 			isMasterInRange = true; //Follow master again
 		}
@@ -350,6 +388,11 @@ void Monster::onCreatureMove(Creature* creature, const Tile* newTile, const Posi
 	}
 }
 
+uint8_t Monster::getTypeInterests() const
+{
+	return mType->info.creatureSayEvent != -1 ? CREATURE_INTEREST_SPEECH : CREATURE_INTEREST_NONE;
+}
+
 void Monster::onCreatureSay(Creature* creature, SpeakClasses type, const std::string& text)
 {
 	Creature::onCreatureSay(creature, type, text);
@@ -368,11 +411,9 @@ void Monster::onCreatureSay(Creature* creature, SpeakClasses type, const std::st
 		lua_State* L = scriptInterface->getLuaState();
 		scriptInterface->pushFunction(mType->info.creatureSayEvent);
 
-		LuaScriptInterface::pushUserdata<Monster>(L, this);
-		LuaScriptInterface::setMetatable(L, -1, "Monster");
+		LuaScriptInterface::pushCreature(L, this);
 
-		LuaScriptInterface::pushUserdata<Creature>(L, creature);
-		LuaScriptInterface::setCreatureMetatable(L, -1, creature);
+		LuaScriptInterface::pushCreature(L, creature);
 
 		lua_pushnumber(L, type);
 		LuaScriptInterface::pushString(L, text);
@@ -405,7 +446,7 @@ void Monster::addTarget(Creature* creature, bool pushFront/* = false*/)
 	if (std::find(targetList.begin(), targetList.end(), creature) == targetList.end()) {
 		creature->incrementReferenceCounter();
 		if (pushFront) {
-			targetList.push_front(creature);
+			targetList.insert(targetList.begin(), creature);
 		} else {
 			targetList.push_back(creature);
 		}
@@ -574,79 +615,59 @@ void Monster::onCreatureLeave(Creature* creature)
 
 bool Monster::searchTarget(TargetSearchType_t searchType /*= TARGETSEARCH_DEFAULT*/)
 {
-	std::list<Creature*> resultList;
 	const Position& myPos = getPosition();
 
-	for (Creature* creature : targetList) {
-		if (followCreature != creature && isTarget(creature)) {
-			if (searchType == TARGETSEARCH_RANDOM || canUseAttack(myPos, creature)) {
-				resultList.push_back(creature);
-			}
-		}
-	}
-
-	switch (searchType) {
-		case TARGETSEARCH_NEAREST: {
-			Creature* target = nullptr;
-			if (!resultList.empty()) {
-				auto it = resultList.begin();
-				target = *it;
-
-				if (++it != resultList.end()) {
-					const Position& targetPosition = target->getPosition();
-					int32_t minRange = Position::getDistanceX(myPos, targetPosition) + Position::getDistanceY(myPos, targetPosition);
-					do {
-						const Position& pos = (*it)->getPosition();
+	if (searchType == TARGETSEARCH_NEAREST) {
+		// nearest attackable target, or the nearest target at all if none can be attacked
+		Creature* nearest = nullptr;
+		Creature* nearestAttackable = nullptr;
+		int32_t minRange = std::numeric_limits<int32_t>::max();
+		int32_t minAttackableRange = std::numeric_limits<int32_t>::max();
 
-						int32_t distance = Position::getDistanceX(myPos, pos) + Position::getDistanceY(myPos, pos);
-						if (distance < minRange) {
-							target = *it;
-							minRange = distance;
-						}
-					} while (++it != resultList.end());
-				}
-			} else {
-				int32_t minRange = std::numeric_limits<int32_t>::max();
-				for (Creature* creature : targetList) {
-					if (!isTarget(creature)) {
-						continue;
-					}
+		for (Creature* creature : targetList) {
+			if (!isTarget(creature)) {
+				continue;
+			}
 
-					const Position& pos = creature->getPosition();
-					int32_t distance = Position::getDistanceX(myPos, pos) + Position::getDistanceY(myPos, pos);
-					if (distance < minRange) {
-						target = creature;
-						minRange = distance;
-					}
-				}
+			const Position& pos = creature->getPosition();
+			int32_t distance = Position::getDistanceX(myPos, pos) + Position::getDistanceY(myPos, pos);
+			if (distance < minRange) {
+				nearest = creature;
+				minRange = distance;
 			}
 
-			if (target && selectTarget(target)) {
-				return true;
+			if (followCreature != creature && distance < minAttackableRange && canUseAttack(myPos, creature)) {
+				nearestAttackable = creature;
+				minAttackableRange = distance;
 			}
-			break;
 		}
 
-		case TARGETSEARCH_DEFAULT:
-		case TARGETSEARCH_ATTACKRANGE:
-		case TARGETSEARCH_RANDOM:
-		default: {
-			if (!resultList.empty()) {
-				auto it = resultList.begin();
-				std::advance(it, uniform_random(0, resultList.size() - 1));
-				return selectTarget(*it);
+		Creature* target = nearestAttackable ? nearestAttackable : nearest;
+		if (target && selectTarget(target)) {
+			return true;
+		}
+	} else {
+		boost::container::small_vector<Creature*, 8> resultList;
+		for (Creature* creature : targetList) {
+			if (followCreature != creature && isTarget(creature)) {
+				if (searchType == TARGETSEARCH_RANDOM || canUseAttack(myPos, creature)) {
+					resultList.push_back(creature);
+				}
 			}
+		}
 
-			if (searchType == TARGETSEARCH_ATTACKRANGE) {
-				return false;
-			}
+		if (!resultList.empty()) {
+			return selectTarget(resultList[uniform_random(0, resultList.size() - 1)]);
+		}
 
-			break;
+		if (searchType == TARGETSEARCH_ATTACKRANGE) {
+			return false;
 		}
 	}
 
-	//lets just pick the first target in the list
-	for (Creature* target : targetList) {
+	//lets just pick the first target in the list, selecting may reorder it
+	for (size_t i = 0; i < targetList.size(); ++i) {
+		Creature* target = targetList[i];
 		if (followCreature != target && selectTarget(target)) {
 			return true;
 		}
@@ -663,7 +684,7 @@ void Monster::onFollowCreatureComplete(const Creature* creature)
 			targetList.erase(it);
 
 			if (hasFollowPath) {
-				targetList.push_front(target);
+				targetList.insert(targetList.begin(), target);
 			} else if (!isSummon()) {
 				targetList.push_back(target);
 			} else {
@@ -679,12 +700,7 @@ BlockType_t Monster::blockHit(Creature* attacker, CombatType_t combatType, int32
 	BlockType_t blockType = Creature::blockHit(attacker, combatType, damage, checkDefense, checkArmor);
 
 	if (damage != 0) {
-		int32_t elementMod = 0;
-		auto it = mType->info.elementMap.find(combatType);
-		if (it != mType->info.elementMap.end()) {
-			elementMod = it->second;
-		}
-
+		int32_t elementMod = combatType != COMBAT_NONE ? mType->info.elements[combatTypeToIndex(combatType)] : 0;
 		if (elementMod != 0) {
 			damage = static_cast<int32_t>(std::round(damage * ((100 - elementMod) / 100.)));
 			if (damage <= 0) {
@@ -744,7 +760,7 @@ void Monster::setIdle(bool idle)
 		onIdleStatus();
 		clearTargetList();
 		clearFriendList();
-		Game::removeCreatureCheck(this);
+		g_game.removeCreatureCheck(this);
 	}
 }
 
@@ -780,6 +796,15 @@ void Monster::onEndCondition(ConditionType_t type)
 	updateIdleStatus();
 }
 
+uint32_t Monster::getThinkRate() const
+{
+	// anything engaged keeps thinking at full rate
+	if (isSummon() || attackedCreature || followCreature || walkingToSpawn || !conditions.empty()) {
+		return 1;
+	}
+	return getThinkRateByNearestPlayer();
+}
+
 void Monster::onThink(uint32_t interval)
 {
 	Creature::onThink(interval);
@@ -798,8 +823,7 @@ void Monster::onThink(uint32_t interval)
 		lua_State* L = scriptInterface->getLuaState();
 		scriptInterface->pushFunction(mType->info.thinkEvent);
 
-		LuaScriptInterface::pushUserdata<Monster>(L, this);
-		LuaScriptInterface::setMetatable(L, -1, "Monster");
+		LuaScriptInterface::pushCreature(L, this);
 
 		lua_pushnumber(L, interval);
 
@@ -1207,7 +1231,7 @@ void Monster::pushCreatures(Tile* tile)
 {
 	//We can not use iterators here since we can push a creature to another tile
 	//which will invalidate the iterator.
-	if (CreatureVector* creatures = tile->getCreatures()) {
+	if (TileCreatureVector* creatures = tile->getCreatures()) {
 		uint32_t removeCount = 0;
 		Monster* lastPushedMonster = nullptr;
 
@@ -1389,6 +1413,49 @@ bool Monster::getDanceStep(const Position& creaturePos, Direction& direction,
 	return false;
 }
 
+bool Monster::getFlowFieldPath(const Creature* target, std::vector<Direction>& dirList) const
+{
+	if (!flowFieldPathing) {
+		return false;
+	}
+
+	const Position& creaturePos = getPosition();
+	if (Position::areInRange<1, 1, 0>(creaturePos, target->getPosition())) {
+		// already next to it, same as an empty path
+		return true;
+	}
+
+	const FlowField& field = g_game.map.getFlowField(*target);
+	uint16_t distance = field.getDistance(creaturePos);
+	if (distance == FlowField::UNREACHABLE) {
+		return false;
+	}
+
+	static const Direction directions[] = {
+		DIRECTION_NORTH, DIRECTION_EAST, DIRECTION_SOUTH, DIRECTION_WEST,
+		DIRECTION_NORTHWEST, DIRECTION_NORTHEAST, DIRECTION_SOUTHWEST, DIRECTION_SOUTHEAST
+	};
+
+	Direction bestDirection = DIRECTION_NONE;
+	for (Direction direction : directions) {
+		Position nextPos = getNextPosition(direction, creaturePos);
+		uint16_t nextDistance = field.getDistance(nextPos);
+		if (nextDistance >= distance || !g_game.map.canWalkTo(*this, nextPos)) {
+			continue;
+		}
+
+		distance = nextDistance;
+		bestDirection = direction;
+	}
+
+	if (bestDirection == DIRECTION_NONE) {
+		return false;
+	}
+
+	dirList.push_back(bestDirection);
+	return true;
+}
+
 bool Monster::getDistanceStep(const Position& targetPos, Direction& direction, bool flee /* = false */)
 {
 	const Position& creaturePos = getPosition();
@@ -2037,20 +2104,18 @@ void Monster::updateLookDirection()
 	g_game.internalCreatureTurn(this, newDir);
 }
 
-struct RarityAttributes {
-	int numAbsorbs;
-	int numSkills;
-	int numSpecials;
-	int numElements;
-};
-
 void Monster::dropLoot(Container* corpse, Creature* mostDamageCreature)
 {
 	if (!corpse || !lootDrop) {
 		return;
 	}
 
-	g_events->eventMonsterOnDropLoot(this, corpse);
+	if (g_events->getScriptId(EventInfoId::MONSTER_ONDROPLOOT) != -1) {
+		g_events->eventMonsterOnDropLoot(this, corpse);
+	} else {
+		mType->createLoot(corpse);
+	}
+
 	Player* mostDamagePlayer = nullptr;
 	if (mostDamageCreature) {
 		mostDamagePlayer = mostDamageCreature->getPlayer();
@@ -2059,68 +2124,10 @@ void Monster::dropLoot(Container* corpse, Creature* mostDamageCreature)
 		return;
 	}
 	
-	struct Rarity {
-        int value;
-        double chance;
-        int minLevel;
-        int maxLevel;
-        int minBonus;
-        int maxBonus;
-    };
-
-    std::vector<Rarity> rarities = {
-        {1,   15.0,   1,   10,   1,   1},
-        {2,   14.0,  11,   20,   1,   2},
-        {3,   13.0,  21,   30,   1,   2},
-        {4,   12.0,  31,   40,   1,   3},
-        {5,   10.0,  41,   50,   1,   3},
-        {6,    8.0,  51,   60,   2,   4},
-        {7,    7.0,  61,   70,   2,   5},
-        {8,    6.0,  71,   80,   3,   6},
-        {9,    5.0,  81,   90,   3,   7},
-        {10,   4.5,  91,  100,   4,   8},
-        {11,   3.3, 101,  110,   4,   9},
-        {12,   2.2, 111,  120,   5,  10},
-        {13,   1.8, 121,  130,   6,  10},
-        {14,   1.3, 131,  140,   7,  12},
-        {15,   1.0, 141,  150,   9,  15}
-    };
-
-	std::vector<RarityAttributes> rarityAttributes = {
-    	{1, 1, 0, 0}, // Rarity 1
-    	{1, 1, 0, 1}, // Rarity 2
-    	{1, 1, 0, 1}, // Rarity 3
-    	{1, 1, 1, 1}, // Rarity 4
-    	{1, 1, 1, 1}, // Rarity 5
-    	{1, 2, 1, 1}, // Rarity 6
-    	{1, 2, 1, 1}, // Rarity 7
-    	{1, 2, 2, 1}, // Rarity 8
-    	{2, 2, 2, 1}, // Rarity 9
-    	{2, 2, 2, 1}, // Rarity 10
-    	{2, 2, 2, 1}, // Rarity 11
-    	{2, 2, 2, 1}, // Rarity 12
-    	{2, 2, 2, 1}, // Rarity 13
-    	{3, 3, 2, 1}, // Rarity 14
-    	{3, 3, 2, 1}  // Rarity 15
-	};
-
-    std::vector<std::pair<int, int>> absorptionBonuses = {
-        {1, 1}, {1, 1}, {1, 1}, {1, 2}, {1, 2},
-        {1, 3}, {1, 3}, {1, 4}, {1, 4}, {2, 5},
-        {2, 5}, {2, 5}, {3, 6}, {4, 6}, {5, 6}
-    };
-
-    std::vector<std::pair<int, int>> elementBonuses = {
-        {1, 3}, {3, 6}, {4, 8}, {5, 10}, {6, 12},
-        {7, 14}, {8, 16}, {9, 18}, {10, 20}, {12, 22},
-        {14, 24}, {16, 26}, {18, 28}, {20, 30}, {25, 40}
-    };
-
     std::vector<Item*> items;
-    std::list<Container*> containers = { corpse };
-    while (!containers.empty()) {
-        Container* container = containers.front();
-        containers.pop_front();
+    std::vector<Container*> containers = { corpse };
+    for (size_t index = 0; index < containers.size(); ++index) {
+        Container* container = containers[index];
         for (Item* i : container->getItemList()) {
             if (Container* sub = i->getContainer()) {
                 containers.push_back(sub);
@@ -2131,7 +2138,7 @@ void Monster::dropLoot(Container* corpse, Creature* mostDamageCreature)
     }
 
     for (Item* item : items) {
-        const auto rarityAttr = item->getCustomAttribute("rarity");
+        const auto rarityAttr = item->getCustomAttribute(CustomAttributeKeys::RARITY);
         if (!rarityAttr) {
             continue;
         }
@@ -2145,240 +2152,7 @@ void Monster::dropLoot(Container* corpse, Creature* mostDamageCreature)
             continue;
         }
 
-        const ItemType& it = Item::items[item->getID()];
-
-		const uint32_t VALID_EQUIP_SLOTS =
-			SLOTP_HEAD |
-			SLOTP_NECKLACE |
-			SLOTP_ARMOR |
-			SLOTP_RIGHT |
-			SLOTP_LEFT |
-			SLOTP_LEGS |
-			SLOTP_FEET |
-			SLOTP_RING |
-			SLOTP_DECKBAD |
-			SLOTP_BELT |
-			SLOTP_GLOVES;
-
-		if ((it.slotPosition & VALID_EQUIP_SLOTS) == 0) {
-			continue;
-		}
-
-        bool isWeapon = (it.weaponType != WEAPON_NONE);
-
-        int finalLevel = 0, minBonus = 0, maxBonus = 0;
-        for (const Rarity& r : rarities) {
-            if (r.value == rarityId) {
-                finalLevel = uniform_random(r.minLevel, r.maxLevel);
-                minBonus = r.minBonus;
-                maxBonus = r.maxBonus;
-                break;
-            }
-        }
-        int bonusRange = maxBonus - minBonus + 1;
-        int finalBonus = minBonus + (finalLevel * bonusRange / 100);
-
-        if (it.attack > 0) {
-            int64_t newAttack = it.attack + finalBonus;
-            item->setIntAttr(ITEM_ATTRIBUTE_ATTACK, newAttack);
-        }
-        if (it.defense > 0) {
-            int64_t newDefense = it.defense + finalBonus;
-            item->setIntAttr(ITEM_ATTRIBUTE_DEFENSE, newDefense);
-        }
-        if (it.armor > 0) {
-            int64_t newArmor = it.armor + finalBonus;
-            item->setIntAttr(ITEM_ATTRIBUTE_ARMOR, newArmor);
-        }
-        if (it.hitChance > 0) {
-            int64_t newHitChance = it.hitChance + finalBonus;
-            item->setIntAttr(ITEM_ATTRIBUTE_HITCHANCE, newHitChance);
-        }
-
-        std::string levelKey = "combatPowerLevel";
-        item->setCustomAttribute(levelKey, static_cast<int64_t>(finalLevel));
-
-        RarityAttributes attrCounts = rarityAttributes[rarityId - 1];
-
-        std::vector<std::tuple<CombatType_t, std::string, std::string>> absorptionTypes = {
-            {COMBAT_PHYSICALDAMAGE, "rarity_physicalAbsorb", "Physical"},
-            {COMBAT_ENERGYDAMAGE, "rarity_energyAbsorb", "Energy"},
-            {COMBAT_EARTHDAMAGE, "rarity_earthAbsorb", "Earth"},
-            {COMBAT_FIREDAMAGE, "rarity_fireAbsorb", "Fire"},
-            {COMBAT_DROWNDAMAGE, "rarity_drownAbsorb", "Drown"},
-            {COMBAT_ICEDAMAGE, "rarity_iceAbsorb", "Ice"},
-            {COMBAT_HOLYDAMAGE, "rarity_holyAbsorb", "Holy"},
-            {COMBAT_DEATHDAMAGE, "rarity_deathAbsorb", "Death"},
-            {COMBAT_WATERDAMAGE, "rarity_waterAbsorb", "Water"},
-            {COMBAT_ARCANEDAMAGE, "rarity_arcaneAbsorb", "Arcane"}
-        };
-
-        std::vector<std::tuple<int, std::string, std::string>> skillTypes = {
-            {SKILL_FIST, "rarity_fistSkill", "Fist"},
-            {SKILL_CLUB, "rarity_clubSkill", "Club"},
-            {SKILL_SWORD, "rarity_swordSkill", "Sword"},
-            {SKILL_AXE, "rarity_axeSkill", "Axe"},
-            {SKILL_DISTANCE, "rarity_distanceSkill", "Distance"},
-            {SKILL_SHIELD, "rarity_shieldSkill", "Shielding"},
-            {SKILL_FISHING, "rarity_fishingSkill", "Fishing"},
-            {SKILL_CRAFTING, "rarity_craftingSkill", "Crafting"},
-            {SKILL_WOODCUTTING, "rarity_woodcuttingSkill", "Woodcutting"},
-            {SKILL_MINING, "rarity_miningSkill", "Mining"},
-            {SKILL_HERBALIST, "rarity_herbalistSkill", "Herbalism"},
-            {SKILL_ARMORSMITH, "rarity_armorsmithSkill", "Armorsmithing"},
-            {SKILL_WEAPONSMITH, "rarity_weaponsmithSkill", "Weaponsmithing"},
-            {SKILL_JEWELSMITH, "rarity_jewelsmithSkill", "Jewelsmithing"},
-            {SKILL_MAGLEVEL, "rarity_maglevelSkill", "Magic"}
-        };
-
-        std::vector<std::tuple<int, std::string, std::string>> specialSkillTypes = {
-            {SPECIALSKILL_CRITICALHITCHANCE, "rarity_criticalHitChance", "Critical Chance"},
-            {SPECIALSKILL_CRITICALHITAMOUNT, "rarity_criticalHitAmount", "Critical Hit"},
-            {SPECIALSKILL_MANALEECHCHANCE, "rarity_manaLeechChance", "Mana Chance"},
-            {SPECIALSKILL_MANALEECHAMOUNT, "rarity_manaLeechAmount", "Mana Amount"},
-            {SPECIALSKILL_LIFELEECHCHANCE, "rarity_lifeLeechChance", "Life Chance"},
-            {SPECIALSKILL_LIFELEECHAMOUNT, "rarity_lifeLeechAmount", "Life Amount"}
-        };
-
-        std::vector<std::tuple<CombatType_t, std::string, std::string>> elementTypes = {
-            {COMBAT_FIREDAMAGE,  "rarity_elementfire",  "Fire"},
-            {COMBAT_ICEDAMAGE,   "rarity_elementice",   "Ice"},
-            {COMBAT_ENERGYDAMAGE,"rarity_elementenergy", "Energy"},
-            {COMBAT_DEATHDAMAGE, "rarity_elementdeath", "Death"},
-            {COMBAT_EARTHDAMAGE, "rarity_elementearth", "Earth"},
-            {COMBAT_WATERDAMAGE, "rarity_elementwater", "Water"},
-            {COMBAT_ARCANEDAMAGE,"rarity_elementarcane", "Arcane"},
-            {COMBAT_HOLYDAMAGE,  "rarity_elementholy",  "Holy"}
-        };
-
-        std::string absorptionDesc;
-        if (attrCounts.numAbsorbs > 0) {
-            std::mt19937 absorbs(std::random_device{}());
-            std::shuffle(absorptionTypes.begin(), absorptionTypes.end(), absorbs);
-            for (int i = 0; i < attrCounts.numAbsorbs && i < (int)absorptionTypes.size(); ++i) {
-                auto [ctype, key, name] = absorptionTypes[i];
-                const auto& range = absorptionBonuses[rarityId - 1];
-                int bonus = uniform_random(range.first, range.second);
-                std::string attrKey = key;
-                item->setCustomAttribute(attrKey, static_cast<int64_t>(bonus));
-                absorptionDesc += (absorptionDesc.empty() ? "" : ", ") + name + " +" + std::to_string(bonus) + "%";
-            }
-        }
-
-        std::string skillsDesc;
-        if (attrCounts.numSkills > 0) {
-            std::mt19937 skills(std::random_device{}());
-            std::shuffle(skillTypes.begin(), skillTypes.end(), skills);
-            for (int i = 0; i < attrCounts.numSkills && i < (int)skillTypes.size(); ++i) {
-                auto [skillId, key, name] = skillTypes[i];
-                const auto& range = absorptionBonuses[rarityId - 1];
-                int bonus = uniform_random(range.first, range.second);
-                std::string attrKey = key;
-                item->setCustomAttribute(attrKey, static_cast<int64_t>(bonus));
-                skillsDesc += (skillsDesc.empty() ? "" : ", ") + name + " +" + std::to_string(bonus);
-            }
-        }
-
-        std::string specialsDesc;
-		bool criticalApplied = false;
-		bool manaApplied = false;
-		bool lifeApplied = false;
-		
-		std::mt19937 specialSkills(std::random_device{}());
-		std::uniform_int_distribution<int> dist(1, 3);
-		int randomPick = dist(specialSkills);
-		
-		switch (randomPick) {
-			case 1: {
-				if (!criticalApplied) {
-					const auto& range = absorptionBonuses[rarityId - 1];
-					int bonus = uniform_random(range.first, range.second);
-					std::string keyChance = "rarity_criticalHitChance";
-					std::string keyAmount = "rarity_criticalHitAmount";
-		
-					item->setCustomAttribute(keyChance, static_cast<int64_t>(bonus));
-					item->setCustomAttribute(keyAmount, static_cast<int64_t>(bonus));
-		
-					specialsDesc += (specialsDesc.empty() ? "" : ", ")
-								  + std::string("Critical Chance +") + std::to_string(bonus) + "%";
-					specialsDesc += ", Critical Hit +" + std::to_string(bonus) + "%";
-		
-					criticalApplied = true;
-				}
-				break;
-			}
-			case 2: {
-				if (!manaApplied) {
-					const auto& range = absorptionBonuses[rarityId - 1];
-					int bonus = uniform_random(range.first, range.second);
-					std::string keyChance = "rarity_manaLeechChance";
-					std::string keyAmount = "rarity_manaLeechAmount";
-		
-					item->setCustomAttribute(keyChance, static_cast<int64_t>(bonus));
-					item->setCustomAttribute(keyAmount, static_cast<int64_t>(bonus));
-		
-					specialsDesc += (specialsDesc.empty() ? "" : ", ")
-								  + std::string("Mana Chance +") + std::to_string(bonus) + "%";
-					specialsDesc += ", Mana Amount +" + std::to_string(bonus) + "%";
-		
-					manaApplied = true;
-				}
-				break;
-			}
-			case 3: {
-				if (!lifeApplied) {
-					const auto& range = absorptionBonuses[rarityId - 1];
-					int bonus = uniform_random(range.first, range.second);
-					std::string keyChance = "rarity_lifeLeechChance";
-					std::string keyAmount = "rarity_lifeLeechAmount";
-		
-					item->setCustomAttribute(keyChance, static_cast<int64_t>(bonus));
-					item->setCustomAttribute(keyAmount, static_cast<int64_t>(bonus));
-		
-					specialsDesc += (specialsDesc.empty() ? "" : ", ")
-								  + std::string("Life Chance +") + std::to_string(bonus) + "%";
-					specialsDesc += ", Life Amount +" + std::to_string(bonus) + "%";
-		
-					lifeApplied = true;
-				}
-				break;
-			}
-		}
-
-        std::string elementDesc;
-		if (isWeapon && it.attack > 0 && attrCounts.numElements > 0) {
-    		if (!it.abilities || it.abilities->elementDamage <= 0) {
-        		std::mt19937 elementDescription(std::random_device{}());
-        		std::shuffle(elementTypes.begin(), elementTypes.end(), elementDescription);
-        		for (int i = 0; i < attrCounts.numElements && i < (int)elementTypes.size(); ++i) {
-            		auto [ctype, key, name] = elementTypes[i];
-            		const auto& range = elementBonuses[rarityId - 1];
-            		int bonus = uniform_random(range.first, range.second);
-            		std::string attrKey = key;
-            		item->setCustomAttribute(attrKey, static_cast<int64_t>(bonus));
-            		elementDesc += (elementDesc.empty() ? "" : ", ") + name + " +" + std::to_string(bonus) + "% dmg";
-        		}
-    		}
-		}
-
-        std::string description = item->getStrAttr(ITEM_ATTRIBUTE_DESCRIPTION);
-        if (!description.empty()) {
-            description += ", ";
-        }
-        description += "Level: " + std::to_string(finalLevel);
-        if (!absorptionDesc.empty()) {
-            description += ", " + absorptionDesc;
-        }
-        if (!skillsDesc.empty()) {
-            description += ", " + skillsDesc;
-        }
-        if (!specialsDesc.empty()) {
-            description += ", " + specialsDesc;
-        }
-        if (!elementDesc.empty()) {
-            description += ", Element: " + elementDesc;
-        }
-        item->setStrAttr(ITEM_ATTRIBUTE_DESCRIPTION, description);
+        applyRarityBonuses(item, rarityId, RARITY_SPECIALS_RANDOM);
     }
 }
 
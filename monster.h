@@ -12,7 +12,7 @@ class Game;
 class Spawn;
 
 using CreatureHashSet = std::unordered_set<Creature*>;
-using CreatureList = std::list<Creature*>;
+using CreatureList = std::vector<Creature*>;
 
 enum TargetSearchType_t {
 	TARGETSEARCH_DEFAULT,
@@ -25,12 +25,17 @@ class Monster final : public Creature
 {
 	public:
 		static Monster* createMonster(const std::string& name);
+		static Monster* createMonster(uint32_t monsterTypeId);
 		static int32_t despawnRange;
 		static int32_t despawnRadius;
 
 		explicit Monster(MonsterType* mType);
 		~Monster();
 
+		// monsters are recycled through a lock-free free list
+		static void* operator new(size_t size);
+		static void operator delete(void* p, size_t size);
+
 		// non-copyable
 		Monster(const Monster&) = delete;
 		Monster& operator=(const Monster&) = delete;
@@ -44,10 +49,12 @@ class Monster final : public Creature
 
 		void setID() override {
 			if (id == 0) {
-				id = monsterAutoID++;
+				id = ids.reserve();
 			}
 		}
 
+		static CreatureIdTable<Monster> ids;
+
 		void addList() override;
 		void removeList() override;
 
@@ -67,6 +74,10 @@ class Monster final : public Creature
 			return CREATURETYPE_MONSTER;
 		}
 
+		const MonsterType* getMonsterType() const {
+			return mType;
+		}
+
 		const Position& getMasterPos() const {
 			return masterPos;
 		}
@@ -117,6 +128,8 @@ class Monster final : public Creature
 		void onRemoveCreature(Creature* creature, bool isLogout) override;
 		void onCreatureMove(Creature* creature, const Tile* newTile, const Position& newPos, const Tile* oldTile, const Position& oldPos, bool teleport) override;
 		void onCreatureSay(Creature* creature, SpeakClasses type, const std::string& text) override;
+		// what the events of the type want to hear about, see Map::setInterests
+		uint8_t getTypeInterests() const;
 
 		void drainHealth(Creature* attacker, int32_t damage) override;
 		void changeHealth(int32_t healthChange, bool sendHealthChange = true) override;
@@ -131,6 +144,7 @@ class Monster final : public Creature
 		void onFollowCreatureComplete(const Creature* creature) override;
 
 		void onThink(uint32_t interval) override;
+		uint32_t getThinkRate() const override;
 
 		bool challengeCreature(Creature* creature, bool force = false) override;
 
@@ -168,6 +182,14 @@ class Monster final : public Creature
 		}
 		
 		bool getDistanceStep(const Position& targetPos, Direction& direction, bool flee = false);
+		bool getFlowFieldPath(const Creature* target, std::vector<Direction>& dirList) const;
+
+		bool isFlowFieldPathing() const {
+			return flowFieldPathing;
+		}
+		void setFlowFieldPathing(bool flowFieldPathing) {
+			this->flowFieldPathing = flowFieldPathing;
+		}
 		bool isTargetNearby() const {
 			return stepDuration >= 1;
 		}
@@ -178,8 +200,6 @@ class Monster final : public Creature
 		BlockType_t blockHit(Creature* attacker, CombatType_t combatType, int32_t& damage,
 		                     bool checkDefense = false, bool checkArmor = false, bool field = false, bool ignoreResistances = false) override;
 
-		static uint32_t monsterAutoID;
-
 	private:
 		CreatureHashSet friendList;
 		CreatureList targetList;
@@ -210,6 +230,7 @@ class Monster final : public Creature
 		bool isMasterInRange = false;
 		bool randomStepping = false;
 		bool walkingToSpawn = false;
+		bool flowFieldPathing = false;
 
 		void onCreatureEnter(Creature* creature);
 		void onCreatureLeave(Creature* creature);
@@ -10,6 +10,7 @@
 #include "weapons.h"
 #include "configmanager.h"
 #include "game.h"
+#include "workerpool.h"
 
 #include "pugicast.h"
 
@@ -38,32 +39,239 @@ void MonsterType::loadLoot(MonsterType* monsterType, LootBlock lootBlock)
 	} else {
 		monsterType->info.lootItems.push_back(lootBlock);
 	}
+	monsterType->compileLoot();
+}
+
+// rows of an area node, one line each with the cells separated by blanks,
+// 1 hits, 2 is the center and 3 is both
+static bool parseAreaRows(const std::string& text, std::vector<uint32_t>& vec, uint32_t& rows)
+{
+	std::istringstream lines(text);
+	std::string line;
+	size_t cols = 0;
+	rows = 0;
+	while (std::getline(lines, line)) {
+		std::istringstream cells(line);
+		size_t count = 0;
+		uint32_t value;
+		while (cells >> value) {
+			vec.push_back(value);
+			++count;
+		}
+
+		if (!cells.eof()) {
+			return false;
+		}
+
+		if (count == 0) {
+			continue;
+		}
+
+		if (rows == 0) {
+			cols = count;
+		} else if (count != cols) {
+			return false;
+		}
+		++rows;
+	}
+	return rows != 0;
+}
+
+static void compileLootBlocks(const std::vector<LootBlock>& lootBlocks, std::vector<CompiledLoot>& compiledLoot)
+{
+	for (const LootBlock& lootBlock : lootBlocks) {
+		const ItemType& it = Item::items[lootBlock.id];
+
+		size_t index = compiledLoot.size();
+		compiledLoot.emplace_back();
+
+		CompiledLoot& loot = compiledLoot.back();
+		loot.text = lootBlock.text;
+		loot.chance = lootBlock.chance;
+		loot.countmax = std::max<uint32_t>(1, lootBlock.countmax);
+		loot.subType = lootBlock.subType;
+		loot.actionId = lootBlock.actionId;
+		loot.id = lootBlock.id;
+		loot.stackable = it.stackable;
+		loot.container = it.isContainer();
+
+		if (loot.container) {
+			compileLootBlocks(lootBlock.childLoot, compiledLoot);
+		}
+		compiledLoot[index].descendants = static_cast<uint16_t>(compiledLoot.size() - index - 1);
+	}
+}
+
+void MonsterType::compileLoot()
+{
+	info.compiledLoot.clear();
+	compileLootBlocks(info.lootItems, info.compiledLoot);
+	info.compiledLoot.shrink_to_fit();
+}
+
+void MonsterType::createLoot(Container* corpse) const
+{
+	const uint64_t rate = g_config.getNumber(ConfigManager::RATE_LOOT);
+	if (!corpse || rate == 0) {
+		return;
+	}
+
+	// containers are filled before they are added to their parent, so the
+	// client only ever sees the finished top level items of the corpse
+	struct OpenContainer {
+		Container* container;
+		size_t end;
+	};
+	std::vector<OpenContainer> openContainers;
+
+	auto closeContainer = [corpse, &openContainers]() {
+		Container* container = openContainers.back().container;
+		openContainers.pop_back();
+		if (openContainers.empty()) {
+			if (g_game.internalAddItem(corpse, container, INDEX_WHEREEVER, FLAG_NOLIMIT) != RETURNVALUE_NOERROR) {
+				delete container;
+			}
+		} else {
+			openContainers.back().container->addItemBack(container);
+		}
+	};
+
+	const std::vector<CompiledLoot>& compiledLoot = info.compiledLoot;
+	for (size_t i = 0, size = compiledLoot.size(); i < size; ++i) {
+		while (!openContainers.empty() && openContainers.back().end <= i) {
+			closeContainer();
+		}
+
+		const CompiledLoot& loot = compiledLoot[i];
+		Container* parent = openContainers.empty() ? nullptr : openContainers.back().container;
+
+		uint32_t roll = 0;
+		if (loot.chance * rate <= MAX_LOOTCHANCE || loot.stackable) {
+			roll = uniform_random(0, MAX_LOOTCHANCE);
+			if (roll >= loot.chance * rate || (parent && parent->size() >= parent->capacity())) {
+				i += loot.descendants;
+				continue;
+			}
+		}
+
+		uint16_t count = 1;
+		if (loot.stackable) {
+			count = static_cast<uint16_t>(std::min<uint32_t>((roll / rate) % loot.countmax + 1, 100));
+		} else if (loot.subType != -1) {
+			count = static_cast<uint16_t>(loot.subType);
+		} else if (Item::items[loot.id].isFluidContainer()) {
+			count = 0;
+		}
+
+		Item* item = Item::CreateItem(loot.id, count);
+		if (!item) {
+			i += loot.descendants;
+			continue;
+		}
+
+		if (loot.actionId != -1) {
+			item->setActionId(loot.actionId);
+		}
+
+		if (!loot.text.empty()) {
+			item->setText(loot.text);
+		}
+
+		if (loot.container && loot.descendants != 0) {
+			Container* container = item->getContainer();
+			if (container) {
+				openContainers.push_back({container, i + loot.descendants + 1});
+				continue;
+			}
+		}
+
+		if (parent) {
+			parent->addItemBack(item);
+		} else if (g_game.internalAddItem(corpse, item, INDEX_WHEREEVER, FLAG_NOLIMIT) != RETURNVALUE_NOERROR) {
+			delete item;
+		}
+	}
+
+	while (!openContainers.empty()) {
+		closeContainer();
+	}
 }
 
 bool Monsters::loadFromXml(bool reloading /*= false*/)
 {
-	unloadedMonsters = {};
+	std::set<std::string> names;
+	if (reloading) {
+		names = getReloadNames();
+	}
+
+	auto files = readFiles(names, g_config.getBoolean(ConfigManager::FORCE_MONSTERTYPE_LOAD));
+	return applyFiles(*files, reloading);
+}
+
+std::set<std::string> Monsters::getReloadNames() const
+{
+	std::set<std::string> names;
+	for (const auto& it : monsters) {
+		names.insert(it.first);
+	}
+	return names;
+}
+
+std::unique_ptr<MonsterFiles> Monsters::readFiles(const std::set<std::string>& names, bool forceLoad)
+{
+	auto files = std::make_unique<MonsterFiles>();
+
 	pugi::xml_document doc;
 	pugi::xml_parse_result result = doc.load_file("data/monster/monsters.xml");
 	if (!result) {
 		printXMLError("Error - Monsters::loadFromXml", "data/monster/monsters.xml", result);
-		return false;
+		return files;
 	}
 
-	loaded = true;
+	files->loaded = true;
 
 	for (auto monsterNode : doc.child("monsters").children()) {
 		std::string name = asLowerCaseString(monsterNode.attribute("name").as_string());
 		std::string file = "data/monster/" + std::string(monsterNode.attribute("file").as_string());
-		unloadedMonsters.emplace(name, file);
+		files->index.emplace(name, file);
 	}
 
-	bool forceLoad = g_config.getBoolean(ConfigManager::FORCE_MONSTERTYPE_LOAD);
+	for (const auto& it : files->index) {
+		if (forceLoad || names.find(it.first) != names.end()) {
+			files->pending.push_back(it);
+		}
+	}
 
-	for (auto it : unloadedMonsters) {
-		if ((forceLoad || reloading) && monsters.find(it.first) != monsters.end()) {
-			loadMonster(it.second, it.first, reloading);
+	// the files are read and parsed in parallel, building the types touches lua and stays serial
+	files->docs.resize(files->pending.size());
+	files->results.resize(files->pending.size());
+	WorkerPool::parallelForStartup(files->pending.size(), [&](size_t i) {
+		files->results[i] = files->docs[i].load_file(files->pending[i].second.c_str());
+	});
+	return files;
+}
+
+bool Monsters::applyFiles(MonsterFiles& files, bool reloading)
+{
+	if (!files.loaded) {
+		return false;
+	}
+
+	if (reloading) {
+		scriptInterface.reset();
+	}
+
+	loaded = true;
+	unloadedMonsters = std::move(files.index);
+
+	for (size_t i = 0; i < files.pending.size(); ++i) {
+		const auto& pending = files.pending[i];
+		if (!files.results[i]) {
+			printXMLError("Error - Monsters::loadMonster", pending.second, files.results[i]);
+			continue;
 		}
+		loadMonster(files.docs[i], pending.second, pending.first, reloading);
+		files.docs[i].reset();
 	}
 
 	return true;
@@ -71,10 +279,6 @@ bool Monsters::loadFromXml(bool reloading /*= false*/)
 
 bool Monsters::reload()
 {
-	loaded = false;
-
-	scriptInterface.reset();
-
 	return loadFromXml(true);
 }
 
@@ -207,6 +411,27 @@ bool Monsters::deserializeSpell(const pugi::xml_node& node, spellBlock_t& sb, co
 			combat->setArea(area);
 		}
 
+		if (pugi::xml_node areaNode = node.child("area")) {
+			std::vector<uint32_t> vec;
+			uint32_t rows;
+			if (!parseAreaRows(areaNode.child_value(), vec, rows)) {
+				std::cout << "[Error - Monsters::deserializeSpell] - " << description << " - Malformed area for spell: " << name << std::endl;
+				return false;
+			}
+
+			AreaCombat* area = new AreaCombat();
+			area->setupArea(vec, rows);
+			combat->setArea(area);
+
+			if ((attr = node.attribute("target"))) {
+				needTarget = attr.as_bool();
+			}
+
+			if ((attr = node.attribute("direction"))) {
+				needDirection = attr.as_bool();
+			}
+		}
+
 		std::string tmpName = asLowerCaseString(name);
 
 		if (tmpName == "melee") {
@@ -608,6 +833,12 @@ bool Monsters::deserializeSpell(MonsterSpell* spell, spellBlock_t& sb, const std
 			combat->setArea(area);
 		}
 
+		if (spell->areaRows != 0) {
+			AreaCombat* area = new AreaCombat();
+			area->setupArea(spell->area, spell->areaRows);
+			combat->setArea(area);
+		}
+
 		std::string tmpName = asLowerCaseString(spell->name);
 
 		if (tmpName == "melee") {
@@ -789,14 +1020,18 @@ bool Monsters::deserializeSpell(MonsterSpell* spell, spellBlock_t& sb, const std
 
 MonsterType* Monsters::loadMonster(const std::string& file, const std::string& monsterName, bool reloading /*= false*/)
 {
-	MonsterType* mType = nullptr;
-
 	pugi::xml_document doc;
 	pugi::xml_parse_result result = doc.load_file(file.c_str());
 	if (!result) {
 		printXMLError("Error - Monsters::loadMonster", file, result);
 		return nullptr;
 	}
+	return loadMonster(doc, file, monsterName, reloading);
+}
+
+MonsterType* Monsters::loadMonster(const pugi::xml_document& doc, const std::string& file, const std::string& monsterName, bool reloading)
+{
+	MonsterType* mType = nullptr;
 
 	pugi::xml_node monsterNode = doc.child("monster");
 	if (!monsterNode) {
@@ -819,7 +1054,7 @@ MonsterType* Monsters::loadMonster(const std::string& file, const std::string& m
 	}
 
 	if (!mType) {
-		mType = &monsters[asLowerCaseString(monsterName)];
+		mType = addMonsterType(monsterName);
 	}
 
 	mType->name = attr.as_string();
@@ -1270,62 +1505,62 @@ MonsterType* Monsters::loadMonster(const std::string& file, const std::string& m
 	if ((node = monsterNode.child("elements"))) {
 		for (auto elementNode : node.children()) {
 			if ((attr = elementNode.attribute("physicalPercent"))) {
-				mType->info.elementMap[COMBAT_PHYSICALDAMAGE] = pugi::cast<int32_t>(attr.value());
+				mType->info.elements[combatTypeToIndex(COMBAT_PHYSICALDAMAGE)] = pugi::cast<int32_t>(attr.value());
 				if (mType->info.damageImmunities & COMBAT_PHYSICALDAMAGE) {
 					std::cout << "[Warning - Monsters::loadMonster] Same element \"physical\" on immunity and element tags. " << file << std::endl;
 				}
 			} else if ((attr = elementNode.attribute("icePercent"))) {
-				mType->info.elementMap[COMBAT_ICEDAMAGE] = pugi::cast<int32_t>(attr.value());
+				mType->info.elements[combatTypeToIndex(COMBAT_ICEDAMAGE)] = pugi::cast<int32_t>(attr.value());
 				if (mType->info.damageImmunities & COMBAT_ICEDAMAGE) {
 					std::cout << "[Warning - Monsters::loadMonster] Same element \"ice\" on immunity and element tags. " << file << std::endl;
 				}
 			} else if ((attr = elementNode.attribute("poisonPercent")) || (attr = elementNode.attribute("earthPercent"))) {
-				mType->info.elementMap[COMBAT_EARTHDAMAGE] = pugi::cast<int32_t>(attr.value());
+				mType->info.elements[combatTypeToIndex(COMBAT_EARTHDAMAGE)] = pugi::cast<int32_t>(attr.value());
 				if (mType->info.damageImmunities & COMBAT_EARTHDAMAGE) {
 					std::cout << "[Warning - Monsters::loadMonster] Same element \"earth\" on immunity and element tags. " << file << std::endl;
 				}
 			} else if ((attr = elementNode.attribute("firePercent"))) {
-				mType->info.elementMap[COMBAT_FIREDAMAGE] = pugi::cast<int32_t>(attr.value());
+				mType->info.elements[combatTypeToIndex(COMBAT_FIREDAMAGE)] = pugi::cast<int32_t>(attr.value());
 				if (mType->info.damageImmunities & COMBAT_FIREDAMAGE) {
 					std::cout << "[Warning - Monsters::loadMonster] Same element \"fire\" on immunity and element tags. " << file << std::endl;
 				}
 			} else if ((attr = elementNode.attribute("energyPercent"))) {
-				mType->info.elementMap[COMBAT_ENERGYDAMAGE] = pugi::cast<int32_t>(attr.value());
+				mType->info.elements[combatTypeToIndex(COMBAT_ENERGYDAMAGE)] = pugi::cast<int32_t>(attr.value());
 				if (mType->info.damageImmunities & COMBAT_ENERGYDAMAGE) {
 					std::cout << "[Warning - Monsters::loadMonster] Same element \"energy\" on immunity and element tags. " << file << std::endl;
 				}
 			} else if ((attr = elementNode.attribute("holyPercent"))) {
-				mType->info.elementMap[COMBAT_HOLYDAMAGE] = pugi::cast<int32_t>(attr.value());
+				mType->info.elements[combatTypeToIndex(COMBAT_HOLYDAMAGE)] = pugi::cast<int32_t>(attr.value());
 				if (mType->info.damageImmunities & COMBAT_HOLYDAMAGE) {
 					std::cout << "[Warning - Monsters::loadMonster] Same element \"holy\" on immunity and element tags. " << file << std::endl;
 				}
 			} else if ((attr = elementNode.attribute("deathPercent"))) {
-				mType->info.elementMap[COMBAT_DEATHDAMAGE] = pugi::cast<int32_t>(attr.value());
+				mType->info.elements[combatTypeToIndex(COMBAT_DEATHDAMAGE)] = pugi::cast<int32_t>(attr.value());
 				if (mType->info.damageImmunities & COMBAT_DEATHDAMAGE) {
 					std::cout << "[Warning - Monsters::loadMonster] Same element \"death\" on immunity and element tags. " << file << std::endl;
 				}
 			} else if ((attr = elementNode.attribute("waterPercent"))) {
-				mType->info.elementMap[COMBAT_WATERDAMAGE] = pugi::cast<int32_t>(attr.value());
+				mType->info.elements[combatTypeToIndex(COMBAT_WATERDAMAGE)] = pugi::cast<int32_t>(attr.value());
 				if (mType->info.damageImmunities & COMBAT_WATERDAMAGE) {
 					std::cout << "[Warning - Monsters::loadMonster] Same element \"water\" on immunity and element tags. " << file << std::endl;
 				}
 			} else if ((attr = elementNode.attribute("arcanePercent"))) {
-				mType->info.elementMap[COMBAT_ARCANEDAMAGE] = pugi::cast<int32_t>(attr.value());
+				mType->info.elements[combatTypeToIndex(COMBAT_ARCANEDAMAGE)] = pugi::cast<int32_t>(attr.value());
 				if (mType->info.damageImmunities & COMBAT_ARCANEDAMAGE) {
 					std::cout << "[Warning - Monsters::loadMonster] Same element \"arcane\" on immunity and element tags. " << file << std::endl;
 				}
 			} else if ((attr = elementNode.attribute("drownPercent"))) {
-				mType->info.elementMap[COMBAT_DROWNDAMAGE] = pugi::cast<int32_t>(attr.value());
+				mType->info.elements[combatTypeToIndex(COMBAT_DROWNDAMAGE)] = pugi::cast<int32_t>(attr.value());
 				if (mType->info.damageImmunities & COMBAT_DROWNDAMAGE) {
 					std::cout << "[Warning - Monsters::loadMonster] Same element \"drown\" on immunity and element tags. " << file << std::endl;
 				}
 			} else if ((attr = elementNode.attribute("lifedrainPercent"))) {
-				mType->info.elementMap[COMBAT_LIFEDRAIN] = pugi::cast<int32_t>(attr.value());
+				mType->info.elements[combatTypeToIndex(COMBAT_LIFEDRAIN)] = pugi::cast<int32_t>(attr.value());
 				if (mType->info.damageImmunities & COMBAT_LIFEDRAIN) {
 					std::cout << "[Warning - Monsters::loadMonster] Same element \"lifedrain\" on immunity and element tags. " << file << std::endl;
 				}
 			} else if ((attr = elementNode.attribute("manadrainPercent"))) {
-				mType->info.elementMap[COMBAT_MANADRAIN] = pugi::cast<int32_t>(attr.value());
+				mType->info.elements[combatTypeToIndex(COMBAT_MANADRAIN)] = pugi::cast<int32_t>(attr.value());
 				if (mType->info.damageImmunities & COMBAT_MANADRAIN) {
 					std::cout << "[Warning - Monsters::loadMonster] Same element \"manadrain\" on immunity and element tags. " << file << std::endl;
 				}
@@ -1394,6 +1629,7 @@ MonsterType* Monsters::loadMonster(const std::string& file, const std::string& m
 
 	mType->info.summons.shrink_to_fit();
 	mType->info.lootItems.shrink_to_fit();
+	mType->compileLoot();
 	mType->info.attackSpells.shrink_to_fit();
 	mType->info.defenseSpells.shrink_to_fit();
 	mType->info.voiceVector.shrink_to_fit();
@@ -1514,6 +1750,16 @@ void Monsters::loadLootContainer(const pugi::xml_node& node, LootBlock& lBlock)
 	}
 }
 
+MonsterType* Monsters::addMonsterType(const std::string& name)
+{
+	MonsterType& mType = monsters[asLowerCaseString(name)];
+	if (mType.id == 0) {
+		mType.id = monsterTypes.size();
+		monsterTypes.push_back(&mType);
+	}
+	return &mType;
+}
+
 MonsterType* Monsters::getMonsterType(const std::string& name, bool loadFromFile /*= true */)
 {
 	std::string lowerCaseName = asLowerCaseString(name);
@@ -29,6 +29,19 @@ struct LootBlock {
 	}
 };
 
+// loot tree flattened in pre-order, so a failed roll skips a whole container at once
+struct CompiledLoot {
+	std::string text;
+	uint32_t chance = 0;
+	uint32_t countmax = 1;
+	int32_t subType = -1;
+	int32_t actionId = -1;
+	uint16_t id = 0;
+	uint16_t descendants = 0;
+	bool stackable = false;
+	bool container = false;
+};
+
 class Loot {
 	public:
 		Loot() = default;
@@ -86,11 +99,13 @@ class MonsterType
 	struct MonsterInfo {
 		LuaScriptInterface* scriptInterface;
 
-		std::map<CombatType_t, int32_t> elementMap;
+		// percent of each combat type taken off incoming hits, by combatTypeToIndex
+		std::array<int32_t, COMBAT_COUNT> elements = {};
 
 		std::vector<voiceBlock_t> voiceVector;
 
 		std::vector<LootBlock> lootItems;
+		std::vector<CompiledLoot> compiledLoot;
 		std::vector<std::string> scripts;
 		std::vector<spellBlock_t> attackSpells;
 		std::vector<spellBlock_t> defenseSpells;
@@ -162,9 +177,14 @@ class MonsterType
 		std::string name;
 		std::string nameDescription;
 
+		// interned when the type is registered, kept across reloads
+		uint32_t id = 0;
+
 		MonsterInfo info;
 
 		void loadLoot(MonsterType* monsterType, LootBlock lootBlock);
+		void compileLoot();
+		void createLoot(Container* corpse) const;
 };
 
 class MonsterSpell
@@ -205,6 +225,10 @@ class MonsterSpell
 		bool combatSpell = false;
 		bool isMelee = false;
 
+		// custom area in row order, used instead of length and radius
+		std::vector<uint32_t> area;
+		uint32_t areaRows = 0;
+
 		Outfit_t outfit = {};
 		ShootType_t shoot = CONST_ANI_NONE;
 		MagicEffectClasses effect = CONST_ME_NONE;
@@ -212,6 +236,17 @@ class MonsterSpell
 		CombatType_t combatType = COMBAT_UNDEFINEDDAMAGE;
 };
 
+// monsters.xml and the parsed files of the types to build, read without
+// touching the registry so a reload can do it on a helper thread
+struct MonsterFiles
+{
+	std::map<std::string, std::string> index;
+	std::vector<std::pair<std::string, std::string>> pending;
+	std::vector<pugi::xml_document> docs;
+	std::vector<pugi::xml_parse_result> results;
+	bool loaded = false;
+};
+
 class Monsters
 {
 	public:
@@ -226,7 +261,24 @@ class Monsters
 		}
 		bool reload();
 
+		// the names whose files a reload reads again
+		std::set<std::string> getReloadNames() const;
+		// any thread, names are the types to parse besides the forced ones
+		static std::unique_ptr<MonsterFiles> readFiles(const std::set<std::string>& names, bool forceLoad);
+		// game thread, rebuilds the listed types in place so monsters keep theirs
+		bool applyFiles(MonsterFiles& files, bool reloading);
+
 		MonsterType* getMonsterType(const std::string& name, bool loadFromFile = true);
+		// resolved once at load, creating from the id never touches a string
+		uint32_t getMonsterTypeId(const std::string& name, bool loadFromFile = true) {
+			MonsterType* mType = getMonsterType(name, loadFromFile);
+			return mType ? mType->id : 0;
+		}
+		MonsterType* getMonsterTypeById(uint32_t id) const {
+			return id < monsterTypes.size() ? monsterTypes[id] : nullptr;
+		}
+		// the type registered under the name, an empty one with a fresh id if none is
+		MonsterType* addMonsterType(const std::string& name);
 		bool deserializeSpell(MonsterSpell* spell, spellBlock_t& sb, const std::string& description = "");
 
 		std::unique_ptr<LuaScriptInterface> scriptInterface;
@@ -238,11 +290,14 @@ class Monsters
 		bool deserializeSpell(const pugi::xml_node& node, spellBlock_t& sb, const std::string& description = "");
 
 		MonsterType* loadMonster(const std::string& file, const std::string& monsterName, bool reloading = false);
+		MonsterType* loadMonster(const pugi::xml_document& doc, const std::string& file, const std::string& monsterName, bool reloading);
 
 		void loadLootContainer(const pugi::xml_node& node, LootBlock&);
 		bool loadLootItem(const pugi::xml_node& node, LootBlock&);
 
 		std::map<std::string, std::string> unloadedMonsters;
+		// by id, 0 is no type
+		std::vector<MonsterType*> monsterTypes{nullptr};
 
 		bool loaded = false;
 };
@@ -11,6 +11,7 @@
 bool Mounts::reload()
 {
 	mounts.clear();
+	mountIndex.fill(0);
 	return loadFromXml();
 }
 
@@ -42,6 +43,11 @@ bool Mounts::loadFromXml()
 			pugi::cast<int32_t>(mountNode.attribute("speed").value()),
 			mountNode.attribute("premium").as_bool()
 		);
+
+		uint16_t& index = mountIndex[mounts.back().id];
+		if (index == 0) {
+			index = static_cast<uint16_t>(mounts.size());
+		}
 	}
 	mounts.shrink_to_fit();
 	return true;
@@ -49,11 +55,8 @@ bool Mounts::loadFromXml()
 
 Mount* Mounts::getMountByID(uint8_t id)
 {
-	auto it = std::find_if(mounts.begin(), mounts.end(), [id](const Mount& mount) {
-		return mount.id == id;
-	});
-
-	return it != mounts.end() ? &*it : nullptr;
+	uint16_t index = mountIndex[id];
+	return index != 0 ? &mounts[index - 1] : nullptr;
 }
 
 Mount* Mounts::getMountByName(const std::string& name) {
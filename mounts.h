@@ -31,6 +31,8 @@ class Mounts
 
 	private:
 		std::vector<Mount> mounts;
+		// position + 1 in mounts for every id, 0 when unused
+		std::array<uint16_t, std::numeric_limits<uint8_t>::max() + 1> mountIndex = {};
 };
 
 #endif
@@ -61,10 +61,52 @@ void MoveEvents::clear(bool fromLua)
 	clearMap(actionIdMap, fromLua);
 	clearMap(uniqueIdMap, fromLua);
 	clearPosMap(positionMap, fromLua);
+	updateEventMasks();
 
 	reInitState(fromLua);
 }
 
+void MoveEvents::updateEventMasks()
+{
+	auto getMask = [](const MoveEventList& moveEventList) {
+		uint8_t mask = 0;
+		for (int eventType = MOVE_EVENT_STEP_IN; eventType < MOVE_EVENT_LAST; ++eventType) {
+			if (!moveEventList.moveEvent[eventType].empty()) {
+				mask |= 1 << eventType;
+			}
+		}
+		return mask;
+	};
+
+	eventMask = 0;
+
+	std::fill(itemIdEventMask.begin(), itemIdEventMask.end(), 0);
+	for (const auto& it : itemIdMap) {
+		if (it.first >= 0 && static_cast<size_t>(it.first) < itemIdEventMask.size()) {
+			itemIdEventMask[it.first] = getMask(it.second);
+			eventMask |= itemIdEventMask[it.first];
+		}
+	}
+
+	actionIdEventMask = 0;
+	for (const auto& it : actionIdMap) {
+		actionIdEventMask |= getMask(it.second);
+	}
+	eventMask |= actionIdEventMask;
+
+	uniqueIdEventMask = 0;
+	for (const auto& it : uniqueIdMap) {
+		uniqueIdEventMask |= getMask(it.second);
+	}
+	eventMask |= uniqueIdEventMask;
+
+	positionEventMask = 0;
+	for (const auto& it : positionMap) {
+		positionEventMask |= getMask(it.second);
+	}
+	eventMask |= positionEventMask;
+}
+
 LuaScriptInterface& MoveEvents::getScriptInterface()
 {
 	return scriptInterface;
@@ -318,6 +360,21 @@ bool MoveEvents::registerLuaEvent(MoveEvent* event)
 
 void MoveEvents::addEvent(MoveEvent moveEvent, int32_t id, MoveListMap& map)
 {
+	const uint8_t eventBit = 1 << moveEvent.getEventType();
+	eventMask |= eventBit;
+	if (&map == &itemIdMap) {
+		if (id >= 0 && id <= std::numeric_limits<uint16_t>::max()) {
+			if (static_cast<size_t>(id) >= itemIdEventMask.size()) {
+				itemIdEventMask.resize(id + 1);
+			}
+			itemIdEventMask[id] |= eventBit;
+		}
+	} else if (&map == &actionIdMap) {
+		actionIdEventMask |= eventBit;
+	} else {
+		uniqueIdEventMask |= eventBit;
+	}
+
 	auto it = map.find(id);
 	if (it == map.end()) {
 		MoveEventList moveEventList;
@@ -356,6 +413,10 @@ MoveEvent* MoveEvents::getEvent(Item* item, MoveEvent_t eventType, slots_t slot)
 		default: slotp = 0; break;
 	}
 
+	if (!hasItemIdEvent(item->getID(), eventType)) {
+		return nullptr;
+	}
+
 	auto it = itemIdMap.find(item->getID());
 	if (it != itemIdMap.end()) {
 		std::list<MoveEvent>& moveEventList = it->second.moveEvent[eventType];
@@ -372,7 +433,8 @@ MoveEvent* MoveEvents::getEvent(Item* item, MoveEvent_t eventType)
 {
 	MoveListMap::iterator it;
 
-	if (item->hasAttribute(ITEM_ATTRIBUTE_UNIQUEID)) {
+	const uint8_t eventBit = 1 << eventType;
+	if ((uniqueIdEventMask & eventBit) != 0 && item->hasAttribute(ITEM_ATTRIBUTE_UNIQUEID)) {
 		it = uniqueIdMap.find(item->getUniqueId());
 		if (it != uniqueIdMap.end()) {
 			std::list<MoveEvent>& moveEventList = it->second.moveEvent[eventType];
@@ -382,7 +444,7 @@ MoveEvent* MoveEvents::getEvent(Item* item, MoveEvent_t eventType)
 		}
 	}
 
-	if (item->hasAttribute(ITEM_ATTRIBUTE_ACTIONID)) {
+	if ((actionIdEventMask & eventBit) != 0 && item->hasAttribute(ITEM_ATTRIBUTE_ACTIONID)) {
 		it = actionIdMap.find(item->getActionId());
 		if (it != actionIdMap.end()) {
 			std::list<MoveEvent>& moveEventList = it->second.moveEvent[eventType];
@@ -392,6 +454,10 @@ MoveEvent* MoveEvents::getEvent(Item* item, MoveEvent_t eventType)
 		}
 	}
 
+	if (!hasItemIdEvent(item->getID(), eventType)) {
+		return nullptr;
+	}
+
 	it = itemIdMap.find(item->getID());
 	if (it != itemIdMap.end()) {
 		std::list<MoveEvent>& moveEventList = it->second.moveEvent[eventType];
@@ -404,6 +470,9 @@ MoveEvent* MoveEvents::getEvent(Item* item, MoveEvent_t eventType)
 
 void MoveEvents::addEvent(MoveEvent moveEvent, const Position& pos, MovePosListMap& map)
 {
+	positionEventMask |= 1 << moveEvent.getEventType();
+	eventMask |= positionEventMask;
+
 	auto it = map.find(pos);
 	if (it == map.end()) {
 		MoveEventList moveEventList;
@@ -421,6 +490,10 @@ void MoveEvents::addEvent(MoveEvent moveEvent, const Position& pos, MovePosListM
 
 MoveEvent* MoveEvents::getEvent(const Tile* tile, MoveEvent_t eventType)
 {
+	if ((positionEventMask & (1 << eventType)) == 0) {
+		return nullptr;
+	}
+
 	auto it = positionMap.find(tile->getPosition());
 	if (it != positionMap.end()) {
 		std::list<MoveEvent>& moveEventList = it->second.moveEvent[eventType];
@@ -433,6 +506,10 @@ MoveEvent* MoveEvents::getEvent(const Tile* tile, MoveEvent_t eventType)
 
 uint32_t MoveEvents::onCreatureMove(Creature* creature, const Tile* tile, MoveEvent_t eventType)
 {
+	if (!hasEvents(eventType)) {
+		return 1;
+	}
+
 	const Position& pos = tile->getPosition();
 
 	uint32_t ret = 1;
@@ -490,6 +567,10 @@ uint32_t MoveEvents::onItemMove(Item* item, Tile* tile, bool isAdd)
 		eventType2 = MOVE_EVENT_REMOVE_ITEM_ITEMTILE;
 	}
 
+	if (!hasEvents(eventType1) && !hasEvents(eventType2)) {
+		return 1;
+	}
+
 	uint32_t ret = 1;
 	MoveEvent* moveEvent = getEvent(tile, eventType1);
 	if (moveEvent) {
@@ -684,7 +765,7 @@ uint32_t MoveEvent::AddItemField(Item* item, Item*, const Position&)
 {
 	if (MagicField* field = item->getMagicField()) {
 		Tile* tile = item->getTile();
-		if (CreatureVector* creatures = tile->getCreatures()) {
+		if (TileCreatureVector* creatures = tile->getCreatures()) {
 			for (Creature* creature : *creatures) {
 				field->onStepInField(creature);
 			}
@@ -734,6 +815,7 @@ ReturnValue MoveEvent::EquipItem(MoveEvent* moveEvent, Player* player, Item* ite
 		g_game.startDecay(newItem);
 	} else {
 		player->setItemAbility(slot, true);
+		player->setItemAbsorbs(slot, it.abilities.get());
 	}
 
 	if (!it.abilities) {
@@ -831,6 +913,7 @@ ReturnValue MoveEvent::DeEquipItem(MoveEvent*, Player* player, Item* item, slots
 	}
 
 	player->setItemAbility(slot, false);
+	player->setItemAbsorbs(slot, nullptr);
 
 	const ItemType& it = Item::items[item->getID()];
 	if (it.transformDeEquipTo != 0) {
@@ -968,8 +1051,7 @@ bool MoveEvent::executeStep(Creature* creature, Item* item, const Position& pos)
 	lua_State* L = scriptInterface->getLuaState();
 
 	scriptInterface->pushFunction(scriptId);
-	LuaScriptInterface::pushUserdata<Creature>(L, creature);
-	LuaScriptInterface::setCreatureMetatable(L, -1, creature);
+	LuaScriptInterface::pushCreature(L, creature);
 	LuaScriptInterface::pushThing(L, item);
 	LuaScriptInterface::pushPosition(L, pos);
 	LuaScriptInterface::pushPosition(L, creature->getLastPosition());
@@ -1007,8 +1089,7 @@ bool MoveEvent::executeEquip(Player* player, Item* item, slots_t slot, bool isCh
 	lua_State* L = scriptInterface->getLuaState();
 
 	scriptInterface->pushFunction(scriptId);
-	LuaScriptInterface::pushUserdata<Player>(L, player);
-	LuaScriptInterface::setMetatable(L, -1, "Player");
+	LuaScriptInterface::pushCreature(L, player);
 	LuaScriptInterface::pushThing(L, item);
 	lua_pushnumber(L, slot);
 	LuaScriptInterface::pushBoolean(L, isCheck);
@@ -51,15 +51,24 @@ class MoveEvents final : public BaseEvents
 
 		MoveEvent* getEvent(Item* item, MoveEvent_t eventType);
 
+		bool hasEvents(MoveEvent_t eventType) const {
+			return (eventMask & (1 << eventType)) != 0;
+		}
+
 		bool registerLuaEvent(MoveEvent* event);
 		bool registerLuaFunction(MoveEvent* event);
 		void clear(bool fromLua) override final;
 
 	private:
-		using MoveListMap = std::map<int32_t, MoveEventList>;
-		using MovePosListMap = std::map<Position, MoveEventList>;
+		using MoveListMap = std::unordered_map<int32_t, MoveEventList>;
+		using MovePosListMap = std::unordered_map<Position, MoveEventList>;
 		void clearMap(MoveListMap& map, bool fromLua);
 		void clearPosMap(MovePosListMap& map, bool fromLua);
+		void updateEventMasks();
+
+		bool hasItemIdEvent(uint16_t itemId, MoveEvent_t eventType) const {
+			return itemId < itemIdEventMask.size() && (itemIdEventMask[itemId] & (1 << eventType)) != 0;
+		}
 
 		LuaScriptInterface& getScriptInterface() override;
 		std::string getScriptBaseName() const override;
@@ -78,6 +87,13 @@ class MoveEvents final : public BaseEvents
 		MoveListMap itemIdMap;
 		MovePosListMap positionMap;
 
+		// one bit per event type, so items and tiles without events skip the map lookups
+		std::vector<uint8_t> itemIdEventMask;
+		uint8_t actionIdEventMask = 0;
+		uint8_t uniqueIdEventMask = 0;
+		uint8_t positionEventMask = 0;
+		uint8_t eventMask = 0;
+
 		LuaScriptInterface scriptInterface;
 };
 
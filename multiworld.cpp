@@ -0,0 +1,113 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#include "otpch.h"
+
+#include "multiworld.h"
+#include "configmanager.h"
+
+#ifndef _WIN32
+#include <csignal>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+extern ConfigManager g_config;
+
+MultiWorld g_multiWorld;
+
+namespace {
+
+#ifndef _WIN32
+// read by the signal handler, written before it is installed
+constexpr size_t MAX_WORLDS = 64;
+pid_t worldPids[MAX_WORLDS];
+size_t worldCount = 0;
+
+void forwardSignal(int signal)
+{
+	for (size_t i = 0; i < worldCount; ++i) {
+		if (worldPids[i] > 0) {
+			kill(worldPids[i], signal);
+		}
+	}
+}
+#endif
+
+}
+
+bool MultiWorld::parseArgument(const std::string& key, const std::string& value)
+{
+	if (key != "--world-config") {
+		return false;
+	}
+
+	configFiles.push_back(value);
+	return true;
+}
+
+int MultiWorld::run(const std::function<bool()>& preload)
+{
+#ifdef _WIN32
+	std::cout << "[Error - MultiWorld::run] Several worlds per launch need fork, start one server per world instead." << std::endl;
+	return 1;
+#else
+	if (configFiles.size() > MAX_WORLDS) {
+		std::cout << "[Error - MultiWorld::run] At most " << MAX_WORLDS << " worlds can be started together." << std::endl;
+		return 1;
+	}
+
+	// no thread may be running yet, a fork only takes the calling one along
+	std::cout << ">> Loading the registries shared by " << configFiles.size() << " worlds" << std::endl;
+	if (!preload()) {
+		return 1;
+	}
+
+	for (const std::string& configFile : configFiles) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			sharedData = true;
+			g_config.setString(ConfigManager::CONFIG_FILE, configFile);
+			return -1;
+		} else if (pid < 0) {
+			std::cout << "[Error - MultiWorld::run] Cannot start the world of " << configFile << '.' << std::endl;
+			forwardSignal(SIGTERM);
+			break;
+		}
+
+		std::cout << ">> World " << configFile << " started as process " << pid << std::endl;
+		worldPids[worldCount++] = pid;
+	}
+
+	// the worlds save and shut down on their own signals
+	std::signal(SIGINT, forwardSignal);
+	std::signal(SIGTERM, forwardSignal);
+	std::signal(SIGHUP, forwardSignal);
+	std::signal(SIGUSR1, forwardSignal);
+
+	int exitCode = 0;
+	for (size_t running = worldCount; running != 0;) {
+		int status;
+		pid_t pid = waitpid(-1, &status, 0);
+		if (pid < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+
+		for (size_t i = 0; i < worldCount; ++i) {
+			if (worldPids[i] == pid) {
+				worldPids[i] = 0;
+				--running;
+			}
+		}
+
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			std::cout << "> World process " << pid << " ended abnormally." << std::endl;
+			exitCode = 1;
+		}
+	}
+	return exitCode;
+#endif
+}
@@ -0,0 +1,41 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#ifndef FS_MULTIWORLD_H_5B0E7D2A94C14F6E8A3D1C6F0B9E2A47
+#define FS_MULTIWORLD_H_5B0E7D2A94C14F6E8A3D1C6F0B9E2A47
+
+// Several worlds started from one launch. The game state is one global per
+// process, so every world still gets its own process, but they are forked
+// from a supervisor that loaded the static registries (items, vocations,
+// outfits) first. The worlds keep those pages shared until one of them
+// writes to them, and each runs its own dispatcher on its own core. Every
+// world reads its own config file, which sets its map, ports and database.
+// Not available on Windows.
+class MultiWorld
+{
+	public:
+		bool isEnabled() const {
+			return !configFiles.empty();
+		}
+
+		// --world-config=file, once per world, false for any other argument
+		bool parseArgument(const std::string& key, const std::string& value);
+
+		// true in a forked world, once the supervisor loaded the static registries
+		bool hasSharedData() const {
+			return sharedData;
+		}
+
+		// the supervisor preloads, forks a world per config file and returns the
+		// exit code of the process once they all ended; a world returns -1 and
+		// goes on starting its server
+		int run(const std::function<bool()>& preload);
+
+	private:
+		std::vector<std::string> configFiles;
+		bool sharedData = false;
+};
+
+extern MultiWorld g_multiWorld;
+
+#endif
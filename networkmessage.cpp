@@ -7,20 +7,67 @@
 
 #include "container.h"
 #include "creature.h"
+#include "lockfree.h"
+
+namespace {
+
+// blocks kept for reuse per class, messages of both live on the dispatcher and the network threads
+constexpr size_t MEDIUM_BUFFER_FREE_LIST_CAPACITY = 1024;
+constexpr size_t LARGE_BUFFER_FREE_LIST_CAPACITY = 64;
+
+}
+
+bool NetworkMessage::grow(size_t size)
+{
+	if (size > LARGE_BUFFER_SIZE) {
+		return false;
+	}
+
+	uint32_t newCapacity;
+	uint8_t* newBuffer;
+	if (size <= MEDIUM_BUFFER_SIZE) {
+		newCapacity = MEDIUM_BUFFER_SIZE;
+		newBuffer = static_cast<uint8_t*>(lockfreeAllocateBlock<MEDIUM_BUFFER_SIZE, MEDIUM_BUFFER_FREE_LIST_CAPACITY>());
+	} else {
+		newCapacity = LARGE_BUFFER_SIZE;
+		newBuffer = static_cast<uint8_t*>(lockfreeAllocateBlock<LARGE_BUFFER_SIZE, LARGE_BUFFER_FREE_LIST_CAPACITY>());
+	}
+
+	// headers of output messages sit in front of the position, the whole buffer moves
+	memcpy(newBuffer, buffer, capacity);
+	releaseBuffer();
+	buffer = newBuffer;
+	capacity = newCapacity;
+	return true;
+}
+
+void NetworkMessage::releaseBuffer()
+{
+	if (capacity == MEDIUM_BUFFER_SIZE) {
+		lockfreeDeallocateBlock<MEDIUM_BUFFER_SIZE, MEDIUM_BUFFER_FREE_LIST_CAPACITY>(buffer);
+	} else if (capacity == LARGE_BUFFER_SIZE) {
+		lockfreeDeallocateBlock<LARGE_BUFFER_SIZE, LARGE_BUFFER_FREE_LIST_CAPACITY>(buffer);
+	}
+}
 
 std::string NetworkMessage::getString(uint16_t stringLen/* = 0*/)
+{
+	return std::string(getStringView(stringLen));
+}
+
+std::string_view NetworkMessage::getStringView(uint16_t stringLen/* = 0*/)
 {
 	if (stringLen == 0) {
 		stringLen = get<uint16_t>();
 	}
 
 	if (!canRead(stringLen)) {
-		return std::string();
+		return std::string_view();
 	}
 
-	char* v = reinterpret_cast<char*>(buffer) + info.position; //does not break strict aliasing
+	const char* v = reinterpret_cast<const char*>(buffer) + info.position; //does not break strict aliasing
 	info.position += stringLen;
-	return std::string(v, stringLen);
+	return std::string_view(v, stringLen);
 }
 
 Position NetworkMessage::getPosition()
@@ -32,7 +79,7 @@ Position NetworkMessage::getPosition()
 	return pos;
 }
 
-void NetworkMessage::addString(const std::string& value)
+void NetworkMessage::addString(std::string_view value)
 {
 	size_t stringLen = value.length();
 	if (!canAdd(stringLen + 2) || stringLen > 8192) {
@@ -40,7 +87,7 @@ void NetworkMessage::addString(const std::string& value)
 	}
 
 	add<uint16_t>(stringLen);
-	memcpy(buffer + info.position, value.c_str(), stringLen);
+	memcpy(buffer + info.position, value.data(), stringLen);
 	info.position += stringLen;
 	info.length += stringLen;
 }
@@ -120,7 +167,7 @@ void NetworkMessage::addItemId(uint16_t itemId)
 {
 	add<uint16_t>(Item::items[itemId].clientId);
 }
-void NetworkMessage::addOutfit(Outfit_t& outfit)
+void NetworkMessage::addOutfit(const Outfit_t& outfit)
 {
 	add<uint16_t>(outfit.lookType);
 
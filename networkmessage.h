@@ -7,6 +7,8 @@
 #include "const.h"
 #include "enums.h"
 
+#include <string_view>
+
 class Item;
 class Creature;
 class Player;
@@ -28,12 +30,35 @@ class NetworkMessage
 		enum { MAX_BODY_LENGTH = NETWORKMESSAGE_MAXSIZE - HEADER_LENGTH - CHECKSUM_LENGTH - XTEA_MULTIPLE };
 		enum { MAX_PROTOCOL_BODY_LENGTH = MAX_BODY_LENGTH - 10 };
 
+		// the buffer starts inline with the small class and moves to the pooled
+		// medium and large classes when a write or a read needs more room
+		static constexpr uint32_t SMALL_BUFFER_SIZE = 512;
+		static constexpr uint32_t MEDIUM_BUFFER_SIZE = 8192;
+		static constexpr uint32_t LARGE_BUFFER_SIZE = NETWORKMESSAGE_MAXSIZE;
+
 		NetworkMessage() = default;
+		~NetworkMessage() {
+			releaseBuffer();
+		}
+
+		// non-copyable
+		NetworkMessage(const NetworkMessage&) = delete;
+		NetworkMessage& operator=(const NetworkMessage&) = delete;
 
+		// the buffer keeps its size class until the message is destroyed
 		void reset() {
 			info = {};
 		}
 
+		// makes the first size bytes of the buffer usable, false past the largest class
+		bool reserve(size_t size) {
+			return size <= capacity || grow(size);
+		}
+
+		uint32_t getCapacity() const {
+			return capacity;
+		}
+
 		// simply read functions for incoming message
 		uint8_t getByte() {
 			if (!canRead(1)) {
@@ -60,10 +85,19 @@ class NetworkMessage
 		}
 
 		std::string getString(uint16_t stringLen = 0);
+		// points into the buffer, valid until the message is reused; parsers read
+		// with it and copy only what they keep or post to the dispatcher
+		std::string_view getStringView(uint16_t stringLen = 0);
 		Position getPosition();
 
 		// skips count unknown/unused bytes in an incoming message
 		void skipBytes(int16_t count) {
+			if (count < 0 ? info.position < -count : !canRead(count)) {
+				// later reads fail instead of decoding bytes past the message
+				info.overrun = true;
+				info.position = info.length + INITIAL_BUFFER_POSITION;
+				return;
+			}
 			info.position += count;
 		}
 
@@ -91,7 +125,7 @@ class NetworkMessage
 		void addBytes(const char* bytes, size_t size);
 		void addPaddingBytes(size_t n);
 
-		void addString(const std::string& value);
+		void addString(std::string_view value);
 
 		void addDouble(double value, uint8_t precision = 2);
 
@@ -100,7 +134,7 @@ class NetworkMessage
 		void addItem(uint16_t id, uint8_t count);
 		void addItem(const Item* item);
 		void addItemId(uint16_t itemId);
-		void addOutfit(Outfit_t& outfit);
+		void addOutfit(const Outfit_t& outfit);
 
 		MsgSize_t getLength() const {
 			return info.length;
@@ -151,20 +185,26 @@ class NetworkMessage
 		};
 
 		NetworkMessageInfo info;
-		uint8_t buffer[NETWORKMESSAGE_MAXSIZE];
+		uint8_t* buffer = smallBuffer;
+		uint32_t capacity = SMALL_BUFFER_SIZE;
 
 	private:
-		bool canAdd(size_t size) const {
-			return (size + info.position) < MAX_BODY_LENGTH;
+		bool grow(size_t size);
+		void releaseBuffer();
+
+		bool canAdd(size_t size) {
+			return (size + info.position) < MAX_BODY_LENGTH && reserve(size + info.position);
 		}
 
 		bool canRead(int32_t size) {
-			if ((info.position + size) > (info.length + 8) || size >= (NETWORKMESSAGE_MAXSIZE - info.position)) {
+			if ((info.position + size) > (info.length + 8) || size >= static_cast<int32_t>(capacity - info.position)) {
 				info.overrun = true;
 				return false;
 			}
 			return true;
 		}
+
+		uint8_t smallBuffer[SMALL_BUFFER_SIZE];
 };
 
 #endif // #ifndef __NETWORK_MESSAGE_H__
@@ -10,7 +10,7 @@
 extern Game g_game;
 extern LuaEnvironment g_luaEnvironment;
 
-uint32_t Npc::npcAutoID = 0x80000000;
+CreatureIdTable<Npc> Npc::ids{0x80000000, 28};
 NpcScriptInterface* Npc::scriptInterface = nullptr;
 
 void Npcs::reload()
@@ -44,21 +44,26 @@ Npc::Npc(const std::string& name) :
 	masterRadius(-1),
 	loaded(false)
 {
+	interests = CREATURE_INTEREST_PLAYER_SPEECH;
 	reset();
 }
 
 Npc::~Npc()
 {
+	ids.release(id);
+
 	reset();
 }
 
 void Npc::addList()
 {
 	g_game.addNpc(this);
+	ids.setCreature(id, this);
 }
 
 void Npc::removeList()
 {
+	ids.setCreature(id, nullptr);
 	g_game.removeNpc(this);
 }
 
@@ -97,7 +102,12 @@ void Npc::reset()
 
 	parameters.clear();
 	shopPlayerSet.clear();
+	shopPayloadList.clear();
+	shopPayload.clear();
 	spectators.clear();
+	conversationPartners.clear();
+	keywords.clear();
+	keywordIndex.clear();
 }
 
 void Npc::reload()
@@ -226,6 +236,10 @@ bool Npc::loadFromXml()
 		parameters[parameterNode.attribute("key").as_string()] = parameterNode.attribute("value").as_string();
 	}
 
+	for (auto keywordNode : npcNode.child("keywords").children()) {
+		addKeyword(keywordNode.attribute("word").as_string());
+	}
+
 	pugi::xml_attribute scriptFile = npcNode.attribute("script");
 	if (scriptFile) {
 		npcEventHandler = new NpcEventsHandler(scriptFile.as_string(), this);
@@ -301,6 +315,7 @@ void Npc::onRemoveCreature(Creature* creature, bool isLogout)
 		}
 
 		spectators.erase(player);
+		conversationPartners.erase(player);
 		setIdle(spectators.empty());
 	}
 }
@@ -323,6 +338,7 @@ void Npc::onCreatureMove(Creature* creature, const Tile* newTile, const Position
 				spectators.insert(player);
 			} else {
 				spectators.erase(player);
+				conversationPartners.erase(player);
 			}
 
 			setIdle(spectators.empty());
@@ -338,10 +354,11 @@ void Npc::onCreatureSay(Creature* creature, SpeakClasses type, const std::string
 
 	//only players for script events
 	Player* player = creature->getPlayer();
-	if (player) {
-		if (npcEventHandler) {
-			npcEventHandler->onCreatureSay(player, type, text);
+	if (player && npcEventHandler) {
+		if (!keywords.empty() && type != TALKTYPE_PRIVATE_PN && !isTalkingTo(player) && !hasKeyword(text)) {
+			return;
 		}
+		npcEventHandler->onCreatureSay(player, type, text);
 	}
 }
 
@@ -352,6 +369,11 @@ void Npc::onPlayerCloseChannel(Player* player)
 	}
 }
 
+uint32_t Npc::getThinkRate() const
+{
+	return getThinkRateByNearestPlayer();
+}
+
 void Npc::onThink(uint32_t interval)
 {
 	Creature::onThink(interval);
@@ -547,11 +569,58 @@ void Npc::setCreatureFocus(Creature* creature)
 	if (creature) {
 		focusCreature = creature->getID();
 		turnToCreature(creature);
+
+		if (Player* player = creature->getPlayer()) {
+			conversationPartners.insert(player);
+		}
 	} else {
 		focusCreature = 0;
 	}
 }
 
+void Npc::addKeyword(const std::string& keyword)
+{
+	if (keyword.empty()) {
+		return;
+	}
+
+	auto it = keywords.insert(asLowerCaseString(keyword)).first;
+	keywordIndex.insert(*it, &*it);
+}
+
+bool Npc::hasKeyword(const std::string& text) const
+{
+	// the words may appear anywhere in the line, like a find in the script
+	std::string_view line = text;
+	for (size_t start = 0; start < line.size(); ++start) {
+		bool found = false;
+		keywordIndex.forEachPrefix(line.substr(start), [&found](const std::string*, size_t) {
+			found = true;
+			return true;
+		});
+
+		if (found) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool Npc::isTalkingTo(Player* player) const
+{
+	return focusCreature == static_cast<int32_t>(player->getID()) || conversationPartners.find(player) != conversationPartners.end() ||
+	       shopPlayerSet.find(player) != shopPlayerSet.end();
+}
+
+const std::string& Npc::getShopPayload(const ShopInfoList& shop)
+{
+	if (shopPayload.empty() || shop != shopPayloadList) {
+		shopPayloadList = shop;
+		shopPayload = ProtocolGame::encodeShop(name, shop);
+	}
+	return shopPayload;
+}
+
 void Npc::addShopPlayer(Player* player)
 {
 	shopPlayerSet.insert(player);
@@ -640,6 +709,7 @@ void NpcScriptInterface::registerFunctions()
 	// metatable
 	registerMethod("Npc", "getParameter", NpcScriptInterface::luaNpcGetParameter);
 	registerMethod("Npc", "setFocus", NpcScriptInterface::luaNpcSetFocus);
+	registerMethod("Npc", "addKeyword", NpcScriptInterface::luaNpcAddKeyword);
 
 	registerMethod("Npc", "openShopWindow", NpcScriptInterface::luaNpcOpenShopWindow);
 	registerMethod("Npc", "closeShopWindow", NpcScriptInterface::luaNpcCloseShopWindow);
@@ -1015,6 +1085,19 @@ int NpcScriptInterface::luaNpcSetFocus(lua_State* L)
 	return 1;
 }
 
+int NpcScriptInterface::luaNpcAddKeyword(lua_State* L)
+{
+	// npc:addKeyword(keyword)
+	Npc* npc = getUserdata<Npc>(L, 1);
+	if (npc) {
+		npc->addKeyword(getString(L, 2));
+		pushBoolean(L, true);
+	} else {
+		lua_pushnil(L);
+	}
+	return 1;
+}
+
 int NpcScriptInterface::luaNpcOpenShopWindow(lua_State* L)
 {
 	// npc:openShopWindow(cid, items, buyCallback, sellCallback)
@@ -1161,8 +1244,7 @@ void NpcEventsHandler::onCreatureAppear(Creature* creature)
 
 	lua_State* L = scriptInterface->getLuaState();
 	scriptInterface->pushFunction(creatureAppearEvent);
-	LuaScriptInterface::pushUserdata<Creature>(L, creature);
-	LuaScriptInterface::setCreatureMetatable(L, -1, creature);
+	LuaScriptInterface::pushCreature(L, creature);
 	scriptInterface->callFunction(1);
 }
 
@@ -1184,8 +1266,7 @@ void NpcEventsHandler::onCreatureDisappear(Creature* creature)
 
 	lua_State* L = scriptInterface->getLuaState();
 	scriptInterface->pushFunction(creatureDisappearEvent);
-	LuaScriptInterface::pushUserdata<Creature>(L, creature);
-	LuaScriptInterface::setCreatureMetatable(L, -1, creature);
+	LuaScriptInterface::pushCreature(L, creature);
 	scriptInterface->callFunction(1);
 }
 
@@ -1207,8 +1288,7 @@ void NpcEventsHandler::onCreatureMove(Creature* creature, const Position& oldPos
 
 	lua_State* L = scriptInterface->getLuaState();
 	scriptInterface->pushFunction(creatureMoveEvent);
-	LuaScriptInterface::pushUserdata<Creature>(L, creature);
-	LuaScriptInterface::setCreatureMetatable(L, -1, creature);
+	LuaScriptInterface::pushCreature(L, creature);
 	LuaScriptInterface::pushPosition(L, oldPos);
 	LuaScriptInterface::pushPosition(L, newPos);
 	scriptInterface->callFunction(3);
@@ -1232,8 +1312,7 @@ void NpcEventsHandler::onCreatureSay(Creature* creature, SpeakClasses type, cons
 
 	lua_State* L = scriptInterface->getLuaState();
 	scriptInterface->pushFunction(creatureSayEvent);
-	LuaScriptInterface::pushUserdata<Creature>(L, creature);
-	LuaScriptInterface::setCreatureMetatable(L, -1, creature);
+	LuaScriptInterface::pushCreature(L, creature);
 	lua_pushnumber(L, type);
 	LuaScriptInterface::pushString(L, text);
 	scriptInterface->callFunction(3);
@@ -1258,8 +1337,7 @@ void NpcEventsHandler::onPlayerTrade(Player* player, int32_t callback, uint16_t
 
 	lua_State* L = scriptInterface->getLuaState();
 	LuaScriptInterface::pushCallback(L, callback);
-	LuaScriptInterface::pushUserdata<Player>(L, player);
-	LuaScriptInterface::setMetatable(L, -1, "Player");
+	LuaScriptInterface::pushCreature(L, player);
 	lua_pushnumber(L, itemId);
 	lua_pushnumber(L, count);
 	lua_pushnumber(L, amount);
@@ -1286,8 +1364,7 @@ void NpcEventsHandler::onPlayerCloseChannel(Player* player)
 
 	lua_State* L = scriptInterface->getLuaState();
 	scriptInterface->pushFunction(playerCloseChannelEvent);
-	LuaScriptInterface::pushUserdata<Player>(L, player);
-	LuaScriptInterface::setMetatable(L, -1, "Player");
+	LuaScriptInterface::pushCreature(L, player);
 	scriptInterface->callFunction(1);
 }
 
@@ -1309,8 +1386,7 @@ void NpcEventsHandler::onPlayerEndTrade(Player* player)
 
 	lua_State* L = scriptInterface->getLuaState();
 	scriptInterface->pushFunction(playerEndTradeEvent);
-	LuaScriptInterface::pushUserdata<Player>(L, player);
-	LuaScriptInterface::setMetatable(L, -1, "Player");
+	LuaScriptInterface::pushCreature(L, player);
 	scriptInterface->callFunction(1);
 }
 
@@ -6,6 +6,7 @@
 
 #include "creature.h"
 #include "luascript.h"
+#include "wordtrie.h"
 
 #include <set>
 
@@ -44,6 +45,7 @@ class NpcScriptInterface final : public LuaScriptInterface
 		// metatable
 		static int luaNpcGetParameter(lua_State* L);
 		static int luaNpcSetFocus(lua_State* L);
+		static int luaNpcAddKeyword(lua_State* L);
 
 		static int luaNpcOpenShopWindow(lua_State* L);
 		static int luaNpcCloseShopWindow(lua_State* L);
@@ -107,10 +109,12 @@ class Npc final : public Creature
 
 		void setID() override {
 			if (id == 0) {
-				id = npcAutoID++;
+				id = ids.reserve();
 			}
 		}
 
+		static CreatureIdTable<Npc> ids;
+
 		void removeList() override;
 		void addList() override;
 
@@ -166,9 +170,15 @@ class Npc final : public Creature
 		void turnToCreature(Creature* creature);
 		void setCreatureFocus(Creature* creature);
 
+		// once an npc has keywords, a line that holds none of them is only
+		// passed to its script while the speaker talks with it
+		void addKeyword(const std::string& keyword);
+
 		NpcScriptInterface* getScriptInterface();
 
-		static uint32_t npcAutoID;
+		// the encoded shop window of the list, kept while the scripts open
+		// the same list
+		const std::string& getShopPayload(const ShopInfoList& shop);
 
 	private:
 		explicit Npc(const std::string& name);
@@ -180,6 +190,7 @@ class Npc final : public Creature
 
 		void onCreatureSay(Creature* creature, SpeakClasses type, const std::string& text) override;
 		void onThink(uint32_t interval) override;
+		uint32_t getThinkRate() const override;
 		std::string getDescription(int32_t lookDistance) const override;
 
 		bool isImmune(CombatType_t) const override {
@@ -205,10 +216,21 @@ class Npc final : public Creature
 		void removeShopPlayer(Player* player);
 		void closeAllShopWindows();
 
+		bool hasKeyword(const std::string& text) const;
+		bool isTalkingTo(Player* player) const;
+
 		std::map<std::string, std::string> parameters;
 
 		std::set<Player*> shopPlayerSet;
+
+		ShopInfoList shopPayloadList;
+		std::string shopPayload;
 		std::set<Player*> spectators;
+		// players focused since they came into view
+		std::set<Player*> conversationPartners;
+
+		std::set<std::string> keywords;
+		WordTrie<const std::string> keywordIndex;
 
 		std::string name;
 		std::string filename;
@@ -8,6 +8,7 @@
 #include "game.h"
 
 #include "iomarket.h"
+#include "ban.h"
 
 #include "configmanager.h"
 #include "scriptmanager.h"
@@ -15,10 +16,18 @@
 #include "protocolold.h"
 #include "protocollogin.h"
 #include "protocolstatus.h"
+#include "protocolmetrics.h"
 #include "databasemanager.h"
 #include "scheduler.h"
 #include "databasetasks.h"
+#include "hugepagearena.h"
+#include "iologindata.h"
+#include "multiworld.h"
+#include "playerjournal.h"
 #include "script.h"
+#include "simulation.h"
+#include "startuploader.h"
+#include "threadplacement.h"
 #include <fstream>
 #include <fmt/color.h>
 #if __has_include("gitmetadata.h")
@@ -48,6 +57,7 @@ void startupErrorMessage(const std::string& errorStr)
 
 void mainLoader(int argc, char* argv[], ServiceManager* services);
 bool argumentsHandler(const StringVector& args);
+bool loadSharedRegistries();
 
 [[noreturn]] void badAllocationHandler()
 {
@@ -67,6 +77,22 @@ int main(int argc, char* argv[])
 	// Setup bad allocation handler
 	std::set_new_handler(badAllocationHandler);
 
+	// the supervisor of several worlds ends here, each world goes on below
+	if (g_multiWorld.isEnabled()) {
+		int exitCode = g_multiWorld.run(loadSharedRegistries);
+		if (exitCode >= 0) {
+			return exitCode;
+		}
+	}
+
+	// the game thread of a simulation is this one, nothing else is started
+	if (g_simulation.isEnabled()) {
+		return g_simulation.run([argc, argv]() {
+			mainLoader(argc, argv, nullptr);
+			return g_game.getGameState() == GAME_STATE_NORMAL;
+		});
+	}
+
 	ServiceManager serviceManager;
 
 	g_dispatcher.start();
@@ -78,6 +104,7 @@ int main(int argc, char* argv[])
 
 	if (serviceManager.is_running()) {
 		std::cout << ">> " << g_config.getString(ConfigManager::SERVER_NAME) << " Server Online!" << std::endl << std::endl;
+		ThreadPlacement::applyToCurrent(g_config.getString(ConfigManager::NETWORK_CPUS), g_config.getNumber(ConfigManager::NETWORK_PRIORITY), "network");
 		serviceManager.run();
 	} else {
 		std::cout << ">> No services running. The server is NOT online." << std::endl;
@@ -89,6 +116,14 @@ int main(int argc, char* argv[])
 	g_scheduler.join();
 	g_databaseTasks.join();
 	g_dispatcher.join();
+
+	// the saves are written once the database workers are joined, the world
+	// is left to the process exit instead of being destroyed object by object
+	if (g_config.getBoolean(ConfigManager::FAST_SHUTDOWN)) {
+		std::cout << "Exiting without tearing down the world." << std::endl;
+		std::fflush(nullptr);
+		std::_Exit(EXIT_SUCCESS);
+	}
 	return 0;
 }
 
@@ -164,6 +199,23 @@ void mainLoader(int, char*[], ServiceManager* services)
 		return;
 	}
 
+	// a fixed seed replays the same rolls, e.g. for benchmarking fights
+	if (g_simulation.isEnabled()) {
+		seedRandomGenerator(g_simulation.getSeed());
+
+		// path searches on worker threads would finish in any order
+		g_config.setNumber(ConfigManager::PATHFINDING_THREADS, 0);
+	} else if (int32_t randomSeed = g_config.getNumber(ConfigManager::RANDOM_SEED)) {
+		seedRandomGenerator(static_cast<uint32_t>(randomSeed));
+	}
+
+	// pinned before the map loads, its pages are then taken on the memory node of these cores
+	g_dispatcher.setPlacement(g_config.getString(ConfigManager::DISPATCHER_CPUS), g_config.getNumber(ConfigManager::DISPATCHER_PRIORITY), "dispatcher");
+	g_scheduler.setPlacement(g_config.getString(ConfigManager::SCHEDULER_CPUS), g_config.getNumber(ConfigManager::SCHEDULER_PRIORITY), "scheduler");
+	if (int32_t arenaSize = g_config.getNumber(ConfigManager::HUGE_PAGE_ARENA_SIZE); arenaSize > 0 && HugePageArena::enable(static_cast<size_t>(arenaSize) << 20)) {
+		std::cout << ">> Reserved " << arenaSize << " MiB of huge pages for the map" << std::endl;
+	}
+
 #ifdef _WIN32
 	const std::string& defaultPriority = g_config.getString(ConfigManager::DEFAULT_PRIORITY);
 	if (strcasecmp(defaultPriority.c_str(), "high") == 0) {
@@ -173,85 +225,121 @@ void mainLoader(int, char*[], ServiceManager* services)
 	}
 #endif
 
-	//set RSA key
-	std::cout << ">> Loading RSA key " << std::endl;
-	try {
-		g_RSA.loadPEM("key.pem");
-	} catch(const std::exception& e) {
-		startupErrorMessage(e.what());
-		return;
-	}
+	// the stages that only read files or talk to the database load alongside
+	// each other, lua and the map stay on this thread in their usual order
+	StartupLoader loader;
+	loader.addStage("RSA key", {}, true, []() -> std::string {
+		try {
+			g_RSA.loadPEM("key.pem");
+		} catch(const std::exception& e) {
+			return e.what();
+		}
+		return {};
+	});
 
-	std::cout << ">> Establishing database connection..." << std::flush;
+	loader.addStage("database", {}, true, []() -> std::string {
+		if (g_simulation.isEnabled()) {
+			std::cout << ">> Simulation, the database is not connected" << std::endl;
+			return {};
+		}
 
-	if (!Database::getInstance().connect()) {
-		startupErrorMessage("Failed to connect to database.");
-		return;
-	}
+		if (!Database::getInstance().connect()) {
+			return "Failed to connect to database.";
+		}
 
-	std::cout << " MySQL " << Database::getClientVersion() << std::endl;
+		std::cout << ">> Connected to MySQL " << Database::getClientVersion() << std::endl;
 
-	// run database manager
-	std::cout << ">> Running database manager" << std::endl;
+		if (!DatabaseManager::isDatabaseSetup()) {
+			return "The database you have specified in config.lua is empty, please import the schema.sql to your database.";
+		}
+		g_databaseTasks.start();
+		g_databaseTasks.setPlacement(g_config.getString(ConfigManager::DATABASE_CPUS), g_config.getNumber(ConfigManager::DATABASE_PRIORITY), "database");
 
-	if (!DatabaseManager::isDatabaseSetup()) {
-		startupErrorMessage("The database you have specified in config.lua is empty, please import the schema.sql to your database.");
-		return;
-	}
-	g_databaseTasks.start();
+		DatabaseManager::updateDatabase();
+		IOLoginData::initItemBlobs();
+		g_playerJournal.recover(Database::getInstance());
 
-	DatabaseManager::updateDatabase();
+		if (g_config.getBoolean(ConfigManager::OPTIMIZE_DATABASE) && !DatabaseManager::optimizeTables()) {
+			std::cout << "> No tables were optimized." << std::endl;
+		}
+		return {};
+	});
 
-	if (g_config.getBoolean(ConfigManager::OPTIMIZE_DATABASE) && !DatabaseManager::optimizeTables()) {
-		std::cout << "> No tables were optimized." << std::endl;
-	}
+	loader.addStage("vocations", {}, true, []() -> std::string {
+		if (g_multiWorld.hasSharedData()) {
+			return {};
+		}
 
-	//load vocations
-	std::cout << ">> Loading vocations" << std::endl;
-	if (!g_vocations.loadFromXml()) {
-		startupErrorMessage("Unable to load vocations!");
-		return;
-	}
+		if (!g_vocations.loadFromXml()) {
+			return "Unable to load vocations!";
+		}
+		return {};
+	});
 
-	// load item data
-	std::cout << ">> Loading items" << std::endl;
-	if (!Item::items.loadFromOtb("data/items/items.otb")) {
-		startupErrorMessage("Unable to load items (OTB)!");
-		return;
-	}
+	loader.addStage("items", {}, true, []() -> std::string {
+		if (g_multiWorld.hasSharedData()) {
+			return {};
+		}
 
-	if (!Item::items.loadFromXml()) {
-		startupErrorMessage("Unable to load items (XML)!");
-		return;
-	}
+		if (!Item::items.loadFromOtb("data/items/items.otb")) {
+			return "Unable to load items (OTB)!";
+		}
 
-	std::cout << ">> Loading script systems" << std::endl;
-	if (!ScriptingManager::getInstance().loadScriptSystems()) {
-		startupErrorMessage("Failed to load script systems");
-		return;
-	}
+		if (!Item::items.loadFromXml()) {
+			return "Unable to load items (XML)!";
+		}
+		return {};
+	});
 
-	std::cout << ">> Loading lua scripts" << std::endl;
-	if (!g_scripts->loadScripts("scripts", false, false)) {
-		startupErrorMessage("Failed to load lua scripts");
-		return;
-	}
+	loader.addStage("outfits", {}, true, []() -> std::string {
+		if (g_multiWorld.hasSharedData()) {
+			return {};
+		}
 
-	std::cout << ">> Loading monsters" << std::endl;
-	if (!g_monsters.loadFromXml()) {
-		startupErrorMessage("Unable to load monsters!");
-		return;
-	}
+		if (!Outfits::getInstance().loadFromXml()) {
+			return "Unable to load outfits!";
+		}
+		return {};
+	});
 
-	std::cout << ">> Loading lua monsters" << std::endl;
-	if (!g_scripts->loadScripts("monster", false, false)) {
-		startupErrorMessage("Failed to load lua monsters");
-		return;
-	}
+	// database migrations share the lua script environment, so nothing lua may run before them
+	loader.addStage("script systems", {"database", "vocations", "items", "outfits"}, false, []() -> std::string {
+		if (!ScriptingManager::getInstance().loadScriptSystems()) {
+			return "Failed to load script systems";
+		}
+		return {};
+	});
 
-	std::cout << ">> Loading outfits" << std::endl;
-	if (!Outfits::getInstance().loadFromXml()) {
-		startupErrorMessage("Unable to load outfits!");
+	loader.addStage("lua scripts", {"script systems"}, false, []() -> std::string {
+		if (!g_scripts->loadScripts("scripts", false, false)) {
+			return "Failed to load lua scripts";
+		}
+		return {};
+	});
+
+	loader.addStage("monsters", {"lua scripts"}, false, []() -> std::string {
+		if (!g_monsters.loadFromXml()) {
+			return "Unable to load monsters!";
+		}
+		return {};
+	});
+
+	loader.addStage("lua monsters", {"monsters"}, false, []() -> std::string {
+		// parse them on every core first, the serial load below then only runs cached bytecode
+		if (g_config.getBoolean(ConfigManager::LUA_BYTECODE_CACHE)) {
+			Scripts::compileScripts("monster");
+		}
+
+		if (!g_scripts->loadScripts("monster", false, false)) {
+			return "Failed to load lua monsters";
+		}
+		return {};
+	});
+
+	std::cout << ">> Loading startup stages" << std::endl;
+	std::string error = loader.run();
+	if (!error.empty()) {
+		startupErrorMessage(error);
 		return;
 	}
 
@@ -279,15 +367,34 @@ void mainLoader(int, char*[], ServiceManager* services)
 	std::cout << ">> Initializing gamestate" << std::endl;
 	g_game.setGameState(GAME_STATE_INIT);
 
-	// Game client protocols
-	services->add<ProtocolGame>(static_cast<uint16_t>(g_config.getNumber(ConfigManager::GAME_PORT)));
-	services->add<ProtocolLogin>(static_cast<uint16_t>(g_config.getNumber(ConfigManager::LOGIN_PORT)));
-
-	// OT protocols
-	services->add<ProtocolStatus>(static_cast<uint16_t>(g_config.getNumber(ConfigManager::STATUS_PORT)));
+	// a simulation has no services
+	if (services) {
+		// Game client protocols
+		SocketOptions gameSocketOptions;
+		gameSocketOptions.noDelay = g_config.getBoolean(ConfigManager::GAME_SOCKET_NODELAY);
+		gameSocketOptions.sendBufferSize = g_config.getNumber(ConfigManager::GAME_SOCKET_SEND_BUFFER);
+		gameSocketOptions.receiveBufferSize = g_config.getNumber(ConfigManager::GAME_SOCKET_RECEIVE_BUFFER);
+		gameSocketOptions.highWatermark = std::max<int32_t>(0, g_config.getNumber(ConfigManager::GAME_WRITE_HIGH_WATERMARK));
+		gameSocketOptions.lowWatermark = std::min<size_t>(gameSocketOptions.highWatermark, std::max<int32_t>(0, g_config.getNumber(ConfigManager::GAME_WRITE_LOW_WATERMARK)));
+		services->add<ProtocolGame>(static_cast<uint16_t>(g_config.getNumber(ConfigManager::GAME_PORT)), gameSocketOptions);
+
+		SocketOptions loginSocketOptions;
+		loginSocketOptions.noDelay = g_config.getBoolean(ConfigManager::LOGIN_SOCKET_NODELAY);
+		loginSocketOptions.sendBufferSize = g_config.getNumber(ConfigManager::LOGIN_SOCKET_SEND_BUFFER);
+		loginSocketOptions.receiveBufferSize = g_config.getNumber(ConfigManager::LOGIN_SOCKET_RECEIVE_BUFFER);
+		services->add<ProtocolLogin>(static_cast<uint16_t>(g_config.getNumber(ConfigManager::LOGIN_PORT)), loginSocketOptions);
+
+		// OT protocols
+		services->add<ProtocolStatus>(static_cast<uint16_t>(g_config.getNumber(ConfigManager::STATUS_PORT)));
+
+		// Prometheus scrape endpoint, disabled unless a port is configured
+		if (g_config.getNumber(ConfigManager::METRICS_PORT) != 0) {
+			services->add<ProtocolMetrics>(static_cast<uint16_t>(g_config.getNumber(ConfigManager::METRICS_PORT)));
+		}
 
-	// Legacy login protocol
-	services->add<ProtocolOld>(static_cast<uint16_t>(g_config.getNumber(ConfigManager::LOGIN_PORT)));
+		// Legacy login protocol
+		services->add<ProtocolOld>(static_cast<uint16_t>(g_config.getNumber(ConfigManager::LOGIN_PORT)));
+	}
 
 	RentPeriod_t rentPeriod;
 	std::string strRentPeriod = asLowerCaseString(g_config.getString(ConfigManager::HOUSE_RENT_PERIOD));
@@ -304,10 +411,16 @@ void mainLoader(int, char*[], ServiceManager* services)
 		rentPeriod = RENTPERIOD_NEVER;
 	}
 
-	g_game.map.houses.payHouses(rentPeriod);
+	// houses and the market live in the database
+	if (!g_simulation.isEnabled()) {
+		g_game.map.houses.payHouses(rentPeriod);
+
+		std::cout << ">> Loading market offers" << std::endl;
+		IOMarket::getInstance().loadOffers();
 
-	IOMarket::checkExpiredOffers();
-	IOMarket::getInstance().updateStatistics();
+		IOMarket::checkExpiredOffers();
+		IOMarket::getInstance().loadStatistics();
+	}
 
 	std::cout << ">> Loaded all modules, server starting up..." << std::endl;
 
@@ -319,9 +432,30 @@ void mainLoader(int, char*[], ServiceManager* services)
 
 	g_game.start(services);
 	g_game.setGameState(GAME_STATE_NORMAL);
+	ProtocolStatus::updateStatusCache();
+	IOBan::updateBanCache();
 	g_loaderSignal.notify_all();
 }
 
+bool loadSharedRegistries()
+{
+	if (!g_vocations.loadFromXml()) {
+		startupErrorMessage("Unable to load vocations!");
+		return false;
+	}
+
+	if (!Item::items.load()) {
+		startupErrorMessage("Unable to load items!");
+		return false;
+	}
+
+	if (!Outfits::getInstance().loadFromXml()) {
+		startupErrorMessage("Unable to load outfits!");
+		return false;
+	}
+	return true;
+}
+
 bool argumentsHandler(const StringVector& args)
 {
 	for (const auto& arg : args) {
@@ -332,7 +466,13 @@ bool argumentsHandler(const StringVector& args)
 			"\t--ip=$1\t\t\tIP address of the server.\n"
 			"\t\t\t\tShould be equal to the global IP.\n"
 			"\t--login-port=$1\tPort for login server to listen on.\n"
-			"\t--game-port=$1\tPort for game server to listen on.\n";
+			"\t--game-port=$1\tPort for game server to listen on.\n"
+			"\t--world-config=$1\tConfig file of one of several worlds started together.\n"
+			"\t--simulate=$1\t\tRun $1 ticks of the world offline and exit.\n"
+			"\t--simulate-players=$1\tSimulated players at the first temple.\n"
+			"\t--simulate-seed=$1\tRandom seed of the simulation.\n"
+			"\t--simulate-tick=$1\tVirtual milliseconds per tick.\n"
+			"\t--simulate-output=$1\tCSV file of per-tick timings.\n";
 			return false;
 		} else if (arg == "--version") {
 			printServerVersion();
@@ -349,6 +489,8 @@ bool argumentsHandler(const StringVector& args)
 			g_config.setNumber(ConfigManager::LOGIN_PORT, std::stoi(tmp[1]));
 		else if (tmp[0] == "--game-port")
 			g_config.setNumber(ConfigManager::GAME_PORT, std::stoi(tmp[1]));
+		else if (tmp.size() > 1 && !g_multiWorld.parseArgument(tmp[0], tmp[1]))
+			g_simulation.parseArgument(tmp[0], tmp[1]);
 	}
 
 	return true;
@@ -6,44 +6,19 @@
 #include "outputmessage.h"
 #include "protocol.h"
 #include "lockfree.h"
-#include "scheduler.h"
-
-extern Scheduler g_scheduler;
 
 namespace {
 
 const uint16_t OUTPUTMESSAGE_FREE_LIST_CAPACITY = 2048;
 const std::chrono::milliseconds OUTPUTMESSAGE_AUTOSEND_DELAY {10};
 
-void sendAll(const std::vector<Protocol_ptr>& bufferedProtocols);
-
-void scheduleSendAll(const std::vector<Protocol_ptr>& bufferedProtocols)
-{
-	g_scheduler.addEvent(createSchedulerTask(OUTPUTMESSAGE_AUTOSEND_DELAY.count(), [&]() { sendAll(bufferedProtocols); }));
-}
-
-void sendAll(const std::vector<Protocol_ptr>& bufferedProtocols)
-{
-	//dispatcher thread
-	for (auto& protocol : bufferedProtocols) {
-		auto& msg = protocol->getCurrentBuffer();
-		if (msg) {
-			protocol->send(std::move(msg));
-		}
-	}
-
-	if (!bufferedProtocols.empty()) {
-		scheduleSendAll(bufferedProtocols);
-	}
-}
-
 }
 
 void OutputMessagePool::addProtocolToAutosend(Protocol_ptr protocol)
 {
 	//dispatcher thread
 	if (bufferedProtocols.empty()) {
-		scheduleSendAll(bufferedProtocols);
+		nextAutosend = std::chrono::steady_clock::now() + OUTPUTMESSAGE_AUTOSEND_DELAY;
 	}
 	bufferedProtocols.emplace_back(protocol);
 }
@@ -58,6 +33,34 @@ void OutputMessagePool::removeProtocolFromAutosend(const Protocol_ptr& protocol)
 	}
 }
 
+std::chrono::steady_clock::time_point OutputMessagePool::sendAll()
+{
+	//dispatcher thread
+	if (bufferedProtocols.empty()) {
+		return std::chrono::steady_clock::time_point::max();
+	}
+
+	auto now = std::chrono::steady_clock::now();
+	if (now < nextAutosend) {
+		return nextAutosend;
+	}
+
+	for (const Protocol_ptr& protocol : bufferedProtocols) {
+		protocol->flush();
+	}
+
+	nextAutosend = now + OUTPUTMESSAGE_AUTOSEND_DELAY;
+	return nextAutosend;
+}
+
+void OutputMessagePool::flushAll(std::vector<Protocol_ptr>& protocols)
+{
+	for (const Protocol_ptr& protocol : protocols) {
+		protocol->flush();
+	}
+	protocols.clear();
+}
+
 OutputMessage_ptr OutputMessagePool::getOutputMessage()
 {
 	// LockfreePoolingAllocator<void,...> will leave (void* allocate) ill-formed because
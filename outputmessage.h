@@ -7,10 +7,11 @@
 #include "networkmessage.h"
 #include "connection.h"
 #include "tools.h"
+#include "memoryaccounting.h"
 
 class Protocol;
 
-class OutputMessage : public NetworkMessage
+class OutputMessage : public NetworkMessage, private MemoryTracked<OutputMessage, MEMORY_OUTPUT_MESSAGES>
 {
 	public:
 		OutputMessage() = default;
@@ -35,8 +36,31 @@ class OutputMessage : public NetworkMessage
 			writeMessageLength();
 		}
 
+		// sequenced packets carry a counter instead of the checksum, the highest
+		// bit tells the client the body is compressed
+		void addSequenceHeader(uint32_t sequence, bool compressed) {
+			add_header((sequence & 0x7FFFFFFF) | (compressed ? 0x80000000 : 0));
+			writeMessageLength();
+		}
+
+		void setBody(const uint8_t* data, MsgSize_t length) {
+			assert(outputBufferStart + length <= NETWORKMESSAGE_MAXSIZE);
+			reserve(outputBufferStart + length);
+			memcpy(buffer + outputBufferStart, data, length);
+			info.length = length;
+			info.position = outputBufferStart + length;
+		}
+
+		void setCompression(bool value) {
+			compression = value;
+		}
+		bool getCompression() const {
+			return compression;
+		}
+
 		void append(const NetworkMessage& msg) {
 			auto msgLen = msg.getLength();
+			reserve(info.position + msgLen);
 			memcpy(buffer + info.position, msg.getBuffer() + 8, msgLen);
 			info.length += msgLen;
 			info.position += msgLen;
@@ -44,6 +68,7 @@ class OutputMessage : public NetworkMessage
 
 		void append(const OutputMessage_ptr& msg) {
 			auto msgLen = msg->getLength();
+			reserve(info.position + msgLen);
 			memcpy(buffer + info.position, msg->getBuffer() + 8, msgLen);
 			info.length += msgLen;
 			info.position += msgLen;
@@ -60,6 +85,7 @@ class OutputMessage : public NetworkMessage
 		}
 
 		MsgSize_t outputBufferStart = INITIAL_BUFFER_POSITION;
+		bool compression = false;
 };
 
 class OutputMessagePool
@@ -78,11 +104,40 @@ class OutputMessagePool
 
 		void addProtocolToAutosend(Protocol_ptr protocol);
 		void removeProtocolFromAutosend(const Protocol_ptr& protocol);
+
+		// the protocol is flushed in the output phase of the running dispatcher frame
+		void addProtocolToFlush(Protocol_ptr protocol) {
+			flushProtocols.emplace_back(std::move(protocol));
+		}
+
+		// dispatcher thread, called once per frame
+		void flushRequested() {
+			if (!flushProtocols.empty()) {
+				flushProtocols.swap(flushingProtocols);
+				flushAll(flushingProtocols);
+			}
+		}
+
+		// dispatcher thread
+		size_t getBufferedProtocolCount() const {
+			return bufferedProtocols.size();
+		}
+
+		// dispatcher thread, flushes every buffered protocol once the autosend delay
+		// has passed and returns when that is due again
+		std::chrono::steady_clock::time_point sendAll();
+
 	private:
 		OutputMessagePool() = default;
+
+		static void flushAll(std::vector<Protocol_ptr>& protocols);
+
 		//NOTE: A vector is used here because this container is mostly read
 		//and relatively rarely modified (only when a client connects/disconnects)
 		std::vector<Protocol_ptr> bufferedProtocols;
+		std::vector<Protocol_ptr> flushProtocols;
+		std::vector<Protocol_ptr> flushingProtocols;
+		std::chrono::steady_clock::time_point nextAutosend;
 };
 
 #endif
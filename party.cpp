@@ -94,6 +94,7 @@ bool Party::leaveParty(Player* player)
 	if (it != memberList.end()) {
 		memberList.erase(it);
 	}
+	updateSharedExperienceLevel();
 
 	player->setParty(nullptr);
 	player->sendClosePrivate(CHANNEL_PARTY);
@@ -192,6 +193,7 @@ bool Party::joinParty(Player& player)
 	player.sendPlayerPartyIcons(leader);
 
 	memberList.push_back(&player);
+	updateSharedExperienceLevel();
 
 	g_game.updatePlayerHelpers(player);
 
@@ -304,6 +306,8 @@ void Party::broadcastPartyMessage(MessageClasses msgClass, const std::string& ms
 
 void Party::updateSharedExperience()
 {
+	updateSharedExperienceLevel();
+
 	if (sharedExpActive) {
 		bool result = getSharedExperienceStatus() == SHAREDEXP_OK;
 		if (result != sharedExpEnabled) {
@@ -313,6 +317,40 @@ void Party::updateSharedExperience()
 	}
 }
 
+void Party::updateSharedExperienceLevel()
+{
+	if (!leader) {
+		return;
+	}
+
+	uint32_t highestLevel = leader->getLevel();
+	for (Player* member : memberList) {
+		if (member->getLevel() > highestLevel) {
+			highestLevel = member->getLevel();
+		}
+	}
+	minSharedLevel = static_cast<uint32_t>(std::ceil((static_cast<float>(highestLevel) * 2) / 3));
+}
+
+void Party::updateMemberPosition(const Player* player)
+{
+	if (!sharedExpActive) {
+		return;
+	}
+
+	// the leader is the reference point for every range check, an activity may also have expired
+	if (player == leader || !sharedExpEnabled || OTSYS_TIME() > sharedExpExpiry) {
+		updateSharedExperience();
+		return;
+	}
+
+	// only this member's range can have changed, everyone else keeps their last result
+	if (!Position::areInRange<EXPERIENCE_SHARE_RANGE, EXPERIENCE_SHARE_RANGE, EXPERIENCE_SHARE_FLOORS>(leader->getPosition(), player->getPosition())) {
+		sharedExpEnabled = false;
+		updateAllPartyIcons();
+	}
+}
+
 namespace {
 
 const char* getSharedExpReturnMessage(SharedExpStatus_t value)
@@ -381,15 +419,7 @@ SharedExpStatus_t Party::getMemberSharedExperienceStatus(const Player* player) c
 		return SHAREDEXP_EMPTYPARTY;
 	}
 
-	uint32_t highestLevel = leader->getLevel();
-	for (Player* member : memberList) {
-		if (member->getLevel() > highestLevel) {
-			highestLevel = member->getLevel();
-		}
-	}
-
-	uint32_t minLevel = static_cast<uint32_t>(std::ceil((static_cast<float>(highestLevel) * 2) / 3));
-	if (player->getLevel() < minLevel) {
+	if (player->getLevel() < minSharedLevel) {
 		return SHAREDEXP_LEVELDIFFTOOLARGE;
 	}
 
@@ -414,6 +444,13 @@ SharedExpStatus_t Party::getMemberSharedExperienceStatus(const Player* player) c
 
 SharedExpStatus_t Party::getSharedExperienceStatus()
 {
+	// a member turns inactive without any event, remember when the first one will so moves can notice
+	const int64_t inactivityTime = g_config.getNumber(ConfigManager::PZ_LOCKED);
+	sharedExpExpiry = std::numeric_limits<int64_t>::max();
+	for (const auto& it : ticksMap) {
+		sharedExpExpiry = std::min<int64_t>(sharedExpExpiry, it.second + inactivityTime);
+	}
+
 	SharedExpStatus_t leaderStatus = getMemberSharedExperienceStatus(leader);
 	if (leaderStatus != SHAREDEXP_OK) {
 		return leaderStatus;
@@ -431,8 +468,15 @@ SharedExpStatus_t Party::getSharedExperienceStatus()
 void Party::updatePlayerTicks(Player* player, uint32_t points)
 {
 	if (points != 0 && !player->hasFlag(PlayerFlag_NotGainInFight)) {
-		ticksMap[player->getID()] = OTSYS_TIME();
-		updateSharedExperience();
+		int64_t now = OTSYS_TIME();
+		int64_t& lastTick = ticksMap[player->getID()];
+		bool wasActive = lastTick != 0 && now - lastTick <= g_config.getNumber(ConfigManager::PZ_LOCKED);
+		lastTick = now;
+
+		// refreshing an already active member cannot change the result, only a reactivation can
+		if (!wasActive || !sharedExpEnabled) {
+			updateSharedExperience();
+		}
 	}
 }
 
@@ -72,15 +72,21 @@ class Party
 		bool canUseSharedExperience(const Player* player) const;
 		SharedExpStatus_t getMemberSharedExperienceStatus(const Player* player) const;
 		void updateSharedExperience();
+		void updateMemberPosition(const Player* player);
 
 		void updatePlayerTicks(Player* player, uint32_t points);
 		void clearPlayerPoints(Player* player);
 
 	private:
 		SharedExpStatus_t getSharedExperienceStatus();
+		void updateSharedExperienceLevel();
 
 		std::map<uint32_t, int64_t> ticksMap;
 
+		// cached from the last full evaluation so moves and icon updates do not rescan every member
+		int64_t sharedExpExpiry = 0;
+		uint32_t minSharedLevel = 0;
+
 		PlayerVector memberList;
 		PlayerVector inviteList;
 
@@ -29,7 +29,22 @@ extern Events* g_events;
 
 MuteCountMap Player::muteCountMap;
 
-uint32_t Player::playerAutoID = 0x10000000;
+namespace {
+
+constexpr std::array<uint64_t, Player::EXPERIENCE_TABLE_LEVELS> makeExperienceTable()
+{
+	std::array<uint64_t, Player::EXPERIENCE_TABLE_LEVELS> table{};
+	for (size_t level = 0; level < table.size(); ++level) {
+		table[level] = Player::computeExpForLevel(level);
+	}
+	return table;
+}
+
+}
+
+constexpr std::array<uint64_t, Player::EXPERIENCE_TABLE_LEVELS> Player::experienceTable = makeExperienceTable();
+
+CreatureIdTable<Player> Player::ids{0x10000000, 28};
 
 Player::Player(ProtocolGame_ptr p) :
 	Creature(), lastPing(OTSYS_TIME()), lastPong(lastPing), inbox(new Inbox(ITEM_INBOX)), storeInbox(new StoreInbox(ITEM_STORE_INBOX)), client(std::move(p))
@@ -42,6 +57,8 @@ Player::Player(ProtocolGame_ptr p) :
 
 Player::~Player()
 {
+	ids.release(id);
+
 	for (Item* item : inventory) {
 		if (item) {
 			item->setParent(nullptr);
@@ -667,7 +684,9 @@ uint16_t Player::getLookCorpse() const
 void Player::addStorageValue(const uint32_t key, const int32_t value, const bool isLogin/* = false*/)
 {
 	if (IS_IN_KEYRANGE(key, RESERVED_RANGE)) {
+		unlockedExtensionsDirty = true;
 		if (IS_IN_KEYRANGE(key, OUTFITS_RANGE)) {
+			outfitStorageEnd = std::max(outfitStorageEnd, key);
 			outfits.emplace_back(
 				value >> 16,
 				value & 0xFF
@@ -687,15 +706,26 @@ void Player::addStorageValue(const uint32_t key, const int32_t value, const bool
 
 		storageMap[key] = value;
 
+		if (oldValue != value) {
+			g_game.quests.onStorageChange(this, key);
+		}
+
 		if (!isLogin) {
+			if (oldValue != value) {
+				changedStorageKeys.insert(key);
+			}
+
 			auto currentFrameTime = g_dispatcher.getDispatcherCycle();
 			if (lastQuestlogUpdate != currentFrameTime && g_game.quests.isQuestStorage(key, value, oldValue)) {
 				lastQuestlogUpdate = currentFrameTime;
 				sendTextMessage(MESSAGE_EVENT_ADVANCE, "Your questlog has been updated.");
 			}
 		}
-	} else {
-		storageMap.erase(key);
+	} else if (storageMap.erase(key) != 0) {
+		g_game.quests.onStorageChange(this, key);
+		if (!isLogin) {
+			changedStorageKeys.insert(key);
+		}
 	}
 }
 
@@ -855,10 +885,45 @@ void Player::sendCancelMessage(ReturnValue message) const
 
 void Player::sendStats()
 {
-	if (client) {
+	if (client && !deferUpdate(PLAYER_UPDATE_STATS)) {
+		client->sendStats();
+		lastStatsTrainingTime = getOfflineTrainingTime() / 60 / 1000;
+	}
+}
+
+bool Player::deferUpdate(uint8_t update) const
+{
+	if (!g_config.getBoolean(ConfigManager::COALESCE_PLAYER_UPDATES)) {
+		return false;
+	}
+
+	if (pendingUpdates == 0) {
+		g_game.addPendingPlayerUpdate(getID());
+	}
+	pendingUpdates |= update;
+	return true;
+}
+
+void Player::flushUpdates()
+{
+	uint8_t updates = pendingUpdates;
+	pendingUpdates = 0;
+	if (!client) {
+		return;
+	}
+
+	if (updates & PLAYER_UPDATE_STATS) {
 		client->sendStats();
 		lastStatsTrainingTime = getOfflineTrainingTime() / 60 / 1000;
 	}
+
+	if (updates & PLAYER_UPDATE_SKILLS) {
+		client->sendSkills();
+	}
+
+	if (updates & PLAYER_UPDATE_ICONS) {
+		client->sendIcons(getClientIcons());
+	}
 }
 
 void Player::sendPing()
@@ -956,7 +1021,7 @@ void Player::sendHouseWindow(House* house, uint32_t listId) const
 //container
 void Player::sendAddContainerItem(const Container* container, const Item* item)
 {
-	if (!client) {
+	if (!client || deferContainerRefresh(container)) {
 		return;
 	}
 
@@ -988,7 +1053,7 @@ void Player::sendAddContainerItem(const Container* container, const Item* item)
 
 void Player::sendUpdateContainerItem(const Container* container, uint16_t slot, const Item* newItem)
 {
-	if (!client) {
+	if (!client || deferContainerRefresh(container)) {
 		return;
 	}
 
@@ -1013,7 +1078,7 @@ void Player::sendUpdateContainerItem(const Container* container, uint16_t slot,
 
 void Player::sendRemoveContainerItem(const Container* container, uint16_t slot)
 {
-	if (!client) {
+	if (!client || deferContainerRefresh(container)) {
 		return;
 	}
 
@@ -1033,6 +1098,54 @@ void Player::sendRemoveContainerItem(const Container* container, uint16_t slot)
 	}
 }
 
+bool Player::deferContainerRefresh(const Container* container)
+{
+	if (!g_game.isMovingItems()) {
+		return false;
+	}
+
+	bool deferred = false;
+	for (const auto& it : openContainers) {
+		if (it.second.container != container) {
+			continue;
+		}
+
+		if (pendingContainerRefreshes.empty()) {
+			g_game.addPendingContainerRefresh(getID());
+		}
+
+		if (std::find(pendingContainerRefreshes.begin(), pendingContainerRefreshes.end(), it.first) == pendingContainerRefreshes.end()) {
+			pendingContainerRefreshes.push_back(it.first);
+		}
+		deferred = true;
+	}
+	return deferred;
+}
+
+void Player::flushContainerRefreshes()
+{
+	std::vector<uint8_t> cids;
+	cids.swap(pendingContainerRefreshes);
+	if (!client) {
+		return;
+	}
+
+	for (uint8_t cid : cids) {
+		auto it = openContainers.find(cid);
+		if (it == openContainers.end()) {
+			continue;
+		}
+
+		// items taken out may have emptied the page that was shown
+		OpenContainer& openContainer = it->second;
+		const Container* container = openContainer.container;
+		while (openContainer.index > 0 && openContainer.index >= container->size()) {
+			openContainer.index -= std::min<uint16_t>(openContainer.index, container->capacity());
+		}
+		client->sendContainer(cid, container, container->hasParent(), openContainer.index);
+	}
+}
+
 void Player::onUpdateTileItem(const Tile* tile, const Position& pos, const Item* oldItem,
                               const ItemType& oldType, const Item* newItem, const ItemType& newType)
 {
@@ -1250,6 +1363,13 @@ void Player::openShopWindow(Npc* npc, const std::list<ShopInfo>& shop)
 	sendSaleItemList();
 }
 
+void Player::sendShop(Npc* npc) const
+{
+	if (client) {
+		client->sendShop(npc->getShopPayload(shopItemList));
+	}
+}
+
 bool Player::closeShopWindow(bool sendCloseShopWindow /*= true*/)
 {
 	//unreference callbacks
@@ -1323,7 +1443,7 @@ void Player::onCreatureMove(Creature* creature, const Tile* newTile, const Posit
 	}
 
 	if (party) {
-		party->updateSharedExperience();
+		party->updateMemberPosition(this);
 	}
 
 	if (teleport || oldPos.z != newPos.z) {
@@ -1930,10 +2050,18 @@ BlockType_t Player::blockHit(Creature* attacker, CombatType_t combatType, int32_
 	}
 
 	if (!ignoreResistances) {
-		for (int32_t slot = CONST_SLOT_FIRST; slot <= CONST_SLOT_BADGE; ++slot) { 
-			if (!isItemAbilityEnabled(static_cast<slots_t>(slot))) {
+		// only the slots holding an absorb for this combat type are visited
+		size_t combatIndex = combatTypeToIndex(combatType);
+		uint32_t slots = absorbSlots[combatIndex];
+		if (field) {
+			slots |= fieldAbsorbSlots[combatIndex];
+		}
+
+		for (int32_t slot = CONST_SLOT_FIRST; slots != 0 && slot <= CONST_SLOT_BADGE; ++slot) {
+			if ((slots & (1u << slot)) == 0) {
 				continue;
 			}
+			slots &= ~(1u << slot);
 
 			Item* item = inventory[slot];
 			if (!item) {
@@ -1942,15 +2070,10 @@ BlockType_t Player::blockHit(Creature* attacker, CombatType_t combatType, int32_
 
 			const ItemType& it = Item::items[item->getID()];
 			if (!it.abilities) {
-				if (damage <= 0) {
-					damage = 0;
-					return BLOCK_ARMOR;
-				}
-
 				continue;
 			}
 
-			const int16_t& absorbPercent = it.abilities->absorbPercent[combatTypeToIndex(combatType)];
+			const int16_t& absorbPercent = it.abilities->absorbPercent[combatIndex];
 			if (absorbPercent != 0) {
 				damage -= std::round(damage * (absorbPercent / 100.));
 
@@ -1961,7 +2084,7 @@ BlockType_t Player::blockHit(Creature* attacker, CombatType_t combatType, int32_
 			}
 
 			if (field) {
-				const int16_t& fieldAbsorbPercent = it.abilities->fieldAbsorbPercent[combatTypeToIndex(combatType)];
+				const int16_t& fieldAbsorbPercent = it.abilities->fieldAbsorbPercent[combatIndex];
 				if (fieldAbsorbPercent != 0) {
 					damage -= std::round(damage * (fieldAbsorbPercent / 100.));
 
@@ -1981,6 +2104,30 @@ BlockType_t Player::blockHit(Creature* attacker, CombatType_t combatType, int32_
 	return blockType;
 }
 
+void Player::setItemAbsorbs(slots_t slot, const Abilities* abilities)
+{
+	// hits only take absorbs from the slots up to the badge
+	if (slot > CONST_SLOT_BADGE) {
+		return;
+	}
+
+	uint32_t bit = 1u << slot;
+	for (size_t i = 0; i < COMBAT_COUNT; ++i) {
+		absorbSlots[i] &= ~bit;
+		fieldAbsorbSlots[i] &= ~bit;
+		if (!abilities) {
+			continue;
+		}
+
+		if (abilities->absorbPercent[i] != 0) {
+			absorbSlots[i] |= bit;
+		}
+		if (abilities->fieldAbsorbPercent[i] != 0) {
+			fieldAbsorbSlots[i] |= bit;
+		}
+	}
+}
+
 uint32_t Player::getIP() const
 {
 	if (client) {
@@ -2001,10 +2148,10 @@ void Player::death(Creature* lastHitCreature)
 		if (lastHitPlayer) {
 			uint32_t sumLevels = 0;
 			uint32_t inFightTicks = g_config.getNumber(ConfigManager::PZ_LOCKED);
-			for (const auto& it : damageMap) {
-				CountBlock_t cb = it.second;
-				if ((OTSYS_TIME() - cb.ticks) <= inFightTicks) {
-					Player* damageDealer = g_game.getPlayerByID(it.first);
+			const int64_t timeNow = OTSYS_TIME();
+			for (const DamageEntry& damage : damageList) {
+				if ((timeNow - damage.ticks) <= inFightTicks) {
+					Player* damageDealer = g_game.getPlayerByID(damage.attackerId);
 					if (damageDealer) {
 						sumLevels += damageDealer->getLevel();
 					}
@@ -2187,20 +2334,16 @@ void Player::addInFightTicks(bool pzlock /*= false*/)
 
 void Player::removeList()
 {
+	ids.setCreature(id, nullptr);
 	g_game.removePlayer(this);
-
-	for (const auto& it : g_game.getPlayers()) {
-		it.second->notifyStatusChange(this, VIPSTATUS_OFFLINE);
-	}
+	g_game.notifyVIPSubscribers(this, VIPSTATUS_OFFLINE);
 }
 
 void Player::addList()
 {
-	for (const auto& it : g_game.getPlayers()) {
-		it.second->notifyStatusChange(this, VIPSTATUS_ONLINE);
-	}
-
+	g_game.notifyVIPSubscribers(this, VIPSTATUS_ONLINE);
 	g_game.addPlayer(this);
+	ids.setCreature(id, this);
 }
 
 void Player::kickPlayer(bool displayEffect)
@@ -2239,6 +2382,10 @@ bool Player::removeVIP(uint32_t vipGuid)
 		return false;
 	}
 
+	if (g_game.getPlayerByID(getID()) == this) {
+		g_game.removeVIPSubscriber(vipGuid, this);
+	}
+
 	IOLoginData::removeVIPEntry(accountNumber, vipGuid);
 	return true;
 }
@@ -2256,6 +2403,10 @@ bool Player::addVIP(uint32_t vipGuid, const std::string& vipName, VipStatus_t st
 		return false;
 	}
 
+	if (g_game.getPlayerByID(getID()) == this) {
+		g_game.addVIPSubscriber(vipGuid, this);
+	}
+
 	IOLoginData::addVIPEntry(accountNumber, vipGuid, "", 0, false);
 	if (client) {
 		client->sendVIP(vipGuid, vipName, "", 0, false, status);
@@ -2269,7 +2420,14 @@ bool Player::addVIPInternal(uint32_t vipGuid)
 		return false;
 	}
 
-	return VIPList.insert(vipGuid).second;
+	if (!VIPList.insert(vipGuid).second) {
+		return false;
+	}
+
+	if (g_game.getPlayerByID(getID()) == this) {
+		g_game.addVIPSubscriber(vipGuid, this);
+	}
+	return true;
 }
 
 bool Player::editVIP(uint32_t vipGuid, const std::string& description, uint32_t icon, bool notify)
@@ -2826,6 +2984,7 @@ void Player::addThing(int32_t index, Thing* thing)
 
 	item->setParent(this);
 	inventory[index] = item;
+	invalidateItemTypeCounts();
 
 	//send to client
 	sendInventoryItem(static_cast<slots_t>(index), item);
@@ -2845,6 +3004,7 @@ void Player::updateThing(Thing* thing, uint16_t itemId, uint32_t count)
 
 	item->setID(itemId);
 	item->setSubType(count);
+	invalidateItemTypeCounts();
 
 	//send to client
 	sendInventoryItem(static_cast<slots_t>(index), item);
@@ -2878,6 +3038,7 @@ void Player::replaceThing(uint32_t index, Thing* thing)
 	item->setParent(this);
 
 	inventory[index] = item;
+	invalidateItemTypeCounts();
 }
 
 void Player::removeThing(Thing* thing, uint32_t count)
@@ -2892,6 +3053,8 @@ void Player::removeThing(Thing* thing, uint32_t count)
 		return /*RETURNVALUE_NOTPOSSIBLE*/;
 	}
 
+	invalidateItemTypeCounts();
+
 	if (item->isStackable()) {
 		if (count == item->getItemCount()) {
 			//send change to client
@@ -2946,6 +3109,12 @@ size_t Player::getLastIndex() const
 
 uint32_t Player::getItemTypeCount(uint16_t itemId, int32_t subType /*= -1*/) const
 {
+	if (subType == -1) {
+		updateItemTypeCounts();
+		auto it = itemTypeCounts.find(itemId);
+		return it != itemTypeCounts.end() ? it->second : 0;
+	}
+
 	uint32_t count = 0;
 	for (int32_t i = CONST_SLOT_FIRST; i <= CONST_SLOT_LAST; i++) {
 		Item* item = inventory[i];
@@ -2968,6 +3137,39 @@ uint32_t Player::getItemTypeCount(uint16_t itemId, int32_t subType /*= -1*/) con
 	return count;
 }
 
+void Player::updateItemTypeCounts() const
+{
+	if (!itemTypeCountsDirty) {
+		return;
+	}
+
+	itemTypeCounts.clear();
+	inventoryMoney = 0;
+
+	for (int32_t i = CONST_SLOT_FIRST; i <= CONST_SLOT_LAST; i++) {
+		Item* item = inventory[i];
+		if (!item) {
+			continue;
+		}
+
+		itemTypeCounts[item->getID()] += item->getItemCount();
+
+		if (Container* container = item->getContainer()) {
+			for (ContainerIterator it = container->iterator(); it.hasNext(); it.advance()) {
+				const Item* containerItem = *it;
+				itemTypeCounts[containerItem->getID()] += containerItem->getItemCount();
+				if (!containerItem->getContainer()) {
+					inventoryMoney += containerItem->getWorth();
+				}
+			}
+		} else {
+			inventoryMoney += item->getWorth();
+		}
+	}
+
+	itemTypeCountsDirty = false;
+}
+
 bool Player::removeItemOfType(uint16_t itemId, uint32_t amount, int32_t subType, bool ignoreEquipped/* = false*/) const
 {
 	if (amount == 0) {
@@ -3021,19 +3223,9 @@ bool Player::removeItemOfType(uint16_t itemId, uint32_t amount, int32_t subType,
 
 std::map<uint32_t, uint32_t>& Player::getAllItemTypeCount(std::map<uint32_t, uint32_t>& countMap) const
 {
-	for (int32_t i = CONST_SLOT_FIRST; i <= CONST_SLOT_LAST; i++) {
-		Item* item = inventory[i];
-		if (!item) {
-			continue;
-		}
-
-		countMap[item->getID()] += Item::countByType(item, -1);
-
-		if (Container* container = item->getContainer()) {
-			for (ContainerIterator it = container->iterator(); it.hasNext(); it.advance()) {
-				countMap[(*it)->getID()] += Item::countByType(*it, -1);
-			}
-		}
+	updateItemTypeCounts();
+	for (const auto& it : itemTypeCounts) {
+		countMap[it.first] += it.second;
 	}
 	return countMap;
 }
@@ -3068,6 +3260,7 @@ void Player::postAddNotification(Thing* thing, const Cylinder* oldParent, int32_
 			requireListUpdate = oldParent != this;
 		}
 
+		invalidateItemTypeCounts();
 		updateInventoryWeight();
 		updateItemsLight();
 		sendStats();
@@ -3122,6 +3315,7 @@ void Player::postRemoveNotification(Thing* thing, const Cylinder* newParent, int
 			requireListUpdate = newParent != this;
 		}
 
+		invalidateItemTypeCounts();
 		updateInventoryWeight();
 		updateItemsLight();
 		sendStats();
@@ -3213,6 +3407,7 @@ void Player::internalAddThing(uint32_t index, Thing* thing)
 
 		inventory[index] = item;
 		item->setParent(this);
+		invalidateItemTypeCounts();
 	}
 }
 
@@ -3316,12 +3511,12 @@ void Player::doAttacking(uint32_t)
 	}
 }
 
-uint64_t Player::getGainedExperience(Creature* attacker) const
+uint64_t Player::getGainedExperience(Creature* attacker, double damageRatio, uint64_t lostExperience) const
 {
 	if (g_config.getBoolean(ConfigManager::EXPERIENCE_FROM_PLAYERS)) {
 		Player* attackerPlayer = attacker->getPlayer();
 		if (attackerPlayer && attackerPlayer != this && skillLoss && std::abs(static_cast<int32_t>(attackerPlayer->getLevel() - level)) <= g_config.getNumber(ConfigManager::EXP_FROM_PLAYERS_LEVEL_RANGE)) {
-			return std::max<uint64_t>(0, std::floor(getLostExperience() * getDamageRatio(attacker) * 0.75));
+			return std::max<uint64_t>(0, std::floor(lostExperience * damageRatio * 0.75));
 		}
 	}
 	return 0;
@@ -3810,8 +4005,23 @@ void Player::genReservedStorageRange()
 	//generate outfits range
 	uint32_t base_key = PSTRG_OUTFITS_RANGE_START;
 	for (const OutfitEntry& entry : outfits) {
-		storageMap[++base_key] = (entry.lookType << 16) | entry.addons;
+		int32_t value = (entry.lookType << 16) | entry.addons;
+		auto it = storageMap.find(++base_key);
+		if (it == storageMap.end()) {
+			storageMap.emplace(base_key, value);
+			changedStorageKeys.insert(base_key);
+		} else if (it->second != value) {
+			it->second = value;
+			changedStorageKeys.insert(base_key);
+		}
+	}
+
+	//drop the keys of outfits removed since they were written
+	for (uint32_t key = base_key + 1; key <= outfitStorageEnd; ++key) {
+		storageMap.erase(key);
+		changedStorageKeys.insert(key);
 	}
+	outfitStorageEnd = base_key;
 }
 
 void Player::addOutfit(uint16_t lookType, uint8_t addons)
@@ -4392,6 +4602,37 @@ bool Player::removeAura(uint8_t auraId) {
 }
 
 
+bool Player::hasUnlockedExtension(PlayerExtension_t extension, uint8_t id) const
+{
+	if (unlockedExtensionsDirty) {
+		static constexpr uint32_t rangeStarts[PLAYER_EXTENSION_LAST] = {
+			PSTRG_MOUNTS_RANGE_START, PSTRG_WINGS_RANGE_START, PSTRG_AURAS_RANGE_START, PSTRG_SHADERS_RANGE_START
+		};
+
+		for (size_t i = 0; i < PLAYER_EXTENSION_LAST; ++i) {
+			auto& unlocked = unlockedExtensions[i];
+			unlocked.reset();
+
+			// ids are stored one based, 31 per storage key
+			for (uint32_t keyIndex = 0; keyIndex * 31 < unlocked.size(); ++keyIndex) {
+				int32_t value;
+				if (!getStorageValue(rangeStarts[i] + keyIndex, value)) {
+					continue;
+				}
+
+				for (uint32_t bit = 0; bit < 31; ++bit) {
+					uint32_t unlockedId = keyIndex * 31 + bit + 1;
+					if ((value & (1 << bit)) != 0 && unlockedId < unlocked.size()) {
+						unlocked.set(unlockedId);
+					}
+				}
+			}
+		}
+		unlockedExtensionsDirty = false;
+	}
+	return unlockedExtensions[extension].test(id);
+}
+
 bool Player::hasMount(const Mount* mount) const
 {
 	if (isAccessPlayer()) {
@@ -4402,14 +4643,7 @@ bool Player::hasMount(const Mount* mount) const
 		return false;
 	}
 
-	const uint8_t tmpMountId = mount->id - 1;
-
-	int32_t value;
-	if (!getStorageValue(PSTRG_MOUNTS_RANGE_START + (tmpMountId / 31), value)) {
-		return false;
-	}
-
-	return ((1 << (tmpMountId % 31)) & value) != 0;
+	return hasUnlockedExtension(PLAYER_EXTENSION_MOUNT, mount->id);
 }
 
 void Player::dismount()
@@ -4453,14 +4687,7 @@ bool Player::hasWing(const Wing* wing) const
 		return false;
 	}
 
-	const uint8_t tmpWingId = wing->id - 1;
-
-	int32_t value;
-	if (!getStorageValue(PSTRG_WINGS_RANGE_START + (tmpWingId / 31), value)) {
-		return false;
-	}
-
-	return ((1 << (tmpWingId % 31)) & value) != 0;
+	return hasUnlockedExtension(PLAYER_EXTENSION_WING, wing->id);
 }
 
 uint8_t Player::getCurrentWing() const
@@ -4509,14 +4736,7 @@ bool Player::hasAura(const Aura* aura) const
 		return false;
 	}
 
-	const uint8_t tmpAuraId = aura->id - 1;
-
-	int32_t value;
-	if (!getStorageValue(PSTRG_AURAS_RANGE_START + (tmpAuraId / 31), value)) {
-		return false;
-	}
-
-	return ((1 << (tmpAuraId % 31)) & value) != 0;
+	return hasUnlockedExtension(PLAYER_EXTENSION_AURA, aura->id);
 }
 
 uint8_t Player::getCurrentAura() const
@@ -4564,14 +4784,7 @@ bool Player::hasShader(const Shader* shader) const
 		return false;
 	}
 
-	const uint8_t tmpShaderId = shader->id - 1;
-
-	int32_t value;
-	if (!getStorageValue(PSTRG_SHADERS_RANGE_START + (tmpShaderId / 31), value)) {
-		return false;
-	}
-
-	return ((1 << (tmpShaderId % 31)) & value) != 0;
+	return hasUnlockedExtension(PLAYER_EXTENSION_SHADER, shader->id);
 }
 
 bool Player::addOfflineTrainingTries(skills_t skill, uint64_t tries)
@@ -4768,36 +4981,8 @@ void Player::sendClosePrivate(uint16_t channelId)
 
 uint64_t Player::getMoney() const
 {
-	std::vector<const Container*> containers;
-	uint64_t moneyCount = 0;
-
-	for (int32_t i = CONST_SLOT_FIRST; i <= CONST_SLOT_LAST; ++i) {
-		Item* item = inventory[i];
-		if (!item) {
-			continue;
-		}
-
-		const Container* container = item->getContainer();
-		if (container) {
-			containers.push_back(container);
-		} else {
-			moneyCount += item->getWorth();
-		}
-	}
-
-	size_t i = 0;
-	while (i < containers.size()) {
-		const Container* container = containers[i++];
-		for (const Item* item : container->getItemList()) {
-			const Container* tmpContainer = item->getContainer();
-			if (tmpContainer) {
-				containers.push_back(tmpContainer);
-			} else {
-				moneyCount += item->getWorth();
-			}
-		}
-	}
-	return moneyCount;
+	updateItemTypeCounts();
+	return inventoryMoney;
 }
 
 size_t Player::getMaxVIPEntries() const
@@ -63,6 +63,41 @@ enum tradestate_t : uint8_t {
 	TRADE_TRANSFER,
 };
 
+// parts of a character save that are not rewritten while their content is unchanged
+enum PlayerSaveSection_t : uint8_t {
+	PLAYER_SAVE_SPELLS,
+	PLAYER_SAVE_ITEMS,
+	PLAYER_SAVE_DEPOT,
+	PLAYER_SAVE_INBOX,
+	PLAYER_SAVE_STORE_INBOX,
+
+	PLAYER_SAVE_SECTIONS
+};
+
+// depot chests and the inbox are fetched the first time the depot is opened
+enum LockerLoadState_t : uint8_t {
+	LOCKER_UNLOADED,
+	LOCKER_LOADING,
+	LOCKER_LOADED,
+};
+
+// outfit extensions whose ownership is kept as bit flags in reserved storage keys
+enum PlayerExtension_t : uint8_t {
+	PLAYER_EXTENSION_MOUNT,
+	PLAYER_EXTENSION_WING,
+	PLAYER_EXTENSION_AURA,
+	PLAYER_EXTENSION_SHADER,
+
+	PLAYER_EXTENSION_LAST
+};
+
+// client updates collected during a dispatcher frame, see Player::flushUpdates
+enum PlayerUpdate_t : uint8_t {
+	PLAYER_UPDATE_STATS = 1 << 0,
+	PLAYER_UPDATE_SKILLS = 1 << 1,
+	PLAYER_UPDATE_ICONS = 1 << 2,
+};
+
 struct VIPEntry {
 	VIPEntry(uint32_t guid, std::string name, std::string description, uint32_t icon, bool notify) :
 		guid(guid), name(std::move(name)), description(std::move(description)), icon(icon), notify(notify) {}
@@ -118,12 +153,18 @@ class Player final : public Creature, public Cylinder
 
 		void setID() override {
 			if (id == 0) {
-				id = playerAutoID++;
+				id = ids.reserve();
 			}
 		}
 
+		static CreatureIdTable<Player> ids;
+
 		static MuteCountMap muteCountMap;
 
+		// getExpForLevel of the levels below the size, built at compile time
+		static constexpr size_t EXPERIENCE_TABLE_LEVELS = 4096;
+		static const std::array<uint64_t, EXPERIENCE_TABLE_LEVELS> experienceTable;
+
 		const std::string& getName() const override {
 			return name;
 		}
@@ -199,6 +240,9 @@ class Player final : public Creature, public Cylinder
 		void kickPlayer(bool displayEffect);
 
 		static uint64_t getExpForLevel(const uint64_t lv) {
+			return lv < EXPERIENCE_TABLE_LEVELS ? experienceTable[lv] : computeExpForLevel(lv);
+		}
+		static constexpr uint64_t computeExpForLevel(const uint64_t lv) {
 			return (((lv - 6ULL) * lv + 17ULL) * lv - 12ULL) / 6ULL * 100ULL;
 		}
 
@@ -344,6 +388,9 @@ class Player final : public Creature, public Cylinder
 		bool isOffline() const {
 			return (getID() == 0);
 		}
+		bool isLockerLoaded() const {
+			return lockerState == LOCKER_LOADED;
+		}
 		void disconnect() {
 			if (client) {
 				client->disconnect();
@@ -394,6 +441,10 @@ class Player final : public Creature, public Cylinder
 			return ghostMode;
 		}
 		bool canSeeGhostMode(const Creature* creature) const override;
+		// the client sees further than the default aware range, see Map::setWideAwareRange
+		bool hasWideAwareRange() const {
+			return wideAwareRange;
+		}
 		void switchGhostMode() {
 			ghostMode = !ghostMode;
 		}
@@ -513,6 +564,9 @@ class Player final : public Creature, public Cylinder
 		void setItemAbility(slots_t slot, bool enabled) {
 			inventoryAbilities[slot] = enabled;
 		}
+		// the absorbs of the item whose ability is enabled in the slot, nullptr
+		// clears them; set by the equip and de-equip move events
+		void setItemAbsorbs(slots_t slot, const Abilities* abilities);
 
 		void setVarSkill(skills_t skill, int32_t modifier) {
 			varSkills[skill] += modifier;
@@ -545,6 +599,11 @@ class Player final : public Creature, public Cylinder
 
 		uint64_t getMoney() const;
 
+		// called whenever an item below the inventory changes, see updateItemTypeCounts
+		void invalidateItemTypeCounts() {
+			itemTypeCountsDirty = true;
+		}
+
 		Item* getItemByUID(uint32_t uid) const;
 		//safe-trade functions
 		void setTradeState(tradestate_t state) {
@@ -671,7 +730,8 @@ class Player final : public Creature, public Cylinder
 
 		void addInFightTicks(bool pzlock = false);
 
-		uint64_t getGainedExperience(Creature* attacker) const override;
+		using Creature::getGainedExperience;
+		uint64_t getGainedExperience(Creature* attacker, double damageRatio, uint64_t lostExperience) const override;
 
 		//combat event functions
 		void onAddCondition(ConditionType_t type) override;
@@ -892,6 +952,7 @@ class Player final : public Creature, public Cylinder
 				client->sendContainer(cid, container, hasParent, firstIndex);
 			}
 		}
+		void flushContainerRefreshes();
 
 		//inventory
 		void sendInventoryItem(slots_t slot, const Item* item) {
@@ -963,6 +1024,11 @@ class Player final : public Creature, public Cylinder
 				client->sendDistanceShoot(from, to, type);
 			}
 		}
+		void sendDistanceShoot(const NetworkMessage& encoded) const {
+			if (client) {
+				client->sendDistanceShoot(encoded);
+			}
+		}
 		void sendHouseWindow(House* house, uint32_t listId) const;
 		void sendCreatePrivateChannel(uint16_t channelId, const std::string& channelName) {
 			if (client) {
@@ -971,7 +1037,7 @@ class Player final : public Creature, public Cylinder
 		}
 		void sendClosePrivate(uint16_t channelId);
 		void sendIcons() const {
-			if (client) {
+			if (client && !deferUpdate(PLAYER_UPDATE_ICONS)) {
 				client->sendIcons(getClientIcons());
 			}
 		}
@@ -980,6 +1046,11 @@ class Player final : public Creature, public Cylinder
 				client->sendMagicEffect(pos, type);
 			}
 		}
+		void sendMagicEffect(const Position& pos, const NetworkMessage& encoded) const {
+			if (client) {
+				client->sendMagicEffect(pos, encoded);
+			}
+		}
 		void sendPing();
 		void sendPingBack() const {
 			if (client) {
@@ -987,13 +1058,14 @@ class Player final : public Creature, public Cylinder
 			}
 		}
 		void sendStats();
+		void flushUpdates();
 		void sendBasicData() const {
 			if (client) {
 				client->sendBasicData();
 			}
 		}
 		void sendSkills() const {
-			if (client) {
+			if (client && !deferUpdate(PLAYER_UPDATE_SKILLS)) {
 				client->sendSkills();
 			}
 		}
@@ -1027,11 +1099,7 @@ class Player final : public Creature, public Cylinder
 				client->sendToChannel(creature, type, text, channelId);
 			}
 		}
-		void sendShop(Npc* npc) const {
-			if (client) {
-				client->sendShop(npc, shopItemList);
-			}
-		}
+		void sendShop(Npc* npc) const;
 		void sendSaleItemList() const {
 			if (client) {
 				client->sendSaleItemList(shopItemList);
@@ -1119,7 +1187,7 @@ class Player final : public Creature, public Cylinder
 			}
 		}
 
-		void sendChannel(uint16_t channelId, const std::string& channelName, const UsersMap* channelUsers, const InvitedMap* invitedUsers) {
+		void sendChannel(uint16_t channelId, const std::string& channelName, const UsersList* channelUsers, const InvitedMap* invitedUsers) {
 			if (client) {
 				client->sendChannel(channelId, channelName, channelUsers, invitedUsers);
 			}
@@ -1160,9 +1228,9 @@ class Player final : public Creature, public Cylinder
 			}
 		}
 
-		void sendTooltipData(const TooltipDataContainer& tooltipData) {
+		void sendTooltip(const std::string& payload) {
 			if (client) {
-				client->sendTooltipData(tooltipData);
+				client->sendTooltip(payload);
 			}
 		}
 
@@ -1208,6 +1276,10 @@ class Player final : public Creature, public Cylinder
 		void removeExperience(uint64_t exp, bool sendText = false);
 
 		void updateInventoryWeight();
+		void updateItemTypeCounts() const;
+		bool deferUpdate(uint8_t update) const;
+		bool deferContainerRefresh(const Container* container);
+		bool hasUnlockedExtension(PlayerExtension_t extension, uint8_t id) const;
 
 		void setNextWalkActionTask(SchedulerTask* task);
 		void setNextWalkTask(SchedulerTask* task);
@@ -1250,7 +1322,20 @@ class Player final : public Creature, public Cylinder
 		std::map<uint8_t, OpenContainer> openContainers;
 		std::map<uint32_t, DepotLocker_ptr> depotLockerMap;
 		std::map<uint32_t, DepotChest*> depotChests;
-		std::map<uint32_t, int32_t> storageMap;
+		std::unordered_map<uint32_t, int32_t> storageMap;
+		// storage keys set or removed since they were last written
+		std::unordered_set<uint32_t> changedStorageKeys;
+		uint32_t outfitStorageEnd = PSTRG_OUTFITS_RANGE_START;
+
+		// QuestState_t of each quest, kept by Quests until a storage it reads changes
+		std::vector<uint8_t> questStates;
+		uint32_t questStatesGeneration = 0;
+
+		// content hash of each section as last written, 0 while unknown
+		std::array<size_t, PLAYER_SAVE_SECTIONS> savedSections = {};
+
+		LockerLoadState_t lockerState = LOCKER_UNLOADED;
+		uint32_t lockerLoadId = 0; // of the fetch in flight, stale ones are dropped
 
 		std::vector<OutfitEntry> outfits;
 		GuildWarVector guildWarVector;
@@ -1305,6 +1390,20 @@ class Player final : public Creature, public Cylinder
 		Vocation* vocation = nullptr;
 		StoreInbox* storeInbox = nullptr;
 
+		// counts and worth of the carried items, rebuilt on the first query after a change
+		mutable std::unordered_map<uint16_t, uint32_t> itemTypeCounts;
+		mutable uint64_t inventoryMoney = 0;
+		mutable bool itemTypeCountsDirty = true;
+
+		// owned mounts, wings, auras and shaders, rebuilt from storage after it changes
+		mutable std::array<std::bitset<std::numeric_limits<uint8_t>::max() + 1>, PLAYER_EXTENSION_LAST> unlockedExtensions;
+		mutable bool unlockedExtensionsDirty = true;
+
+		// PlayerUpdate_t bits waiting for the end of the dispatcher task
+		mutable uint8_t pendingUpdates = 0;
+		// windows sent whole at the end of a bulk item move, see Game::internalMoveItems
+		std::vector<uint8_t> pendingContainerRefreshes;
+
 		uint32_t inventoryWeight = 0;
 		uint32_t capacity = 40000;
 		uint32_t damageImmunities = 0;
@@ -1357,12 +1456,15 @@ class Player final : public Creature, public Cylinder
 		bool inMarket = false;
 		bool wasMounted = false;
 		bool ghostMode = false;
+		bool wideAwareRange = false;
 		bool pzLocked = false;
 		bool isConnecting = false;
 		bool addAttackSkillPoint = false;
 		bool inventoryAbilities[CONST_SLOT_LAST + 1] = {};
 
-		static uint32_t playerAutoID;
+		// per combat type index, the slots whose items absorb it
+		std::array<uint32_t, COMBAT_COUNT> absorbSlots = {};
+		std::array<uint32_t, COMBAT_COUNT> fieldAbsorbSlots = {};
 
 		void updateItemsLight(bool internal = false);
 		int32_t getStepSpeed() const override {
@@ -1404,6 +1506,8 @@ class Player final : public Creature, public Cylinder
 		friend class Actions;
 		friend class IOLoginData;
 		friend class ProtocolGame;
+		friend class Quests;
+		friend class PlayerJournal;
 };
 
 #endif
@@ -0,0 +1,291 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#include "otpch.h"
+
+#include "playerjournal.h"
+
+#include "configmanager.h"
+#include "database.h"
+#include "game.h"
+#include "scheduler.h"
+
+extern ConfigManager g_config;
+extern Game g_game;
+
+PlayerJournal g_playerJournal;
+
+namespace {
+
+// the file is rewritten once it holds this many records and four times as many as are unsaved
+constexpr size_t COMPACT_RECORDS = 65536;
+
+constexpr const char* SKILL_COLUMNS[SKILL_LAST + 1] = {
+	"skill_fist", "skill_club", "skill_sword", "skill_axe", "skill_dist", "skill_shielding", "skill_fishing",
+	"skill_crafting", "skill_woodcutting", "skill_mining", "skill_herbalist", "skill_armorsmith", "skill_weaponsmith", "skill_jewelsmith",
+};
+
+}
+
+void PlayerJournal::recover(Database& db)
+{
+	path = g_config.getString(ConfigManager::PLAYER_JOURNAL_FILE);
+
+	FILE* journal = fopen(path.c_str(), "rb");
+	if (!journal) {
+		return;
+	}
+
+	// a record cut short by the crash is left out
+	std::unordered_map<uint32_t, Record> unsaved;
+	Record record;
+	while (fread(&record, sizeof(Record), 1, journal) == 1) {
+		applyRecord(unsaved, record);
+	}
+	fclose(journal);
+
+	size_t recovered = 0;
+	for (const auto& it : unsaved) {
+		const Record& progress = it.second;
+
+		std::ostringstream query;
+		DBParams params;
+		query << "UPDATE `players` SET `level` = ?, `experience` = ?, `maglevel` = ?, `manaspent` = ?, `health` = ?, `mana` = ?, `soul` = ?, `stamina` = ?, `posx` = ?, `posy` = ?, `posz` = ?";
+		params.addNumber(progress.level);
+		params.addNumber(progress.experience);
+		params.addNumber(progress.magLevel);
+		params.addNumber(progress.manaSpent);
+		params.addNumber(progress.health);
+		params.addNumber(progress.mana);
+		params.addNumber(progress.soul);
+		params.addNumber(progress.staminaMinutes);
+		params.addNumber(progress.posX);
+		params.addNumber(progress.posY);
+		params.addNumber(progress.posZ);
+
+		for (uint8_t skill = SKILL_FIRST; skill <= SKILL_LAST; ++skill) {
+			query << ", `" << SKILL_COLUMNS[skill] << "` = ?, `" << SKILL_COLUMNS[skill] << "_tries` = ?";
+			params.addNumber(progress.skillLevels[skill]);
+			params.addNumber(progress.skillTries[skill]);
+		}
+
+		// characters that are never saved keep what they had
+		query << " WHERE `id` = ? AND `save` != 0";
+		params.addNumber(progress.guid);
+
+		if (db.executeQuery(query.str(), params)) {
+			++recovered;
+		} else {
+			std::cout << "[Error - PlayerJournal::recover] Failed to restore player " << progress.guid << '.' << std::endl;
+		}
+	}
+
+	if (recovered != 0) {
+		std::cout << ">> Restored the progress of " << recovered << " players from " << path << std::endl;
+	}
+	std::remove(path.c_str());
+}
+
+void PlayerJournal::start(uint32_t interval)
+{
+	if (interval == 0) {
+		return;
+	}
+
+	path = g_config.getString(ConfigManager::PLAYER_JOURNAL_FILE);
+	file = fopen(path.c_str(), "ab");
+	if (!file) {
+		std::cout << "[Error - PlayerJournal::start] Cannot open " << path << ", the journal is off." << std::endl;
+		return;
+	}
+
+	this->interval = interval;
+	ThreadHolder::start();
+	g_scheduler.addEvent(createSchedulerTask(interval, std::bind(&PlayerJournal::checkPlayers, this)));
+}
+
+void PlayerJournal::shutdown()
+{
+	if (!isEnabled()) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lockClass(journalLock);
+		setState(THREAD_STATE_TERMINATED);
+	}
+	journalSignal.notify_one();
+	join();
+}
+
+void PlayerJournal::markSaved(uint32_t guid, uint64_t sequence)
+{
+	if (!isEnabled()) {
+		return;
+	}
+
+	Record mark;
+	mark.guid = guid;
+	mark.sequence = sequence;
+	mark.saved = true;
+	push(mark);
+}
+
+void PlayerJournal::checkPlayers()
+{
+	std::unordered_map<uint32_t, Record> records;
+	records.reserve(g_game.getPlayers().size());
+
+	for (const auto& it : g_game.getPlayers()) {
+		const Player* player = it.second;
+
+		Record record;
+		fillRecord(record, player);
+
+		auto last = lastRecords.find(record.guid);
+		if (last == lastRecords.end() || !sameProgress(last->second, record)) {
+			record.sequence = nextSequence();
+			push(record);
+		} else {
+			record.sequence = last->second.sequence;
+		}
+		records.emplace(record.guid, record);
+	}
+
+	// players that left are dropped
+	lastRecords = std::move(records);
+
+	g_scheduler.addEvent(createSchedulerTask(interval, std::bind(&PlayerJournal::checkPlayers, this)));
+}
+
+void PlayerJournal::push(const Record& record)
+{
+	{
+		std::lock_guard<std::mutex> lockClass(journalLock);
+		if (getState() != THREAD_STATE_RUNNING) {
+			return;
+		}
+		queuedRecords.push_back(record);
+	}
+	journalSignal.notify_one();
+}
+
+void PlayerJournal::threadMain()
+{
+	std::vector<Record> records;
+
+	std::unique_lock<std::mutex> journalLockUnique(journalLock);
+	while (true) {
+		journalSignal.wait(journalLockUnique, [this]() { return !queuedRecords.empty() || getState() != THREAD_STATE_RUNNING; });
+
+		records.swap(queuedRecords);
+		bool running = getState() == THREAD_STATE_RUNNING;
+		journalLockUnique.unlock();
+
+		write(records);
+		records.clear();
+
+		if (!running) {
+			break;
+		}
+		journalLockUnique.lock();
+	}
+
+	if (file) {
+		fclose(file);
+		file = nullptr;
+	}
+}
+
+void PlayerJournal::write(const std::vector<Record>& records)
+{
+	if (records.empty() || !file) {
+		return;
+	}
+
+	fwrite(records.data(), sizeof(Record), records.size(), file);
+	fflush(file);
+
+	for (const Record& record : records) {
+		applyRecord(unsavedRecords, record);
+	}
+
+	writtenRecords += records.size();
+	if (writtenRecords >= COMPACT_RECORDS && writtenRecords >= unsavedRecords.size() * 4) {
+		compact();
+	}
+}
+
+void PlayerJournal::compact()
+{
+	std::string compactPath = path + ".tmp";
+	FILE* compacted = fopen(compactPath.c_str(), "wb");
+	if (!compacted) {
+		return;
+	}
+
+	for (const auto& it : unsavedRecords) {
+		fwrite(&it.second, sizeof(Record), 1, compacted);
+	}
+	fclose(compacted);
+	fclose(file);
+
+	// rename replaces the journal in one step where the target may exist
+	if (std::rename(compactPath.c_str(), path.c_str()) != 0) {
+		std::remove(path.c_str());
+		std::rename(compactPath.c_str(), path.c_str());
+	}
+
+	file = fopen(path.c_str(), "ab");
+	if (!file) {
+		std::cout << "[Error - PlayerJournal::compact] Cannot open " << path << ", no more records are written." << std::endl;
+	}
+	writtenRecords = unsavedRecords.size();
+}
+
+void PlayerJournal::fillRecord(Record& record, const Player* player)
+{
+	const Position& position = player->getPosition();
+
+	record.guid = player->getGUID();
+	record.experience = player->experience;
+	record.manaSpent = player->manaSpent;
+	record.level = player->level;
+	record.magLevel = player->magLevel;
+	record.mana = player->mana;
+	record.health = std::max<int32_t>(1, player->health);
+	record.staminaMinutes = player->staminaMinutes;
+	record.posX = position.x;
+	record.posY = position.y;
+	record.posZ = position.z;
+	record.soul = player->soul;
+
+	for (uint8_t skill = SKILL_FIRST; skill <= SKILL_LAST; ++skill) {
+		record.skillLevels[skill] = player->skills[skill].level;
+		record.skillTries[skill] = player->skills[skill].tries;
+	}
+}
+
+bool PlayerJournal::sameProgress(const Record& a, const Record& b)
+{
+	return a.experience == b.experience && a.manaSpent == b.manaSpent && a.level == b.level && a.magLevel == b.magLevel &&
+	       a.mana == b.mana && a.health == b.health && a.staminaMinutes == b.staminaMinutes && a.soul == b.soul &&
+	       a.posX == b.posX && a.posY == b.posY && a.posZ == b.posZ &&
+	       std::equal(std::begin(a.skillLevels), std::end(a.skillLevels), std::begin(b.skillLevels)) &&
+	       std::equal(std::begin(a.skillTries), std::end(a.skillTries), std::begin(b.skillTries));
+}
+
+void PlayerJournal::applyRecord(std::unordered_map<uint32_t, Record>& unsaved, const Record& record)
+{
+	auto it = unsaved.find(record.guid);
+	if (record.saved) {
+		// a save serialized before the last record does not hold it
+		if (it != unsaved.end() && it->second.sequence <= record.sequence) {
+			unsaved.erase(it);
+		}
+	} else if (it == unsaved.end()) {
+		unsaved.emplace(record.guid, record);
+	} else if (it->second.sequence < record.sequence) {
+		it->second = record;
+	}
+}
@@ -0,0 +1,97 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#ifndef FS_PLAYERJOURNAL_H_9BBC7254B14B4E7B999D505648A579F5
+#define FS_PLAYERJOURNAL_H_9BBC7254B14B4E7B999D505648A579F5
+
+#include "thread_holder_base.h"
+
+#include <condition_variable>
+#include <cstdio>
+
+class Database;
+class Player;
+
+// Append-only file of player progress between saves, so a crash loses the
+// last seconds instead of everything since the last save. Every interval the
+// game thread records the players whose experience, skills, vitals or
+// position changed and every written save records a mark; the journal thread
+// appends both and rewrites the file down to the records newer than their
+// player's mark once it has grown. At startup those records are written to
+// the players table before the world opens. Items stay with the saves.
+class PlayerJournal : public ThreadHolder<PlayerJournal>
+{
+	public:
+		// the progress of a player, or with saved set the mark of a save that
+		// holds everything recorded up to its sequence
+		struct Record {
+			uint64_t sequence = 0;
+			uint64_t experience = 0;
+			uint64_t manaSpent = 0;
+			uint64_t skillTries[SKILL_LAST + 1] = {};
+			uint32_t guid = 0;
+			uint32_t level = 0;
+			uint32_t magLevel = 0;
+			uint32_t mana = 0;
+			int32_t health = 0;
+			uint16_t skillLevels[SKILL_LAST + 1] = {};
+			uint16_t staminaMinutes = 0;
+			uint16_t posX = 0;
+			uint16_t posY = 0;
+			uint8_t posZ = 0;
+			uint8_t soul = 0;
+			bool saved = false;
+		};
+
+		// writes what a crash left in the journal to the database and empties
+		// it, also while the journal is off, before any player is loaded
+		void recover(Database& db);
+
+		// dispatcher thread, the interval is in milliseconds and 0 keeps it off
+		void start(uint32_t interval);
+		void shutdown();
+
+		bool isEnabled() const {
+			return interval != 0;
+		}
+
+		// dispatcher thread, orders the records and the saves serialized between them
+		uint64_t nextSequence() {
+			return ++sequence;
+		}
+		// any thread, once the save serialized at that sequence is written
+		void markSaved(uint32_t guid, uint64_t sequence);
+
+		void threadMain();
+
+	private:
+		void checkPlayers();
+		void push(const Record& record);
+		void write(const std::vector<Record>& records);
+		void compact();
+
+		static void fillRecord(Record& record, const Player* player);
+		static bool sameProgress(const Record& a, const Record& b);
+		// keeps the latest record of each player that is newer than its mark
+		static void applyRecord(std::unordered_map<uint32_t, Record>& unsaved, const Record& record);
+
+		std::string path;
+
+		std::mutex journalLock;
+		std::condition_variable journalSignal;
+		std::vector<Record> queuedRecords;
+
+		// journal thread
+		FILE* file = nullptr;
+		std::unordered_map<uint32_t, Record> unsavedRecords;
+		size_t writtenRecords = 0;
+
+		// dispatcher thread, the last record of each online player
+		std::unordered_map<uint32_t, Record> lastRecords;
+		uint64_t sequence = 0;
+		uint32_t interval = 0;
+};
+
+extern PlayerJournal g_playerJournal;
+
+#endif
@@ -5,13 +5,21 @@
 
 #include "protocol.h"
 #include "outputmessage.h"
+#include "configmanager.h"
+#include "metrics.h"
 #include "rsa.h"
 #include "xtea.h"
 
+#include <zlib.h>
+
 extern RSA g_RSA;
+extern ConfigManager g_config;
 
 namespace {
 
+// buffered output past this size is sent at the end of the dispatcher frame instead of waiting for the autosend
+constexpr int32_t OUTPUT_FLUSH_THRESHOLD = 8192;
+
 void XTEA_encrypt(OutputMessage& msg, const xtea::round_keys& key)
 {
 	// The message must be a multiple of 8
@@ -44,16 +52,87 @@ bool XTEA_decrypt(NetworkMessage& msg, const xtea::round_keys& key)
 
 }
 
-void Protocol::onSendMessage(const OutputMessage_ptr& msg) const
+void Protocol::send(OutputMessage_ptr msg) const
 {
+	if (auto connection = getConnection()) {
+		msg->setCompression(compression);
+		connection->send(msg);
+	}
+}
+
+void Protocol::onSendMessage(const OutputMessage_ptr& msg)
+{
+	uint64_t payload = msg->getLength();
+	Metrics::add(METRIC_NETWORK_PAYLOAD_BYTES_OUT, payload);
+
 	if (!rawMessages) {
+		bool compressed = msg->getCompression() && compress(*msg);
 		msg->writeMessageLength();
 
 		if (encryptionEnabled) {
 			XTEA_encrypt(*msg, key);
-			msg->addCryptoHeader(checksumEnabled);
+			if (msg->getCompression()) {
+				msg->addSequenceHeader(sequence++, compressed);
+			} else {
+				msg->addCryptoHeader(checksumEnabled);
+			}
 		}
 	}
+
+	// onSendMessage runs under the connection lock, readers only need a recent value
+	sentPayloadBytes.store(sentPayloadBytes.load(std::memory_order_relaxed) + payload, std::memory_order_relaxed);
+	sentWireBytes.store(sentWireBytes.load(std::memory_order_relaxed) + msg->getLength(), std::memory_order_relaxed);
+}
+
+void Protocol::enableCompression()
+{
+	if (compression) {
+		return;
+	}
+
+	// raw deflate, the stream stays open so every packet reuses the dictionary of the previous ones
+	auto stream = std::make_unique<z_stream>();
+	int32_t level = std::min<int32_t>(Z_BEST_COMPRESSION, std::max<int32_t>(Z_BEST_SPEED, g_config.getNumber(ConfigManager::PACKET_COMPRESSION_LEVEL)));
+	if (deflateInit2(stream.get(), level, Z_DEFLATED, -15, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+		std::cout << "[Error - Protocol::enableCompression] Failed to initialize the deflate stream." << std::endl;
+		return;
+	}
+
+	compressionStream.reset(stream.release(), [](z_stream* stream) {
+		deflateEnd(stream);
+		delete stream;
+	});
+
+	compressionThreshold = std::max<int32_t>(0, g_config.getNumber(ConfigManager::PACKET_COMPRESSION_THRESHOLD));
+	compression = true;
+}
+
+bool Protocol::compress(OutputMessage& msg)
+{
+	// small packets are not worth it, and the largest ones could outgrow the buffer
+	// once deflated, both are sent as they are without touching the stream
+	NetworkMessage::MsgSize_t length = msg.getLength();
+	if (compressionFailed || length < compressionThreshold || length > NetworkMessage::MAX_BODY_LENGTH - 64) {
+		return false;
+	}
+
+	static thread_local std::array<uint8_t, NETWORKMESSAGE_MAXSIZE> output;
+
+	compressionStream->next_in = msg.getOutputBuffer();
+	compressionStream->avail_in = length;
+	compressionStream->next_out = output.data();
+	compressionStream->avail_out = NetworkMessage::MAX_BODY_LENGTH;
+
+	int ret = deflate(compressionStream.get(), Z_SYNC_FLUSH);
+	if (ret != Z_OK || compressionStream->avail_in != 0 || compressionStream->avail_out == 0) {
+		// the stream no longer matches what the client has seen
+		std::cout << "[Error - Protocol::compress] Deflate failed, compression disabled for this connection." << std::endl;
+		compressionFailed = true;
+		return false;
+	}
+
+	msg.setBody(output.data(), NetworkMessage::MAX_BODY_LENGTH - compressionStream->avail_out);
+	return true;
 }
 
 void Protocol::onRecvMessage(NetworkMessage& msg)
@@ -74,9 +153,31 @@ OutputMessage_ptr Protocol::getOutputBuffer(int32_t size)
 		send(outputBuffer);
 		outputBuffer = OutputMessagePool::getOutputMessage();
 	}
+
+	if (outputBuffer->getLength() + size >= OUTPUT_FLUSH_THRESHOLD) {
+		requestFlush();
+	}
 	return outputBuffer;
 }
 
+void Protocol::requestFlush()
+{
+	//dispatcher thread
+	if (!flushRequested && outputBuffer) {
+		flushRequested = true;
+		OutputMessagePool::getInstance().addProtocolToFlush(shared_from_this());
+	}
+}
+
+void Protocol::flush()
+{
+	//dispatcher thread
+	flushRequested = false;
+	if (outputBuffer) {
+		send(std::move(outputBuffer));
+	}
+}
+
 bool Protocol::RSA_decrypt(NetworkMessage& msg)
 {
 	if ((msg.getLength() - msg.getBufferPosition()) < 128) {
@@ -7,6 +7,8 @@
 #include "connection.h"
 #include "xtea.h"
 
+struct z_stream_s;
+
 class Protocol : public std::enable_shared_from_this<Protocol>
 {
 	public:
@@ -19,11 +21,21 @@ class Protocol : public std::enable_shared_from_this<Protocol>
 
 		virtual void parsePacket(NetworkMessage&) {}
 
-		virtual void onSendMessage(const OutputMessage_ptr& msg) const;
+		virtual void onSendMessage(const OutputMessage_ptr& msg);
 		void onRecvMessage(NetworkMessage& msg);
 		virtual void onRecvFirstMessage(NetworkMessage& msg) = 0;
 		virtual void onConnect() {}
 
+		// plain text protocols get their first read handed over as it arrived, without a length header
+		virtual bool hasFramedMessages() const {
+			return true;
+		}
+
+		// the first message carries an rsa block, it is parsed on the login workers
+		virtual bool decryptsFirstMessage() const {
+			return false;
+		}
+
 		bool isConnectionExpired() const {
 			return connection.expired();
 		}
@@ -34,6 +46,15 @@ class Protocol : public std::enable_shared_from_this<Protocol>
 
 		uint32_t getIP() const;
 
+		// the connection is over the write watermark of its service, bulk output
+		// should be held back until it drains
+		bool isOutputBackpressured() const {
+			if (auto connection = getConnection()) {
+				return connection->isBackpressured();
+			}
+			return false;
+		}
+
 		//Use this function for autosend messages only
 		OutputMessage_ptr getOutputBuffer(int32_t size);
 
@@ -41,11 +62,20 @@ class Protocol : public std::enable_shared_from_this<Protocol>
 			return outputBuffer;
 		}
 
-		void send(OutputMessage_ptr msg) const {
-			if (auto connection = getConnection()) {
-				connection->send(msg);
-			}
+		void send(OutputMessage_ptr msg) const;
+
+		// bytes of the messages sent on this connection, before and after
+		// compression, encryption and headers
+		uint64_t getSentPayloadBytes() const {
+			return sentPayloadBytes.load(std::memory_order_relaxed);
 		}
+		uint64_t getSentWireBytes() const {
+			return sentWireBytes.load(std::memory_order_relaxed);
+		}
+
+		// dispatcher thread, sends the buffered output in the output phase of the running frame
+		void requestFlush();
+		void flush();
 
 	protected:
 		void disconnect() const {
@@ -62,6 +92,8 @@ class Protocol : public std::enable_shared_from_this<Protocol>
 		void disableChecksum() {
 			checksumEnabled = false;
 		}
+		// messages sent from now on are sequenced and deflated into one stream
+		void enableCompression();
 
 		static bool RSA_decrypt(NetworkMessage& msg);
 
@@ -74,13 +106,28 @@ class Protocol : public std::enable_shared_from_this<Protocol>
 	private:
 		friend class Connection;
 
+		bool compress(OutputMessage& msg);
+
 		OutputMessage_ptr outputBuffer;
+		std::shared_ptr<z_stream_s> compressionStream;
 
 		const ConnectionWeak_ptr connection;
 		xtea::round_keys key;
 		bool encryptionEnabled = false;
 		bool checksumEnabled = true;
 		bool rawMessages = false;
+		bool flushRequested = false;
+
+		// compression state, set on the dispatcher before the first flagged message
+		// is sent and only used by onSendMessage afterwards
+		bool compression = false;
+		bool compressionFailed = false;
+		uint32_t compressionThreshold = 0;
+		uint32_t sequence = 0;
+
+		// written on the network threads, see onSendMessage
+		std::atomic<uint64_t> sentPayloadBytes{0};
+		std::atomic<uint64_t> sentWireBytes{0};
 };
 
 #endif
@@ -16,9 +16,12 @@
 #include "game.h"
 #include "iologindata.h"
 #include "iomarket.h"
+#include "json.h"
+#include "metrics.h"
 #include "ban.h"
 #include "scheduler.h"
 #include "monster.h"
+#include "taskprofiler.h"
 #include <fmt/format.h>
 
 extern ConfigManager g_config;
@@ -32,6 +35,149 @@ using WaitList = std::deque<std::pair<int64_t, uint32_t>>; // (timeout, player g
 
 WaitList priorityWaitList, waitList;
 
+// teleports up to this many steps away are sent as view scrolls instead of a full map description
+constexpr int32_t MAX_SCROLL_TELEPORT_DISTANCE = 3;
+
+struct PacketRateLimit
+{
+	uint8_t recvbyte;
+	int64_t interval; // milliseconds per packet sustained
+	int64_t burst; // packets accepted back to back
+};
+
+// cheap to send and only querying state, a flooding client would otherwise fill the dispatcher
+constexpr std::array<PacketRateLimit, ProtocolGame::RATE_LIMITED_PACKETS> packetRateLimits = {{
+	{0x64, 50, 10}, // auto walk
+	{0x79, 100, 10}, // look in shop
+	{0x7E, 100, 10}, // look in trade
+	{0x8C, 100, 10}, // look at
+	{0x8D, 100, 10}, // look in battle list
+	{0x9F, 25, 40}, // tooltip
+}};
+
+// serializes the parts of a tile that are the same for every viewer
+TileDescription describeTileItems(const Tile* tile)
+{
+	static NetworkMessage scratch;
+	scratch.reset();
+
+	TileDescription description;
+	scratch.add<uint16_t>(0x00); //environmental effects
+
+	Item* ground = tile->getGround();
+	if (ground) {
+		scratch.addItem(ground);
+		++description.headCount;
+	}
+
+	const TileItemVector* items = tile->getItemList();
+	if (items) {
+		for (auto it = items->getBeginTopItem(), end = items->getEndTopItem(); it != end && description.headCount < 10; ++it) {
+			scratch.addItem(*it);
+			++description.headCount;
+		}
+	}
+	description.headLength = scratch.getLength();
+
+	if (items) {
+		for (auto it = items->getBeginDownItem(), end = items->getEndDownItem(); it != end && description.headCount + description.downCount < 10; ++it) {
+			scratch.addItem(*it);
+			description.downEnds[description.downCount++] = scratch.getLength();
+		}
+	}
+
+	const uint8_t* bytes = scratch.getBuffer() + NetworkMessage::INITIAL_BUFFER_POSITION;
+	description.bytes.assign(bytes, bytes + scratch.getLength());
+	return description;
+}
+
+const char* getPacketName(uint8_t recvbyte)
+{
+	switch (recvbyte) {
+		case 0x14: return "logout";
+		case 0x1D: return "playerReceivePingBack";
+		case 0x1E: return "playerReceivePing";
+		case 0x32: return "parseExtendedOpcode";
+		case 0x42: return "parseChangeAwareRange";
+		case 0x64: return "parseAutoWalk";
+		case 0x65: return "playerMove";
+		case 0x66: return "playerMove";
+		case 0x67: return "playerMove";
+		case 0x68: return "playerMove";
+		case 0x69: return "playerStopAutoWalk";
+		case 0x6A: return "playerMove";
+		case 0x6B: return "playerMove";
+		case 0x6C: return "playerMove";
+		case 0x6D: return "playerMove";
+		case 0x6F: return "playerTurn";
+		case 0x70: return "playerTurn";
+		case 0x71: return "playerTurn";
+		case 0x72: return "playerTurn";
+		case 0x77: return "parseEquipObject";
+		case 0x78: return "parseThrow";
+		case 0x79: return "parseLookInShop";
+		case 0x7A: return "parsePlayerPurchase";
+		case 0x7B: return "parsePlayerSale";
+		case 0x7C: return "playerCloseShop";
+		case 0x7D: return "parseRequestTrade";
+		case 0x7E: return "parseLookInTrade";
+		case 0x7F: return "playerAcceptTrade";
+		case 0x80: return "playerCloseTrade";
+		case 0x82: return "parseUseItem";
+		case 0x83: return "parseUseItemEx";
+		case 0x84: return "parseUseWithCreature";
+		case 0x85: return "parseRotateItem";
+		case 0x87: return "parseCloseContainer";
+		case 0x88: return "parseUpArrowContainer";
+		case 0x89: return "parseTextWindow";
+		case 0x8A: return "parseHouseWindow";
+		case 0x8B: return "parseWrapItem";
+		case 0x8C: return "parseLookAt";
+		case 0x8D: return "parseLookInBattleList";
+		case 0x96: return "parseSay";
+		case 0x97: return "playerRequestChannels";
+		case 0x98: return "parseOpenChannel";
+		case 0x99: return "parseCloseChannel";
+		case 0x9A: return "parseOpenPrivateChannel";
+		case 0x9E: return "playerCloseNpcChannel";
+		case 0xA0: return "parseFightModes";
+		case 0x9F: return "parseTooltip";
+		case 0xA1: return "parseAttack";
+		case 0xA2: return "parseFollow";
+		case 0xA3: return "parseInviteToParty";
+		case 0xA4: return "parseJoinParty";
+		case 0xA5: return "parseRevokePartyInvite";
+		case 0xA6: return "parsePassPartyLeadership";
+		case 0xA7: return "playerLeaveParty";
+		case 0xA8: return "parseEnableSharedPartyExperience";
+		case 0xAA: return "playerCreatePrivateChannel";
+		case 0xAB: return "parseChannelInvite";
+		case 0xAC: return "parseChannelExclude";
+		case 0xBE: return "playerCancelAttackAndFollow";
+		case 0xCA: return "parseUpdateContainer";
+		case 0xCB: return "parseBrowseField";
+		case 0xCC: return "parseSeekInContainer";
+		case 0xD2: return "playerRequestOutfit";
+		case 0xD3: return "parseSetOutfit";
+		case 0xD4: return "parseToggleMount";
+		case 0xDC: return "parseAddVip";
+		case 0xDD: return "parseRemoveVip";
+		case 0xDE: return "parseEditVip";
+		case 0xE6: return "parseBugReport";
+		case 0xE8: return "parseDebugAssert";
+		case 0xF0: return "playerShowQuestLog";
+		case 0xF1: return "parseQuestLine";
+		case 0xF2: return "parseRuleViolationReport";
+		case 0xF4: return "parseMarketLeave";
+		case 0xF5: return "parseMarketBrowse";
+		case 0xF6: return "parseMarketCreateOffer";
+		case 0xF7: return "parseMarketCancelOffer";
+		case 0xF8: return "parseMarketAcceptOffer";
+		case 0xF9: return "parseModalWindowAnswer";
+		default: return "unknownPacket";
+	}
+}
+
 std::tuple<WaitList&, WaitList::iterator, WaitList::size_type> findClient(const Player& player) {
 	const auto fn = [&](const WaitList::value_type& it) { return it.second == player.getGUID(); };
 
@@ -133,6 +279,8 @@ void ProtocolGame::release()
 		player = nullptr;
 	}
 
+	moveBatchOutput.reset();
+
 	OutputMessagePool::getInstance().removeProtocolFromAutosend(shared_from_this());
 	Protocol::release();
 }
@@ -211,27 +359,10 @@ void ProtocolGame::login(const std::string& name, uint32_t accountId, OperatingS
 			return;
 		}
 
-		if (!IOLoginData::loadPlayerById(player, player->getGUID())) {
-			disconnectClient("Your character could not be loaded.");
-			return;
-		}
-
-		player->setOperatingSystem(operatingSystem);
-
-		if (!g_game.placeCreature(player, player->getLoginPosition())) {
-			if (!g_game.placeCreature(player, player->getTemplePosition(), false, true)) {
-				disconnectClient("Temple position is wrong. Contact the administrator.");
-				return;
-			}
-		}
-
-		if (operatingSystem >= CLIENTOS_OTCLIENT_LINUX) {
-			player->registerCreatureEvent("ExtendedOpcode");
-		}
-
-		player->lastIP = player->getIP();
-		player->lastLoginSaved = std::max<time_t>(time(nullptr), player->lastLoginSaved + 1);
-		acceptPackets = true;
+		auto thisPtr = getThis();
+		IOLoginData::loadPlayerAsync(player->getGUID(), [thisPtr, operatingSystem](PlayerLoadData* data) {
+			thisPtr->onPlayerLoaded(data, operatingSystem);
+		});
 	} else {
 		if (eventConnect != 0 || !g_config.getBoolean(ConfigManager::REPLACE_KICK_ON_LOGIN)) {
 			//Already trying to connect
@@ -251,6 +382,47 @@ void ProtocolGame::login(const std::string& name, uint32_t accountId, OperatingS
 	OutputMessagePool::getInstance().addProtocolToAutosend(shared_from_this());
 }
 
+void ProtocolGame::onPlayerLoaded(PlayerLoadData* data, OperatingSystem_t operatingSystem)
+{
+	//dispatcher thread
+	if (!player || isConnectionExpired()) {
+		return;
+	}
+
+	if (!data || !IOLoginData::loadPlayer(player, *data)) {
+		disconnectClient("Your character could not be loaded.");
+		return;
+	}
+
+	// the character or account may have logged in while it was loading
+	if (!g_config.getBoolean(ConfigManager::ALLOW_CLONES) && g_game.getPlayerByName(player->getName())) {
+		disconnectClient("You are already logged in.");
+		return;
+	}
+
+	if (g_config.getBoolean(ConfigManager::ONE_PLAYER_ON_ACCOUNT) && player->getAccountType() < ACCOUNT_TYPE_GAMEMASTER && g_game.getPlayerByAccount(player->getAccount())) {
+		disconnectClient("You may only login with one character\nof your account at the same time.");
+		return;
+	}
+
+	player->setOperatingSystem(operatingSystem);
+
+	if (!g_game.placeCreature(player, player->getLoginPosition())) {
+		if (!g_game.placeCreature(player, player->getTemplePosition(), false, true)) {
+			disconnectClient("Temple position is wrong. Contact the administrator.");
+			return;
+		}
+	}
+
+	if (operatingSystem >= CLIENTOS_OTCLIENT_LINUX) {
+		player->registerCreatureEvent("ExtendedOpcode");
+	}
+
+	player->lastIP = player->getIP();
+	player->lastLoginSaved = std::max<time_t>(time(nullptr), player->lastLoginSaved + 1);
+	acceptPackets = true;
+}
+
 void ProtocolGame::connect(uint32_t playerId, OperatingSystem_t operatingSystem)
 {
 	eventConnect = 0;
@@ -387,7 +559,7 @@ void ProtocolGame::onRecvFirstMessage(NetworkMessage& msg)
 
 	// OTCv8 version detection
 	uint16_t otcV8StringLength = msg.get<uint16_t>();
-	if(otcV8StringLength == 5 && msg.getString(5) == "OTCv8") {
+	if(otcV8StringLength == 5 && msg.getStringView(5) == "OTCv8") {
 		otclientV8 = msg.get<uint16_t>(); // 253, 260, 261, ...
 	}
 
@@ -464,10 +636,134 @@ void ProtocolGame::disconnectClient(const std::string& message) const
 
 void ProtocolGame::writeToOutputBuffer(const NetworkMessage& msg)
 {
+	addSentPacket(msg.getBuffer() + NetworkMessage::INITIAL_BUFFER_POSITION, msg.getLength());
+
 	auto out = getOutputBuffer(msg.getLength());
 	out->append(msg);
 }
 
+NetworkMessage& ProtocolGame::beginPacket(int32_t maxSize)
+{
+	assert(!packetOutput);
+	packetOutput = getOutputBuffer(maxSize);
+	packetStart = packetOutput->getLength();
+	return *packetOutput;
+}
+
+void ProtocolGame::endPacket(OutputPriority_t priority/* = OUTPUT_PRIORITY_NORMAL*/)
+{
+	addSentPacket(packetOutput->getOutputBuffer() + packetStart, packetOutput->getLength() - packetStart);
+	packetOutput.reset();
+
+	if (priority == OUTPUT_PRIORITY_CRITICAL) {
+		requestFlush();
+	}
+}
+
+bool ProtocolGame::acceptBulkPacket(int32_t size)
+{
+	if (isOutputBackpressured()) {
+		Metrics::add(METRIC_NETWORK_PACKETS_SHED);
+		return false;
+	}
+
+	const int32_t budget = g_config.getNumber(ConfigManager::BULK_OUTPUT_BUDGET);
+	if (budget <= 0) {
+		return true;
+	}
+
+	int64_t tick = OTSYS_TIME() / SCHEDULER_MINTICKS;
+	if (tick != bulkBudgetTick) {
+		bulkBudgetTick = tick;
+		bulkBudget = budget;
+	}
+
+	if (bulkBudget < size) {
+		Metrics::add(METRIC_NETWORK_PACKETS_SHED);
+		return false;
+	}
+
+	bulkBudget -= size;
+	return true;
+}
+
+bool ProtocolGame::addBatchedMove(uint32_t creatureId, const Position& oldPos, const Position& newPos)
+{
+	const int32_t offsetX = newPos.x - oldPos.x;
+	const int32_t offsetY = newPos.y - oldPos.y;
+	const int32_t offsetZ = newPos.z - oldPos.z;
+	if (std::abs(offsetX) > 1 || std::abs(offsetY) > 1 || std::abs(offsetZ) > 1) {
+		return false;
+	}
+
+	// creature id and the step, each offset in two bits biased by one
+	static constexpr int32_t ENTRY_SIZE = 5;
+	const uint8_t step = (offsetX + 1) | ((offsetY + 1) << 2) | ((offsetZ + 1) << 4);
+
+	// anything written after the batch would be reordered before the steps
+	const OutputMessage_ptr& current = getCurrentBuffer();
+	if (current && current == moveBatchOutput && current->getLength() == moveBatchEnd && moveBatchCount < std::numeric_limits<uint8_t>::max() &&
+	        current->getLength() + ENTRY_SIZE <= NetworkMessage::MAX_PROTOCOL_BODY_LENGTH) {
+		OutputMessage_ptr output = getOutputBuffer(ENTRY_SIZE);
+		output->add<uint32_t>(creatureId);
+		output->addByte(step);
+		output->getOutputBuffer()[moveBatchCountPosition] = ++moveBatchCount;
+		moveBatchEnd = output->getLength();
+
+		// counted as one packet, the steps only add bytes
+		sentPackets[0x44].bytes += ENTRY_SIZE;
+		return true;
+	}
+
+	NetworkMessage& msg = beginPacket(2 + ENTRY_SIZE);
+	msg.addByte(0x44);
+	msg.addByte(1);
+	msg.add<uint32_t>(creatureId);
+	msg.addByte(step);
+
+	moveBatchOutput = packetOutput;
+	moveBatchCountPosition = packetStart + 1;
+	moveBatchEnd = packetOutput->getLength();
+	moveBatchCount = 1;
+	endPacket();
+	return true;
+}
+
+void ProtocolGame::addSentPacket(const uint8_t* data, size_t length)
+{
+	if (length == 0) {
+		return;
+	}
+
+	// a message that chains several opcodes counts under its first one
+	SentPacketStats& stats = sentPackets[data[0]];
+	stats.bytes += length;
+	++stats.count;
+	Metrics::addSentPacket(data[0], length);
+}
+
+bool ProtocolGame::acceptRateLimitedPacket(uint8_t recvbyte)
+{
+	for (size_t i = 0; i < packetRateLimits.size(); ++i) {
+		const PacketRateLimit& limit = packetRateLimits[i];
+		if (limit.recvbyte != recvbyte) {
+			continue;
+		}
+
+		// token bucket kept as the time the next packet is due, a packet may arrive up to a burst early
+		int64_t now = OTSYS_TIME();
+		int64_t& nextAllowed = rateLimitedPackets[i];
+		nextAllowed = std::max(nextAllowed, now);
+		if (nextAllowed - now >= limit.interval * limit.burst) {
+			return false;
+		}
+
+		nextAllowed += limit.interval;
+		return true;
+	}
+	return true;
+}
+
 void ProtocolGame::parsePacket(NetworkMessage& msg)
 {
 	if (!acceptPackets || g_game.getGameState() == GAME_STATE_SHUTDOWN || msg.getLength() == 0) {
@@ -475,6 +771,7 @@ void ProtocolGame::parsePacket(NetworkMessage& msg)
 	}
 
 	uint8_t recvbyte = msg.getByte();
+	packetName = getPacketName(recvbyte);
 
 	if (!player) {
 		if (recvbyte == 0x0F) {
@@ -496,6 +793,13 @@ void ProtocolGame::parsePacket(NetworkMessage& msg)
 		}
 	}
 
+	if (g_config.getBoolean(ConfigManager::PACKET_FLOOD_CONTROL) && !acceptRateLimitedPacket(recvbyte)) {
+		if (g_taskProfiler.isEnabled()) {
+			g_taskProfiler.addThrottled(packetName);
+		}
+		return;
+	}
+
 	switch (recvbyte) {
 		case 0x14: g_dispatcher.addTask(createTask(std::bind(&ProtocolGame::logout, getThis(), true, false))); break;
 		case 0x1D: addGameTask(&Game::playerReceivePingBack, player->getID()); break;
@@ -594,29 +898,17 @@ void ProtocolGame::parsePacket(NetworkMessage& msg)
 
 void ProtocolGame::GetTileDescription(const Tile* tile, NetworkMessage& msg)
 {
-	msg.add<uint16_t>(0x00); //environmental effects
-
-	int32_t count;
-	Item* ground = tile->getGround();
-	if (ground) {
-		msg.addItem(ground);
-		count = 1;
-	} else {
-		count = 0;
+	const TileDescription* description = tile->getCachedDescription();
+	if (!description) {
+		description = &tile->cacheDescription(describeTileItems(tile));
 	}
 
-	const TileItemVector* items = tile->getItemList();
-	if (items) {
-		for (auto it = items->getBeginTopItem(), end = items->getEndTopItem(); it != end; ++it) {
-			msg.addItem(*it);
+	const char* bytes = reinterpret_cast<const char*>(description->bytes.data());
+	msg.addBytes(bytes, description->headLength);
 
-			if (++count == 10) {
-				break;
-			}
-		}
-	}
+	int32_t count = description->headCount;
 
-	const CreatureVector* creatures = tile->getCreatures();
+	const TileCreatureVector* creatures = tile->getCreatures();
 	if (creatures) {
 		for (const Creature* creature : boost::adaptors::reverse(*creatures)) {
 			if (!player->canSeeCreature(creature)) {
@@ -631,14 +923,9 @@ void ProtocolGame::GetTileDescription(const Tile* tile, NetworkMessage& msg)
 		}
 	}
 
-	if (items && count < 10) {
-		for (auto it = items->getBeginDownItem(), end = items->getEndDownItem(); it != end; ++it) {
-			msg.addItem(*it);
-
-			if (++count == 10) {
-				return;
-			}
-		}
+	if (count < 10 && description->downCount != 0) {
+		int32_t downItems = std::min<int32_t>(10 - count, description->downCount);
+		msg.addBytes(bytes + description->headLength, description->downEnds[downItems - 1] - description->headLength);
 	}
 }
 
@@ -693,36 +980,9 @@ void ProtocolGame::GetFloorDescription(NetworkMessage& msg, int32_t x, int32_t y
 
 void ProtocolGame::checkCreatureAsKnown(uint32_t id, bool& known, uint32_t& removedKnown)
 {
-	auto result = knownCreatureSet.insert(id);
-	if (!result.second) {
-		known = true;
-		return;
-	}
-
-	known = false;
-
-	if (knownCreatureSet.size() > 1300) {
-		// Look for a creature to remove
-		for (auto it = knownCreatureSet.begin(), end = knownCreatureSet.end(); it != end; ++it) {
-			Creature* creature = g_game.getCreatureByID(*it);
-			if (!canSee(creature)) {
-				removedKnown = *it;
-				knownCreatureSet.erase(it);
-				return;
-			}
-		}
-
-		// Bad situation. Let's just remove anyone.
-		auto it = knownCreatureSet.begin();
-		if (*it == id) {
-			++it;
-		}
-
-		removedKnown = *it;
-		knownCreatureSet.erase(it);
-	} else {
-		removedKnown = 0;
-	}
+	known = knownCreatureSet.insert(id, removedKnown, [this](uint32_t knownId) {
+		return !canSee(g_game.getCreatureByID(knownId));
+	});
 }
 
 bool ProtocolGame::canSee(const Creature* c) const
@@ -776,14 +1036,14 @@ bool ProtocolGame::canSee(int32_t x, int32_t y, int32_t z) const
 // Parse methods
 void ProtocolGame::parseChannelInvite(NetworkMessage& msg)
 {
-	const std::string name = msg.getString();
-	addGameTask(&Game::playerChannelInvite, player->getID(), name);
+	std::string name = msg.getString();
+	addGameTask(&Game::playerChannelInvite, player->getID(), std::move(name));
 }
 
 void ProtocolGame::parseChannelExclude(NetworkMessage& msg)
 {
-	const std::string name = msg.getString();
-	addGameTask(&Game::playerChannelExclude, player->getID(), name);
+	std::string name = msg.getString();
+	addGameTask(&Game::playerChannelExclude, player->getID(), std::move(name));
 }
 
 void ProtocolGame::parseOpenChannel(NetworkMessage& msg)
@@ -800,8 +1060,8 @@ void ProtocolGame::parseCloseChannel(NetworkMessage& msg)
 
 void ProtocolGame::parseOpenPrivateChannel(NetworkMessage& msg)
 {
-	const std::string receiver = msg.getString();
-	addGameTask(&Game::playerOpenPrivateChannel, player->getID(), receiver);
+	std::string receiver = msg.getString();
+	addGameTask(&Game::playerOpenPrivateChannel, player->getID(), std::move(receiver));
 }
 
 void ProtocolGame::parseAutoWalk(NetworkMessage& msg)
@@ -850,8 +1110,7 @@ void ProtocolGame::parseSetOutfit(NetworkMessage& msg)
 	newOutfit.lookMount = msg.get<uint16_t>();
 	newOutfit.lookWings = otclientV8 ? msg.get<uint16_t>() : 0;
 	newOutfit.lookAura = otclientV8 ? msg.get<uint16_t>() : 0;
-	std::string shaderName = otclientV8 ? msg.getString() : "";
-	Shader* shader = g_game.shaders.getShaderByName(shaderName);
+	Shader* shader = otclientV8 ? g_game.shaders.getShaderByName(msg.getStringView()) : nullptr;
 	newOutfit.lookShader = shader ? shader->id : 0;
 	addGameTask(&Game::playerChangeOutfit, player->getID(), newOutfit);
 }
@@ -965,12 +1224,13 @@ void ProtocolGame::parseSay(NetworkMessage& msg)
 			break;
 	}
 
-	const std::string text = msg.getString();
+	// oversized messages are dropped before anything is copied
+	std::string_view text = msg.getStringView();
 	if (text.length() > 255) {
 		return;
 	}
 
-	addGameTask(&Game::playerSay, player->getID(), channelId, type, receiver, text);
+	addGameTask(&Game::playerSay, player->getID(), channelId, type, std::move(receiver), std::string(text));
 }
 
 void ProtocolGame::parseFightModes(NetworkMessage& msg)
@@ -1017,16 +1277,16 @@ void ProtocolGame::parseEquipObject(NetworkMessage& msg)
 void ProtocolGame::parseTextWindow(NetworkMessage& msg)
 {
 	uint32_t windowTextId = msg.get<uint32_t>();
-	const std::string newText = msg.getString();
-	addGameTask(&Game::playerWriteItem, player->getID(), windowTextId, newText);
+	std::string newText = msg.getString();
+	addGameTask(&Game::playerWriteItem, player->getID(), windowTextId, std::move(newText));
 }
 
 void ProtocolGame::parseHouseWindow(NetworkMessage& msg)
 {
 	uint8_t doorId = msg.getByte();
 	uint32_t id = msg.get<uint32_t>();
-	const std::string text = msg.getString();
-	addGameTask(&Game::playerUpdateHouseWindow, player->getID(), doorId, id, text);
+	std::string text = msg.getString();
+	addGameTask(&Game::playerUpdateHouseWindow, player->getID(), doorId, id, std::move(text));
 }
 
 void ProtocolGame::parseWrapItem(NetworkMessage& msg)
@@ -1081,8 +1341,8 @@ void ProtocolGame::parseLookInTrade(NetworkMessage& msg)
 
 void ProtocolGame::parseAddVip(NetworkMessage& msg)
 {
-	const std::string name = msg.getString();
-	addGameTask(&Game::playerRequestAddVip, player->getID(), name);
+	std::string name = msg.getString();
+	addGameTask(&Game::playerRequestAddVip, player->getID(), std::move(name));
 }
 
 void ProtocolGame::parseRemoveVip(NetworkMessage& msg)
@@ -1094,10 +1354,10 @@ void ProtocolGame::parseRemoveVip(NetworkMessage& msg)
 void ProtocolGame::parseEditVip(NetworkMessage& msg)
 {
 	uint32_t guid = msg.get<uint32_t>();
-	const std::string description = msg.getString();
+	std::string description = msg.getString();
 	uint32_t icon = std::min<uint32_t>(10, msg.get<uint32_t>()); // 10 is max icon in 9.63
 	bool notify = msg.getByte() != 0;
-	addGameTask(&Game::playerRequestEditVip, player->getID(), guid, description, icon, notify);
+	addGameTask(&Game::playerRequestEditVip, player->getID(), guid, std::move(description), icon, notify);
 }
 
 void ProtocolGame::parseRotateItem(NetworkMessage& msg)
@@ -1112,8 +1372,8 @@ void ProtocolGame::parseRuleViolationReport(NetworkMessage& msg)
 {
 	uint8_t reportType = msg.getByte();
 	uint8_t reportReason = msg.getByte();
-	const std::string& targetName = msg.getString();
-	const std::string& comment = msg.getString();
+	std::string targetName = msg.getString();
+	std::string comment = msg.getString();
 	std::string translation;
 	if (reportType == REPORT_TYPE_NAME) {
 		translation = msg.getString();
@@ -1122,7 +1382,7 @@ void ProtocolGame::parseRuleViolationReport(NetworkMessage& msg)
 		msg.get<uint32_t>(); // statement id, used to get whatever player have said, we don't log that.
 	}
 
-	addGameTask(&Game::playerReportRuleViolation, player->getID(), targetName, reportType, reportReason, comment, translation);
+	addGameTask(&Game::playerReportRuleViolation, player->getID(), std::move(targetName), reportType, reportReason, std::move(comment), std::move(translation));
 }
 
 void ProtocolGame::parseBugReport(NetworkMessage& msg)
@@ -1135,7 +1395,7 @@ void ProtocolGame::parseBugReport(NetworkMessage& msg)
 		position = msg.getPosition();
 	}
 
-	addGameTask(&Game::playerReportBug, player->getID(), message, position, category);
+	addGameTask(&Game::playerReportBug, player->getID(), std::move(message), position, category);
 }
 
 void ProtocolGame::parseDebugAssert(NetworkMessage& msg)
@@ -1150,7 +1410,7 @@ void ProtocolGame::parseDebugAssert(NetworkMessage& msg)
 	std::string date = msg.getString();
 	std::string description = msg.getString();
 	std::string comment = msg.getString();
-	addGameTask(&Game::playerDebugAssert, player->getID(), assertLine, date, description, comment);
+	addGameTask(&Game::playerDebugAssert, player->getID(), std::move(assertLine), std::move(date), std::move(description), std::move(comment));
 }
 
 void ProtocolGame::parseInviteToParty(NetworkMessage& msg)
@@ -1291,16 +1551,16 @@ void ProtocolGame::sendCreatureLight(const Creature* creature)
 		return;
 	}
 
-	NetworkMessage msg;
+	NetworkMessage& msg = beginPacket(16);
 	AddCreatureLight(msg, creature);
-	writeToOutputBuffer(msg);
+	endPacket();
 }
 
 void ProtocolGame::sendWorldLight(LightInfo lightInfo)
 {
-	NetworkMessage msg;
+	NetworkMessage& msg = beginPacket(8);
 	AddWorldLight(msg, lightInfo);
-	writeToOutputBuffer(msg);
+	endPacket();
 }
 
 void ProtocolGame::sendCreatureWalkthrough(const Creature* creature, bool walkthrough)
@@ -1309,11 +1569,11 @@ void ProtocolGame::sendCreatureWalkthrough(const Creature* creature, bool walkth
 		return;
 	}
 
-	NetworkMessage msg;
+	NetworkMessage& msg = beginPacket(8);
 	msg.addByte(0x92);
 	msg.add<uint32_t>(creature->getID());
 	msg.addByte(walkthrough ? 0x00 : 0x01);
-	writeToOutputBuffer(msg);
+	endPacket();
 }
 
 void ProtocolGame::sendCreatureShield(const Creature* creature)
@@ -1322,11 +1582,11 @@ void ProtocolGame::sendCreatureShield(const Creature* creature)
 		return;
 	}
 
-	NetworkMessage msg;
+	NetworkMessage& msg = beginPacket(8);
 	msg.addByte(0x91);
 	msg.add<uint32_t>(creature->getID());
 	msg.addByte(player->getPartyShield(creature->getPlayer()));
-	writeToOutputBuffer(msg);
+	endPacket();
 }
 
 void ProtocolGame::sendCreatureSkull(const Creature* creature)
@@ -1339,11 +1599,11 @@ void ProtocolGame::sendCreatureSkull(const Creature* creature)
 		return;
 	}
 
-	NetworkMessage msg;
+	NetworkMessage& msg = beginPacket(8);
 	msg.addByte(0x90);
 	msg.add<uint32_t>(creature->getID());
 	msg.addByte(player->getSkullClient(creature));
-	writeToOutputBuffer(msg);
+	endPacket();
 }
 
 void ProtocolGame::sendCreatureEmblem(const Creature* creature)
@@ -1424,9 +1684,9 @@ void ProtocolGame::sendReLoginWindow(uint8_t unfairFightReduction)
 
 void ProtocolGame::sendStats()
 {
-	NetworkMessage msg;
+	NetworkMessage& msg = beginPacket(128);
 	AddPlayerStats(msg);
-	writeToOutputBuffer(msg);
+	endPacket(OUTPUT_PRIORITY_CRITICAL);
 }
 
 void ProtocolGame::sendBasicData()
@@ -1450,7 +1710,12 @@ void ProtocolGame::sendBasicData()
 
 void ProtocolGame::sendTextMessage(const TextMessage& message)
 {
-	NetworkMessage msg;
+	encodeTextMessage(beginPacket(message.text.size() + 32), message);
+	endPacket();
+}
+
+void ProtocolGame::encodeTextMessage(NetworkMessage& msg, const TextMessage& message)
+{
 	msg.addByte(0xB4);
 	msg.addByte(message.type);
 	switch (message.type) {
@@ -1483,7 +1748,6 @@ void ProtocolGame::sendTextMessage(const TextMessage& message)
 		}
 	}
 	msg.addString(message.text);
-	writeToOutputBuffer(msg);
 }
 
 void ProtocolGame::sendClosePrivate(uint16_t channelId)
@@ -1521,7 +1785,7 @@ void ProtocolGame::sendChannelsDialog()
 	writeToOutputBuffer(msg);
 }
 
-void ProtocolGame::sendChannel(uint16_t channelId, const std::string& channelName, const UsersMap* channelUsers, const InvitedMap* invitedUsers)
+void ProtocolGame::sendChannel(uint16_t channelId, const std::string& channelName, const UsersList* channelUsers, const InvitedMap* invitedUsers)
 {
 	NetworkMessage msg;
 	msg.addByte(0xAC);
@@ -1531,8 +1795,8 @@ void ProtocolGame::sendChannel(uint16_t channelId, const std::string& channelNam
 
 	if (channelUsers) {
 		msg.add<uint16_t>(channelUsers->size());
-		for (const auto& it : *channelUsers) {
-			msg.addString(it.second->getName());
+		for (const Player* user : *channelUsers) {
+			msg.addString(user->getName());
 		}
 	} else {
 		msg.add<uint16_t>(0x00);
@@ -1552,6 +1816,12 @@ void ProtocolGame::sendChannel(uint16_t channelId, const std::string& channelNam
 void ProtocolGame::sendChannelMessage(const std::string& author, const std::string& text, SpeakClasses type, uint16_t channel)
 {
 	NetworkMessage msg;
+	encodeChannelMessage(msg, author, text, type, channel);
+	writeToOutputBuffer(msg);
+}
+
+void ProtocolGame::encodeChannelMessage(NetworkMessage& msg, const std::string& author, const std::string& text, SpeakClasses type, uint16_t channel)
+{
 	msg.addByte(0xAA);
 	msg.add<uint32_t>(0x00);
 	msg.addString(author);
@@ -1559,15 +1829,14 @@ void ProtocolGame::sendChannelMessage(const std::string& author, const std::stri
 	msg.addByte(type);
 	msg.add<uint16_t>(channel);
 	msg.addString(text);
-	writeToOutputBuffer(msg);
 }
 
 void ProtocolGame::sendIcons(uint16_t icons)
 {
-	NetworkMessage msg;
+	NetworkMessage& msg = beginPacket(8);
 	msg.addByte(0xA2);
 	msg.add<uint16_t>(icons);
-	writeToOutputBuffer(msg);
+	endPacket();
 }
 
 void ProtocolGame::sendContainer(uint8_t cid, const Container* container, bool hasParent, uint16_t firstIndex)
@@ -1608,21 +1877,15 @@ void ProtocolGame::sendContainer(uint8_t cid, const Container* container, bool h
 	writeToOutputBuffer(msg);
 }
 
-void ProtocolGame::sendShop(Npc* npc, const ShopInfoList& itemList)
+void ProtocolGame::sendShop(const std::string& payload)
 {
-	NetworkMessage msg;
-	msg.addByte(0x7A);
-	msg.addString(npc->getName());
+	addSentPacket(reinterpret_cast<const uint8_t*>(payload.data()), payload.size());
 
-	uint16_t itemsToSend = std::min<size_t>(itemList.size(), std::numeric_limits<uint16_t>::max());
-	msg.add<uint16_t>(itemsToSend);
+	auto out = getOutputBuffer(payload.size());
+	out->addBytes(payload.data(), payload.size());
 
-	uint16_t i = 0;
-	for (auto it = itemList.begin(); i < itemsToSend; ++it, ++i) {
-		AddShopItem(msg, *it);
-	}
-
-	writeToOutputBuffer(msg);
+	// a new window shows no sale list yet
+	saleListSent = false;
 }
 
 void ProtocolGame::sendCloseShop()
@@ -1634,73 +1897,35 @@ void ProtocolGame::sendCloseShop()
 
 void ProtocolGame::sendSaleItemList(const std::list<ShopInfo>& shop)
 {
-	NetworkMessage msg;
-	msg.addByte(0x7B);
-	msg.add<uint64_t>(player->getMoney() + player->getBankBalance());
-
+	// the counts of items without subtype come from the item count index of the player
 	std::map<uint16_t, uint32_t> saleMap;
-
-	if (shop.size() <= 5) {
-		// For very small shops it's not worth it to create the complete map
-		for (const ShopInfo& shopInfo : shop) {
-			if (shopInfo.sellPrice == 0) {
-				continue;
-			}
-
-			int8_t subtype = -1;
-
-			const ItemType& itemType = Item::items[shopInfo.itemId];
-			if (itemType.hasSubType() && !itemType.stackable) {
-				subtype = (shopInfo.subType == 0 ? -1 : shopInfo.subType);
-			}
-
-			uint32_t count = player->getItemTypeCount(shopInfo.itemId, subtype);
-			if (count > 0) {
-				saleMap[shopInfo.itemId] = count;
-			}
+	for (const ShopInfo& shopInfo : shop) {
+		if (shopInfo.sellPrice == 0) {
+			continue;
 		}
-	} else {
-		// Large shop, it's better to get a cached map of all item counts and use it
-		// We need a temporary map since the finished map should only contain items
-		// available in the shop
-		std::map<uint32_t, uint32_t> tempSaleMap;
-		player->getAllItemTypeCount(tempSaleMap);
-
-		// We must still check manually for the special items that require subtype matches
-		// (That is, fluids such as potions etc., actually these items are very few since
-		// health potions now use their own ID)
-		for (const ShopInfo& shopInfo : shop) {
-			if (shopInfo.sellPrice == 0) {
-				continue;
-			}
 
-			int8_t subtype = -1;
+		int8_t subtype = -1;
 
-			const ItemType& itemType = Item::items[shopInfo.itemId];
-			if (itemType.hasSubType() && !itemType.stackable) {
-				subtype = (shopInfo.subType == 0 ? -1 : shopInfo.subType);
-			}
-
-			if (subtype != -1) {
-				uint32_t count;
-				if (itemType.isFluidContainer() || itemType.isSplash()) {
-					count = player->getItemTypeCount(shopInfo.itemId, subtype); // This shop item requires extra checks
-				} else {
-					count = subtype;
-				}
+		const ItemType& itemType = Item::items[shopInfo.itemId];
+		if (itemType.hasSubType() && !itemType.stackable) {
+			subtype = (shopInfo.subType == 0 ? -1 : shopInfo.subType);
+		}
 
-				if (count > 0) {
-					saleMap[shopInfo.itemId] = count;
-				}
-			} else {
-				std::map<uint32_t, uint32_t>::const_iterator findIt = tempSaleMap.find(shopInfo.itemId);
-				if (findIt != tempSaleMap.end() && findIt->second > 0) {
-					saleMap[shopInfo.itemId] = findIt->second;
-				}
-			}
+		uint32_t count = player->getItemTypeCount(shopInfo.itemId, subtype);
+		if (count > 0) {
+			saleMap[shopInfo.itemId] = count;
 		}
 	}
 
+	uint64_t money = player->getMoney() + player->getBankBalance();
+	if (saleListSent && money == sentSaleMoney && saleMap == sentSaleItems) {
+		return;
+	}
+
+	NetworkMessage msg;
+	msg.addByte(0x7B);
+	msg.add<uint64_t>(money);
+
 	uint8_t itemsToSend = std::min<size_t>(saleMap.size(), std::numeric_limits<uint8_t>::max());
 	msg.addByte(itemsToSend);
 
@@ -1711,6 +1936,10 @@ void ProtocolGame::sendSaleItemList(const std::list<ShopInfo>& shop)
 	}
 
 	writeToOutputBuffer(msg);
+
+	sentSaleItems = std::move(saleMap);
+	sentSaleMoney = money;
+	saleListSent = true;
 }
 
 void ProtocolGame::sendMarketEnter(uint32_t depotId)
@@ -2129,14 +2358,15 @@ void ProtocolGame::sendQuestLog()
 {
 	NetworkMessage msg;
 	msg.addByte(0xF0);
-	msg.add<uint16_t>(g_game.quests.getQuestsCount(player));
+	auto startedQuests = g_game.quests.getStartedQuests(player);
+	uint16_t questsToSend = std::min<size_t>(startedQuests.size(), std::numeric_limits<uint16_t>::max());
+	msg.add<uint16_t>(questsToSend);
 
-	for (const Quest& quest : g_game.quests.getQuests()) {
-		if (quest.isStarted(player)) {
-			msg.add<uint16_t>(quest.getID());
-			msg.addString(quest.getName());
-			msg.addByte(quest.isCompleted(player));
-		}
+	for (uint16_t i = 0; i < questsToSend; ++i) {
+		const auto& [quest, completed] = startedQuests[i];
+		msg.add<uint16_t>(quest->getID());
+		msg.addString(quest->getName());
+		msg.addByte(completed);
 	}
 
 	writeToOutputBuffer(msg);
@@ -2219,7 +2449,7 @@ void ProtocolGame::sendCreatureTurn(const Creature* creature, uint32_t stackPos)
 		return;
 	}
 
-	NetworkMessage msg;
+	NetworkMessage& msg = beginPacket(32);
 	msg.addByte(0x6B);
 	if (stackPos >= 10) {
 		msg.add<uint16_t>(0xFFFF);
@@ -2233,12 +2463,11 @@ void ProtocolGame::sendCreatureTurn(const Creature* creature, uint32_t stackPos)
 	msg.add<uint32_t>(creature->getID());
 	msg.addByte(creature->getDirection());
 	msg.addByte(player->canWalkthroughEx(creature) ? 0x00 : 0x01);
-	writeToOutputBuffer(msg);
+	endPacket();
 }
 
-void ProtocolGame::sendCreatureSay(const Creature* creature, SpeakClasses type, const std::string& text, const Position* pos/* = nullptr*/)
+void ProtocolGame::encodeCreatureSay(NetworkMessage& msg, const Creature* creature, SpeakClasses type, const std::string& text, const Position* pos)
 {
-	NetworkMessage msg;
 	msg.addByte(0xAA);
 
 	static uint32_t statementId = 0;
@@ -2261,12 +2490,24 @@ void ProtocolGame::sendCreatureSay(const Creature* creature, SpeakClasses type,
 	}
 
 	msg.addString(text);
-	writeToOutputBuffer(msg);
+}
+
+void ProtocolGame::sendCreatureSay(const Creature* creature, SpeakClasses type, const std::string& text, const Position* pos/* = nullptr*/)
+{
+	NetworkMessage& msg = beginPacket(creature->getName().size() + text.size() + 32);
+	encodeCreatureSay(msg, creature, type, text, pos);
+	endPacket();
 }
 
 void ProtocolGame::sendToChannel(const Creature* creature, SpeakClasses type, const std::string& text, uint16_t channelId)
 {
-	NetworkMessage msg;
+	NetworkMessage& msg = beginPacket((creature ? creature->getName().size() : 0) + text.size() + 32);
+	encodeChannelSpeech(msg, creature, type, text, channelId);
+	endPacket();
+}
+
+void ProtocolGame::encodeChannelSpeech(NetworkMessage& msg, const Creature* creature, SpeakClasses type, const std::string& text, uint16_t channelId)
+{
 	msg.addByte(0xAA);
 
 	static uint32_t statementId = 0;
@@ -2286,12 +2527,17 @@ void ProtocolGame::sendToChannel(const Creature* creature, SpeakClasses type, co
 	msg.addByte(type);
 	msg.add<uint16_t>(channelId);
 	msg.addString(text);
-	writeToOutputBuffer(msg);
 }
 
 void ProtocolGame::sendPrivateMessage(const Player* speaker, SpeakClasses type, const std::string& text)
 {
 	NetworkMessage msg;
+	encodePrivateMessage(msg, speaker, type, text);
+	writeToOutputBuffer(msg);
+}
+
+void ProtocolGame::encodePrivateMessage(NetworkMessage& msg, const Player* speaker, SpeakClasses type, const std::string& text)
+{
 	msg.addByte(0xAA);
 	static uint32_t statementId = 0;
 	msg.add<uint32_t>(++statementId);
@@ -2303,82 +2549,108 @@ void ProtocolGame::sendPrivateMessage(const Player* speaker, SpeakClasses type,
 	}
 	msg.addByte(type);
 	msg.addString(text);
-	writeToOutputBuffer(msg);
 }
 
 void ProtocolGame::sendCancelTarget()
 {
-	NetworkMessage msg;
+	NetworkMessage& msg = beginPacket(8);
 	msg.addByte(0xA3);
 	msg.add<uint32_t>(0x00);
-	writeToOutputBuffer(msg);
+	endPacket(OUTPUT_PRIORITY_CRITICAL);
 }
 
 void ProtocolGame::sendChangeSpeed(const Creature* creature, uint32_t speed)
 {
-	NetworkMessage msg;
+	NetworkMessage& msg = beginPacket(16);
 	msg.addByte(0x8F);
 	msg.add<uint32_t>(creature->getID());
 	msg.add<uint16_t>(creature->getBaseSpeed() / 2);
 	msg.add<uint16_t>(speed / 2);
-	writeToOutputBuffer(msg);
+	endPacket();
 }
 
 void ProtocolGame::sendCancelWalk()
 {
-	NetworkMessage msg;
+	NetworkMessage& msg = beginPacket(8);
 	msg.addByte(0xB5);
 	msg.addByte(player->getDirection());
-	writeToOutputBuffer(msg);
+	endPacket(OUTPUT_PRIORITY_CRITICAL);
 }
 
 void ProtocolGame::sendSkills()
 {
-	NetworkMessage msg;
+	NetworkMessage& msg = beginPacket(128);
 	AddPlayerSkills(msg);
-	writeToOutputBuffer(msg);
+	endPacket();
 }
 
 void ProtocolGame::sendPing()
 {
-	NetworkMessage msg;
+	NetworkMessage& msg = beginPacket(8);
 	msg.addByte(0x1D);
-	writeToOutputBuffer(msg);
+	endPacket(OUTPUT_PRIORITY_CRITICAL);
 }
 
 void ProtocolGame::sendPingBack()
 {
-	NetworkMessage msg;
+	NetworkMessage& msg = beginPacket(8);
 	msg.addByte(0x1E);
-	writeToOutputBuffer(msg);
+	endPacket(OUTPUT_PRIORITY_CRITICAL);
 }
 
-void ProtocolGame::sendDistanceShoot(const Position& from, const Position& to, uint8_t type)
+void ProtocolGame::encodeDistanceShoot(NetworkMessage& msg, const Position& from, const Position& to, uint8_t type)
 {
-	NetworkMessage msg;
 	msg.addByte(0x85);
 	msg.addPosition(from);
 	msg.addPosition(to);
 	msg.addByte(type);
-	writeToOutputBuffer(msg);
 }
 
-void ProtocolGame::sendMagicEffect(const Position& pos, uint16_t type)
+void ProtocolGame::sendDistanceShoot(const Position& from, const Position& to, uint8_t type)
 {
-	if (!canSee(pos)) {
+	if (!acceptBulkPacket(12)) {
 		return;
 	}
 
-	NetworkMessage msg;
+	NetworkMessage& msg = beginPacket(16);
+	encodeDistanceShoot(msg, from, to, type);
+	endPacket(OUTPUT_PRIORITY_BULK);
+}
+
+void ProtocolGame::sendDistanceShoot(const NetworkMessage& encoded)
+{
+	if (acceptBulkPacket(encoded.getLength())) {
+		writeToOutputBuffer(encoded);
+	}
+}
+
+void ProtocolGame::encodeMagicEffect(NetworkMessage& msg, const Position& pos, uint16_t type)
+{
 	msg.addByte(0x83);
 	msg.addPosition(pos);
 	msg.add<uint16_t>(type);
-	writeToOutputBuffer(msg);
 }
 
-void ProtocolGame::sendCreatureHealth(const Creature* creature)
+void ProtocolGame::sendMagicEffect(const Position& pos, uint16_t type)
+{
+	if (!canSee(pos) || !acceptBulkPacket(8)) {
+		return;
+	}
+
+	NetworkMessage& msg = beginPacket(16);
+	encodeMagicEffect(msg, pos, type);
+	endPacket(OUTPUT_PRIORITY_BULK);
+}
+
+void ProtocolGame::sendMagicEffect(const Position& pos, const NetworkMessage& encoded)
+{
+	if (canSee(pos) && acceptBulkPacket(encoded.getLength())) {
+		writeToOutputBuffer(encoded);
+	}
+}
+
+void ProtocolGame::encodeCreatureHealth(NetworkMessage& msg, const Creature* creature)
 {
-	NetworkMessage msg;
 	msg.addByte(0x8C);
 	msg.add<uint32_t>(creature->getID());
 
@@ -2387,7 +2659,13 @@ void ProtocolGame::sendCreatureHealth(const Creature* creature)
 	} else {
 		msg.addByte(std::ceil((static_cast<double>(creature->getHealth()) / std::max<int32_t>(creature->getMaxHealth(), 1)) * 100));
 	}
-	writeToOutputBuffer(msg);
+}
+
+void ProtocolGame::sendCreatureHealth(const Creature* creature)
+{
+	NetworkMessage& msg = beginPacket(8);
+	encodeCreatureHealth(msg, creature);
+	endPacket();
 }
 
 void ProtocolGame::sendFYIBox(const std::string& message)
@@ -2418,11 +2696,12 @@ void ProtocolGame::sendMapDescription(const Position& pos)
 			sendFloorDescription(pos, nz);
 		}
 	} else {
-		NetworkMessage msg;
+		// the largest packet, whatever is buffered goes out first so it has the whole buffer
+		NetworkMessage& msg = beginPacket(NetworkMessage::MAX_PROTOCOL_BODY_LENGTH);
 		msg.addByte(0x64);
 		msg.addPosition(player->getPosition());
 		GetMapDescription(pos.x - awareRange.left(), pos.y - awareRange.top(), pos.z, awareRange.horizontal(), awareRange.vertical(), msg);
-		writeToOutputBuffer(msg);
+		endPacket();
 	}
 }
 
@@ -2430,7 +2709,7 @@ void ProtocolGame::sendFloorDescription(const Position& pos, int floor)
 {
 	// When map view range is big, let's say 30x20 all floors may not fit in single packets
 	// So we split one packet with every floor to few packets with single floor
-	NetworkMessage msg;
+	NetworkMessage& msg = beginPacket(NetworkMessage::MAX_PROTOCOL_BODY_LENGTH);
 	msg.addByte(0x4B);
 	msg.addPosition(player->getPosition());
 	msg.addByte(floor);
@@ -2440,7 +2719,7 @@ void ProtocolGame::sendFloorDescription(const Position& pos, int floor)
 		msg.addByte(skip);
 		msg.addByte(0xFF);
 	}
-	writeToOutputBuffer(msg);
+	endPacket();
 }
 
 
@@ -2450,12 +2729,12 @@ void ProtocolGame::sendAddTileItem(const Position& pos, uint32_t stackpos, const
 		return;
 	}
 
-	NetworkMessage msg;
+	NetworkMessage& msg = beginPacket(16);
 	msg.addByte(0x6A);
 	msg.addPosition(pos);
 	msg.addByte(stackpos);
 	msg.addItem(item);
-	writeToOutputBuffer(msg);
+	endPacket();
 }
 
 void ProtocolGame::sendUpdateTileItem(const Position& pos, uint32_t stackpos, const Item* item)
@@ -2464,12 +2743,12 @@ void ProtocolGame::sendUpdateTileItem(const Position& pos, uint32_t stackpos, co
 		return;
 	}
 
-	NetworkMessage msg;
+	NetworkMessage& msg = beginPacket(16);
 	msg.addByte(0x6B);
 	msg.addPosition(pos);
 	msg.addByte(stackpos);
 	msg.addItem(item);
-	writeToOutputBuffer(msg);
+	endPacket();
 }
 
 void ProtocolGame::sendRemoveTileThing(const Position& pos, uint32_t stackpos)
@@ -2478,9 +2757,9 @@ void ProtocolGame::sendRemoveTileThing(const Position& pos, uint32_t stackpos)
 		return;
 	}
 
-	NetworkMessage msg;
+	NetworkMessage& msg = beginPacket(8);
 	RemoveTileThing(msg, pos, stackpos);
-	writeToOutputBuffer(msg);
+	endPacket();
 }
 
 void ProtocolGame::sendUpdateTileCreature(const Position& pos, uint32_t stackpos, const Creature* creature)
@@ -2666,7 +2945,38 @@ void ProtocolGame::sendMoveCreature(const Creature* creature, const Position& ne
 	if (creature == player) {
 		if (teleport) {
 			sendRemoveTileCreature(creature, oldPos, oldStackPos);
-			sendMapDescription(newPos);
+
+			// short hops scroll the view, the client already knows every other tile
+			// and only needs the player put back on its new one. A hop one floor up
+			// or down (ladders, ropes, holes) first shifts the known floors the way
+			// a stair step does, so only the floors and rows coming into view are sent
+			if (Position::getDistanceZ(oldPos, newPos) <= 1 && newStackPos < 10 &&
+			        Position::getDistanceX(oldPos, newPos) + Position::getDistanceY(oldPos, newPos) <= MAX_SCROLL_TELEPORT_DISTANCE) {
+				Position floorPos(oldPos.x, oldPos.y, newPos.z);
+				if (newPos.z != oldPos.z) {
+					NetworkMessage msg;
+					if (newPos.z > oldPos.z) {
+						MoveDownCreature(msg, creature, floorPos, oldPos);
+					} else {
+						MoveUpCreature(msg, creature, floorPos, oldPos);
+					}
+					writeToOutputBuffer(msg);
+				}
+				sendMapScroll(floorPos, newPos);
+
+				NetworkMessage msg;
+				msg.addByte(0x6A);
+				msg.addPosition(newPos);
+				msg.addByte(newStackPos);
+
+				bool known;
+				uint32_t removedKnown;
+				checkCreatureAsKnown(creature->getID(), known, removedKnown);
+				AddCreature(msg, creature, known, removedKnown);
+				writeToOutputBuffer(msg);
+			} else {
+				sendMapDescription(newPos);
+			}
 		} else {
 			NetworkMessage msg;
 			if (oldPos.z == 7 && newPos.z >= 8) {
@@ -2706,12 +3016,15 @@ void ProtocolGame::sendMoveCreature(const Creature* creature, const Position& ne
 			}
 			writeToOutputBuffer(msg);
 		}
+
+		// the client waits for the step confirmation before walking on
+		requestFlush();
 	} else if (canSee(oldPos) && canSee(creature->getPosition())) {
 		if (teleport || (oldPos.z == 7 && newPos.z >= 8)) {
 			sendRemoveTileCreature(creature, oldPos, oldStackPos);
 			sendAddCreature(creature, newPos, newStackPos, false);
-		} else {
-			NetworkMessage msg;
+		} else if (!batchCreatureMoves || !addBatchedMove(creature->getID(), oldPos, creature->getPosition())) {
+			NetworkMessage& msg = beginPacket(16);
 			msg.addByte(0x6D);
 			if (oldStackPos < 10) {
 				msg.addPosition(oldPos);
@@ -2721,7 +3034,7 @@ void ProtocolGame::sendMoveCreature(const Creature* creature, const Position& ne
 				msg.add<uint32_t>(creature->getID());
 			}
 			msg.addPosition(creature->getPosition());
-			writeToOutputBuffer(msg);
+			endPacket();
 		}
 	} else if (canSee(oldPos)) {
 		sendRemoveTileCreature(creature, oldPos, oldStackPos);
@@ -2730,9 +3043,42 @@ void ProtocolGame::sendMoveCreature(const Creature* creature, const Position& ne
 	}
 }
 
+void ProtocolGame::sendMapScroll(const Position& oldPos, const Position& newPos)
+{
+	// each step is a separate message so large aware ranges can't overflow it
+	Position pos = oldPos;
+	while (pos.x != newPos.x) {
+		NetworkMessage msg;
+		if (pos.x < newPos.x) { // east
+			++pos.x;
+			msg.addByte(0x66);
+			GetMapDescription(pos.x + awareRange.right(), pos.y - awareRange.top(), pos.z, 1, awareRange.vertical(), msg);
+		} else { // west
+			--pos.x;
+			msg.addByte(0x68);
+			GetMapDescription(pos.x - awareRange.left(), pos.y - awareRange.top(), pos.z, 1, awareRange.vertical(), msg);
+		}
+		writeToOutputBuffer(msg);
+	}
+
+	while (pos.y != newPos.y) {
+		NetworkMessage msg;
+		if (pos.y > newPos.y) { // north
+			--pos.y;
+			msg.addByte(0x65);
+			GetMapDescription(pos.x - awareRange.left(), pos.y - awareRange.top(), pos.z, awareRange.horizontal(), 1, msg);
+		} else { // south
+			++pos.y;
+			msg.addByte(0x67);
+			GetMapDescription(pos.x - awareRange.left(), pos.y + awareRange.bottom(), pos.z, awareRange.horizontal(), 1, msg);
+		}
+		writeToOutputBuffer(msg);
+	}
+}
+
 void ProtocolGame::sendInventoryItem(slots_t slot, const Item* item)
 {
-	NetworkMessage msg;
+	NetworkMessage& msg = beginPacket(16);
 	if (item) {
 		msg.addByte(0x78);
 		msg.addByte(slot);
@@ -2741,7 +3087,7 @@ void ProtocolGame::sendInventoryItem(slots_t slot, const Item* item)
 		msg.addByte(0x79);
 		msg.addByte(slot);
 	}
-	writeToOutputBuffer(msg);
+	endPacket();
 }
 
 void ProtocolGame::sendItems()
@@ -2768,27 +3114,27 @@ void ProtocolGame::sendItems()
 
 void ProtocolGame::sendAddContainerItem(uint8_t cid, uint16_t slot, const Item* item)
 {
-	NetworkMessage msg;
+	NetworkMessage& msg = beginPacket(16);
 	msg.addByte(0x70);
 	msg.addByte(cid);
 	msg.add<uint16_t>(slot);
 	msg.addItem(item);
-	writeToOutputBuffer(msg);
+	endPacket();
 }
 
 void ProtocolGame::sendUpdateContainerItem(uint8_t cid, uint16_t slot, const Item* item)
 {
-	NetworkMessage msg;
+	NetworkMessage& msg = beginPacket(16);
 	msg.addByte(0x71);
 	msg.addByte(cid);
 	msg.add<uint16_t>(slot);
 	msg.addItem(item);
-	writeToOutputBuffer(msg);
+	endPacket();
 }
 
 void ProtocolGame::sendRemoveContainerItem(uint8_t cid, uint16_t slot, const Item* lastItem)
 {
-	NetworkMessage msg;
+	NetworkMessage& msg = beginPacket(16);
 	msg.addByte(0x72);
 	msg.addByte(cid);
 	msg.add<uint16_t>(slot);
@@ -2797,7 +3143,7 @@ void ProtocolGame::sendRemoveContainerItem(uint8_t cid, uint16_t slot, const Ite
 	} else {
 		msg.add<uint16_t>(0x00);
 	}
-	writeToOutputBuffer(msg);
+	endPacket();
 }
 
 void ProtocolGame::sendTextWindow(uint32_t windowTextId, Item* item, uint16_t maxlen, bool canWrite)
@@ -2985,19 +3331,26 @@ void ProtocolGame::sendVIP(uint32_t guid, const std::string& name, const std::st
 
 void ProtocolGame::sendVIPEntries()
 {
-	const std::forward_list<VIPEntry>& vipEntries = IOLoginData::getVIPEntries(player->getAccount());
+	auto thisPtr = getThis();
+	IOLoginData::getVIPEntries(player->getAccount(), [thisPtr](std::forward_list<VIPEntry>& vipEntries) {
+		// the player may have left while the list was read
+		Player* player = thisPtr->player;
+		if (!player || player->isRemoved() || thisPtr->isConnectionExpired()) {
+			return;
+		}
 
-	for (const VIPEntry& entry : vipEntries) {
-		VipStatus_t vipStatus = VIPSTATUS_ONLINE;
+		for (const VIPEntry& entry : vipEntries) {
+			VipStatus_t vipStatus = VIPSTATUS_ONLINE;
 
-		Player* vipPlayer = g_game.getPlayerByGUID(entry.guid);
+			Player* vipPlayer = g_game.getPlayerByGUID(entry.guid);
 
-		if (!vipPlayer || !player->canSeeCreature(vipPlayer)) {
-			vipStatus = VIPSTATUS_OFFLINE;
-		}
+			if (!vipPlayer || !player->canSeeCreature(vipPlayer)) {
+				vipStatus = VIPSTATUS_OFFLINE;
+			}
 
-		sendVIP(entry.guid, entry.name, entry.description, entry.icon, entry.notify, vipStatus);
-	}
+			thisPtr->sendVIP(entry.guid, entry.name, entry.description, entry.icon, entry.notify, vipStatus);
+		}
+	});
 }
 
 void ProtocolGame::sendSpellCooldown(uint8_t spellId, uint32_t time)
@@ -3207,9 +3560,14 @@ void ProtocolGame::AddOutfit(NetworkMessage& msg, const Outfit_t& outfit)
 }
 
 void ProtocolGame::AddWorldLight(NetworkMessage& msg, LightInfo lightInfo)
+{
+	encodeWorldLight(msg, lightInfo, player->isAccessPlayer());
+}
+
+void ProtocolGame::encodeWorldLight(NetworkMessage& msg, LightInfo lightInfo, bool accessPlayer)
 {
 	msg.addByte(0x82);
-	msg.addByte((player->isAccessPlayer() ? 0xFF : lightInfo.level));
+	msg.addByte((accessPlayer ? 0xFF : lightInfo.level));
 	msg.addByte(lightInfo.color);
 }
 
@@ -3365,10 +3723,21 @@ void ProtocolGame::AddShopItem(NetworkMessage& msg, const ShopInfo& item)
 void ProtocolGame::parseExtendedOpcode(NetworkMessage& msg)
 {
 	uint8_t opcode = msg.getByte();
-	const std::string& buffer = msg.getString();
+	std::string buffer = msg.getString();
+
+	// payloads of handlers registered with decode are parsed here, on the
+	// network thread, so the game thread only turns the tree into a table
+	std::shared_ptr<const JsonValue> data;
+	bool decoded = CreatureEvents::isJsonOpcode(opcode);
+	if (decoded) {
+		auto json = std::make_shared<JsonValue>();
+		if (JsonValue::parse(buffer, *json)) {
+			data = std::move(json);
+		}
+	}
 
 	// process additional opcodes via lua script event
-	addGameTask(&Game::parsePlayerExtendedOpcode, player->getID(), opcode, buffer);
+	addGameTask(&Game::parsePlayerExtendedOpcode, player->getID(), opcode, std::move(buffer), std::move(data), decoded);
 }
 
 // OTCv8
@@ -3383,6 +3752,18 @@ void ProtocolGame::sendFeatures()
 	features[GameWingsAndAura] = true;
 	features[GameOutfitShaders] = true;
 	features[GameChangeMapAwareRange] = true;
+
+	if (g_config.getBoolean(ConfigManager::BATCH_CREATURE_MOVES)) {
+		features[GameCreatureMoveBatch] = true;
+		batchCreatureMoves = true;
+	}
+
+	bool compression = g_config.getBoolean(ConfigManager::PACKET_COMPRESSION);
+	if (compression) {
+		features[GameSequencedPackets] = true;
+		features[GamePacketCompression] = true;
+	}
+
 	if(features.empty())
 		return;
 
@@ -3394,6 +3775,12 @@ void ProtocolGame::sendFeatures()
 		msg.addByte(feature.second ? 1 : 0);
 	}
 	writeToOutputBuffer(msg);
+
+	if (compression) {
+		// the client switches formats once it has parsed the features, so they go out in their own packet
+		send(std::move(getCurrentBuffer()));
+		enableCompression();
+	}
 }
 
 void ProtocolGame::parseChangeAwareRange(NetworkMessage& msg)
@@ -3409,6 +3796,8 @@ void ProtocolGame::updateAwareRange(int width, int height)
 	if (!otclientV8)
 		return;
 
+	AwareRange previousRange = awareRange;
+
 	// If you want to change max awareRange, edit maxViewportX, maxViewportY, maxClientViewportX, maxClientViewportY in map.h
 	awareRange.width = std::min(Map::maxViewportX * 2 - 1, std::min(Map::maxClientViewportX * 2 + 1, std::max(15, width)));
 	awareRange.height = std::min(Map::maxViewportY * 2 - 1, std::min(Map::maxClientViewportY * 2 + 1, std::max(11, height)));
@@ -3418,8 +3807,15 @@ void ProtocolGame::updateAwareRange(int width, int height)
 	if (awareRange.height % 2 != 1)
 		awareRange.height -= 1;
 
+	const AwareRange defaultRange;
+	g_game.map.setWideAwareRange(player, awareRange.width > defaultRange.width || awareRange.height > defaultRange.height);
+
 	sendAwareRange();
-	sendMapDescription(player->getPosition()); // refresh map
+
+	// a smaller or unchanged range is already covered by the tiles the client has
+	if (awareRange.width > previousRange.width || awareRange.height > previousRange.height) {
+		sendMapDescription(player->getPosition()); // refresh map
+	}
 }
 
 void ProtocolGame::sendAwareRange()
@@ -3434,7 +3830,7 @@ void ProtocolGame::sendAwareRange()
 	writeToOutputBuffer(msg);
 }
 
-void ProtocolGame::sendTooltipData(const TooltipDataContainer& tooltipData)
+std::string ProtocolGame::encodeTooltipData(const TooltipDataContainer& tooltipData)
 {
 	NetworkMessage msg;
 	msg.addByte(0x9E);
@@ -3455,7 +3851,35 @@ void ProtocolGame::sendTooltipData(const TooltipDataContainer& tooltipData)
 			msg.addString(itTooltip.getString());
 		}
 	}
-	writeToOutputBuffer(msg);
+	return std::string(reinterpret_cast<const char*>(msg.getBuffer()) + NetworkMessage::INITIAL_BUFFER_POSITION, msg.getLength());
+}
+
+std::string ProtocolGame::encodeShop(const std::string& npcName, const ShopInfoList& itemList)
+{
+	NetworkMessage msg;
+	msg.addByte(0x7A);
+	msg.addString(npcName);
+
+	uint16_t itemsToSend = std::min<size_t>(itemList.size(), std::numeric_limits<uint16_t>::max());
+	msg.add<uint16_t>(itemsToSend);
+
+	uint16_t i = 0;
+	for (auto it = itemList.begin(); i < itemsToSend; ++it, ++i) {
+		AddShopItem(msg, *it);
+	}
+	return std::string(reinterpret_cast<const char*>(msg.getBuffer()) + NetworkMessage::INITIAL_BUFFER_POSITION, msg.getLength());
+}
+
+void ProtocolGame::sendTooltip(const std::string& payload)
+{
+	if (!acceptBulkPacket(payload.size())) {
+		return;
+	}
+
+	addSentPacket(reinterpret_cast<const uint8_t*>(payload.data()), payload.size());
+
+	auto out = getOutputBuffer(payload.size());
+	out->addBytes(payload.data(), payload.size());
 }
 
 void ProtocolGame::parseTooltip(NetworkMessage& msg)
@@ -7,6 +7,7 @@
 #include "protocol.h"
 #include "chat.h"
 #include "creature.h"
+#include "knowncreatureset.h"
 #include "tasks.h"
 
 class NetworkMessage;
@@ -18,10 +19,20 @@ class Tile;
 class Connection;
 class Quest;
 class ProtocolGame;
+struct PlayerLoadData;
 using ProtocolGame_ptr = std::shared_ptr<ProtocolGame>;
 
 extern Game g_game;
 
+// Critical packets answer the player's own input and are flushed once the
+// dispatcher frame ends. Normal packets wait for the autosend. Bulk packets are only
+// visual and are dropped while the connection is over its output budget.
+enum OutputPriority_t : uint8_t {
+	OUTPUT_PRIORITY_CRITICAL,
+	OUTPUT_PRIORITY_NORMAL,
+	OUTPUT_PRIORITY_BULK,
+};
+
 struct TextMessage
 {
 	MessageClasses type = MESSAGE_STATUS_DEFAULT;
@@ -48,6 +59,16 @@ class ProtocolGame final : public Protocol
 			return "gameworld protocol";
 		}
 
+		// client packets with a per connection rate limit
+		static constexpr size_t RATE_LIMITED_PACKETS = 6;
+
+		// messages sent on this connection by their first opcode, before compression
+		struct SentPacketStats {
+			uint64_t bytes = 0;
+			uint32_t count = 0;
+		};
+		using SentPackets = std::array<SentPacketStats, 256>;
+
 		explicit ProtocolGame(Connection_ptr connection) : Protocol(connection) {}
 
 		void login(const std::string& name, uint32_t accountId, OperatingSystem_t operatingSystem);
@@ -57,13 +78,53 @@ class ProtocolGame final : public Protocol
 			return version;
 		}
 
+		// dispatcher thread
+		const SentPackets& getSentPackets() const {
+			return sentPackets;
+		}
+
+		// pre-encodes a 0x9E tooltip message so it can be cached
+		static std::string encodeTooltipData(const TooltipDataContainer& tooltipData);
+		// pre-encodes a 0x7A shop window so the npc can reuse it
+		static std::string encodeShop(const std::string& npcName, const ShopInfoList& itemList);
+
+		// broadcast messages carry no per-player data, they are encoded once and
+		// appended as they are to the buffer of every spectator
+		static void encodeDistanceShoot(NetworkMessage& msg, const Position& from, const Position& to, uint8_t type);
+		static void encodeMagicEffect(NetworkMessage& msg, const Position& pos, uint16_t type);
+		static void encodeCreatureHealth(NetworkMessage& msg, const Creature* creature);
+		static void encodeCreatureSay(NetworkMessage& msg, const Creature* creature, SpeakClasses type, const std::string& text, const Position* pos);
+		static void encodeChannelSpeech(NetworkMessage& msg, const Creature* creature, SpeakClasses type, const std::string& text, uint16_t channelId);
+		static void encodeChannelMessage(NetworkMessage& msg, const std::string& author, const std::string& text, SpeakClasses type, uint16_t channel);
+		static void encodeTextMessage(NetworkMessage& msg, const TextMessage& message);
+		// a broadcast shares one statement id among all receivers
+		static void encodePrivateMessage(NetworkMessage& msg, const Player* speaker, SpeakClasses type, const std::string& text);
+		// access players see the world at full light, they get their own copy
+		static void encodeWorldLight(NetworkMessage& msg, LightInfo lightInfo, bool accessPlayer);
+
 	private:
 		ProtocolGame_ptr getThis() {
 			return std::static_pointer_cast<ProtocolGame>(shared_from_this());
 		}
+		// places the character once its rows are fetched
+		void onPlayerLoaded(PlayerLoadData* data, OperatingSystem_t operatingSystem);
 		void connect(uint32_t playerId, OperatingSystem_t operatingSystem);
 		void disconnectClient(const std::string& message) const;
 		void writeToOutputBuffer(const NetworkMessage& msg);
+		void addSentPacket(const uint8_t* data, size_t length);
+
+		// a packet written straight into the output buffer instead of a local
+		// message, maxSize bounds what is written before endPacket
+		NetworkMessage& beginPacket(int32_t maxSize);
+		void endPacket(OutputPriority_t priority = OUTPUT_PRIORITY_NORMAL);
+
+		// whether a bulk packet of that size fits the budget of this tick, false
+		// also while the connection is over its write watermark
+		bool acceptBulkPacket(int32_t size);
+
+		// appends a step of another creature to the move batch at the end of the
+		// output buffer or opens one, false for moves the batch cannot encode
+		bool addBatchedMove(uint32_t creatureId, const Position& oldPos, const Position& newPos);
 
 		void release() override;
 
@@ -76,6 +137,9 @@ class ProtocolGame final : public Protocol
 		// we have all the parse methods
 		void parsePacket(NetworkMessage& msg) override;
 		void onRecvFirstMessage(NetworkMessage& msg) override;
+		bool decryptsFirstMessage() const override {
+			return true;
+		}
 		void onConnect() override;
 
 		//Parse methods
@@ -155,7 +219,7 @@ class ProtocolGame final : public Protocol
 		void sendClosePrivate(uint16_t channelId);
 		void sendCreatePrivateChannel(uint16_t channelId, const std::string& channelName);
 		void sendChannelsDialog();
-		void sendChannel(uint16_t channelId, const std::string& channelName, const UsersMap* channelUsers, const InvitedMap* invitedUsers);
+		void sendChannel(uint16_t channelId, const std::string& channelName, const UsersList* channelUsers, const InvitedMap* invitedUsers);
 		void sendOpenPrivateChannel(const std::string& receiver);
 		void sendToChannel(const Creature* creature, SpeakClasses type, const std::string& text, uint16_t channelId);
 		void sendPrivateMessage(const Player* speaker, SpeakClasses type, const std::string& text);
@@ -163,7 +227,9 @@ class ProtocolGame final : public Protocol
 		void sendFYIBox(const std::string& message);
 
 		void sendDistanceShoot(const Position& from, const Position& to, uint8_t type);
+		void sendDistanceShoot(const NetworkMessage& encoded);
 		void sendMagicEffect(const Position& pos, uint16_t type);
+		void sendMagicEffect(const Position& pos, const NetworkMessage& encoded);
 		void sendCreatureHealth(const Creature* creature);
 		void sendSkills();
 		void sendPing();
@@ -193,7 +259,8 @@ class ProtocolGame final : public Protocol
 		void sendCreatureType(uint32_t creatureId, uint8_t creatureType);
 		void sendCreatureHelpers(uint32_t creatureId, uint16_t helpers);
 
-		void sendShop(Npc* npc, const ShopInfoList& itemList);
+		// a payload of encodeShop
+		void sendShop(const std::string& payload);
 		void sendCloseShop();
 		void sendSaleItemList(const std::list<ShopInfo>& shop);
 		void sendMarketEnter(uint32_t depotId);
@@ -220,7 +287,7 @@ class ProtocolGame final : public Protocol
 		void sendEnterWorld();
 
 		void sendFightModes();
-		void sendTooltipData(const TooltipDataContainer& tooltipData);
+		void sendTooltip(const std::string& payload);
 
 		void sendCreatureLight(const Creature* creature);
 		void sendWorldLight(LightInfo lightInfo);
@@ -286,8 +353,11 @@ class ProtocolGame final : public Protocol
 		void MoveUpCreature(NetworkMessage& msg, const Creature* creature, const Position& newPos, const Position& oldPos);
 		void MoveDownCreature(NetworkMessage& msg, const Creature* creature, const Position& newPos, const Position& oldPos);
 
+		// moves the view one step at a time sending only the exposed rows and columns
+		void sendMapScroll(const Position& oldPos, const Position& newPos);
+
 		//shop
-		void AddShopItem(NetworkMessage& msg, const ShopInfo& item);
+		static void AddShopItem(NetworkMessage& msg, const ShopInfo& item);
 
 		//otclient
 		void parseExtendedOpcode(NetworkMessage& msg);
@@ -304,17 +374,45 @@ class ProtocolGame final : public Protocol
 		// Helpers so we don't need to bind every time
 		template <typename Callable, typename... Args>
 		void addGameTask(Callable&& function, Args&&... args) {
-			g_dispatcher.addTask(createTask(std::bind(std::forward<Callable>(function), &g_game, std::forward<Args>(args)...)));
+			g_dispatcher.addTask(createTask(std::bind(std::forward<Callable>(function), &g_game, std::forward<Args>(args)...), packetName));
 		}
 
 		template <typename Callable, typename... Args>
 		void addGameTaskTimed(uint32_t delay, Callable&& function, Args&&... args) {
-			g_dispatcher.addTask(createTask(delay, std::bind(std::forward<Callable>(function), &g_game, std::forward<Args>(args)...)));
+			g_dispatcher.addTask(createTask(delay, std::bind(std::forward<Callable>(function), &g_game, std::forward<Args>(args)...), packetName));
 		}
 
-		std::unordered_set<uint32_t> knownCreatureSet;
+		KnownCreatureSet knownCreatureSet;
 		Player* player = nullptr;
 
+		// name of the packet being parsed, used as origin of the tasks it posts
+		const char* packetName = nullptr;
+
+		// flood control, evaluated on the network thread before any task is posted
+		bool acceptRateLimitedPacket(uint8_t recvbyte);
+		std::array<int64_t, RATE_LIMITED_PACKETS> rateLimitedPackets = {};
+
+		SentPackets sentPackets = {};
+
+		// bulk output left in the tick bulkBudgetTick
+		int64_t bulkBudgetTick = 0;
+		int32_t bulkBudget = 0;
+
+		// the output buffer of the packet between beginPacket and endPacket
+		OutputMessage_ptr packetOutput;
+		NetworkMessage::MsgSize_t packetStart = 0;
+
+		// the open move batch, it takes more steps while it is the last packet of that buffer
+		OutputMessage_ptr moveBatchOutput;
+		NetworkMessage::MsgSize_t moveBatchCountPosition = 0;
+		NetworkMessage::MsgSize_t moveBatchEnd = 0;
+		uint8_t moveBatchCount = 0;
+
+		// the sale list the open shop window shows, an unchanged list is not sent again
+		std::map<uint16_t, uint32_t> sentSaleItems;
+		uint64_t sentSaleMoney = 0;
+		bool saleListSent = false;
+
 		uint32_t eventConnect = 0;
 		uint32_t challengeTimestamp = 0;
 		uint16_t version = CLIENT_VERSION_MIN;
@@ -323,6 +421,7 @@ class ProtocolGame final : public Protocol
 
 		bool debugAssertSent = false;
 		bool acceptPackets = false;
+		bool batchCreatureMoves = false;
 		
 		uint16_t otclientV8 = 0;
 		struct AwareRange {
@@ -9,6 +9,7 @@
 #include "tasks.h"
 
 #include "configmanager.h"
+#include "databasetasks.h"
 #include "iologindata.h"
 #include "ban.h"
 #include "game.h"
@@ -29,14 +30,8 @@ void ProtocolLogin::disconnectClient(const std::string& message, uint16_t versio
 	disconnect();
 }
 
-void ProtocolLogin::getCharacterList(const std::string& accountName, const std::string& password, const std::string& token, uint16_t version)
+void ProtocolLogin::getCharacterList(const Account& account, const std::string& accountName, const std::string& password, const std::string& token, uint16_t version)
 {
-	Account account;
-	if (!IOLoginData::loginserverAuthentication(accountName, password, account)) {
-		disconnectClient("Account name or password is not correct.", version);
-		return;
-	}
-
 	uint32_t ticks = time(nullptr) / AUTHENTICATOR_PERIOD;
 
 	auto output = OutputMessagePool::getOutputMessage();
@@ -88,7 +83,7 @@ void ProtocolLogin::getCharacterList(const std::string& accountName, const std::
 	}
 
 	output->addByte(characters);
-	for (std::vector<Character>::iterator it = account.characters.begin(); it != account.characters.end(); it++) {
+	for (std::vector<Character>::const_iterator it = account.characters.begin(); it != account.characters.end(); it++) {
 		output->addByte(0x00);
 		output->addString(it->name);
 		output->add<uint32_t>(it->level);
@@ -208,5 +203,23 @@ void ProtocolLogin::onRecvFirstMessage(NetworkMessage& msg)
 	std::string authToken = msg.getString();
 
 	auto thisPtr = std::static_pointer_cast<ProtocolLogin>(shared_from_this());
-	g_dispatcher.addTask(createTask(std::bind(&ProtocolLogin::getCharacterList, thisPtr, accountName, password, authToken, version)));
+	auto account = std::make_shared<Account>();
+	auto sendCharacterList = [=](DBResult_ptr, bool success) {
+		if (!success) {
+			thisPtr->disconnectClient("Account name or password is not correct.", version);
+			return;
+		}
+		thisPtr->getCharacterList(*account, accountName, password, authToken, version);
+	};
+
+	// the password check and account reads run on a database worker
+	bool queued = g_databaseTasks.addJob([accountName, password, account](Database& db) {
+		return IOLoginData::loginserverAuthentication(db, accountName, password, *account);
+	}, sendCharacterList);
+
+	if (!queued) {
+		g_dispatcher.addTask(createTask([=]() {
+			sendCharacterList(nullptr, IOLoginData::loginserverAuthentication(Database::getInstance(), accountName, password, *account));
+		}));
+	}
 }
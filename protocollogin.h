@@ -8,6 +8,7 @@
 
 class NetworkMessage;
 class OutputMessage;
+struct Account;
 
 class ProtocolLogin : public Protocol
 {
@@ -23,11 +24,14 @@ class ProtocolLogin : public Protocol
 		explicit ProtocolLogin(Connection_ptr connection) : Protocol(connection) {}
 
 		void onRecvFirstMessage(NetworkMessage& msg) override;
+		bool decryptsFirstMessage() const override {
+			return true;
+		}
 
 	private:
 		void disconnectClient(const std::string& message, uint16_t version);
 
-		void getCharacterList(const std::string& accountName, const std::string& password, const std::string& token, uint16_t version);
+		void getCharacterList(const Account& account, const std::string& accountName, const std::string& password, const std::string& token, uint16_t version);
 };
 
 #endif
@@ -0,0 +1,38 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#include "otpch.h"
+
+#include "protocolmetrics.h"
+#include "metrics.h"
+#include "outputmessage.h"
+#include "tasks.h"
+
+#include <fmt/format.h>
+
+void ProtocolMetrics::onRecvFirstMessage(NetworkMessage& msg)
+{
+	// any path is served, only the method is checked
+	std::string request(reinterpret_cast<const char*>(msg.getBuffer()), msg.getLength());
+	if (request.compare(0, 4, "GET ") != 0) {
+		disconnect();
+		return;
+	}
+
+	g_dispatcher.addTask(createTask(std::bind(&ProtocolMetrics::sendMetrics, std::static_pointer_cast<ProtocolMetrics>(shared_from_this()))));
+}
+
+void ProtocolMetrics::sendMetrics()
+{
+	std::string body = g_metrics.getReport();
+	std::string response = fmt::format("HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: {:d}\r\nConnection: close\r\n\r\n", body.size());
+	response += body;
+
+	auto output = OutputMessagePool::getOutputMessage();
+
+	setRawMessages(true);
+
+	output->addBytes(response.data(), response.size());
+	send(output);
+	disconnect();
+}
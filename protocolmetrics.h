@@ -0,0 +1,34 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#ifndef FS_PROTOCOLMETRICS_H_78B85C01B128485AA422C6F416942989
+#define FS_PROTOCOLMETRICS_H_78B85C01B128485AA422C6F416942989
+
+#include "protocol.h"
+
+// Answers a single plain HTTP request with the runtime counters in the
+// Prometheus text format and closes the connection.
+class ProtocolMetrics final : public Protocol
+{
+	public:
+		// static protocol information
+		enum {server_sends_first = true};
+		enum {protocol_identifier = 0}; // Not required as we send first
+		enum {use_checksum = false};
+		static const char* protocol_name() {
+			return "metrics protocol";
+		}
+
+		explicit ProtocolMetrics(Connection_ptr connection) : Protocol(connection) {}
+
+		bool hasFramedMessages() const override {
+			return false;
+		}
+
+		void onRecvFirstMessage(NetworkMessage& msg) override;
+
+	private:
+		void sendMetrics();
+};
+
+#endif
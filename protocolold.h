@@ -22,6 +22,9 @@ class ProtocolOld final : public Protocol
 		explicit ProtocolOld(Connection_ptr connection) : Protocol(connection) {}
 
 		void onRecvFirstMessage(NetworkMessage& msg) override;
+		bool decryptsFirstMessage() const override {
+			return true;
+		}
 
 	private:
 		void disconnectClient(const std::string& message);
@@ -7,11 +7,17 @@
 #include "configmanager.h"
 #include "game.h"
 #include "outputmessage.h"
+#include "scheduler.h"
 
 extern ConfigManager g_config;
 extern Game g_game;
 
+static constexpr int32_t STATUS_CACHE_INTERVAL = 1000;
+
 std::map<uint32_t, int64_t> ProtocolStatus::ipConnectMap;
+std::mutex ProtocolStatus::ipConnectMapLock;
+std::shared_ptr<const ProtocolStatus::StatusCache> ProtocolStatus::statusCache;
+std::mutex ProtocolStatus::statusCacheLock;
 const uint64_t ProtocolStatus::start = OTSYS_TIME();
 
 enum RequestedInfo_t : uint16_t {
@@ -28,25 +34,27 @@ enum RequestedInfo_t : uint16_t {
 void ProtocolStatus::onRecvFirstMessage(NetworkMessage& msg)
 {
 	uint32_t ip = getIP();
-	if (ip != 0x0100007F) {
-		std::string ipStr = convertIPToString(ip);
-		if (ipStr != g_config.getString(ConfigManager::IP)) {
-			std::map<uint32_t, int64_t>::const_iterator it = ipConnectMap.find(ip);
-			if (it != ipConnectMap.end() && (OTSYS_TIME() < (it->second + g_config.getNumber(ConfigManager::STATUSQUERY_TIMEOUT)))) {
-				disconnect();
-				return;
+	{
+		std::lock_guard<std::mutex> lockClass(ipConnectMapLock);
+		if (ip != 0x0100007F) {
+			std::string ipStr = convertIPToString(ip);
+			if (ipStr != g_config.getString(ConfigManager::IP)) {
+				std::map<uint32_t, int64_t>::const_iterator it = ipConnectMap.find(ip);
+				if (it != ipConnectMap.end() && (OTSYS_TIME() < (it->second + g_config.getNumber(ConfigManager::STATUSQUERY_TIMEOUT)))) {
+					disconnect();
+					return;
+				}
 			}
 		}
-	}
 
-	ipConnectMap[ip] = OTSYS_TIME();
+		ipConnectMap[ip] = OTSYS_TIME();
+	}
 
 	switch (msg.getByte()) {
 		//XML info protocol
 		case 0xFF: {
 			if (msg.getString(4) == "info") {
-				g_dispatcher.addTask(createTask(std::bind(&ProtocolStatus::sendStatusString,
-									  std::static_pointer_cast<ProtocolStatus>(shared_from_this()))));
+				sendStatusString();
 				return;
 			}
 			break;
@@ -59,8 +67,14 @@ void ProtocolStatus::onRecvFirstMessage(NetworkMessage& msg)
 			if (requestedInfo & REQUEST_PLAYER_STATUS_INFO) {
 				characterName = msg.getString();
 			}
-			g_dispatcher.addTask(createTask(std::bind(&ProtocolStatus::sendInfo, std::static_pointer_cast<ProtocolStatus>(shared_from_this()),
-								  requestedInfo, characterName)));
+
+			// only the player lookup needs game state, everything else is served from the cache
+			if (requestedInfo & REQUEST_PLAYER_STATUS_INFO) {
+				g_dispatcher.addTask(createTask(std::bind(&ProtocolStatus::sendInfo, std::static_pointer_cast<ProtocolStatus>(shared_from_this()),
+									  requestedInfo, characterName)));
+			} else {
+				sendInfo(requestedInfo, characterName);
+			}
 			return;
 		}
 
@@ -70,11 +84,15 @@ void ProtocolStatus::onRecvFirstMessage(NetworkMessage& msg)
 	disconnect();
 }
 
-void ProtocolStatus::sendStatusString()
+std::shared_ptr<const ProtocolStatus::StatusCache> ProtocolStatus::getStatusCache()
 {
-	auto output = OutputMessagePool::getOutputMessage();
+	std::lock_guard<std::mutex> lockClass(statusCacheLock);
+	return statusCache;
+}
 
-	setRawMessages(true);
+void ProtocolStatus::updateStatusCache()
+{
+	auto cache = std::make_shared<StatusCache>();
 
 	pugi::xml_document doc;
 
@@ -132,80 +150,117 @@ void ProtocolStatus::sendStatusString()
 
 	std::ostringstream ss;
 	doc.save(ss, "", pugi::format_raw);
+	cache->statusString = ss.str();
 
-	std::string data = ss.str();
-	output->addBytes(data.c_str(), data.size());
-	send(output);
-	disconnect();
-}
-
-void ProtocolStatus::sendInfo(uint16_t requestedInfo, const std::string& characterName)
-{
-	auto output = OutputMessagePool::getOutputMessage();
+	NetworkMessage msg;
+	auto finishBlock = [&](RequestedInfo_t requestedInfo) {
+		size_t index = 0;
+		while ((1 << index) != requestedInfo) {
+			++index;
+		}
 
-	if (requestedInfo & REQUEST_BASIC_SERVER_INFO) {
-		output->addByte(0x10);
-		output->addString(g_config.getString(ConfigManager::SERVER_NAME));
-		output->addString(g_config.getString(ConfigManager::IP));
-		output->addString(std::to_string(g_config.getNumber(ConfigManager::LOGIN_PORT)));
+		cache->infoBlocks[index].assign(reinterpret_cast<const char*>(msg.getBuffer() + NetworkMessage::INITIAL_BUFFER_POSITION), msg.getLength());
+		msg.reset();
+	};
+
+	msg.addByte(0x10);
+	msg.addString(g_config.getString(ConfigManager::SERVER_NAME));
+	msg.addString(g_config.getString(ConfigManager::IP));
+	msg.addString(std::to_string(g_config.getNumber(ConfigManager::LOGIN_PORT)));
+	finishBlock(REQUEST_BASIC_SERVER_INFO);
+
+	msg.addByte(0x11);
+	msg.addString(g_config.getString(ConfigManager::OWNER_NAME));
+	msg.addString(g_config.getString(ConfigManager::OWNER_EMAIL));
+	finishBlock(REQUEST_OWNER_SERVER_INFO);
+
+	msg.addByte(0x12);
+	msg.addString(g_config.getString(ConfigManager::MOTD));
+	msg.addString(g_config.getString(ConfigManager::LOCATION));
+	msg.addString(g_config.getString(ConfigManager::URL));
+	msg.add<uint64_t>(uptime);
+	finishBlock(REQUEST_MISC_SERVER_INFO);
+
+	msg.addByte(0x20);
+	msg.add<uint32_t>(g_game.getPlayersOnline());
+	msg.add<uint32_t>(g_config.getNumber(ConfigManager::MAX_PLAYERS));
+	msg.add<uint32_t>(g_game.getPlayersRecord());
+	finishBlock(REQUEST_PLAYERS_INFO);
+
+	msg.addByte(0x30);
+	msg.addString(g_config.getString(ConfigManager::MAP_NAME));
+	msg.addString(g_config.getString(ConfigManager::MAP_AUTHOR));
+	msg.add<uint16_t>(mapWidth);
+	msg.add<uint16_t>(mapHeight);
+	finishBlock(REQUEST_MAP_INFO);
+
+	msg.addByte(0x21); // players info - online players list
+	const auto& onlinePlayers = g_game.getPlayers();
+	msg.add<uint32_t>(onlinePlayers.size());
+	for (const auto& it : onlinePlayers) {
+		msg.addString(it.second->getName());
+		msg.add<uint32_t>(it.second->getLevel());
 	}
+	finishBlock(REQUEST_EXT_PLAYERS_INFO);
 
-	if (requestedInfo & REQUEST_OWNER_SERVER_INFO) {
-		output->addByte(0x11);
-		output->addString(g_config.getString(ConfigManager::OWNER_NAME));
-		output->addString(g_config.getString(ConfigManager::OWNER_EMAIL));
-	}
+	msg.addByte(0x23); // server software info
+	msg.addString(STATUS_SERVER_NAME);
+	msg.addString(STATUS_SERVER_VERSION);
+	msg.addString(CLIENT_VERSION_STR);
+	finishBlock(REQUEST_SERVER_SOFTWARE_INFO);
 
-	if (requestedInfo & REQUEST_MISC_SERVER_INFO) {
-		output->addByte(0x12);
-		output->addString(g_config.getString(ConfigManager::MOTD));
-		output->addString(g_config.getString(ConfigManager::LOCATION));
-		output->addString(g_config.getString(ConfigManager::URL));
-		output->add<uint64_t>((OTSYS_TIME() - ProtocolStatus::start) / 1000);
+	{
+		std::lock_guard<std::mutex> lockClass(statusCacheLock);
+		statusCache = std::move(cache);
 	}
 
-	if (requestedInfo & REQUEST_PLAYERS_INFO) {
-		output->addByte(0x20);
-		output->add<uint32_t>(g_game.getPlayersOnline());
-		output->add<uint32_t>(g_config.getNumber(ConfigManager::MAX_PLAYERS));
-		output->add<uint32_t>(g_game.getPlayersRecord());
+	g_scheduler.addEvent(createSchedulerTask(STATUS_CACHE_INTERVAL, &ProtocolStatus::updateStatusCache));
+}
+
+void ProtocolStatus::sendStatusString()
+{
+	auto cache = getStatusCache();
+	if (!cache) {
+		disconnect();
+		return;
 	}
 
-	if (requestedInfo & REQUEST_MAP_INFO) {
-		output->addByte(0x30);
-		output->addString(g_config.getString(ConfigManager::MAP_NAME));
-		output->addString(g_config.getString(ConfigManager::MAP_AUTHOR));
-		uint32_t mapWidth, mapHeight;
-		g_game.getMapDimensions(mapWidth, mapHeight);
-		output->add<uint16_t>(mapWidth);
-		output->add<uint16_t>(mapHeight);
+	auto output = OutputMessagePool::getOutputMessage();
+
+	setRawMessages(true);
+
+	output->addBytes(cache->statusString.data(), cache->statusString.size());
+	send(output);
+	disconnect();
+}
+
+void ProtocolStatus::sendInfo(uint16_t requestedInfo, const std::string& characterName)
+{
+	auto cache = getStatusCache();
+	if (!cache) {
+		disconnect();
+		return;
 	}
 
-	if (requestedInfo & REQUEST_EXT_PLAYERS_INFO) {
-		output->addByte(0x21); // players info - online players list
+	auto output = OutputMessagePool::getOutputMessage();
 
-		const auto& players = g_game.getPlayers();
-		output->add<uint32_t>(players.size());
-		for (const auto& it : players) {
-			output->addString(it.second->getName());
-			output->add<uint32_t>(it.second->getLevel());
+	for (size_t index = 0; index < cache->infoBlocks.size(); ++index) {
+		if ((requestedInfo & (1 << index)) == 0) {
+			continue;
 		}
-	}
 
-	if (requestedInfo & REQUEST_PLAYER_STATUS_INFO) {
-		output->addByte(0x22); // players info - online status info of a player
-		if (g_game.getPlayerByName(characterName) != nullptr) {
-			output->addByte(0x01);
-		} else {
-			output->addByte(0x00);
+		if ((1 << index) == REQUEST_PLAYER_STATUS_INFO) {
+			output->addByte(0x22); // players info - online status info of a player
+			if (g_game.getPlayerByName(characterName) != nullptr) {
+				output->addByte(0x01);
+			} else {
+				output->addByte(0x00);
+			}
+			continue;
 		}
-	}
 
-	if (requestedInfo & REQUEST_SERVER_SOFTWARE_INFO) {
-		output->addByte(0x23); // server software info
-		output->addString(STATUS_SERVER_NAME);
-		output->addString(STATUS_SERVER_VERSION);
-		output->addString(CLIENT_VERSION_STR);
+		const std::string& block = cache->infoBlocks[index];
+		output->addBytes(block.data(), block.size());
 	}
 	send(output);
 	disconnect();
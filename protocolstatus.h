@@ -25,10 +25,25 @@ class ProtocolStatus final : public Protocol
 		void sendStatusString();
 		void sendInfo(uint16_t requestedInfo, const std::string& characterName);
 
+		// rebuilds the cached responses on the dispatcher and reschedules itself
+		static void updateStatusCache();
+
 		static const uint64_t start;
 
 	private:
+		struct StatusCache {
+			std::string statusString;
+			// serialized sendInfo blocks, indexed by request bit
+			std::array<std::string, 8> infoBlocks;
+		};
+
 		static std::map<uint32_t, int64_t> ipConnectMap;
+		static std::mutex ipConnectMapLock;
+
+		static std::shared_ptr<const StatusCache> statusCache;
+		static std::mutex statusCacheLock;
+
+		static std::shared_ptr<const StatusCache> getStatusCache();
 };
 
 #endif
@@ -0,0 +1,183 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#include "otpch.h"
+
+#include "purescripts.h"
+#include "item.h"
+#include "workerpool.h"
+
+#include <boost/filesystem.hpp>
+
+PureScripts g_pureScripts;
+
+namespace {
+
+std::vector<std::string> getScriptFiles()
+{
+	namespace fs = boost::filesystem;
+
+	std::vector<std::string> files;
+	const auto dir = fs::current_path() / "data" / "pure";
+	if (!fs::exists(dir) || !fs::is_directory(dir)) {
+		return files;
+	}
+
+	for (fs::recursive_directory_iterator it(dir), endit; it != endit; ++it) {
+		if (fs::is_regular_file(*it) && it->path().extension() == ".lua" && it->path().filename().string().find('#') == std::string::npos) {
+			files.push_back(it->path().string());
+		}
+	}
+	std::sort(files.begin(), files.end());
+	return files;
+}
+
+void setField(lua_State* L, const char* index, lua_Number value)
+{
+	lua_pushnumber(L, value);
+	lua_setfield(L, -2, index);
+}
+
+}
+
+PureScripts::~PureScripts()
+{
+	clear();
+}
+
+void PureScripts::clear()
+{
+	for (lua_State* L : states) {
+		lua_close(L);
+	}
+	states.clear();
+}
+
+bool PureScripts::load(size_t slots)
+{
+	clear();
+
+	const std::vector<std::string> files = getScriptFiles();
+	for (size_t slot = 0; slot < slots; ++slot) {
+		lua_State* L = createState();
+		if (!L) {
+			std::cout << "[Error - PureScripts::load] Unable to create lua state." << std::endl;
+			clear();
+			return false;
+		}
+
+		for (const std::string& file : files) {
+			if (luaL_loadfile(L, file.c_str()) != 0 || lua_pcall(L, 0, 0, 0) != 0) {
+				// every state loads the same files, report them once
+				if (slot == 0) {
+					std::cout << "[Warning - PureScripts::load] " << lua_tostring(L, -1) << std::endl;
+				}
+				lua_pop(L, 1);
+			}
+		}
+		states.push_back(L);
+	}
+	return true;
+}
+
+bool PureScripts::reload()
+{
+	return load(states.size());
+}
+
+lua_State* PureScripts::createState() const
+{
+	lua_State* L = luaL_newstate();
+	if (!L) {
+		return nullptr;
+	}
+
+	luaL_openlibs(L);
+
+	// no file, process or module access, only os.time and os.clock stay
+	for (const char* name : {"io", "package", "require", "dofile", "loadfile", "module"}) {
+		lua_pushnil(L);
+		lua_setglobal(L, name);
+	}
+
+	lua_getglobal(L, "os");
+	lua_createtable(L, 0, 2);
+	lua_getfield(L, -2, "time");
+	lua_setfield(L, -2, "time");
+	lua_getfield(L, -2, "clock");
+	lua_setfield(L, -2, "clock");
+	lua_setglobal(L, "os");
+	lua_pop(L, 1);
+
+	lua_register(L, "getItemTypeInfo", PureScripts::luaGetItemTypeInfo);
+	return L;
+}
+
+bool PureScripts::hasFunction(const std::string& name) const
+{
+	if (states.empty()) {
+		return false;
+	}
+
+	lua_State* L = states.front();
+	lua_getglobal(L, name.c_str());
+	bool result = lua_isfunction(L, -1);
+	lua_pop(L, 1);
+	return result;
+}
+
+bool PureScripts::call(const std::string& name, std::initializer_list<lua_Number> args, lua_Number* results, int resultCount)
+{
+	size_t slot = WorkerPool::getCurrentWorker();
+	if (slot >= states.size()) {
+		return false;
+	}
+
+	lua_State* L = states[slot];
+	lua_getglobal(L, name.c_str());
+	if (!lua_isfunction(L, -1)) {
+		lua_pop(L, 1);
+		return false;
+	}
+
+	for (lua_Number arg : args) {
+		lua_pushnumber(L, arg);
+	}
+
+	if (lua_pcall(L, args.size(), resultCount, 0) != 0) {
+		std::cout << "[Error - PureScripts::call] " << name << ": " << lua_tostring(L, -1) << std::endl;
+		lua_pop(L, 1);
+		return false;
+	}
+
+	for (int i = 0; i < resultCount; ++i) {
+		results[i] = lua_tonumber(L, i - resultCount);
+	}
+	lua_pop(L, resultCount);
+	return true;
+}
+
+int PureScripts::luaGetItemTypeInfo(lua_State* L)
+{
+	// getItemTypeInfo(itemId)
+	const ItemType& it = Item::items[static_cast<uint16_t>(lua_tonumber(L, 1))];
+	if (it.id == 0) {
+		lua_pushnil(L);
+		return 1;
+	}
+
+	lua_createtable(L, 0, 9);
+	lua_pushlstring(L, it.name.c_str(), it.name.size());
+	lua_setfield(L, -2, "name");
+	lua_pushboolean(L, it.stackable);
+	lua_setfield(L, -2, "stackable");
+	setField(L, "id", it.id);
+	setField(L, "weight", it.weight);
+	setField(L, "attack", it.attack);
+	setField(L, "defense", it.defense);
+	setField(L, "extraDefense", it.extraDefense);
+	setField(L, "armor", it.armor);
+	setField(L, "hitChance", it.hitChance);
+	setField(L, "shootRange", it.shootRange);
+	return 1;
+}
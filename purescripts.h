@@ -0,0 +1,48 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#ifndef FS_PURESCRIPTS_H_9A4C2E7F1B6D4D08B3E5F2A1C7D9E046
+#define FS_PURESCRIPTS_H_9A4C2E7F1B6D4D08B3E5F2A1C7D9E046
+
+#if __has_include("luajit/lua.hpp")
+#include <luajit/lua.hpp>
+#else
+#include <lua.hpp>
+#endif
+
+// Scripts from data/pure that only compute values from their arguments, such
+// as damage formulas. Every execution slot (the dispatcher and each worker of
+// g_workerPool) owns a separate lua state with the same scripts loaded, so they
+// may be called from inside a parallelFor. They get no access to creatures or
+// items, only to read-only data that does not change while the server runs.
+class PureScripts
+{
+	public:
+		PureScripts() = default;
+		~PureScripts();
+
+		// non-copyable
+		PureScripts(const PureScripts&) = delete;
+		PureScripts& operator=(const PureScripts&) = delete;
+
+		bool load(size_t slots);
+		bool reload();
+
+		bool hasFunction(const std::string& name) const;
+
+		// calls the global function name(args...) on the state of the calling
+		// thread and stores its first resultCount return values in results
+		bool call(const std::string& name, std::initializer_list<lua_Number> args, lua_Number* results, int resultCount);
+
+	private:
+		void clear();
+		lua_State* createState() const;
+
+		static int luaGetItemTypeInfo(lua_State* L);
+
+		std::vector<lua_State*> states;
+};
+
+extern PureScripts g_pureScripts;
+
+#endif
@@ -127,6 +127,8 @@ bool Quest::isStarted(Player* player) const
 bool Quests::reload()
 {
 	quests.clear();
+	questOrder.clear();
+	storageQuests.clear();
 	return loadFromXml();
 }
 
@@ -171,6 +173,20 @@ bool Quests::loadFromXml()
 			}
 		}
 	}
+
+	++generation;
+	for (const Quest& quest : quests) {
+		uint32_t index = questOrder.size();
+		questOrder.push_back(&quest);
+
+		storageQuests[quest.startStorageID].push_back(index);
+		for (const Mission& mission : quest.missions) {
+			std::vector<uint32_t>& readers = storageQuests[mission.getStorageId()];
+			if (readers.back() != index) {
+				readers.push_back(index);
+			}
+		}
+	}
 	return true;
 }
 
@@ -195,9 +211,57 @@ uint16_t Quests::getQuestsCount(Player* player) const
 	return count;
 }
 
+std::vector<std::pair<const Quest*, bool>> Quests::getStartedQuests(Player* player) const
+{
+	std::vector<uint8_t>& states = player->questStates;
+	if (player->questStatesGeneration != generation) {
+		states.assign(questOrder.size(), QUESTSTATE_UNKNOWN);
+		player->questStatesGeneration = generation;
+	}
+
+	std::vector<std::pair<const Quest*, bool>> started;
+	for (size_t i = 0, size = questOrder.size(); i < size; ++i) {
+		const Quest* quest = questOrder[i];
+		if (states[i] == QUESTSTATE_UNKNOWN) {
+			if (!quest->isStarted(player)) {
+				states[i] = QUESTSTATE_NOT_STARTED;
+			} else {
+				states[i] = quest->isCompleted(player) ? QUESTSTATE_COMPLETED : QUESTSTATE_STARTED;
+			}
+		}
+
+		if (states[i] != QUESTSTATE_NOT_STARTED) {
+			started.emplace_back(quest, states[i] == QUESTSTATE_COMPLETED);
+		}
+	}
+	return started;
+}
+
+void Quests::onStorageChange(Player* player, uint32_t key) const
+{
+	if (player->questStatesGeneration != generation) {
+		return;
+	}
+
+	auto it = storageQuests.find(key);
+	if (it == storageQuests.end()) {
+		return;
+	}
+
+	for (uint32_t index : it->second) {
+		player->questStates[index] = QUESTSTATE_UNKNOWN;
+	}
+}
+
 bool Quests::isQuestStorage(const uint32_t key, const int32_t value, const int32_t oldValue) const
 {
-	for (const Quest& quest : quests) {
+	auto it = storageQuests.find(key);
+	if (it == storageQuests.end()) {
+		return false;
+	}
+
+	for (uint32_t index : it->second) {
+		const Quest& quest = *questOrder[index];
 		if (quest.getStartStorageId() == key && quest.getStartStorageValue() == value) {
 			return true;
 		}
@@ -13,6 +13,13 @@ class Quest;
 using MissionsList = std::list<Mission>;
 using QuestsList = std::list<Quest>;
 
+enum QuestState_t : uint8_t {
+	QUESTSTATE_UNKNOWN,
+	QUESTSTATE_NOT_STARTED,
+	QUESTSTATE_STARTED,
+	QUESTSTATE_COMPLETED,
+};
+
 class Mission
 {
 	public:
@@ -96,8 +103,20 @@ class Quests
 		uint16_t getQuestsCount(Player* player) const;
 		bool reload();
 
+		// the started quests of the player in load order and whether they are
+		// completed, from the states cached on the player
+		std::vector<std::pair<const Quest*, bool>> getStartedQuests(Player* player) const;
+		// forgets the cached states of the quests that read the key
+		void onStorageChange(Player* player, uint32_t key) const;
+
 	private:
 		QuestsList quests;
+
+		// the quests in load order and the indexes of those that read a key
+		std::vector<const Quest*> questOrder;
+		std::unordered_map<uint32_t, std::vector<uint32_t>> storageQuests;
+		// bumped on every load, the player caches of an older one are dropped
+		uint32_t generation = 0;
 };
 
 #endif
@@ -16,6 +16,7 @@
 
 extern Game g_game;
 extern ConfigManager g_config;
+extern Monsters g_monsters;
 
 Raids::Raids()
 {
@@ -231,19 +232,41 @@ void Raid::startRaid()
 
 void Raid::executeRaidEvent(RaidEvent* raidEvent)
 {
-	if (raidEvent->executeEvent()) {
-		nextEvent++;
-		RaidEvent* newRaidEvent = getNextRaidEvent();
+	eventStartTime = OTSYS_TIME();
+	if (!raidEvent->executeEvent()) {
+		resetRaid();
+		return;
+	}
+	scheduleNextRaidEvent(raidEvent);
+}
 
-		if (newRaidEvent) {
-			uint32_t ticks = static_cast<uint32_t>(std::max<int32_t>(RAID_MINTICKS, newRaidEvent->getDelay() - raidEvent->getDelay()));
-			nextEventEvent = g_scheduler.addEvent(createSchedulerTask(ticks, std::bind(&Raid::executeRaidEvent, this, newRaidEvent)));
-		} else {
-			resetRaid();
-		}
-	} else {
+void Raid::continueRaidEvent(RaidEvent* raidEvent)
+{
+	if (!raidEvent->continueEvent()) {
+		resetRaid();
+		return;
+	}
+	scheduleNextRaidEvent(raidEvent);
+}
+
+void Raid::scheduleNextRaidEvent(RaidEvent* raidEvent)
+{
+	if (raidEvent->hasPendingWork()) {
+		nextEventEvent = g_scheduler.addEvent(createSchedulerTask(RAID_SPAWN_TICKS, std::bind(&Raid::continueRaidEvent, this, raidEvent)));
+		return;
+	}
+
+	nextEvent++;
+	RaidEvent* newRaidEvent = getNextRaidEvent();
+	if (!newRaidEvent) {
 		resetRaid();
+		return;
 	}
+
+	// the time spent spreading this event's work counts towards the delay of the next one
+	int64_t elapsed = OTSYS_TIME() - eventStartTime;
+	uint32_t ticks = static_cast<uint32_t>(std::max<int64_t>(RAID_MINTICKS, static_cast<int64_t>(newRaidEvent->getDelay()) - raidEvent->getDelay() - elapsed));
+	nextEventEvent = g_scheduler.addEvent(createSchedulerTask(ticks, std::bind(&Raid::executeRaidEvent, this, newRaidEvent)));
 }
 
 void Raid::resetRaid()
@@ -338,6 +361,7 @@ bool SingleSpawnEvent::configureRaidEvent(const pugi::xml_node& eventNode)
 	pugi::xml_attribute attr;
 	if ((attr = eventNode.attribute("name"))) {
 		monsterName = attr.as_string();
+		monsterTypeId = g_monsters.getMonsterTypeId(monsterName);
 	} else {
 		std::cout << "[Error] Raid: name tag missing for singlespawn event." << std::endl;
 		return false;
@@ -368,7 +392,7 @@ bool SingleSpawnEvent::configureRaidEvent(const pugi::xml_node& eventNode)
 
 bool SingleSpawnEvent::executeEvent()
 {
-	Monster* monster = Monster::createMonster(monsterName);
+	Monster* monster = Monster::createMonster(monsterTypeId);
 	if (!monster) {
 		std::cout << "[Error] Raids: Cant create monster " << monsterName << std::endl;
 		return false;
@@ -499,35 +523,57 @@ bool AreaSpawnEvent::configureRaidEvent(const pugi::xml_node& eventNode)
 			}
 		}
 
-		spawnList.emplace_back(name, minAmount, maxAmount);
+		spawnList.emplace_back(name, g_monsters.getMonsterTypeId(name), minAmount, maxAmount);
 	}
 	return true;
 }
 
 bool AreaSpawnEvent::executeEvent()
 {
+	pendingSpawns.clear();
 	for (const MonsterSpawn& spawn : spawnList) {
 		uint32_t amount = uniform_random(spawn.minAmount, spawn.maxAmount);
-		for (uint32_t i = 0; i < amount; ++i) {
-			Monster* monster = Monster::createMonster(spawn.name);
-			if (!monster) {
-				std::cout << "[Error - AreaSpawnEvent::executeEvent] Can't create monster " << spawn.name << std::endl;
-				return false;
-			}
+		pendingSpawns.insert(pendingSpawns.end(), amount, &spawn);
+	}
 
-			bool success = false;
-			for (int32_t tries = 0; tries < MAXIMUM_TRIES_PER_MONSTER; tries++) {
-				Tile* tile = g_game.map.getTile(uniform_random(fromPos.x, toPos.x), uniform_random(fromPos.y, toPos.y), uniform_random(fromPos.z, toPos.z));
-				if (tile && !tile->isMoveableBlocking() && !tile->hasFlag(TILESTATE_PROTECTIONZONE) && tile->getTopCreature() == nullptr && g_game.placeCreature(monster, tile->getPosition(), false, true)) {
-					success = true;
-					break;
-				}
-			}
+	// placed back to front, keep the configured order
+	std::reverse(pendingSpawns.begin(), pendingSpawns.end());
+	return continueEvent();
+}
+
+bool AreaSpawnEvent::continueEvent()
+{
+	// every placement runs its own spectator query and sends, a budget keeps one task from placing hundreds
+	int64_t budget = g_config.getNumber(ConfigManager::RAID_SPAWNS_PER_TICK);
+	if (budget <= 0) {
+		budget = std::numeric_limits<int64_t>::max();
+	}
+
+	while (!pendingSpawns.empty() && budget-- > 0) {
+		const MonsterSpawn& spawn = *pendingSpawns.back();
+		pendingSpawns.pop_back();
+
+		Monster* monster = Monster::createMonster(spawn.monsterTypeId);
+		if (!monster) {
+			std::cout << "[Error - AreaSpawnEvent::continueEvent] Can't create monster " << spawn.name << std::endl;
+			pendingSpawns.clear();
+			return false;
+		}
+
+		monster->setFlowFieldPathing(g_config.getBoolean(ConfigManager::RAID_FLOW_FIELD_PATHING));
 
-			if (!success) {
-				delete monster;
+		bool success = false;
+		for (int32_t tries = 0; tries < MAXIMUM_TRIES_PER_MONSTER; tries++) {
+			Tile* tile = g_game.map.getTile(uniform_random(fromPos.x, toPos.x), uniform_random(fromPos.y, toPos.y), uniform_random(fromPos.z, toPos.z));
+			if (tile && !tile->isMoveableBlocking() && !tile->hasFlag(TILESTATE_PROTECTIONZONE) && tile->getTopCreature() == nullptr && g_game.placeCreature(monster, tile->getPosition(), false, true)) {
+				success = true;
+				break;
 			}
 		}
+
+		if (!success) {
+			delete monster;
+		}
 	}
 	return true;
 }
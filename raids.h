@@ -14,10 +14,11 @@ enum RaidState_t {
 };
 
 struct MonsterSpawn {
-	MonsterSpawn(std::string name, uint32_t minAmount, uint32_t maxAmount) :
-		name(std::move(name)), minAmount(minAmount), maxAmount(maxAmount) {}
+	MonsterSpawn(std::string name, uint32_t monsterTypeId, uint32_t minAmount, uint32_t maxAmount) :
+		name(std::move(name)), monsterTypeId(monsterTypeId), minAmount(minAmount), maxAmount(maxAmount) {}
 
 	std::string name;
+	uint32_t monsterTypeId;
 	uint32_t minAmount;
 	uint32_t maxAmount;
 };
@@ -26,6 +27,7 @@ struct MonsterSpawn {
 static constexpr int32_t MAXIMUM_TRIES_PER_MONSTER = 10;
 static constexpr int32_t CHECK_RAIDS_INTERVAL = 60;
 static constexpr int32_t RAID_MINTICKS = 1000;
+static constexpr int32_t RAID_SPAWN_TICKS = 100;
 
 class Raid;
 class RaidEvent;
@@ -102,6 +104,7 @@ class Raid
 		void startRaid();
 
 		void executeRaidEvent(RaidEvent* raidEvent);
+		void continueRaidEvent(RaidEvent* raidEvent);
 		void resetRaid();
 
 		RaidEvent* getNextRaidEvent();
@@ -128,6 +131,8 @@ class Raid
 		void stopEvents();
 
 	private:
+		void scheduleNextRaidEvent(RaidEvent* raidEvent);
+
 		std::vector<RaidEvent*> raidEvents;
 		std::string name;
 		uint32_t interval;
@@ -135,6 +140,7 @@ class Raid
 		uint64_t margin;
 		RaidState_t state = RAIDSTATE_IDLE;
 		uint32_t nextEventEvent = 0;
+		int64_t eventStartTime = 0;
 		bool loaded = false;
 		bool repeat;
 };
@@ -147,6 +153,15 @@ class RaidEvent
 		virtual bool configureRaidEvent(const pugi::xml_node& eventNode);
 
 		virtual bool executeEvent() = 0;
+
+		// events that spread their work over several ticks report it here and get continueEvent calls
+		virtual bool hasPendingWork() const {
+			return false;
+		}
+		virtual bool continueEvent() {
+			return true;
+		}
+
 		uint32_t getDelay() const {
 			return delay;
 		}
@@ -178,6 +193,7 @@ class SingleSpawnEvent final : public RaidEvent
 
 	private:
 		std::string monsterName;
+		uint32_t monsterTypeId = 0;
 		Position position;
 };
 
@@ -188,8 +204,14 @@ class AreaSpawnEvent final : public RaidEvent
 
 		bool executeEvent() override;
 
+		bool hasPendingWork() const override {
+			return !pendingSpawns.empty();
+		}
+		bool continueEvent() override;
+
 	private:
 		std::list<MonsterSpawn> spawnList;
+		std::vector<const MonsterSpawn*> pendingSpawns;
 		Position fromPos, toPos;
 };
 
@@ -0,0 +1,169 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#include "otpch.h"
+
+#include "rarity.h"
+#include "item.h"
+
+#include <numeric>
+
+namespace {
+
+struct RarityKeys
+{
+	std::array<CustomAttributeKey, rarityAbsorbTypes.size()> absorbs;
+	std::array<CustomAttributeKey, raritySkillTypes.size()> skills;
+	std::array<CustomAttributeKey, rarityElementTypes.size()> elements;
+	std::array<std::pair<CustomAttributeKey, CustomAttributeKey>, raritySpecialTypes.size()> specials;
+};
+
+template <size_t N>
+std::array<CustomAttributeKey, N> internKeys(const std::array<RarityBonusType, N>& types)
+{
+	std::array<CustomAttributeKey, N> keys;
+	for (size_t i = 0; i < N; ++i) {
+		keys[i] = CustomAttributeKey::get(types[i].key);
+	}
+	return keys;
+}
+
+const RarityKeys& getRarityKeys()
+{
+	static const RarityKeys keys = []() {
+		RarityKeys keys;
+		keys.absorbs = internKeys(rarityAbsorbTypes);
+		keys.skills = internKeys(raritySkillTypes);
+		keys.elements = internKeys(rarityElementTypes);
+		for (size_t i = 0; i < raritySpecialTypes.size(); ++i) {
+			keys.specials[i] = {CustomAttributeKey::get(raritySpecialTypes[i].chance.key), CustomAttributeKey::get(raritySpecialTypes[i].amount.key)};
+		}
+		return keys;
+	}();
+	return keys;
+}
+
+void appendBonus(std::string& description, const char* name, int32_t bonus, const char* suffix)
+{
+	if (!description.empty()) {
+		description += ", ";
+	}
+	description += name;
+	description += " +";
+	description += std::to_string(bonus);
+	description += suffix;
+}
+
+// picks count distinct random entries of the table
+template <size_t N>
+std::string rollBonuses(Item* item, const std::array<RarityBonusType, N>& types, const std::array<CustomAttributeKey, N>& keys,
+	int32_t count, const RarityBonusRange& range, const char* suffix)
+{
+	std::array<uint8_t, N> order;
+	std::iota(order.begin(), order.end(), 0);
+
+	std::string description;
+	count = std::min<int32_t>(count, N);
+	for (int32_t i = 0; i < count; ++i) {
+		std::swap(order[i], order[uniform_random(i, N - 1)]);
+
+		int32_t bonus = uniform_random(range.min, range.max);
+		item->setCustomAttribute(keys[order[i]], static_cast<int64_t>(bonus));
+		appendBonus(description, types[order[i]].name, bonus, suffix);
+	}
+	return description;
+}
+
+void rollSpecial(Item* item, size_t index, const RarityBonusRange& range, std::string& description)
+{
+	const RaritySpecialType& special = raritySpecialTypes[index];
+	const auto& keys = getRarityKeys().specials[index];
+
+	int32_t bonus = uniform_random(range.min, range.max);
+	item->setCustomAttribute(keys.first, static_cast<int64_t>(bonus));
+	item->setCustomAttribute(keys.second, static_cast<int64_t>(bonus));
+	appendBonus(description, special.chance.name, bonus, "%");
+	appendBonus(description, special.amount.name, bonus, "%");
+}
+
+}
+
+void buildRarityProfile(ItemType& it)
+{
+	it.rarityEquipment = (it.slotPosition & RARITY_EQUIP_SLOTS) != 0;
+	it.rarityElements = it.weaponType != WEAPON_NONE && it.attack > 0 && (!it.abilities || it.abilities->elementDamage == 0);
+}
+
+void applyRarityBonuses(Item* item, int32_t rarityId, RaritySpecials_t specials)
+{
+	if (rarityId <= 0 || rarityId > static_cast<int32_t>(RARITY_LEVELS)) {
+		return;
+	}
+
+	const ItemType& it = Item::items[item->getID()];
+	if (!it.rarityEquipment) {
+		return;
+	}
+
+	const RarityLevel& rarity = rarityLevels[rarityId - 1];
+	int32_t finalLevel = uniform_random(rarity.minLevel, rarity.maxLevel);
+	int32_t bonusRange = rarity.maxBonus - rarity.minBonus + 1;
+	int32_t finalBonus = rarity.minBonus + (finalLevel * bonusRange / 100);
+
+	if (it.attack > 0) {
+		item->setIntAttr(ITEM_ATTRIBUTE_ATTACK, it.attack + finalBonus);
+	}
+	if (it.defense > 0) {
+		item->setIntAttr(ITEM_ATTRIBUTE_DEFENSE, it.defense + finalBonus);
+	}
+	if (it.armor > 0) {
+		item->setIntAttr(ITEM_ATTRIBUTE_ARMOR, it.armor + finalBonus);
+	}
+	if (it.hitChance > 0) {
+		item->setIntAttr(ITEM_ATTRIBUTE_HITCHANCE, it.hitChance + finalBonus);
+	}
+
+	item->setCustomAttribute(CustomAttributeKeys::COMBAT_POWER_LEVEL, static_cast<int64_t>(finalLevel));
+
+	const RarityAttributes& attrCounts = rarityAttributes[rarityId - 1];
+	const RarityBonusRange& range = rarityAbsorptionBonuses[rarityId - 1];
+	const RarityKeys& keys = getRarityKeys();
+
+	std::string absorptionDesc = rollBonuses(item, rarityAbsorbTypes, keys.absorbs, attrCounts.numAbsorbs, range, "%");
+	std::string skillsDesc = rollBonuses(item, raritySkillTypes, keys.skills, attrCounts.numSkills, range, "");
+
+	std::string specialsDesc;
+	if (specials == RARITY_SPECIALS_RANDOM) {
+		rollSpecial(item, uniform_random(0, raritySpecialTypes.size() - 1), range, specialsDesc);
+	} else {
+		// every pair covers two special skills
+		int32_t numSpecials = std::min<int32_t>(attrCounts.numSpecials, raritySpecialTypes.size() * 2);
+		for (int32_t i = 0; i < numSpecials; i += 2) {
+			rollSpecial(item, i / 2, range, specialsDesc);
+		}
+	}
+
+	std::string elementDesc;
+	if (it.rarityElements && attrCounts.numElements > 0) {
+		elementDesc = rollBonuses(item, rarityElementTypes, keys.elements, attrCounts.numElements, rarityElementBonuses[rarityId - 1], "% dmg");
+	}
+
+	std::string description = item->getStrAttr(ITEM_ATTRIBUTE_DESCRIPTION);
+	if (!description.empty()) {
+		description += ", ";
+	}
+	description += "Level: " + std::to_string(finalLevel);
+	if (!absorptionDesc.empty()) {
+		description += ", " + absorptionDesc;
+	}
+	if (!skillsDesc.empty()) {
+		description += ", " + skillsDesc;
+	}
+	if (!specialsDesc.empty()) {
+		description += ", " + specialsDesc;
+	}
+	if (!elementDesc.empty()) {
+		description += ", Element: " + elementDesc;
+	}
+	item->setStrAttr(ITEM_ATTRIBUTE_DESCRIPTION, description);
+}
@@ -0,0 +1,163 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#ifndef FS_RARITY_H_5B0C9E2D7A4F4C1B9E3D8A6F0C2B7E41
+#define FS_RARITY_H_5B0C9E2D7A4F4C1B9E3D8A6F0C2B7E41
+
+#include "items.h"
+
+#include <array>
+
+class Item;
+
+struct RarityLevel
+{
+	int32_t value;
+	double chance;
+	int32_t minLevel;
+	int32_t maxLevel;
+	int32_t minBonus;
+	int32_t maxBonus;
+};
+
+struct RarityAttributes
+{
+	int32_t numAbsorbs;
+	int32_t numSkills;
+	int32_t numSpecials;
+	int32_t numElements;
+};
+
+struct RarityBonusRange
+{
+	int32_t min;
+	int32_t max;
+};
+
+struct RarityBonusType
+{
+	const char* key;
+	const char* name;
+};
+
+// special skills are always granted as a chance/amount pair
+struct RaritySpecialType
+{
+	RarityBonusType chance;
+	RarityBonusType amount;
+};
+
+enum RaritySpecials_t {
+	RARITY_SPECIALS_IN_ORDER,
+	RARITY_SPECIALS_RANDOM,
+};
+
+static constexpr size_t RARITY_LEVELS = 15;
+
+static constexpr uint32_t RARITY_EQUIP_SLOTS = SLOTP_HEAD | SLOTP_NECKLACE | SLOTP_ARMOR | SLOTP_RIGHT | SLOTP_LEFT
+	| SLOTP_LEGS | SLOTP_FEET | SLOTP_RING | SLOTP_DECKBAD | SLOTP_BELT | SLOTP_GLOVES;
+
+static constexpr std::array<RarityLevel, RARITY_LEVELS> rarityLevels = {{
+	{1,   15.0,   1,   10,   1,   1},
+	{2,   14.0,  11,   20,   1,   2},
+	{3,   13.0,  21,   30,   1,   2},
+	{4,   12.0,  31,   40,   1,   3},
+	{5,   10.0,  41,   50,   1,   3},
+	{6,    8.0,  51,   60,   2,   4},
+	{7,    7.0,  61,   70,   2,   5},
+	{8,    6.0,  71,   80,   3,   6},
+	{9,    5.0,  81,   90,   3,   7},
+	{10,   4.5,  91,  100,   4,   8},
+	{11,   3.3, 101,  110,   4,   9},
+	{12,   2.2, 111,  120,   5,  10},
+	{13,   1.8, 121,  130,   6,  10},
+	{14,   1.3, 131,  140,   7,  12},
+	{15,   1.0, 141,  150,   9,  15}
+}};
+
+static constexpr std::array<RarityAttributes, RARITY_LEVELS> rarityAttributes = {{
+	{1, 1, 0, 0}, // Rarity 1
+	{1, 1, 0, 1}, // Rarity 2
+	{1, 1, 0, 1}, // Rarity 3
+	{1, 1, 1, 1}, // Rarity 4
+	{1, 1, 1, 1}, // Rarity 5
+	{1, 2, 1, 1}, // Rarity 6
+	{1, 2, 1, 1}, // Rarity 7
+	{1, 2, 2, 1}, // Rarity 8
+	{2, 2, 2, 1}, // Rarity 9
+	{2, 2, 2, 1}, // Rarity 10
+	{2, 2, 2, 1}, // Rarity 11
+	{2, 2, 2, 1}, // Rarity 12
+	{2, 2, 2, 1}, // Rarity 13
+	{3, 3, 2, 1}, // Rarity 14
+	{3, 3, 2, 1}  // Rarity 15
+}};
+
+static constexpr std::array<RarityBonusRange, RARITY_LEVELS> rarityAbsorptionBonuses = {{
+	{1, 1}, {1, 1}, {1, 1}, {1, 2}, {1, 2},
+	{1, 3}, {1, 3}, {1, 4}, {1, 4}, {2, 5},
+	{2, 5}, {2, 5}, {3, 6}, {4, 6}, {5, 6}
+}};
+
+static constexpr std::array<RarityBonusRange, RARITY_LEVELS> rarityElementBonuses = {{
+	{1, 3}, {3, 6}, {4, 8}, {5, 10}, {6, 12},
+	{7, 14}, {8, 16}, {9, 18}, {10, 20}, {12, 22},
+	{14, 24}, {16, 26}, {18, 28}, {20, 30}, {25, 40}
+}};
+
+static constexpr std::array<RarityBonusType, 10> rarityAbsorbTypes = {{
+	{"rarity_physicalAbsorb", "Physical"},
+	{"rarity_energyAbsorb", "Energy"},
+	{"rarity_earthAbsorb", "Earth"},
+	{"rarity_fireAbsorb", "Fire"},
+	{"rarity_drownAbsorb", "Drown"},
+	{"rarity_iceAbsorb", "Ice"},
+	{"rarity_holyAbsorb", "Holy"},
+	{"rarity_deathAbsorb", "Death"},
+	{"rarity_waterAbsorb", "Water"},
+	{"rarity_arcaneAbsorb", "Arcane"}
+}};
+
+static constexpr std::array<RarityBonusType, 15> raritySkillTypes = {{
+	{"rarity_fistSkill", "Fist"},
+	{"rarity_clubSkill", "Club"},
+	{"rarity_swordSkill", "Sword"},
+	{"rarity_axeSkill", "Axe"},
+	{"rarity_distanceSkill", "Distance"},
+	{"rarity_shieldSkill", "Shielding"},
+	{"rarity_fishingSkill", "Fishing"},
+	{"rarity_craftingSkill", "Crafting"},
+	{"rarity_woodcuttingSkill", "Woodcutting"},
+	{"rarity_miningSkill", "Mining"},
+	{"rarity_herbalistSkill", "Herbalism"},
+	{"rarity_armorsmithSkill", "Armorsmithing"},
+	{"rarity_weaponsmithSkill", "Weaponsmithing"},
+	{"rarity_jewelsmithSkill", "Jewelsmithing"},
+	{"rarity_maglevelSkill", "Magic"}
+}};
+
+static constexpr std::array<RaritySpecialType, 3> raritySpecialTypes = {{
+	{{"rarity_criticalHitChance", "Critical Chance"}, {"rarity_criticalHitAmount", "Critical Hit"}},
+	{{"rarity_manaLeechChance", "Mana Chance"}, {"rarity_manaLeechAmount", "Mana Amount"}},
+	{{"rarity_lifeLeechChance", "Life Chance"}, {"rarity_lifeLeechAmount", "Life Amount"}}
+}};
+
+static constexpr std::array<RarityBonusType, 8> rarityElementTypes = {{
+	{"rarity_elementfire", "Fire"},
+	{"rarity_elementice", "Ice"},
+	{"rarity_elementenergy", "Energy"},
+	{"rarity_elementdeath", "Death"},
+	{"rarity_elementearth", "Earth"},
+	{"rarity_elementwater", "Water"},
+	{"rarity_elementarcane", "Arcane"},
+	{"rarity_elementholy", "Holy"}
+}};
+
+// fills the rarity profile of an item type, called once the type is fully loaded
+void buildRarityProfile(ItemType& it);
+
+// rolls the bonuses of the given rarity onto an item, items whose type cannot
+// carry rarity bonuses are left untouched
+void applyRarityBonuses(Item* item, int32_t rarityId, RaritySpecials_t specials);
+
+#endif
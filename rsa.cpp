@@ -6,19 +6,107 @@
 #include "rsa.h"
 
 #include <cryptopp/base64.h>
+#include <cryptopp/modarith.h>
+#include <cryptopp/nbtheory.h>
 #include <cryptopp/osrng.h>
 #include <fmt/color.h>
 
+#include <atomic>
 #include <fstream>
 #include <sstream>
 
-static CryptoPP::AutoSeededRandomPool prng;
+namespace {
+
+std::atomic<uint64_t> nextKeyGeneration{1};
+
+// Montgomery forms of the modulus and of both primes, built once per thread
+// and key. Their arithmetic writes to scratch space inside the object, so a
+// thread never shares them, and neither the random pool.
+class DecryptContext
+{
+	public:
+		DecryptContext(const CryptoPP::RSA::PrivateKey& key, uint64_t keyGeneration) :
+			key(key), modN(key.GetModulus()), modP(key.GetPrime1()), modQ(key.GetPrime2()), keyGeneration(keyGeneration) {}
+
+		uint64_t getKeyGeneration() const {
+			return keyGeneration;
+		}
+
+		CryptoPP::Integer calculateInverse(const CryptoPP::Integer& c) {
+			const CryptoPP::Integer& n = key.GetModulus();
+			const CryptoPP::Integer& e = key.GetPublicExponent();
+			const CryptoPP::Integer& p = key.GetPrime1();
+			const CryptoPP::Integer& q = key.GetPrime2();
+
+			if (c.IsNegative() || c >= n) {
+				throw CryptoPP::Exception(CryptoPP::Exception::INVALID_ARGUMENT, "RSA::decrypt: input out of range");
+			}
+
+			// blinded with a random r, the time taken does not depend on c
+			CryptoPP::Integer r;
+			do {
+				r.Randomize(rng, CryptoPP::Integer::One(), n - CryptoPP::Integer::One());
+			} while (!CryptoPP::RelativelyPrime(r, n));
+
+			CryptoPP::Integer blinded = CryptoPP::a_times_b_mod_c(c, power(modN, r, e), n);
+
+			// chinese remainder theorem with the exponents and the coefficient stored in the key
+			CryptoPP::Integer mp = power(modP, blinded % p, key.GetModPrime1PrivateExponent());
+			CryptoPP::Integer mq = power(modQ, blinded % q, key.GetModPrime2PrivateExponent());
+			CryptoPP::Integer difference = (mp - mq) % p;
+			if (difference.IsNegative()) {
+				difference += p;
+			}
+			CryptoPP::Integer m = mq + q * CryptoPP::a_times_b_mod_c(key.GetMultiplicativeInverseOfPrime2ModPrime1(), difference, p);
+			m = CryptoPP::a_times_b_mod_c(m, r.InverseMod(n), n);
+
+			// a fault in the private operation must not hand out a value that leaks the primes
+			if (power(modN, m, e) != c) {
+				throw CryptoPP::Exception(CryptoPP::Exception::OTHER_ERROR, "RSA::decrypt: computational error");
+			}
+			return m;
+		}
+
+	private:
+		static CryptoPP::Integer power(const CryptoPP::MontgomeryRepresentation& modulus, const CryptoPP::Integer& base, const CryptoPP::Integer& exponent) {
+			return modulus.ConvertOut(modulus.Exponentiate(modulus.ConvertIn(base), exponent));
+		}
+
+		const CryptoPP::RSA::PrivateKey& key;
+		CryptoPP::MontgomeryRepresentation modN;
+		CryptoPP::MontgomeryRepresentation modP;
+		CryptoPP::MontgomeryRepresentation modQ;
+		CryptoPP::AutoSeededRandomPool rng;
+		uint64_t keyGeneration;
+};
+
+DecryptContext& getDecryptContext(const CryptoPP::RSA::PrivateKey& key, uint64_t keyGeneration)
+{
+	thread_local std::unique_ptr<DecryptContext> context;
+	if (!context || context->getKeyGeneration() != keyGeneration) {
+		context.reset(new DecryptContext(key, keyGeneration));
+	}
+	return *context;
+}
+
+}
 
 void RSA::decrypt(char* msg) const
+{
+	try {
+		CryptoPP::Integer c{reinterpret_cast<uint8_t*>(msg), 128};
+		auto m = getDecryptContext(pk, keyGeneration).calculateInverse(c);
+		m.Encode(reinterpret_cast<uint8_t*>(msg), 128);
+	} catch (const CryptoPP::Exception& e) {
+		fmt::print(fg(fmt::color::crimson) | fmt::emphasis::bold, e.what(), "\n");
+	}
+}
+
+void RSA::encrypt(char* msg) const
 {
 	try {
 		CryptoPP::Integer m{reinterpret_cast<uint8_t*>(msg), 128};
-		auto c = pk.CalculateInverse(prng, m);
+		auto c = pk.ApplyFunction(m);
 		c.Encode(reinterpret_cast<uint8_t*>(msg), 128);
 	} catch (const CryptoPP::Exception& e) {
 		fmt::print(fg(fmt::color::crimson) | fmt::emphasis::bold, e.what(), "\n");
@@ -63,7 +151,11 @@ void RSA::loadPEM(const std::string& filename)
 
 	pk.BERDecodePrivateKey(queue, false, queue.MaxRetrievable());
 
+	CryptoPP::AutoSeededRandomPool prng;
 	if (!pk.Validate(prng, 3)) {
 		throw std::runtime_error("RSA private key is not valid.");
 	}
+
+	// every thread builds its context again on its next decrypt
+	keyGeneration = nextKeyGeneration.fetch_add(1, std::memory_order_relaxed);
 }
@@ -19,9 +19,13 @@ class RSA
 
 		void loadPEM(const std::string& filename);
 		void decrypt(char* msg) const;
+		// raw public key operation, for tools that speak the client side
+		void encrypt(char* msg) const;
 
 	private:
 		CryptoPP::RSA::PrivateKey pk;
+		// tells the contexts decrypt keeps per thread which key they were built for
+		uint64_t keyGeneration = 0;
 };
 
 #endif
@@ -4,36 +4,304 @@
 #include "otpch.h"
 
 #include "scheduler.h"
-#include <boost/asio/post.hpp>
-#include <memory>
+#include "lockfree.h"
 
-uint32_t Scheduler::addEvent(SchedulerTask* task)
+static constexpr size_t SCHEDULER_TASK_FREE_LIST_CAPACITY = 8192;
+
+Scheduler::Scheduler()
+{
+	wheel.fill(INVALID_SLOT);
+	timers.reserve(4096);
+	dueTimers.reserve(256);
+}
+
+int64_t Scheduler::getElapsedTime() const
+{
+	if (virtualTime) {
+		return virtualElapsed;
+	}
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+uint32_t Scheduler::allocateSlot()
 {
-	// check if the event has a valid id
-	if (task->getEventId() == 0) {
-		task->setEventId(++lastEventId);
+	if (freeHead == INVALID_SLOT) {
+		if (timers.size() >= MAX_SLOTS) {
+			return INVALID_SLOT;
+		}
+
+		timers.emplace_back();
+		return timers.size() - 1;
 	}
 
-	boost::asio::post(io_context, [this, task]() {
-		// insert the event id in the list of active events
-		auto it = eventIdTimerMap.emplace(task->getEventId(), boost::asio::steady_timer{io_context});
-		auto& timer = it.first->second;
+	// slots are recycled in FIFO order so a generation wraps as late as possible
+	uint32_t slot = freeHead;
+	freeHead = timers[slot].next;
+	if (freeHead == INVALID_SLOT) {
+		freeTail = INVALID_SLOT;
+	}
+	return slot;
+}
 
-		timer.expires_from_now(std::chrono::milliseconds(task->getDelay()));
-		timer.async_wait([this, task](const boost::system::error_code& error) {
-			eventIdTimerMap.erase(task->getEventId());
+void Scheduler::releaseSlot(uint32_t slot)
+{
+	TimerEntry& entry = timers[slot];
+	entry.task = nullptr;
+	entry.state = TIMER_FREE;
+	entry.generation = (entry.generation + 1) & GENERATION_MASK;
+	entry.prev = INVALID_SLOT;
+	entry.next = INVALID_SLOT;
 
-			if (error == boost::asio::error::operation_aborted || getState() == THREAD_STATE_TERMINATED) {
-				// the timer has been manually canceled(timer->cancel()) or Scheduler::shutdown has been called
-				delete task;
-				return;
-			}
+	if (freeTail == INVALID_SLOT) {
+		freeHead = slot;
+	} else {
+		timers[freeTail].next = slot;
+	}
+	freeTail = slot;
+}
+
+uint32_t Scheduler::getSlot(uint32_t eventId) const
+{
+	uint32_t slot = (eventId & SLOT_MASK) - 1;
+	if (slot >= timers.size()) {
+		return INVALID_SLOT;
+	}
+
+	const TimerEntry& entry = timers[slot];
+	if (entry.state == TIMER_FREE || entry.state == TIMER_CANCELED || entry.generation != (eventId >> SLOT_BITS)) {
+		return INVALID_SLOT;
+	}
+	return slot;
+}
+
+void Scheduler::insertTimer(uint32_t slot)
+{
+	TimerEntry& entry = timers[slot];
+	uint64_t expireTick = entry.deadline / SCHEDULER_MINTICKS;
+	if (expireTick <= currentTick) {
+		pushDueTimer(slot);
+		return;
+	}
+
+	uint64_t delta = expireTick - currentTick;
+	uint32_t level = 0;
+	while (level < WHEEL_LEVELS - 1 && delta >= (uint64_t{1} << (WHEEL_BITS * (level + 1)))) {
+		++level;
+	}
+
+	uint32_t bucket = level * WHEEL_SIZE + ((expireTick >> (WHEEL_BITS * level)) & WHEEL_MASK);
+	entry.state = TIMER_WHEEL;
+	entry.bucket = bucket;
+	entry.prev = INVALID_SLOT;
+	entry.next = wheel[bucket];
+	if (entry.next != INVALID_SLOT) {
+		timers[entry.next].prev = slot;
+	}
+	wheel[bucket] = slot;
+	++wheelCount;
+}
+
+void Scheduler::unlinkTimer(uint32_t slot)
+{
+	TimerEntry& entry = timers[slot];
+	if (entry.prev != INVALID_SLOT) {
+		timers[entry.prev].next = entry.next;
+	} else {
+		wheel[entry.bucket] = entry.next;
+	}
+
+	if (entry.next != INVALID_SLOT) {
+		timers[entry.next].prev = entry.prev;
+	}
+
+	entry.prev = INVALID_SLOT;
+	entry.next = INVALID_SLOT;
+	--wheelCount;
+}
 
-			g_dispatcher.addTask(task);
-		});
+void Scheduler::pushDueTimer(uint32_t slot)
+{
+	timers[slot].state = TIMER_DUE;
+	dueTimers.push_back(slot);
+	std::push_heap(dueTimers.begin(), dueTimers.end(), [this](uint32_t lhs, uint32_t rhs) {
+		const TimerEntry& l = timers[lhs];
+		const TimerEntry& r = timers[rhs];
+		return l.deadline != r.deadline ? l.deadline > r.deadline : l.sequence > r.sequence;
 	});
+}
 
-	return task->getEventId();
+void Scheduler::popDueTimer()
+{
+	std::pop_heap(dueTimers.begin(), dueTimers.end(), [this](uint32_t lhs, uint32_t rhs) {
+		const TimerEntry& l = timers[lhs];
+		const TimerEntry& r = timers[rhs];
+		return l.deadline != r.deadline ? l.deadline > r.deadline : l.sequence > r.sequence;
+	});
+	dueTimers.pop_back();
+}
+
+void Scheduler::cascadeBucket(uint32_t level, uint32_t index)
+{
+	uint32_t& head = wheel[level * WHEEL_SIZE + index];
+	uint32_t slot = head;
+	head = INVALID_SLOT;
+
+	while (slot != INVALID_SLOT) {
+		uint32_t next = timers[slot].next;
+		--wheelCount;
+		insertTimer(slot);
+		slot = next;
+	}
+}
+
+void Scheduler::advanceWheel(int64_t now)
+{
+	uint64_t targetTick = now / SCHEDULER_MINTICKS;
+	while (currentTick < targetTick) {
+		if (wheelCount == 0) {
+			// nothing can be missed, jump straight to the current tick
+			currentTick = targetTick;
+			return;
+		}
+
+		++currentTick;
+
+		// refill the lower levels once their current rotation is over
+		for (uint32_t level = 1; level < WHEEL_LEVELS; ++level) {
+			if ((currentTick & ((uint64_t{1} << (WHEEL_BITS * level)) - 1)) != 0) {
+				break;
+			}
+			cascadeBucket(level, (currentTick >> (WHEEL_BITS * level)) & WHEEL_MASK);
+		}
+
+		cascadeBucket(0, currentTick & WHEEL_MASK);
+	}
+}
+
+void Scheduler::collectDueTasks(int64_t now)
+{
+	advanceWheel(now);
+
+	while (!dueTimers.empty()) {
+		uint32_t slot = dueTimers.front();
+		TimerEntry& entry = timers[slot];
+		if (entry.state == TIMER_CANCELED) {
+			popDueTimer();
+			releaseSlot(slot);
+			continue;
+		}
+
+		if (entry.deadline > now) {
+			break;
+		}
+
+		readyTasks.push_back(entry.task);
+		popDueTimer();
+		releaseSlot(slot);
+	}
+}
+
+size_t Scheduler::dispatchDueTasks()
+{
+	std::vector<SchedulerTask*> tasks;
+	{
+		std::lock_guard<ProfiledMutex> lockClass(eventLock);
+		collectDueTasks(getElapsedTime());
+		tasks.swap(readyTasks);
+	}
+
+	for (SchedulerTask* task : tasks) {
+		g_dispatcher.addTask(task);
+	}
+	return tasks.size();
+}
+
+void Scheduler::threadMain()
+{
+	ProfiledUniqueLock eventLockUnique(eventLock);
+	while (getState() != THREAD_STATE_TERMINATED) {
+		collectDueTasks(getElapsedTime());
+
+		if (!readyTasks.empty()) {
+			eventLockUnique.unlock();
+			for (SchedulerTask* task : readyTasks) {
+				g_dispatcher.addTask(task);
+			}
+			readyTasks.clear();
+			eventLockUnique.lock();
+			continue;
+		}
+
+		if (!dueTimers.empty()) {
+			nextWakeup = timers[dueTimers.front()].deadline;
+		} else if (wheelCount != 0) {
+			nextWakeup = (currentTick + 1) * SCHEDULER_MINTICKS;
+		} else {
+			nextWakeup = std::numeric_limits<int64_t>::max();
+		}
+
+		if (nextWakeup == std::numeric_limits<int64_t>::max()) {
+			eventSignal.wait(eventLockUnique);
+		} else {
+			eventSignal.wait_until(eventLockUnique, epoch + std::chrono::milliseconds(nextWakeup));
+		}
+	}
+
+	// the scheduler has been shut down, release all pending tasks
+	for (TimerEntry& entry : timers) {
+		if (entry.state == TIMER_WHEEL || entry.state == TIMER_DUE) {
+			delete entry.task;
+			entry.task = nullptr;
+		}
+	}
+}
+
+uint32_t Scheduler::addEvent(SchedulerTask* task)
+{
+	ProfiledUniqueLock eventLockUnique(eventLock);
+
+	uint32_t slot = allocateSlot();
+	if (slot == INVALID_SLOT) {
+		eventLockUnique.unlock();
+		std::cout << "[Error - Scheduler::addEvent] Too many active events." << std::endl;
+		delete task;
+		return 0;
+	}
+
+	int64_t now = getElapsedTime();
+	if (wheelCount == 0) {
+		// an empty wheel may lag behind, fast forward it before placing the timer
+		currentTick = std::max<uint64_t>(currentTick, now / SCHEDULER_MINTICKS);
+	}
+
+	TimerEntry& entry = timers[slot];
+	entry.task = task;
+	entry.deadline = now + task->getDelay();
+	entry.sequence = nextSequence++;
+
+	uint32_t eventId = (entry.generation << SLOT_BITS) | (slot + 1);
+	task->setEventId(eventId);
+
+	insertTimer(slot);
+
+	int64_t wakeup = entry.state == TIMER_DUE ? entry.deadline : (currentTick + 1) * SCHEDULER_MINTICKS;
+	bool doSignal = wakeup < nextWakeup;
+	if (doSignal) {
+		nextWakeup = wakeup;
+	}
+
+	eventLockUnique.unlock();
+
+	if (doSignal) {
+		eventSignal.notify_one();
+	}
+	return eventId;
+}
+
+size_t Scheduler::getEventCount()
+{
+	std::lock_guard<ProfiledMutex> lockClass(eventLock);
+	return wheelCount + dueTimers.size();
 }
 
 void Scheduler::stopEvent(uint32_t eventId)
@@ -42,29 +310,57 @@ void Scheduler::stopEvent(uint32_t eventId)
 		return;
 	}
 
-	boost::asio::post(io_context, [this, eventId]() {
-		// search the event id
-		auto it = eventIdTimerMap.find(eventId);
-		if (it != eventIdTimerMap.end()) {
-			it->second.cancel();
+	SchedulerTask* task;
+	{
+		std::lock_guard<ProfiledMutex> lockClass(eventLock);
+		uint32_t slot = getSlot(eventId);
+		if (slot == INVALID_SLOT) {
+			return;
 		}
-	});
+
+		TimerEntry& entry = timers[slot];
+		task = entry.task;
+		entry.task = nullptr;
+
+		if (entry.state == TIMER_WHEEL) {
+			unlinkTimer(slot);
+			releaseSlot(slot);
+		} else {
+			// still referenced by the due heap, the scheduler thread frees it
+			entry.state = TIMER_CANCELED;
+		}
+	}
+
+	delete task;
 }
 
 void Scheduler::shutdown()
 {
-	setState(THREAD_STATE_TERMINATED);
-	boost::asio::post(io_context, [this]() {
-		// cancel all active timers
-		for (auto& it : eventIdTimerMap) {
-			it.second.cancel();
-		}
+	{
+		std::lock_guard<ProfiledMutex> lockClass(eventLock);
+		setState(THREAD_STATE_TERMINATED);
+	}
+	eventSignal.notify_one();
+}
 
-		io_context.stop();
-	});
+void* SchedulerTask::operator new(size_t size)
+{
+	if (size != sizeof(SchedulerTask)) {
+		return ::operator new(size);
+	}
+	return LockfreePoolingAllocator<SchedulerTask, SCHEDULER_TASK_FREE_LIST_CAPACITY>().allocate(1);
+}
+
+void SchedulerTask::operator delete(void* p, size_t size)
+{
+	if (size != sizeof(SchedulerTask)) {
+		::operator delete(p);
+		return;
+	}
+	LockfreePoolingAllocator<SchedulerTask, SCHEDULER_TASK_FREE_LIST_CAPACITY>().deallocate(static_cast<SchedulerTask*>(p), 1);
 }
 
-SchedulerTask* createSchedulerTask(uint32_t delay, TaskFunc&& f)
+SchedulerTask* createSchedulerTask(uint32_t delay, TaskFunc&& f, const char* origin/* = TASK_CALLER*/)
 {
-	return new SchedulerTask(delay, std::move(f));
+	return new SchedulerTask(delay, std::move(f), origin);
 }
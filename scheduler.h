@@ -5,8 +5,11 @@
 #define FS_SCHEDULER_H_2905B3D5EAB34B4BA8830167262D2DC1
 
 #include "tasks.h"
-#include <unordered_map>
+#include <array>
+#include <condition_variable>
+#include <limits>
 
+#include "lockprofiler.h"
 #include "thread_holder_base.h"
 
 static constexpr int32_t SCHEDULER_MINTICKS = 50;
@@ -14,6 +17,9 @@ static constexpr int32_t SCHEDULER_MINTICKS = 50;
 class SchedulerTask : public Task
 {
 	public:
+		static void* operator new(size_t size);
+		static void operator delete(void* p, size_t size);
+
 		void setEventId(uint32_t id) {
 			eventId = id;
 		}
@@ -25,30 +31,112 @@ class SchedulerTask : public Task
 			return delay;
 		}
 	private:
-		SchedulerTask(uint32_t delay, TaskFunc&& f) : Task(std::move(f)), delay(delay) {}
+		SchedulerTask(uint32_t delay, TaskFunc&& f, const char* origin) : Task(std::move(f), origin), delay(delay) {
+			phase = TICK_PHASE_SIMULATE;
+		}
 
 		uint32_t eventId = 0;
 		uint32_t delay = 0;
 
-		friend SchedulerTask* createSchedulerTask(uint32_t, TaskFunc&&);
+		friend SchedulerTask* createSchedulerTask(uint32_t, TaskFunc&&, const char*);
 };
 
-SchedulerTask* createSchedulerTask(uint32_t delay, TaskFunc&& f);
+SchedulerTask* createSchedulerTask(uint32_t delay, TaskFunc&& f, const char* origin = TASK_CALLER);
 
 class Scheduler : public ThreadHolder<Scheduler>
 {
 	public:
+		Scheduler();
+
 		uint32_t addEvent(SchedulerTask* task);
 		void stopEvent(uint32_t eventId);
 
+		size_t getEventCount();
+
+		// simulation, no thread is started and time only moves when the caller
+		// sets it, the tasks due by then are posted by dispatchDueTasks
+		void startVirtual() {
+			virtualTime = true;
+			setState(THREAD_STATE_RUNNING);
+		}
+		void setVirtualElapsedTime(int64_t elapsed) {
+			virtualElapsed = elapsed;
+		}
+		size_t dispatchDueTasks();
+
 		void shutdown();
 
-		void threadMain() { io_context.run(); }
+		void threadMain();
+
 	private:
-		std::atomic<uint32_t> lastEventId{0};
-		std::unordered_map<uint32_t, boost::asio::steady_timer> eventIdTimerMap;
-		boost::asio::io_context io_context;
-		boost::asio::io_context::work work{io_context};
+		// hierarchical timer wheel, every level has WHEEL_SIZE buckets and
+		// one bucket of level n spans WHEEL_SIZE^n ticks of SCHEDULER_MINTICKS
+		static constexpr uint32_t WHEEL_BITS = 8;
+		static constexpr uint32_t WHEEL_SIZE = 1 << WHEEL_BITS;
+		static constexpr uint32_t WHEEL_MASK = WHEEL_SIZE - 1;
+		static constexpr uint32_t WHEEL_LEVELS = 4;
+
+		// event ids are slab handles: the low bits hold the slot (offset by one
+		// so that 0 is never a valid id) and the high bits its generation
+		static constexpr uint32_t SLOT_BITS = 20;
+		static constexpr uint32_t SLOT_MASK = (1 << SLOT_BITS) - 1;
+		static constexpr uint32_t MAX_SLOTS = SLOT_MASK - 1;
+		static constexpr uint32_t GENERATION_MASK = (1 << (32 - SLOT_BITS)) - 1;
+		static constexpr uint32_t INVALID_SLOT = std::numeric_limits<uint32_t>::max();
+
+		enum TimerState : uint8_t {
+			TIMER_FREE,
+			TIMER_WHEEL,
+			TIMER_DUE,
+			TIMER_CANCELED,
+		};
+
+		struct TimerEntry {
+			SchedulerTask* task = nullptr;
+			int64_t deadline = 0;
+			uint64_t sequence = 0;
+			uint32_t prev = INVALID_SLOT;
+			uint32_t next = INVALID_SLOT;
+			uint32_t generation = 0;
+			uint16_t bucket = 0;
+			TimerState state = TIMER_FREE;
+		};
+
+		int64_t getElapsedTime() const;
+
+		uint32_t allocateSlot();
+		void releaseSlot(uint32_t slot);
+		uint32_t getSlot(uint32_t eventId) const;
+
+		void insertTimer(uint32_t slot);
+		void unlinkTimer(uint32_t slot);
+		void pushDueTimer(uint32_t slot);
+		void popDueTimer();
+		void cascadeBucket(uint32_t level, uint32_t index);
+		void advanceWheel(int64_t now);
+		void collectDueTasks(int64_t now);
+
+		ProfiledMutex eventLock{"Scheduler::eventLock"};
+		ProfiledConditionVariable eventSignal;
+
+		std::vector<TimerEntry> timers;
+		uint32_t freeHead = INVALID_SLOT;
+		uint32_t freeTail = INVALID_SLOT;
+
+		std::array<uint32_t, WHEEL_SIZE * WHEEL_LEVELS> wheel;
+		size_t wheelCount = 0;
+		uint64_t currentTick = 0;
+
+		// timers whose tick has been reached, kept as a heap on the exact deadline
+		std::vector<uint32_t> dueTimers;
+		std::vector<SchedulerTask*> readyTasks;
+
+		uint64_t nextSequence = 0;
+		int64_t nextWakeup = std::numeric_limits<int64_t>::max();
+		const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+		bool virtualTime = false;
+		int64_t virtualElapsed = 0;
 };
 
 extern Scheduler g_scheduler;
@@ -6,6 +6,7 @@
 #include "script.h"
 #include <boost/filesystem.hpp>
 #include "configmanager.h"
+#include "workerpool.h"
 
 extern LuaEnvironment g_luaEnvironment;
 extern ConfigManager g_config;
@@ -81,3 +82,33 @@ bool Scripts::loadScripts(std::string folderName, bool isLib, bool reload)
 
 	return true;
 }
+
+void Scripts::compileScripts(const std::string& folderName)
+{
+	namespace fs = boost::filesystem;
+
+	const auto dir = fs::current_path() / "data" / folderName;
+	if (!fs::exists(dir) || !fs::is_directory(dir)) {
+		return;
+	}
+
+	std::vector<std::string> files;
+	fs::recursive_directory_iterator endit;
+	for (fs::recursive_directory_iterator it(dir); it != endit; ++it) {
+		if (fs::is_regular_file(*it) && it->path().extension() == ".lua" && it->path().filename().string().find('#') == std::string::npos) {
+			files.push_back(it->path().string());
+		}
+	}
+
+	// compiling needs no libraries, a bare state per file is cheap enough
+	WorkerPool::parallelForStartup(files.size(), [&files](size_t i) {
+		lua_State* L = luaL_newstate();
+		if (!L) {
+			return;
+		}
+
+		// syntax errors are reported once the scripts get loaded
+		LuaScriptInterface::loadCachedFile(L, files[i]);
+		lua_close(L);
+	});
+}
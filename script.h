@@ -14,6 +14,11 @@ class Scripts
 		~Scripts();
 
 		bool loadScripts(std::string folderName, bool isLib, bool reload);
+
+		// refreshes the bytecode cache of every script in the folder without running them,
+		// meant for a helper thread ahead of a reload
+		static void compileScripts(const std::string& folderName);
+
 		LuaScriptInterface& getScriptInterface() {
 			return scriptInterface;
 		}
@@ -14,6 +14,8 @@
 #include "globalevent.h"
 #include "events.h"
 #include "script.h"
+#include "purescripts.h"
+#include "configmanager.h"
 
 Actions* g_actions = nullptr;
 CreatureEvents* g_creatureEvents = nullptr;
@@ -27,6 +29,7 @@ Weapons* g_weapons = nullptr;
 Scripts* g_scripts = nullptr;
 
 extern LuaEnvironment g_luaEnvironment;
+extern ConfigManager g_config;
 
 ScriptingManager::~ScriptingManager()
 {
@@ -48,6 +51,12 @@ bool ScriptingManager::loadScriptSystems()
 		std::cout << "[Warning - ScriptingManager::loadScriptSystems] Can not load data/global.lua" << std::endl;
 	}
 
+	// one state for the dispatcher and one for every worker thread
+	if (!g_pureScripts.load(std::max<int32_t>(0, g_config.getNumber(ConfigManager::PATHFINDING_THREADS)) + 1)) {
+		std::cout << "> ERROR: Unable to load pure scripts!" << std::endl;
+		return false;
+	}
+
 	g_scripts = new Scripts();
 	std::cout << ">> Loading lua libs" << std::endl;
 	if (!g_scripts->loadScripts("scripts/lib", true, false)) {
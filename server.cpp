@@ -8,10 +8,31 @@
 #include "scheduler.h"
 #include "configmanager.h"
 #include "ban.h"
+#include "loginworkers.h"
 
 extern ConfigManager g_config;
 Ban g_bans;
 
+namespace {
+
+#ifdef SO_REUSEPORT
+using reuse_port = boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+#endif
+
+size_t getAcceptorCount()
+{
+	int32_t acceptorCount = std::max<int32_t>(1, g_config.getNumber(ConfigManager::ACCEPTORS_PER_PORT));
+#ifndef SO_REUSEPORT
+	if (acceptorCount > 1) {
+		std::cout << "[Warning - ServicePort::open] SO_REUSEPORT is not available, every port gets one acceptor." << std::endl;
+		acceptorCount = 1;
+	}
+#endif
+	return acceptorCount;
+}
+
+}
+
 ServiceManager::~ServiceManager()
 {
 	stop();
@@ -26,7 +47,26 @@ void ServiceManager::run()
 {
 	assert(!running);
 	running = true;
+
+	// the main thread services the io_service too, any extra threads share its handlers
+	int32_t threadCount = std::max<int32_t>(1, g_config.getNumber(ConfigManager::NETWORK_THREADS));
+
+	std::vector<std::thread> threads;
+	threads.reserve(threadCount - 1);
+	for (int32_t i = 1; i < threadCount; ++i) {
+		threads.emplace_back([this]() { io_service.run(); });
+	}
+
+	// without login workers the first messages are parsed on the network threads
+	g_loginWorkers.start(std::max<int32_t>(0, g_config.getNumber(ConfigManager::LOGIN_THREADS)));
+
 	io_service.run();
+
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+
+	g_loginWorkers.shutdown();
 }
 
 void ServiceManager::stop()
@@ -76,17 +116,18 @@ std::string ServicePort::get_protocol_names() const
 	return str;
 }
 
-void ServicePort::accept()
+void ServicePort::accept(const Acceptor_ptr& acceptor)
 {
-	if (!acceptor) {
+	std::lock_guard<std::mutex> lockClass(acceptorLock);
+	if (!acceptor->is_open()) {
 		return;
 	}
 
 	auto connection = ConnectionManager::getInstance().createConnection(io_service, shared_from_this());
-	acceptor->async_accept(connection->getSocket(), std::bind(&ServicePort::onAccept, shared_from_this(), connection, std::placeholders::_1));
+	acceptor->async_accept(connection->getSocket(), std::bind(&ServicePort::onAccept, shared_from_this(), acceptor, connection, std::placeholders::_1));
 }
 
-void ServicePort::onAccept(Connection_ptr connection, const boost::system::error_code& error)
+void ServicePort::onAccept(const Acceptor_ptr& acceptor, Connection_ptr connection, const boost::system::error_code& error)
 {
 	if (!error) {
 		if (services.empty()) {
@@ -95,6 +136,8 @@ void ServicePort::onAccept(Connection_ptr connection, const boost::system::error
 
 		auto remote_ip = connection->getIP();
 		if (remote_ip != 0 && g_bans.acceptConnection(remote_ip)) {
+			applySocketOptions(connection->getSocket());
+
 			Service_ptr service = services.front();
 			if (service->is_single_socket()) {
 				connection->accept(service->make_protocol(connection));
@@ -105,10 +148,11 @@ void ServicePort::onAccept(Connection_ptr connection, const boost::system::error
 			connection->close(Connection::FORCE_CLOSE);
 		}
 
-		accept();
+		accept(acceptor);
 	} else if (error != boost::asio::error::operation_aborted) {
+		std::lock_guard<std::mutex> lockClass(acceptorLock);
 		if (!pendingStart) {
-			close();
+			closeAcceptors();
 			pendingStart = true;
 			g_scheduler.addEvent(createSchedulerTask(15000,
 			                     std::bind(&ServicePort::openAcceptor, std::weak_ptr<ServicePort>(shared_from_this()), serverPort)));
@@ -116,6 +160,19 @@ void ServicePort::onAccept(Connection_ptr connection, const boost::system::error
 	}
 }
 
+void ServicePort::applySocketOptions(boost::asio::ip::tcp::socket& socket) const
+{
+	// a refused option leaves the system default, the connection works either way
+	boost::system::error_code error;
+	socket.set_option(boost::asio::ip::tcp::no_delay(socketOptions.noDelay), error);
+	if (socketOptions.sendBufferSize > 0) {
+		socket.set_option(boost::asio::socket_base::send_buffer_size(socketOptions.sendBufferSize), error);
+	}
+	if (socketOptions.receiveBufferSize > 0) {
+		socket.set_option(boost::asio::socket_base::receive_buffer_size(socketOptions.receiveBufferSize), error);
+	}
+}
+
 Protocol_ptr ServicePort::make_protocol(bool checksummed, NetworkMessage& msg, const Connection_ptr& connection) const
 {
 	uint8_t protocolID = msg.getByte();
@@ -145,38 +202,72 @@ void ServicePort::openAcceptor(std::weak_ptr<ServicePort> weak_service, uint16_t
 
 void ServicePort::open(uint16_t port)
 {
-	close();
+	std::vector<Acceptor_ptr> opened;
+	{
+		std::lock_guard<std::mutex> lockClass(acceptorLock);
+		closeAcceptors();
 
-	serverPort = port;
-	pendingStart = false;
+		serverPort = port;
+		pendingStart = false;
 
-	try {
-		if (g_config.getBoolean(ConfigManager::BIND_ONLY_GLOBAL_ADDRESS)) {
-			acceptor.reset(new boost::asio::ip::tcp::acceptor(io_service, boost::asio::ip::tcp::endpoint(
-			            boost::asio::ip::address(boost::asio::ip::address_v4::from_string(g_config.getString(ConfigManager::IP))), serverPort)));
-		} else {
-			acceptor.reset(new boost::asio::ip::tcp::acceptor(io_service, boost::asio::ip::tcp::endpoint(
-			            boost::asio::ip::address(boost::asio::ip::address_v4(INADDR_ANY)), serverPort)));
-		}
+		try {
+			boost::asio::ip::tcp::endpoint endpoint;
+			if (g_config.getBoolean(ConfigManager::BIND_ONLY_GLOBAL_ADDRESS)) {
+				endpoint = boost::asio::ip::tcp::endpoint(boost::asio::ip::address(boost::asio::ip::address_v4::from_string(g_config.getString(ConfigManager::IP))), serverPort);
+			} else {
+				endpoint = boost::asio::ip::tcp::endpoint(boost::asio::ip::address(boost::asio::ip::address_v4(INADDR_ANY)), serverPort);
+			}
 
-		acceptor->set_option(boost::asio::ip::tcp::no_delay(true));
+			size_t acceptorCount = getAcceptorCount();
+			for (size_t i = 0; i < acceptorCount; ++i) {
+				auto acceptor = std::make_shared<boost::asio::ip::tcp::acceptor>(io_service);
+				acceptor->open(endpoint.protocol());
+				acceptor->set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+#ifdef SO_REUSEPORT
+				if (acceptorCount > 1) {
+					acceptor->set_option(reuse_port(true));
+				}
+#endif
+				acceptor->bind(endpoint);
+				acceptor->listen();
+				opened.push_back(acceptor);
+			}
+			acceptors = opened;
+		} catch (boost::system::system_error& e) {
+			std::cout << "[ServicePort::open] Error: " << e.what() << std::endl;
 
-		accept();
-	} catch (boost::system::system_error& e) {
-		std::cout << "[ServicePort::open] Error: " << e.what() << std::endl;
+			for (const Acceptor_ptr& acceptor : opened) {
+				boost::system::error_code error;
+				acceptor->close(error);
+			}
 
-		pendingStart = true;
-		g_scheduler.addEvent(createSchedulerTask(15000,
-		                     std::bind(&ServicePort::openAcceptor, std::weak_ptr<ServicePort>(shared_from_this()), port)));
+			pendingStart = true;
+			g_scheduler.addEvent(createSchedulerTask(15000,
+			                     std::bind(&ServicePort::openAcceptor, std::weak_ptr<ServicePort>(shared_from_this()), port)));
+			return;
+		}
+	}
+
+	for (const Acceptor_ptr& acceptor : opened) {
+		accept(acceptor);
 	}
 }
 
 void ServicePort::close()
 {
-	if (acceptor && acceptor->is_open()) {
-		boost::system::error_code error;
-		acceptor->close(error);
+	std::lock_guard<std::mutex> lockClass(acceptorLock);
+	closeAcceptors();
+}
+
+void ServicePort::closeAcceptors()
+{
+	for (const Acceptor_ptr& acceptor : acceptors) {
+		if (acceptor->is_open()) {
+			boost::system::error_code error;
+			acceptor->close(error);
+		}
 	}
+	acceptors.clear();
 }
 
 bool ServicePort::add_service(const Service_ptr& new_svc)
@@ -10,6 +10,8 @@
 
 class Protocol;
 
+using Acceptor_ptr = std::shared_ptr<boost::asio::ip::tcp::acceptor>;
+
 class ServiceBase
 {
 	public:
@@ -46,7 +48,7 @@ class Service final : public ServiceBase
 class ServicePort : public std::enable_shared_from_this<ServicePort>
 {
 	public:
-		explicit ServicePort(boost::asio::io_service& io_service) : io_service(io_service) {}
+		ServicePort(boost::asio::io_service& io_service, const SocketOptions& socketOptions) : io_service(io_service), socketOptions(socketOptions) {}
 		~ServicePort();
 
 		// non-copyable
@@ -60,17 +62,29 @@ class ServicePort : public std::enable_shared_from_this<ServicePort>
 		std::string get_protocol_names() const;
 
 		bool add_service(const Service_ptr& new_svc);
+
+		// of the first service added to the port
+		const SocketOptions& getSocketOptions() const {
+			return socketOptions;
+		}
 		Protocol_ptr make_protocol(bool checksummed, NetworkMessage& msg, const Connection_ptr& connection) const;
 
 		void onStopServer();
-		void onAccept(Connection_ptr connection, const boost::system::error_code& error);
+		void onAccept(const Acceptor_ptr& acceptor, Connection_ptr connection, const boost::system::error_code& error);
 
 	private:
-		void accept();
+		void accept(const Acceptor_ptr& acceptor);
+		// acceptorLock held
+		void closeAcceptors();
+		void applySocketOptions(boost::asio::ip::tcp::socket& socket) const;
 
 		boost::asio::io_service& io_service;
-		std::unique_ptr<boost::asio::ip::tcp::acceptor> acceptor;
+		// several with SO_REUSEPORT, the kernel spreads the connections over
+		// them and their accepts complete on different network threads
+		std::vector<Acceptor_ptr> acceptors;
+		std::mutex acceptorLock;
 		std::vector<Service_ptr> services;
+		const SocketOptions socketOptions;
 
 		uint16_t serverPort = 0;
 		bool pendingStart = false;
@@ -90,7 +104,7 @@ class ServiceManager
 		void stop();
 
 		template <typename ProtocolType>
-		bool add(uint16_t port);
+		bool add(uint16_t port, const SocketOptions& socketOptions = SocketOptions());
 
 		bool is_running() const {
 			return acceptors.empty() == false;
@@ -108,7 +122,7 @@ class ServiceManager
 };
 
 template <typename ProtocolType>
-bool ServiceManager::add(uint16_t port)
+bool ServiceManager::add(uint16_t port, const SocketOptions& socketOptions/* = SocketOptions()*/)
 {
 	if (port == 0) {
 		std::cout << "ERROR: No port provided for service " << ProtocolType::protocol_name() << ". Service disabled." << std::endl;
@@ -120,7 +134,7 @@ bool ServiceManager::add(uint16_t port)
 	auto foundServicePort = acceptors.find(port);
 
 	if (foundServicePort == acceptors.end()) {
-		service_port = std::make_shared<ServicePort>(io_service);
+		service_port = std::make_shared<ServicePort>(io_service, socketOptions);
 		service_port->open(port);
 		acceptors[port] = service_port;
 	} else {
@@ -8,6 +8,7 @@
 bool Shaders::reload()
 {
 	shaders.clear();
+	shaderIndex.fill(0);
 	return loadFromXml();
 }
 
@@ -26,6 +27,11 @@ bool Shaders::loadFromXml()
 			shaderNode.attribute("name").as_string(),
 			shaderNode.attribute("premium").as_bool()
 		);
+
+		uint16_t& index = shaderIndex[shaders.back().id];
+		if (index == 0) {
+			index = static_cast<uint16_t>(shaders.size());
+		}
 	}
 	shaders.shrink_to_fit();
 	return true;
@@ -33,17 +39,13 @@ bool Shaders::loadFromXml()
 
 Shader* Shaders::getShaderByID(uint8_t id)
 {
-	auto it = std::find_if(shaders.begin(), shaders.end(), [id](const Shader& shader) {
-		return shader.id == id;
-	});
-
-	return it != shaders.end() ? &*it : nullptr;
+	uint16_t index = shaderIndex[id];
+	return index != 0 ? &shaders[index - 1] : nullptr;
 }
 
-Shader* Shaders::getShaderByName(const std::string& name) {
-	auto shaderName = name.c_str();
+Shader* Shaders::getShaderByName(std::string_view name) {
 	for (auto& it : shaders) {
-		if (strcasecmp(shaderName, it.name.c_str()) == 0) {
+		if (CaseInsensitiveEqual()(name, it.name)) {
 			return &it;
 		}
 	}
@@ -17,7 +17,7 @@ class Shaders
 		bool reload();
 		bool loadFromXml();
 		Shader* getShaderByID(uint8_t id);
-		Shader* getShaderByName(const std::string& name);
+		Shader* getShaderByName(std::string_view name);
 
 		const std::vector<Shader>& getShaders() const {
 			return shaders;
@@ -25,6 +25,8 @@ class Shaders
 
 	private:
 		std::vector<Shader> shaders;
+		// position + 1 in shaders for every id, 0 when unused
+		std::array<uint16_t, std::numeric_limits<uint8_t>::max() + 1> shaderIndex = {};
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,173 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#include "otpch.h"
+
+#include "simulation.h"
+#include "game.h"
+#include "taskprofiler.h"
+
+#include <fmt/format.h>
+#include <fstream>
+
+extern Game g_game;
+
+Simulation g_simulation;
+
+namespace {
+
+// virtual time starts at the same instant on every run
+constexpr int64_t SIMULATION_EPOCH = 1600000000000;
+
+// tasks due at a tick may schedule more for the same tick, this bounds the chain
+constexpr uint32_t MAX_PASSES_PER_TICK = 16;
+
+}
+
+bool Simulation::parseArgument(const std::string& key, const std::string& value)
+{
+	if (key == "--simulate") {
+		ticks = std::stoul(value);
+	} else if (key == "--simulate-players") {
+		players = std::stoul(value);
+	} else if (key == "--simulate-seed") {
+		seed = std::stoul(value);
+	} else if (key == "--simulate-tick") {
+		tickInterval = std::max<uint32_t>(1, std::stoul(value));
+	} else if (key == "--simulate-output") {
+		outputFile = value;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+int Simulation::run(const std::function<bool()>& load)
+{
+	setVirtualTime(SIMULATION_EPOCH);
+	g_scheduler.startVirtual();
+	g_dispatcher.startInline();
+
+	if (!load()) {
+		return 1;
+	}
+	g_dispatcher.runPendingTasks();
+
+	placePlayers();
+
+	std::ofstream output;
+	if (!outputFile.empty()) {
+		output.open(outputFile);
+		if (!output.is_open()) {
+			std::cout << "[Error - Simulation::run] Cannot open " << outputFile << '.' << std::endl;
+			return 1;
+		}
+		output << "tick,virtual_ms,tasks,micros,players,monsters\n";
+	}
+
+	std::cout << ">> Simulating " << ticks << " ticks of " << tickInterval << " ms with " << playerIds.size() << " players, seed " << seed << std::endl;
+
+	TaskProfiler::Histogram tickDurations;
+	uint64_t totalTasks = 0;
+	int64_t elapsed = 0;
+	for (uint32_t tick = 1; tick <= ticks; ++tick) {
+		elapsed += tickInterval;
+		setVirtualTime(SIMULATION_EPOCH + elapsed);
+		g_scheduler.setVirtualElapsedTime(elapsed);
+
+		auto start = std::chrono::steady_clock::now();
+		actPlayers();
+
+		size_t tasks = g_dispatcher.runPendingTasks();
+		for (uint32_t pass = 0; pass < MAX_PASSES_PER_TICK; ++pass) {
+			size_t due = g_scheduler.dispatchDueTasks();
+			size_t executed = g_dispatcher.runPendingTasks();
+			tasks += executed;
+			if (due == 0 && executed == 0) {
+				break;
+			}
+		}
+
+		uint64_t micros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+		tickDurations.add(micros);
+		totalTasks += tasks;
+
+		if (output.is_open()) {
+			output << fmt::format("{:d},{:d},{:d},{:d},{:d},{:d}\n", tick, elapsed, tasks, micros, g_game.getPlayersOnline(), g_game.getMonstersOnline());
+		}
+	}
+
+	std::cout << fmt::format(">> Simulated {:d} ticks, {:d} tasks, {:.3f} s of CPU for {:.3f} s of game time", tickDurations.count, totalTasks, tickDurations.total / 1000000., elapsed / 1000.) << std::endl;
+	if (tickDurations.count != 0) {
+		std::cout << fmt::format(">> Tick time in microseconds: mean {:d}, p50 {:d}, p90 {:d}, p99 {:d}, max {:d}", tickDurations.total / tickDurations.count,
+			tickDurations.getPercentile(0.5), tickDurations.getPercentile(0.9), tickDurations.getPercentile(0.99), tickDurations.max) << std::endl;
+	}
+
+	g_game.shutdown();
+	return 0;
+}
+
+void Simulation::placePlayers()
+{
+	if (players == 0) {
+		return;
+	}
+
+	const TownMap& towns = g_game.map.towns.getTowns();
+	Group* group = g_game.groups.getGroup(1);
+	if (towns.empty() || !group) {
+		std::cout << "> Simulation: the world has no town or no group 1, no players are placed." << std::endl;
+		return;
+	}
+
+	Town* town = towns.begin()->second;
+	for (uint32_t i = 1; i <= players; ++i) {
+		Player* player = new Player(nullptr);
+		player->setName(fmt::format("Simulated {:d}", i));
+		player->setGUID(i);
+		player->setGroup(group);
+		player->setTown(town);
+		player->setVocation(0);
+		player->setChaseMode(true);
+
+		if (!g_game.placeCreature(player, town->getTemplePosition(), true)) {
+			delete player;
+			continue;
+		}
+		playerIds.push_back(player->getID());
+	}
+}
+
+void Simulation::actPlayers()
+{
+	for (uint32_t playerId : playerIds) {
+		Player* player = g_game.getPlayerByID(playerId);
+		if (!player) {
+			continue;
+		}
+
+		// a potion whenever half of the health is gone keeps the hunt going
+		if (player->getHealth() < player->getMaxHealth() / 2) {
+			player->changeHealth(player->getMaxHealth() - player->getHealth());
+		}
+
+		if (player->getAttackedCreature()) {
+			continue;
+		}
+
+		if (uniform_random(1, 100) <= 5) {
+			SpectatorVec spectators;
+			g_game.map.getSpectators(spectators, player->getPosition(), false, false);
+			for (Creature* spectator : spectators) {
+				if (spectator->getMonster()) {
+					g_game.playerSetAttackedCreature(playerId, spectator->getID());
+					break;
+				}
+			}
+		}
+
+		if (!player->getAttackedCreature() && uniform_random(1, 100) <= 10) {
+			g_game.playerMove(playerId, static_cast<Direction>(uniform_random(DIRECTION_NORTH, DIRECTION_WEST)));
+		}
+	}
+}
@@ -0,0 +1,46 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#ifndef FS_SIMULATION_H_C46465926F7941DBA28961B09D653E61
+#define FS_SIMULATION_H_C46465926F7941DBA28961B09D653E61
+
+#include "scheduler.h"
+
+// Headless run of the loaded world for offline performance comparisons. The
+// main thread is the game thread, the scheduler runs on virtual time and
+// OTSYS_TIME follows it, so creature thinks, decay, spawns and walks happen
+// in the same order on every run with the same seed and datapack. No service
+// is started and the database is never connected, its queries fail. Simulated
+// players walk, hunt and heal themselves from the first town temple.
+class Simulation
+{
+	public:
+		bool isEnabled() const {
+			return ticks != 0;
+		}
+
+		// --simulate=ticks and its companions, false for any other argument
+		bool parseArgument(const std::string& key, const std::string& value);
+
+		uint32_t getSeed() const {
+			return seed;
+		}
+
+		// runs the loader and then the ticks, returns the exit code of the process
+		int run(const std::function<bool()>& load);
+
+	private:
+		void placePlayers();
+		void actPlayers();
+
+		std::vector<uint32_t> playerIds;
+		std::string outputFile;
+		uint32_t ticks = 0;
+		uint32_t tickInterval = SCHEDULER_MINTICKS;
+		uint32_t players = 0;
+		uint32_t seed = 1;
+};
+
+extern Simulation g_simulation;
+
+#endif
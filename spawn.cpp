@@ -11,6 +11,9 @@
 
 #include "pugicast.h"
 #include "events.h"
+#include "assetcache.h"
+
+#include <boost/filesystem.hpp>
 
 extern ConfigManager g_config;
 extern Monsters g_monsters;
@@ -20,12 +23,39 @@ extern Events* g_events;
 static constexpr int32_t MINSPAWN_INTERVAL = 10 * 1000; // 10 seconds to match RME
 static constexpr int32_t MAXSPAWN_INTERVAL = 24 * 60 * 60 * 1000; // 1 day
 
-bool Spawns::loadFromXml(const std::string& filename)
+namespace {
+
+// bumped whenever the spawns cache holds something else
+constexpr uint64_t SPAWNS_CACHE_VERSION = 1;
+
+enum SpawnEntryKind : uint8_t {
+	SPAWN_ENTRY_BLOCK,
+	SPAWN_ENTRY_MONSTER,
+	SPAWN_ENTRY_NPC,
+};
+
+// a child of a spawn as the spawn file gives it, the names are looked up
+// when the spawn is built
+struct SpawnEntry {
+	// name and chance, a monster or npc entry has one name
+	std::vector<std::pair<std::string, uint16_t>> names;
+	Position pos;
+	uint32_t interval = 0;
+	// none keeps the direction of the npc file
+	Direction direction = DIRECTION_NONE;
+	SpawnEntryKind kind = SPAWN_ENTRY_BLOCK;
+};
+
+struct SpawnDefinition {
+	SpawnDefinition(Position centerPos, int32_t radius) : centerPos(std::move(centerPos)), radius(radius) {}
+
+	Position centerPos;
+	int32_t radius;
+	std::vector<SpawnEntry> entries;
+};
+
+bool parseSpawnFile(const std::string& filename, std::vector<SpawnDefinition>& definitions)
 {
-	if (loaded) {
-		return true;
-	}
-
 	pugi::xml_document doc;
 	pugi::xml_parse_result result = doc.load_file(filename.c_str());
 	if (!result) {
@@ -33,9 +63,6 @@ bool Spawns::loadFromXml(const std::string& filename)
 		return false;
 	}
 
-	this->filename = filename;
-	loaded = true;
-
 	for (auto spawnNode : doc.child("spawns").children()) {
 		Position centerPos(
 			pugi::cast<uint16_t>(spawnNode.attribute("centerx").value()),
@@ -60,8 +87,8 @@ bool Spawns::loadFromXml(const std::string& filename)
 			continue;
 		}
 
-		spawnList.emplace_front(centerPos, radius);
-		Spawn& spawn = spawnList.front();
+		definitions.emplace_back(centerPos, radius);
+		SpawnDefinition& definition = definitions.back();
 
 		for (auto childNode : spawnNode.children()) {
 			if (strcasecmp(childNode.name(), "monsters") == 0) {
@@ -86,12 +113,10 @@ bool Spawns::loadFromXml(const std::string& filename)
 					continue;
 				}
 
-				uint16_t totalChance = 0;
-				spawnBlock_t sb;
-				sb.pos = pos;
-				sb.direction = DIRECTION_NORTH;
-				sb.interval = interval;
-				sb.lastSpawn = 0;
+				SpawnEntry entry;
+				entry.kind = SPAWN_ENTRY_BLOCK;
+				entry.pos = pos;
+				entry.interval = interval;
 
 				for (auto monsterNode : childNode.children()) {
 					pugi::xml_attribute nameAttribute = monsterNode.attribute("name");
@@ -99,42 +124,14 @@ bool Spawns::loadFromXml(const std::string& filename)
 						continue;
 					}
 
-					MonsterType* mType = g_monsters.getMonsterType(nameAttribute.as_string());
-					if (!mType) {
-						std::cout << "[Warning - Spawn::loadFromXml] " << pos << " can not find " << nameAttribute.as_string() << std::endl;
-						continue;
-					}
-
 					uint16_t chance = 100 / monstersCount;
 					pugi::xml_attribute chanceAttribute = monsterNode.attribute("chance");
 					if (chanceAttribute) {
 						chance = pugi::cast<uint16_t>(chanceAttribute.value());
 					}
-
-					if (chance + totalChance > 100) {
-						chance = 100 - totalChance;
-						totalChance = 100;
-						std::cout << "[Warning - Spawns::loadFromXml] " << mType->name << ' ' << pos << " total chance for set can not be higher than 100." << std::endl;
-					} else {
-						totalChance += chance;
-					}
-
-					sb.mTypes.push_back({mType, chance});
-				}
-
-				if (sb.mTypes.empty()) {
-					std::cout << "[Warning - Spawns::loadFromXml] " << pos << " empty monsters set." << std::endl;
-					continue;
+					entry.names.emplace_back(nameAttribute.as_string(), chance);
 				}
-
-				sb.mTypes.shrink_to_fit();
-				if (sb.mTypes.size() > 1) {
-					std::sort(sb.mTypes.begin(), sb.mTypes.end(), [](std::pair<MonsterType*, uint16_t> a, std::pair<MonsterType*, uint16_t> b) {
-						return a.second > b.second;
-					});
-				}
-
-				spawn.addBlock(sb);
+				definition.entries.push_back(std::move(entry));
 			} else if (strcasecmp(childNode.name(), "monster") == 0) {
 				pugi::xml_attribute nameAttribute = childNode.attribute("name");
 				if (!nameAttribute) {
@@ -157,7 +154,13 @@ bool Spawns::loadFromXml(const std::string& filename)
 				);
 				int32_t interval = pugi::cast<int32_t>(childNode.attribute("spawntime").value()) * 1000;
 				if (interval >= MINSPAWN_INTERVAL && interval <= MAXSPAWN_INTERVAL) {
-					spawn.addMonster(nameAttribute.as_string(), pos, dir, static_cast<uint32_t>(interval));
+					SpawnEntry entry;
+					entry.kind = SPAWN_ENTRY_MONSTER;
+					entry.names.emplace_back(nameAttribute.as_string(), 100);
+					entry.pos = pos;
+					entry.interval = static_cast<uint32_t>(interval);
+					entry.direction = dir;
+					definition.entries.push_back(std::move(entry));
 				} else {
 					if (interval < MINSPAWN_INTERVAL) {
 						std::cout << "[Warning - Spawns::loadFromXml] " << nameAttribute.as_string() << ' ' << pos << " spawntime can not be less than " << MINSPAWN_INTERVAL / 1000 << " seconds." << std::endl;
@@ -171,22 +174,216 @@ bool Spawns::loadFromXml(const std::string& filename)
 					continue;
 				}
 
-				Npc* npc = Npc::createNpc(nameAttribute.as_string());
-				if (!npc) {
-					continue;
-				}
+				SpawnEntry entry;
+				entry.kind = SPAWN_ENTRY_NPC;
+				entry.names.emplace_back(nameAttribute.as_string(), 0);
 
 				pugi::xml_attribute directionAttribute = childNode.attribute("direction");
 				if (directionAttribute) {
-					npc->setDirection(static_cast<Direction>(pugi::cast<uint16_t>(directionAttribute.value())));
+					entry.direction = static_cast<Direction>(pugi::cast<uint16_t>(directionAttribute.value()));
 				}
 
-				npc->setMasterPos(Position(
+				entry.pos = Position(
 					centerPos.x + pugi::cast<uint16_t>(childNode.attribute("x").value()),
 					centerPos.y + pugi::cast<uint16_t>(childNode.attribute("y").value()),
 					centerPos.z
-				), radius);
-				npcList.push_front(npc);
+				);
+				definition.entries.push_back(std::move(entry));
+			}
+		}
+	}
+	return true;
+}
+
+void writePosition(PropWriteStream& propWriteStream, const Position& pos)
+{
+	propWriteStream.write<uint16_t>(pos.x);
+	propWriteStream.write<uint16_t>(pos.y);
+	propWriteStream.write<uint8_t>(pos.z);
+}
+
+bool readPosition(PropStream& propStream, Position& pos)
+{
+	return propStream.read<uint16_t>(pos.x) && propStream.read<uint16_t>(pos.y) && propStream.read<uint8_t>(pos.z);
+}
+
+void writeSpawnsCache(const std::string& path, uint64_t sourceHash, const std::vector<SpawnDefinition>& definitions)
+{
+	PropWriteStream propWriteStream;
+	propWriteStream.writeVarint(definitions.size());
+	for (const SpawnDefinition& definition : definitions) {
+		writePosition(propWriteStream, definition.centerPos);
+		propWriteStream.writeSignedVarint(definition.radius);
+
+		propWriteStream.writeVarint(definition.entries.size());
+		for (const SpawnEntry& entry : definition.entries) {
+			propWriteStream.write<uint8_t>(entry.kind);
+			writePosition(propWriteStream, entry.pos);
+			propWriteStream.writeVarint(entry.interval);
+			propWriteStream.write<uint8_t>(entry.direction);
+
+			propWriteStream.writeVarint(entry.names.size());
+			for (const auto& it : entry.names) {
+				propWriteStream.writeCompactString(it.first);
+				propWriteStream.write<uint16_t>(it.second);
+			}
+		}
+	}
+	AssetCache::write(path, sourceHash, propWriteStream);
+}
+
+bool readSpawnsCache(PropStream& propStream, std::vector<SpawnDefinition>& definitions)
+{
+	uint64_t count;
+	if (!propStream.readVarint(count)) {
+		return false;
+	}
+
+	definitions.reserve(count);
+	for (uint64_t i = 0; i < count; ++i) {
+		Position centerPos;
+		int64_t radius;
+		uint64_t entries;
+		if (!readPosition(propStream, centerPos) || !propStream.readSignedVarint(radius) || !propStream.readVarint(entries)) {
+			return false;
+		}
+
+		definitions.emplace_back(centerPos, static_cast<int32_t>(radius));
+		SpawnDefinition& definition = definitions.back();
+		definition.entries.resize(entries);
+
+		for (SpawnEntry& entry : definition.entries) {
+			uint8_t kind, direction;
+			uint64_t interval, names;
+			if (!propStream.read<uint8_t>(kind) || !readPosition(propStream, entry.pos) || !propStream.readVarint(interval) ||
+					!propStream.read<uint8_t>(direction) || !propStream.readVarint(names) || kind > SPAWN_ENTRY_NPC) {
+				return false;
+			}
+
+			entry.kind = static_cast<SpawnEntryKind>(kind);
+			entry.interval = static_cast<uint32_t>(interval);
+			entry.direction = static_cast<Direction>(direction);
+
+			entry.names.resize(names);
+			for (auto& it : entry.names) {
+				if (!propStream.readCompactString(it.first) || !propStream.read<uint16_t>(it.second)) {
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+void addSpawnBlock(Spawn& spawn, const SpawnEntry& entry)
+{
+	uint16_t totalChance = 0;
+	spawnBlock_t sb;
+	sb.pos = entry.pos;
+	sb.direction = DIRECTION_NORTH;
+	sb.interval = entry.interval;
+	sb.lastSpawn = 0;
+
+	for (const auto& it : entry.names) {
+		MonsterType* mType = g_monsters.getMonsterType(it.first);
+		if (!mType) {
+			std::cout << "[Warning - Spawn::loadFromXml] " << entry.pos << " can not find " << it.first << std::endl;
+			continue;
+		}
+
+		uint16_t chance = it.second;
+		if (chance + totalChance > 100) {
+			chance = 100 - totalChance;
+			totalChance = 100;
+			std::cout << "[Warning - Spawns::loadFromXml] " << mType->name << ' ' << entry.pos << " total chance for set can not be higher than 100." << std::endl;
+		} else {
+			totalChance += chance;
+		}
+
+		sb.mTypes.push_back({mType, chance});
+	}
+
+	if (sb.mTypes.empty()) {
+		std::cout << "[Warning - Spawns::loadFromXml] " << entry.pos << " empty monsters set." << std::endl;
+		return;
+	}
+
+	sb.mTypes.shrink_to_fit();
+	if (sb.mTypes.size() > 1) {
+		std::sort(sb.mTypes.begin(), sb.mTypes.end(), [](std::pair<MonsterType*, uint16_t> a, std::pair<MonsterType*, uint16_t> b) {
+			return a.second > b.second;
+		});
+	}
+
+	spawn.addBlock(sb);
+}
+
+}
+
+bool Spawns::loadFromXml(const std::string& filename)
+{
+	if (loaded) {
+		return true;
+	}
+
+	// the cache holds the spawns as the file gives them, the monsters and
+	// npcs are looked up again on every start
+	std::vector<SpawnDefinition> definitions;
+	std::string cachePath = AssetCache::getPath(boost::filesystem::path(filename).stem().string());
+	uint64_t sourceHash = AssetCache::HASH_SEED ^ SPAWNS_CACHE_VERSION;
+	bool cached = false;
+	if (!cachePath.empty()) {
+		if (!AssetCache::hashFile(filename, sourceHash)) {
+			cachePath.clear();
+		} else {
+			AssetCache cache;
+			cached = cache.open(cachePath, sourceHash) && readSpawnsCache(cache.getStream(), definitions);
+		}
+	}
+
+	if (!cached) {
+		definitions.clear();
+		if (!parseSpawnFile(filename, definitions)) {
+			return false;
+		}
+
+		if (!cachePath.empty()) {
+			writeSpawnsCache(cachePath, sourceHash, definitions);
+		}
+	}
+
+	this->filename = filename;
+	loaded = true;
+
+	for (const SpawnDefinition& definition : definitions) {
+		spawnList.emplace_front(definition.centerPos, definition.radius);
+		Spawn& spawn = spawnList.front();
+
+		for (const SpawnEntry& entry : definition.entries) {
+			switch (entry.kind) {
+				case SPAWN_ENTRY_BLOCK: {
+					addSpawnBlock(spawn, entry);
+					break;
+				}
+
+				case SPAWN_ENTRY_MONSTER: {
+					spawn.addMonster(entry.names.front().first, entry.pos, entry.direction, entry.interval);
+					break;
+				}
+
+				case SPAWN_ENTRY_NPC: {
+					Npc* npc = Npc::createNpc(entry.names.front().first);
+					if (!npc) {
+						break;
+					}
+
+					if (entry.direction != DIRECTION_NONE) {
+						npc->setDirection(entry.direction);
+					}
+					npc->setMasterPos(entry.pos, definition.radius);
+					npcList.push_front(npc);
+					break;
+				}
 			}
 		}
 	}
@@ -220,12 +417,136 @@ void Spawns::clear()
 		spawn.stopEvent();
 	}
 	spawnList.clear();
+	hibernatingSpawns.clear();
+
+	if (checkEventId != 0) {
+		g_scheduler.stopEvent(checkEventId);
+		checkEventId = 0;
+	}
+	checkQueue = SpawnQueue();
 
 	loaded = false;
 	started = false;
 	filename.clear();
 }
 
+template<typename Function>
+void Spawns::forEachSector(const Position& centerPos, int32_t radius, Function&& function)
+{
+	// every sector the activation area of the spawn overlaps
+	int32_t range = radius + Spawn::ACTIVATION_RANGE;
+	int32_t startX = std::max<int32_t>(0, centerPos.x - range) >> SECTOR_BITS;
+	int32_t startY = std::max<int32_t>(0, centerPos.y - range) >> SECTOR_BITS;
+	int32_t endX = std::min<int32_t>(0xFFFF, centerPos.x + range) >> SECTOR_BITS;
+	int32_t endY = std::min<int32_t>(0xFFFF, centerPos.y + range) >> SECTOR_BITS;
+	for (int32_t y = startY; y <= endY; ++y) {
+		for (int32_t x = startX; x <= endX; ++x) {
+			function(getSectorKey(x << SECTOR_BITS, y << SECTOR_BITS));
+		}
+	}
+}
+
+void Spawns::hibernate(Spawn* spawn, const Position& centerPos, int32_t radius)
+{
+	forEachSector(centerPos, radius, [&](uint32_t key) {
+		hibernatingSpawns[key].push_back(spawn);
+	});
+}
+
+void Spawns::wakeUp(Spawn* spawn, const Position& centerPos, int32_t radius)
+{
+	forEachSector(centerPos, radius, [&](uint32_t key) {
+		auto it = hibernatingSpawns.find(key);
+		if (it == hibernatingSpawns.end()) {
+			return;
+		}
+
+		auto& spawns = it->second;
+		spawns.erase(std::remove(spawns.begin(), spawns.end(), spawn), spawns.end());
+		if (spawns.empty()) {
+			hibernatingSpawns.erase(it);
+		}
+	});
+}
+
+void Spawns::onPlayerMove(const Position& pos)
+{
+	if (hibernatingSpawns.empty()) {
+		return;
+	}
+
+	auto it = hibernatingSpawns.find(getSectorKey(pos.x, pos.y));
+	if (it == hibernatingSpawns.end()) {
+		return;
+	}
+
+	// wakeUp edits the sector list, so collect first
+	std::vector<Spawn*> spawns;
+	for (Spawn* spawn : it->second) {
+		if (spawn->isInActivationRange(pos)) {
+			spawns.push_back(spawn);
+		}
+	}
+
+	for (Spawn* spawn : spawns) {
+		spawn->wakeUp();
+	}
+}
+
+void Spawns::scheduleCheck(Spawn* spawn, int64_t deadline)
+{
+	spawn->checkDeadline = deadline;
+	checkQueue.emplace(deadline, spawn);
+	scheduleChecks();
+}
+
+void Spawns::scheduleChecks()
+{
+	// entries of stopped or rescheduled checks are dropped once they come up
+	while (!checkQueue.empty() && checkQueue.top().second->checkDeadline != checkQueue.top().first) {
+		checkQueue.pop();
+	}
+
+	if (checkQueue.empty()) {
+		return;
+	}
+
+	int64_t deadline = checkQueue.top().first;
+	if (checkEventId != 0) {
+		if (deadline >= checkEventDeadline) {
+			return;
+		}
+		g_scheduler.stopEvent(checkEventId);
+	}
+
+	checkEventDeadline = deadline;
+	checkEventId = g_scheduler.addEvent(createSchedulerTask(std::max<int64_t>(SCHEDULER_MINTICKS, deadline - OTSYS_TIME()),
+	                                    std::bind(&Spawns::checkSpawns, this)));
+}
+
+void Spawns::checkSpawns()
+{
+	checkEventId = 0;
+
+	// pop the whole due batch first, the checks push their next deadlines
+	int64_t now = OTSYS_TIME();
+	std::vector<Spawn*> dueSpawns;
+	while (!checkQueue.empty() && checkQueue.top().first <= now) {
+		const SpawnDeadline& entry = checkQueue.top();
+		if (entry.second->checkDeadline == entry.first) {
+			entry.second->checkDeadline = 0;
+			dueSpawns.push_back(entry.second);
+		}
+		checkQueue.pop();
+	}
+
+	for (Spawn* spawn : dueSpawns) {
+		spawn->checkSpawn();
+	}
+
+	scheduleChecks();
+}
+
 bool Spawns::isInZone(const Position& centerPos, int32_t radius, const Position& pos)
 {
 	if (radius == -1) {
@@ -238,8 +559,9 @@ bool Spawns::isInZone(const Position& centerPos, int32_t radius, const Position&
 
 void Spawn::startSpawnCheck()
 {
-	if (checkSpawnEvent == 0) {
-		checkSpawnEvent = g_scheduler.addEvent(createSchedulerTask(getInterval(), std::bind(&Spawn::checkSpawn, this)));
+	// a hibernating spawn is checked again when a player wakes it up
+	if (checkDeadline == 0 && !hibernating) {
+		g_game.map.spawns.scheduleCheck(this, OTSYS_TIME() + getInterval());
 	}
 }
 
@@ -264,6 +586,35 @@ bool Spawn::findPlayer(const Position& pos)
 	return false;
 }
 
+bool Spawn::hasPlayerInRange() const
+{
+	int32_t range = radius + ACTIVATION_RANGE;
+
+	SpectatorVec spectators;
+	g_game.map.getSpectators(spectators, centerPos, true, true, range, range, range, range);
+	return !spectators.empty();
+}
+
+void Spawn::wakeUp()
+{
+	if (!hibernating) {
+		return;
+	}
+
+	hibernating = false;
+	g_game.map.spawns.wakeUp(this, centerPos, radius);
+
+	// pending respawns happen right away, before the player gets in view
+	if (checkDeadline == 0) {
+		g_game.map.spawns.scheduleCheck(this, OTSYS_TIME() + SCHEDULER_MINTICKS);
+	}
+}
+
+bool Spawn::isInActivationRange(const Position& pos) const
+{
+	return Spawns::isInZone(centerPos, radius + ACTIVATION_RANGE, pos);
+}
+
 bool Spawn::isInSpawnZone(const Position& pos)
 {
 	return Spawns::isInZone(centerPos, radius, pos);
@@ -348,10 +699,14 @@ void Spawn::startup()
 
 void Spawn::checkSpawn()
 {
-	checkSpawnEvent = 0;
-
 	cleanup();
 
+	if (spawnedMap.size() < spawnMap.size() && !hasPlayerInRange()) {
+		hibernating = true;
+		g_game.map.spawns.hibernate(this, centerPos, radius);
+		return;
+	}
+
 	uint32_t spawnCount = 0;
 
 	for (auto& it : spawnMap) {
@@ -374,7 +729,7 @@ void Spawn::checkSpawn()
 	}
 
 	if (spawnedMap.size() < spawnMap.size()) {
-		checkSpawnEvent = g_scheduler.addEvent(createSchedulerTask(getInterval(), std::bind(&Spawn::checkSpawn, this)));
+		g_game.map.spawns.scheduleCheck(this, OTSYS_TIME() + getInterval());
 	}
 }
 
@@ -435,8 +790,6 @@ void Spawn::removeMonster(Monster* monster)
 
 void Spawn::stopEvent()
 {
-	if (checkSpawnEvent != 0) {
-		g_scheduler.stopEvent(checkSpawnEvent);
-		checkSpawnEvent = 0;
-	}
+	// the queued entry no longer matches and is dropped
+	checkDeadline = 0;
 }
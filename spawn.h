@@ -7,12 +7,17 @@
 #include "tile.h"
 #include "position.h"
 
+#include <queue>
 #include <utility>
 #include <vector>
 
 class Monster;
 class MonsterType;
 class Npc;
+class Spawn;
+
+using SpawnDeadline = std::pair<int64_t, Spawn*>;
+using SpawnQueue = std::priority_queue<SpawnDeadline, std::vector<SpawnDeadline>, std::greater<SpawnDeadline>>;
 
 struct spawnBlock_t {
 	Position pos;
@@ -45,8 +50,17 @@ class Spawn
 		void stopEvent();
 
 		bool isInSpawnZone(const Position& pos);
+		bool isInActivationRange(const Position& pos) const;
 		void cleanup();
 
+		// players closer than this to the spawn zone keep it awake
+		static constexpr int32_t ACTIVATION_RANGE = 16;
+
+		bool isHibernating() const {
+			return hibernating;
+		}
+		void wakeUp();
+
 	private:
 		//map of the spawned creatures
 		using SpawnedMap = std::multimap<uint32_t, Monster*>;
@@ -59,12 +73,17 @@ class Spawn
 		int32_t radius;
 
 		uint32_t interval = 60000;
-		uint32_t checkSpawnEvent = 0;
+		// when Spawns checks this spawn next, 0 while no check is due
+		int64_t checkDeadline = 0;
+		bool hibernating = false;
 
 		static bool findPlayer(const Position& pos);
+		bool hasPlayerInRange() const;
 		bool spawnMonster(uint32_t spawnId, spawnBlock_t sb, bool startup = false);
 		bool spawnMonster(uint32_t spawnId, MonsterType* mType, const Position& pos, Direction dir, bool startup = false);
 		void checkSpawn();
+
+		friend class Spawns;
 };
 
 class Spawns
@@ -80,9 +99,37 @@ class Spawns
 			return started;
 		}
 
+		// spawns with pending respawns and no player in range stop their
+		// check timer and are woken up once a player comes close
+		void hibernate(Spawn* spawn, const Position& centerPos, int32_t radius);
+		void wakeUp(Spawn* spawn, const Position& centerPos, int32_t radius);
+		void onPlayerMove(const Position& pos);
+
+		// every spawn check runs from one deadline queue, the spawns due at the
+		// same tick are checked in a single scheduler task
+		void scheduleCheck(Spawn* spawn, int64_t deadline);
+
 	private:
+		void scheduleChecks();
+		void checkSpawns();
+
+		SpawnQueue checkQueue;
+		int64_t checkEventDeadline = 0;
+		uint32_t checkEventId = 0;
+
 		std::forward_list<Npc*> npcList;
 		std::forward_list<Spawn> spawnList;
+
+		static constexpr int32_t SECTOR_BITS = 5;
+
+		static uint32_t getSectorKey(int32_t x, int32_t y) {
+			return (static_cast<uint32_t>(x >> SECTOR_BITS) << 16) | static_cast<uint32_t>(y >> SECTOR_BITS);
+		}
+
+		template<typename Function>
+		static void forEachSector(const Position& centerPos, int32_t radius, Function&& function);
+
+		std::unordered_map<uint32_t, std::vector<Spawn*>> hibernatingSpawns;
 		std::string filename;
 		bool loaded = false;
 		bool started = false;
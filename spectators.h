@@ -44,6 +44,7 @@ public:
 	Iterator end() { return vec.end(); }
 	ConstIterator end() const { return vec.end(); }
 	void emplace_back(Creature* c) { vec.emplace_back(c); }
+	void clear() { vec.clear(); }
 
 private:
 	Vec vec;
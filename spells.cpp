@@ -83,6 +83,8 @@ TalkActionResult_t Spells::playerSaySpell(Player* player, std::string& words)
 
 void Spells::clearMaps(bool fromLua)
 {
+	instantIndexDirty = true;
+
 	for (auto instant = instants.begin(); instant != instants.end(); ) {
 		if (fromLua == instant->second.fromLua) {
 			instant = instants.erase(instant);
@@ -131,6 +133,7 @@ bool Spells::registerEvent(Event_ptr event, const pugi::xml_node&)
 {
 	InstantSpell* instant = dynamic_cast<InstantSpell*>(event.get());
 	if (instant) {
+		instantIndexDirty = true;
 		auto result = instants.emplace(instant->getWords(), std::move(*instant));
 		if (!result.second) {
 			std::cout << "[Warning - Spells::registerEvent] Duplicate registered instant spell with words: " << instant->getWords() << std::endl;
@@ -155,6 +158,7 @@ bool Spells::registerInstantLuaEvent(InstantSpell* event)
 	InstantSpell_ptr instant { event };
 	if (instant) {
 		std::string words = instant->getWords();
+		instantIndexDirty = true;
 		auto result = instants.emplace(instant->getWords(), std::move(*instant));
 		if (!result.second) {
 			std::cout << "[Warning - Spells::registerInstantLuaEvent] Duplicate registered instant spell with words: " << words << std::endl;
@@ -213,23 +217,31 @@ RuneSpell* Spells::getRuneSpellByName(const std::string& name)
 	return nullptr;
 }
 
-InstantSpell* Spells::getInstantSpell(const std::string& words)
+void Spells::buildInstantIndex()
 {
-	InstantSpell* result = nullptr;
+	instantIndex.clear();
 
+	// in map order, so the first of several words that differ only in case wins as before
 	for (auto& it : instants) {
 		const std::string& instantSpellWords = it.second.getWords();
-		size_t spellLen = instantSpellWords.length();
-		if (strncasecmp(instantSpellWords.c_str(), words.c_str(), spellLen) == 0) {
-			if (!result || spellLen > result->getWords().length()) {
-				result = &it.second;
-				if (words.length() == spellLen) {
-					break;
-				}
-			}
-		}
+		instantIndex.insert(instantSpellWords, &it.second);
+	}
+	instantIndexDirty = false;
+}
+
+InstantSpell* Spells::getInstantSpell(const std::string& words)
+{
+	if (instantIndexDirty) {
+		buildInstantIndex();
 	}
 
+	// the longest spell words the text starts with
+	InstantSpell* result = nullptr;
+	instantIndex.forEachPrefix(words, [&result](InstantSpell* spell, size_t) {
+		result = spell;
+		return false;
+	});
+
 	if (result) {
 		const std::string& resultWords = result->getWords();
 		if (words.length() > resultWords.length()) {
@@ -351,8 +363,7 @@ bool CombatSpell::executeCastSpell(Creature* creature, const LuaVariant& var)
 
 	scriptInterface->pushFunction(scriptId);
 
-	LuaScriptInterface::pushUserdata<Creature>(L, creature);
-	LuaScriptInterface::setCreatureMetatable(L, -1, creature);
+	LuaScriptInterface::pushCreature(L, creature);
 
 	LuaScriptInterface::pushVariant(L, var);
 
@@ -1064,8 +1075,7 @@ bool InstantSpell::executeCastSpell(Creature* creature, const LuaVariant& var)
 
 	scriptInterface->pushFunction(scriptId);
 
-	LuaScriptInterface::pushUserdata<Creature>(L, creature);
-	LuaScriptInterface::setCreatureMetatable(L, -1, creature);
+	LuaScriptInterface::pushCreature(L, creature);
 
 	LuaScriptInterface::pushVariant(L, var);
 
@@ -1250,8 +1260,7 @@ bool RuneSpell::executeCastSpell(Creature* creature, const LuaVariant& var, bool
 
 	scriptInterface->pushFunction(scriptId);
 
-	LuaScriptInterface::pushUserdata<Creature>(L, creature);
-	LuaScriptInterface::setCreatureMetatable(L, -1, creature);
+	LuaScriptInterface::pushCreature(L, creature);
 
 	LuaScriptInterface::pushVariant(L, var);
 
@@ -9,6 +9,7 @@
 #include "actions.h"
 #include "talkaction.h"
 #include "baseevents.h"
+#include "wordtrie.h"
 
 class InstantSpell;
 class RuneSpell;
@@ -54,9 +55,15 @@ class Spells final : public BaseEvents
 		Event_ptr getEvent(const std::string& nodeName) override;
 		bool registerEvent(Event_ptr event, const pugi::xml_node& node) override;
 
+		void buildInstantIndex();
+
 		std::map<uint16_t, RuneSpell> runes;
 		std::map<std::string, InstantSpell> instants;
 
+		// lowercase words to spell, probed with the longest registered lengths first
+		WordTrie<InstantSpell> instantIndex;
+		bool instantIndexDirty = true;
+
 		friend class CombatSpell;
 		LuaScriptInterface scriptInterface { "Spell Interface" };
 };
@@ -0,0 +1,124 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#include "otpch.h"
+
+#include "startuploader.h"
+
+#include <fmt/format.h>
+
+void StartupLoader::addStage(std::string name, std::vector<std::string> dependencies, bool concurrent, StageFunction function)
+{
+	Stage stage;
+	stage.name = std::move(name);
+	stage.function = std::move(function);
+	stage.concurrent = concurrent;
+
+	// stages can only depend on the ones added before them, so there are no cycles
+	for (const std::string& dependency : dependencies) {
+		auto it = std::find_if(stages.begin(), stages.end(), [&dependency](const Stage& other) { return other.name == dependency; });
+		if (it == stages.end()) {
+			unknownDependency = fmt::format("Startup stage {:s} depends on unknown stage {:s}.", stage.name, dependency);
+			continue;
+		}
+		stage.dependencies.push_back(std::distance(stages.begin(), it));
+	}
+	stages.push_back(std::move(stage));
+}
+
+bool StartupLoader::isReady(const Stage& stage) const
+{
+	if (stage.state != STAGE_PENDING) {
+		return false;
+	}
+
+	return std::all_of(stage.dependencies.begin(), stage.dependencies.end(), [this](size_t index) { return stages[index].state == STAGE_DONE; });
+}
+
+std::string StartupLoader::execute(Stage& stage)
+{
+	auto start = std::chrono::steady_clock::now();
+	std::string error = stage.function();
+	auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+	if (error.empty()) {
+		std::cout << fmt::format(">> Loaded {:s} in {:d} ms\n", stage.name, ms) << std::flush;
+	}
+	return error;
+}
+
+std::string StartupLoader::run()
+{
+	if (!unknownDependency.empty()) {
+		return unknownDependency;
+	}
+
+	std::mutex lock;
+	std::condition_variable signal;
+	std::vector<std::thread> threads;
+	std::string failure;
+	size_t running = 0, done = 0;
+
+	auto start = std::chrono::steady_clock::now();
+
+	std::unique_lock<std::mutex> guard(lock);
+	while (done < stages.size() && failure.empty()) {
+		for (Stage& stage : stages) {
+			if (!stage.concurrent || !isReady(stage)) {
+				continue;
+			}
+
+			stage.state = STAGE_RUNNING;
+			++running;
+			threads.emplace_back([&, stagePtr = &stage]() {
+				std::string error = execute(*stagePtr);
+
+				std::lock_guard<std::mutex> threadGuard(lock);
+				stagePtr->state = STAGE_DONE;
+				--running;
+				++done;
+				if (!error.empty() && failure.empty()) {
+					failure = std::move(error);
+				}
+				signal.notify_all();
+			});
+		}
+
+		// one stage at a time, concurrent stages that became ready in the
+		// meantime get started before the next one
+		auto it = std::find_if(stages.begin(), stages.end(), [this](const Stage& stage) { return !stage.concurrent && isReady(stage); });
+		if (it != stages.end()) {
+			it->state = STAGE_RUNNING;
+			guard.unlock();
+			std::string error = execute(*it);
+			guard.lock();
+
+			it->state = STAGE_DONE;
+			++done;
+			if (!error.empty() && failure.empty()) {
+				failure = std::move(error);
+			}
+			continue;
+		}
+
+		if (running == 0) {
+			// unreachable as long as dependencies are only added backwards
+			failure = "Startup stages could not be ordered.";
+			break;
+		}
+		signal.wait(guard);
+	}
+
+	// never leave a stage running behind the caller's back
+	signal.wait(guard, [&running]() { return running == 0; });
+	guard.unlock();
+
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+
+	if (failure.empty()) {
+		auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+		std::cout << fmt::format(">> Loaded {:d} startup stages in {:d} ms", stages.size(), ms) << std::endl;
+	}
+	return failure;
+}
@@ -0,0 +1,46 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#ifndef FS_STARTUPLOADER_H_C54E0B7A2D9F4A6E8B13F6D2A0E97C58
+#define FS_STARTUPLOADER_H_C54E0B7A2D9F4A6E8B13F6D2A0E97C58
+
+#include <functional>
+
+// Runs the startup stages in dependency order. Concurrent stages get a thread
+// of their own as soon as their dependencies are done, the others (everything
+// that touches lua or the game) run one after another on the calling thread.
+class StartupLoader
+{
+	public:
+		// returns an empty string on success and the error message otherwise
+		using StageFunction = std::function<std::string()>;
+
+		void addStage(std::string name, std::vector<std::string> dependencies, bool concurrent, StageFunction function);
+
+		// no stage is started after the first failure, its error is returned
+		// once the ones still running have finished
+		std::string run();
+
+	private:
+		enum StageState {
+			STAGE_PENDING,
+			STAGE_RUNNING,
+			STAGE_DONE,
+		};
+
+		struct Stage {
+			std::string name;
+			std::vector<size_t> dependencies;
+			StageFunction function;
+			bool concurrent;
+			StageState state = STAGE_PENDING;
+		};
+
+		bool isReady(const Stage& stage) const;
+		std::string execute(Stage& stage);
+
+		std::vector<Stage> stages;
+		std::string unknownDependency;
+};
+
+#endif
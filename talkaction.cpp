@@ -20,6 +20,7 @@ TalkActions::~TalkActions()
 
 void TalkActions::clear(bool fromLua)
 {
+	indexDirty = true;
 	for (auto it = talkActions.begin(); it != talkActions.end(); ) {
 		if (fromLua == it->second.fromLua) {
 			it = talkActions.erase(it);
@@ -54,6 +55,7 @@ bool TalkActions::registerEvent(Event_ptr event, const pugi::xml_node&)
 	TalkAction_ptr talkAction{static_cast<TalkAction*>(event.release())}; // event is guaranteed to be a TalkAction
 	std::vector<std::string> words = talkAction->getWordsMap();
 
+	indexDirty = true;
 	for (size_t i = 0; i < words.size(); i++) {
 		if (i == words.size() - 1) {
 			talkActions.emplace(words[i], std::move(*talkAction));
@@ -70,6 +72,7 @@ bool TalkActions::registerLuaEvent(TalkAction* event)
 	TalkAction_ptr talkAction{ event };
 	std::vector<std::string> words = talkAction->getWordsMap();
 
+	indexDirty = true;
 	for (size_t i = 0; i < words.size(); i++) {
 		if (i == words.size() - 1) {
 			talkActions.emplace(words[i], std::move(*talkAction));
@@ -81,56 +84,70 @@ bool TalkActions::registerLuaEvent(TalkAction* event)
 	return true;
 }
 
-TalkActionResult_t TalkActions::playerSaySpell(Player* player, SpeakClasses type, const std::string& words) const
+void TalkActions::buildIndex()
 {
-	size_t wordsLength = words.length();
-	for (auto it = talkActions.begin(); it != talkActions.end(); ) {
-		const std::string& talkactionWords = it->first;
-		size_t talkactionLength = talkactionWords.length();
-		if (wordsLength < talkactionLength || strncasecmp(words.c_str(), talkactionWords.c_str(), talkactionLength) != 0) {
-			++it;
-			continue;
+	index.clear();
+	for (auto& it : talkActions) {
+		index.insert(it.first, &it);
+	}
+	indexDirty = false;
+}
+
+TalkActionResult_t TalkActions::playerSaySpell(Player* player, SpeakClasses type, const std::string& words)
+{
+	if (indexDirty) {
+		buildIndex();
+	}
+
+	// words only match up to a blank or the end of the line
+	TalkActionMap::value_type* match = nullptr;
+	std::string_view param;
+	index.forEachPrefix(words, [&](TalkActionMap::value_type* entry, size_t length) {
+		if (length == words.length()) {
+			match = entry;
+			return true;
 		}
 
-		std::string param;
-		if (wordsLength != talkactionLength) {
-			param = words.substr(talkactionLength);
-			if (param.front() != ' ') {
-				++it;
-				continue;
-			}
-			trim_left(param, ' ');
-
-			std::string separator = it->second.getSeparator();
-			if (separator != " ") {
-				if (!param.empty()) {
-					if (param != separator) {
-						++it;
-						continue;
-					} else {
-						param.erase(param.begin());
-					}
-				}
-			}
+		if (words[length] != ' ') {
+			return false;
 		}
 
-		if (it->second.fromLua) {
-			if (it->second.getNeedAccess() && !player->getGroup()->access) {
-				return TALKACTION_CONTINUE;
-			}
+		std::string_view text(words);
+		text.remove_prefix(std::min(text.find_first_not_of(' ', length), text.size()));
 
-			if (player->getAccountType() < it->second.getRequiredAccountType()) {
-				return TALKACTION_CONTINUE;
+		const std::string& separator = entry->second.getSeparator();
+		if (separator != " " && !text.empty()) {
+			if (text != separator) {
+				return false;
 			}
+			text.remove_prefix(1);
 		}
 
-		if (it->second.executeSay(player, talkactionWords, param, type)) {
+		match = entry;
+		param = text;
+		return true;
+	});
+
+	if (!match) {
+		return TALKACTION_CONTINUE;
+	}
+
+	const TalkAction& talkAction = match->second;
+	if (talkAction.fromLua) {
+		if (talkAction.getNeedAccess() && !player->getGroup()->access) {
 			return TALKACTION_CONTINUE;
-		} else {
-			return TALKACTION_BREAK;
 		}
+
+		if (player->getAccountType() < talkAction.getRequiredAccountType()) {
+			return TALKACTION_CONTINUE;
+		}
+	}
+
+	if (talkAction.executeSay(player, match->first, param, type)) {
+		return TALKACTION_CONTINUE;
+	} else {
+		return TALKACTION_BREAK;
 	}
-	return TALKACTION_CONTINUE;
 }
 
 bool TalkAction::configureEvent(const pugi::xml_node& node)
@@ -157,7 +174,7 @@ std::string TalkAction::getScriptEventName() const
 	return "onSay";
 }
 
-bool TalkAction::executeSay(Player* player, const std::string& words, const std::string& param, SpeakClasses type) const
+bool TalkAction::executeSay(Player* player, const std::string& words, std::string_view param, SpeakClasses type) const
 {
 	//onSay(player, words, param, type)
 	if (!scriptInterface->reserveScriptEnv()) {
@@ -172,11 +189,10 @@ bool TalkAction::executeSay(Player* player, const std::string& words, const std:
 
 	scriptInterface->pushFunction(scriptId);
 
-	LuaScriptInterface::pushUserdata<Player>(L, player);
-	LuaScriptInterface::setMetatable(L, -1, "Player");
+	LuaScriptInterface::pushCreature(L, player);
 
 	LuaScriptInterface::pushString(L, words);
-	LuaScriptInterface::pushString(L, param);
+	lua_pushlstring(L, param.data(), param.size());
 	lua_pushnumber(L, type);
 
 	return scriptInterface->callFunction(4);
@@ -7,6 +7,7 @@
 #include "luascript.h"
 #include "baseevents.h"
 #include "const.h"
+#include "wordtrie.h"
 
 class TalkAction;
 using TalkAction_ptr = std::unique_ptr<TalkAction>;
@@ -34,7 +35,7 @@ class TalkAction : public Event
 			words = word;
 			wordsMap.push_back(word);
 		}
-		std::string getSeparator() const {
+		const std::string& getSeparator() const {
 			return separator;
 		}
 		void setSeparator(std::string sep) {
@@ -42,7 +43,7 @@ class TalkAction : public Event
 		}
 
 		//scripting
-		bool executeSay(Player* player, const std::string& words, const std::string& param, SpeakClasses type) const;
+		bool executeSay(Player* player, const std::string& words, std::string_view param, SpeakClasses type) const;
 
 		AccountType_t getRequiredAccountType() const {
 			return requiredAccountType;
@@ -80,7 +81,7 @@ class TalkActions final : public BaseEvents
 		TalkActions(const TalkActions&) = delete;
 		TalkActions& operator=(const TalkActions&) = delete;
 
-		TalkActionResult_t playerSaySpell(Player* player, SpeakClasses type, const std::string& words) const;
+		TalkActionResult_t playerSaySpell(Player* player, SpeakClasses type, const std::string& words);
 
 		bool registerLuaEvent(TalkAction* event);
 		void clear(bool fromLua) override final;
@@ -91,7 +92,14 @@ class TalkActions final : public BaseEvents
 		Event_ptr getEvent(const std::string& nodeName) override;
 		bool registerEvent(Event_ptr event, const pugi::xml_node& node) override;
 
-		std::map<std::string, TalkAction> talkActions;
+		using TalkActionMap = std::map<std::string, TalkAction>;
+
+		void buildIndex();
+
+		TalkActionMap talkActions;
+		// the words in map order, rebuilt on the first line said after a change
+		WordTrie<TalkActionMap::value_type> index;
+		bool indexDirty = true;
 
 		LuaScriptInterface scriptInterface;
 };
@@ -0,0 +1,161 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#include "otpch.h"
+
+#include "taskprofiler.h"
+#include "scheduler.h"
+#include "tools.h"
+
+#include <fstream>
+#include <fmt/format.h>
+
+TaskProfiler g_taskProfiler;
+
+void TaskProfiler::Histogram::add(uint64_t micros)
+{
+	size_t bucket = 0;
+	while (bucket < HISTOGRAM_BUCKETS - 1 && micros >= (uint64_t{1} << bucket)) {
+		++bucket;
+	}
+
+	++buckets[bucket];
+	++count;
+	total += micros;
+	max = std::max(max, micros);
+}
+
+uint64_t TaskProfiler::Histogram::getPercentile(double percentile) const
+{
+	if (count == 0) {
+		return 0;
+	}
+
+	// report the upper bound of the bucket holding the requested sample
+	uint64_t target = std::max<uint64_t>(1, static_cast<uint64_t>(count * percentile));
+	uint64_t seen = 0;
+	for (size_t bucket = 0; bucket < HISTOGRAM_BUCKETS; ++bucket) {
+		seen += buckets[bucket];
+		if (seen >= target) {
+			return std::min(max, uint64_t{1} << bucket);
+		}
+	}
+	return max;
+}
+
+void TaskProfiler::setEnabled(bool value)
+{
+	if (value && !isEnabled()) {
+		reset();
+	}
+	enabled.store(value, std::memory_order_relaxed);
+}
+
+void TaskProfiler::addExecution(const char* origin, uint64_t waitMicros, uint64_t executionMicros)
+{
+	OriginStats& stats = origins[origin];
+	stats.wait.add(waitMicros);
+	stats.execution.add(executionMicros);
+}
+
+void TaskProfiler::addExpired(const char* origin)
+{
+	++origins[origin].expired;
+}
+
+void TaskProfiler::addThrottled(const char* origin)
+{
+	std::lock_guard<std::mutex> lockGuard(throttledLock);
+	++throttled[origin];
+}
+
+void TaskProfiler::reset()
+{
+	origins.clear();
+	{
+		std::lock_guard<std::mutex> lockGuard(throttledLock);
+		throttled.clear();
+	}
+	since = std::chrono::steady_clock::now();
+}
+
+std::string TaskProfiler::getReport() const
+{
+	// the same tag may live at different addresses in different translation units
+	std::map<std::string, OriginStats> merged;
+	for (const auto& it : origins) {
+		OriginStats& stats = merged[it.first ? it.first : "unknown"];
+		for (size_t bucket = 0; bucket < HISTOGRAM_BUCKETS; ++bucket) {
+			stats.execution.buckets[bucket] += it.second.execution.buckets[bucket];
+			stats.wait.buckets[bucket] += it.second.wait.buckets[bucket];
+		}
+		stats.execution.count += it.second.execution.count;
+		stats.execution.total += it.second.execution.total;
+		stats.execution.max = std::max(stats.execution.max, it.second.execution.max);
+		stats.wait.count += it.second.wait.count;
+		stats.wait.total += it.second.wait.total;
+		stats.wait.max = std::max(stats.wait.max, it.second.wait.max);
+		stats.expired += it.second.expired;
+	}
+	{
+		std::lock_guard<std::mutex> lockGuard(throttledLock);
+		for (const auto& it : throttled) {
+			merged[it.first ? it.first : "unknown"].throttled += it.second;
+		}
+	}
+
+	std::vector<std::pair<std::string, OriginStats>> sorted(merged.begin(), merged.end());
+	std::sort(sorted.begin(), sorted.end(), [](const std::pair<std::string, OriginStats>& lhs, const std::pair<std::string, OriginStats>& rhs) {
+		return lhs.second.execution.total > rhs.second.execution.total;
+	});
+
+	uint64_t tasks = 0, expired = 0, throttledPackets = 0, busy = 0;
+	for (const auto& it : sorted) {
+		tasks += it.second.execution.count;
+		expired += it.second.expired;
+		throttledPackets += it.second.throttled;
+		busy += it.second.execution.total;
+	}
+
+	auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - since).count();
+
+	std::ostringstream ss;
+	ss << fmt::format("Dispatcher profile over {:.1f}s: {:d} tasks, {:d} expired, {:d} throttled, {:.1f}% busy\n", elapsed / 1000., tasks, expired, throttledPackets, elapsed > 0 ? busy / (elapsed * 10.) : 0.);
+	ss << fmt::format("{:<32s} {:>9s} {:>10s} {:>8s} {:>8s} {:>8s} {:>9s} {:>9s} {:>9s} {:>8s} {:>9s}\n",
+	                  "origin", "count", "total ms", "avg us", "p50 us", "p99 us", "max us", "wait avg", "wait p99", "expired", "throttled");
+	for (const auto& it : sorted) {
+		const OriginStats& stats = it.second;
+		uint64_t count = std::max<uint64_t>(1, stats.execution.count);
+		ss << fmt::format("{:<32s} {:>9d} {:>10.1f} {:>8d} {:>8d} {:>8d} {:>9d} {:>9d} {:>9d} {:>8d} {:>9d}\n",
+		                  it.first, stats.execution.count, stats.execution.total / 1000., stats.execution.total / count,
+		                  stats.execution.getPercentile(0.5), stats.execution.getPercentile(0.99), stats.execution.max,
+		                  stats.wait.total / count, stats.wait.getPercentile(0.99), stats.expired, stats.throttled);
+	}
+	return ss.str();
+}
+
+bool TaskProfiler::dumpReport(const std::string& path) const
+{
+	std::ofstream file(path, std::ios::app);
+	if (!file.is_open()) {
+		std::cout << "[Warning - TaskProfiler::dumpReport] Unable to open " << path << " for writing." << std::endl;
+		return false;
+	}
+
+	file << formatDateShort(time(nullptr)) << '\n' << getReport() << std::endl;
+	return true;
+}
+
+void TaskProfiler::scheduleDump(uint32_t interval, const std::string& path)
+{
+	g_scheduler.addEvent(createSchedulerTask(interval, std::bind(&TaskProfiler::dump, this, interval, path)));
+}
+
+void TaskProfiler::dump(uint32_t interval, std::string path)
+{
+	if (isEnabled()) {
+		dumpReport(path);
+		reset();
+	}
+	scheduleDump(interval, path);
+}
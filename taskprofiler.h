@@ -0,0 +1,66 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#ifndef FS_TASKPROFILER_H_6F1C2A9D3B8E4F7A9C0D1E2F3A4B5C6D
+#define FS_TASKPROFILER_H_6F1C2A9D3B8E4F7A9C0D1E2F3A4B5C6D
+
+#include <array>
+#include <atomic>
+
+// Opt-in accounting of the tasks executed by the dispatcher, grouped by the
+// static origin tag every task carries. All recording and reporting happens on
+// the dispatcher thread, only the enabled flag and the throttled packet counts
+// are touched by other threads.
+class TaskProfiler
+{
+	public:
+		// bucket n counts samples below 2^n microseconds, the last one everything above
+		static constexpr size_t HISTOGRAM_BUCKETS = 24;
+
+		struct Histogram {
+			void add(uint64_t micros);
+			uint64_t getPercentile(double percentile) const;
+
+			std::array<uint64_t, HISTOGRAM_BUCKETS> buckets = {};
+			uint64_t count = 0;
+			uint64_t total = 0;
+			uint64_t max = 0;
+		};
+
+		struct OriginStats {
+			Histogram execution;
+			Histogram wait;
+			uint64_t expired = 0;
+			uint64_t throttled = 0;
+		};
+
+		bool isEnabled() const {
+			return enabled.load(std::memory_order_relaxed);
+		}
+		void setEnabled(bool value);
+
+		void addExecution(const char* origin, uint64_t waitMicros, uint64_t executionMicros);
+		void addExpired(const char* origin);
+		// client packets dropped by flood control before becoming a task, callable from any thread
+		void addThrottled(const char* origin);
+
+		void reset();
+		std::string getReport() const;
+		bool dumpReport(const std::string& path) const;
+
+		// periodically appends the report to the given file and resets the counters
+		void scheduleDump(uint32_t interval, const std::string& path);
+
+	private:
+		void dump(uint32_t interval, std::string path);
+
+		std::atomic<bool> enabled{false};
+		std::map<const char*, OriginStats> origins;
+		std::map<const char*, uint64_t> throttled;
+		mutable std::mutex throttledLock;
+		std::chrono::steady_clock::time_point since = std::chrono::steady_clock::now();
+};
+
+extern TaskProfiler g_taskProfiler;
+
+#endif
@@ -5,77 +5,225 @@
 
 #include "tasks.h"
 #include "game.h"
+#include "lockfree.h"
+#include "luascript.h"
+#include "metrics.h"
+#include "outputmessage.h"
+#include "taskprofiler.h"
+#include "tracer.h"
+#include "watchdog.h"
 
 extern Game g_game;
+extern LuaEnvironment g_luaEnvironment;
 
-Task* createTask(TaskFunc&& f)
+static constexpr size_t TASK_FREE_LIST_CAPACITY = 8192;
+
+void* Task::operator new(size_t size)
+{
+	// derived task types without their own pool end up here too
+	if (size != sizeof(Task)) {
+		return ::operator new(size);
+	}
+	return LockfreePoolingAllocator<Task, TASK_FREE_LIST_CAPACITY>().allocate(1);
+}
+
+void Task::operator delete(void* p, size_t size)
+{
+	if (size != sizeof(Task)) {
+		::operator delete(p);
+		return;
+	}
+	LockfreePoolingAllocator<Task, TASK_FREE_LIST_CAPACITY>().deallocate(static_cast<Task*>(p), 1);
+}
+
+Task* createTask(TaskFunc&& f, const char* origin/* = TASK_CALLER*/)
 {
-	return new Task(std::move(f));
+	return new Task(std::move(f), origin);
 }
 
-Task* createTask(uint32_t expiration, TaskFunc&& f)
+Task* createTask(uint32_t expiration, TaskFunc&& f, const char* origin/* = TASK_CALLER*/)
 {
-	return new Task(expiration, std::move(f));
+	return new Task(expiration, std::move(f), origin);
 }
 
 void Dispatcher::threadMain()
 {
-	std::vector<Task*> tmpTaskList;
-	// NOTE: second argument defer_lock is to prevent from immediate locking
-	std::unique_lock<std::mutex> taskLockUnique(taskLock, std::defer_lock);
+	OutputMessagePool& outputPool = OutputMessagePool::getInstance();
 
 	while (getState() != THREAD_STATE_TERMINATED) {
-		// check if there are tasks waiting
-		taskLockUnique.lock();
-		if (taskList.empty()) {
-			//if the list is empty wait for signal
-			taskSignal.wait(taskLockUnique);
+		// buffered output is sent from here rather than through the scheduler
+		auto nextAutosend = outputPool.sendAll();
+
+		// take every task posted so far in one go
+		Task* task = taskHead.exchange(nullptr, std::memory_order_acquire);
+		if (!task) {
+			// the gap before sleeping belongs to the lua collector, so its
+			// steps don't land in whichever callback allocates next
+			g_luaEnvironment.collectIdleGarbage();
+
+			// announce that we are about to sleep, then check again so a
+			// producer that missed the flag can't leave us waiting
+			sleeping.store(true);
+			if (!taskHead.load()) {
+				std::unique_lock<std::mutex> sleepLockUnique(sleepLock);
+				auto hasTask = [this]() { return taskHead.load(std::memory_order_relaxed) != nullptr; };
+				if (nextAutosend == std::chrono::steady_clock::time_point::max()) {
+					taskSignal.wait(sleepLockUnique, hasTask);
+				} else {
+					taskSignal.wait_until(sleepLockUnique, nextAutosend, hasTask);
+				}
+			}
+			sleeping.store(false, std::memory_order_relaxed);
+			continue;
 		}
-		tmpTaskList.swap(taskList);
-		taskLockUnique.unlock();
 
-		for (Task* task : tmpTaskList) {
-			if (!task->hasExpired()) {
-				++dispatcherCycle;
-				// execute it
+		executeBatch(task);
+	}
+
+	// release whatever has been posted after the shutdown task
+	Task* task = taskHead.exchange(nullptr, std::memory_order_acquire);
+	while (task) {
+		Task* next = task->next;
+		delete task;
+		task = next;
+	}
+}
+
+size_t Dispatcher::runPendingTasks()
+{
+	size_t executed = 0;
+	while (Task* task = taskHead.exchange(nullptr, std::memory_order_acquire)) {
+		executed += executeBatch(task);
+	}
+	return executed;
+}
+
+size_t Dispatcher::executeBatch(Task* task)
+{
+	// the stack holds the newest task first, reverse it into posting order
+	// while sorting the tasks into their phase
+	std::array<Task*, TICK_PHASE_OUTPUT> ordered = {};
+	size_t batchSize = 0;
+	while (task) {
+		Task* next = task->next;
+		task->next = ordered[task->phase];
+		ordered[task->phase] = task;
+		task = next;
+		++batchSize;
+	}
+	g_metrics.addDispatcherBatch(batchSize);
+
+	auto start = std::chrono::steady_clock::now();
+	for (size_t phase = TICK_PHASE_INPUT; phase < TICK_PHASE_OUTPUT; ++phase) {
+		if (ordered[phase]) {
+			executeTasks(ordered[phase]);
+
+			auto end = std::chrono::steady_clock::now();
+			g_metrics.addTickPhase(static_cast<TickPhase_t>(phase), std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+			start = end;
+		}
+	}
+
+	flushOutput();
+	g_metrics.addTickPhase(TICK_PHASE_OUTPUT, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+	return batchSize;
+}
+
+void Dispatcher::executeTasks(Task* tasks)
+{
+	bool profiling = g_taskProfiler.isEnabled();
+	while (tasks) {
+		Task* task = tasks;
+		tasks = task->next;
+
+		if (profiling) {
+			executeProfiled(task);
+		} else if (!task->hasExpired()) {
+			++dispatcherCycle;
+			// execute it
+			auto start = std::chrono::steady_clock::now();
+			g_watchdog.enterTask(task->getOrigin(), start);
+			{
+				TraceSpan traceSpan(task->getOrigin() ? task->getOrigin() : "Dispatcher::task");
 				(*task)();
 			}
-			delete task;
+			g_watchdog.leaveTask();
+			g_metrics.addTaskExecution(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
 		}
-		tmpTaskList.clear();
+		delete task;
 	}
 }
 
-void Dispatcher::addTask(Task* task)
+void Dispatcher::flushOutput()
 {
-	bool do_signal = false;
+	// health bars and player stats batched during the frame go out with its packets
+	g_game.flushCreatureHealth();
+	g_game.flushPlayerUpdates();
 
-	taskLock.lock();
+	// interactive packets leave as soon as the frame that produced them is done
+	OutputMessagePool::getInstance().flushRequested();
+}
 
-	if (getState() == THREAD_STATE_RUNNING) {
-		do_signal = taskList.empty();
-		taskList.push_back(task);
-	} else {
-		delete task;
+void Dispatcher::executeProfiled(Task* task)
+{
+	if (task->hasExpired()) {
+		g_taskProfiler.addExpired(task->getOrigin());
+		return;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	++dispatcherCycle;
+	g_watchdog.enterTask(task->getOrigin(), start);
+	{
+		TraceSpan traceSpan(task->getOrigin() ? task->getOrigin() : "Dispatcher::task");
+		(*task)();
+	}
+	g_watchdog.leaveTask();
+	auto end = std::chrono::steady_clock::now();
+	g_metrics.addTaskExecution(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+
+	// tasks posted before profiling was enabled carry no enqueue time
+	int64_t wait = 0;
+	if (task->enqueued != std::chrono::steady_clock::time_point{}) {
+		wait = std::chrono::duration_cast<std::chrono::microseconds>(start - task->enqueued).count();
+	}
+	g_taskProfiler.addExecution(task->getOrigin(), wait, std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+}
+
+void Dispatcher::pushTask(Task* task)
+{
+	if (g_taskProfiler.isEnabled()) {
+		task->enqueued = std::chrono::steady_clock::now();
 	}
 
-	taskLock.unlock();
+	Task* head = taskHead.load(std::memory_order_relaxed);
+	do {
+		task->next = head;
+	} while (!taskHead.compare_exchange_weak(head, task, std::memory_order_seq_cst, std::memory_order_relaxed));
 
-	// send a signal if the list was empty
-	if (do_signal) {
+	// wake the game thread only if it is actually waiting for work
+	if (sleeping.load()) {
+		{
+			// serializes with the predicate check done under sleepLock
+			std::lock_guard<std::mutex> lockClass(sleepLock);
+		}
 		taskSignal.notify_one();
 	}
 }
 
-void Dispatcher::shutdown()
+void Dispatcher::addTask(Task* task)
 {
-	Task* task = createTask([this]() {
-		setState(THREAD_STATE_TERMINATED);
-		taskSignal.notify_one();
-	});
+	if (getState() != THREAD_STATE_RUNNING) {
+		delete task;
+		return;
+	}
 
-	std::lock_guard<std::mutex> lockClass(taskLock);
-	taskList.push_back(task);
+	pushTask(task);
+}
 
-	taskSignal.notify_one();
+void Dispatcher::shutdown()
+{
+	pushTask(createTask([this]() {
+		setState(THREAD_STATE_TERMINATED);
+	}));
 }
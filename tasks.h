@@ -5,10 +5,127 @@
 #define FS_TASKS_H_A66AC384766041E59DCA059DAB6E1976
 
 #include <condition_variable>
+#include <type_traits>
 #include "thread_holder_base.h"
 #include "enums.h"
 
-using TaskFunc = std::function<void(void)>;
+// Move-only nullary callable. Captures up to STORAGE_SIZE bytes (enough for
+// the std::bind(&Game::..., &g_game, ...) calls made by the protocols) live
+// inline, only bigger ones fall back to the heap.
+class TaskFunc
+{
+	public:
+		static constexpr size_t STORAGE_SIZE = 96;
+
+		TaskFunc() = default;
+
+		template <typename F, typename = std::enable_if_t<!std::is_same<std::decay_t<F>, TaskFunc>::value>>
+		TaskFunc(F&& f) {
+			using Callable = std::decay_t<F>;
+			if constexpr (fitsInline<Callable>()) {
+				new (&storage) Callable(std::forward<F>(f));
+				ops = &inlineOperations<Callable>;
+			} else {
+				*reinterpret_cast<Callable**>(&storage) = new Callable(std::forward<F>(f));
+				ops = &heapOperations<Callable>;
+			}
+		}
+
+		TaskFunc(TaskFunc&& other) noexcept {
+			moveFrom(other);
+		}
+		TaskFunc& operator=(TaskFunc&& other) noexcept {
+			if (this != &other) {
+				reset();
+				moveFrom(other);
+			}
+			return *this;
+		}
+
+		// non-copyable
+		TaskFunc(const TaskFunc&) = delete;
+		TaskFunc& operator=(const TaskFunc&) = delete;
+
+		~TaskFunc() {
+			reset();
+		}
+
+		void operator()() {
+			ops->invoke(&storage);
+		}
+
+		explicit operator bool() const {
+			return ops != nullptr;
+		}
+
+	private:
+		struct Operations {
+			void (*invoke)(void* storage);
+			void (*move)(void* to, void* from);
+			void (*destroy)(void* storage);
+		};
+
+		template <typename Callable>
+		static constexpr bool fitsInline() {
+			return sizeof(Callable) <= STORAGE_SIZE && alignof(Callable) <= alignof(std::max_align_t) &&
+			       std::is_nothrow_move_constructible<Callable>::value;
+		}
+
+		template <typename Callable>
+		static constexpr Operations inlineOperations = {
+			[](void* storage) { (*static_cast<Callable*>(storage))(); },
+			[](void* to, void* from) {
+				new (to) Callable(std::move(*static_cast<Callable*>(from)));
+				static_cast<Callable*>(from)->~Callable();
+			},
+			[](void* storage) { static_cast<Callable*>(storage)->~Callable(); },
+		};
+
+		template <typename Callable>
+		static constexpr Operations heapOperations = {
+			[](void* storage) { (**static_cast<Callable**>(storage))(); },
+			[](void* to, void* from) { *static_cast<Callable**>(to) = *static_cast<Callable**>(from); },
+			[](void* storage) { delete *static_cast<Callable**>(storage); },
+		};
+
+		void moveFrom(TaskFunc& other) {
+			ops = other.ops;
+			if (ops) {
+				ops->move(&storage, &other.storage);
+				other.ops = nullptr;
+			}
+		}
+
+		void reset() {
+			if (ops) {
+				ops->destroy(&storage);
+				ops = nullptr;
+			}
+		}
+
+		alignas(std::max_align_t) unsigned char storage[STORAGE_SIZE];
+		const Operations* ops = nullptr;
+};
+
+// origin tag of a task defaults to the name of the function creating it
+#if defined(__GNUC__) || defined(__clang__) || (defined(_MSC_VER) && _MSC_VER >= 1926)
+#define TASK_CALLER __builtin_FUNCTION()
+#else
+#define TASK_CALLER nullptr
+#endif
+
+// A dispatcher frame runs the tasks it took in two phases, everything posted
+// by the network and other threads first and the scheduled world updates
+// (creature thinks, conditions, decay) after them. The output phase then
+// sends the batched updates and the flushes requested by the frame once.
+enum TickPhase_t : uint8_t {
+	TICK_PHASE_INPUT,
+	TICK_PHASE_SIMULATE,
+	TICK_PHASE_OUTPUT,
+
+	TICK_PHASE_LAST
+};
+
 const int DISPATCHER_TASK_EXPIRATION = 2000;
 const auto SYSTEM_TIME_ZERO = std::chrono::system_clock::time_point(std::chrono::milliseconds(0));
 
@@ -16,11 +133,16 @@ class Task
 {
 	public:
 		// DO NOT allocate this class on the stack
-		explicit Task(TaskFunc&& f) : func(std::move(f)) {}
-		Task(uint32_t ms, TaskFunc&& f) :
-			expiration(std::chrono::system_clock::now() + std::chrono::milliseconds(ms)), func(std::move(f)) {}
+		explicit Task(TaskFunc&& f, const char* origin = nullptr) : func(std::move(f)), origin(origin) {}
+		Task(uint32_t ms, TaskFunc&& f, const char* origin = nullptr) :
+			expiration(std::chrono::system_clock::now() + std::chrono::milliseconds(ms)), func(std::move(f)), origin(origin) {}
 
 		virtual ~Task() = default;
+
+		// tasks are recycled through a lock-free free list
+		static void* operator new(size_t size);
+		static void operator delete(void* p, size_t size);
+
 		void operator()() {
 			func();
 		}
@@ -36,18 +158,32 @@ class Task
 			return expiration < std::chrono::system_clock::now();
 		}
 
+		const char* getOrigin() const {
+			return origin;
+		}
+
 	protected:
 		std::chrono::system_clock::time_point expiration = SYSTEM_TIME_ZERO;
+		TickPhase_t phase = TICK_PHASE_INPUT;
 
 	private:
 		// Expiration has another meaning for scheduler tasks,
 		// then it is the time the task should be added to the
 		// dispatcher
 		TaskFunc func;
+
+		// static tag used by the task profiler
+		const char* origin;
+		std::chrono::steady_clock::time_point enqueued;
+
+		// intrusive link used by the dispatcher queue
+		Task* next = nullptr;
+
+		friend class Dispatcher;
 };
 
-Task* createTask(TaskFunc&& f);
-Task* createTask(uint32_t expiration, TaskFunc&& f);
+Task* createTask(TaskFunc&& f, const char* origin = TASK_CALLER);
+Task* createTask(uint32_t expiration, TaskFunc&& f, const char* origin = TASK_CALLER);
 
 class Dispatcher : public ThreadHolder<Dispatcher> {
 	public:
@@ -61,11 +197,29 @@ class Dispatcher : public ThreadHolder<Dispatcher> {
 
 		void threadMain();
 
+		// simulation, the calling thread becomes the game thread and runs the
+		// posted tasks itself, see Simulation
+		void startInline() {
+			setState(THREAD_STATE_RUNNING);
+		}
+		size_t runPendingTasks();
+
 	private:
-		std::mutex taskLock;
+		void pushTask(Task* task);
+		size_t executeBatch(Task* task);
+		void executeTasks(Task* tasks);
+		void executeProfiled(Task* task);
+		void flushOutput();
+
+		// multi-producer/single-consumer stack of pending tasks, the game
+		// thread takes it as a whole and restores FIFO order itself
+		std::atomic<Task*> taskHead{nullptr};
+
+		// only touched by producers while the game thread is waiting
+		std::atomic<bool> sleeping{false};
+		std::mutex sleepLock;
 		std::condition_variable taskSignal;
 
-		std::vector<Task*> taskList;
 		uint64_t dispatcherCycle = 0;
 };
 
@@ -7,6 +7,7 @@
 #include <thread>
 #include <atomic>
 #include "enums.h"
+#include "threadplacement.h"
 
 template <typename Derived>
 class ThreadHolder
@@ -27,6 +28,11 @@ class ThreadHolder
 				thread.join();
 			}
 		}
+
+		// see ThreadPlacement, any thread once started
+		void setPlacement(const std::string& cpus, int32_t priority, const char* name) {
+			ThreadPlacement::apply(thread, cpus, priority, name);
+		}
 	protected:
 		void setState(ThreadState newState) {
 			threadState.store(newState, std::memory_order_relaxed);
@@ -0,0 +1,95 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#include "otpch.h"
+
+#include "threadplacement.h"
+
+#include "tools.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+
+#ifdef __linux__
+bool parseCpus(const std::string& cpus, cpu_set_t& set)
+{
+	CPU_ZERO(&set);
+	for (const std::string& range : explodeString(cpus, ",")) {
+		std::string bounds = range;
+		trimString(bounds);
+		if (bounds.empty()) {
+			continue;
+		}
+
+		int32_t first, last;
+		try {
+			size_t dash = bounds.find('-');
+			first = std::stoi(bounds.substr(0, dash));
+			last = dash == std::string::npos ? first : std::stoi(bounds.substr(dash + 1));
+		} catch (const std::exception&) {
+			return false;
+		}
+
+		if (first < 0 || last < first || last >= CPU_SETSIZE) {
+			return false;
+		}
+
+		for (int32_t cpu = first; cpu <= last; ++cpu) {
+			CPU_SET(cpu, &set);
+		}
+	}
+	return CPU_COUNT(&set) != 0;
+}
+
+void applyToHandle(pthread_t handle, const std::string& cpus, int32_t priority, const char* name)
+{
+	if (!cpus.empty()) {
+		cpu_set_t set;
+		if (!parseCpus(cpus, set)) {
+			std::cout << "[Warning - ThreadPlacement::apply] Invalid cores \"" << cpus << "\" for the " << name << " thread." << std::endl;
+		} else if (pthread_setaffinity_np(handle, sizeof(set), &set) != 0) {
+			std::cout << "[Warning - ThreadPlacement::apply] Cannot pin the " << name << " thread to cores " << cpus << '.' << std::endl;
+		}
+	}
+
+	if (priority != 0) {
+		sched_param param;
+		param.sched_priority = std::max<int32_t>(sched_get_priority_min(SCHED_RR), std::min<int32_t>(priority, sched_get_priority_max(SCHED_RR)));
+		if (pthread_setschedparam(handle, SCHED_RR, &param) != 0) {
+			std::cout << "[Warning - ThreadPlacement::apply] Cannot set priority " << priority << " for the " << name << " thread, it needs CAP_SYS_NICE." << std::endl;
+		}
+	}
+}
+#endif
+
+}
+
+void ThreadPlacement::apply(std::thread& thread, const std::string& cpus, int32_t priority, const char* name)
+{
+	if ((cpus.empty() && priority == 0) || !thread.joinable()) {
+		return;
+	}
+
+#ifdef __linux__
+	applyToHandle(thread.native_handle(), cpus, priority, name);
+#else
+	std::cout << "[Warning - ThreadPlacement::apply] Cores and priorities of the " << name << " thread are only set on Linux." << std::endl;
+#endif
+}
+
+void ThreadPlacement::applyToCurrent(const std::string& cpus, int32_t priority, const char* name)
+{
+	if (cpus.empty() && priority == 0) {
+		return;
+	}
+
+#ifdef __linux__
+	applyToHandle(pthread_self(), cpus, priority, name);
+#else
+	std::cout << "[Warning - ThreadPlacement::apply] Cores and priorities of the " << name << " thread are only set on Linux." << std::endl;
+#endif
+}
@@ -0,0 +1,22 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#ifndef FS_THREADPLACEMENT_H_3E0A037B9D3F422EA47ADEC35155CC64
+#define FS_THREADPLACEMENT_H_3E0A037B9D3F422EA47ADEC35155CC64
+
+#include <string>
+#include <thread>
+
+// Pins a thread to a set of cores and sets its scheduling. cpus lists cores
+// and ranges like "2,4-5", empty leaves the thread where the system puts it.
+// A priority of 1 to 99 runs it round robin realtime, which needs
+// CAP_SYS_NICE, 0 keeps the normal scheduling. Failures are warned about and
+// leave the thread as it was. Linux only.
+namespace ThreadPlacement
+{
+	void apply(std::thread& thread, const std::string& cpus, int32_t priority, const char* name);
+	// the calling thread, for the ones not started through a ThreadHolder
+	void applyToCurrent(const std::string& cpus, int32_t priority, const char* name);
+}
+
+#endif
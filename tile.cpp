@@ -10,12 +10,14 @@
 #include "creature.h"
 #include "combat.h"
 #include "game.h"
+#include "hugepagearena.h"
 #include "mailbox.h"
 #include "monster.h"
 #include "movement.h"
 #include "teleport.h"
 #include "trashholder.h"
 #include "configmanager.h"
+#include "memoryaccounting.h"
 
 extern Game g_game;
 extern MoveEvents* g_moveEvents;
@@ -24,8 +26,48 @@ extern ConfigManager g_config;
 StaticTile real_nullptr_tile(0xFFFF, 0xFFFF, 0xFF);
 Tile& Tile::nullptr_tile = real_nullptr_tile;
 
+void* Tile::operator new(size_t size)
+{
+	MemoryAccounting::allocated(MEMORY_TILES, size);
+	if (void* p = HugePageArena::allocate(size)) {
+		return p;
+	}
+	return ::operator new(size);
+}
+
+void Tile::operator delete(void* p, size_t size)
+{
+	MemoryAccounting::released(MEMORY_TILES, size);
+	if (!HugePageArena::release(p, size)) {
+		::operator delete(p);
+	}
+}
+
+namespace {
+
+// the item properties setTileFlags and resetTileFlags keep track of
+tileflags_t getPropertyFlag(ITEMPROPERTY prop)
+{
+	switch (prop) {
+		case CONST_PROP_BLOCKSOLID: return TILESTATE_BLOCKSOLID;
+		case CONST_PROP_BLOCKPATH: return TILESTATE_BLOCKPATH;
+		case CONST_PROP_BLOCKPROJECTILE: return TILESTATE_BLOCKPROJECTILE;
+		case CONST_PROP_IMMOVABLEBLOCKSOLID: return TILESTATE_IMMOVABLEBLOCKSOLID;
+		case CONST_PROP_IMMOVABLEBLOCKPATH: return TILESTATE_IMMOVABLEBLOCKPATH;
+		case CONST_PROP_IMMOVABLENOFIELDBLOCKPATH: return TILESTATE_IMMOVABLENOFIELDBLOCKPATH;
+		case CONST_PROP_NOFIELDBLOCKPATH: return TILESTATE_NOFIELDBLOCKPATH;
+		default: return TILESTATE_NONE;
+	}
+}
+
+}
+
 bool Tile::hasProperty(ITEMPROPERTY prop) const
 {
+	if (tileflags_t flag = getPropertyFlag(prop)) {
+		return hasFlag(flag);
+	}
+
 	if (ground && ground->hasProperty(prop)) {
 		return true;
 	}
@@ -44,6 +86,11 @@ bool Tile::hasProperty(const Item* exclude, ITEMPROPERTY prop) const
 {
 	assert(exclude);
 
+	tileflags_t flag = getPropertyFlag(prop);
+	if (flag != TILESTATE_NONE && !hasFlag(flag)) {
+		return false;
+	}
+
 	if (ground && exclude != ground && ground->hasProperty(prop)) {
 		return true;
 	}
@@ -89,7 +136,7 @@ bool Tile::hasHeight(uint32_t n) const
 
 size_t Tile::getCreatureCount() const
 {
-	if (const CreatureVector* creatures = getCreatures()) {
+	if (const TileCreatureVector* creatures = getCreatures()) {
 		return creatures->size();
 	}
 	return 0;
@@ -222,7 +269,7 @@ BedItem* Tile::getBedItem() const
 
 Creature* Tile::getTopCreature() const
 {
-	if (const CreatureVector* creatures = getCreatures()) {
+	if (const TileCreatureVector* creatures = getCreatures()) {
 		if (!creatures->empty()) {
 			return *creatures->begin();
 		}
@@ -232,7 +279,7 @@ Creature* Tile::getTopCreature() const
 
 const Creature* Tile::getBottomCreature() const
 {
-	if (const CreatureVector* creatures = getCreatures()) {
+	if (const TileCreatureVector* creatures = getCreatures()) {
 		if (!creatures->empty()) {
 			return *creatures->rbegin();
 		}
@@ -242,7 +289,7 @@ const Creature* Tile::getBottomCreature() const
 
 Creature* Tile::getTopVisibleCreature(const Creature* creature) const
 {
-	if (const CreatureVector* creatures = getCreatures()) {
+	if (const TileCreatureVector* creatures = getCreatures()) {
 		if (creature) {
 			for (Creature* tileCreature : *creatures) {
 				if (creature->canSeeCreature(tileCreature)) {
@@ -265,7 +312,7 @@ Creature* Tile::getTopVisibleCreature(const Creature* creature) const
 
 const Creature* Tile::getBottomVisibleCreature(const Creature* creature) const
 {
-	if (const CreatureVector* creatures = getCreatures()) {
+	if (const TileCreatureVector* creatures = getCreatures()) {
 		if (creature) {
 			for (auto it = creatures->rbegin(), end = creatures->rend(); it != end; ++it) {
 				if (creature->canSeeCreature(*it)) {
@@ -310,8 +357,8 @@ Item* Tile::getItemByTopOrder(int32_t topOrder)
 	//3: doors etc
 	//4: creatures
 	if (TileItemVector* items = getItemList()) {
-		for (auto it = ItemVector::const_reverse_iterator(items->getEndTopItem()), end = ItemVector::const_reverse_iterator(items->getBeginTopItem()); it != end; ++it) {
-			if (Item::items[(*it)->getID()].alwaysOnTopOrder == topOrder) {
+		for (auto it = TileItemVector::const_reverse_iterator(items->getEndTopItem()), end = TileItemVector::const_reverse_iterator(items->getBeginTopItem()); it != end; ++it) {
+			if (Item::items.getHotType((*it)->getID()).alwaysOnTopOrder == topOrder) {
 				return (*it);
 			}
 		}
@@ -328,16 +375,14 @@ Thing* Tile::getTopVisibleThing(const Creature* creature)
 
 	TileItemVector* items = getItemList();
 	if (items) {
-		for (ItemVector::const_iterator it = items->getBeginDownItem(), end = items->getEndDownItem(); it != end; ++it) {
-			const ItemType& iit = Item::items[(*it)->getID()];
-			if (!iit.lookThrough) {
+		for (TileItemVector::const_iterator it = items->getBeginDownItem(), end = items->getEndDownItem(); it != end; ++it) {
+			if (!Item::items.getHotType((*it)->getID()).hasFlag(ITEMFLAG_LOOKTHROUGH)) {
 				return (*it);
 			}
 		}
 
-		for (auto it = ItemVector::const_reverse_iterator(items->getEndTopItem()), end = ItemVector::const_reverse_iterator(items->getBeginTopItem()); it != end; ++it) {
-			const ItemType& iit = Item::items[(*it)->getID()];
-			if (!iit.lookThrough) {
+		for (auto it = TileItemVector::const_reverse_iterator(items->getEndTopItem()), end = TileItemVector::const_reverse_iterator(items->getBeginTopItem()); it != end; ++it) {
+			if (!Item::items.getHotType((*it)->getID()).hasFlag(ITEMFLAG_LOOKTHROUGH)) {
 				return (*it);
 			}
 		}
@@ -346,8 +391,30 @@ Thing* Tile::getTopVisibleThing(const Creature* creature)
 	return ground;
 }
 
+const TileDescription* Tile::getCachedDescription() const
+{
+	if (!descriptionCached) {
+		return nullptr;
+	}
+	return g_game.map.getTileDescription(this);
+}
+
+const TileDescription& Tile::cacheDescription(TileDescription&& description) const
+{
+	descriptionCached = true;
+	return g_game.map.setTileDescription(this, std::move(description));
+}
+
+void Tile::dropCachedDescription()
+{
+	descriptionCached = false;
+	g_game.map.removeTileDescription(this);
+}
+
 void Tile::onAddTileItem(Item* item)
 {
+	invalidateDescription();
+
 	if (item->hasProperty(CONST_PROP_MOVEABLE) || item->getContainer()) {
 		auto it = g_game.browseFields.find(this);
 		if (it != g_game.browseFields.end()) {
@@ -384,6 +451,8 @@ void Tile::onAddTileItem(Item* item)
 
 void Tile::onUpdateTileItem(Item* oldItem, const ItemType& oldType, Item* newItem, const ItemType& newType)
 {
+	invalidateDescription();
+
 	if (newItem->hasProperty(CONST_PROP_MOVEABLE) || newItem->getContainer()) {
 		auto it = g_game.browseFields.find(this);
 		if (it != g_game.browseFields.end()) {
@@ -422,6 +491,8 @@ void Tile::onUpdateTileItem(Item* oldItem, const ItemType& oldType, Item* newIte
 
 void Tile::onRemoveTileItem(const SpectatorVec& spectators, const std::vector<int32_t>& oldStackPosVector, Item* item)
 {
+	invalidateDescription();
+
 	if (item->hasProperty(CONST_PROP_MOVEABLE) || item->getContainer()) {
 		auto it = g_game.browseFields.find(this);
 		if (it != g_game.browseFields.end()) {
@@ -470,6 +541,8 @@ void Tile::onRemoveTileItem(const SpectatorVec& spectators, const std::vector<in
 
 void Tile::onUpdateTile(const SpectatorVec& spectators)
 {
+	invalidateDescription();
+
 	const Position& cylinderMapPos = getPosition();
 
 	//send to clients
@@ -498,7 +571,7 @@ ReturnValue Tile::queryAdd(int32_t, const Thing& thing, uint32_t, uint32_t flags
 				return RETURNVALUE_NOTPOSSIBLE;
 			}
 
-			const CreatureVector* creatures = getCreatures();
+			const TileCreatureVector* creatures = getCreatures();
 			if (monster->canPushCreatures() && !monster->isSummon()) {
 				if (creatures) {
 					for (Creature* tileCreature : *creatures) {
@@ -559,7 +632,7 @@ ReturnValue Tile::queryAdd(int32_t, const Thing& thing, uint32_t, uint32_t flags
 			return RETURNVALUE_NOERROR;
 		}
 
-		const CreatureVector* creatures = getCreatures();
+		const TileCreatureVector* creatures = getCreatures();
 		if (const Player* player = creature->getPlayer()) {
 			if (creatures && !creatures->empty() && !hasBitSet(FLAG_IGNOREBLOCKCREATURE, flags) && !player->isAccessPlayer()) {
 				for (const Creature* tileCreature : *creatures) {
@@ -642,7 +715,7 @@ ReturnValue Tile::queryAdd(int32_t, const Thing& thing, uint32_t, uint32_t flags
 			return RETURNVALUE_NOTPOSSIBLE;
 		}
 
-		const CreatureVector* creatures = getCreatures();
+		const TileCreatureVector* creatures = getCreatures();
 		if (creatures && !creatures->empty() && item->isBlocking() && !hasBitSet(FLAG_IGNOREBLOCKCREATURE, flags)) {
 			for (const Creature* tileCreature : *creatures) {
 				if (!tileCreature->isInGhostMode()) {
@@ -835,13 +908,11 @@ void Tile::addThing(int32_t, Thing* thing)
 {
 	Creature* creature = thing->getCreature();
 	if (creature) {
-		g_game.map.clearSpectatorCache();
-		if (creature->getPlayer()) {
-			g_game.map.clearPlayersSpectatorCache();
-		}
+		g_game.map.invalidateSpectatorCache(getPosition(), creature->getPlayer() != nullptr);
+		g_game.map.invalidatePathCache(getPosition());
 
 		creature->setParent(this);
-		CreatureVector* creatures = makeCreatures();
+		TileCreatureVector* creatures = makeCreatures();
 		creatures->insert(creatures->begin(), creature);
 	} else {
 		Item* item = thing->getItem();
@@ -876,7 +947,7 @@ void Tile::addThing(int32_t, Thing* thing)
 		} else if (itemType.alwaysOnTop) {
 			if (itemType.isSplash() && items) {
 				//remove old splash if exists
-				for (ItemVector::const_iterator it = items->getBeginTopItem(), end = items->getEndTopItem(); it != end; ++it) {
+				for (TileItemVector::const_iterator it = items->getBeginTopItem(), end = items->getEndTopItem(); it != end; ++it) {
 					Item* oldSplash = *it;
 					if (!Item::items[oldSplash->getID()].isSplash()) {
 						continue;
@@ -895,7 +966,7 @@ void Tile::addThing(int32_t, Thing* thing)
 			if (items) {
 				for (auto it = items->getBeginTopItem(), end = items->getEndTopItem(); it != end; ++it) {
 					//Note: this is different from internalAddThing
-					if (itemType.alwaysOnTopOrder <= Item::items[(*it)->getID()].alwaysOnTopOrder) {
+					if (itemType.alwaysOnTopOrder <= Item::items.getHotType((*it)->getID()).alwaysOnTopOrder) {
 						items->insert(it, item);
 						isInserted = true;
 						break;
@@ -914,7 +985,7 @@ void Tile::addThing(int32_t, Thing* thing)
 			if (itemType.isMagicField()) {
 				//remove old field item if exists
 				if (items) {
-					for (ItemVector::const_iterator it = items->getBeginDownItem(), end = items->getEndDownItem(); it != end; ++it) {
+					for (TileItemVector::const_iterator it = items->getBeginDownItem(), end = items->getEndDownItem(); it != end; ++it) {
 						MagicField* oldField = (*it)->getMagicField();
 						if (oldField) {
 							if (oldField->isReplaceable()) {
@@ -1002,7 +1073,7 @@ void Tile::replaceThing(uint32_t index, Thing* thing)
 		pos -= topItemSize;
 	}
 
-	CreatureVector* creatures = getCreatures();
+	TileCreatureVector* creatures = getCreatures();
 	if (creatures) {
 		if (!isInserted && pos < static_cast<int32_t>(creatures->size())) {
 			return /*RETURNVALUE_NOTPOSSIBLE*/;
@@ -1040,14 +1111,12 @@ void Tile::removeThing(Thing* thing, uint32_t count)
 {
 	Creature* creature = thing->getCreature();
 	if (creature) {
-		CreatureVector* creatures = getCreatures();
+		TileCreatureVector* creatures = getCreatures();
 		if (creatures) {
 			auto it = std::find(creatures->begin(), creatures->end(), thing);
 			if (it != creatures->end()) {
-				g_game.map.clearSpectatorCache();
-				if (creature->getPlayer()) {
-					g_game.map.clearPlayersSpectatorCache();
-				}
+				g_game.map.invalidateSpectatorCache(getPosition(), creature->getPlayer() != nullptr);
+				g_game.map.invalidatePathCache(getPosition());
 
 				creatures->erase(it);
 			}
@@ -1160,7 +1229,7 @@ int32_t Tile::getThingIndex(const Thing* thing) const
 		}
 	}
 
-	if (const CreatureVector* creatures = getCreatures()) {
+	if (const TileCreatureVector* creatures = getCreatures()) {
 		if (thing->getCreature()) {
 			for (Creature* creature : *creatures) {
 				++n;
@@ -1201,7 +1270,7 @@ int32_t Tile::getClientIndexOfCreature(const Player* player, const Creature* cre
 		n += items->getTopItemCount();
 	}
 
-	if (const CreatureVector* creatures = getCreatures()) {
+	if (const TileCreatureVector* creatures = getCreatures()) {
 		for (const Creature* c : boost::adaptors::reverse(*creatures)) {
 			if (c == creature) {
 				return n;
@@ -1241,7 +1310,7 @@ int32_t Tile::getStackposOfItem(const Player* player, const Item* item) const
 		}
 	}
 
-	if (const CreatureVector* creatures = getCreatures()) {
+	if (const TileCreatureVector* creatures = getCreatures()) {
 		for (const Creature* creature : *creatures) {
 			if (player->canSeeCreature(creature)) {
 				if (++n >= 10) {
@@ -1310,7 +1379,7 @@ Thing* Tile::getThing(size_t index) const
 		index -= topItemSize;
 	}
 
-	if (const CreatureVector* creatures = getCreatures()) {
+	if (const TileCreatureVector* creatures = getCreatures()) {
 		if (index < creatures->size()) {
 			return (*creatures)[index];
 		}
@@ -1414,12 +1483,10 @@ void Tile::internalAddThing(uint32_t, Thing* thing)
 
 	Creature* creature = thing->getCreature();
 	if (creature) {
-		g_game.map.clearSpectatorCache();
-		if (creature->getPlayer()) {
-			g_game.map.clearPlayersSpectatorCache();
-		}
+		g_game.map.invalidateSpectatorCache(getPosition(), creature->getPlayer() != nullptr);
+		g_game.map.invalidatePathCache(getPosition());
 
-		CreatureVector* creatures = makeCreatures();
+		TileCreatureVector* creatures = makeCreatures();
 		creatures->insert(creatures->begin(), creature);
 	} else {
 		Item* item = thing->getItem();
@@ -1427,6 +1494,8 @@ void Tile::internalAddThing(uint32_t, Thing* thing)
 			return;
 		}
 
+		invalidateDescription();
+
 		const ItemType& itemType = Item::items[item->getID()];
 		if (itemType.isGroundTile()) {
 			if (ground == nullptr) {
@@ -1444,7 +1513,7 @@ void Tile::internalAddThing(uint32_t, Thing* thing)
 		if (itemType.alwaysOnTop) {
 			bool isInserted = false;
 			for (auto it = items->getBeginTopItem(), end = items->getEndTopItem(); it != end; ++it) {
-				if (Item::items[(*it)->getID()].alwaysOnTopOrder > itemType.alwaysOnTopOrder) {
+				if (Item::items.getHotType((*it)->getID()).alwaysOnTopOrder > itemType.alwaysOnTopOrder) {
 					items->insert(it, item);
 					isInserted = true;
 					break;
@@ -1465,8 +1534,10 @@ void Tile::internalAddThing(uint32_t, Thing* thing)
 
 void Tile::setTileFlags(const Item* item)
 {
+	uint32_t oldFlags = flags;
+
 	if (!hasFlag(TILESTATE_FLOORCHANGE)) {
-		const ItemType& it = Item::items[item->getID()];
+		const ItemHotType& it = Item::items.getHotType(item->getID());
 		if (it.floorChange != 0) {
 			setFlag(it.floorChange);
 		}
@@ -1480,6 +1551,14 @@ void Tile::setTileFlags(const Item* item)
 		setFlag(TILESTATE_BLOCKPATH);
 	}
 
+	if (item->hasProperty(CONST_PROP_IMMOVABLEBLOCKPATH)) {
+		setFlag(TILESTATE_IMMOVABLEBLOCKPATH);
+	}
+
+	if (item->hasProperty(CONST_PROP_BLOCKPROJECTILE)) {
+		setFlag(TILESTATE_BLOCKPROJECTILE);
+	}
+
 	if (item->hasProperty(CONST_PROP_NOFIELDBLOCKPATH)) {
 		setFlag(TILESTATE_NOFIELDBLOCKPATH);
 	}
@@ -1520,12 +1599,17 @@ void Tile::setTileFlags(const Item* item)
 	if (item->hasProperty(CONST_PROP_SUPPORTHANGABLE)) {
 		setFlag(TILESTATE_SUPPORTS_HANGABLE);
 	}
+
+	if (isPathingItem(item, oldFlags)) {
+		g_game.map.invalidatePathCache(getPosition());
+	}
 }
 
 void Tile::resetTileFlags(const Item* item)
 {
-	const ItemType& it = Item::items[item->getID()];
-	if (it.floorChange != 0) {
+	uint32_t oldFlags = flags;
+
+	if (Item::items.getHotType(item->getID()).floorChange != 0) {
 		resetFlag(TILESTATE_FLOORCHANGE);
 	}
 
@@ -1553,6 +1637,10 @@ void Tile::resetTileFlags(const Item* item)
 		resetFlag(TILESTATE_IMMOVABLENOFIELDBLOCKPATH);
 	}
 
+	if (item->hasProperty(CONST_PROP_BLOCKPROJECTILE) && !hasProperty(item, CONST_PROP_BLOCKPROJECTILE)) {
+		resetFlag(TILESTATE_BLOCKPROJECTILE);
+	}
+
 	if (item->getTeleport()) {
 		resetFlag(TILESTATE_TELEPORT);
 	}
@@ -1581,6 +1669,16 @@ void Tile::resetTileFlags(const Item* item)
 	if (item->hasProperty(CONST_PROP_SUPPORTHANGABLE)) {
 		resetFlag(TILESTATE_SUPPORTS_HANGABLE);
 	}
+
+	if (isPathingItem(item, oldFlags)) {
+		g_game.map.invalidatePathCache(getPosition());
+	}
+}
+
+bool Tile::isPathingItem(const Item* item, uint32_t oldFlags) const
+{
+	// walkability, walk costs and sight lines of path searches
+	return flags != oldFlags || item->isGroundTile() || item->getMagicField() || item->hasProperty(CONST_PROP_BLOCKPROJECTILE);
 }
 
 bool Tile::isMoveableBlocking() const
@@ -9,6 +9,8 @@
 #include "tools.h"
 #include "spectators.h"
 
+#include <boost/container/small_vector.hpp>
+
 class Creature;
 class Teleport;
 class TrashHolder;
@@ -20,6 +22,10 @@ class BedItem;
 using CreatureVector = std::vector<Creature*>;
 using ItemVector = std::vector<Item*>;
 
+// most tiles hold a few items and at most one creature, those stay inline
+using TileCreatureVector = boost::container::small_vector<Creature*, 2>;
+using TileItemStorage = boost::container::small_vector<Item*, 4>;
+
 enum tileflags_t : uint32_t {
 	TILESTATE_NONE = 0,
 
@@ -47,6 +53,7 @@ enum tileflags_t : uint32_t {
 	TILESTATE_IMMOVABLENOFIELDBLOCKPATH = 1 << 21,
 	TILESTATE_NOFIELDBLOCKPATH = 1 << 22,
 	TILESTATE_SUPPORTS_HANGABLE = 1 << 23,
+	TILESTATE_BLOCKPROJECTILE = 1 << 24,
 
 	TILESTATE_FLOORCHANGE = TILESTATE_FLOORCHANGE_DOWN | TILESTATE_FLOORCHANGE_NORTH | TILESTATE_FLOORCHANGE_SOUTH | TILESTATE_FLOORCHANGE_EAST | TILESTATE_FLOORCHANGE_WEST | TILESTATE_FLOORCHANGE_SOUTH_ALT | TILESTATE_FLOORCHANGE_EAST_ALT,
 };
@@ -59,25 +66,25 @@ enum ZoneType_t {
 	ZONE_NORMAL,
 };
 
-class TileItemVector : private ItemVector
+class TileItemVector : private TileItemStorage
 {
 	public:
-		using ItemVector::begin;
-		using ItemVector::end;
-		using ItemVector::rbegin;
-		using ItemVector::rend;
-		using ItemVector::size;
-		using ItemVector::clear;
-		using ItemVector::at;
-		using ItemVector::insert;
-		using ItemVector::erase;
-		using ItemVector::push_back;
-		using ItemVector::value_type;
-		using ItemVector::iterator;
-		using ItemVector::const_iterator;
-		using ItemVector::reverse_iterator;
-		using ItemVector::const_reverse_iterator;
-		using ItemVector::empty;
+		using TileItemStorage::begin;
+		using TileItemStorage::end;
+		using TileItemStorage::rbegin;
+		using TileItemStorage::rend;
+		using TileItemStorage::size;
+		using TileItemStorage::clear;
+		using TileItemStorage::at;
+		using TileItemStorage::insert;
+		using TileItemStorage::erase;
+		using TileItemStorage::push_back;
+		using TileItemStorage::value_type;
+		using TileItemStorage::iterator;
+		using TileItemStorage::const_iterator;
+		using TileItemStorage::reverse_iterator;
+		using TileItemStorage::const_reverse_iterator;
+		using TileItemStorage::empty;
 
 		iterator getBeginDownItem() {
 			return begin();
@@ -130,15 +137,30 @@ class TileItemVector : private ItemVector
 		uint16_t downItemCount = 0;
 };
 
+// ground and item bytes of a tile as sent to clients, the creatures seen by
+// each viewer are written between the top and the down items
+struct TileDescription
+{
+	std::vector<uint8_t> bytes;
+	uint16_t headLength = 0; // environment, ground and top items
+	uint8_t headCount = 0;
+	uint8_t downCount = 0;
+	std::array<uint16_t, 10> downEnds; // end offset of each down item
+};
+
 class Tile : public Cylinder
 {
 	public:
 		static Tile& nullptr_tile;
 		Tile(uint16_t x, uint16_t y, uint8_t z) : tilePos(x, y, z) {}
 		virtual ~Tile() {
+			invalidateDescription();
 			delete ground;
 		};
 
+		static void* operator new(size_t size);
+		static void operator delete(void* p, size_t size);
+
 		// non-copyable
 		Tile(const Tile&) = delete;
 		Tile& operator=(const Tile&) = delete;
@@ -147,9 +169,9 @@ class Tile : public Cylinder
 		virtual const TileItemVector* getItemList() const = 0;
 		virtual TileItemVector* makeItemList() = 0;
 
-		virtual CreatureVector* getCreatures() = 0;
-		virtual const CreatureVector* getCreatures() const = 0;
-		virtual CreatureVector* makeCreatures() = 0;
+		virtual TileCreatureVector* getCreatures() = 0;
+		virtual const TileCreatureVector* getCreatures() const = 0;
+		virtual TileCreatureVector* makeCreatures() = 0;
 
 		int32_t getThrowRange() const override final {
 			return 0;
@@ -263,10 +285,22 @@ class Tile : public Cylinder
 			return ground;
 		}
 		void setGround(Item* item) {
+			invalidateDescription();
 			ground = item;
 		}
 
+		// dropped by every change of the ground or the items
+		const TileDescription* getCachedDescription() const;
+		const TileDescription& cacheDescription(TileDescription&& description) const;
+
 	private:
+		void invalidateDescription() {
+			if (descriptionCached) {
+				dropCachedDescription();
+			}
+		}
+		void dropCachedDescription();
+
 		void onAddTileItem(Item* item);
 		void onUpdateTileItem(Item* oldItem, const ItemType& oldType, Item* newItem, const ItemType& newType);
 		void onRemoveTileItem(const SpectatorVec& spectators, const std::vector<int32_t>& oldStackPosVector, Item* item);
@@ -274,10 +308,12 @@ class Tile : public Cylinder
 
 		void setTileFlags(const Item* item);
 		void resetTileFlags(const Item* item);
+		bool isPathingItem(const Item* item, uint32_t oldFlags) const;
 
 		Item* ground = nullptr;
 		Position tilePos;
 		uint32_t flags = 0;
+		mutable bool descriptionCached = false;
 };
 
 // Used for walkable tiles, where there is high likeliness of
@@ -286,7 +322,7 @@ class DynamicTile : public Tile
 {
 		// By allocating the vectors in-house, we avoid some memory fragmentation
 		TileItemVector items;
-		CreatureVector creatures;
+		TileCreatureVector creatures;
 
 	public:
 		DynamicTile(uint16_t x, uint16_t y, uint8_t z) : Tile(x, y, z) {}
@@ -310,13 +346,13 @@ class DynamicTile : public Tile
 			return &items;
 		}
 
-		CreatureVector* getCreatures() override {
+		TileCreatureVector* getCreatures() override {
 			return &creatures;
 		}
-		const CreatureVector* getCreatures() const override {
+		const TileCreatureVector* getCreatures() const override {
 			return &creatures;
 		}
-		CreatureVector* makeCreatures() override {
+		TileCreatureVector* makeCreatures() override {
 			return &creatures;
 		}
 };
@@ -326,7 +362,7 @@ class StaticTile final : public Tile
 {
 	// We very rarely even need the vectors, so don't keep them in memory
 	std::unique_ptr<TileItemVector> items;
-	std::unique_ptr<CreatureVector> creatures;
+	std::unique_ptr<TileCreatureVector> creatures;
 
 	public:
 		StaticTile(uint16_t x, uint16_t y, uint8_t z) : Tile(x, y, z) {}
@@ -355,15 +391,15 @@ class StaticTile final : public Tile
 			return items.get();
 		}
 
-		CreatureVector* getCreatures() override {
+		TileCreatureVector* getCreatures() override {
 			return creatures.get();
 		}
-		const CreatureVector* getCreatures() const override {
+		const TileCreatureVector* getCreatures() const override {
 			return creatures.get();
 		}
-		CreatureVector* makeCreatures() override {
+		TileCreatureVector* makeCreatures() override {
 			if (!creatures) {
-				creatures.reset(new CreatureVector);
+				creatures.reset(new TileCreatureVector);
 			}
 			return creatures.get();
 		}
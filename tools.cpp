@@ -3,6 +3,8 @@
 
 #include "otpch.h"
 
+#include <atomic>
+
 #include "tools.h"
 #include "configmanager.h"
 
@@ -278,27 +280,111 @@ IntegerVector vectorAtoi(const StringVector& stringVector)
 	return returnVector;
 }
 
-std::mt19937& getRandomGenerator()
+namespace {
+
+// 0 seeds every stream from std::random_device
+std::atomic<uint64_t> randomSeed{0};
+std::atomic<uint64_t> randomStreams{0};
+
+uint64_t splitMix64(uint64_t& x)
+{
+	uint64_t z = (x += 0x9E3779B97F4A7C15);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+	return z ^ (z >> 31);
+}
+
+uint64_t nextStreamSeed()
 {
-	static std::random_device rd;
-	static std::mt19937 generator(rd());
+	const uint64_t stream = randomStreams.fetch_add(1, std::memory_order_relaxed);
+	uint64_t seed = randomSeed.load(std::memory_order_relaxed);
+	if (seed == 0) {
+		std::random_device rd;
+		return (static_cast<uint64_t>(rd()) << 32) | rd();
+	}
+
+	seed += stream * 0xD1B54A32D192ED03;
+	return splitMix64(seed);
+}
+
+// Lemire's nearly divisionless method, returns [0, range)
+uint32_t boundedRandom(RandomGenerator& generator, uint32_t range)
+{
+	uint64_t m = (generator() >> 32) * range;
+	uint32_t low = static_cast<uint32_t>(m);
+	if (low < range) {
+		const uint32_t threshold = -range % range;
+		while (low < threshold) {
+			m = (generator() >> 32) * range;
+			low = static_cast<uint32_t>(m);
+		}
+	}
+	return static_cast<uint32_t>(m >> 32);
+}
+
+}
+
+void RandomGenerator::seed(uint64_t seed)
+{
+	for (uint64_t& s : state) {
+		s = splitMix64(seed);
+	}
+}
+
+RandomGenerator& getRandomGenerator()
+{
+	thread_local RandomGenerator generator(nextStreamSeed());
 	return generator;
 }
 
+void seedRandomGenerator(uint64_t seed)
+{
+	// threads started afterwards derive their stream from the same seed, in start order
+	RandomGenerator& generator = getRandomGenerator();
+	randomSeed = seed;
+	randomStreams = 0;
+	generator.seed(nextStreamSeed());
+}
+
 int32_t uniform_random(int32_t minNumber, int32_t maxNumber)
 {
-	static std::uniform_int_distribution<int32_t> uniformRand;
 	if (minNumber == maxNumber) {
 		return minNumber;
 	} else if (minNumber > maxNumber) {
 		std::swap(minNumber, maxNumber);
 	}
-	return uniformRand(getRandomGenerator(), std::uniform_int_distribution<int32_t>::param_type(minNumber, maxNumber));
+
+	const uint64_t range = static_cast<int64_t>(maxNumber) - minNumber + 1;
+	if (range > std::numeric_limits<uint32_t>::max()) {
+		return static_cast<int32_t>(getRandomGenerator()() >> 32);
+	}
+	return static_cast<int32_t>(minNumber + static_cast<int64_t>(boundedRandom(getRandomGenerator(), range)));
+}
+
+void fill_uniform_random(int32_t* numbers, size_t count, int32_t minNumber, int32_t maxNumber)
+{
+	if (minNumber > maxNumber) {
+		std::swap(minNumber, maxNumber);
+	}
+
+	const uint64_t range = static_cast<int64_t>(maxNumber) - minNumber + 1;
+	RandomGenerator& generator = getRandomGenerator();
+	if (range == 1) {
+		std::fill(numbers, numbers + count, minNumber);
+	} else if (range > std::numeric_limits<uint32_t>::max()) {
+		for (size_t i = 0; i < count; ++i) {
+			numbers[i] = static_cast<int32_t>(generator() >> 32);
+		}
+	} else {
+		for (size_t i = 0; i < count; ++i) {
+			numbers[i] = static_cast<int32_t>(minNumber + static_cast<int64_t>(boundedRandom(generator, range)));
+		}
+	}
 }
 
 int32_t normal_random(int32_t minNumber, int32_t maxNumber)
 {
-	static std::normal_distribution<float> normalRand(0.5f, 0.25f);
+	thread_local std::normal_distribution<float> normalRand(0.5f, 0.25f);
 	if (minNumber == maxNumber) {
 		return minNumber;
 	} else if (minNumber > maxNumber) {
@@ -320,8 +406,8 @@ int32_t normal_random(int32_t minNumber, int32_t maxNumber)
 
 bool boolean_random(double probability/* = 0.5*/)
 {
-	static std::bernoulli_distribution booleanRand;
-	return booleanRand(getRandomGenerator(), std::bernoulli_distribution::param_type(probability));
+	// top 53 bits as a double in [0, 1)
+	return (getRandomGenerator()() >> 11) * (1.0 / 9007199254740992.0) < probability;
 }
 
 void trimString(std::string& str)
@@ -1270,8 +1356,22 @@ const char* getReturnMessage(ReturnValue value)
 	}
 }
 
+namespace {
+
+std::atomic<int64_t> virtualTime{0};
+
+}
+
+void setVirtualTime(int64_t ms)
+{
+	virtualTime.store(ms, std::memory_order_relaxed);
+}
+
 int64_t OTSYS_TIME()
 {
+	if (int64_t ms = virtualTime.load(std::memory_order_relaxed)) {
+		return ms;
+	}
 	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
 }
 
@@ -5,6 +5,7 @@
 #define FS_TOOLS_H_5F9A9742DA194628830AA1C64909AE43
 
 #include <random>
+#include <string_view>
 
 #include "position.h"
 #include "const.h"
@@ -25,14 +26,75 @@ std::string asUpperCaseString(std::string source);
 using StringVector = std::vector<std::string>;
 using IntegerVector = std::vector<int32_t>;
 
+// hashes and compares ASCII names without building lowercase copies
+struct CaseInsensitiveHash {
+	std::size_t operator()(std::string_view str) const {
+		std::size_t hash = 14695981039346656037ULL;
+		for (char c : str) {
+			hash = (hash ^ static_cast<uint8_t>(std::tolower(static_cast<unsigned char>(c)))) * 1099511628211ULL;
+		}
+		return hash;
+	}
+};
+
+struct CaseInsensitiveEqual {
+	bool operator()(std::string_view lhs, std::string_view rhs) const {
+		return lhs.size() == rhs.size() && std::equal(lhs.begin(), lhs.end(), rhs.begin(), [](char a, char b) {
+			return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
+		});
+	}
+};
+
 StringVector explodeString(const std::string& inString, const std::string& separator, int32_t limit = -1);
 IntegerVector vectorAtoi(const StringVector& stringVector);
 constexpr bool hasBitSet(uint32_t flag, uint32_t flags) {
 	return (flags & flag) != 0;
 }
 
-std::mt19937& getRandomGenerator();
+// xoshiro256**, every thread draws from its own stream
+class RandomGenerator
+{
+	public:
+		using result_type = uint64_t;
+
+		explicit RandomGenerator(uint64_t seed) {
+			this->seed(seed);
+		}
+
+		void seed(uint64_t seed);
+
+		static constexpr result_type min() {
+			return std::numeric_limits<result_type>::min();
+		}
+		static constexpr result_type max() {
+			return std::numeric_limits<result_type>::max();
+		}
+
+		result_type operator()() {
+			const uint64_t result = rotl(state[1] * 5, 7) * 9;
+			const uint64_t t = state[1] << 17;
+
+			state[2] ^= state[0];
+			state[3] ^= state[1];
+			state[1] ^= state[2];
+			state[0] ^= state[3];
+			state[2] ^= t;
+			state[3] = rotl(state[3], 45);
+			return result;
+		}
+
+	private:
+		static constexpr uint64_t rotl(uint64_t x, int k) {
+			return (x << k) | (x >> (64 - k));
+		}
+
+		uint64_t state[4];
+};
+
+RandomGenerator& getRandomGenerator();
+void seedRandomGenerator(uint64_t seed);
 int32_t uniform_random(int32_t minNumber, int32_t maxNumber);
+void fill_uniform_random(int32_t* numbers, size_t count, int32_t minNumber, int32_t maxNumber);
 int32_t normal_random(int32_t minNumber, int32_t maxNumber);
 bool boolean_random(double probability = 0.5);
 
@@ -77,6 +139,8 @@ itemAttrTypes stringToItemAttribute(const std::string& str);
 const char* getReturnMessage(ReturnValue value);
 
 int64_t OTSYS_TIME();
+// simulation, while non zero OTSYS_TIME returns this instead of the clock
+void setVirtualTime(int64_t ms);
 
 SpellGroup_t stringToSpellGroup(const std::string& value);
 
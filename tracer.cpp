@@ -0,0 +1,73 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#include "otpch.h"
+
+#include "tracer.h"
+
+#include <fstream>
+#include <fmt/format.h>
+
+Tracer g_tracer;
+
+Tracer::Ring& Tracer::getLocalRing()
+{
+	thread_local Ring* ring = nullptr;
+	if (!ring) {
+		std::lock_guard<std::mutex> lockClass(ringsLock);
+		rings.emplace_back(new Ring());
+		ring = rings.back().get();
+		ring->thread = static_cast<uint32_t>(rings.size());
+	}
+	return *ring;
+}
+
+void Tracer::addSpan(const char* name, int64_t start, int64_t end)
+{
+	Ring& ring = getLocalRing();
+
+	// only contended while a dump copies the ring
+	std::lock_guard<std::mutex> lockClass(ring.lock);
+	if (ring.spans.size() < RING_SIZE) {
+		ring.spans.push_back({name, start, end - start});
+		return;
+	}
+
+	ring.spans[ring.next] = {name, start, end - start};
+	ring.next = (ring.next + 1) % RING_SIZE;
+}
+
+bool Tracer::dump(const std::string& path, uint32_t window) const
+{
+	std::ofstream file(path, std::ios::out | std::ios::trunc);
+	if (!file.is_open()) {
+		std::cout << "[Error - Tracer::dump] Unable to open " << path << std::endl;
+		return false;
+	}
+
+	const int64_t since = now() - static_cast<int64_t>(window) * 1000;
+
+	std::vector<Span> spans;
+	file << "{\"traceEvents\":[";
+
+	bool first = true;
+	std::lock_guard<std::mutex> lockClass(ringsLock);
+	for (const auto& ring : rings) {
+		{
+			std::lock_guard<std::mutex> ringLockClass(ring->lock);
+			spans = ring->spans;
+		}
+
+		for (const Span& span : spans) {
+			if (span.start + span.duration < since) {
+				continue;
+			}
+
+			file << (first ? "" : ",") << fmt::format("\n{{\"name\":\"{:s}\",\"ph\":\"X\",\"ts\":{:d},\"dur\":{:d},\"pid\":1,\"tid\":{:d}}}", span.name, span.start, span.duration, ring->thread);
+			first = false;
+		}
+	}
+
+	file << "\n]}\n";
+	return true;
+}
@@ -0,0 +1,84 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#ifndef FS_TRACER_H_D0D3BDB7A09042B9AF41C0DC0D8DA716
+#define FS_TRACER_H_D0D3BDB7A09042B9AF41C0DC0D8DA716
+
+#include <atomic>
+
+// Opt-in timeline recording. Instrumented scopes append a span to a ring
+// buffer owned by the thread they run on, the oldest spans being overwritten
+// once it is full, and a window of the rings can be written out in the Chrome
+// trace event format (chrome://tracing, ui.perfetto.dev). While disabled a
+// span costs a single relaxed load.
+class Tracer
+{
+	public:
+		// spans kept per thread
+		static constexpr size_t RING_SIZE = 1 << 16;
+
+		bool isEnabled() const {
+			return enabled.load(std::memory_order_relaxed);
+		}
+		void setEnabled(bool value) {
+			enabled.store(value, std::memory_order_relaxed);
+		}
+
+		static int64_t now() {
+			return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+
+		// name must outlive the recording, spans only keep the pointer
+		void addSpan(const char* name, int64_t start, int64_t end);
+
+		// writes the spans that ended within the last window milliseconds
+		bool dump(const std::string& path, uint32_t window) const;
+
+	private:
+		struct Span {
+			const char* name;
+			int64_t start;
+			int64_t duration;
+		};
+
+		struct Ring {
+			std::mutex lock;
+			std::vector<Span> spans;
+			size_t next = 0;
+			uint32_t thread = 0;
+		};
+
+		Ring& getLocalRing();
+
+		std::atomic<bool> enabled{false};
+
+		mutable std::mutex ringsLock;
+		std::vector<std::unique_ptr<Ring>> rings;
+};
+
+extern Tracer g_tracer;
+
+class TraceSpan
+{
+	public:
+		explicit TraceSpan(const char* name) : name(g_tracer.isEnabled() ? name : nullptr) {
+			if (this->name) {
+				start = Tracer::now();
+			}
+		}
+		~TraceSpan() {
+			if (name) {
+				g_tracer.addSpan(name, start, Tracer::now());
+			}
+		}
+
+		// non-copyable
+		TraceSpan(const TraceSpan&) = delete;
+		TraceSpan& operator=(const TraceSpan&) = delete;
+
+	private:
+		const char* name;
+		int64_t start = 0;
+};
+
+#endif
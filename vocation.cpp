@@ -26,9 +26,14 @@ bool Vocations::loadFromXml()
 		}
 
 		uint16_t id = pugi::cast<uint16_t>(attr.value());
-		auto res = vocationsMap.emplace(std::piecewise_construct,
-				std::forward_as_tuple(id), std::forward_as_tuple(id));
-		Vocation& voc = res.first->second;
+		if (id >= vocations.size()) {
+			vocations.resize(id + 1);
+		}
+
+		if (!vocations[id]) {
+			vocations[id].reset(new Vocation(id));
+		}
+		Vocation& voc = *vocations[id];
 
 		vocationNode.remove_attribute("id");
 		for (auto attrNode : vocationNode.attributes()) {
@@ -104,52 +109,67 @@ bool Vocations::loadFromXml()
 				}
 			}
 		}
+
+		voc.updateRequirements();
 	}
 	return true;
 }
 
 Vocation* Vocations::getVocation(uint16_t id)
 {
-	auto it = vocationsMap.find(id);
-	if (it == vocationsMap.end()) {
+	if (id >= vocations.size() || !vocations[id]) {
 		std::cout << "[Warning - Vocations::getVocation] Vocation " << id << " not found." << std::endl;
 		return nullptr;
 	}
-	return &it->second;
+	return vocations[id].get();
 }
 
 int32_t Vocations::getVocationId(const std::string& name) const
 {
-	auto it = std::find_if(vocationsMap.begin(), vocationsMap.end(), [&name](auto it) {
-		return name.size() == it.second.name.size() && std::equal(name.begin(), name.end(), it.second.name.begin(), [](char a, char b) {
+	for (const auto& vocation : vocations) {
+		if (vocation && name.size() == vocation->name.size() && std::equal(name.begin(), name.end(), vocation->name.begin(), [](char a, char b) {
 			return std::tolower(a) == std::tolower(b);
-		});
-	});
-	return it != vocationsMap.end() ? it->first : -1;
+		})) {
+			return vocation->id;
+		}
+	}
+	return -1;
 }
 
 uint16_t Vocations::getPromotedVocation(uint16_t id) const
 {
-	auto it = std::find_if(vocationsMap.begin(), vocationsMap.end(), [id](auto it) {
-		return it.second.fromVocation == id && it.first != id;
-	});
-	return it != vocationsMap.end() ? it->first : VOCATION_NONE;
+	for (const auto& vocation : vocations) {
+		if (vocation && vocation->fromVocation == id && vocation->id != id) {
+			return vocation->id;
+		}
+	}
+	return VOCATION_NONE;
 }
 
 static const uint32_t skillBase[SKILL_LAST + 1] = {50, 50, 50, 50, 30, 100, 20, 20, 20, 20, 20, 20, 20, 20};
 
-uint64_t Vocation::getReqSkillTries(uint8_t skill, uint16_t level)
+uint64_t Vocation::computeReqSkillTries(uint8_t skill, uint16_t level) const
 {
-	if (skill > SKILL_LAST) {
-		return 0;
-	}
 	return skillBase[skill] * std::pow(skillMultipliers[skill], static_cast<int32_t>(level - (MINIMUM_SKILL_LEVEL + 1)));
 }
 
-uint64_t Vocation::getReqMana(uint32_t magLevel)
+uint64_t Vocation::computeReqMana(uint32_t magLevel) const
 {
 	if (magLevel == 0) {
 		return 0;
 	}
 	return 1600 * std::pow(manaMultiplier, static_cast<int32_t>(magLevel - 1));
 }
+
+void Vocation::updateRequirements()
+{
+	for (uint8_t skill = SKILL_FIRST; skill <= SKILL_LAST; ++skill) {
+		for (uint16_t level = 0; level < REQUIREMENT_LEVELS; ++level) {
+			reqSkillTries[skill][level] = computeReqSkillTries(skill, level);
+		}
+	}
+
+	for (uint16_t magLevel = 0; magLevel < REQUIREMENT_LEVELS; ++magLevel) {
+		reqMana[magLevel] = computeReqMana(magLevel);
+	}
+}
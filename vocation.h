@@ -7,6 +7,8 @@
 #include "enums.h"
 #include "item.h"
 
+#include <array>
+
 class Vocation
 {
 	public:
@@ -18,8 +20,15 @@ class Vocation
 		const std::string& getVocDescription() const {
 			return description;
 		}
-		uint64_t getReqSkillTries(uint8_t skill, uint16_t level);
-		uint64_t getReqMana(uint32_t magLevel);
+		uint64_t getReqSkillTries(uint8_t skill, uint16_t level) const {
+			if (skill > SKILL_LAST) {
+				return 0;
+			}
+			return level < REQUIREMENT_LEVELS ? reqSkillTries[skill][level] : computeReqSkillTries(skill, level);
+		}
+		uint64_t getReqMana(uint32_t magLevel) const {
+			return magLevel < REQUIREMENT_LEVELS ? reqMana[magLevel] : computeReqMana(magLevel);
+		}
 
 		uint16_t getId() const {
 			return id;
@@ -86,6 +95,16 @@ class Vocation
 	private:
 		friend class Vocations;
 
+		// levels whose requirements are tabled at load, higher ones are computed
+		static constexpr uint16_t REQUIREMENT_LEVELS = 256;
+
+		uint64_t computeReqSkillTries(uint8_t skill, uint16_t level) const;
+		uint64_t computeReqMana(uint32_t magLevel) const;
+		void updateRequirements();
+
+		std::array<std::array<uint64_t, REQUIREMENT_LEVELS>, SKILL_LAST + 1> reqSkillTries;
+		std::array<uint64_t, REQUIREMENT_LEVELS> reqMana;
+
 		std::string name = "none";
 		std::string description;
 
@@ -123,7 +142,8 @@ class Vocations
 		uint16_t getPromotedVocation(uint16_t vocationId) const;
 
 	private:
-		std::map<uint16_t, Vocation> vocationsMap;
+		// by id, a vocation keeps its address across reloads
+		std::vector<std::unique_ptr<Vocation>> vocations;
 };
 
 #endif
@@ -0,0 +1,208 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#include "otpch.h"
+
+#include "watchdog.h"
+#include "luascript.h"
+
+#include <fmt/format.h>
+
+#if defined(__linux__) && __has_include(<execinfo.h>)
+#include <execinfo.h>
+#include <pthread.h>
+#include <signal.h>
+#define WATCHDOG_NATIVE_STACK
+#endif
+
+Watchdog g_watchdog;
+
+namespace {
+
+#ifdef WATCHDOG_NATIVE_STACK
+constexpr int MAX_STACK_FRAMES = 64;
+constexpr int STACK_SIGNAL = SIGUSR2;
+
+pthread_t gameThread;
+void* stackFrames[MAX_STACK_FRAMES];
+std::atomic<int> stackFrameCount{-1};
+
+void stackSignalHandler(int)
+{
+	// libgcc has been loaded by the probe in start, so backtrace does not allocate here
+	stackFrameCount.store(backtrace(stackFrames, MAX_STACK_FRAMES), std::memory_order_release);
+}
+#endif
+
+}
+
+void Watchdog::start(uint32_t threshold)
+{
+	if (threshold == 0) {
+		return;
+	}
+
+	this->threshold = std::chrono::milliseconds(threshold);
+
+#ifdef WATCHDOG_NATIVE_STACK
+	gameThread = pthread_self();
+
+	void* probe;
+	backtrace(&probe, 1);
+
+	struct sigaction action = {};
+	action.sa_handler = stackSignalHandler;
+	action.sa_flags = SA_RESTART;
+	sigemptyset(&action.sa_mask);
+	sigaction(STACK_SIGNAL, &action, nullptr);
+#endif
+
+	ThreadHolder::start();
+}
+
+void Watchdog::shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lockClass(watchdogLock);
+		setState(THREAD_STATE_TERMINATED);
+	}
+	watchdogSignal.notify_one();
+	join();
+}
+
+void Watchdog::attach(lua_State* L)
+{
+	std::lock_guard<std::mutex> lockClass(stateLock);
+	if (state && luaHookArmed.exchange(false)) {
+		lua_sethook(state, previousHook, previousMask, previousCount);
+	}
+	state = L;
+}
+
+void Watchdog::threadMain()
+{
+	// a few checks per threshold keep the reporting delay well below it
+	const auto interval = std::max<std::chrono::milliseconds>(std::chrono::milliseconds(10), threshold / 4);
+
+	std::unique_lock<std::mutex> watchdogLockUnique(watchdogLock);
+	while (getState() == THREAD_STATE_RUNNING) {
+		watchdogSignal.wait_for(watchdogLockUnique, interval);
+		if (getState() != THREAD_STATE_RUNNING) {
+			break;
+		}
+
+		// every task is reported once, identified by its start time
+		int64_t start = taskStart.load(std::memory_order_acquire);
+		if (start == 0 || start == reportedStart) {
+			continue;
+		}
+
+		auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch() - std::chrono::steady_clock::duration(start));
+		if (elapsed < threshold) {
+			continue;
+		}
+
+		reportedStart = start;
+		report(start, elapsed);
+	}
+}
+
+void Watchdog::report(int64_t start, std::chrono::milliseconds elapsed)
+{
+	const char* origin = currentOrigin.load(std::memory_order_relaxed);
+	std::cout << "[Warning - Watchdog] Dispatcher task " << (origin ? origin : "(unknown)") << " has been running for " << elapsed.count() << " ms." << std::endl;
+
+	captureNativeStack(start);
+	armLuaHook(start);
+}
+
+void Watchdog::captureNativeStack(int64_t start)
+{
+#ifdef WATCHDOG_NATIVE_STACK
+	stackFrameCount.store(-1, std::memory_order_relaxed);
+	if (pthread_kill(gameThread, STACK_SIGNAL) != 0) {
+		return;
+	}
+
+	int frames = -1;
+	for (int i = 0; i < 100 && frames < 0; ++i) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		frames = stackFrameCount.load(std::memory_order_acquire);
+	}
+
+	if (frames <= 0) {
+		std::cout << "[Warning - Watchdog] The game thread did not answer the stack request." << std::endl;
+		return;
+	}
+
+	if (taskStart.load(std::memory_order_acquire) != start) {
+		std::cout << "[Warning - Watchdog] The task finished while its stack was taken, the frames may belong to the dispatcher loop." << std::endl;
+	}
+
+	char** symbols = backtrace_symbols(stackFrames, frames);
+	if (!symbols) {
+		return;
+	}
+
+	// the first frame is the signal handler itself
+	std::ostringstream ss;
+	ss << "[Warning - Watchdog] Game thread stack:" << std::endl;
+	for (int i = 1; i < frames; ++i) {
+		ss << "\t#" << (i - 1) << ' ' << symbols[i] << std::endl;
+	}
+	std::cout << ss.str() << std::flush;
+	free(symbols);
+#else
+	(void)start;
+#endif
+}
+
+void Watchdog::armLuaHook(int64_t start)
+{
+	std::lock_guard<std::mutex> lockClass(stateLock);
+	if (!state || luaHookArmed.load(std::memory_order_relaxed)) {
+		return;
+	}
+
+	hookedStart = start;
+
+	previousHook = lua_gethook(state);
+	previousMask = lua_gethookmask(state);
+	previousCount = lua_gethookcount(state);
+
+	// lua_sethook may be called from another thread, the hook itself runs on the game thread
+	luaHookArmed.store(true, std::memory_order_release);
+	lua_sethook(state, luaHook, LUA_MASKCOUNT, 1);
+
+	// the task may have ended before the hook was in place, leaveTask would have missed it
+	if (taskStart.load(std::memory_order_acquire) != start && luaHookArmed.exchange(false)) {
+		lua_sethook(state, previousHook, previousMask, previousCount);
+	}
+}
+
+void Watchdog::disarmLuaHook()
+{
+	std::lock_guard<std::mutex> lockClass(stateLock);
+	if (!luaHookArmed.exchange(false)) {
+		return;
+	}
+
+	if (state) {
+		lua_sethook(state, previousHook, previousMask, previousCount);
+	}
+}
+
+void Watchdog::luaHook(lua_State* L, lua_Debug*)
+{
+	if (!g_watchdog.luaHookArmed.load(std::memory_order_acquire)) {
+		return;
+	}
+	g_watchdog.disarmLuaHook();
+
+	if (g_watchdog.taskStart.load(std::memory_order_acquire) != g_watchdog.hookedStart) {
+		return;
+	}
+
+	const char* origin = g_watchdog.currentOrigin.load(std::memory_order_relaxed);
+	std::cout << LuaScriptInterface::getStackTrace(L, fmt::format("[Warning - Watchdog] Lua stack of the slow {:s} task:", origin ? origin : "(unknown)")) << std::endl;
+}
@@ -0,0 +1,75 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#ifndef FS_WATCHDOG_H_84B70484497F4747BB69FE11A2DB8E95
+#define FS_WATCHDOG_H_84B70484497F4747BB69FE11A2DB8E95
+
+#include "thread_holder_base.h"
+
+#include <condition_variable>
+
+#if __has_include("luajit/lua.hpp")
+#include <luajit/lua.hpp>
+#else
+#include <lua.hpp>
+#endif
+
+// Watches the dispatcher from its own thread and reports a task that runs for
+// longer than the threshold while it is still running: its origin tag, the
+// native stack of the game thread where supported and, when the task is
+// inside lua, the lua traceback taken by a one-shot hook on the next
+// instruction. The dispatcher only publishes two atomics per task.
+class Watchdog : public ThreadHolder<Watchdog>
+{
+	public:
+		// dispatcher thread, the threshold is in milliseconds
+		void start(uint32_t threshold);
+		void shutdown();
+
+		// dispatcher thread, brackets every executed task
+		void enterTask(const char* origin, std::chrono::steady_clock::time_point start) {
+			currentOrigin.store(origin, std::memory_order_relaxed);
+			taskStart.store(start.time_since_epoch().count(), std::memory_order_release);
+		}
+		void leaveTask() {
+			taskStart.store(0, std::memory_order_release);
+			if (luaHookArmed.load(std::memory_order_acquire)) {
+				disarmLuaHook();
+			}
+		}
+
+		// the state to take tracebacks from, nullptr before it is closed
+		void attach(lua_State* L);
+
+		void threadMain();
+
+	private:
+		void report(int64_t start, std::chrono::milliseconds elapsed);
+		void captureNativeStack(int64_t start);
+		void armLuaHook(int64_t start);
+		void disarmLuaHook();
+
+		static void luaHook(lua_State* L, lua_Debug* ar);
+
+		std::atomic<int64_t> taskStart{0};
+		std::atomic<const char*> currentOrigin{nullptr};
+		std::atomic<bool> luaHookArmed{false};
+
+		std::mutex watchdogLock;
+		std::condition_variable watchdogSignal;
+
+		// guards the state against being closed while a hook is installed on it
+		std::mutex stateLock;
+		lua_State* state = nullptr;
+		lua_Hook previousHook = nullptr;
+		int previousMask = 0;
+		int previousCount = 0;
+		int64_t hookedStart = 0;
+
+		std::chrono::milliseconds threshold{0};
+		int64_t reportedStart = 0;
+};
+
+extern Watchdog g_watchdog;
+
+#endif
@@ -30,20 +30,15 @@ const Weapon* Weapons::getWeapon(const Item* item) const
 		return nullptr;
 	}
 
-	auto it = weapons.find(item->getID());
-	if (it == weapons.end()) {
-		return nullptr;
-	}
-	return it->second;
+	uint16_t id = item->getID();
+	return id < weapons.size() ? weapons[id] : nullptr;
 }
 
 void Weapons::clear(bool fromLua)
 {
-	for (auto it = weapons.begin(); it != weapons.end(); ) {
-		if (fromLua == it->second->fromLua) {
-			it = weapons.erase(it);
-		} else {
-			++it;
+	for (Weapon*& weapon : weapons) {
+		if (weapon && fromLua == weapon->fromLua) {
+			weapon = nullptr;
 		}
 	}
 
@@ -62,9 +57,14 @@ std::string Weapons::getScriptBaseName() const
 
 void Weapons::loadDefaults()
 {
-	for (size_t i = 100, size = Item::items.size(); i < size; ++i) {
+	size_t size = Item::items.size();
+	if (weapons.size() < size) {
+		weapons.resize(size);
+	}
+
+	for (size_t i = 100; i < size; ++i) {
 		const ItemType& it = Item::items.getItemType(i);
-		if (it.id == 0 || weapons.find(i) != weapons.end()) {
+		if (it.id == 0 || weapons[i]) {
 			continue;
 		}
 
@@ -112,16 +112,26 @@ bool Weapons::registerEvent(Event_ptr event, const pugi::xml_node&)
 {
 	Weapon* weapon = static_cast<Weapon*>(event.release()); //event is guaranteed to be a Weapon
 
-	auto result = weapons.emplace(weapon->getID(), weapon);
-	if (!result.second) {
-		std::cout << "[Warning - Weapons::registerEvent] Duplicate registered item with id: " << weapon->getID() << std::endl;
+	uint16_t id = weapon->getID();
+	if (id >= weapons.size()) {
+		weapons.resize(id + 1);
+	} else if (weapons[id]) {
+		std::cout << "[Warning - Weapons::registerEvent] Duplicate registered item with id: " << id << std::endl;
+		return false;
 	}
-	return result.second;
+
+	weapons[id] = weapon;
+	return true;
 }
 
 bool Weapons::registerLuaEvent(Weapon* weapon)
 {
-	weapons[weapon->getID()] = weapon;
+	uint16_t id = weapon->getID();
+	if (id >= weapons.size()) {
+		weapons.resize(id + 1);
+	}
+
+	weapons[id] = weapon;
 	return true;
 }
 
@@ -197,10 +207,10 @@ bool Weapon::configureEvent(const pugi::xml_node& node)
 
 		int32_t vocationId = g_vocations.getVocationId(attr.as_string());
 		if (vocationId != -1) {
-			vocWeaponMap[vocationId] = true;
+			addWieldVocation(vocationId);
 			int32_t promotedVocation = g_vocations.getPromotedVocation(vocationId);
 			if (promotedVocation != VOCATION_NONE) {
-				vocWeaponMap[promotedVocation] = true;
+				addWieldVocation(promotedVocation);
 			}
 
 			if (vocationNode.attribute("showInDescription").as_bool(true)) {
@@ -296,8 +306,9 @@ int32_t Weapon::playerWeaponCheck(Player* player, Creature* target, uint8_t shoo
 			return 0;
 		}
 
-		if (!vocWeaponMap.empty()) {
-			if (vocWeaponMap.find(player->getVocationId()) == vocWeaponMap.end()) {
+		if (!wieldVocations.empty()) {
+			uint16_t vocationId = player->getVocationId();
+			if (vocationId >= wieldVocations.size() || !wieldVocations[vocationId]) {
 				return 0;
 			}
 		}
@@ -493,8 +504,7 @@ bool Weapon::executeUseWeapon(Player* player, const LuaVariant& var) const
 	lua_State* L = scriptInterface->getLuaState();
 
 	scriptInterface->pushFunction(scriptId);
-	LuaScriptInterface::pushUserdata<Player>(L, player);
-	LuaScriptInterface::setMetatable(L, -1, "Player");
+	LuaScriptInterface::pushCreature(L, player);
 	scriptInterface->pushVariant(L, var);
 
 	return scriptInterface->callFunction(2);
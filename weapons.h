@@ -45,7 +45,8 @@ class Weapons final : public BaseEvents
 		Event_ptr getEvent(const std::string& nodeName) override;
 		bool registerEvent(Event_ptr event, const pugi::xml_node& node) override;
 
-		std::map<uint32_t, Weapon*> weapons;
+		// indexed by item id, nullptr for items that are no weapon
+		std::vector<Weapon*> weapons;
 
 		LuaScriptInterface scriptInterface { "Weapon Interface" };
 };
@@ -166,7 +167,7 @@ class Weapon : public Event
 		void addVocWeaponMap(std::string vocName) {
 			int32_t vocationId = g_vocations.getVocationId(vocName);
 			if (vocationId != -1) {
-				vocWeaponMap[vocationId] = true;
+				addWieldVocation(vocationId);
 			}
 		}
 
@@ -180,9 +181,18 @@ class Weapon : public Event
 		WeaponAction_t action = WEAPONACTION_NONE;
 		CombatParams params;
 		WeaponType_t weaponType;
-		std::map<uint16_t, bool> vocWeaponMap;
 
 	protected:
+		void addWieldVocation(uint16_t vocationId) {
+			if (vocationId >= wieldVocations.size()) {
+				wieldVocations.resize(vocationId + 1);
+			}
+			wieldVocations[vocationId] = true;
+		}
+
+		// indexed by vocation id, empty when every vocation may wield it
+		std::vector<bool> wieldVocations;
+
 		void internalUseWeapon(Player* player, Item* item, Creature* target, int32_t damageModifier) const;
 		void internalUseWeapon(Player* player, Item* item, Tile* tile) const;
 
@@ -3,95 +3,126 @@
 
 #include "otpch.h"
 
-#include <stack>
-
 #include "wildcardtree.h"
 
-WildcardTreeNode* WildcardTreeNode::getChild(char ch)
+WildcardTree::WildcardTree()
 {
-	auto it = children.find(ch);
-	if (it == children.end()) {
-		return nullptr;
-	}
-	return &it->second;
+	nodes.emplace_back();
 }
 
-const WildcardTreeNode* WildcardTreeNode::getChild(char ch) const
+uint32_t WildcardTree::getChild(uint32_t parent, char ch) const
 {
-	auto it = children.find(ch);
-	if (it == children.end()) {
-		return nullptr;
+	for (uint32_t child = nodes[parent].firstChild; child != NO_NODE; child = nodes[child].nextSibling) {
+		const Node& node = nodes[child];
+		if (node.ch == ch) {
+			return child;
+		} else if (node.ch > ch) {
+			break;
+		}
 	}
-	return &it->second;
+	return NO_NODE;
 }
 
-WildcardTreeNode* WildcardTreeNode::addChild(char ch, bool breakpoint)
+uint32_t WildcardTree::addChild(uint32_t parent, char ch)
 {
-	WildcardTreeNode* child = getChild(ch);
-	if (child) {
-		if (breakpoint && !child->breakpoint) {
-			child->breakpoint = true;
-		}
+	uint32_t prev = NO_NODE;
+	uint32_t next = nodes[parent].firstChild;
+	while (next != NO_NODE && nodes[next].ch < ch) {
+		prev = next;
+		next = nodes[next].nextSibling;
+	}
+
+	if (next != NO_NODE && nodes[next].ch == ch) {
+		return next;
+	}
+
+	uint32_t child;
+	if (!freeNodes.empty()) {
+		child = freeNodes.back();
+		freeNodes.pop_back();
+		nodes[child] = Node();
 	} else {
-		auto pair = children.emplace(std::piecewise_construct,
-				std::forward_as_tuple(ch), std::forward_as_tuple(breakpoint));
-		child = &pair.first->second;
+		child = nodes.size();
+		nodes.emplace_back();
+	}
+
+	Node& node = nodes[child];
+	node.ch = ch;
+	node.nextSibling = next;
+
+	if (prev == NO_NODE) {
+		nodes[parent].firstChild = child;
+	} else {
+		nodes[prev].nextSibling = child;
 	}
 	return child;
 }
 
-void WildcardTreeNode::insert(const std::string& str)
+void WildcardTree::removeChild(uint32_t parent, uint32_t child)
 {
-	WildcardTreeNode* cur = this;
+	uint32_t next = nodes[child].nextSibling;
+	if (nodes[parent].firstChild == child) {
+		nodes[parent].firstChild = next;
+	} else {
+		uint32_t prev = nodes[parent].firstChild;
+		while (nodes[prev].nextSibling != child) {
+			prev = nodes[prev].nextSibling;
+		}
+		nodes[prev].nextSibling = next;
+	}
+
+	freeNodes.push_back(child);
+}
 
-	size_t length = str.length() - 1;
-	for (size_t pos = 0; pos < length; ++pos) {
-		cur = cur->addChild(str[pos], false);
+void WildcardTree::insert(const std::string& str)
+{
+	if (str.empty()) {
+		return;
 	}
 
-	cur->addChild(str[length], true);
+	uint32_t cur = 0;
+	for (char ch : str) {
+		cur = addChild(cur, ch);
+	}
+	nodes[cur].breakpoint = true;
 }
 
-void WildcardTreeNode::remove(const std::string& str)
+void WildcardTree::remove(const std::string& str)
 {
-	WildcardTreeNode* cur = this;
-
-	std::stack<WildcardTreeNode*> path;
-	path.push(cur);
-	size_t len = str.length();
-	for (size_t pos = 0; pos < len; ++pos) {
-		cur = cur->getChild(str[pos]);
-		if (!cur) {
+	std::vector<uint32_t> path;
+	path.reserve(str.length() + 1);
+	path.push_back(0);
+
+	uint32_t cur = 0;
+	for (char ch : str) {
+		cur = getChild(cur, ch);
+		if (cur == NO_NODE) {
 			return;
 		}
-		path.push(cur);
+		path.push_back(cur);
 	}
 
-	cur->breakpoint = false;
-
-	do {
-		cur = path.top();
-		path.pop();
+	nodes[cur].breakpoint = false;
 
-		if (!cur->children.empty() || cur->breakpoint || path.empty()) {
+	// drop the nodes that no longer lead to a name, the root always stays
+	while (path.size() > 1) {
+		cur = path.back();
+		const Node& node = nodes[cur];
+		if (node.firstChild != NO_NODE || node.breakpoint) {
 			break;
 		}
 
-		cur = path.top();
-
-		auto it = cur->children.find(str[--len]);
-		if (it != cur->children.end()) {
-			cur->children.erase(it);
-		}
-	} while (true);
+		path.pop_back();
+		removeChild(path.back(), cur);
+	}
 }
 
-ReturnValue WildcardTreeNode::findOne(const std::string& query, std::string& result) const
+ReturnValue WildcardTree::findOne(const std::string& query, std::string& result) const
 {
-	const WildcardTreeNode* cur = this;
-	for (char pos : query) {
-		cur = cur->getChild(pos);
-		if (!cur) {
+	uint32_t cur = 0;
+	for (char ch : query) {
+		cur = getChild(cur, ch);
+		if (cur == NO_NODE) {
 			return RETURNVALUE_PLAYERWITHTHISNAMEISNOTONLINE;
 		}
 	}
@@ -99,15 +130,17 @@ ReturnValue WildcardTreeNode::findOne(const std::string& query, std::string& res
 	result = query;
 
 	do {
-		size_t size = cur->children.size();
-		if (size == 0) {
+		const Node& node = nodes[cur];
+		if (node.firstChild == NO_NODE) {
 			return RETURNVALUE_NOERROR;
-		} else if (size > 1 || cur->breakpoint) {
+		}
+
+		const Node& child = nodes[node.firstChild];
+		if (child.nextSibling != NO_NODE || node.breakpoint) {
 			return RETURNVALUE_NAMEISTOOAMBIGUOUS;
 		}
 
-		auto it = cur->children.begin();
-		result += it->first;
-		cur = &it->second;
+		result += child.ch;
+		cur = node.firstChild;
 	} while (true);
 }
@@ -6,19 +6,16 @@
 
 #include "enums.h"
 
-class WildcardTreeNode
+// prefix tree of the online player names, the nodes live in one vector and
+// link to their first child and next sibling (siblings sorted by character)
+class WildcardTree
 {
 	public:
-		explicit WildcardTreeNode(bool breakpoint) : breakpoint(breakpoint) {}
-		WildcardTreeNode(WildcardTreeNode&& other) = default;
+		WildcardTree();
 
 		// non-copyable
-		WildcardTreeNode(const WildcardTreeNode&) = delete;
-		WildcardTreeNode& operator=(const WildcardTreeNode&) = delete;
-
-		WildcardTreeNode* getChild(char ch);
-		const WildcardTreeNode* getChild(char ch) const;
-		WildcardTreeNode* addChild(char ch, bool breakpoint);
+		WildcardTree(const WildcardTree&) = delete;
+		WildcardTree& operator=(const WildcardTree&) = delete;
 
 		void insert(const std::string& str);
 		void remove(const std::string& str);
@@ -26,8 +23,22 @@ class WildcardTreeNode
 		ReturnValue findOne(const std::string& query, std::string& result) const;
 
 	private:
-		std::map<char, WildcardTreeNode> children;
-		bool breakpoint;
+		static constexpr uint32_t NO_NODE = std::numeric_limits<uint32_t>::max();
+
+		struct Node {
+			uint32_t firstChild = NO_NODE;
+			uint32_t nextSibling = NO_NODE;
+			char ch = 0;
+			bool breakpoint = false;
+		};
+
+		uint32_t getChild(uint32_t parent, char ch) const;
+		uint32_t addChild(uint32_t parent, char ch);
+		void removeChild(uint32_t parent, uint32_t child);
+
+		// nodes[0] is the root, released nodes are reused before the vector grows
+		std::vector<Node> nodes;
+		std::vector<uint32_t> freeNodes;
 };
 
 #endif
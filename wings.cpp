@@ -8,6 +8,7 @@
 bool Wings::reload()
 {
 	wings.clear();
+	wingIndex.fill(0);
 	return loadFromXml();
 }
 
@@ -28,6 +29,11 @@ bool Wings::loadFromXml()
 			pugi::cast<int32_t>(wingNode.attribute("speed").value()),
 			wingNode.attribute("premium").as_bool()
 		);
+
+		uint16_t& index = wingIndex[wings.back().id];
+		if (index == 0) {
+			index = static_cast<uint16_t>(wings.size());
+		}
 	}
 	wings.shrink_to_fit();
 	return true;
@@ -35,11 +41,8 @@ bool Wings::loadFromXml()
 
 Wing* Wings::getWingByID(uint8_t id)
 {
-	auto it = std::find_if(wings.begin(), wings.end(), [id](const Wing& wing) {
-		return wing.id == id;
-	});
-
-	return it != wings.end() ? &*it : nullptr;
+	uint16_t index = wingIndex[id];
+	return index != 0 ? &wings[index - 1] : nullptr;
 }
 
 Wing* Wings::getWingByName(const std::string& name) {
@@ -28,6 +28,8 @@ class Wings
 
 	private:
 		std::vector<Wing> wings;
+		// position + 1 in wings for every id, 0 when unused
+		std::array<uint16_t, std::numeric_limits<uint8_t>::max() + 1> wingIndex = {};
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,111 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#ifndef FS_WORDTRIE_H_5F0A8C2E6B1D4E7396C4A2F81D0B3E57
+#define FS_WORDTRIE_H_5F0A8C2E6B1D4E7396C4A2F81D0B3E57
+
+#include <cctype>
+#include <string_view>
+#include <vector>
+
+// Case-insensitive prefix tree from words to values, so the words a text
+// starts with are found in one pass over it. The nodes live in one vector
+// and link to their first child and next sibling like the WildcardTree.
+// The first value inserted under a word is kept.
+template <typename T>
+class WordTrie
+{
+	public:
+		WordTrie() : nodes(1) {}
+
+		void clear() {
+			nodes.assign(1, Node());
+		}
+
+		// false when the word already has a value
+		bool insert(std::string_view words, T* value) {
+			uint32_t node = 0;
+			for (char ch : words) {
+				node = addChild(node, lower(ch));
+			}
+
+			if (nodes[node].value) {
+				return false;
+			}
+			nodes[node].value = value;
+			return true;
+		}
+
+		// calls f(value, length) for the words text starts with, shortest
+		// first, until f returns true
+		template <typename F>
+		void forEachPrefix(std::string_view text, F&& f) const {
+			uint32_t node = 0;
+			for (size_t length = 0; length < text.size(); ) {
+				node = getChild(node, lower(text[length]));
+				if (node == NO_NODE) {
+					return;
+				}
+
+				++length;
+				if (nodes[node].value && f(nodes[node].value, length)) {
+					return;
+				}
+			}
+		}
+
+	private:
+		static constexpr uint32_t NO_NODE = std::numeric_limits<uint32_t>::max();
+
+		struct Node {
+			T* value = nullptr;
+			uint32_t firstChild = NO_NODE;
+			uint32_t nextSibling = NO_NODE;
+			char ch = 0;
+		};
+
+		static char lower(char ch) {
+			return static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+		}
+
+		uint32_t getChild(uint32_t parent, char ch) const {
+			for (uint32_t child = nodes[parent].firstChild; child != NO_NODE; child = nodes[child].nextSibling) {
+				if (nodes[child].ch == ch) {
+					return child;
+				} else if (nodes[child].ch > ch) {
+					break;
+				}
+			}
+			return NO_NODE;
+		}
+
+		uint32_t addChild(uint32_t parent, char ch) {
+			uint32_t prev = NO_NODE;
+			uint32_t next = nodes[parent].firstChild;
+			while (next != NO_NODE && nodes[next].ch < ch) {
+				prev = next;
+				next = nodes[next].nextSibling;
+			}
+
+			if (next != NO_NODE && nodes[next].ch == ch) {
+				return next;
+			}
+
+			uint32_t child = nodes.size();
+			nodes.emplace_back();
+			nodes[child].ch = ch;
+			nodes[child].nextSibling = next;
+
+			if (prev == NO_NODE) {
+				nodes[parent].firstChild = child;
+			} else {
+				nodes[prev].nextSibling = child;
+			}
+			return child;
+		}
+
+		// nodes[0] is the root
+		std::vector<Node> nodes;
+};
+
+#endif
@@ -0,0 +1,123 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#include "otpch.h"
+
+#include "workerpool.h"
+
+WorkerPool g_workerPool;
+
+namespace {
+
+thread_local size_t currentWorker = 0;
+
+}
+
+void WorkerPool::start(size_t threadCount)
+{
+	threads.reserve(threadCount);
+	for (size_t i = 0; i < threadCount; ++i) {
+		threads.emplace_back(&WorkerPool::threadMain, this, i + 1);
+	}
+}
+
+size_t WorkerPool::getCurrentWorker()
+{
+	return currentWorker;
+}
+
+void WorkerPool::parallelForStartup(size_t count, const std::function<void(size_t)>& job)
+{
+	std::atomic<size_t> next{0};
+	auto run = [&]() {
+		size_t i;
+		while ((i = next.fetch_add(1, std::memory_order_relaxed)) < count) {
+			job(i);
+		}
+	};
+
+	size_t threadCount = std::min<size_t>(std::max<unsigned>(1, std::thread::hardware_concurrency()), count);
+	std::vector<std::thread> helpers;
+	helpers.reserve(threadCount > 0 ? threadCount - 1 : 0);
+	for (size_t i = 1; i < threadCount; ++i) {
+		helpers.emplace_back(run);
+	}
+
+	run();
+
+	for (std::thread& helper : helpers) {
+		helper.join();
+	}
+}
+
+void WorkerPool::shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lockClass(poolLock);
+		stopping = true;
+	}
+	workSignal.notify_all();
+
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+	threads.clear();
+}
+
+void WorkerPool::parallelFor(size_t count, const std::function<void(size_t)>& job)
+{
+	if (threads.empty() || count <= 1) {
+		for (size_t i = 0; i < count; ++i) {
+			job(i);
+		}
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lockClass(poolLock);
+		this->job = &job;
+		jobCount = count;
+		nextJob.store(0, std::memory_order_relaxed);
+		busyWorkers = threads.size();
+		++generation;
+	}
+	workSignal.notify_all();
+
+	runJobs();
+
+	std::unique_lock<std::mutex> lockClass(poolLock);
+	doneSignal.wait(lockClass, [this]() { return busyWorkers == 0; });
+	this->job = nullptr;
+}
+
+void WorkerPool::threadMain(size_t index)
+{
+	currentWorker = index;
+	uint64_t lastGeneration = 0;
+
+	std::unique_lock<std::mutex> lockClass(poolLock);
+	while (true) {
+		workSignal.wait(lockClass, [&]() { return stopping || generation != lastGeneration; });
+		if (stopping) {
+			break;
+		}
+
+		lastGeneration = generation;
+		lockClass.unlock();
+
+		runJobs();
+
+		lockClass.lock();
+		if (--busyWorkers == 0) {
+			doneSignal.notify_one();
+		}
+	}
+}
+
+void WorkerPool::runJobs()
+{
+	size_t i;
+	while ((i = nextJob.fetch_add(1, std::memory_order_relaxed)) < jobCount) {
+		(*job)(i);
+	}
+}
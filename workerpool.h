@@ -0,0 +1,60 @@
+// Copyright 2022 The Forgotten Server Authors. All rights reserved.
+// Use of this source code is governed by the GPL-2.0 License that can be found in the LICENSE file.
+
+#ifndef FS_WORKERPOOL_H_3D8E5A1C7B2F4E9A8D6C0B1A2F3E4D5C
+#define FS_WORKERPOOL_H_3D8E5A1C7B2F4E9A8D6C0B1A2F3E4D5C
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <thread>
+
+// Helper threads for read-only work of the dispatcher thread, the world is
+// not modified while a parallelFor is running.
+class WorkerPool
+{
+	public:
+		WorkerPool() = default;
+
+		// non-copyable
+		WorkerPool(const WorkerPool&) = delete;
+		WorkerPool& operator=(const WorkerPool&) = delete;
+
+		void start(size_t threadCount);
+		void shutdown();
+
+		size_t getThreadCount() const {
+			return threads.size();
+		}
+
+		// runs job(i) for every i < count on the workers and the calling thread
+		// and returns once all of them finished
+		void parallelFor(size_t count, const std::function<void(size_t)>& job);
+
+		// 1 to getThreadCount() on the workers, 0 on every other thread
+		static size_t getCurrentWorker();
+
+		// parallelFor on short lived threads, one per hardware thread, for the
+		// loading done before the pool is started
+		static void parallelForStartup(size_t count, const std::function<void(size_t)>& job);
+
+	private:
+		void threadMain(size_t index);
+		void runJobs();
+
+		std::vector<std::thread> threads;
+		std::mutex poolLock;
+		std::condition_variable workSignal;
+		std::condition_variable doneSignal;
+
+		const std::function<void(size_t)>* job = nullptr;
+		size_t jobCount = 0;
+		std::atomic<size_t> nextJob{0};
+		size_t busyWorkers = 0;
+		uint64_t generation = 0;
+		bool stopping = false;
+};
+
+extern WorkerPool g_workerPool;
+
+#endif
@@ -8,8 +8,232 @@
 #include <array>
 #include <assert.h>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define XTEA_SSE2
+#include <emmintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define XTEA_AVX2
+#include <immintrin.h>
+#endif
+#elif defined(__ARM_NEON)
+#define XTEA_NEON
+#include <arm_neon.h>
+#endif
+
 namespace xtea {
 
+namespace {
+
+constexpr size_t BLOCK_SIZE = 8;
+
+// every block runs all rounds in registers before moving to the next one
+void encryptScalar(uint8_t* data, size_t length, const round_keys& k)
+{
+	for (auto it = data, last = data + length; it < last; it += BLOCK_SIZE) {
+		uint32_t left, right;
+		std::memcpy(&left, it, 4);
+		std::memcpy(&right, it + 4, 4);
+
+		for (size_t i = 0; i < k.size(); i += 2) {
+			left += ((right << 4 ^ right >> 5) + right) ^ k[i];
+			right += ((left << 4 ^ left >> 5) + left) ^ k[i + 1];
+		}
+
+		std::memcpy(it, &left, 4);
+		std::memcpy(it + 4, &right, 4);
+	}
+}
+
+void decryptScalar(uint8_t* data, size_t length, const round_keys& k)
+{
+	for (auto it = data, last = data + length; it < last; it += BLOCK_SIZE) {
+		uint32_t left, right;
+		std::memcpy(&left, it, 4);
+		std::memcpy(&right, it + 4, 4);
+
+		for (size_t i = k.size(); i > 0; i -= 2) {
+			right -= ((left << 4 ^ left >> 5) + left) ^ k[i - 1];
+			left -= ((right << 4 ^ right >> 5) + right) ^ k[i - 2];
+		}
+
+		std::memcpy(it, &left, 4);
+		std::memcpy(it + 4, &right, 4);
+	}
+}
+
+#if defined(XTEA_SSE2)
+
+// 4 blocks at a time, the lanes hold the left and right halves of each block
+inline __m128i mix(__m128i v)
+{
+	return _mm_add_epi32(_mm_xor_si128(_mm_slli_epi32(v, 4), _mm_srli_epi32(v, 5)), v);
+}
+
+size_t encryptSSE2(uint8_t* data, size_t length, const round_keys& k)
+{
+	size_t processed = length & ~size_t(4 * BLOCK_SIZE - 1);
+	for (size_t offset = 0; offset < processed; offset += 4 * BLOCK_SIZE) {
+		__m128 a = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + offset)));
+		__m128 b = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + offset + 16)));
+		__m128i left = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+		__m128i right = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+
+		for (size_t i = 0; i < k.size(); i += 2) {
+			left = _mm_add_epi32(left, _mm_xor_si128(mix(right), _mm_set1_epi32(k[i])));
+			right = _mm_add_epi32(right, _mm_xor_si128(mix(left), _mm_set1_epi32(k[i + 1])));
+		}
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(data + offset), _mm_unpacklo_epi32(left, right));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(data + offset + 16), _mm_unpackhi_epi32(left, right));
+	}
+	return processed;
+}
+
+size_t decryptSSE2(uint8_t* data, size_t length, const round_keys& k)
+{
+	size_t processed = length & ~size_t(4 * BLOCK_SIZE - 1);
+	for (size_t offset = 0; offset < processed; offset += 4 * BLOCK_SIZE) {
+		__m128 a = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + offset)));
+		__m128 b = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + offset + 16)));
+		__m128i left = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+		__m128i right = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+
+		for (size_t i = k.size(); i > 0; i -= 2) {
+			right = _mm_sub_epi32(right, _mm_xor_si128(mix(left), _mm_set1_epi32(k[i - 1])));
+			left = _mm_sub_epi32(left, _mm_xor_si128(mix(right), _mm_set1_epi32(k[i - 2])));
+		}
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(data + offset), _mm_unpacklo_epi32(left, right));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(data + offset + 16), _mm_unpackhi_epi32(left, right));
+	}
+	return processed;
+}
+
+#endif
+
+#if defined(XTEA_AVX2)
+
+// 8 blocks at a time, the shuffles work per 128-bit lane so the block order
+// inside the registers differs from memory but the unpacks restore it
+__attribute__((target("avx2"))) inline __m256i mix(__m256i v)
+{
+	return _mm256_add_epi32(_mm256_xor_si256(_mm256_slli_epi32(v, 4), _mm256_srli_epi32(v, 5)), v);
+}
+
+__attribute__((target("avx2"))) size_t encryptAVX2(uint8_t* data, size_t length, const round_keys& k)
+{
+	size_t processed = length & ~size_t(8 * BLOCK_SIZE - 1);
+	for (size_t offset = 0; offset < processed; offset += 8 * BLOCK_SIZE) {
+		__m256 a = _mm256_castsi256_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + offset)));
+		__m256 b = _mm256_castsi256_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + offset + 32)));
+		__m256i left = _mm256_castps_si256(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+		__m256i right = _mm256_castps_si256(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+
+		for (size_t i = 0; i < k.size(); i += 2) {
+			left = _mm256_add_epi32(left, _mm256_xor_si256(mix(right), _mm256_set1_epi32(k[i])));
+			right = _mm256_add_epi32(right, _mm256_xor_si256(mix(left), _mm256_set1_epi32(k[i + 1])));
+		}
+
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(data + offset), _mm256_unpacklo_epi32(left, right));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(data + offset + 32), _mm256_unpackhi_epi32(left, right));
+	}
+	return processed;
+}
+
+__attribute__((target("avx2"))) size_t decryptAVX2(uint8_t* data, size_t length, const round_keys& k)
+{
+	size_t processed = length & ~size_t(8 * BLOCK_SIZE - 1);
+	for (size_t offset = 0; offset < processed; offset += 8 * BLOCK_SIZE) {
+		__m256 a = _mm256_castsi256_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + offset)));
+		__m256 b = _mm256_castsi256_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + offset + 32)));
+		__m256i left = _mm256_castps_si256(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+		__m256i right = _mm256_castps_si256(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+
+		for (size_t i = k.size(); i > 0; i -= 2) {
+			right = _mm256_sub_epi32(right, _mm256_xor_si256(mix(left), _mm256_set1_epi32(k[i - 1])));
+			left = _mm256_sub_epi32(left, _mm256_xor_si256(mix(right), _mm256_set1_epi32(k[i - 2])));
+		}
+
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(data + offset), _mm256_unpacklo_epi32(left, right));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(data + offset + 32), _mm256_unpackhi_epi32(left, right));
+	}
+	return processed;
+}
+
+#endif
+
+#if defined(XTEA_NEON)
+
+inline uint32x4_t mix(uint32x4_t v)
+{
+	return vaddq_u32(veorq_u32(vshlq_n_u32(v, 4), vshrq_n_u32(v, 5)), v);
+}
+
+// vld2q splits 4 blocks into their left and right halves directly
+size_t encryptNEON(uint8_t* data, size_t length, const round_keys& k)
+{
+	size_t processed = length & ~size_t(4 * BLOCK_SIZE - 1);
+	for (size_t offset = 0; offset < processed; offset += 4 * BLOCK_SIZE) {
+		uint32x4x2_t v = vld2q_u32(reinterpret_cast<const uint32_t*>(data + offset));
+		for (size_t i = 0; i < k.size(); i += 2) {
+			v.val[0] = vaddq_u32(v.val[0], veorq_u32(mix(v.val[1]), vdupq_n_u32(k[i])));
+			v.val[1] = vaddq_u32(v.val[1], veorq_u32(mix(v.val[0]), vdupq_n_u32(k[i + 1])));
+		}
+		vst2q_u32(reinterpret_cast<uint32_t*>(data + offset), v);
+	}
+	return processed;
+}
+
+size_t decryptNEON(uint8_t* data, size_t length, const round_keys& k)
+{
+	size_t processed = length & ~size_t(4 * BLOCK_SIZE - 1);
+	for (size_t offset = 0; offset < processed; offset += 4 * BLOCK_SIZE) {
+		uint32x4x2_t v = vld2q_u32(reinterpret_cast<const uint32_t*>(data + offset));
+		for (size_t i = k.size(); i > 0; i -= 2) {
+			v.val[1] = vsubq_u32(v.val[1], veorq_u32(mix(v.val[0]), vdupq_n_u32(k[i - 1])));
+			v.val[0] = vsubq_u32(v.val[0], veorq_u32(mix(v.val[1]), vdupq_n_u32(k[i - 2])));
+		}
+		vst2q_u32(reinterpret_cast<uint32_t*>(data + offset), v);
+	}
+	return processed;
+}
+
+#endif
+
+using Kernel = size_t (*)(uint8_t* data, size_t length, const round_keys& k);
+
+struct Kernels
+{
+	Kernel encrypt = nullptr;
+	Kernel decrypt = nullptr;
+};
+
+// picked once from the features of the running cpu
+Kernels selectKernels()
+{
+	Kernels kernels;
+#if defined(XTEA_AVX2)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		kernels.encrypt = encryptAVX2;
+		kernels.decrypt = decryptAVX2;
+		return kernels;
+	}
+#endif
+#if defined(XTEA_SSE2)
+	kernels.encrypt = encryptSSE2;
+	kernels.decrypt = decryptSSE2;
+#elif defined(XTEA_NEON)
+	kernels.encrypt = encryptNEON;
+	kernels.decrypt = decryptNEON;
+#endif
+	return kernels;
+}
+
+const Kernels kernels = selectKernels();
+
+} // namespace
+
 round_keys expand_key(const key& k)
 {
 	constexpr uint32_t delta = 0x9E3779B9;
@@ -25,36 +249,20 @@ round_keys expand_key(const key& k)
 
 void encrypt(uint8_t* data, size_t length, const round_keys& k)
 {
-	for (int32_t i = 0; i < k.size(); i += 2) {
-		for (auto it = data, last = data + length; it < last; it += 8) {
-			uint32_t left, right;
-			std::memcpy(&left, it, 4);
-			std::memcpy(&right, it + 4, 4);
-
-			left += ((right << 4 ^ right >> 5) + right) ^ k[i];
-			right += ((left << 4 ^ left >> 5) + left) ^ k[i + 1];
-
-			std::memcpy(it, &left, 4);
-			std::memcpy(it + 4, &right, 4);
-		}
+	size_t processed = 0;
+	if (kernels.encrypt) {
+		processed = kernels.encrypt(data, length, k);
 	}
+	encryptScalar(data + processed, length - processed, k);
 }
 
 void decrypt(uint8_t* data, size_t length, const round_keys& k)
 {
-	for (int32_t i = k.size() - 1; i > 0; i -= 2) {
-		for (auto it = data, last = data + length; it < last; it += 8) {
-			uint32_t left, right;
-			std::memcpy(&left, it, 4);
-			std::memcpy(&right, it + 4, 4);
-
-			right -= ((left << 4 ^ left >> 5) + left) ^ k[i];
-			left -= ((right << 4 ^ right >> 5) + right) ^ k[i - 1];
-
-			std::memcpy(it, &left, 4);
-			std::memcpy(it + 4, &right, 4);
-		}
+	size_t processed = 0;
+	if (kernels.decrypt) {
+		processed = kernels.decrypt(data, length, k);
 	}
+	decryptScalar(data + processed, length - processed, k);
 }
 
 } // namespace xtea